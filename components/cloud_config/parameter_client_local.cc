@@ -47,6 +47,61 @@ ABSL_FLAG(int32_t, num_shards, 1, "Total number of shards.");
 ABSL_FLAG(int32_t, udf_num_workers, 2, "Number of workers for UDF execution.");
 ABSL_FLAG(bool, route_v1_to_v2, false,
           "Whether to route V1 requests through V2.");
+ABSL_FLAG(int32_t, data_loading_max_threads, 0,
+          "Number of threads shared by all the readers of data files, which "
+          "split files into smaller shards that free threads take over. Each "
+          "file is still read by at most data_loading_num_threads threads, "
+          "including the thread loading it. Zero reads each shard on a thread "
+          "of its own instead, which doesn't bound the threads of concurrent "
+          "loads.");
+ABSL_FLAG(int32_t, cache_num_stripes, 1,
+          "Number of independently locked stripes the key value cache is "
+          "split into. Values greater than 1 enable the lock-striped cache.");
+ABSL_FLAG(bool, cache_lock_free_reads, false,
+          "Whether key value lookups use the epoch-based cache whose readers "
+          "never take a lock.");
+ABSL_FLAG(bool, cache_slab_storage, false,
+          "Whether key value pairs are stored in large slabs instead of one "
+          "allocation per key and value. Reduces the memory footprint of "
+          "caches with many small entries.");
+ABSL_FLAG(absl::Duration, cache_slab_compaction_interval, absl::Minutes(1),
+          "How often space left by overwritten and deleted values is "
+          "reclaimed when cache_slab_storage is set.");
+ABSL_FLAG(absl::Duration, cache_tombstone_compaction_interval,
+          absl::Seconds(30),
+          "How often the tombstones of deleted keys and set values are "
+          "removed from the cache by a background thread. Zero removes them "
+          "at the end of each data file load instead.");
+ABSL_FLAG(int64_t, cache_memory_budget_bytes, 0,
+          "Approximate number of bytes the cache may hold. Data files aren't "
+          "loaded past it, and are retried once memory is released. Zero "
+          "means unlimited.");
+ABSL_FLAG(bool, cache_swap_on_load, false,
+          "Whether data is loaded at startup into a fresh cache instance, "
+          "which replaces the serving one once it has caught up with the "
+          "deltas.");
+ABSL_FLAG(std::string, cache_image_path, "",
+          "Local file the cache is periodically written to, and loaded from "
+          "at startup instead of the latest snapshot. Empty disables it.");
+ABSL_FLAG(absl::Duration, cache_image_interval, absl::Hours(1),
+          "How often the cache is written to cache_image_path.");
+ABSL_FLAG(std::string, cache_base_path, "",
+          "Local file the key-value pairs of the latest snapshot are kept in, "
+          "memory mapped, with later updates held in a small in-memory "
+          "overlay. Empty disables it.");
+ABSL_FLAG(bool, cache_partition_by_namespace, false,
+          "Whether the cache keeps the key-value pairs of each key namespace "
+          "in a separate, independently locked partition.");
+ABSL_FLAG(int32_t, cache_compression_threshold_bytes, 0,
+          "Values of at least this many bytes are compressed in the cache. "
+          "Zero disables compression.");
+ABSL_FLAG(int64_t, cache_decompressed_values_bytes, 16 << 20,
+          "Bytes of recently read compressed values kept decompressed, when "
+          "cache_compression_threshold_bytes is set.");
+ABSL_FLAG(int32_t, cache_key_filter_expected_keys, 0,
+          "Number of keys a Bloom filter of the keys loaded is sized for. "
+          "Lookups of keys it rules out skip the cache. Zero disables the "
+          "filter.");
 
 // TODO(b/299623229): Remove GCP parameters here once the GCP parameter client
 // supports local instance.
@@ -85,6 +140,17 @@ class LocalParameterClient : public ParameterClient {
         {"kv-server-local-launch-hook", absl::GetFlag(FLAGS_launch_hook)});
     string_flag_values_.insert({"kv-server-local-realtime-directory",
                                 absl::GetFlag(FLAGS_realtime_directory)});
+    string_flag_values_.insert({"kv-server-local-cache-image-path",
+                                absl::GetFlag(FLAGS_cache_image_path)});
+    string_flag_values_.insert({"kv-server-local-cache-base-path",
+                                absl::GetFlag(FLAGS_cache_base_path)});
+    // 64-bit parameters are stored as strings.
+    string_flag_values_.insert(
+        {"kv-server-local-cache-memory-budget-bytes",
+         absl::StrCat(absl::GetFlag(FLAGS_cache_memory_budget_bytes))});
+    string_flag_values_.insert(
+        {"kv-server-local-cache-decompressed-values-bytes",
+         absl::StrCat(absl::GetFlag(FLAGS_cache_decompressed_values_bytes))});
     // Insert more string flag values here.
 
     int32_t_flag_values_.insert(
@@ -112,12 +178,49 @@ class LocalParameterClient : public ParameterClient {
         {"kv-server-local-num-shards", absl::GetFlag(FLAGS_num_shards)});
     int32_t_flag_values_.insert({"kv-server-local-udf-num-workers",
                                  absl::GetFlag(FLAGS_udf_num_workers)});
+    int32_t_flag_values_.insert(
+        {"kv-server-local-data-loading-max-threads",
+         absl::GetFlag(FLAGS_data_loading_max_threads)});
+    int32_t_flag_values_.insert({"kv-server-local-cache-num-stripes",
+                                 absl::GetFlag(FLAGS_cache_num_stripes)});
+    int32_t_flag_values_.insert(
+        {"kv-server-local-cache-slab-compaction-interval-secs",
+         absl::ToInt64Seconds(
+             absl::GetFlag(FLAGS_cache_slab_compaction_interval))});
+    int32_t_flag_values_.insert(
+        {"kv-server-local-cache-tombstone-compaction-interval-secs",
+         absl::ToInt64Seconds(
+             absl::GetFlag(FLAGS_cache_tombstone_compaction_interval))});
+    // The image is disabled by its interval rather than its path.
+    int32_t_flag_values_.insert(
+        {"kv-server-local-cache-image-interval-secs",
+         absl::GetFlag(FLAGS_cache_image_path).empty()
+             ? 0
+             : absl::ToInt64Seconds(
+                   absl::GetFlag(FLAGS_cache_image_interval))});
+    int32_t_flag_values_.insert(
+        {"kv-server-local-cache-compression-threshold-bytes",
+         absl::GetFlag(FLAGS_cache_compression_threshold_bytes)});
+    int32_t_flag_values_.insert(
+        {"kv-server-local-cache-key-filter-expected-keys",
+         absl::GetFlag(FLAGS_cache_key_filter_expected_keys)});
     // Insert more int32 flag values here.
     bool_flag_values_.insert({"kv-server-local-route-v1-to-v2",
                               absl::GetFlag(FLAGS_route_v1_to_v2)});
     bool_flag_values_.insert({"kv-server-local-use-real-coordinators", false});
     bool_flag_values_.insert(
         {"kv-server-local-use-external-metrics-collector-endpoint", false});
+    bool_flag_values_.insert({"kv-server-local-cache-lock-free-reads",
+                              absl::GetFlag(FLAGS_cache_lock_free_reads)});
+    bool_flag_values_.insert({"kv-server-local-cache-slab-storage",
+                              absl::GetFlag(FLAGS_cache_slab_storage)});
+    bool_flag_values_.insert({"kv-server-local-cache-swap-on-load",
+                              absl::GetFlag(FLAGS_cache_swap_on_load)});
+    bool_flag_values_.insert({"kv-server-local-cache-use-snapshot-base",
+                              !absl::GetFlag(FLAGS_cache_base_path).empty()});
+    bool_flag_values_.insert(
+        {"kv-server-local-cache-partition-by-namespace",
+         absl::GetFlag(FLAGS_cache_partition_by_namespace)});
     // Insert more bool flag values here.
   }
 
@@ -116,6 +116,102 @@ TEST(ParameterClientLocal, ExpectedFlagDefaultsArePresent) {
     ASSERT_TRUE(statusor.ok());
     EXPECT_EQ(false, *statusor);
   }
+  {
+    const auto statusor =
+        client->GetInt32Parameter("kv-server-local-data-loading-max-threads");
+    ASSERT_TRUE(statusor.ok());
+    EXPECT_EQ(0, *statusor);
+  }
+  {
+    const auto statusor =
+        client->GetInt32Parameter("kv-server-local-cache-num-stripes");
+    ASSERT_TRUE(statusor.ok());
+    EXPECT_EQ(1, *statusor);
+  }
+  {
+    const auto statusor = client->GetInt32Parameter(
+        "kv-server-local-cache-slab-compaction-interval-secs");
+    ASSERT_TRUE(statusor.ok());
+    EXPECT_EQ(60, *statusor);
+  }
+  {
+    const auto statusor = client->GetInt32Parameter(
+        "kv-server-local-cache-tombstone-compaction-interval-secs");
+    ASSERT_TRUE(statusor.ok());
+    EXPECT_EQ(30, *statusor);
+  }
+  {
+    const auto statusor =
+        client->GetParameter("kv-server-local-cache-memory-budget-bytes");
+    ASSERT_TRUE(statusor.ok());
+    EXPECT_EQ("0", *statusor);
+  }
+  {
+    const auto statusor =
+        client->GetInt32Parameter("kv-server-local-cache-image-interval-secs");
+    ASSERT_TRUE(statusor.ok());
+    EXPECT_EQ(0, *statusor);
+  }
+  {
+    const auto statusor = client->GetInt32Parameter(
+        "kv-server-local-cache-compression-threshold-bytes");
+    ASSERT_TRUE(statusor.ok());
+    EXPECT_EQ(0, *statusor);
+  }
+  {
+    const auto statusor =
+        client->GetParameter("kv-server-local-cache-decompressed-values-bytes");
+    ASSERT_TRUE(statusor.ok());
+    EXPECT_EQ("16777216", *statusor);
+  }
+  {
+    const auto statusor = client->GetInt32Parameter(
+        "kv-server-local-cache-key-filter-expected-keys");
+    ASSERT_TRUE(statusor.ok());
+    EXPECT_EQ(0, *statusor);
+  }
+  {
+    const auto statusor =
+        client->GetBoolParameter("kv-server-local-cache-lock-free-reads");
+    ASSERT_TRUE(statusor.ok());
+    EXPECT_EQ(false, *statusor);
+  }
+  {
+    const auto statusor =
+        client->GetBoolParameter("kv-server-local-cache-slab-storage");
+    ASSERT_TRUE(statusor.ok());
+    EXPECT_EQ(false, *statusor);
+  }
+  {
+    const auto statusor =
+        client->GetBoolParameter("kv-server-local-cache-swap-on-load");
+    ASSERT_TRUE(statusor.ok());
+    EXPECT_EQ(false, *statusor);
+  }
+  {
+    const auto statusor =
+        client->GetBoolParameter("kv-server-local-cache-use-snapshot-base");
+    ASSERT_TRUE(statusor.ok());
+    EXPECT_EQ(false, *statusor);
+  }
+  {
+    const auto statusor = client->GetBoolParameter(
+        "kv-server-local-cache-partition-by-namespace");
+    ASSERT_TRUE(statusor.ok());
+    EXPECT_EQ(false, *statusor);
+  }
+  {
+    const auto statusor =
+        client->GetParameter("kv-server-local-cache-image-path");
+    ASSERT_TRUE(statusor.ok());
+    EXPECT_EQ("", *statusor);
+  }
+  {
+    const auto statusor =
+        client->GetParameter("kv-server-local-cache-base-path");
+    ASSERT_TRUE(statusor.ok());
+    EXPECT_EQ("", *statusor);
+  }
 }
 
 }  // namespace
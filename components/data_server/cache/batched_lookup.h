@@ -0,0 +1,97 @@
+/*
+ * Copyright 2023 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef COMPONENTS_DATA_SERVER_CACHE_BATCHED_LOOKUP_H_
+#define COMPONENTS_DATA_SERVER_CACHE_BATCHED_LOOKUP_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "absl/types/span.h"
+
+namespace kv_server {
+
+// Looks up a batch of keys in an absl hash map keyed by strings.
+//
+// Probing keys one at a time stalls on a cache miss for almost every key of
+// a large map. The keys are instead deduplicated and hashed up front, which
+// doesn't touch the map and so can be done before locking it, and the
+// buckets of the next keys are prefetched while a key is probed, so that
+// the misses of consecutive probes overlap.
+template <typename Map>
+class BatchedLookup {
+ public:
+  explicit BatchedLookup(absl::Span<const std::string_view> keys) {
+    keys_.reserve(keys.size());
+    hashes_.reserve(keys.size());
+    // Duplicates are collapsed with an open-addressed table of indexes into
+    // `keys_`, plus one, probed with the hashes, so that keys aren't hashed
+    // again.
+    size_t capacity = 1;
+    while (capacity < 2 * keys.size()) {
+      capacity <<= 1;
+    }
+    std::vector<uint32_t> slots(capacity, 0);
+    for (std::string_view key : keys) {
+      const size_t hash = typename Map::hasher{}(key);
+      size_t pos = hash & (capacity - 1);
+      for (; slots[pos] != 0; pos = (pos + 1) & (capacity - 1)) {
+        const uint32_t i = slots[pos] - 1;
+        if (hashes_[i] == hash && keys_[i] == key) {
+          break;
+        }
+      }
+      if (slots[pos] == 0) {
+        slots[pos] = keys_.size() + 1;
+        keys_.push_back(key);
+        hashes_.push_back(hash);
+      }
+    }
+  }
+
+  // Returns the distinct keys, in the order of their first occurrence.
+  const std::vector<std::string_view>& keys() const { return keys_; }
+
+  // Returns the entry of `keys()[i]` in `map`, or `map.end()`. Keys are
+  // found in order, from the first one, so that the next ones are
+  // prefetched.
+  typename Map::const_iterator Find(const Map& map, size_t i) const {
+    if (i == 0) {
+      for (size_t j = 0; j < std::min(keys_.size(), kPrefetchDistance); ++j) {
+        map.prefetch(keys_[j]);
+      }
+    }
+    if (i + kPrefetchDistance < keys_.size()) {
+      map.prefetch(keys_[i + kPrefetchDistance]);
+    }
+    return map.find(keys_[i], hashes_[i]);
+  }
+
+ private:
+  // Keys prefetched ahead of the probed one. Enough to cover the latency of
+  // a miss, without evicting the buckets before they're probed.
+  static constexpr size_t kPrefetchDistance = 8;
+
+  std::vector<std::string_view> keys_;
+  std::vector<size_t> hashes_;
+};
+
+}  // namespace kv_server
+
+#endif  // COMPONENTS_DATA_SERVER_CACHE_BATCHED_LOOKUP_H_
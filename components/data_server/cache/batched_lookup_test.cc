@@ -0,0 +1,77 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "components/data_server/cache/batched_lookup.h"
+
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/strings/str_cat.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace kv_server {
+namespace {
+
+using Map = absl::flat_hash_map<std::string, int>;
+using testing::ElementsAre;
+using testing::IsEmpty;
+using testing::Pair;
+
+std::vector<std::pair<std::string_view, int>> FindAll(
+    const Map& map, const BatchedLookup<Map>& lookup) {
+  std::vector<std::pair<std::string_view, int>> found;
+  for (size_t i = 0; i < lookup.keys().size(); ++i) {
+    if (const auto it = lookup.Find(map, i); it != map.end()) {
+      found.emplace_back(lookup.keys()[i], it->second);
+    }
+  }
+  return found;
+}
+
+TEST(BatchedLookupTest, FindsKeysInOrder) {
+  const Map map = {{"a", 1}, {"b", 2}, {"c", 3}};
+  EXPECT_THAT(FindAll(map, BatchedLookup<Map>({"c", "missing", "a"})),
+              ElementsAre(Pair("c", 3), Pair("a", 1)));
+  EXPECT_THAT(FindAll(map, BatchedLookup<Map>({})), IsEmpty());
+}
+
+TEST(BatchedLookupTest, CollapsesDuplicateKeys) {
+  const Map map = {{"a", 1}, {"b", 2}};
+  const BatchedLookup<Map> lookup({"b", "a", "b", "missing", "missing"});
+  EXPECT_THAT(lookup.keys(), ElementsAre("b", "a", "missing"));
+  EXPECT_THAT(FindAll(map, lookup), ElementsAre(Pair("b", 2), Pair("a", 1)));
+}
+
+TEST(BatchedLookupTest, FindsMoreKeysThanArePrefetched) {
+  Map map;
+  std::vector<std::string> keys;
+  for (int i = 0; i < 100; ++i) {
+    map.emplace(absl::StrCat("key", i), i);
+    keys.push_back(absl::StrCat("key", 99 - i));
+  }
+  const std::vector<std::string_view> key_views(keys.begin(), keys.end());
+  const auto found = FindAll(map, BatchedLookup<Map>(key_views));
+  ASSERT_EQ(found.size(), 100);
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_EQ(found[i].first, keys[i]);
+    EXPECT_EQ(found[i].second, 99 - i);
+  }
+}
+
+}  // namespace
+}  // namespace kv_server
@@ -17,6 +17,8 @@
 #ifndef COMPONENTS_DATA_SERVER_CACHE_CACHE_H_
 #define COMPONENTS_DATA_SERVER_CACHE_CACHE_H_
 
+#include <cstdint>
+#include <functional>
 #include <iostream>
 #include <memory>
 #include <string>
@@ -26,20 +28,124 @@
 
 #include "absl/container/flat_hash_map.h"
 #include "absl/container/flat_hash_set.h"
+#include "absl/strings/cord.h"
+#include "absl/types/span.h"
 #include "components/data_server/cache/get_key_value_set_result.h"
+#include "components/data_server/cache/value_proto.h"
+#include "public/base_types.pb.h"
 
 namespace kv_server {
 
+// Approximate number of bytes held by a cache. Only the bytes of keys, values
+// and their per-entry bookkeeping are counted, not allocator and hash table
+// overhead, so that caches can keep the counts up to date with a few
+// additions per mutation.
+struct CacheMemoryUsage {
+  // Keys of key-value pairs and key-value sets, including deleted ones.
+  int64_t key_bytes = 0;
+  // Values of key-value pairs.
+  int64_t value_bytes = 0;
+  // Live members of key-value sets.
+  int64_t set_member_bytes = 0;
+  // Strings of the interned set values.
+  int64_t interned_value_bytes = 0;
+  // Deleted keys and set values kept until they are removed by
+  // `RemoveDeletedKeys`.
+  int64_t tombstone_bytes = 0;
+  // Compressed values kept decompressed for lookups.
+  int64_t decompressed_value_bytes = 0;
+
+  CacheMemoryUsage& operator+=(const CacheMemoryUsage& other) {
+    key_bytes += other.key_bytes;
+    value_bytes += other.value_bytes;
+    set_member_bytes += other.set_member_bytes;
+    interned_value_bytes += other.interned_value_bytes;
+    tombstone_bytes += other.tombstone_bytes;
+    decompressed_value_bytes += other.decompressed_value_bytes;
+    return *this;
+  }
+
+  int64_t total_bytes() const {
+    return key_bytes + value_bytes + set_member_bytes + interned_value_bytes +
+           tombstone_bytes + decompressed_value_bytes;
+  }
+};
+
+// One update or deletion of a key-value pair or key-value set, applied to a
+// cache with `Cache::ApplyBatch`.
+struct Mutation {
+  enum class Type {
+    kUpdateKeyValue,
+    kUpdateKeyValueSet,
+    kDeleteKey,
+    kDeleteValuesInSet,
+  };
+  Type type;
+  std::string_view key;
+  // Only set for kUpdateKeyValue.
+  std::string_view value;
+  // Only set for kUpdateKeyValueSet and kDeleteValuesInSet.
+  std::vector<std::string_view> value_set;
+  int64_t logical_commit_time = 0;
+};
+
+// Contents of a cache pinned by `Cache::PinReadVersion`, for a series of
+// lookups that must not see the updates made between them. The pin is
+// released when the object is destroyed, which must happen before the cache
+// is destroyed.
+class ReadVersion {
+ public:
+  virtual ~ReadVersion() = default;
+};
+
 // Interface for in-memory datastore.
-// One cache object is only for keys in one namespace.
+// One cache object is only for keys in one namespace, unless it's split
+// into a partition per namespace, see `GetPartition`.
 class Cache {
  public:
   virtual ~Cache() = default;
 
   // Looks up and returns key-value pairs for the given keys.
-  virtual absl::flat_hash_map<std::string, std::string> GetKeyValuePairs(
+  // The returned keys are views of the strings referenced by `key_list`, and
+  // the values share the cache's immutable, reference counted buffers, so no
+  // key or value bytes are copied. The result must not outlive the strings
+  // backing `key_list`.
+  virtual absl::flat_hash_map<std::string_view, absl::Cord> GetKeyValuePairs(
       const std::vector<std::string_view>& key_list) const = 0;
 
+  // Pins the current key-value pairs of the cache for `GetKeyValuePairsAt`.
+  // Values replaced or deleted later are kept until no pinned version can
+  // see them anymore. Returns null if the cache doesn't keep versions, in
+  // which case lookups always see the latest values.
+  virtual std::unique_ptr<ReadVersion> PinReadVersion() const {
+    return nullptr;
+  }
+
+  // Like `GetKeyValuePairs`, but returns the values as of `read_version`,
+  // which must have been pinned on this cache. A null `read_version` reads
+  // the latest values.
+  virtual absl::flat_hash_map<std::string_view, absl::Cord>
+  GetKeyValuePairsAt(const std::vector<std::string_view>& key_list,
+                     const ReadVersion* read_version) const {
+    return GetKeyValuePairs(key_list);
+  }
+
+  // Like `GetKeyValuePairsAt`, but returns each value as the
+  // google.protobuf.Value it stands for in a V1 response, see
+  // `ToValueProto`. By default every value is tried as JSON. Caches that
+  // know which values are JSON documents override it, so that the others
+  // aren't parsed.
+  virtual absl::flat_hash_map<std::string_view, google::protobuf::Value>
+  GetValueProtosAt(const std::vector<std::string_view>& key_list,
+                   const ReadVersion* read_version) const {
+    absl::flat_hash_map<std::string_view, google::protobuf::Value>
+        value_protos;
+    for (auto& [key, value] : GetKeyValuePairsAt(key_list, read_version)) {
+      value_protos.emplace(key, ToValueProto(value.Flatten()));
+    }
+    return value_protos;
+  }
+
   // Looks up and returns key-value set result for the given key set.
   virtual std::unique_ptr<GetKeyValueSetResult> GetKeyValueSet(
       const absl::flat_hash_set<std::string_view>& key_set) const = 0;
@@ -64,9 +170,60 @@ class Cache {
                                  absl::Span<std::string_view> value_set,
                                  int64_t logical_commit_time) = 0;
 
+  // Applies the mutations as if the update and delete methods were called
+  // once per mutation, in order. Caches that take locks or record metrics
+  // per call should override it to do so once per batch. The mutations may
+  // be moved from.
+  virtual void ApplyBatch(absl::Span<Mutation> mutations) {
+    for (Mutation& mutation : mutations) {
+      switch (mutation.type) {
+        case Mutation::Type::kUpdateKeyValue:
+          UpdateKeyValue(mutation.key, mutation.value,
+                         mutation.logical_commit_time);
+          break;
+        case Mutation::Type::kUpdateKeyValueSet:
+          UpdateKeyValueSet(mutation.key, absl::MakeSpan(mutation.value_set),
+                            mutation.logical_commit_time);
+          break;
+        case Mutation::Type::kDeleteKey:
+          DeleteKey(mutation.key, mutation.logical_commit_time);
+          break;
+        case Mutation::Type::kDeleteValuesInSet:
+          DeleteValuesInSet(mutation.key, absl::MakeSpan(mutation.value_set),
+                            mutation.logical_commit_time);
+          break;
+      }
+    }
+  }
+
   // Removes the values that were deleted before the specified
   // logical_commit_time.
   virtual void RemoveDeletedKeys(int64_t logical_commit_time) = 0;
+
+  // Returns the approximate number of bytes held by the cache. Cheap enough
+  // to be called for every few records loaded.
+  virtual CacheMemoryUsage GetMemoryUsage() const = 0;
+
+  // Calls `callback` with mutations that rebuild the contents of the cache
+  // when applied to an empty one, including the deleted keys and set values
+  // that are kept until `RemoveDeletedKeys`. The mutations come in no
+  // particular order, and the views in them are only valid during the call.
+  // Entries are copied a bounded chunk at a time, and `callback` runs
+  // without holding the cache's locks, so updates go on meanwhile and an
+  // entry updated during the call is exported as it was when its chunk was
+  // copied.
+  virtual void ExportMutations(
+      const std::function<void(const Mutation&)>& callback) const = 0;
+
+  // Returns the partition that holds the key-value pairs of `key_namespace`,
+  // which is locked and measured on its own. Caches that aren't partitioned
+  // hold every namespace and return themselves.
+  virtual Cache& GetPartition(KeyNamespace::Enum key_namespace) {
+    return *this;
+  }
+  virtual const Cache& GetPartition(KeyNamespace::Enum key_namespace) const {
+    return *this;
+  }
 };
 
 }  // namespace kv_server
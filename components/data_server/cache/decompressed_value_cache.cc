@@ -0,0 +1,80 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "components/data_server/cache/decompressed_value_cache.h"
+
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "absl/hash/hash.h"
+
+namespace kv_server {
+
+DecompressedValueCache::DecompressedValueCache(int64_t capacity_bytes)
+    : shard_capacity_bytes_(capacity_bytes / kNumShards),
+      shards_(new Shard[kNumShards]) {}
+
+DecompressedValueCache::Shard& DecompressedValueCache::ShardFor(
+    std::string_view key) {
+  return shards_[absl::Hash<std::string_view>()(key) % kNumShards];
+}
+
+std::optional<absl::Cord> DecompressedValueCache::Get(std::string_view key,
+                                                      int64_t version) {
+  Shard& shard = ShardFor(key);
+  absl::MutexLock lock(&shard.mutex);
+  const auto it = shard.index.find(key);
+  if (it == shard.index.end() || it->second->version != version) {
+    return std::nullopt;
+  }
+  shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+  return it->second->value;
+}
+
+void DecompressedValueCache::Put(std::string_view key, int64_t version,
+                                 absl::Cord value) {
+  Entry entry{.key = std::string(key),
+              .version = version,
+              .value = std::move(value)};
+  const int64_t entry_bytes = EntryBytes(entry);
+  if (entry_bytes > shard_capacity_bytes_) {
+    return;
+  }
+  Shard& shard = ShardFor(key);
+  absl::MutexLock lock(&shard.mutex);
+  int64_t added_bytes = entry_bytes;
+  if (const auto it = shard.index.find(key); it != shard.index.end()) {
+    const int64_t replaced_bytes = EntryBytes(*it->second);
+    shard.bytes -= replaced_bytes;
+    added_bytes -= replaced_bytes;
+    shard.entries.erase(it->second);
+    shard.index.erase(it);
+  }
+  shard.entries.push_front(std::move(entry));
+  shard.index.emplace(shard.entries.front().key, shard.entries.begin());
+  shard.bytes += entry_bytes;
+  while (shard.bytes > shard_capacity_bytes_) {
+    const Entry& evicted = shard.entries.back();
+    const int64_t evicted_bytes = EntryBytes(evicted);
+    shard.bytes -= evicted_bytes;
+    added_bytes -= evicted_bytes;
+    shard.index.erase(evicted.key);
+    shard.entries.pop_back();
+  }
+  bytes_.fetch_add(added_bytes, std::memory_order_relaxed);
+}
+
+}  // namespace kv_server
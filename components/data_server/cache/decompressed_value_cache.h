@@ -0,0 +1,92 @@
+/*
+ * Copyright 2023 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef COMPONENTS_DATA_SERVER_CACHE_DECOMPRESSED_VALUE_CACHE_H_
+#define COMPONENTS_DATA_SERVER_CACHE_DECOMPRESSED_VALUE_CACHE_H_
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/strings/cord.h"
+#include "absl/synchronization/mutex.h"
+
+namespace kv_server {
+
+// Least recently used values that were decompressed for lookups, so that hot
+// values aren't decompressed again on every read. Values are identified by
+// their key and the version at which they were set, so entries of replaced
+// values are never returned and just age out.
+//
+// Split into shards with a lock each, so that concurrent lookups rarely
+// contend. Thread-safe.
+class DecompressedValueCache {
+ public:
+  // Holds up to about `capacity_bytes` of keys and values.
+  explicit DecompressedValueCache(int64_t capacity_bytes);
+
+  DecompressedValueCache(const DecompressedValueCache&) = delete;
+  DecompressedValueCache& operator=(const DecompressedValueCache&) = delete;
+
+  // Returns the value of `key` at `version`, if it's held.
+  std::optional<absl::Cord> Get(std::string_view key, int64_t version);
+
+  // Holds `value` as the value of `key` at `version`, replacing any other
+  // version, and evicts the least recently used values of the shard past
+  // its capacity. Values larger than a shard aren't held.
+  void Put(std::string_view key, int64_t version, absl::Cord value);
+
+  // Returns the bytes of the keys and values held. Doesn't take any lock.
+  int64_t bytes() const { return bytes_.load(std::memory_order_relaxed); }
+
+ private:
+  static constexpr int kNumShards = 16;
+
+  struct Entry {
+    std::string key;
+    int64_t version;
+    absl::Cord value;
+  };
+
+  struct Shard {
+    absl::Mutex mutex;
+    // Most recently used first.
+    std::list<Entry> entries ABSL_GUARDED_BY(mutex);
+    // Keys are views of the keys in `entries`, whose nodes never move.
+    absl::flat_hash_map<std::string_view, std::list<Entry>::iterator> index
+        ABSL_GUARDED_BY(mutex);
+    int64_t bytes ABSL_GUARDED_BY(mutex) = 0;
+  };
+
+  static int64_t EntryBytes(const Entry& entry) {
+    return entry.key.size() + entry.value.size();
+  }
+
+  Shard& ShardFor(std::string_view key);
+
+  const int64_t shard_capacity_bytes_;
+  std::unique_ptr<Shard[]> shards_;
+  std::atomic<int64_t> bytes_ = 0;
+};
+
+}  // namespace kv_server
+
+#endif  // COMPONENTS_DATA_SERVER_CACHE_DECOMPRESSED_VALUE_CACHE_H_
@@ -0,0 +1,63 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "components/data_server/cache/decompressed_value_cache.h"
+
+#include <string>
+
+#include "gtest/gtest.h"
+
+namespace kv_server {
+namespace {
+
+TEST(DecompressedValueCacheTest, ReturnsValueOfMatchingVersion) {
+  DecompressedValueCache cache(1 << 20);
+  cache.Put("key1", 1, absl::Cord("value1"));
+  EXPECT_EQ(cache.Get("key1", 1), absl::Cord("value1"));
+  EXPECT_FALSE(cache.Get("key1", 2).has_value());
+  EXPECT_FALSE(cache.Get("key2", 1).has_value());
+
+  cache.Put("key1", 2, absl::Cord("value2"));
+  EXPECT_FALSE(cache.Get("key1", 1).has_value());
+  EXPECT_EQ(cache.Get("key1", 2), absl::Cord("value2"));
+  EXPECT_EQ(cache.bytes(), 10);
+}
+
+TEST(DecompressedValueCacheTest, EvictsLeastRecentlyUsedValues) {
+  // Each of the 16 shards holds 100 bytes.
+  DecompressedValueCache cache(1600);
+  const std::string value(40, 'v');
+  int num_held = 0;
+  for (int i = 0; i < 100; ++i) {
+    cache.Put(std::to_string(i), 1, absl::Cord(value));
+    EXPECT_TRUE(cache.Get(std::to_string(i), 1).has_value());
+  }
+  for (int i = 0; i < 100; ++i) {
+    num_held += cache.Get(std::to_string(i), 1).has_value();
+  }
+  // At most two values fit in a shard.
+  EXPECT_LE(num_held, 32);
+  EXPECT_GT(num_held, 0);
+  EXPECT_LE(cache.bytes(), 1600);
+}
+
+TEST(DecompressedValueCacheTest, SkipsValuesLargerThanShard) {
+  DecompressedValueCache cache(1600);
+  cache.Put("key", 1, absl::Cord(std::string(200, 'v')));
+  EXPECT_FALSE(cache.Get("key", 1).has_value());
+  EXPECT_EQ(cache.bytes(), 0);
+}
+
+}  // namespace
+}  // namespace kv_server
@@ -0,0 +1,93 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "components/data_server/cache/epoch_manager.h"
+
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "absl/hash/hash.h"
+
+namespace kv_server {
+
+EpochManager::~EpochManager() {
+  absl::MutexLock lock(&mutex_);
+  for (const Retired& retired : retired_) {
+    retired.deleter(retired.ptr);
+  }
+  retired_.clear();
+}
+
+int EpochManager::ThreadSlot() {
+  thread_local const int slot =
+      absl::Hash<std::thread::id>{}(std::this_thread::get_id()) %
+      kNumReaderSlots;
+  return slot;
+}
+
+EpochManager::ReadGuard EpochManager::Pin() const {
+  const int slot = ThreadSlot();
+  while (true) {
+    const uint64_t epoch = epoch_.load(std::memory_order_seq_cst);
+    std::atomic<int64_t>& counter = readers_[epoch & 1][slot].count;
+    counter.fetch_add(1, std::memory_order_seq_cst);
+    // If a grace period started after the epoch was loaded, the writer may
+    // already have checked this counter. Register against the new epoch.
+    if (epoch_.load(std::memory_order_seq_cst) == epoch) {
+      return ReadGuard(&counter);
+    }
+    counter.fetch_sub(1, std::memory_order_release);
+  }
+}
+
+void EpochManager::Retire(void* ptr, void (*deleter)(void*)) {
+  absl::MutexLock lock(&mutex_);
+  retired_.push_back({.ptr = ptr, .deleter = deleter});
+}
+
+void EpochManager::MaybeSynchronize() {
+  {
+    absl::MutexLock lock(&mutex_);
+    if (retired_.size() < kMaxPendingRetired) {
+      return;
+    }
+  }
+  Synchronize();
+}
+
+void EpochManager::Synchronize() {
+  absl::MutexLock grace_period_lock(&grace_period_mutex_);
+  std::vector<Retired> to_delete;
+  {
+    absl::MutexLock lock(&mutex_);
+    to_delete.swap(retired_);
+  }
+  if (to_delete.empty()) {
+    return;
+  }
+  // New readers register against the other parity from here on. Readers of
+  // the previous-but-one epoch were drained by the last grace period.
+  const uint64_t epoch = epoch_.fetch_add(1, std::memory_order_seq_cst);
+  for (ReaderSlot& slot : readers_[epoch & 1]) {
+    while (slot.count.load(std::memory_order_seq_cst) != 0) {
+      std::this_thread::yield();
+    }
+  }
+  for (const Retired& retired : to_delete) {
+    retired.deleter(retired.ptr);
+  }
+}
+
+}  // namespace kv_server
@@ -0,0 +1,126 @@
+/*
+ * Copyright 2023 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef COMPONENTS_DATA_SERVER_CACHE_EPOCH_MANAGER_H_
+#define COMPONENTS_DATA_SERVER_CACHE_EPOCH_MANAGER_H_
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#include "absl/synchronization/mutex.h"
+
+namespace kv_server {
+
+// Epoch based memory reclamation for read-mostly data structures.
+//
+// Readers pin the current epoch for the duration of a read and never block:
+// pinning is a pair of atomic operations on a counter that is sharded across
+// cache lines. Writers unlink objects from the shared structure and hand them
+// to `Retire`. Retired objects are deleted once every reader that could still
+// hold a pointer to them has unpinned, i.e. after a grace period.
+//
+// Writers must be serialized by the caller. Readers may run concurrently with
+// writers and with each other.
+class EpochManager {
+ public:
+  // RAII guard for a pinned epoch. Pointers loaded from the protected data
+  // structure while the guard is alive remain valid until it is destroyed.
+  class ReadGuard {
+   public:
+    ~ReadGuard() {
+      if (counter_ != nullptr) {
+        counter_->fetch_sub(1, std::memory_order_release);
+      }
+    }
+    ReadGuard(ReadGuard&& other) : counter_(other.counter_) {
+      other.counter_ = nullptr;
+    }
+    ReadGuard(const ReadGuard&) = delete;
+    ReadGuard& operator=(const ReadGuard&) = delete;
+    ReadGuard& operator=(ReadGuard&&) = delete;
+
+   private:
+    explicit ReadGuard(std::atomic<int64_t>* counter) : counter_(counter) {}
+
+    std::atomic<int64_t>* counter_;
+
+    friend class EpochManager;
+  };
+
+  EpochManager() = default;
+  // Deletes all retired objects. No reader may be pinned at this point.
+  ~EpochManager();
+
+  EpochManager(const EpochManager&) = delete;
+  EpochManager& operator=(const EpochManager&) = delete;
+
+  // Pins the current epoch. Wait-free unless a grace period starts between
+  // loading the epoch and registering the reader, in which case it retries.
+  ReadGuard Pin() const;
+
+  // Schedules `ptr` to be deleted with `deleter` after a grace period. Never
+  // waits for readers, so it may be called under the writers' lock.
+  void Retire(void* ptr, void (*deleter)(void*));
+
+  // Convenience overload for objects that are deleted with `delete`.
+  template <typename T>
+  void Retire(T* ptr) {
+    Retire(ptr, [](void* p) { delete static_cast<T*>(p); });
+  }
+
+  // Waits until all readers pinned before this call have unpinned and deletes
+  // everything retired before this call. The calling thread must not hold a
+  // `ReadGuard`, and shouldn't hold locks other writers wait on, as a slow
+  // reader would then hold them back as well.
+  void Synchronize();
+
+  // Calls `Synchronize` if enough objects are pending. Writers call it once
+  // they've released their lock.
+  void MaybeSynchronize();
+
+ private:
+  // Number of pending retired objects that triggers a grace period from
+  // `MaybeSynchronize`.
+  static constexpr int kMaxPendingRetired = 4096;
+  // Number of cache-line aligned reader counters per epoch parity.
+  static constexpr int kNumReaderSlots = 64;
+
+  struct alignas(64) ReaderSlot {
+    std::atomic<int64_t> count{0};
+  };
+
+  struct Retired {
+    void* ptr;
+    void (*deleter)(void*);
+  };
+
+  static int ThreadSlot();
+
+  std::atomic<uint64_t> epoch_{0};
+  // Reader counters indexed by the parity of the epoch they pinned.
+  mutable ReaderSlot readers_[2][kNumReaderSlots];
+
+  // Serializes grace periods. Held while waiting for readers, unlike
+  // `mutex_`, so that `Retire` doesn't wait on them.
+  absl::Mutex grace_period_mutex_;
+  absl::Mutex mutex_;
+  std::vector<Retired> retired_ ABSL_GUARDED_BY(mutex_);
+};
+
+}  // namespace kv_server
+
+#endif  // COMPONENTS_DATA_SERVER_CACHE_EPOCH_MANAGER_H_
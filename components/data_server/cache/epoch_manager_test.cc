@@ -0,0 +1,100 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "components/data_server/cache/epoch_manager.h"
+
+#include <atomic>
+#include <memory>
+#include <thread>
+
+#include "absl/synchronization/notification.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "gtest/gtest.h"
+
+namespace kv_server {
+namespace {
+
+TEST(EpochManagerTest, SynchronizeDeletesRetiredObjects) {
+  EpochManager epoch_manager;
+  int num_deleted = 0;
+  epoch_manager.Retire(&num_deleted,
+                       [](void* ptr) { ++*static_cast<int*>(ptr); });
+  EXPECT_EQ(num_deleted, 0);
+  epoch_manager.Synchronize();
+  EXPECT_EQ(num_deleted, 1);
+}
+
+TEST(EpochManagerTest, SynchronizeWaitsForPinnedReaders) {
+  EpochManager epoch_manager;
+  std::atomic<int> num_deleted = 0;
+  auto guard = std::make_unique<EpochManager::ReadGuard>(epoch_manager.Pin());
+  epoch_manager.Retire(&num_deleted, [](void* ptr) {
+    static_cast<std::atomic<int>*>(ptr)->fetch_add(1);
+  });
+  std::thread writer([&epoch_manager]() { epoch_manager.Synchronize(); });
+  absl::SleepFor(absl::Milliseconds(50));
+  EXPECT_EQ(num_deleted.load(), 0);
+  guard.reset();
+  writer.join();
+  EXPECT_EQ(num_deleted.load(), 1);
+}
+
+TEST(EpochManagerTest, RetireDoesNotWaitForGracePeriod) {
+  EpochManager epoch_manager;
+  std::atomic<int> num_deleted = 0;
+  const auto count_deletion = [](void* ptr) {
+    static_cast<std::atomic<int>*>(ptr)->fetch_add(1);
+  };
+  auto guard = std::make_unique<EpochManager::ReadGuard>(epoch_manager.Pin());
+  epoch_manager.Retire(&num_deleted, count_deletion);
+  absl::Notification synchronizing;
+  std::thread writer([&epoch_manager, &synchronizing]() {
+    synchronizing.Notify();
+    epoch_manager.Synchronize();
+  });
+  synchronizing.WaitForNotification();
+  absl::SleepFor(absl::Milliseconds(50));
+  // Returns while the grace period waits for the pinned reader.
+  epoch_manager.Retire(&num_deleted, count_deletion);
+  EXPECT_EQ(num_deleted.load(), 0);
+  guard.reset();
+  writer.join();
+  epoch_manager.Synchronize();
+  EXPECT_EQ(num_deleted.load(), 2);
+}
+
+TEST(EpochManagerTest, MaybeSynchronizeWaitsForBacklog) {
+  EpochManager epoch_manager;
+  int num_deleted = 0;
+  epoch_manager.Retire(&num_deleted,
+                       [](void* ptr) { ++*static_cast<int*>(ptr); });
+  epoch_manager.MaybeSynchronize();
+  EXPECT_EQ(num_deleted, 0);
+  epoch_manager.Synchronize();
+  EXPECT_EQ(num_deleted, 1);
+}
+
+TEST(EpochManagerTest, DestructorDeletesRetiredObjects) {
+  int num_deleted = 0;
+  {
+    EpochManager epoch_manager;
+    epoch_manager.Retire(&num_deleted,
+                         [](void* ptr) { ++*static_cast<int*>(ptr); });
+  }
+  EXPECT_EQ(num_deleted, 1);
+}
+
+}  // namespace
+}  // namespace kv_server
@@ -18,14 +18,17 @@
 #define COMPONENTS_DATA_SERVER_CACHE_GET_KEY_VALUE_SET_RESULT_H_
 
 #include <memory>
+#include <string_view>
 #include <utility>
 #include <vector>
 
 #include "absl/container/flat_hash_set.h"
+#include "components/data_server/cache/value_dictionary.h"
+#include "components/query/roaring_bitmap.h"
 
 namespace kv_server {
-// Class that holds the data retrieved from cache lookup and read locks for
-// the lookup keys
+// Class that holds the data retrieved from cache lookup. The value sets are
+// shared snapshots, so holding a result doesn't block updates of its keys.
 class GetKeyValueSetResult {
  public:
   virtual ~GetKeyValueSetResult() = default;
@@ -34,14 +37,25 @@ class GetKeyValueSetResult {
   virtual absl::flat_hash_set<std::string_view> GetValueSet(
       std::string_view key) const = 0;
 
+  // Returns the IDs of the values in the set for `key`. IDs are only
+  // meaningful to `GetValues` on the same result, and the bitmap stays valid
+  // as long as this object.
+  virtual const RoaringBitmap& GetValueIdSet(std::string_view key) const = 0;
+
+  // Returns the values with the given IDs, in ascending order of ID.
+  virtual std::vector<std::string_view> GetValues(
+      const RoaringBitmap& value_ids) const = 0;
+
  private:
-  // Adds key, value_set to the result data map, mantains the lock on `key`
-  // until this object goes out of scope.
+  // Adds key, value_ids to the result data map. The snapshot of `value_ids`
+  // is kept until this object goes out of scope.
   virtual void AddKeyValueSet(
-      std::string_view key, absl::flat_hash_set<std::string_view> value_set,
-      std::unique_ptr<absl::ReaderMutexLock> key_lock) = 0;
+      std::string_view key,
+      std::shared_ptr<const RoaringBitmap> value_ids) = 0;
 
-  static std::unique_ptr<GetKeyValueSetResult> Create();
+  // Values are resolved with `dictionary`, which must outlive the result.
+  static std::unique_ptr<GetKeyValueSetResult> Create(
+      const ValueDictionary& dictionary);
 
   friend class KeyValueCache;
 };
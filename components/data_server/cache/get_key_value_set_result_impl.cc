@@ -15,56 +15,70 @@
  */
 
 #include <memory>
+#include <string_view>
 #include <utility>
 #include <vector>
 
 #include "absl/container/flat_hash_map.h"
 #include "absl/container/flat_hash_set.h"
 #include "components/data_server/cache/get_key_value_set_result.h"
+#include "components/data_server/cache/value_dictionary.h"
+#include "components/query/roaring_bitmap.h"
 
 namespace kv_server {
 namespace {
 
-// Class that holds the data retrieved from cache lookup and read locks for
-// the lookup keys
+// Class that holds the data retrieved from cache lookup, and the snapshots
+// of the value sets of the lookup keys
 class GetKeyValueSetResultImpl : public GetKeyValueSetResult {
  public:
-  GetKeyValueSetResultImpl() {}
+  explicit GetKeyValueSetResultImpl(const ValueDictionary& dictionary)
+      : dictionary_(dictionary) {}
 
   // Looks up the key in the data map and returns value set. If the value_set
   // for the key is missing, returns empty set.
   absl::flat_hash_set<std::string_view> GetValueSet(
       std::string_view key) const override {
-    static const absl::flat_hash_set<std::string_view>* kEmptySet =
-        new absl::flat_hash_set<std::string_view>();
+    const std::vector<std::string_view> values =
+        GetValues(GetValueIdSet(key));
+    return absl::flat_hash_set<std::string_view>(values.begin(),
+                                                 values.end());
+  }
+
+  // Looks up the key in the data map and returns the IDs of its values. If
+  // the value_set for the key is missing, returns an empty bitmap.
+  const RoaringBitmap& GetValueIdSet(std::string_view key) const override {
+    static const RoaringBitmap* kEmptySet = new RoaringBitmap();
     auto key_itr = data_map_.find(key);
-    return key_itr == data_map_.end() ? *kEmptySet : key_itr->second;
+    return key_itr == data_map_.end() ? *kEmptySet : *key_itr->second;
+  }
+
+  std::vector<std::string_view> GetValues(
+      const RoaringBitmap& value_ids) const override {
+    return dictionary_.GetValues(value_ids.ToVector());
   }
 
   GetKeyValueSetResultImpl(const GetKeyValueSetResultImpl&) = delete;
   GetKeyValueSetResultImpl& operator=(const GetKeyValueSetResultImpl&) = delete;
-  GetKeyValueSetResultImpl(GetKeyValueSetResultImpl&& other) = default;
-  GetKeyValueSetResultImpl& operator=(GetKeyValueSetResultImpl&& other) =
-      default;
 
  private:
-  std::vector<std::unique_ptr<absl::ReaderMutexLock>> read_locks_;
-  absl::flat_hash_map<std::string_view, absl::flat_hash_set<std::string_view>>
+  const ValueDictionary& dictionary_;
+  // The snapshots are shared with the cache, which never mutates them.
+  absl::flat_hash_map<std::string_view, std::shared_ptr<const RoaringBitmap>>
       data_map_;
 
-  // Adds key, value_set to the result data map, creates a read lock for
-  // the key mutex
+  // Adds key, value_ids to the result data map
   void AddKeyValueSet(
-      std::string_view key, absl::flat_hash_set<std::string_view> value_set,
-      std::unique_ptr<absl::ReaderMutexLock> key_lock) override {
-    read_locks_.push_back(std::move(key_lock));
-    data_map_.emplace(key, std::move(value_set));
+      std::string_view key,
+      std::shared_ptr<const RoaringBitmap> value_ids) override {
+    data_map_.emplace(key, std::move(value_ids));
   }
 };
 }  // namespace
 
-std::unique_ptr<GetKeyValueSetResult> GetKeyValueSetResult::Create() {
-  return std::make_unique<GetKeyValueSetResultImpl>();
+std::unique_ptr<GetKeyValueSetResult> GetKeyValueSetResult::Create(
+    const ValueDictionary& dictionary) {
+  return std::make_unique<GetKeyValueSetResultImpl>(dictionary);
 }
 
 }  // namespace kv_server
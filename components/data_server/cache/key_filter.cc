@@ -0,0 +1,177 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "components/data_server/cache/key_filter.h"
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <utility>
+
+#include "absl/memory/memory.h"
+#include "absl/random/random.h"
+#include "absl/status/status.h"
+#include "absl/strings/str_format.h"
+
+namespace kv_server {
+namespace {
+
+// Gives about 1% false positives with 8 bits set per key.
+constexpr int64_t kBitsPerKey = 12;
+// Bytes of the block count, version and logical commit time that precede
+// the blocks.
+constexpr size_t kHeaderBytes = 24;
+
+// Multipliers that pick the bit set in each word of a block, from the split
+// block Bloom filters of Apache Parquet.
+constexpr uint32_t kSalts[] = {0x47b6137bU, 0x44974d91U, 0x8824ad5bU,
+                               0xa2b7289dU, 0x705495c7U, 0x2df1424bU,
+                               0x9efc4947U, 0x5c6bfb31U};
+
+// FNV-1a, finished with the splitmix64 mixer since FNV leaves the high bits
+// poorly mixed. Unlike absl::Hash it isn't seeded per process.
+uint64_t HashKey(std::string_view key) {
+  uint64_t hash = 14695981039346656037ULL;
+  for (const unsigned char c : key) {
+    hash = (hash ^ c) * 1099511628211ULL;
+  }
+  hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebULL;
+  return hash ^ (hash >> 31);
+}
+
+// Bit of word `i` of the block that the key with `hash` sets.
+uint64_t WordMask(uint64_t hash, int i) {
+  return uint64_t{1} << ((static_cast<uint32_t>(hash) * kSalts[i]) >> 26);
+}
+
+void AppendUint64(uint64_t value, std::string& out) {
+  for (int i = 0; i < 8; ++i) {
+    out.push_back(static_cast<char>(value >> (8 * i)));
+  }
+}
+
+uint64_t ReadUint64(const char* in) {
+  uint64_t value = 0;
+  for (int i = 0; i < 8; ++i) {
+    value |= uint64_t{static_cast<unsigned char>(in[i])} << (8 * i);
+  }
+  return value;
+}
+
+}  // namespace
+
+KeyFilter::KeyFilter(int64_t num_blocks)
+    : num_blocks_(num_blocks), blocks_(new Block[num_blocks]()) {
+  // Versions start at random, so that the filter of a restarted server isn't
+  // mistaken for the copy of an earlier one.
+  absl::BitGen bitgen;
+  version_.store(absl::Uniform<int64_t>(bitgen, 0, int64_t{1} << 62),
+                 std::memory_order_relaxed);
+}
+
+void KeyFilter::Add(std::string_view key) {
+  const uint64_t hash = HashKey(key);
+  Block& block = blocks_[((hash >> 32) * num_blocks_) >> 32];
+  bool changed = false;
+  for (int i = 0; i < kWordsPerBlock; ++i) {
+    const uint64_t mask = WordMask(hash, i);
+    if ((block.words[i].load(std::memory_order_relaxed) & mask) == 0) {
+      block.words[i].fetch_or(mask, std::memory_order_relaxed);
+      changed = true;
+    }
+  }
+  if (changed) {
+    version_.fetch_add(1, std::memory_order_release);
+  }
+}
+
+void KeyFilter::AdvanceLogicalCommitTime(int64_t logical_commit_time) {
+  int64_t current = logical_commit_time_.load(std::memory_order_relaxed);
+  while (current < logical_commit_time) {
+    // Released after the keys of the update were added, so that a copy with
+    // this time has them.
+    if (logical_commit_time_.compare_exchange_weak(
+            current, logical_commit_time, std::memory_order_release,
+            std::memory_order_relaxed)) {
+      version_.fetch_add(1, std::memory_order_release);
+      return;
+    }
+  }
+}
+
+bool KeyFilter::MayContain(std::string_view key) const {
+  const uint64_t hash = HashKey(key);
+  const Block& block = blocks_[((hash >> 32) * num_blocks_) >> 32];
+  for (int i = 0; i < kWordsPerBlock; ++i) {
+    const uint64_t mask = WordMask(hash, i);
+    if ((block.words[i].load(std::memory_order_relaxed) & mask) == 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+std::string KeyFilter::Serialize() const {
+  std::string serialized;
+  serialized.reserve(kHeaderBytes + bytes());
+  AppendUint64(num_blocks_, serialized);
+  // Read before the blocks, so that they're never newer than them.
+  AppendUint64(version(), serialized);
+  AppendUint64(logical_commit_time(), serialized);
+  for (int64_t i = 0; i < num_blocks_; ++i) {
+    for (const auto& word : blocks_[i].words) {
+      AppendUint64(word.load(std::memory_order_relaxed), serialized);
+    }
+  }
+  return serialized;
+}
+
+std::unique_ptr<KeyFilter> KeyFilter::Create(int64_t expected_keys) {
+  const int64_t bits = std::max<int64_t>(expected_keys, 1) * kBitsPerKey;
+  const int64_t bits_per_block = 8 * sizeof(Block);
+  return absl::WrapUnique(
+      new KeyFilter((bits + bits_per_block - 1) / bits_per_block));
+}
+
+absl::StatusOr<std::unique_ptr<KeyFilter>> KeyFilter::Parse(
+    std::string_view serialized) {
+  if (serialized.size() < kHeaderBytes) {
+    return absl::InvalidArgumentError("Key filter is truncated.");
+  }
+  const uint64_t num_blocks = ReadUint64(serialized.data());
+  // Compares block counts rather than sizes, which could overflow.
+  const size_t block_bytes = serialized.size() - kHeaderBytes;
+  if (num_blocks == 0 || block_bytes % sizeof(Block) != 0 ||
+      num_blocks != block_bytes / sizeof(Block)) {
+    return absl::InvalidArgumentError(
+        absl::StrFormat("Key filter of %d blocks has %d bytes.", num_blocks,
+                        serialized.size()));
+  }
+  auto filter = absl::WrapUnique(new KeyFilter(num_blocks));
+  filter->version_.store(ReadUint64(serialized.data() + 8),
+                         std::memory_order_relaxed);
+  filter->logical_commit_time_.store(ReadUint64(serialized.data() + 16),
+                                     std::memory_order_relaxed);
+  const char* in = serialized.data() + kHeaderBytes;
+  for (uint64_t i = 0; i < num_blocks; ++i) {
+    for (auto& word : filter->blocks_[i].words) {
+      word.store(ReadUint64(in), std::memory_order_relaxed);
+      in += 8;
+    }
+  }
+  return filter;
+}
+
+}  // namespace kv_server
@@ -0,0 +1,99 @@
+/*
+ * Copyright 2023 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef COMPONENTS_DATA_SERVER_CACHE_KEY_FILTER_H_
+#define COMPONENTS_DATA_SERVER_CACHE_KEY_FILTER_H_
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "absl/status/statusor.h"
+
+namespace kv_server {
+
+// Approximate set of the keys loaded into a cache, which can tell that a key
+// is definitely absent without looking it up. It's a blocked Bloom filter:
+// each key sets a few bits of one 64-byte block, so that adding and testing
+// a key touch a single cache line.
+//
+// Keys can't be removed, so deleted keys only add to the false positives.
+// The keys are hashed the same way in every process, so that filters can be
+// serialized and tested by other servers.
+//
+// Adding and testing keys is thread safe and doesn't take locks.
+class KeyFilter {
+ public:
+  KeyFilter(const KeyFilter&) = delete;
+  KeyFilter& operator=(const KeyFilter&) = delete;
+
+  void Add(std::string_view key);
+
+  // Returns false only if `key` was never added.
+  bool MayContain(std::string_view key) const;
+
+  // Records that the keys of the updates up to `logical_commit_time` were
+  // added. It only ever rises.
+  void AdvanceLogicalCommitTime(int64_t logical_commit_time);
+
+  // Logical commit time of the most recent update whose key was added, or 0.
+  // A copy of the filter rules out keys reliably only for a server that
+  // hasn't loaded more recent updates itself. When data files are loaded
+  // concurrently, it can get ahead of the keys of the older files.
+  int64_t logical_commit_time() const {
+    return logical_commit_time_.load(std::memory_order_acquire);
+  }
+
+  // Changes whenever an added key sets new bits or the logical commit time
+  // rises, so that copies of the filter only need to be fetched again when
+  // it changed.
+  int64_t version() const { return version_.load(std::memory_order_acquire); }
+
+  int64_t bytes() const { return num_blocks_ * sizeof(Block); }
+
+  // Returns a copy of the filter, with its version and logical commit time,
+  // for `Parse`. Keys added
+  // concurrently may or may not be included, but then the version is older
+  // than theirs.
+  std::string Serialize() const;
+
+  // Sized for a false positive rate of about 1% with `expected_keys` keys.
+  // The rate grows as more keys are added.
+  static std::unique_ptr<KeyFilter> Create(int64_t expected_keys);
+
+  // Returns the filter written by `Serialize`.
+  static absl::StatusOr<std::unique_ptr<KeyFilter>> Parse(
+      std::string_view serialized);
+
+ private:
+  static constexpr int kWordsPerBlock = 8;
+  struct alignas(64) Block {
+    std::atomic<uint64_t> words[kWordsPerBlock];
+  };
+
+  explicit KeyFilter(int64_t num_blocks);
+
+  const int64_t num_blocks_;
+  const std::unique_ptr<Block[]> blocks_;
+  std::atomic<int64_t> version_ = 0;
+  std::atomic<int64_t> logical_commit_time_ = 0;
+};
+
+}  // namespace kv_server
+
+#endif  // COMPONENTS_DATA_SERVER_CACHE_KEY_FILTER_H_
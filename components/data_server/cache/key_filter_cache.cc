@@ -0,0 +1,168 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "components/data_server/cache/key_filter_cache.h"
+
+#include <algorithm>
+#include <memory>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "absl/memory/memory.h"
+
+namespace kv_server {
+
+KeyFilterCache::KeyFilterCache(std::unique_ptr<Cache> cache, KeyFilter& filter)
+    : cache_(std::move(cache)), filter_(filter) {}
+
+std::optional<std::vector<std::string_view>> KeyFilterCache::FilterKeys(
+    const std::vector<std::string_view>& key_list) const {
+  std::optional<std::vector<std::string_view>> filtered_keys;
+  for (size_t i = 0; i < key_list.size(); ++i) {
+    if (filter_.MayContain(key_list[i])) {
+      if (filtered_keys.has_value()) {
+        filtered_keys->push_back(key_list[i]);
+      }
+    } else if (!filtered_keys.has_value()) {
+      // The first key ruled out, the ones before it are all kept.
+      filtered_keys.emplace(key_list.begin(), key_list.begin() + i);
+    }
+  }
+  return filtered_keys;
+}
+
+absl::flat_hash_map<std::string_view, absl::Cord>
+KeyFilterCache::GetKeyValuePairs(
+    const std::vector<std::string_view>& key_list) const {
+  const auto filtered_keys = FilterKeys(key_list);
+  if (!filtered_keys.has_value()) {
+    return cache_->GetKeyValuePairs(key_list);
+  }
+  if (filtered_keys->empty()) {
+    return {};
+  }
+  return cache_->GetKeyValuePairs(*filtered_keys);
+}
+
+std::unique_ptr<ReadVersion> KeyFilterCache::PinReadVersion() const {
+  return cache_->PinReadVersion();
+}
+
+absl::flat_hash_map<std::string_view, absl::Cord>
+KeyFilterCache::GetKeyValuePairsAt(
+    const std::vector<std::string_view>& key_list,
+    const ReadVersion* read_version) const {
+  const auto filtered_keys = FilterKeys(key_list);
+  if (!filtered_keys.has_value()) {
+    return cache_->GetKeyValuePairsAt(key_list, read_version);
+  }
+  if (filtered_keys->empty()) {
+    return {};
+  }
+  return cache_->GetKeyValuePairsAt(*filtered_keys, read_version);
+}
+
+absl::flat_hash_map<std::string_view, google::protobuf::Value>
+KeyFilterCache::GetValueProtosAt(const std::vector<std::string_view>& key_list,
+                                 const ReadVersion* read_version) const {
+  const auto filtered_keys = FilterKeys(key_list);
+  if (!filtered_keys.has_value()) {
+    return cache_->GetValueProtosAt(key_list, read_version);
+  }
+  if (filtered_keys->empty()) {
+    return {};
+  }
+  return cache_->GetValueProtosAt(*filtered_keys, read_version);
+}
+
+std::unique_ptr<GetKeyValueSetResult> KeyFilterCache::GetKeyValueSet(
+    const absl::flat_hash_set<std::string_view>& key_set) const {
+  const auto may_contain = [this](std::string_view key) {
+    return filter_.MayContain(key);
+  };
+  if (std::all_of(key_set.begin(), key_set.end(), may_contain)) {
+    return cache_->GetKeyValueSet(key_set);
+  }
+  absl::flat_hash_set<std::string_view> filtered_keys;
+  for (std::string_view key : key_set) {
+    if (may_contain(key)) {
+      filtered_keys.insert(key);
+    }
+  }
+  return cache_->GetKeyValueSet(filtered_keys);
+}
+
+void KeyFilterCache::UpdateKeyValue(std::string_view key,
+                                    std::string_view value,
+                                    int64_t logical_commit_time) {
+  filter_.Add(key);
+  filter_.AdvanceLogicalCommitTime(logical_commit_time);
+  cache_->UpdateKeyValue(key, value, logical_commit_time);
+}
+
+void KeyFilterCache::UpdateKeyValueSet(std::string_view key,
+                                       absl::Span<std::string_view> value_set,
+                                       int64_t logical_commit_time) {
+  filter_.Add(key);
+  filter_.AdvanceLogicalCommitTime(logical_commit_time);
+  cache_->UpdateKeyValueSet(key, value_set, logical_commit_time);
+}
+
+void KeyFilterCache::DeleteKey(std::string_view key,
+                               int64_t logical_commit_time) {
+  cache_->DeleteKey(key, logical_commit_time);
+  filter_.AdvanceLogicalCommitTime(logical_commit_time);
+}
+
+void KeyFilterCache::DeleteValuesInSet(std::string_view key,
+                                       absl::Span<std::string_view> value_set,
+                                       int64_t logical_commit_time) {
+  cache_->DeleteValuesInSet(key, value_set, logical_commit_time);
+  filter_.AdvanceLogicalCommitTime(logical_commit_time);
+}
+
+void KeyFilterCache::ApplyBatch(absl::Span<Mutation> mutations) {
+  int64_t max_logical_commit_time = 0;
+  for (const Mutation& mutation : mutations) {
+    if (mutation.type == Mutation::Type::kUpdateKeyValue ||
+        mutation.type == Mutation::Type::kUpdateKeyValueSet) {
+      filter_.Add(mutation.key);
+    }
+    max_logical_commit_time =
+        std::max(max_logical_commit_time, mutation.logical_commit_time);
+  }
+  filter_.AdvanceLogicalCommitTime(max_logical_commit_time);
+  cache_->ApplyBatch(mutations);
+}
+
+void KeyFilterCache::RemoveDeletedKeys(int64_t logical_commit_time) {
+  cache_->RemoveDeletedKeys(logical_commit_time);
+}
+
+CacheMemoryUsage KeyFilterCache::GetMemoryUsage() const {
+  return cache_->GetMemoryUsage();
+}
+
+void KeyFilterCache::ExportMutations(
+    const std::function<void(const Mutation&)>& callback) const {
+  cache_->ExportMutations(callback);
+}
+
+std::unique_ptr<KeyFilterCache> KeyFilterCache::Create(
+    std::unique_ptr<Cache> cache, KeyFilter& filter) {
+  return absl::WrapUnique(new KeyFilterCache(std::move(cache), filter));
+}
+
+}  // namespace kv_server
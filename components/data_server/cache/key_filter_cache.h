@@ -0,0 +1,101 @@
+/*
+ * Copyright 2023 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef COMPONENTS_DATA_SERVER_CACHE_KEY_FILTER_CACHE_H_
+#define COMPONENTS_DATA_SERVER_CACHE_KEY_FILTER_CACHE_H_
+
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
+#include "components/data_server/cache/cache.h"
+#include "components/data_server/cache/get_key_value_set_result.h"
+#include "components/data_server/cache/key_filter.h"
+
+namespace kv_server {
+
+// Cache that adds the keys of the pairs and sets updated through it to a
+// key filter, and skips the lookups of keys the filter rules out. Keys are
+// added to the filter before the update is forwarded, so a lookup never
+// skips a key the forwarded cache holds. The filter's logical commit time is
+// raised to that of every mutation.
+//
+// The filter may be shared by several caches, e.g. the instances of a
+// SwappableCache or the partitions of a PartitionedCache, and then rules out
+// the keys of none of them.
+class KeyFilterCache : public Cache {
+ public:
+  absl::flat_hash_map<std::string_view, absl::Cord> GetKeyValuePairs(
+      const std::vector<std::string_view>& key_list) const override;
+
+  std::unique_ptr<ReadVersion> PinReadVersion() const override;
+
+  absl::flat_hash_map<std::string_view, absl::Cord> GetKeyValuePairsAt(
+      const std::vector<std::string_view>& key_list,
+      const ReadVersion* read_version) const override;
+
+  absl::flat_hash_map<std::string_view, google::protobuf::Value>
+  GetValueProtosAt(const std::vector<std::string_view>& key_list,
+                   const ReadVersion* read_version) const override;
+
+  std::unique_ptr<GetKeyValueSetResult> GetKeyValueSet(
+      const absl::flat_hash_set<std::string_view>& key_set) const override;
+
+  void UpdateKeyValue(std::string_view key, std::string_view value,
+                      int64_t logical_commit_time) override;
+
+  void UpdateKeyValueSet(std::string_view key,
+                         absl::Span<std::string_view> value_set,
+                         int64_t logical_commit_time) override;
+
+  void DeleteKey(std::string_view key, int64_t logical_commit_time) override;
+
+  void DeleteValuesInSet(std::string_view key,
+                         absl::Span<std::string_view> value_set,
+                         int64_t logical_commit_time) override;
+
+  void ApplyBatch(absl::Span<Mutation> mutations) override;
+
+  void RemoveDeletedKeys(int64_t logical_commit_time) override;
+
+  CacheMemoryUsage GetMemoryUsage() const override;
+
+  void ExportMutations(
+      const std::function<void(const Mutation&)>& callback) const override;
+
+  // `filter` must outlive the cache.
+  static std::unique_ptr<KeyFilterCache> Create(std::unique_ptr<Cache> cache,
+                                                KeyFilter& filter);
+
+ private:
+  KeyFilterCache(std::unique_ptr<Cache> cache, KeyFilter& filter);
+
+  // Returns the keys of `key_list` that the filter doesn't rule out, or
+  // nothing if it rules out none of them.
+  std::optional<std::vector<std::string_view>> FilterKeys(
+      const std::vector<std::string_view>& key_list) const;
+
+  const std::unique_ptr<Cache> cache_;
+  KeyFilter& filter_;
+};
+
+}  // namespace kv_server
+
+#endif  // COMPONENTS_DATA_SERVER_CACHE_KEY_FILTER_CACHE_H_
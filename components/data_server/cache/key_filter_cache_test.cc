@@ -0,0 +1,89 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "components/data_server/cache/key_filter_cache.h"
+
+#include <memory>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "components/data_server/cache/key_filter.h"
+#include "components/data_server/cache/key_value_cache.h"
+#include "components/data_server/cache/mocks.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "src/cpp/telemetry/metrics_recorder.h"
+#include "src/cpp/telemetry/telemetry_provider.h"
+
+namespace kv_server {
+namespace {
+
+using privacy_sandbox::server_common::TelemetryProvider;
+using testing::ElementsAre;
+using testing::IsEmpty;
+using testing::Return;
+using testing::UnorderedElementsAre;
+
+TEST(KeyFilterCacheTest, AddsUpdatedKeysToFilter) {
+  auto noop_metrics_recorder =
+      TelemetryProvider::GetInstance().CreateMetricsRecorder();
+  auto filter = KeyFilter::Create(100);
+  auto cache = KeyFilterCache::Create(
+      KeyValueCache::Create(*noop_metrics_recorder), *filter);
+  cache->UpdateKeyValue("key1", "value1", 1);
+  std::vector<std::string_view> values = {"v1"};
+  std::vector<Mutation> mutations = {
+      {.type = Mutation::Type::kUpdateKeyValueSet,
+       .key = "set1",
+       .value_set = values,
+       .logical_commit_time = 1},
+      {.type = Mutation::Type::kUpdateKeyValue,
+       .key = "key2",
+       .value = "value2",
+       .logical_commit_time = 2},
+  };
+  cache->ApplyBatch(absl::MakeSpan(mutations));
+  cache->DeleteKey("key1", 3);
+
+  EXPECT_EQ(filter->logical_commit_time(), 3);
+  EXPECT_TRUE(filter->MayContain("key1"));
+  EXPECT_TRUE(filter->MayContain("key2"));
+  EXPECT_TRUE(filter->MayContain("set1"));
+  EXPECT_FALSE(filter->MayContain("key3"));
+  EXPECT_THAT(cache->GetKeyValuePairs({"key1", "key2", "key3"}),
+              UnorderedElementsAre(KVPairEq("key2", "value2")));
+  EXPECT_THAT(cache->GetKeyValueSet({"set1", "set2"})->GetValueSet("set1"),
+              UnorderedElementsAre("v1"));
+}
+
+TEST(KeyFilterCacheTest, SkipsLookupsOfKeysRuledOut) {
+  auto filter = KeyFilter::Create(100);
+  auto mock_cache = std::make_unique<MockCache>();
+  MockCache& inner = *mock_cache;
+  auto cache = KeyFilterCache::Create(std::move(mock_cache), *filter);
+  EXPECT_CALL(inner, UpdateKeyValue("key1", "value1", 1));
+  cache->UpdateKeyValue("key1", "value1", 1);
+
+  EXPECT_CALL(inner, GetKeyValuePairs(ElementsAre("key1")))
+      .WillOnce(Return(absl::flat_hash_map<std::string_view, absl::Cord>{
+          {"key1", absl::Cord("value1")}}));
+  EXPECT_THAT(cache->GetKeyValuePairs({"key2", "key1", "key3"}),
+              UnorderedElementsAre(KVPairEq("key1", "value1")));
+  // Lookups of keys that are all ruled out don't reach the cache.
+  EXPECT_THAT(cache->GetKeyValuePairs({"key2", "key3"}), IsEmpty());
+}
+
+}  // namespace
+}  // namespace kv_server
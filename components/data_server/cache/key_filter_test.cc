@@ -0,0 +1,119 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "components/data_server/cache/key_filter.h"
+
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "gtest/gtest.h"
+
+namespace kv_server {
+namespace {
+
+TEST(KeyFilterTest, ContainsAddedKeys) {
+  auto filter = KeyFilter::Create(1000);
+  for (int i = 0; i < 1000; ++i) {
+    filter->Add(absl::StrCat("key", i));
+  }
+  for (int i = 0; i < 1000; ++i) {
+    EXPECT_TRUE(filter->MayContain(absl::StrCat("key", i)));
+  }
+}
+
+TEST(KeyFilterTest, RejectsMostAbsentKeys) {
+  auto filter = KeyFilter::Create(10000);
+  for (int i = 0; i < 10000; ++i) {
+    filter->Add(absl::StrCat("key", i));
+  }
+  int false_positives = 0;
+  for (int i = 0; i < 10000; ++i) {
+    false_positives += filter->MayContain(absl::StrCat("absent", i));
+  }
+  EXPECT_LT(false_positives, 200);
+}
+
+TEST(KeyFilterTest, VersionChangesWhenKeysAreAdded) {
+  auto filter = KeyFilter::Create(100);
+  const int64_t empty_version = filter->version();
+  filter->Add("key1");
+  const int64_t version = filter->version();
+  EXPECT_NE(version, empty_version);
+  filter->Add("key1");
+  EXPECT_EQ(filter->version(), version);
+}
+
+TEST(KeyFilterTest, LogicalCommitTimeOnlyRises) {
+  auto filter = KeyFilter::Create(100);
+  EXPECT_EQ(filter->logical_commit_time(), 0);
+  const int64_t version = filter->version();
+  filter->AdvanceLogicalCommitTime(5);
+  EXPECT_EQ(filter->logical_commit_time(), 5);
+  EXPECT_NE(filter->version(), version);
+  const int64_t advanced_version = filter->version();
+  filter->AdvanceLogicalCommitTime(3);
+  EXPECT_EQ(filter->logical_commit_time(), 5);
+  EXPECT_EQ(filter->version(), advanced_version);
+}
+
+TEST(KeyFilterTest, ParsesSerializedFilter) {
+  auto filter = KeyFilter::Create(100);
+  filter->Add("key1");
+  filter->Add("key2");
+  filter->AdvanceLogicalCommitTime(7);
+  auto parsed = KeyFilter::Parse(filter->Serialize());
+  ASSERT_TRUE(parsed.ok()) << parsed.status();
+  EXPECT_TRUE((*parsed)->MayContain("key1"));
+  EXPECT_TRUE((*parsed)->MayContain("key2"));
+  EXPECT_FALSE((*parsed)->MayContain("key3"));
+  EXPECT_EQ((*parsed)->version(), filter->version());
+  EXPECT_EQ((*parsed)->logical_commit_time(), 7);
+  EXPECT_EQ((*parsed)->bytes(), filter->bytes());
+}
+
+TEST(KeyFilterTest, RejectsMalformedFilters) {
+  const std::string serialized = KeyFilter::Create(100)->Serialize();
+  EXPECT_FALSE(KeyFilter::Parse("").ok());
+  EXPECT_FALSE(KeyFilter::Parse(serialized.substr(0, 16)).ok());
+  EXPECT_FALSE(
+      KeyFilter::Parse(serialized.substr(0, serialized.size() - 1)).ok());
+  std::string extra_block = serialized + std::string(64, '\0');
+  EXPECT_FALSE(KeyFilter::Parse(extra_block).ok());
+}
+
+TEST(KeyFilterTest, AddsKeysConcurrently) {
+  auto filter = KeyFilter::Create(4000);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([&filter, t] {
+      for (int i = 0; i < 1000; ++i) {
+        filter->Add(absl::StrCat("key", t, "_", i));
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  for (int t = 0; t < 4; ++t) {
+    for (int i = 0; i < 1000; ++i) {
+      EXPECT_TRUE(filter->MayContain(absl::StrCat("key", t, "_", i)));
+    }
+  }
+}
+
+}  // namespace
+}  // namespace kv_server
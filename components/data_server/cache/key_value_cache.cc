@@ -14,15 +14,27 @@
 #include "components/data_server/cache/key_value_cache.h"
 
 #include <algorithm>
+#include <functional>
+#include <limits>
 #include <memory>
+#include <optional>
+#include <string>
 #include <string_view>
 #include <vector>
 
+#include "absl/container/btree_map.h"
 #include "absl/container/flat_hash_map.h"
 #include "absl/memory/memory.h"
 #include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "components/data_server/cache/batched_lookup.h"
 #include "components/data_server/cache/cache.h"
 #include "components/data_server/cache/get_key_value_set_result.h"
+#include "components/data_server/cache/value_dictionary.h"
+#include "components/data_server/cache/value_proto.h"
+#include "components/query/roaring_bitmap.h"
 #include "glog/logging.h"
 #include "src/cpp/telemetry/metrics_recorder.h"
 
@@ -37,50 +49,519 @@ constexpr char kUpdateKeyValueEvent[] = "UpdateKeyValue";
 constexpr char kUpdateKeyValueSetEvent[] = "UpdateKeyValueSet";
 constexpr char kDeleteKeyEvent[] = "DeleteKey";
 constexpr char kDeleteValuesInSetEvent[] = "DeleteValuesInSet";
+constexpr char kApplyBatchEvent[] = "ApplyBatch";
 constexpr char kRemoveDeletedKeysEvent[] = "RemoveDeletedKeys";
 constexpr char kCleanUpKeyValueMapEvent[] = "CleanUpKeyValueMap";
 constexpr char kCleanUpKeyValueSetMapEvent[] = "CleanUpKeyValueSetMap";
+// Time a map lock is held by one slice of a tombstone cleanup.
+constexpr char kTombstoneCleanUpPauseEvent[] = "TombstoneCleanUpPause";
+constexpr char kRemovedTombstones[] = "RemovedTombstones";
+constexpr char kTombstoneReclaimedBytes[] = "TombstoneReclaimedBytes";
+constexpr char kCompressValueEvent[] = "CompressValue";
+constexpr char kDecompressValueEvent[] = "DecompressValue";
+constexpr char kTrainCompressionDictionaryEvent[] =
+    "TrainCompressionDictionary";
+// Original size of each compressed value, in percent of its compressed size.
+constexpr char kValueCompressionRatio[] = "ValueCompressionRatio";
+constexpr char kDecompressedValueCacheHit[] = "DecompressedValueCacheHit";
+constexpr char kDecompressedValueCacheMiss[] = "DecompressedValueCacheMiss";
 
-absl::flat_hash_map<std::string, std::string> KeyValueCache::GetKeyValuePairs(
-    const std::vector<std::string_view>& key_list) const {
-  ScopeLatencyRecorder latency_recorder(kGetKeyValuePairsEvent,
-                                        metrics_recorder_);
-  absl::flat_hash_map<std::string, std::string> kv_pairs;
-  absl::ReaderMutexLock lock(&mutex_);
-  for (std::string_view key : key_list) {
-    const auto key_iter = map_.find(key);
-    if (key_iter == map_.end() || key_iter->second.value == nullptr) {
+const std::vector<double> kTombstoneBucketBoundaries = {
+    10, 100, 1'000, 10'000, 100'000, 1'000'000, 10'000'000,
+};
+const std::vector<double> kBytesBucketBoundaries = {
+    1 << 10, 1 << 14, 1 << 18, 1 << 22, 1 << 26, 1 << 30,
+};
+const std::vector<double> kCompressionRatioBucketBoundaries = {
+    100, 125, 150, 200, 300, 500, 1'000, 2'000,
+};
+
+// Bounds on the tombstones removed while holding a map lock.
+constexpr int kMaxTombstonesPerSlice = 1024;
+constexpr absl::Duration kMaxSliceDuration = absl::Milliseconds(1);
+// Reading the clock for every tombstone would cost more than removing it.
+constexpr int kTombstonesPerClockCheck = 64;
+// Keys whose entries are copied under one map lock by `ExportMutations`.
+constexpr size_t kKeysPerExportChunk = 1024;
+
+namespace {
+
+// Budget of one slice of a tombstone cleanup. At least one tombstone is
+// removed per slice, so that the cleanup always makes progress.
+class CleanUpSlice {
+ public:
+  // Returns whether another tombstone may be removed in this slice, and
+  // charges it to the slice if so.
+  bool TryTake() {
+    if (taken_ >= kMaxTombstonesPerSlice ||
+        (taken_ > 0 && taken_ % kTombstonesPerClockCheck == 0 &&
+         absl::Now() >= deadline_)) {
+      return false;
+    }
+    ++taken_;
+    return true;
+  }
+
+ private:
+  const absl::Time deadline_ = absl::Now() + kMaxSliceDuration;
+  int taken_ = 0;
+};
+
+// Interns `values` and returns their IDs sorted and without duplicates. The
+// extra references taken for duplicate values are released.
+std::vector<uint32_t> InternSorted(ValueDictionary& dictionary,
+                                   absl::Span<const std::string_view> values) {
+  std::vector<uint32_t> value_ids = dictionary.Intern(values);
+  std::sort(value_ids.begin(), value_ids.end());
+  std::vector<uint32_t> duplicate_ids;
+  for (size_t i = 1; i < value_ids.size(); ++i) {
+    if (value_ids[i] == value_ids[i - 1]) {
+      duplicate_ids.push_back(value_ids[i]);
+    }
+  }
+  if (!duplicate_ids.empty()) {
+    dictionary.Release(duplicate_ids);
+    value_ids.erase(std::unique(value_ids.begin(), value_ids.end()),
+                    value_ids.end());
+  }
+  return value_ids;
+}
+
+// Returns the position of `id` in the sorted `ids`, or -1 if it's missing.
+int64_t FindId(const std::vector<uint32_t>& ids, uint32_t id) {
+  const auto iter = std::lower_bound(ids.begin(), ids.end(), id);
+  return iter != ids.end() && *iter == id ? iter - ids.begin() : -1;
+}
+
+// Inserts the sorted `new_ids`, none of which are in `ids`, with the given
+// commit time. Merges from the back so no temporary arrays are needed.
+void InsertSorted(std::vector<uint32_t>& ids,
+                  std::vector<int64_t>& commit_times,
+                  absl::Span<const uint32_t> new_ids,
+                  int64_t logical_commit_time) {
+  size_t old_end = ids.size();
+  size_t new_end = new_ids.size();
+  size_t out = old_end + new_end;
+  ids.resize(out);
+  commit_times.resize(out);
+  while (new_end > 0) {
+    --out;
+    if (old_end > 0 && ids[old_end - 1] > new_ids[new_end - 1]) {
+      --old_end;
+      ids[out] = ids[old_end];
+      commit_times[out] = commit_times[old_end];
+    } else {
+      --new_end;
+      ids[out] = new_ids[new_end];
+      commit_times[out] = logical_commit_time;
+    }
+  }
+}
+
+// Erases the sorted `erased_ids`, all of which are in `ids`.
+void EraseSorted(std::vector<uint32_t>& ids,
+                 std::vector<int64_t>& commit_times,
+                 absl::Span<const uint32_t> erased_ids) {
+  if (erased_ids.empty()) {
+    return;
+  }
+  size_t out = 0;
+  size_t erased = 0;
+  for (size_t i = 0; i < ids.size(); ++i) {
+    if (erased < erased_ids.size() && ids[i] == erased_ids[erased]) {
+      ++erased;
       continue;
+    }
+    ids[out] = ids[i];
+    commit_times[out] = commit_times[i];
+    ++out;
+  }
+  ids.resize(out);
+  commit_times.resize(out);
+}
+
+// Adds the sorted `new_ids`, none of which are in `ids`, with the given
+// commit time. `commit_times` is kept in ascending order of ID.
+void InsertIntoBitmap(RoaringBitmap& ids, std::vector<int64_t>& commit_times,
+                      absl::Span<const uint32_t> new_ids,
+                      int64_t logical_commit_time) {
+  if (new_ids.empty()) {
+    return;
+  }
+  std::vector<int64_t> merged_commit_times;
+  merged_commit_times.reserve(commit_times.size() + new_ids.size());
+  size_t old_pos = 0;
+  size_t new_pos = 0;
+  ids.ForEach([&](uint32_t id) {
+    while (new_pos < new_ids.size() && new_ids[new_pos] < id) {
+      merged_commit_times.push_back(logical_commit_time);
+      ++new_pos;
+    }
+    merged_commit_times.push_back(commit_times[old_pos++]);
+  });
+  merged_commit_times.resize(commit_times.size() + new_ids.size(),
+                             logical_commit_time);
+  commit_times = std::move(merged_commit_times);
+  ids = RoaringBitmap::Union(ids, RoaringBitmap::FromSorted(new_ids));
+}
+
+// Removes the sorted `erased_ids`, all of which are in `ids`.
+void EraseFromBitmap(RoaringBitmap& ids, std::vector<int64_t>& commit_times,
+                     absl::Span<const uint32_t> erased_ids) {
+  if (erased_ids.empty()) {
+    return;
+  }
+  size_t out = 0;
+  size_t pos = 0;
+  size_t erased = 0;
+  ids.ForEach([&](uint32_t id) {
+    if (erased < erased_ids.size() && erased_ids[erased] == id) {
+      ++erased;
+    } else {
+      commit_times[out++] = commit_times[pos];
+    }
+    ++pos;
+  });
+  commit_times.resize(out);
+  ids = RoaringBitmap::Difference(ids, RoaringBitmap::FromSorted(erased_ids));
+}
+
+// Passes the values with the parallel `ids` and `commit_times` to `callback`
+// in `mutation`, one call per distinct commit time.
+void ExportValues(
+    const ValueDictionary& dictionary, absl::Span<const uint32_t> ids,
+    absl::Span<const int64_t> commit_times, Mutation& mutation,
+    const std::function<void(const Mutation&)>& callback) {
+  absl::btree_map<int64_t, std::vector<uint32_t>> ids_by_commit_time;
+  for (size_t i = 0; i < ids.size(); ++i) {
+    ids_by_commit_time[commit_times[i]].push_back(ids[i]);
+  }
+  for (const auto& [logical_commit_time, value_ids] : ids_by_commit_time) {
+    mutation.logical_commit_time = logical_commit_time;
+    mutation.value_set = dictionary.GetValues(value_ids);
+    callback(mutation);
+  }
+}
+
+}  // namespace
+
+KeyValueCache::KeyValueCache(MetricsRecorder& metrics_recorder)
+    : KeyValueCache(metrics_recorder, std::make_shared<ValueDictionary>()) {}
+
+KeyValueCache::KeyValueCache(MetricsRecorder& metrics_recorder,
+                             std::shared_ptr<ValueDictionary> dictionary,
+                             ValueCompressionOptions compression)
+    : compression_(std::move(compression)),
+      decompressed_values_(compression_.threshold_bytes > 0 &&
+                                   compression_.decompressed_cache_bytes > 0
+                               ? std::make_unique<DecompressedValueCache>(
+                                     compression_.decompressed_cache_bytes)
+                               : nullptr),
+      metrics_recorder_(metrics_recorder),
+      dictionary_(std::move(dictionary)) {
+  metrics_recorder_.RegisterHistogram(
+      kRemovedTombstones, "Tombstones removed by a cache cleanup", "tombstone",
+      kTombstoneBucketBoundaries);
+  metrics_recorder_.RegisterHistogram(
+      kTombstoneReclaimedBytes, "Bytes reclaimed by a cache cleanup", "byte",
+      kBytesBucketBoundaries);
+  if (compression_.threshold_bytes > 0) {
+    metrics_recorder_.RegisterHistogram(
+        kValueCompressionRatio,
+        "Original size of a compressed cache value, in percent of its "
+        "compressed size",
+        "percent", kCompressionRatioBucketBoundaries);
+  }
+}
+
+KeyValueCache::EncodedValue KeyValueCache::EncodeValue(
+    std::string_view value) const {
+  EncodedValue encoded;
+  encoded.is_json = IsJsonValue(value);
+  // The compressor is never replaced once set, so a snapshot of it can be
+  // used without the map lock.
+  std::shared_ptr<const ValueCompressor> compressor;
+  if (MayCompress(value.size())) {
+    compressor = std::atomic_load(&compressor_);
+  }
+  std::optional<std::string> compressed_value;
+  if (compressor != nullptr) {
+    ScopeLatencyRecorder latency_recorder(kCompressValueEvent,
+                                          metrics_recorder_);
+    compressed_value = compressor->Compress(value);
+  }
+  if (!compressed_value.has_value()) {
+    encoded.value = absl::Cord(std::string(value));
+    return encoded;
+  }
+  metrics_recorder_.RecordHistogramEvent(
+      kValueCompressionRatio, value.size() * 100 / compressed_value->size());
+  encoded.value = absl::Cord(*std::move(compressed_value));
+  encoded.compressed = true;
+  return encoded;
+}
+
+void KeyValueCache::SampleValueLocked(const absl::Cord& buffer) {
+  if (!MayCompress(buffer.size()) ||
+      std::atomic_load(&compressor_) != nullptr ||
+      static_cast<int64_t>(compression_samples_.size()) >=
+          compression_.sample_bytes) {
+    return;
+  }
+  for (absl::string_view chunk : buffer.Chunks()) {
+    compression_samples_.append(chunk.data(), chunk.size());
+  }
+  compression_sample_sizes_.push_back(buffer.size());
+}
+
+bool KeyValueCache::MayCompress(int64_t size) const {
+  return compression_.threshold_bytes > 0 &&
+         size >= compression_.threshold_bytes;
+}
+
+std::optional<absl::Cord> KeyValueCache::DecodeValue(
+    std::string_view key, int64_t version, const absl::Cord& stored) const {
+  if (decompressed_values_ != nullptr) {
+    if (std::optional<absl::Cord> value =
+            decompressed_values_->Get(key, version);
+        value.has_value()) {
+      metrics_recorder_.IncrementEventCounter(kDecompressedValueCacheHit);
+      return value;
+    }
+    metrics_recorder_.IncrementEventCounter(kDecompressedValueCacheMiss);
+  }
+  // Set before any value was compressed.
+  const std::shared_ptr<const ValueCompressor> compressor =
+      std::atomic_load(&compressor_);
+  absl::StatusOr<std::string> value;
+  {
+    ScopeLatencyRecorder latency_recorder(kDecompressValueEvent,
+                                          metrics_recorder_);
+    // Stored values are a single flat buffer, so this doesn't copy.
+    if (auto flat = stored.TryFlat(); flat.has_value()) {
+      value = compressor->Decompress(*flat);
     } else {
-      VLOG(9) << "Get called for " << key
-              << ". returning value: " << *(key_iter->second.value);
-      kv_pairs.insert_or_assign(key, *(key_iter->second.value));
+      value = compressor->Decompress(std::string(stored));
     }
   }
+  if (!value.ok()) {
+    LOG(ERROR) << "Failed to read the value of " << key << ": "
+               << value.status();
+    return std::nullopt;
+  }
+  absl::Cord cord(*std::move(value));
+  if (decompressed_values_ != nullptr) {
+    decompressed_values_->Put(key, version, cord);
+  }
+  return cord;
+}
+
+void KeyValueCache::MaybeTrainCompressor() {
+  std::string samples;
+  std::vector<size_t> sample_sizes;
+  {
+    absl::MutexLock lock(&mutex_);
+    if (std::atomic_load(&compressor_) != nullptr || training_compressor_ ||
+        static_cast<int64_t>(compression_samples_.size()) <
+            compression_.sample_bytes) {
+      return;
+    }
+    training_compressor_ = true;
+    samples.swap(compression_samples_);
+    sample_sizes.swap(compression_sample_sizes_);
+  }
+  absl::StatusOr<std::string> dictionary = std::string();
+  if (!sample_sizes.empty()) {
+    ScopeLatencyRecorder latency_recorder(kTrainCompressionDictionaryEvent,
+                                          metrics_recorder_);
+    dictionary = ValueCompressor::TrainDictionary(
+        samples, sample_sizes, compression_.dictionary_bytes);
+  }
+  if (!dictionary.ok()) {
+    // Values still compress on their own, only not as well.
+    LOG(WARNING) << dictionary.status();
+    dictionary = std::string();
+  }
+  std::shared_ptr<const ValueCompressor> compressor =
+      ValueCompressor::Create(*std::move(dictionary), compression_.level);
+  absl::MutexLock lock(&mutex_);
+  std::atomic_store(&compressor_, std::move(compressor));
+  compression_samples_.clear();
+  compression_samples_.shrink_to_fit();
+  compression_sample_sizes_.clear();
+  compression_sample_sizes_.shrink_to_fit();
+}
+
+// Releases its pin when destroyed.
+class KeyValueCache::PinnedReadVersion : public ReadVersion {
+ public:
+  PinnedReadVersion(const KeyValueCache& cache, int shard, int64_t version)
+      : cache_(cache), shard_(shard), version_(version) {}
+  ~PinnedReadVersion() override { cache_.Unpin(shard_, version_); }
+
+  int64_t version() const { return version_; }
+
+ private:
+  const KeyValueCache& cache_;
+  const int shard_;
+  const int64_t version_;
+};
+
+const KeyValueCache::StoredValue* KeyValueCache::FindVisibleValue(
+    const CacheValue& cache_value, int64_t version) {
+  if (cache_value.version <= version) {
+    return &cache_value;
+  }
+  if (cache_value.past_values == nullptr) {
+    return nullptr;
+  }
+  // Past values are few, so a backward scan beats a binary search.
+  for (auto it = cache_value.past_values->rbegin();
+       it != cache_value.past_values->rend(); ++it) {
+    if (it->version <= version) {
+      return &*it;
+    }
+  }
+  return nullptr;
+}
+
+void KeyValueCache::AddValueLocked(std::string_view key,
+                                   const StoredValue& stored,
+                                   AddValue add_value,
+                                   std::vector<PendingValue>& pending) const {
+  if (!stored.value.has_value()) {
+    return;
+  }
+  if (stored.compressed) {
+    pending.push_back({.key = key,
+                       .version = stored.version,
+                       .value = *stored.value,
+                       .is_json = stored.is_json});
+    return;
+  }
+  VLOG(9) << "Get called for " << key << ". returning value: "
+          << *stored.value;
+  add_value(key, *stored.value, stored.is_json);
+}
+
+void KeyValueCache::AddPendingValue(const PendingValue& pending,
+                                    AddValue add_value) const {
+  std::optional<absl::Cord> value =
+      DecodeValue(pending.key, pending.version, pending.value);
+  if (!value.has_value()) {
+    return;
+  }
+  VLOG(9) << "Get called for " << pending.key
+          << ". returning value: " << *value;
+  add_value(pending.key, *std::move(value), pending.is_json);
+}
+
+void KeyValueCache::LookUp(const std::vector<std::string_view>& key_list,
+                           const ReadVersion* read_version,
+                           AddValue add_value) const {
+  ScopeLatencyRecorder latency_recorder(kGetKeyValuePairsEvent,
+                                        metrics_recorder_);
+  // Read versions passed to a cache always come from its own
+  // `PinReadVersion`.
+  const auto* pinned_version =
+      static_cast<const PinnedReadVersion*>(read_version);
+  // Keys are hashed before taking the lock.
+  const BatchedLookup<decltype(map_)> lookup(key_list);
+  // Values that need decompressing, which is done after the lock is
+  // released. They share the stored buffers meanwhile.
+  std::vector<PendingValue> pending;
+  {
+    absl::ReaderMutexLock lock(&mutex_);
+    for (size_t i = 0; i < lookup.keys().size(); ++i) {
+      const auto key_iter = lookup.Find(map_, i);
+      if (key_iter == map_.end()) {
+        continue;
+      }
+      const StoredValue* stored =
+          pinned_version == nullptr
+              ? &key_iter->second
+              : FindVisibleValue(key_iter->second, pinned_version->version());
+      if (stored != nullptr) {
+        AddValueLocked(lookup.keys()[i], *stored, add_value, pending);
+      }
+    }
+  }
+  for (const PendingValue& value : pending) {
+    AddPendingValue(value, add_value);
+  }
+}
+
+absl::flat_hash_map<std::string_view, absl::Cord>
+KeyValueCache::GetKeyValuePairs(
+    const std::vector<std::string_view>& key_list) const {
+  return GetKeyValuePairsAt(key_list, /*read_version=*/nullptr);
+}
+
+std::unique_ptr<ReadVersion> KeyValueCache::PinReadVersion() const {
+  absl::ReaderMutexLock lock(&mutex_);
+  const int shard = pinned_versions_.Pin(last_version_);
+  return std::make_unique<PinnedReadVersion>(*this, shard, last_version_);
+}
+
+void KeyValueCache::Unpin(int shard, int64_t version) const {
+  pinned_versions_.Unpin(shard, version);
+}
+
+absl::flat_hash_map<std::string_view, absl::Cord>
+KeyValueCache::GetKeyValuePairsAt(
+    const std::vector<std::string_view>& key_list,
+    const ReadVersion* read_version) const {
+  absl::flat_hash_map<std::string_view, absl::Cord> kv_pairs;
+  kv_pairs.reserve(key_list.size());
+  LookUp(key_list, read_version,
+         [&kv_pairs](std::string_view key, absl::Cord value, bool is_json) {
+           kv_pairs.emplace(key, std::move(value));
+         });
   return kv_pairs;
 }
 
+absl::flat_hash_map<std::string_view, google::protobuf::Value>
+KeyValueCache::GetValueProtosAt(
+    const std::vector<std::string_view>& key_list,
+    const ReadVersion* read_version) const {
+  // Values are parsed once the lookup released the map lock.
+  std::vector<PendingValue> values;
+  values.reserve(key_list.size());
+  LookUp(key_list, read_version,
+         [&values](std::string_view key, absl::Cord value, bool is_json) {
+           values.push_back(
+               {.key = key, .value = std::move(value), .is_json = is_json});
+         });
+  absl::flat_hash_map<std::string_view, google::protobuf::Value> value_protos;
+  value_protos.reserve(values.size());
+  for (PendingValue& value : values) {
+    value_protos.emplace(value.key,
+                         ToValueProto(value.value.Flatten(), value.is_json));
+  }
+  return value_protos;
+}
+
 std::unique_ptr<GetKeyValueSetResult> KeyValueCache::GetKeyValueSet(
     const absl::flat_hash_set<std::string_view>& key_set) const {
   ScopeLatencyRecorder latency_recorder(kGetKeyValueSetEvent,
                                         metrics_recorder_);
   // lock the cache map
   absl::ReaderMutexLock lock(&set_map_mutex_);
-  auto result = GetKeyValueSetResult::Create();
+  auto result = GetKeyValueSetResult::Create(*dictionary_);
   for (const auto& key : key_set) {
     VLOG(8) << "Getting key: " << key;
     const auto key_itr = key_to_value_set_map_.find(key);
     if (key_itr != key_to_value_set_map_.end()) {
-      absl::flat_hash_set<std::string_view> value_set;
-      auto set_lock =
-          std::make_unique<absl::ReaderMutexLock>(&key_itr->second->first);
-      for (const auto& v : key_itr->second->second) {
-        if (!v.second.is_deleted) {
-          value_set.emplace(v.first);
-        }
+      // Only the live values are returned. The result shares their current
+      // snapshot, so the set is only locked while the snapshot is taken.
+      std::shared_ptr<const LiveValues> live;
+      {
+        absl::ReaderMutexLock set_lock(&key_itr->second.mutex);
+        live = key_itr->second.value_set.live;
       }
-      // Add key value set to the result
-      result->AddKeyValueSet(key, std::move(value_set), std::move(set_lock));
+      const RoaringBitmap* value_ids = &live->ids;
+      result->AddKeyValueSet(key, std::shared_ptr<const RoaringBitmap>(
+                                      std::move(live), value_ids));
     }
   }
   return result;
@@ -93,8 +574,17 @@ void KeyValueCache::UpdateKeyValue(std::string_view key, std::string_view value,
                                         metrics_recorder_);
   VLOG(9) << "Received update for [" << key << "] at " << logical_commit_time
           << ". value will be set to: " << value;
-  absl::MutexLock lock(&mutex_);
+  EncodedValue encoded = EncodeValue(value);
+  {
+    absl::MutexLock lock(&mutex_);
+    UpdateKeyValueLocked(key, logical_commit_time, std::move(encoded));
+  }
+  MaybeTrainCompressor();
+}
 
+void KeyValueCache::UpdateKeyValueLocked(std::string_view key,
+                                         int64_t logical_commit_time,
+                                         EncodedValue encoded) {
   if (logical_commit_time <= max_cleanup_logical_commit_time_) {
     VLOG(1) << "Skipping the update as its logical_commit_time: "
             << logical_commit_time << " is older than the current cutoff time:"
@@ -113,19 +603,78 @@ void KeyValueCache::UpdateKeyValue(std::string_view key, std::string_view value,
     return;
   }
 
-  if (key_iter != map_.end() &&
-      key_iter->second.last_logical_commit_time < logical_commit_time &&
-      key_iter->second.value == nullptr) {
-    // should always have this, but checking just in case
-    auto dl_key_iter =
-        deleted_nodes_.find(key_iter->second.last_logical_commit_time);
-    if (dl_key_iter != deleted_nodes_.end() && dl_key_iter->second == key) {
-      deleted_nodes_.erase(dl_key_iter);
+  // The tombstone of a deleted key stays in `deleted_nodes_`, and the
+  // cleanup skips it once it finds the key updated.
+  if (key_iter == map_.end()) {
+    memory_counters_.AddKeyBytes(key.size());
+  }
+  // Cords adopt large strings without copying them again, so values are
+  // always stored as a single flat buffer.
+  if (!encoded.compressed) {
+    SampleValueLocked(encoded.value);
+  }
+  StoredValue stored;
+  stored.value = std::move(encoded.value);
+  stored.compressed = encoded.compressed;
+  stored.is_json = encoded.is_json;
+  memory_counters_.AddValueBytes(stored.bytes());
+  CacheValue& cache_value = map_.try_emplace(key).first->second;
+  SetValueLocked(key, cache_value, std::move(stored));
+  cache_value.last_logical_commit_time = logical_commit_time;
+}
+
+void KeyValueCache::SetValueLocked(std::string_view key,
+                                   CacheValue& cache_value,
+                                   StoredValue value) {
+  const int64_t version = ++last_version_;
+  // Version 0 marks a new entry, which no read version can see.
+  if (cache_value.version > 0) {
+    if (pinned_versions_.IsAnyPinned(cache_value.version,
+                                     std::numeric_limits<int64_t>::max())) {
+      if (cache_value.past_values == nullptr) {
+        cache_value.past_values =
+            std::make_unique<std::vector<StoredValue>>();
+        keys_with_past_values_.emplace(key);
+      }
+      // The bytes of the replaced value stay counted while it's kept.
+      cache_value.past_values->push_back(
+          std::move(static_cast<StoredValue&>(cache_value)));
+    } else {
+      memory_counters_.AddValueBytes(-cache_value.bytes());
     }
   }
+  static_cast<StoredValue&>(cache_value) = std::move(value);
+  cache_value.version = version;
+  if (cache_value.past_values != nullptr &&
+      !PrunePastValuesLocked(cache_value)) {
+    keys_with_past_values_.erase(key);
+  }
+}
 
-  map_.insert_or_assign(key, {.value = std::make_unique<std::string>(value),
-                              .last_logical_commit_time = logical_commit_time});
+bool KeyValueCache::PrunePastValuesLocked(CacheValue& cache_value) {
+  std::vector<StoredValue>& past_values = *cache_value.past_values;
+  // A past value is seen by the versions from its own up to that of the
+  // value that replaced it.
+  auto kept = past_values.begin();
+  for (auto it = past_values.begin(); it != past_values.end(); ++it) {
+    const int64_t replaced_at = it + 1 == past_values.end()
+                                    ? cache_value.version
+                                    : (it + 1)->version;
+    if (pinned_versions_.IsAnyPinned(it->version, replaced_at)) {
+      if (kept != it) {
+        *kept = std::move(*it);
+      }
+      ++kept;
+    } else {
+      memory_counters_.AddValueBytes(-it->bytes());
+    }
+  }
+  past_values.erase(kept, past_values.end());
+  if (past_values.empty()) {
+    cache_value.past_values.reset();
+    return false;
+  }
+  return true;
 }
 
 void KeyValueCache::UpdateKeyValueSet(
@@ -134,65 +683,19 @@ void KeyValueCache::UpdateKeyValueSet(
   ScopeLatencyRecorder latency_recorder(kUpdateKeyValueSetEvent,
                                         metrics_recorder_);
   VLOG(9) << "Received update for [" << key << "] at " << logical_commit_time;
-  std::unique_ptr<absl::MutexLock> key_lock;
-  absl::flat_hash_map<std::string, SetValueMeta>* existing_value_set;
-  // The max cleanup time needs to be locked before doing this comparison
-  {
-    absl::MutexLock lock_map(&set_map_mutex_);
-
-    if (logical_commit_time <= max_cleanup_logical_commit_time_for_set_cache_) {
-      VLOG(1) << "Skipping the update as its logical_commit_time: "
-              << logical_commit_time
-              << " is older than the current cutoff time:"
-              << max_cleanup_logical_commit_time_for_set_cache_;
-      return;
-    } else if (input_value_set.empty()) {
-      VLOG(1) << "Skipping the update as it has no value in the set.";
-      return;
-    }
-    auto key_itr = key_to_value_set_map_.find(key);
-    if (key_itr == key_to_value_set_map_.end()) {
-      VLOG(9) << key << " is a new key. Adding it";
-      // There is no existing value set for the given key,
-      // simply insert the key value set to the map, no need to update deleted
-      // set nodes
-      auto mutex_value_map_pair = std::make_unique<std::pair<
-          absl::Mutex, absl::flat_hash_map<std::string, SetValueMeta>>>();
-
-      for (const auto& value : input_value_set) {
-        mutex_value_map_pair->second.emplace(
-            value, SetValueMeta{logical_commit_time, /*is_deleted=*/false});
-      }
-      key_to_value_set_map_.emplace(key, std::move(mutex_value_map_pair));
-      return;
-    }
-    // The given key has an existing value set, then
-    // update the existing value if update is suggested by the comparison result
-    // on the logical commit times.
-    // Lock the key
-    key_lock = std::make_unique<absl::MutexLock>(&key_itr->second->first);
-    existing_value_set = &key_itr->second->second;
-  }  // end locking map;
-
-  for (const auto& value : input_value_set) {
-    auto& current_value_state = (*existing_value_set)[value];
-    if (current_value_state.last_logical_commit_time >= logical_commit_time) {
-      // no need to update
-      continue;
-    }
-    // Insert new value or update existing value with
-    // the recent logical commit time. If the existing value was marked
-    // deleted, update is_deleted boolean to false
-    current_value_state.is_deleted = false;
-    current_value_state.last_logical_commit_time = logical_commit_time;
-  }
-  // end locking key
+  MutateValueSet(key, input_value_set, logical_commit_time,
+                 /*deleted=*/false);
 }
 
 void KeyValueCache::DeleteKey(std::string_view key,
                               int64_t logical_commit_time) {
   ScopeLatencyRecorder latency_recorder(kDeleteKeyEvent, metrics_recorder_);
   absl::MutexLock lock(&mutex_);
+  DeleteKeyLocked(key, logical_commit_time);
+}
+
+void KeyValueCache::DeleteKeyLocked(std::string_view key,
+                                    int64_t logical_commit_time) {
   if (logical_commit_time <= max_cleanup_logical_commit_time_) {
     return;
   }
@@ -203,11 +706,15 @@ void KeyValueCache::DeleteKey(std::string_view key,
     // If key is missing, we still need to add a null value to the map to
     // avoid the late coming update with smaller logical commit time
     // inserting value to the map for the given key
-    map_.insert_or_assign(
-        key,
-        {.value = nullptr, .last_logical_commit_time = logical_commit_time});
+    if (key_iter == map_.end()) {
+      memory_counters_.AddKeyBytes(key.size());
+    }
+    CacheValue& cache_value = map_.try_emplace(key).first->second;
+    SetValueLocked(key, cache_value, StoredValue());
+    cache_value.last_logical_commit_time = logical_commit_time;
 
-    auto result = deleted_nodes_.emplace(logical_commit_time, key);
+    deleted_nodes_.Add(logical_commit_time, key);
+    memory_counters_.AddTombstoneBytes(TombstoneIndex::KeyBytes(key));
   }
 }
 
@@ -216,136 +723,544 @@ void KeyValueCache::DeleteValuesInSet(std::string_view key,
                                       int64_t logical_commit_time) {
   ScopeLatencyRecorder latency_recorder(kDeleteValuesInSetEvent,
                                         metrics_recorder_);
-  std::unique_ptr<absl::MutexLock> key_lock;
-  absl::flat_hash_map<std::string, SetValueMeta>* existing_value_set;
-  // The max cleanup time needs to be locked before doing this comparison
+  // Deleted values are added to the set in deleted state, even if the key or
+  // the values are missing, to avoid late arriving updates with smaller
+  // logical commit time inserting the same values.
+  MutateValueSet(key, value_set, logical_commit_time, /*deleted=*/true);
+}
+
+void KeyValueCache::MutateValueSet(std::string_view key,
+                                   absl::Span<std::string_view> values,
+                                   int64_t logical_commit_time, bool deleted) {
+  if (values.empty()) {
+    VLOG(1) << "Skipping the update as it has no value in the set.";
+    return;
+  }
+  // Values are interned before taking the cache locks. The references that
+  // the set doesn't keep are released once the key is unlocked.
+  const std::vector<uint32_t> value_ids = InternSorted(*dictionary_, values);
+  std::vector<uint32_t> unused_ids;
+  std::vector<uint32_t> deleted_ids;
   {
+    std::unique_ptr<absl::MutexLock> key_lock;
+    ValueSet* value_set;
+    // The max cleanup time needs to be locked before doing this comparison
+    {
+      absl::MutexLock lock_map(&set_map_mutex_);
+      if (logical_commit_time <=
+          max_cleanup_logical_commit_time_for_set_cache_) {
+        VLOG(1) << "Skipping the update as its logical_commit_time: "
+                << logical_commit_time
+                << " is older than the current cutoff time:"
+                << max_cleanup_logical_commit_time_for_set_cache_;
+        dictionary_->Release(value_ids);
+        return;
+      }
+      auto& locked_value_set = FindOrInsertValueSet(key);
+      // Lock the key
+      key_lock = std::make_unique<absl::MutexLock>(&locked_value_set.mutex);
+      value_set = &locked_value_set.value_set;
+    }  // end locking map
+    ApplyToValueSetAndCount(*value_set, value_ids, logical_commit_time,
+                            deleted, unused_ids, deleted_ids);
+  }  // end locking key
+  dictionary_->Release(unused_ids);
+  if (!deleted_ids.empty()) {
+    // The key lock is released before locking the map to avoid potential
+    // deadlock caused by cycle in the ordering of lock acquisitions
     absl::MutexLock lock_map(&set_map_mutex_);
+    AddDeletedSetNode(key, logical_commit_time);
+  }
+}
 
-    if (logical_commit_time <= max_cleanup_logical_commit_time_for_set_cache_ ||
-        value_set.empty()) {
-      return;
-    }
-    auto key_itr = key_to_value_set_map_.find(key);
-    if (key_itr == key_to_value_set_map_.end()) {
-      // If the key is missing, still need to add all the deleted values to the
-      // map to avoid late arriving update with smaller logical commit time
-      // inserting values same as the deleted ones for the key
-      auto mutex_value_map_pair = std::make_unique<std::pair<
-          absl::Mutex, absl::flat_hash_map<std::string, SetValueMeta>>>();
-
-      for (const auto& value : value_set) {
-        mutex_value_map_pair->second.emplace(
-            value, SetValueMeta{logical_commit_time, /*is_deleted=*/true});
+void KeyValueCache::MutateValueSets(absl::Span<Mutation* const> mutations) {
+  // Values are interned before taking the cache locks, as in
+  // `MutateValueSet`.
+  std::vector<std::vector<uint32_t>> value_ids;
+  value_ids.reserve(mutations.size());
+  for (const Mutation* mutation : mutations) {
+    value_ids.push_back(InternSorted(*dictionary_, mutation->value_set));
+  }
+  std::vector<uint32_t> unused_ids;
+  std::vector<uint32_t> deleted_ids;
+  {
+    absl::MutexLock lock_map(&set_map_mutex_);
+    for (size_t i = 0; i < mutations.size(); ++i) {
+      const Mutation& mutation = *mutations[i];
+      if (value_ids[i].empty()) {
+        continue;
       }
-      key_to_value_set_map_.emplace(key, std::move(mutex_value_map_pair));
-      // Add to deleted set nodes
-      for (const std::string_view value : value_set) {
-        deleted_set_nodes_[logical_commit_time][key].emplace(value);
+      if (mutation.logical_commit_time <=
+          max_cleanup_logical_commit_time_for_set_cache_) {
+        unused_ids.insert(unused_ids.end(), value_ids[i].begin(),
+                          value_ids[i].end());
+        continue;
+      }
+      auto& [key_mutex, value_set] = FindOrInsertValueSet(mutation.key);
+      deleted_ids.clear();
+      {
+        // Keys are always locked after the map, so holding the map lock
+        // while locking the key keeps the lock ordering of `MutateValueSet`.
+        absl::MutexLock key_lock(&key_mutex);
+        ApplyToValueSetAndCount(
+            value_set, value_ids[i], mutation.logical_commit_time,
+            mutation.type == Mutation::Type::kDeleteValuesInSet, unused_ids,
+            deleted_ids);
+      }
+      if (!deleted_ids.empty()) {
+        AddDeletedSetNode(mutation.key, mutation.logical_commit_time);
       }
-      return;
     }
-    // Lock the key
-    key_lock = std::make_unique<absl::MutexLock>(&key_itr->second->first);
-    existing_value_set = &key_itr->second->second;
   }  // end locking map
-  // Keep track of the values to be added to the deleted set nodes
-  std::vector<std::string_view> values_to_delete;
-  for (const auto& value : value_set) {
-    auto& current_value_state = (*existing_value_set)[value];
-    if (current_value_state.last_logical_commit_time >= logical_commit_time) {
-      // No need to delete
+  dictionary_->Release(unused_ids);
+}
+
+KeyValueCache::LiveValues::~LiveValues() {
+  if (retained) {
+    dictionary.Release(ids.ToVector());
+  }
+}
+
+void KeyValueCache::LiveValues::Retain() {
+  dictionary.Retain(ids.ToVector());
+  retained = true;
+}
+
+KeyValueCache::LockedValueSet& KeyValueCache::FindOrInsertValueSet(
+    std::string_view key) {
+  auto key_itr = key_to_value_set_map_.find(key);
+  if (key_itr == key_to_value_set_map_.end()) {
+    VLOG(9) << key << " is a new key. Adding it";
+    memory_counters_.AddKeyBytes(key.size());
+    key_itr = key_to_value_set_map_.try_emplace(key, *dictionary_).first;
+  }
+  return key_itr->second;
+}
+
+void KeyValueCache::ApplyToValueSetAndCount(
+    ValueSet& value_set, absl::Span<const uint32_t> value_ids,
+    int64_t logical_commit_time, bool deleted,
+    std::vector<uint32_t>& unused_ids, std::vector<uint32_t>& deleted_ids) {
+  const int64_t num_live = value_set.commit_times.size();
+  const int64_t num_deleted = value_set.deleted_ids.size();
+  // The set is locked, so no lookup can take another reference on the
+  // snapshot while it's checked.
+  if (value_set.live.use_count() > 1) {
+    value_set.live->Retain();
+    value_set.live =
+        std::make_shared<LiveValues>(*dictionary_, value_set.live->ids);
+  }
+  ApplyToValueSet(value_set, value_ids, logical_commit_time, deleted,
+                  unused_ids, deleted_ids);
+  memory_counters_.AddSetMemberBytes(
+      (static_cast<int64_t>(value_set.commit_times.size()) - num_live) *
+      MemoryCounters::kSetMemberBytes);
+  memory_counters_.AddTombstoneBytes(
+      (static_cast<int64_t>(value_set.deleted_ids.size()) - num_deleted) *
+      MemoryCounters::kSetMemberBytes);
+}
+
+void KeyValueCache::AddDeletedSetNode(std::string_view key,
+                                      int64_t logical_commit_time) {
+  // The set may have been cleaned up since its values were deleted, along
+  // with them.
+  const auto key_itr = key_to_value_set_map_.find(key);
+  if (key_itr == key_to_value_set_map_.end()) {
+    return;
+  }
+  std::vector<ValueSetMap::value_type*>& deleted_sets =
+      deleted_set_nodes_[logical_commit_time];
+  // Deletions of the same key at the same time usually arrive in a row.
+  if (!deleted_sets.empty() && deleted_sets.back() == &*key_itr) {
+    return;
+  }
+  deleted_sets.push_back(&*key_itr);
+  ++key_itr->second.value_set.tombstone_refs;
+  memory_counters_.AddTombstoneBytes(sizeof(ValueSetMap::value_type*));
+}
+
+void KeyValueCache::ApplyToValueSet(ValueSet& value_set,
+                                    absl::Span<const uint32_t> value_ids,
+                                    int64_t logical_commit_time, bool deleted,
+                                    std::vector<uint32_t>& unused_ids,
+                                    std::vector<uint32_t>& deleted_ids) {
+  // Values move between the live and deleted values depending on their most
+  // recent mutation. The moves are applied once all values are checked.
+  std::vector<uint32_t> inserted_ids;
+  std::vector<uint32_t> moved_ids;
+  RoaringBitmap& live_ids = value_set.live->ids;
+  for (uint32_t id : value_ids) {
+    const int64_t live_pos = live_ids.Contains(id) ? live_ids.Rank(id) : -1;
+    const int64_t deleted_pos = FindId(value_set.deleted_ids, id);
+    if (live_pos < 0 && deleted_pos < 0) {
+      inserted_ids.push_back(id);
+      if (deleted) {
+        deleted_ids.push_back(id);
+      }
       continue;
     }
-    // Add a value that represents a deleted value, or mark the existing value
-    // deleted. We need to add the value in deleted state to the map to avoid
-    // late arriving update with smaller logical commit time
-    // inserting the same value
-    current_value_state.last_logical_commit_time = logical_commit_time;
-    current_value_state.is_deleted = true;
-    values_to_delete.push_back(value);
-  }
-  if (!values_to_delete.empty()) {
-    // Release key lock before locking the map to avoid potential deadlock
-    // caused by cycle in the ordering of lock acquisitions
-    key_lock.reset();
-    absl::MutexLock lock_map(&set_map_mutex_);
-    for (const std::string_view value : values_to_delete) {
-      deleted_set_nodes_[logical_commit_time][key].emplace(value);
+    // The set already holds a reference to the value.
+    unused_ids.push_back(id);
+    int64_t& current_commit_time =
+        live_pos >= 0 ? value_set.commit_times[live_pos]
+                      : value_set.deleted_commit_times[deleted_pos];
+    if (current_commit_time >= logical_commit_time) {
+      // no need to update
+      continue;
+    }
+    if (deleted) {
+      deleted_ids.push_back(id);
+    }
+    if ((live_pos >= 0) != deleted) {
+      current_commit_time = logical_commit_time;
+    } else {
+      moved_ids.push_back(id);
+      inserted_ids.push_back(id);
+    }
+  }
+  if (deleted) {
+    EraseFromBitmap(live_ids, value_set.commit_times, moved_ids);
+    InsertSorted(value_set.deleted_ids, value_set.deleted_commit_times,
+                 inserted_ids, logical_commit_time);
+  } else {
+    EraseSorted(value_set.deleted_ids, value_set.deleted_commit_times,
+                moved_ids);
+    InsertIntoBitmap(live_ids, value_set.commit_times, inserted_ids,
+                     logical_commit_time);
+  }
+}
+
+void KeyValueCache::ApplyBatch(absl::Span<Mutation> mutations) {
+  ScopeLatencyRecorder latency_recorder(kApplyBatchEvent, metrics_recorder_);
+  std::vector<Mutation*> set_mutations;
+  // Values are checked or compressed before taking the lock, one per
+  // mutation.
+  std::vector<EncodedValue> encoded_values(mutations.size());
+  for (size_t i = 0; i < mutations.size(); ++i) {
+    if (mutations[i].type == Mutation::Type::kUpdateKeyValue) {
+      encoded_values[i] = EncodeValue(mutations[i].value);
+    }
+  }
+  {
+    absl::MutexLock lock(&mutex_);
+    for (size_t i = 0; i < mutations.size(); ++i) {
+      Mutation& mutation = mutations[i];
+      switch (mutation.type) {
+        case Mutation::Type::kUpdateKeyValue:
+          UpdateKeyValueLocked(mutation.key, mutation.logical_commit_time,
+                               std::move(encoded_values[i]));
+          break;
+        case Mutation::Type::kDeleteKey:
+          DeleteKeyLocked(mutation.key, mutation.logical_commit_time);
+          break;
+        case Mutation::Type::kUpdateKeyValueSet:
+        case Mutation::Type::kDeleteValuesInSet:
+          set_mutations.push_back(&mutation);
+          break;
+      }
     }
   }
+  if (!set_mutations.empty()) {
+    MutateValueSets(set_mutations);
+  }
+  MaybeTrainCompressor();
 }
 
 void KeyValueCache::RemoveDeletedKeys(int64_t logical_commit_time) {
   ScopeLatencyRecorder latency_recorder(kRemoveDeletedKeysEvent,
                                         metrics_recorder_);
-  CleanUpKeyValueMap(logical_commit_time);
-  CleanUpKeyValueSetMap(logical_commit_time);
+  const CleanUpStats map_stats = CleanUpKeyValueMap(logical_commit_time);
+  RemoveUnpinnedPastValues();
+  const CleanUpStats set_map_stats =
+      CleanUpKeyValueSetMap(logical_commit_time);
+  metrics_recorder_.RecordHistogramEvent(
+      kRemovedTombstones,
+      map_stats.removed_tombstones + set_map_stats.removed_tombstones);
+  metrics_recorder_.RecordHistogramEvent(
+      kTombstoneReclaimedBytes,
+      map_stats.reclaimed_bytes + set_map_stats.reclaimed_bytes);
 }
 
-void KeyValueCache::CleanUpKeyValueMap(int64_t logical_commit_time) {
+KeyValueCache::CleanUpStats KeyValueCache::CleanUpKeyValueMap(
+    int64_t logical_commit_time) {
   ScopeLatencyRecorder latency_recorder(kCleanUpKeyValueMapEvent,
                                         metrics_recorder_);
-  absl::MutexLock lock(&mutex_);
-  auto it = deleted_nodes_.begin();
-
-  while (it != deleted_nodes_.end()) {
-    if (it->first > logical_commit_time) {
-      break;
+  CleanUpStats stats;
+  {
+    // Raised before the first slice, so that updates older than the cleanup
+    // made between slices are dropped rather than bringing back the keys
+    // whose tombstones were already removed.
+    absl::MutexLock lock(&mutex_);
+    max_cleanup_logical_commit_time_ =
+        std::max(max_cleanup_logical_commit_time_, logical_commit_time);
+  }
+  bool done = false;
+  while (!done) {
+    absl::MutexLock lock(&mutex_);
+    ScopeLatencyRecorder pause_recorder(kTombstoneCleanUpPauseEvent,
+                                        metrics_recorder_);
+    CleanUpSlice slice;
+    std::optional<TombstoneIndex::Tombstone> tombstone;
+    while ((tombstone = deleted_nodes_.Peek(logical_commit_time)).has_value() &&
+           slice.TryTake()) {
+      // The key may have been updated since, or already removed if it was
+      // deleted more than once. Keys with past values are removed once those
+      // are dropped.
+      auto key_iter = map_.find(tombstone->key);
+      if (key_iter != map_.end() && !key_iter->second.value.has_value() &&
+          key_iter->second.last_logical_commit_time <= logical_commit_time &&
+          key_iter->second.past_values == nullptr) {
+        stats.reclaimed_bytes += key_iter->first.size();
+        memory_counters_.AddKeyBytes(
+            -static_cast<int64_t>(key_iter->first.size()));
+        map_.erase(key_iter);
+      }
+      const int64_t tombstone_bytes = TombstoneIndex::KeyBytes(tombstone->key);
+      stats.reclaimed_bytes += tombstone_bytes;
+      memory_counters_.AddTombstoneBytes(-tombstone_bytes);
+      ++stats.removed_tombstones;
+      deleted_nodes_.Pop();
     }
+    done = !tombstone.has_value();
+  }
+  return stats;
+}
 
-    // should always have this, but checking just in case
-    auto key_iter = map_.find(it->second);
-    if (key_iter != map_.end() && key_iter->second.value == nullptr &&
-        key_iter->second.last_logical_commit_time <= logical_commit_time) {
+void KeyValueCache::RemoveUnpinnedPastValues() {
+  absl::MutexLock lock(&mutex_);
+  for (auto it = keys_with_past_values_.begin();
+       it != keys_with_past_values_.end();) {
+    auto key_iter = map_.find(*it);
+    if (key_iter != map_.end() && PrunePastValuesLocked(key_iter->second)) {
+      ++it;
+      continue;
+    }
+    if (key_iter != map_.end() && !key_iter->second.value.has_value() &&
+        key_iter->second.last_logical_commit_time <=
+            max_cleanup_logical_commit_time_) {
+      // The tombstone was cleaned up while the past values were kept.
+      memory_counters_.AddKeyBytes(
+          -static_cast<int64_t>(key_iter->first.size()));
       map_.erase(key_iter);
     }
-
-    ++it;
+    keys_with_past_values_.erase(it++);
   }
-  deleted_nodes_.erase(deleted_nodes_.begin(), it);
-  max_cleanup_logical_commit_time_ =
-      std::max(max_cleanup_logical_commit_time_, logical_commit_time);
 }
 
-void KeyValueCache::CleanUpKeyValueSetMap(int64_t logical_commit_time) {
+KeyValueCache::CleanUpStats KeyValueCache::CleanUpKeyValueSetMap(
+    int64_t logical_commit_time) {
   ScopeLatencyRecorder latency_recorder(kCleanUpKeyValueSetMapEvent,
                                         metrics_recorder_);
-  absl::MutexLock lock_set_map(&set_map_mutex_);
-  auto delete_itr = deleted_set_nodes_.begin();
-  while (delete_itr != deleted_set_nodes_.end()) {
-    if (delete_itr->first > logical_commit_time) {
-      break;
-    }
-    for (const auto& [key, values] : delete_itr->second) {
-      if (auto key_itr = key_to_value_set_map_.find(key);
-          key_itr != key_to_value_set_map_.end()) {
-        absl::MutexLock(&key_itr->second->first);
-        for (const auto& v_to_delete : values) {
-          auto existing_value_itr = key_itr->second->second.find(v_to_delete);
-          if (existing_value_itr != key_itr->second->second.end() &&
-              existing_value_itr->second.is_deleted &&
-              existing_value_itr->second.last_logical_commit_time <=
-                  logical_commit_time) {
-            // Delete the existing value that is marked deleted from set
-            key_itr->second->second.erase(existing_value_itr);
+  CleanUpStats stats;
+  {
+    // Raised before the first slice, as in `CleanUpKeyValueMap`.
+    absl::MutexLock lock_set_map(&set_map_mutex_);
+    max_cleanup_logical_commit_time_for_set_cache_ = std::max(
+        max_cleanup_logical_commit_time_for_set_cache_, logical_commit_time);
+  }
+  bool done = false;
+  while (!done) {
+    absl::MutexLock lock_set_map(&set_map_mutex_);
+    ScopeLatencyRecorder pause_recorder(kTombstoneCleanUpPauseEvent,
+                                        metrics_recorder_);
+    CleanUpSlice slice;
+    while (!deleted_set_nodes_.empty() &&
+           deleted_set_nodes_.begin()->first <= logical_commit_time) {
+      // Sets are popped from the node as they are cleaned up, so that the
+      // next slice resumes where this one stopped.
+      auto& deleted_sets = deleted_set_nodes_.begin()->second;
+      while (!deleted_sets.empty() && slice.TryTake()) {
+        auto& [key, locked_value_set] = *deleted_sets.back();
+        auto& [key_mutex, value_set] = locked_value_set;
+        deleted_sets.pop_back();
+        --value_set.tombstone_refs;
+        stats.reclaimed_bytes += sizeof(ValueSetMap::value_type*);
+        memory_counters_.AddTombstoneBytes(
+            -static_cast<int64_t>(sizeof(ValueSetMap::value_type*)));
+        bool is_empty;
+        {
+          absl::MutexLock key_lock(&key_mutex);
+          // Deletions of the set at later times in the sweep are cleaned up
+          // along with this one, and their nodes then find nothing left.
+          std::vector<uint32_t> erased_ids;
+          for (size_t i = 0; i < value_set.deleted_ids.size(); ++i) {
+            if (value_set.deleted_commit_times[i] <= logical_commit_time) {
+              erased_ids.push_back(value_set.deleted_ids[i]);
+            }
           }
+          // Delete the existing values that are marked deleted from set
+          EraseSorted(value_set.deleted_ids, value_set.deleted_commit_times,
+                      erased_ids);
+          dictionary_->Release(erased_ids);
+          stats.removed_tombstones += erased_ids.size();
+          const int64_t erased_bytes =
+              erased_ids.size() * MemoryCounters::kSetMemberBytes;
+          stats.reclaimed_bytes += erased_bytes;
+          memory_counters_.AddTombstoneBytes(-erased_bytes);
+          is_empty =
+              value_set.live->ids.empty() && value_set.deleted_ids.empty();
         }
-        if (key_itr->second->second.empty()) {
-          // If the value set is empty, erase the key-value_set from cache map
+        if (is_empty && value_set.tombstone_refs == 0) {
+          // If the value set is empty, erase the key-value_set from cache
+          // map
+          stats.reclaimed_bytes += key.size();
+          memory_counters_.AddKeyBytes(-static_cast<int64_t>(key.size()));
           key_to_value_set_map_.erase(key);
         }
       }
+      if (!deleted_sets.empty()) {
+        break;
+      }
+      deleted_set_nodes_.erase(deleted_set_nodes_.begin());
+    }
+    done = deleted_set_nodes_.empty() ||
+           deleted_set_nodes_.begin()->first > logical_commit_time;
+  }
+  return stats;
+}
+
+CacheMemoryUsage KeyValueCache::GetMemoryUsage() const {
+  CacheMemoryUsage usage = memory_counters_.Get();
+  usage.interned_value_bytes = dictionary_->bytes();
+  if (decompressed_values_ != nullptr) {
+    usage.decompressed_value_bytes = decompressed_values_->bytes();
+  }
+  return usage;
+}
+
+void KeyValueCache::ExportMutations(
+    const std::function<void(const Mutation&)>& callback) const {
+  // The keys are collected first, and their entries then copied a chunk at a
+  // time, so that updates are only held back while a chunk is copied rather
+  // than while the mutations are written. An entry updated meanwhile is
+  // exported as it is when its chunk is copied.
+  std::vector<std::string> keys;
+  {
+    absl::ReaderMutexLock lock(&mutex_);
+    keys.reserve(map_.size());
+    for (const auto& [key, cache_value] : map_) {
+      keys.push_back(key);
+    }
+  }
+  struct ExportedPair {
+    std::string_view key;
+    StoredValue stored;
+    int64_t logical_commit_time;
+  };
+  std::vector<ExportedPair> pairs;
+  Mutation mutation;
+  std::string value;
+  for (size_t begin = 0; begin < keys.size(); begin += kKeysPerExportChunk) {
+    const size_t end = std::min(keys.size(), begin + kKeysPerExportChunk);
+    pairs.clear();
+    {
+      absl::ReaderMutexLock lock(&mutex_);
+      for (size_t i = begin; i < end; ++i) {
+        // The key may have been removed since.
+        if (const auto key_iter = map_.find(keys[i]); key_iter != map_.end()) {
+          pairs.push_back({.key = keys[i],
+                           .stored = key_iter->second,
+                           .logical_commit_time =
+                               key_iter->second.last_logical_commit_time});
+        }
+      }
+    }
+    for (const ExportedPair& pair : pairs) {
+      mutation.key = pair.key;
+      mutation.logical_commit_time = pair.logical_commit_time;
+      if (pair.stored.value.has_value()) {
+        mutation.type = Mutation::Type::kUpdateKeyValue;
+        absl::CopyCordToString(*pair.stored.value, &value);
+        if (pair.stored.compressed) {
+          absl::StatusOr<std::string> decompressed =
+              std::atomic_load(&compressor_)->Decompress(value);
+          if (!decompressed.ok()) {
+            LOG(ERROR) << "Failed to export the value of " << pair.key << ": "
+                       << decompressed.status();
+            continue;
+          }
+          value = *std::move(decompressed);
+        }
+        mutation.value = value;
+      } else {
+        mutation.type = Mutation::Type::kDeleteKey;
+        mutation.value = {};
+      }
+      callback(mutation);
+    }
+  }
+  mutation.value = {};
+
+  std::vector<std::string> set_keys;
+  {
+    absl::ReaderMutexLock lock(&set_map_mutex_);
+    set_keys.reserve(key_to_value_set_map_.size());
+    for (const auto& [key, locked_value_set] : key_to_value_set_map_) {
+      set_keys.push_back(key);
+    }
+  }
+  // The live values are kept by their snapshot, which is copied before the
+  // set is mutated again, and the deleted values by references taken on
+  // them.
+  struct ExportedSet {
+    std::string_view key;
+    std::shared_ptr<const LiveValues> live;
+    std::vector<int64_t> commit_times;
+    std::vector<uint32_t> deleted_ids;
+    std::vector<int64_t> deleted_commit_times;
+  };
+  std::vector<ExportedSet> sets;
+  for (size_t begin = 0; begin < set_keys.size();
+       begin += kKeysPerExportChunk) {
+    const size_t end = std::min(set_keys.size(), begin + kKeysPerExportChunk);
+    sets.clear();
+    {
+      absl::ReaderMutexLock lock(&set_map_mutex_);
+      for (size_t i = begin; i < end; ++i) {
+        const auto key_iter = key_to_value_set_map_.find(set_keys[i]);
+        if (key_iter == key_to_value_set_map_.end()) {
+          continue;
+        }
+        absl::ReaderMutexLock set_lock(&key_iter->second.mutex);
+        const ValueSet& value_set = key_iter->second.value_set;
+        dictionary_->Retain(value_set.deleted_ids);
+        sets.push_back(
+            {.key = set_keys[i],
+             .live = value_set.live,
+             .commit_times = value_set.commit_times,
+             .deleted_ids = value_set.deleted_ids,
+             .deleted_commit_times = value_set.deleted_commit_times});
+      }
+    }
+    for (const ExportedSet& set : sets) {
+      mutation.key = set.key;
+      mutation.type = Mutation::Type::kUpdateKeyValueSet;
+      ExportValues(*dictionary_, set.live->ids.ToVector(), set.commit_times,
+                   mutation, callback);
+      mutation.type = Mutation::Type::kDeleteValuesInSet;
+      ExportValues(*dictionary_, set.deleted_ids, set.deleted_commit_times,
+                   mutation, callback);
+      dictionary_->Release(set.deleted_ids);
     }
-    ++delete_itr;
   }
-  deleted_set_nodes_.erase(deleted_set_nodes_.begin(), delete_itr);
-  max_cleanup_logical_commit_time_for_set_cache_ = std::max(
-      max_cleanup_logical_commit_time_for_set_cache_, logical_commit_time);
 }
 
 std::unique_ptr<Cache> KeyValueCache::Create(
     MetricsRecorder& metrics_recorder) {
   return absl::WrapUnique(new KeyValueCache(metrics_recorder));
 }
+
+std::unique_ptr<Cache> KeyValueCache::Create(
+    MetricsRecorder& metrics_recorder,
+    std::shared_ptr<ValueDictionary> dictionary) {
+  return absl::WrapUnique(
+      new KeyValueCache(metrics_recorder, std::move(dictionary)));
+}
+
+std::unique_ptr<Cache> KeyValueCache::Create(
+    MetricsRecorder& metrics_recorder, ValueCompressionOptions compression) {
+  return absl::WrapUnique(
+      new KeyValueCache(metrics_recorder, std::make_shared<ValueDictionary>(),
+                        std::move(compression)));
+}
 }  // namespace kv_server
@@ -17,9 +17,10 @@
 #ifndef COMPONENTS_DATA_SERVER_CACHE_KEY_VALUE_CACHE_H_
 #define COMPONENTS_DATA_SERVER_CACHE_KEY_VALUE_CACHE_H_
 
+#include <functional>
 #include <iostream>
-#include <map>
 #include <memory>
+#include <optional>
 #include <string>
 #include <string_view>
 #include <unordered_map>
@@ -29,24 +30,64 @@
 #include "absl/container/btree_map.h"
 #include "absl/container/flat_hash_map.h"
 #include "absl/container/flat_hash_set.h"
+#include "absl/container/node_hash_map.h"
+#include "absl/functional/function_ref.h"
+#include "absl/strings/cord.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/types/span.h"
 #include "components/data_server/cache/cache.h"
+#include "components/data_server/cache/decompressed_value_cache.h"
 #include "components/data_server/cache/get_key_value_set_result.h"
+#include "components/data_server/cache/memory_counters.h"
+#include "components/data_server/cache/pinned_versions.h"
+#include "components/data_server/cache/tombstone_index.h"
+#include "components/data_server/cache/value_compressor.h"
+#include "components/data_server/cache/value_dictionary.h"
+#include "components/query/roaring_bitmap.h"
 #include "public/base_types.pb.h"
 #include "src/cpp/telemetry/metrics_recorder.h"
 
 namespace kv_server {
 // In-memory datastore.
+//
+// Values of key-value pairs may be compressed, see `ValueCompressionOptions`.
+// The first values above the threshold are stored as they are and sampled,
+// and once enough are sampled a dictionary is trained from them and later
+// values are compressed with it. Values are decompressed when they're looked
+// up, and the most recently read ones are kept decompressed.
 // One cache object is only for keys in one namespace.
 class KeyValueCache : public Cache {
  public:
+  explicit KeyValueCache(
+      privacy_sandbox::server_common::MetricsRecorder& metrics_recorder);
+
+  // Interns set values in `dictionary`, which may be shared with other
+  // caches.
   KeyValueCache(
-      privacy_sandbox::server_common::MetricsRecorder& metrics_recorder)
-      : metrics_recorder_(metrics_recorder) {}
+      privacy_sandbox::server_common::MetricsRecorder& metrics_recorder,
+      std::shared_ptr<ValueDictionary> dictionary,
+      ValueCompressionOptions compression = {});
 
   // Looks up and returns key-value pairs for the given keys.
-  absl::flat_hash_map<std::string, std::string> GetKeyValuePairs(
+  absl::flat_hash_map<std::string_view, absl::Cord> GetKeyValuePairs(
       const std::vector<std::string_view>& key_list) const override;
 
+  // Pinning is cheap, and values are only kept past their replacement while
+  // a version that can see them is pinned.
+  std::unique_ptr<ReadVersion> PinReadVersion() const override;
+
+  // Each call takes the map lock only for its own lookups, like
+  // `GetKeyValuePairs`.
+  absl::flat_hash_map<std::string_view, absl::Cord> GetKeyValuePairsAt(
+      const std::vector<std::string_view>& key_list,
+      const ReadVersion* read_version) const override;
+
+  // Values are checked for JSON once when they're loaded, so only JSON
+  // documents are parsed. They're parsed after the map lock is released.
+  absl::flat_hash_map<std::string_view, google::protobuf::Value>
+  GetValueProtosAt(const std::vector<std::string_view>& key_list,
+                   const ReadVersion* read_version) const override;
+
   // Looks up and returns key-value set result for the given key set.
   std::unique_ptr<GetKeyValueSetResult> GetKeyValueSet(
       const absl::flat_hash_set<std::string_view>& key_set) const override;
@@ -71,26 +112,64 @@ class KeyValueCache : public Cache {
                          absl::Span<std::string_view> value_set,
                          int64_t logical_commit_time) override;
 
+  // Applies the mutations of key-value pairs under one lock of the map, and
+  // the mutations of key-value sets under one lock of the set map, and
+  // records one latency sample for the batch.
+  void ApplyBatch(absl::Span<Mutation> mutations) override;
+
   // Removes the values that were deleted before the specified
-  // logical_commit_time.
-  // TODO: b/267182790 -- Cache cleanup should be done periodically from a
-  // background thread
+  // logical_commit_time. Tombstones are removed in slices bounded in count
+  // and duration, and the map locks are released between slices so that
+  // lookups and updates aren't blocked for the whole cleanup. Run it from a
+  // TombstoneCompactor to keep it off the data loading path. Also drops the
+  // replaced values that no pinned read version can see anymore.
   void RemoveDeletedKeys(int64_t logical_commit_time) override;
 
+  // Includes the bytes of the whole value dictionary, even if it's shared.
+  // Compressed values are counted at their compressed size.
+  CacheMemoryUsage GetMemoryUsage() const override;
+
+  // Set values are passed with one mutation per key and commit time, and
+  // values are passed decompressed.
+  void ExportMutations(
+      const std::function<void(const Mutation&)>& callback) const override;
+
   static std::unique_ptr<Cache> Create(
       privacy_sandbox::server_common::MetricsRecorder& metrics_recorder);
 
+  static std::unique_ptr<Cache> Create(
+      privacy_sandbox::server_common::MetricsRecorder& metrics_recorder,
+      std::shared_ptr<ValueDictionary> dictionary);
+
+  static std::unique_ptr<Cache> Create(
+      privacy_sandbox::server_common::MetricsRecorder& metrics_recorder,
+      ValueCompressionOptions compression);
+
  private:
-  struct CacheValue {
-    // We need to be able to set the value to null. For deletion we're keeping
+  // A value of a key, current or past.
+  struct StoredValue {
+    // We need to be able to unset the value. For deletion we're keeping
     // the timestamp of the key (to prevent a specific type of out of order
     // delete-update messages issue) until it is later cleaned up.
-    // We've also considered using optional, but it takes more space.
-    // sizeof(string) + sizeof(bool) -- for optional
-    // sizeof(string*) when null, sizeof(string*) + sizeof(string) otherwise
-    // -- for the unique pointer
-    std::unique_ptr<std::string> value;
-    int64_t last_logical_commit_time;
+    // The value is a cord so that lookups share its reference counted buffer
+    // instead of copying it. Small values are stored inline in the cord, so
+    // the optional also saves the separate string allocation for them.
+    std::optional<absl::Cord> value;
+    // Version at which `value` became current.
+    int64_t version = 0;
+    // Whether `value` was compressed by `compressor_`.
+    bool compressed = false;
+    // Whether `value` is a JSON document, so that V1 lookups only parse the
+    // values that are.
+    bool is_json = false;
+
+    int64_t bytes() const { return value.has_value() ? value->size() : 0; }
+  };
+  struct CacheValue : StoredValue {
+    int64_t last_logical_commit_time = 0;
+    // Earlier values, oldest first, kept while a pinned read version can see
+    // them. Null for almost all keys.
+    std::unique_ptr<std::vector<StoredValue>> past_values;
   };
   struct SetValueMeta {
     // Last logical commit time for a value
@@ -104,6 +183,54 @@ class KeyValueCache : public Cache {
     SetValueMeta(int64_t logical_commit_time, bool deleted)
         : last_logical_commit_time(logical_commit_time), is_deleted(deleted) {}
   };
+  // Live values of a key-value set, as IDs in `dictionary`, published to
+  // lookups as an immutable snapshot. A snapshot that lookups still hold is
+  // replaced by a copy before the set is mutated, so lookups never lock the
+  // set while they use it.
+  struct LiveValues {
+    LiveValues(ValueDictionary& dictionary, RoaringBitmap ids)
+        : dictionary(dictionary), ids(std::move(ids)) {}
+    ~LiveValues();
+
+    // Takes a reference on each ID, released with the snapshot. Called when
+    // the snapshot is replaced, as the set may then release its values while
+    // lookups still hold it.
+    void Retain();
+
+    ValueDictionary& dictionary;
+    RoaringBitmap ids;
+    bool retained = false;
+  };
+  // Values of a key-value set, as IDs in `dictionary_`. Live values are kept
+  // in a compressed bitmap, which lookups share, with their last logical
+  // commit times in ascending order of ID. Deleted values are kept in a
+  // sorted array, with a parallel array of their commit times.
+  struct ValueSet {
+    explicit ValueSet(ValueDictionary& dictionary)
+        : live(std::make_shared<LiveValues>(dictionary, RoaringBitmap())) {}
+
+    // Never null.
+    std::shared_ptr<LiveValues> live;
+    std::vector<int64_t> commit_times;
+    // Deleted values are kept in case there are late-arriving updates to
+    // them.
+    std::vector<uint32_t> deleted_ids;
+    std::vector<int64_t> deleted_commit_times;
+    // References to the set in `deleted_set_nodes_`. Guarded by the set map
+    // lock rather than the lock of the set, and the set isn't erased while
+    // any are left.
+    int32_t tombstone_refs = 0;
+  };
+  struct LockedValueSet {
+    explicit LockedValueSet(ValueDictionary& dictionary)
+        : value_set(dictionary) {}
+
+    mutable absl::Mutex mutex;
+    ValueSet value_set;
+  };
+  // Value sets are kept in nodes, whose addresses are stable, so that
+  // `deleted_set_nodes_` can refer to them.
+  using ValueSetMap = absl::node_hash_map<std::string, LockedValueSet>;
   // mutex for key value map;
   mutable absl::Mutex mutex_;
   // mutex for key value set map;
@@ -111,13 +238,39 @@ class KeyValueCache : public Cache {
   // Mapping from a key to its value
   absl::flat_hash_map<std::string, CacheValue> map_ ABSL_GUARDED_BY(mutex_);
 
-  // Sorted mapping from the logical timestamp to a key, for nodes that were
-  // deleted We keep this to do proper and efficient clean up in map_.
-  std::multimap<int64_t, std::string> deleted_nodes_ ABSL_GUARDED_BY(mutex_);
+  // Keys that were deleted, by the logical timestamp of their deletion. We
+  // keep this to do proper and efficient clean up in map_.
+  TombstoneIndex deleted_nodes_ ABSL_GUARDED_BY(mutex_);
 
   // The maximum value that was passed to RemoveDeletedKeys.
   int64_t max_cleanup_logical_commit_time_ ABSL_GUARDED_BY(mutex_) = 0;
 
+  // Version of the last mutation of a key-value pair. Versions count the
+  // mutations applied to `map_`, so unlike logical commit times, which may
+  // arrive out of order, they follow the order in which lookups see the
+  // mutations.
+  int64_t last_version_ ABSL_GUARDED_BY(mutex_) = 0;
+  // Keys whose past values are kept.
+  absl::flat_hash_set<std::string> keys_with_past_values_
+      ABSL_GUARDED_BY(mutex_);
+  // Pinned read versions. New versions are only pinned under a reader lock
+  // of `mutex_`, so writers holding it see every version that may read the
+  // values they replace, and skip the check while none are pinned.
+  mutable PinnedVersions pinned_versions_;
+
+  const ValueCompressionOptions compression_;
+  // Set once the dictionary is trained, and never replaced, since stored
+  // values were compressed with it. Accessed with std::atomic_load and
+  // std::atomic_store, so that values are compressed and decompressed
+  // without holding the map lock.
+  std::shared_ptr<const ValueCompressor> compressor_;
+  // Values sampled for the dictionary, concatenated, and their sizes.
+  std::string compression_samples_ ABSL_GUARDED_BY(mutex_);
+  std::vector<size_t> compression_sample_sizes_ ABSL_GUARDED_BY(mutex_);
+  bool training_compressor_ ABSL_GUARDED_BY(mutex_) = false;
+  // Null if values aren't compressed or none are kept decompressed.
+  const std::unique_ptr<DecompressedValueCache> decompressed_values_;
+
   // The maximum value of logical commit time that is used to do update/delete
   // for key-value set map.
   // TODO(b/284474892) Need to evaluate if we really need to make this variable
@@ -126,33 +279,168 @@ class KeyValueCache : public Cache {
   int64_t max_cleanup_logical_commit_time_for_set_cache_
       ABSL_GUARDED_BY(set_map_mutex_) = 0;
 
-  // Mapping from a key to its value map. The key in the inner map is the
-  // value string, and value is the ValueMeta. The inner map allows value
-  // look up to check the meta data to determine to state of the value
-  // in the cache, like logical commit time and whether the value
-  // is deleted or not.
-  absl::flat_hash_map<
-      std::string,
-      std::unique_ptr<std::pair<
-          absl::Mutex, absl::flat_hash_map<std::string, SetValueMeta>>>>
-      key_to_value_set_map_ ABSL_GUARDED_BY(set_map_mutex_);
-  // Sorted mapping from logical timestamp to key-value_set map to keep track of
-  // deleted key-values to handle out of order update case. In the inner map,
-  // the key string is the key for the values, and the string
-  // in the flat_hash_set is the value
-  absl::btree_map<int64_t, absl::flat_hash_map<
-                               std::string, absl::flat_hash_set<std::string>>>
+  // Mapping from a key to its value set, along with the mutex that guards
+  // the set. The value set keeps the logical commit time of each value and
+  // whether the value is deleted or not.
+  ValueSetMap key_to_value_set_map_ ABSL_GUARDED_BY(set_map_mutex_);
+  // Sorted mapping from logical timestamp to the value sets with values
+  // deleted at that time, to clean up the deleted values that are kept to
+  // handle out of order updates. The sets are referenced by their entries in
+  // `key_to_value_set_map_`, and the deleted values are found in the sets.
+  absl::btree_map<int64_t, std::vector<ValueSetMap::value_type*>>
       deleted_set_nodes_ ABSL_GUARDED_BY(set_map_mutex_);
 
+  // Work done by a tombstone cleanup.
+  struct CleanUpStats {
+    int64_t removed_tombstones = 0;
+    // Approximate, as allocator overhead isn't accounted for.
+    int64_t reclaimed_bytes = 0;
+  };
+
   // Removes deleted keys from key-value map
-  void CleanUpKeyValueMap(int64_t logical_commit_time);
+  CleanUpStats CleanUpKeyValueMap(int64_t logical_commit_time);
 
   // Removes deleted key-values from key-value_set map
-  void CleanUpKeyValueSetMap(int64_t logical_commit_time);
+  CleanUpStats CleanUpKeyValueSetMap(int64_t logical_commit_time);
+
+  // A value prepared for storage before taking the map lock.
+  struct EncodedValue {
+    // As in `StoredValue`.
+    absl::Cord value;
+    bool compressed = false;
+    bool is_json = false;
+  };
+
+  // A value found by a lookup that still needs decompressing or parsing,
+  // which is done after the map lock is released.
+  struct PendingValue {
+    std::string_view key;
+    int64_t version;
+    absl::Cord value;
+    bool is_json;
+  };
+
+  // Called by lookups with each value found, uncompressed.
+  using AddValue = absl::FunctionRef<void(std::string_view key,
+                                          absl::Cord value, bool is_json)>;
+
+  void UpdateKeyValueLocked(std::string_view key, int64_t logical_commit_time,
+                            EncodedValue encoded)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  void DeleteKeyLocked(std::string_view key, int64_t logical_commit_time)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Replaces the value of `key` with `value`, as of a new version. The
+  // replaced value is kept if a pinned read version can see it. Doesn't
+  // account for the bytes of the new value.
+  void SetValueLocked(std::string_view key, CacheValue& cache_value,
+                      StoredValue value) ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Returns the value of `cache_value` that's visible at `version`, or null
+  // if none is.
+  static const StoredValue* FindVisibleValue(const CacheValue& cache_value,
+                                             int64_t version);
+
+  // Whether a buffer of `size` bytes is compressed once a dictionary is
+  // trained.
+  bool MayCompress(int64_t size) const;
+
+  // Returns `value` as it should be stored, possibly compressed, and whether
+  // it's a JSON document. Doesn't need the map lock, so that values are
+  // checked and compressed before taking it.
+  EncodedValue EncodeValue(std::string_view value) const;
+
+  // Samples `buffer`, which is stored uncompressed, for the dictionary if
+  // none is trained yet.
+  void SampleValueLocked(const absl::Cord& buffer)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Passes the value of `key` in `stored` to `add_value`, or appends it to
+  // `pending` if it has to be decompressed first.
+  void AddValueLocked(std::string_view key, const StoredValue& stored,
+                      AddValue add_value,
+                      std::vector<PendingValue>& pending) const
+      ABSL_SHARED_LOCKS_REQUIRED(mutex_);
+
+  // Passes `pending` to `add_value` like `AddValueLocked`, without the lock.
+  void AddPendingValue(const PendingValue& pending, AddValue add_value) const;
+
+  // Looks up `key_list` at `read_version`, or the latest values if it's
+  // null. Values stored uncompressed are passed to `add_value` with the map
+  // lock held, so it shouldn't do more than store them.
+  void LookUp(const std::vector<std::string_view>& key_list,
+              const ReadVersion* read_version, AddValue add_value) const;
+
+  // Returns the decompressed buffer of `key` set at `version` and stored
+  // compressed as `stored`, or nullopt if it can't be decompressed. `stored`
+  // is a copy sharing the stored buffer, so the map lock isn't needed.
+  std::optional<absl::Cord> DecodeValue(std::string_view key, int64_t version,
+                                        const absl::Cord& stored) const;
+
+  // Trains the dictionary once enough values are sampled, without holding
+  // the map lock, and then starts compressing values.
+  void MaybeTrainCompressor() ABSL_LOCKS_EXCLUDED(mutex_);
+
+  // Drops the past values of `cache_value` that no pinned read version can
+  // see, and returns whether any are left.
+  bool PrunePastValuesLocked(CacheValue& cache_value)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Prunes the past values of all keys. Deleted keys left without past
+  // values are removed if their tombstone was already cleaned up.
+  void RemoveUnpinnedPastValues();
+
+  // Releases a pin of `version` taken on `shard` of `pinned_versions_`.
+  void Unpin(int shard, int64_t version) const;
+
+  class PinnedReadVersion;
+
+  // Inserts, or marks deleted if `deleted` is set, the values in the set for
+  // the given key, unless they were changed at a later logical commit time.
+  void MutateValueSet(std::string_view key, absl::Span<std::string_view> values,
+                      int64_t logical_commit_time, bool deleted);
+
+  // Applies set mutations like `MutateValueSet`, but holds the set map lock
+  // for the whole batch.
+  void MutateValueSets(absl::Span<Mutation* const> mutations);
+
+  // Returns the value set of `key`, inserting an empty one if it's missing.
+  LockedValueSet& FindOrInsertValueSet(std::string_view key)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(set_map_mutex_);
+
+  // Applies a mutation to the locked `value_set`, like `ApplyToValueSet`, and
+  // accounts for the change in its size. Live values that lookups hold are
+  // copied first.
+  void ApplyToValueSetAndCount(ValueSet& value_set,
+                               absl::Span<const uint32_t> value_ids,
+                               int64_t logical_commit_time, bool deleted,
+                               std::vector<uint32_t>& unused_ids,
+                               std::vector<uint32_t>& deleted_ids);
+
+  // Records that values of `key` were deleted at `logical_commit_time`, so
+  // that they are removed by a later cleanup.
+  void AddDeletedSetNode(std::string_view key, int64_t logical_commit_time)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(set_map_mutex_);
+
+  // Applies a mutation of the values with the sorted `value_ids` to
+  // `value_set`. Each ID carries one dictionary reference; the IDs whose
+  // reference the set doesn't keep are appended to `unused_ids`. If
+  // `deleted` is set, the IDs of the values marked deleted are appended to
+  // `deleted_ids`.
+  static void ApplyToValueSet(ValueSet& value_set,
+                              absl::Span<const uint32_t> value_ids,
+                              int64_t logical_commit_time, bool deleted,
+                              std::vector<uint32_t>& unused_ids,
+                              std::vector<uint32_t>& deleted_ids);
 
   friend class KeyValueCacheTestPeer;
 
   privacy_sandbox::server_common::MetricsRecorder& metrics_recorder_;
+  MemoryCounters memory_counters_;
+  // Interns the values of key-value sets. Shared by all stripes of a
+  // StripedKeyValueCache.
+  std::shared_ptr<ValueDictionary> dictionary_;
 };
 }  // namespace kv_server
 
@@ -15,6 +15,8 @@
 #include "components/data_server/cache/key_value_cache.h"
 
 #include <algorithm>
+#include <atomic>
+#include <map>
 #include <memory>
 #include <string>
 #include <string_view>
@@ -22,26 +24,54 @@
 #include <utility>
 #include <vector>
 
+#include "absl/algorithm/container.h"
 #include "absl/container/flat_hash_map.h"
+#include "absl/strings/str_cat.h"
 #include "absl/synchronization/notification.h"
 #include "components/data_server/cache/cache.h"
 #include "components/data_server/cache/get_key_value_set_result.h"
+#include "components/data_server/cache/memory_counters.h"
 #include "components/data_server/cache/mocks.h"
+#include "components/data_server/cache/tombstone_index.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "public/base_types.pb.h"
 #include "src/cpp/telemetry/metrics_recorder.h"
 #include "src/cpp/telemetry/telemetry_provider.h"
+#include "src/google/protobuf/struct.pb.h"
 
 namespace kv_server {
 
 class KeyValueCacheTestPeer {
  public:
   KeyValueCacheTestPeer() = delete;
+  // Returns the tombstones of keys that weren't updated since.
   static std::multimap<int64_t, std::string> ReadDeletedNodes(
       const KeyValueCache& c) {
     absl::MutexLock lock(&c.mutex_);
-    return c.deleted_nodes_;
+    std::multimap<int64_t, std::string> deleted_nodes;
+    c.deleted_nodes_.ForEach(
+        [&deleted_nodes](const TombstoneIndex::Tombstone& tombstone) {
+          deleted_nodes.emplace(tombstone.logical_commit_time, tombstone.key);
+        });
+    for (auto it = deleted_nodes.begin(); it != deleted_nodes.end();) {
+      const auto key_iter = c.map_.find(it->second);
+      if (key_iter == c.map_.end() || key_iter->second.value.has_value()) {
+        it = deleted_nodes.erase(it);
+      } else {
+        ++it;
+      }
+    }
+    return deleted_nodes;
+  }
+  static int64_t GetNumTombstones(const KeyValueCache& c) {
+    absl::MutexLock lock(&c.mutex_);
+    int64_t num_tombstones = 0;
+    c.deleted_nodes_.ForEach(
+        [&num_tombstones](const TombstoneIndex::Tombstone&) {
+          ++num_tombstones;
+        });
+    return num_tombstones;
   }
   static absl::flat_hash_map<std::string, kv_server::KeyValueCache::CacheValue>&
   ReadNodes(KeyValueCache& c) {
@@ -58,9 +88,20 @@ class KeyValueCacheTestPeer {
       const KeyValueCache& c, int64_t logical_commit_time,
       std::string_view key) {
     absl::MutexLock lock(&c.set_map_mutex_);
-    return c.deleted_set_nodes_.find(logical_commit_time)
-        ->second.find(key)
-        ->second;
+    const auto& deleted_sets = c.deleted_set_nodes_.find(logical_commit_time)
+                                   ->second;
+    const auto deleted_set = absl::c_find_if(
+        deleted_sets, [key](const auto* set) { return set->first == key; });
+    const KeyValueCache::ValueSet& value_set = (*deleted_set)->second.value_set;
+    std::vector<uint32_t> value_ids;
+    for (size_t i = 0; i < value_set.deleted_ids.size(); ++i) {
+      if (value_set.deleted_commit_times[i] == logical_commit_time) {
+        value_ids.push_back(value_set.deleted_ids[i]);
+      }
+    }
+    const std::vector<std::string_view> values =
+        c.dictionary_->GetValues(value_ids);
+    return absl::flat_hash_set<std::string>(values.begin(), values.end());
   }
 
   static int GetCacheKeyValueSetMapSize(KeyValueCache& c) {
@@ -73,12 +114,27 @@ class KeyValueCacheTestPeer {
                                                      std::string_view value) {
     absl::MutexLock lock(&c.set_map_mutex_);
     auto iter = c.key_to_value_set_map_.find(key);
-    return iter->second->second.find(value)->second;
+    const KeyValueCache::ValueSet& value_set = iter->second.value_set;
+    const uint32_t id = *c.dictionary_->Find(value);
+    if (value_set.live->ids.Contains(id)) {
+      return KeyValueCache::SetValueMeta(
+          value_set.commit_times[value_set.live->ids.Rank(id)],
+          /*deleted=*/false);
+    }
+    auto id_iter = absl::c_find(value_set.deleted_ids, id);
+    return KeyValueCache::SetValueMeta(
+        value_set.deleted_commit_times[id_iter - value_set.deleted_ids.begin()],
+        /*deleted=*/true);
   }
   static int GetSetValueSize(const KeyValueCache& c, std::string_view key) {
     absl::MutexLock lock(&c.set_map_mutex_);
     auto iter = c.key_to_value_set_map_.find(key);
-    return iter->second->second.size();
+    return iter->second.value_set.live->ids.size() +
+           iter->second.value_set.deleted_ids.size();
+  }
+
+  static int64_t GetDictionarySize(const KeyValueCache& c) {
+    return c.dictionary_->size();
   }
 
   static void CallCacheCleanup(KeyValueCache& c, int64_t logical_commit_time) {
@@ -97,7 +153,7 @@ TEST(CacheTest, RetrievesMatchingEntry) {
   std::unique_ptr<Cache> cache = KeyValueCache::Create(*noop_metrics_recorder);
   cache->UpdateKeyValue("my_key", "my_value", 1);
   std::vector<std::string_view> keys = {"my_key"};
-  absl::flat_hash_map<std::string, std::string> kv_pairs =
+  absl::flat_hash_map<std::string_view, absl::Cord> kv_pairs =
       cache->GetKeyValuePairs(keys);
   std::vector<std::string_view> wrong_keys = {"wrong_key"};
   EXPECT_FALSE(cache->GetKeyValuePairs(keys).empty());
@@ -115,7 +171,7 @@ TEST(CacheTest, GetWithMultipleKeysReturnsMatchingValues) {
 
   std::vector<std::string_view> full_keys = {"key1", "key2"};
 
-  absl::flat_hash_map<std::string, std::string> kv_pairs =
+  absl::flat_hash_map<std::string_view, absl::Cord> kv_pairs =
       cache->GetKeyValuePairs(full_keys);
   EXPECT_EQ(kv_pairs.size(), 2);
   EXPECT_THAT(kv_pairs, UnorderedElementsAre(KVPairEq("key1", "value1"),
@@ -130,7 +186,7 @@ TEST(CacheTest, GetAfterUpdateReturnsNewValue) {
 
   std::vector<std::string_view> keys = {"my_key"};
 
-  absl::flat_hash_map<std::string, std::string> kv_pairs =
+  absl::flat_hash_map<std::string_view, absl::Cord> kv_pairs =
       cache->GetKeyValuePairs(keys);
   EXPECT_THAT(kv_pairs, UnorderedElementsAre(KVPairEq("my_key", "my_value")));
 
@@ -151,7 +207,7 @@ TEST(CacheTest, GetAfterUpdateDifferentKeyReturnsSameValue) {
 
   std::vector<std::string_view> keys = {"my_key"};
 
-  absl::flat_hash_map<std::string, std::string> kv_pairs =
+  absl::flat_hash_map<std::string_view, absl::Cord> kv_pairs =
       cache->GetKeyValuePairs(keys);
   EXPECT_THAT(kv_pairs, UnorderedElementsAre(KVPairEq("my_key", "my_value")));
 }
@@ -161,7 +217,7 @@ TEST(CacheTest, GetForEmptyCacheReturnsEmptyList) {
       TelemetryProvider::GetInstance().CreateMetricsRecorder();
   std::unique_ptr<Cache> cache = KeyValueCache::Create(*noop_metrics_recorder);
   std::vector<std::string_view> keys = {"my_key"};
-  absl::flat_hash_map<std::string, std::string> kv_pairs =
+  absl::flat_hash_map<std::string_view, absl::Cord> kv_pairs =
       cache->GetKeyValuePairs(keys);
   EXPECT_EQ(kv_pairs.size(), 0);
 }
@@ -197,7 +253,7 @@ TEST(DeleteKeyTest, RemovesKeyEntry) {
   cache->UpdateKeyValue("my_key", "my_value", 1);
   cache->DeleteKey("my_key", 2);
   std::vector<std::string_view> full_keys = {"my_key"};
-  absl::flat_hash_map<std::string, std::string> kv_pairs =
+  absl::flat_hash_map<std::string_view, absl::Cord> kv_pairs =
       cache->GetKeyValuePairs(full_keys);
   EXPECT_EQ(kv_pairs.size(), 0);
 }
@@ -209,7 +265,7 @@ TEST(DeleteKeyValueSetTest, WrongkeyDoesNotRemoveEntry) {
   cache->UpdateKeyValue("my_key", "my_value", 1);
   cache->DeleteKey("wrong_key", 1);
   std::vector<std::string_view> keys = {"my_key"};
-  absl::flat_hash_map<std::string, std::string> kv_pairs =
+  absl::flat_hash_map<std::string_view, absl::Cord> kv_pairs =
       cache->GetKeyValuePairs(keys);
   EXPECT_THAT(kv_pairs, UnorderedElementsAre(KVPairEq("my_key", "my_value")));
 }
@@ -312,7 +368,7 @@ TEST(CacheTest, OutOfOrderUpdateAfterUpdateWorks) {
 
   std::vector<std::string_view> keys = {"my_key"};
 
-  absl::flat_hash_map<std::string, std::string> kv_pairs =
+  absl::flat_hash_map<std::string_view, absl::Cord> kv_pairs =
       cache->GetKeyValuePairs(keys);
   EXPECT_THAT(kv_pairs, UnorderedElementsAre(KVPairEq("my_key", "my_value")));
 
@@ -330,7 +386,7 @@ TEST(DeleteKeyTest, OutOfOrderDeleteAfterUpdateWorks) {
   cache->DeleteKey("my_key", 2);
   cache->UpdateKeyValue("my_key", "my_value", 1);
   std::vector<std::string_view> full_keys = {"my_key"};
-  absl::flat_hash_map<std::string, std::string> kv_pairs =
+  absl::flat_hash_map<std::string_view, absl::Cord> kv_pairs =
       cache->GetKeyValuePairs(full_keys);
   EXPECT_EQ(kv_pairs.size(), 0);
 }
@@ -342,7 +398,7 @@ TEST(DeleteKeyTest, OutOfOrderUpdateAfterDeleteWorks) {
   cache->UpdateKeyValue("my_key", "my_value", 2);
   cache->DeleteKey("my_key", 1);
   std::vector<std::string_view> full_keys = {"my_key"};
-  absl::flat_hash_map<std::string, std::string> kv_pairs =
+  absl::flat_hash_map<std::string_view, absl::Cord> kv_pairs =
       cache->GetKeyValuePairs(full_keys);
   EXPECT_EQ(kv_pairs.size(), 1);
   EXPECT_THAT(kv_pairs, UnorderedElementsAre(KVPairEq("my_key", "my_value")));
@@ -355,7 +411,7 @@ TEST(DeleteKeyTest, InOrderUpdateAfterDeleteWorks) {
   cache->DeleteKey("my_key", 1);
   cache->UpdateKeyValue("my_key", "my_value", 2);
   std::vector<std::string_view> full_keys = {"my_key"};
-  absl::flat_hash_map<std::string, std::string> kv_pairs =
+  absl::flat_hash_map<std::string_view, absl::Cord> kv_pairs =
       cache->GetKeyValuePairs(full_keys);
   EXPECT_EQ(kv_pairs.size(), 1);
   EXPECT_THAT(kv_pairs, UnorderedElementsAre(KVPairEq("my_key", "my_value")));
@@ -368,7 +424,7 @@ TEST(DeleteKeyTest, InOrderDeleteAfterUpdateWorks) {
   cache->UpdateKeyValue("my_key", "my_value", 1);
   cache->DeleteKey("my_key", 2);
   std::vector<std::string_view> full_keys = {"my_key"};
-  absl::flat_hash_map<std::string, std::string> kv_pairs =
+  absl::flat_hash_map<std::string_view, absl::Cord> kv_pairs =
       cache->GetKeyValuePairs(full_keys);
   EXPECT_EQ(kv_pairs.size(), 0);
 }
@@ -510,6 +566,81 @@ TEST(CleanUpTimestamps, RemoveDeletedKeysRemovesOldRecords) {
   EXPECT_EQ(nodes.size(), 0);
 }
 
+TEST(CleanUpTimestamps, RemoveDeletedKeysRemovesTombstonesAcrossSlices) {
+  auto noop_metrics_recorder =
+      TelemetryProvider::GetInstance().CreateMetricsRecorder();
+  std::unique_ptr<KeyValueCache> cache =
+      std::make_unique<KeyValueCache>(*noop_metrics_recorder);
+  // More tombstones than fit in one cleanup slice.
+  constexpr int kNumKeys = 5000;
+  std::vector<std::string_view> values = {"v1"};
+  for (int i = 0; i < kNumKeys; ++i) {
+    const std::string key = absl::StrCat("key", i);
+    cache->UpdateKeyValue(key, "value", 1);
+    cache->DeleteKey(key, 2);
+    cache->UpdateKeyValueSet(key, absl::Span<std::string_view>(values), 1);
+    cache->DeleteValuesInSet(key, absl::Span<std::string_view>(values),
+                             i % 2 == 0 ? 2 : 3);
+  }
+  cache->DeleteKey("new_key", 4);
+
+  cache->RemoveDeletedKeys(3);
+
+  EXPECT_THAT(KeyValueCacheTestPeer::ReadDeletedNodes(*cache),
+              UnorderedElementsAre(std::make_pair(4, "new_key")));
+  EXPECT_EQ(KeyValueCacheTestPeer::ReadNodes(*cache).size(), 1);
+  EXPECT_EQ(KeyValueCacheTestPeer::GetDeletedSetNodesMapSize(*cache), 0);
+  EXPECT_EQ(KeyValueCacheTestPeer::GetCacheKeyValueSetMapSize(*cache), 0);
+  EXPECT_EQ(KeyValueCacheTestPeer::GetDictionarySize(*cache), 0);
+}
+
+TEST(CleanUpTimestamps, DropsOldRecordsUpdatedBetweenSlices) {
+  auto noop_metrics_recorder =
+      TelemetryProvider::GetInstance().CreateMetricsRecorder();
+  std::unique_ptr<KeyValueCache> cache =
+      std::make_unique<KeyValueCache>(*noop_metrics_recorder);
+  // "stale_key" is deleted first, and then more keys than fit in one cleanup
+  // slice, so that the updates below land after its tombstones were removed.
+  constexpr int kNumKeys = 100'000;
+  std::vector<std::string_view> values = {"v1"};
+  cache->UpdateKeyValue("stale_key", "value", 1);
+  cache->DeleteKey("stale_key", 2);
+  cache->UpdateKeyValueSet("stale_key", absl::Span<std::string_view>(values),
+                           1);
+  cache->DeleteValuesInSet("stale_key", absl::Span<std::string_view>(values),
+                           2);
+  for (int i = 0; i < kNumKeys; ++i) {
+    const std::string key = absl::StrCat("key", i);
+    cache->UpdateKeyValue(key, "value", 1);
+    cache->DeleteKey(key, 3);
+    cache->UpdateKeyValueSet(key, absl::Span<std::string_view>(values), 1);
+    cache->DeleteValuesInSet(key, absl::Span<std::string_view>(values), 3);
+  }
+
+  std::atomic<bool> cleaned_up = false;
+  absl::Notification updating;
+  std::thread updater([&cache, &values, &cleaned_up, &updating] {
+    while (!cleaned_up) {
+      cache->UpdateKeyValue("stale_key", "stale", 1);
+      cache->UpdateKeyValueSet("stale_key",
+                               absl::Span<std::string_view>(values), 1);
+      if (!updating.HasBeenNotified()) {
+        updating.Notify();
+      }
+    }
+  });
+  updating.WaitForNotification();
+  cache->RemoveDeletedKeys(3);
+  cleaned_up = true;
+  updater.join();
+
+  EXPECT_THAT(cache->GetKeyValuePairs({"stale_key"}), testing::IsEmpty());
+  EXPECT_THAT(cache->GetKeyValueSet({"stale_key"})->GetValueSet("stale_key"),
+              testing::IsEmpty());
+  EXPECT_TRUE(KeyValueCacheTestPeer::ReadNodes(*cache).empty());
+  EXPECT_EQ(KeyValueCacheTestPeer::GetCacheKeyValueSetMapSize(*cache), 0);
+}
+
 TEST(CleanUpTimestamps, RemoveDeletedKeysDoesntAffectNewRecords) {
   auto noop_metrics_recorder =
       TelemetryProvider::GetInstance().CreateMetricsRecorder();
@@ -558,13 +689,41 @@ TEST(CleanUpTimestamps,
   std::vector<std::string_view> full_keys = {
       "my_key1", "my_key2", "my_key3", "my_key4", "my_key5",
   };
-  absl::flat_hash_map<std::string, std::string> kv_pairs =
+  absl::flat_hash_map<std::string_view, absl::Cord> kv_pairs =
       cache->GetKeyValuePairs(full_keys);
   EXPECT_EQ(kv_pairs.size(), 2);
   EXPECT_THAT(kv_pairs, UnorderedElementsAre(KVPairEq("my_key4", "my_value"),
                                              KVPairEq("my_key5", "my_value")));
 }
 
+TEST(CleanUpTimestamps, RemoveDeletedKeysSkipsKeysUpdatedSinceDeletion) {
+  auto noop_metrics_recorder =
+      TelemetryProvider::GetInstance().CreateMetricsRecorder();
+  std::unique_ptr<KeyValueCache> cache =
+      std::make_unique<KeyValueCache>(*noop_metrics_recorder);
+  cache->UpdateKeyValue("key1", "value1", 1);
+  cache->DeleteKey("key1", 2);
+  cache->UpdateKeyValue("key1", "value2", 3);
+  // The tombstone is left for the cleanup.
+  EXPECT_TRUE(KeyValueCacheTestPeer::ReadDeletedNodes(*cache).empty());
+  EXPECT_EQ(KeyValueCacheTestPeer::GetNumTombstones(*cache), 1);
+
+  cache->RemoveDeletedKeys(3);
+  EXPECT_EQ(KeyValueCacheTestPeer::GetNumTombstones(*cache), 0);
+  EXPECT_THAT(cache->GetKeyValuePairs({"key1"}),
+              UnorderedElementsAre(KVPairEq("key1", "value2")));
+  EXPECT_EQ(cache->GetMemoryUsage().tombstone_bytes, 0);
+
+  // Deleted again after an update, the key has a tombstone per deletion.
+  cache->DeleteKey("key1", 4);
+  cache->UpdateKeyValue("key1", "value3", 5);
+  cache->DeleteKey("key1", 6);
+  EXPECT_EQ(KeyValueCacheTestPeer::GetNumTombstones(*cache), 2);
+  cache->RemoveDeletedKeys(6);
+  EXPECT_TRUE(KeyValueCacheTestPeer::ReadNodes(*cache).empty());
+  EXPECT_EQ(cache->GetMemoryUsage().total_bytes(), 0);
+}
+
 TEST(CleanUpTimestamps, CantInsertOldRecordsAfterCleanup) {
   auto noop_metrics_recorder =
       TelemetryProvider::GetInstance().CreateMetricsRecorder();
@@ -581,7 +740,7 @@ TEST(CleanUpTimestamps, CantInsertOldRecordsAfterCleanup) {
 
   std::vector<std::string_view> keys = {"my_key1"};
 
-  absl::flat_hash_map<std::string, std::string> kv_pairs =
+  absl::flat_hash_map<std::string_view, absl::Cord> kv_pairs =
       cache->GetKeyValuePairs(keys);
   EXPECT_EQ(kv_pairs.size(), 0);
 }
@@ -639,6 +798,37 @@ TEST(CleanUpTimestampsForSetCache, RemoveDeletedKeyValuesRemovesOldRecords) {
   EXPECT_EQ(KeyValueCacheTestPeer::GetCacheKeyValueSetMapSize(*cache), 0);
 }
 
+TEST(CleanUpTimestampsForSetCache, RemoveDeletedKeyValuesKeepsSetUntilEmpty) {
+  auto noop_metrics_recorder =
+      TelemetryProvider::GetInstance().CreateMetricsRecorder();
+  std::unique_ptr<KeyValueCache> cache =
+      std::make_unique<KeyValueCache>(*noop_metrics_recorder);
+  std::vector<std::string_view> values = {"v1", "v2"};
+  std::vector<std::string_view> v1 = {"v1"};
+  std::vector<std::string_view> v2 = {"v2"};
+  cache->UpdateKeyValueSet("my_key", absl::Span<std::string_view>(values), 1);
+  cache->DeleteValuesInSet("my_key", absl::Span<std::string_view>(v1), 2);
+  // Deleting again at the same time doesn't add another record.
+  cache->DeleteValuesInSet("my_key", absl::Span<std::string_view>(v1), 2);
+  cache->DeleteValuesInSet("my_key", absl::Span<std::string_view>(v2), 4);
+  EXPECT_EQ(KeyValueCacheTestPeer::GetDeletedSetNodesMapSize(*cache), 2);
+  EXPECT_THAT(
+      KeyValueCacheTestPeer::ReadDeletedSetNodesForTimestamp(*cache, 2,
+                                                             "my_key"),
+      UnorderedElementsAre("v1"));
+
+  cache->RemoveDeletedKeys(3);
+  EXPECT_EQ(KeyValueCacheTestPeer::GetDeletedSetNodesMapSize(*cache), 1);
+  EXPECT_EQ(KeyValueCacheTestPeer::GetSetValueSize(*cache, "my_key"), 1);
+  EXPECT_TRUE(KeyValueCacheTestPeer::GetSetValueMeta(*cache, "my_key", "v2")
+                  .is_deleted);
+
+  cache->RemoveDeletedKeys(4);
+  EXPECT_EQ(KeyValueCacheTestPeer::GetDeletedSetNodesMapSize(*cache), 0);
+  EXPECT_EQ(KeyValueCacheTestPeer::GetCacheKeyValueSetMapSize(*cache), 0);
+  EXPECT_EQ(cache->GetMemoryUsage().total_bytes(), 0);
+}
+
 TEST(CleanUpTimestampsForSetCache,
      RemoveDeletedKeyValuesDoesntAffectNewRecords) {
   auto noop_metrics_recorder =
@@ -759,6 +949,504 @@ TEST(CleanUpTimestampsForSetCache, CantAddOldDeletedRecordsAfterCleanup) {
   EXPECT_EQ(kv_set.size(), 0);
 }
 
+TEST(InternedValueSetTest, ValuesAreInternedOnceAcrossKeys) {
+  auto noop_metrics_recorder =
+      TelemetryProvider::GetInstance().CreateMetricsRecorder();
+  std::unique_ptr<KeyValueCache> cache =
+      std::make_unique<KeyValueCache>(*noop_metrics_recorder);
+  std::vector<std::string_view> values = {"v1", "v2", "v1"};
+  cache->UpdateKeyValueSet("key1", absl::Span<std::string_view>(values), 1);
+  cache->UpdateKeyValueSet("key2", absl::Span<std::string_view>(values), 1);
+  EXPECT_EQ(KeyValueCacheTestPeer::GetDictionarySize(*cache), 2);
+  EXPECT_EQ(KeyValueCacheTestPeer::GetSetValueSize(*cache, "key1"), 2);
+
+  auto result = cache->GetKeyValueSet({"key1", "key2"});
+  EXPECT_THAT(result->GetValueSet("key1"), UnorderedElementsAre("v1", "v2"));
+  EXPECT_EQ(result->GetValueIdSet("key1"), result->GetValueIdSet("key2"));
+  EXPECT_THAT(result->GetValues(result->GetValueIdSet("key2")),
+              UnorderedElementsAre("v1", "v2"));
+  EXPECT_EQ(result->GetValueIdSet("key1").size(), 2);
+  EXPECT_TRUE(result->GetValueIdSet("missing_key").empty());
+}
+
+TEST(InternedValueSetTest, RemoveDeletedKeysReleasesValues) {
+  auto noop_metrics_recorder =
+      TelemetryProvider::GetInstance().CreateMetricsRecorder();
+  std::unique_ptr<KeyValueCache> cache =
+      std::make_unique<KeyValueCache>(*noop_metrics_recorder);
+  std::vector<std::string_view> values = {"v1", "v2"};
+  std::vector<std::string_view> deleted_values = {"v1", "v3"};
+  cache->UpdateKeyValueSet("key1", absl::Span<std::string_view>(values), 1);
+  cache->UpdateKeyValueSet("key2", absl::Span<std::string_view>(values), 1);
+  cache->DeleteValuesInSet("key1", absl::Span<std::string_view>(values), 2);
+  cache->DeleteValuesInSet("key2",
+                           absl::Span<std::string_view>(deleted_values), 2);
+  EXPECT_EQ(KeyValueCacheTestPeer::GetDictionarySize(*cache), 3);
+
+  cache->RemoveDeletedKeys(2);
+  // Only "v2" is still in a set.
+  EXPECT_EQ(KeyValueCacheTestPeer::GetDictionarySize(*cache), 1);
+  EXPECT_EQ(KeyValueCacheTestPeer::GetCacheKeyValueSetMapSize(*cache), 1);
+  EXPECT_THAT(cache->GetKeyValueSet({"key2"})->GetValueSet("key2"),
+              UnorderedElementsAre("v2"));
+}
+
+TEST(InternedValueSetTest, ResultsKeepTheirSnapshotWhileSetsAreUpdated) {
+  auto noop_metrics_recorder =
+      TelemetryProvider::GetInstance().CreateMetricsRecorder();
+  std::unique_ptr<KeyValueCache> cache =
+      std::make_unique<KeyValueCache>(*noop_metrics_recorder);
+  std::vector<std::string_view> values = {"v1"};
+  std::vector<std::string_view> new_values = {"v2"};
+  cache->UpdateKeyValueSet("my_key", absl::Span<std::string_view>(values), 1);
+  auto result = cache->GetKeyValueSet({"my_key"});
+
+  // The result doesn't lock the set, so updates aren't blocked by it.
+  cache->UpdateKeyValueSet("my_key", absl::Span<std::string_view>(new_values),
+                           2);
+  cache->DeleteValuesInSet("my_key", absl::Span<std::string_view>(values), 3);
+  cache->RemoveDeletedKeys(3);
+  EXPECT_THAT(cache->GetKeyValueSet({"my_key"})->GetValueSet("my_key"),
+              UnorderedElementsAre("v2"));
+  EXPECT_THAT(result->GetValueSet("my_key"), UnorderedElementsAre("v1"));
+  EXPECT_EQ(KeyValueCacheTestPeer::GetDictionarySize(*cache), 2);
+
+  // The deleted value is released with the last snapshot that holds it.
+  result.reset();
+  EXPECT_EQ(KeyValueCacheTestPeer::GetDictionarySize(*cache), 1);
+}
+
+TEST(CacheMemoryUsageTest, TracksKeysValuesSetsAndTombstones) {
+  auto noop_metrics_recorder =
+      TelemetryProvider::GetInstance().CreateMetricsRecorder();
+  std::unique_ptr<KeyValueCache> cache =
+      std::make_unique<KeyValueCache>(*noop_metrics_recorder);
+  cache->UpdateKeyValue("key1", "value1", 1);
+  cache->UpdateKeyValue("key1", "v", 2);
+  CacheMemoryUsage usage = cache->GetMemoryUsage();
+  EXPECT_EQ(usage.key_bytes, 4);
+  EXPECT_EQ(usage.value_bytes, 1);
+
+  cache->DeleteKey("key1", 3);
+  usage = cache->GetMemoryUsage();
+  EXPECT_EQ(usage.value_bytes, 0);
+  EXPECT_EQ(usage.tombstone_bytes, TombstoneIndex::KeyBytes("key1"));
+
+  std::vector<std::string_view> values = {"a", "bc"};
+  std::vector<std::string_view> deleted_values = {"a"};
+  cache->UpdateKeyValueSet("set1", absl::Span<std::string_view>(values), 1);
+  cache->DeleteValuesInSet("set1",
+                           absl::Span<std::string_view>(deleted_values), 2);
+  usage = cache->GetMemoryUsage();
+  EXPECT_EQ(usage.key_bytes, 8);
+  EXPECT_EQ(usage.set_member_bytes, MemoryCounters::kSetMemberBytes);
+  EXPECT_EQ(usage.interned_value_bytes, 3);
+  // The deleted member, and the reference to the set recording its
+  // deletion.
+  EXPECT_EQ(usage.tombstone_bytes, TombstoneIndex::KeyBytes("key1") +
+                                       MemoryCounters::kSetMemberBytes +
+                                       sizeof(void*));
+
+  cache->RemoveDeletedKeys(3);
+  usage = cache->GetMemoryUsage();
+  EXPECT_EQ(usage.key_bytes, 4);
+  EXPECT_EQ(usage.value_bytes, 0);
+  EXPECT_EQ(usage.set_member_bytes, MemoryCounters::kSetMemberBytes);
+  EXPECT_EQ(usage.interned_value_bytes, 2);
+  EXPECT_EQ(usage.tombstone_bytes, 0);
+  EXPECT_EQ(usage.total_bytes(), 4 + MemoryCounters::kSetMemberBytes + 2);
+}
+
+TEST(ApplyBatchTest, AppliesMutationsLikePerRecordCalls) {
+  auto noop_metrics_recorder =
+      TelemetryProvider::GetInstance().CreateMetricsRecorder();
+  std::unique_ptr<KeyValueCache> cache =
+      std::make_unique<KeyValueCache>(*noop_metrics_recorder);
+  std::vector<Mutation> mutations = {
+      {.type = Mutation::Type::kUpdateKeyValue,
+       .key = "key1",
+       .value = "value1",
+       .logical_commit_time = 1},
+      {.type = Mutation::Type::kUpdateKeyValue,
+       .key = "key2",
+       .value = "value2",
+       .logical_commit_time = 1},
+      {.type = Mutation::Type::kDeleteKey,
+       .key = "key2",
+       .logical_commit_time = 2},
+      // Older than the deletion, so it's dropped.
+      {.type = Mutation::Type::kUpdateKeyValue,
+       .key = "key2",
+       .value = "stale",
+       .logical_commit_time = 1},
+      {.type = Mutation::Type::kUpdateKeyValueSet,
+       .key = "set1",
+       .value_set = {"a", "b", "c"},
+       .logical_commit_time = 1},
+      {.type = Mutation::Type::kDeleteValuesInSet,
+       .key = "set1",
+       .value_set = {"b"},
+       .logical_commit_time = 2},
+      // Empty sets are skipped.
+      {.type = Mutation::Type::kUpdateKeyValueSet,
+       .key = "set2",
+       .logical_commit_time = 1},
+  };
+  cache->ApplyBatch(absl::MakeSpan(mutations));
+
+  EXPECT_THAT(cache->GetKeyValuePairs({"key1", "key2"}),
+              UnorderedElementsAre(KVPairEq("key1", "value1")));
+  auto result = cache->GetKeyValueSet({"set1", "set2"});
+  EXPECT_THAT(result->GetValueSet("set1"), UnorderedElementsAre("a", "c"));
+  EXPECT_THAT(result->GetValueSet("set2"), testing::IsEmpty());
+  result.reset();
+
+  CacheMemoryUsage usage = cache->GetMemoryUsage();
+  EXPECT_EQ(usage.key_bytes, 12);
+  EXPECT_EQ(usage.value_bytes, 6);
+  EXPECT_EQ(usage.set_member_bytes, 2 * MemoryCounters::kSetMemberBytes);
+
+  // The deleted key and set value are cleaned up like ones deleted outside
+  // of a batch.
+  cache->RemoveDeletedKeys(2);
+  usage = cache->GetMemoryUsage();
+  EXPECT_EQ(usage.key_bytes, 8);
+  EXPECT_EQ(usage.tombstone_bytes, 0);
+  EXPECT_EQ(usage.interned_value_bytes, 2);
+}
+
+TEST(ApplyBatchTest, DropsMutationsOlderThanCleanUp) {
+  auto noop_metrics_recorder =
+      TelemetryProvider::GetInstance().CreateMetricsRecorder();
+  std::unique_ptr<KeyValueCache> cache =
+      std::make_unique<KeyValueCache>(*noop_metrics_recorder);
+  cache->RemoveDeletedKeys(2);
+  std::vector<Mutation> mutations = {
+      {.type = Mutation::Type::kUpdateKeyValue,
+       .key = "key1",
+       .value = "value1",
+       .logical_commit_time = 2},
+      {.type = Mutation::Type::kUpdateKeyValueSet,
+       .key = "set1",
+       .value_set = {"a"},
+       .logical_commit_time = 2},
+  };
+  cache->ApplyBatch(absl::MakeSpan(mutations));
+  EXPECT_THAT(cache->GetKeyValuePairs({"key1"}), testing::IsEmpty());
+  EXPECT_THAT(cache->GetKeyValueSet({"set1"})->GetValueSet("set1"),
+              testing::IsEmpty());
+  EXPECT_EQ(cache->GetMemoryUsage().total_bytes(), 0);
+}
+
+TEST(ExportMutationsTest, RebuildsCacheWithTombstones) {
+  auto noop_metrics_recorder =
+      TelemetryProvider::GetInstance().CreateMetricsRecorder();
+  auto cache = std::make_unique<KeyValueCache>(*noop_metrics_recorder);
+  cache->UpdateKeyValue("key1", "value1", 1);
+  cache->UpdateKeyValue("key2", "value2", 1);
+  cache->DeleteKey("key2", 2);
+  std::vector<std::string_view> values = {"a", "b"};
+  cache->UpdateKeyValueSet("set1", absl::MakeSpan(values), 1);
+  values = {"c"};
+  cache->UpdateKeyValueSet("set1", absl::MakeSpan(values), 3);
+  values = {"a"};
+  cache->DeleteValuesInSet("set1", absl::MakeSpan(values), 2);
+
+  auto restored = std::make_unique<KeyValueCache>(*noop_metrics_recorder);
+  int num_mutations = 0;
+  cache->ExportMutations([&restored, &num_mutations](const Mutation& mutation) {
+    Mutation copy = mutation;
+    restored->ApplyBatch(absl::MakeSpan(&copy, 1));
+    ++num_mutations;
+  });
+  // One mutation per key, and per set and commit time.
+  EXPECT_EQ(num_mutations, 5);
+  EXPECT_THAT(restored->GetKeyValuePairs({"key1", "key2"}),
+              UnorderedElementsAre(KVPairEq("key1", "value1")));
+  EXPECT_THAT(restored->GetKeyValueSet({"set1"})->GetValueSet("set1"),
+              UnorderedElementsAre("b", "c"));
+  EXPECT_EQ(restored->GetMemoryUsage().total_bytes(),
+            cache->GetMemoryUsage().total_bytes());
+
+  // The commit times and tombstones are kept, so late-arriving mutations
+  // are handled as they would be by the original cache.
+  restored->UpdateKeyValue("key2", "stale", 1);
+  values = {"a"};
+  restored->UpdateKeyValueSet("set1", absl::MakeSpan(values), 1);
+  values = {"b", "c"};
+  restored->DeleteValuesInSet("set1", absl::MakeSpan(values), 2);
+  EXPECT_THAT(restored->GetKeyValuePairs({"key2"}), testing::IsEmpty());
+  EXPECT_THAT(restored->GetKeyValueSet({"set1"})->GetValueSet("set1"),
+              UnorderedElementsAre("c"));
+}
+
+TEST(ExportMutationsTest, DoesNotHoldBackUpdates) {
+  auto noop_metrics_recorder =
+      TelemetryProvider::GetInstance().CreateMetricsRecorder();
+  auto cache = std::make_unique<KeyValueCache>(*noop_metrics_recorder);
+  // More keys than are copied under one lock.
+  for (int i = 0; i < 3000; ++i) {
+    cache->UpdateKeyValue(absl::StrCat("key", i), "value", 1);
+  }
+  std::vector<std::string_view> values = {"a", "b"};
+  cache->UpdateKeyValueSet("set1", absl::MakeSpan(values), 1);
+  cache->DeleteValuesInSet("set1", absl::MakeSpan(values), 2);
+
+  int num_pairs = 0;
+  std::vector<std::string> deleted_values;
+  cache->ExportMutations([&](const Mutation& mutation) {
+    switch (mutation.type) {
+      case Mutation::Type::kUpdateKeyValue:
+        ++num_pairs;
+        // Would wait for the export if it held the map lock.
+        cache->DeleteKey(mutation.key, 2);
+        break;
+      case Mutation::Type::kDeleteValuesInSet: {
+        // Drops the deleted values from the set, while the export still
+        // refers to them.
+        cache->RemoveDeletedKeys(2);
+        deleted_values.assign(mutation.value_set.begin(),
+                              mutation.value_set.end());
+        break;
+      }
+      default:
+        break;
+    }
+  });
+  EXPECT_EQ(num_pairs, 3000);
+  EXPECT_THAT(deleted_values, UnorderedElementsAre("a", "b"));
+  EXPECT_THAT(cache->GetKeyValuePairs({"key0"}), testing::IsEmpty());
+}
+
+TEST(ReadVersionTest, LookupsAtPinnedVersionIgnoreLaterMutations) {
+  auto noop_metrics_recorder =
+      TelemetryProvider::GetInstance().CreateMetricsRecorder();
+  auto cache = std::make_unique<KeyValueCache>(*noop_metrics_recorder);
+  cache->UpdateKeyValue("key1", "value1", 1);
+  cache->UpdateKeyValue("key2", "value2", 1);
+  std::unique_ptr<ReadVersion> version = cache->PinReadVersion();
+  ASSERT_NE(version, nullptr);
+  cache->UpdateKeyValue("key1", "newer1", 2);
+  cache->UpdateKeyValue("key1", "newest1", 3);
+  cache->DeleteKey("key2", 2);
+  cache->UpdateKeyValue("key3", "value3", 2);
+
+  EXPECT_THAT(cache->GetKeyValuePairsAt({"key1", "key2", "key3"},
+                                        version.get()),
+              UnorderedElementsAre(KVPairEq("key1", "value1"),
+                                   KVPairEq("key2", "value2")));
+  EXPECT_THAT(cache->GetKeyValuePairs({"key1", "key2", "key3"}),
+              UnorderedElementsAre(KVPairEq("key1", "newest1"),
+                                   KVPairEq("key3", "value3")));
+  EXPECT_THAT(cache->GetKeyValuePairsAt({"key1"}, nullptr),
+              UnorderedElementsAre(KVPairEq("key1", "newest1")));
+}
+
+TEST(ReadVersionTest, ReplacedValuesAreOnlyKeptWhilePinned) {
+  auto noop_metrics_recorder =
+      TelemetryProvider::GetInstance().CreateMetricsRecorder();
+  auto cache = std::make_unique<KeyValueCache>(*noop_metrics_recorder);
+  cache->UpdateKeyValue("key1", "aaa", 1);
+  // Values replaced while nothing is pinned aren't kept.
+  cache->UpdateKeyValue("key1", "bbb", 2);
+  EXPECT_EQ(cache->GetMemoryUsage().value_bytes, 3);
+
+  std::unique_ptr<ReadVersion> version = cache->PinReadVersion();
+  cache->UpdateKeyValue("key1", "ccc", 3);
+  // Only "bbb" is visible to the pin, so "ccc" is dropped when replaced.
+  cache->UpdateKeyValue("key1", "ddd", 4);
+  EXPECT_EQ(cache->GetMemoryUsage().value_bytes, 6);
+  EXPECT_THAT(cache->GetKeyValuePairsAt({"key1"}, version.get()),
+              UnorderedElementsAre(KVPairEq("key1", "bbb")));
+
+  version.reset();
+  cache->RemoveDeletedKeys(0);
+  EXPECT_EQ(cache->GetMemoryUsage().value_bytes, 3);
+}
+
+TEST(ReadVersionTest, DeletedKeysAreRemovedOnceUnpinned) {
+  auto noop_metrics_recorder =
+      TelemetryProvider::GetInstance().CreateMetricsRecorder();
+  auto cache = std::make_unique<KeyValueCache>(*noop_metrics_recorder);
+  cache->UpdateKeyValue("key1", "value1", 1);
+  std::unique_ptr<ReadVersion> version = cache->PinReadVersion();
+  cache->DeleteKey("key1", 2);
+
+  // The tombstone is cleaned up, but the key stays for the pinned version.
+  cache->RemoveDeletedKeys(2);
+  EXPECT_TRUE(KeyValueCacheTestPeer::ReadDeletedNodes(*cache).empty());
+  EXPECT_EQ(KeyValueCacheTestPeer::ReadNodes(*cache).size(), 1);
+  EXPECT_THAT(cache->GetKeyValuePairsAt({"key1"}, version.get()),
+              UnorderedElementsAre(KVPairEq("key1", "value1")));
+  EXPECT_THAT(cache->GetKeyValuePairs({"key1"}), testing::IsEmpty());
+
+  version.reset();
+  cache->RemoveDeletedKeys(2);
+  EXPECT_TRUE(KeyValueCacheTestPeer::ReadNodes(*cache).empty());
+  EXPECT_EQ(cache->GetMemoryUsage().total_bytes(), 0);
+}
+
+TEST(ReadVersionTest, ConcurrentLookupsSeeConsistentPairs) {
+  auto noop_metrics_recorder =
+      TelemetryProvider::GetInstance().CreateMetricsRecorder();
+  auto cache = std::make_unique<KeyValueCache>(*noop_metrics_recorder);
+  cache->UpdateKeyValue("key1", "0", 1);
+  cache->UpdateKeyValue("key2", "0", 1);
+  std::atomic<bool> done = false;
+  // Both keys are always updated together.
+  std::thread writer([&cache, &done]() {
+    for (int i = 1; i <= 1000; ++i) {
+      const std::string value = std::to_string(i);
+      std::vector<Mutation> mutations = {
+          {.type = Mutation::Type::kUpdateKeyValue,
+           .key = "key1",
+           .value = value,
+           .logical_commit_time = i + 1},
+          {.type = Mutation::Type::kUpdateKeyValue,
+           .key = "key2",
+           .value = value,
+           .logical_commit_time = i + 1},
+      };
+      cache->ApplyBatch(absl::MakeSpan(mutations));
+    }
+    done = true;
+  });
+  while (!done) {
+    std::unique_ptr<ReadVersion> version = cache->PinReadVersion();
+    auto first = cache->GetKeyValuePairsAt({"key1"}, version.get());
+    auto second = cache->GetKeyValuePairsAt({"key2"}, version.get());
+    EXPECT_EQ(first["key1"], second["key2"]);
+  }
+  writer.join();
+}
+
+std::string CompressibleValue(int i) {
+  return absl::StrCat(R"({"campaign_id":)", i,
+                      R"(,"render_url":"https://ads.example/creative/)", i,
+                      R"(","categories":["sports","news","travel"]})");
+}
+
+TEST(ValueCompressionTest, CompressesValuesOnceDictionaryIsTrained) {
+  auto noop_metrics_recorder =
+      TelemetryProvider::GetInstance().CreateMetricsRecorder();
+  KeyValueCache cache(*noop_metrics_recorder,
+                      std::make_shared<ValueDictionary>(),
+                      ValueCompressionOptions{.threshold_bytes = 50,
+                                              .sample_bytes = 20 << 10,
+                                              .dictionary_bytes = 4 << 10});
+  int64_t value_bytes = 0;
+  std::vector<std::string> keys;
+  for (int i = 0; i < 1000; ++i) {
+    keys.push_back(absl::StrCat("key", i));
+    const std::string value = CompressibleValue(i);
+    value_bytes += value.size();
+    cache.UpdateKeyValue(keys.back(), value, 1);
+  }
+  // Values below the threshold aren't compressed.
+  cache.UpdateKeyValue("small", "small_value", 1);
+  value_bytes += std::string_view("small_value").size();
+  EXPECT_LT(cache.GetMemoryUsage().value_bytes, value_bytes / 2);
+
+  std::unique_ptr<ReadVersion> version = cache.PinReadVersion();
+  cache.UpdateKeyValue("key999", CompressibleValue(-1), 2);
+  for (int i = 0; i < 1000; ++i) {
+    EXPECT_THAT(cache.GetKeyValuePairsAt({keys[i]}, version.get()),
+                UnorderedElementsAre(KVPairEq(keys[i], CompressibleValue(i))));
+  }
+  EXPECT_THAT(cache.GetKeyValuePairs({"key999", "small"}),
+              UnorderedElementsAre(KVPairEq("key999", CompressibleValue(-1)),
+                                   KVPairEq("small", "small_value")));
+  EXPECT_GT(cache.GetMemoryUsage().decompressed_value_bytes, 0);
+
+  // Values are exported decompressed.
+  auto restored = std::make_unique<KeyValueCache>(*noop_metrics_recorder);
+  cache.ExportMutations([&restored](const Mutation& mutation) {
+    Mutation copy = mutation;
+    restored->ApplyBatch(absl::MakeSpan(&copy, 1));
+  });
+  EXPECT_THAT(restored->GetKeyValuePairs({"key0", "key999"}),
+              UnorderedElementsAre(KVPairEq("key0", CompressibleValue(0)),
+                                   KVPairEq("key999", CompressibleValue(-1))));
+}
+
+TEST(ValueCompressionTest, ReadsWithoutDecompressedValueCache) {
+  auto noop_metrics_recorder =
+      TelemetryProvider::GetInstance().CreateMetricsRecorder();
+  KeyValueCache cache(*noop_metrics_recorder,
+                      std::make_shared<ValueDictionary>(),
+                      ValueCompressionOptions{.threshold_bytes = 50,
+                                              .sample_bytes = 0,
+                                              .decompressed_cache_bytes = 0});
+  cache.UpdateKeyValue("key1", std::string(1000, 'a'), 1);
+  cache.UpdateKeyValue("key1", std::string(1000, 'b'), 2);
+  EXPECT_LT(cache.GetMemoryUsage().value_bytes, 1000);
+  EXPECT_THAT(cache.GetKeyValuePairs({"key1"}),
+              UnorderedElementsAre(KVPairEq("key1", std::string(1000, 'b'))));
+  EXPECT_EQ(cache.GetMemoryUsage().decompressed_value_bytes, 0);
+  cache.DeleteKey("key1", 3);
+  EXPECT_EQ(cache.GetMemoryUsage().value_bytes, 0);
+}
+
+TEST(ValueProtoTest, ReturnsJsonValuesParsed) {
+  auto noop_metrics_recorder =
+      TelemetryProvider::GetInstance().CreateMetricsRecorder();
+  auto cache = std::make_unique<KeyValueCache>(*noop_metrics_recorder);
+  const std::string json_value = R"({"a":1})";
+  cache->UpdateKeyValue("json", json_value, 1);
+  cache->UpdateKeyValue("plain", "not json", 1);
+  // Only the values themselves are stored.
+  EXPECT_EQ(cache->GetMemoryUsage().value_bytes,
+            json_value.size() + std::string_view("not json").size());
+  EXPECT_THAT(cache->GetKeyValuePairs({"json", "plain"}),
+              UnorderedElementsAre(KVPairEq("json", json_value),
+                                   KVPairEq("plain", "not json")));
+
+  auto value_protos =
+      cache->GetValueProtosAt({"json", "plain", "missing"}, nullptr);
+  ASSERT_EQ(value_protos.size(), 2);
+  EXPECT_EQ(value_protos["json"].struct_value().fields().at("a").number_value(),
+            1);
+  EXPECT_EQ(value_protos["plain"].string_value(), "not json");
+}
+
+TEST(ValueProtoTest, ValuesFollowPinnedVersion) {
+  auto noop_metrics_recorder =
+      TelemetryProvider::GetInstance().CreateMetricsRecorder();
+  auto cache = std::make_unique<KeyValueCache>(*noop_metrics_recorder);
+  cache->UpdateKeyValue("key1", "1", 1);
+  std::unique_ptr<ReadVersion> version = cache->PinReadVersion();
+  cache->UpdateKeyValue("key1", "not json", 2);
+
+  EXPECT_EQ(cache->GetValueProtosAt({"key1"}, version.get())["key1"]
+                .number_value(),
+            1);
+  EXPECT_EQ(cache->GetValueProtosAt({"key1"}, nullptr)["key1"].string_value(),
+            "not json");
+}
+
+TEST(ValueProtoTest, ReturnsCompressedValuesParsed) {
+  auto noop_metrics_recorder =
+      TelemetryProvider::GetInstance().CreateMetricsRecorder();
+  KeyValueCache cache(*noop_metrics_recorder,
+                      std::make_shared<ValueDictionary>(),
+                      ValueCompressionOptions{.threshold_bytes = 50,
+                                              .sample_bytes = 0});
+  const std::string value = absl::StrCat(R"({"a":")", std::string(1000, 'a'),
+                                         R"("})");
+  // The compressor is set up after the first value is stored.
+  cache.UpdateKeyValue("key1", value, 1);
+  cache.UpdateKeyValue("key1", value, 2);
+  EXPECT_LT(cache.GetMemoryUsage().value_bytes, value.size());
+  EXPECT_EQ(cache.GetValueProtosAt({"key1"}, nullptr)["key1"]
+                .struct_value()
+                .fields()
+                .at("a")
+                .string_value(),
+            std::string(1000, 'a'));
+  EXPECT_THAT(cache.GetKeyValuePairs({"key1"}),
+              UnorderedElementsAre(KVPairEq("key1", value)));
+}
+
 TEST(ConcurrentSetMemoryAccessTest, ConcurrentGetAndGet) {
   auto noop_metrics_recorder =
       TelemetryProvider::GetInstance().CreateMetricsRecorder();
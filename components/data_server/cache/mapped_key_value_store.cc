@@ -0,0 +1,405 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "components/data_server/cache/mapped_key_value_store.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "absl/strings/str_cat.h"
+
+namespace kv_server {
+namespace {
+
+constexpr std::string_view kTempFileSuffix = ".tmp";
+constexpr char kMagic[8] = {'K', 'V', 'S', 'T', 'O', 'R', 'E', '1'};
+
+// The file starts with the header and the source, followed by these
+// sections, each starting at a multiple of 8 bytes:
+//  - the offset of each block in the keys, as uint64_t,
+//  - the front coded keys,
+//  - the offset of each value in the values, then the size of the values,
+//    as uint64_t,
+//  - the commit time of each entry, as int64_t,
+//  - the values.
+struct Header {
+  char magic[8];
+  uint64_t num_entries;
+  uint64_t num_blocks;
+  uint64_t source_size;
+  uint64_t keys_size;
+  uint64_t values_size;
+};
+
+uint64_t AlignUp(uint64_t offset) { return (offset + 7) & ~uint64_t{7}; }
+
+// Sections may not be aligned for `T` in the mapping, so they're read by
+// copying.
+template <typename T>
+T Load(const char* array, int64_t index) {
+  T value;
+  std::memcpy(&value, array + index * sizeof(T), sizeof(T));
+  return value;
+}
+
+void AppendVarint(uint64_t value, std::string& out) {
+  while (value >= 0x80) {
+    out.push_back(static_cast<char>(value | 0x80));
+    value >>= 7;
+  }
+  out.push_back(static_cast<char>(value));
+}
+
+// Reads a varint at `pos` of `data` and advances `pos`. Returns false if the
+// varint runs past the end of `data`.
+bool ReadVarint(std::string_view data, size_t& pos, uint64_t& value) {
+  value = 0;
+  for (int shift = 0; shift < 64 && pos < data.size(); shift += 7) {
+    const uint8_t byte = data[pos++];
+    value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+    if (byte < 0x80) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Reads the key at `pos` of a block, given the previous key of the block in
+// `key`, and advances `pos`. Returns false if the key is malformed.
+bool ReadKey(std::string_view block, size_t& pos, std::string& key) {
+  uint64_t shared;
+  uint64_t suffix_size;
+  if (!ReadVarint(block, pos, shared) || !ReadVarint(block, pos, suffix_size) ||
+      shared > key.size() || suffix_size > block.size() - pos) {
+    return false;
+  }
+  key.resize(shared);
+  key.append(block.substr(pos, suffix_size));
+  pos += suffix_size;
+  return true;
+}
+
+size_t SharedPrefixSize(std::string_view a, std::string_view b) {
+  const size_t size = std::min(a.size(), b.size());
+  size_t shared = 0;
+  while (shared < size && a[shared] == b[shared]) {
+    ++shared;
+  }
+  return shared;
+}
+
+template <typename T>
+void WriteArray(const std::vector<T>& array, std::ofstream& stream) {
+  stream.write(reinterpret_cast<const char*>(array.data()),
+               array.size() * sizeof(T));
+}
+
+void WritePadding(uint64_t size, std::ofstream& stream) {
+  static constexpr char kZeros[8] = {};
+  stream.write(kZeros, AlignUp(size) - size);
+}
+
+absl::Status WriteStore(std::string_view source,
+                        absl::Span<const MappedKeyValueStore::Entry> entries,
+                        std::ofstream& stream) {
+  std::string keys;
+  std::vector<uint64_t> block_offsets;
+  std::vector<uint64_t> value_offsets;
+  std::vector<int64_t> commit_times;
+  value_offsets.reserve(entries.size() + 1);
+  commit_times.reserve(entries.size());
+  uint64_t values_size = 0;
+  for (size_t i = 0; i < entries.size(); ++i) {
+    const MappedKeyValueStore::Entry& entry = entries[i];
+    size_t shared = 0;
+    if (i > 0) {
+      if (entries[i - 1].key >= entry.key) {
+        return absl::InvalidArgumentError(absl::StrCat(
+            "Entries are not sorted by unique keys at key ", entry.key));
+      }
+      if (i % MappedKeyValueStore::kKeysPerBlock != 0) {
+        shared = SharedPrefixSize(entries[i - 1].key, entry.key);
+      }
+    }
+    if (i % MappedKeyValueStore::kKeysPerBlock == 0) {
+      block_offsets.push_back(keys.size());
+    }
+    AppendVarint(shared, keys);
+    AppendVarint(entry.key.size() - shared, keys);
+    keys.append(entry.key.substr(shared));
+    value_offsets.push_back(values_size);
+    commit_times.push_back(entry.logical_commit_time);
+    values_size += entry.value.size();
+  }
+  value_offsets.push_back(values_size);
+
+  Header header;
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.num_entries = entries.size();
+  header.num_blocks = block_offsets.size();
+  header.source_size = source.size();
+  header.keys_size = keys.size();
+  header.values_size = values_size;
+  stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  stream.write(source.data(), source.size());
+  WritePadding(sizeof(header) + source.size(), stream);
+  WriteArray(block_offsets, stream);
+  stream.write(keys.data(), keys.size());
+  WritePadding(keys.size(), stream);
+  WriteArray(value_offsets, stream);
+  WriteArray(commit_times, stream);
+  for (const MappedKeyValueStore::Entry& entry : entries) {
+    stream.write(entry.value.data(), entry.value.size());
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace
+
+MappedKeyValueStore::~MappedKeyValueStore() {
+  munmap(const_cast<char*>(data_), size_);
+}
+
+absl::Status MappedKeyValueStore::Write(const std::string& path,
+                                        std::string_view source,
+                                        absl::Span<const Entry> entries) {
+  const std::string temp_path = absl::StrCat(path, kTempFileSuffix);
+  std::ofstream stream(temp_path, std::ios::binary | std::ios::trunc);
+  if (!stream.is_open()) {
+    return absl::InternalError(
+        absl::StrCat("Failed to open key-value store file: ", temp_path));
+  }
+  absl::Status status = WriteStore(source, entries, stream);
+  stream.close();
+  if (status.ok() && stream.fail()) {
+    status = absl::InternalError(
+        absl::StrCat("Failed to write key-value store file: ", temp_path));
+  }
+  std::error_code error;
+  if (status.ok()) {
+    std::filesystem::rename(temp_path, path, error);
+    if (!error) {
+      return absl::OkStatus();
+    }
+    status = absl::InternalError(absl::StrCat(
+        "Failed to replace key-value store ", path, ": ", error.message()));
+  }
+  std::filesystem::remove(temp_path, error);
+  return status;
+}
+
+absl::StatusOr<std::unique_ptr<MappedKeyValueStore>> MappedKeyValueStore::Open(
+    const std::string& path) {
+  const int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    const int error = errno;
+    const std::string message = absl::StrCat(
+        "Failed to open key-value store ", path, ": ", std::strerror(error));
+    return error == ENOENT ? absl::NotFoundError(message)
+                           : absl::InternalError(message);
+  }
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) != 0 ||
+      file_stat.st_size < static_cast<off_t>(sizeof(Header))) {
+    close(fd);
+    return absl::DataLossError(
+        absl::StrCat("Key-value store ", path, " is truncated."));
+  }
+  void* data =
+      mmap(nullptr, file_stat.st_size, PROT_READ, MAP_SHARED, fd, /*offset=*/0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    return absl::InternalError(absl::StrCat(
+        "Failed to map key-value store ", path, ": ", std::strerror(errno)));
+  }
+  // Lookups touch a few scattered pages each, so reading ahead would mostly
+  // fault in pages that aren't needed.
+  madvise(data, file_stat.st_size, MADV_RANDOM);
+  auto store = absl::WrapUnique(
+      new MappedKeyValueStore(static_cast<const char*>(data),
+                              file_stat.st_size));
+  if (absl::Status status = store->Parse(); !status.ok()) {
+    return absl::DataLossError(absl::StrCat("Key-value store ", path,
+                                            " is corrupted: ",
+                                            status.message()));
+  }
+  return store;
+}
+
+absl::Status MappedKeyValueStore::Parse() {
+  Header header;
+  std::memcpy(&header, data_, sizeof(header));
+  if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0) {
+    return absl::DataLossError("Bad magic.");
+  }
+  const uint64_t size = size_;
+  // Bounding the counts by the file size first keeps the sums below from
+  // overflowing.
+  if (header.num_entries > size || header.num_blocks > size ||
+      header.source_size > size || header.keys_size > size ||
+      header.values_size > size) {
+    return absl::DataLossError("Section sizes exceed the file size.");
+  }
+  if (header.num_blocks != (header.num_entries + kKeysPerBlock - 1) /
+                               kKeysPerBlock) {
+    return absl::DataLossError("Wrong number of blocks.");
+  }
+  uint64_t offset = sizeof(header);
+  source_ = std::string_view(data_ + offset, header.source_size);
+  offset = AlignUp(offset + header.source_size);
+  const uint64_t block_offsets_offset = offset;
+  offset += header.num_blocks * sizeof(uint64_t);
+  const uint64_t keys_offset = offset;
+  offset = AlignUp(offset + header.keys_size);
+  const uint64_t value_offsets_offset = offset;
+  offset += (header.num_entries + 1) * sizeof(uint64_t);
+  const uint64_t commit_times_offset = offset;
+  offset += header.num_entries * sizeof(int64_t);
+  const uint64_t values_offset = offset;
+  offset += header.values_size;
+  if (offset != size) {
+    return absl::DataLossError(
+        absl::StrCat("Expected ", offset, " bytes, found ", size, "."));
+  }
+  num_entries_ = header.num_entries;
+  num_blocks_ = header.num_blocks;
+  block_offsets_ = data_ + block_offsets_offset;
+  keys_ = std::string_view(data_ + keys_offset, header.keys_size);
+  value_offsets_ = data_ + value_offsets_offset;
+  commit_times_ = data_ + commit_times_offset;
+  values_ = std::string_view(data_ + values_offset, header.values_size);
+  // The offsets are checked once here so that lookups can trust them. They
+  // take 8 bytes per entry and block, far less than the keys and values.
+  uint64_t previous = 0;
+  for (int64_t block = 0; block < num_blocks_; ++block) {
+    const uint64_t block_offset = Load<uint64_t>(block_offsets_, block);
+    if (block_offset < previous || block_offset > keys_.size()) {
+      return absl::DataLossError("Block offsets are out of order.");
+    }
+    previous = block_offset;
+  }
+  previous = 0;
+  for (int64_t index = 0; index <= num_entries_; ++index) {
+    const uint64_t value_offset = Load<uint64_t>(value_offsets_, index);
+    if (value_offset < previous || value_offset > values_.size()) {
+      return absl::DataLossError("Value offsets are out of order.");
+    }
+    previous = value_offset;
+  }
+  if (previous != values_.size()) {
+    return absl::DataLossError("Value offsets don't cover the values.");
+  }
+  return absl::OkStatus();
+}
+
+std::string_view MappedKeyValueStore::BlockFirstKey(int64_t block) const {
+  const std::string_view data =
+      keys_.substr(Load<uint64_t>(block_offsets_, block));
+  size_t pos = 0;
+  uint64_t shared;
+  uint64_t size;
+  if (!ReadVarint(data, pos, shared) || !ReadVarint(data, pos, size) ||
+      size > data.size() - pos) {
+    return {};
+  }
+  return data.substr(pos, size);
+}
+
+int64_t MappedKeyValueStore::Find(std::string_view key) const {
+  // Finds the first block whose first key is past `key`. The key can only be
+  // in the block before it.
+  int64_t low = 0;
+  int64_t high = num_blocks_;
+  while (low < high) {
+    const int64_t middle = low + (high - low) / 2;
+    if (BlockFirstKey(middle) <= key) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  if (low == 0) {
+    return kNotFound;
+  }
+  const int64_t block = low - 1;
+  const uint64_t begin = Load<uint64_t>(block_offsets_, block);
+  const uint64_t end = block + 1 < num_blocks_
+                           ? Load<uint64_t>(block_offsets_, block + 1)
+                           : keys_.size();
+  const std::string_view block_keys = keys_.substr(begin, end - begin);
+  std::string current;
+  size_t pos = 0;
+  for (int64_t index = block * kKeysPerBlock;
+       index < num_entries_ && pos < block_keys.size(); ++index) {
+    if (!ReadKey(block_keys, pos, current)) {
+      break;
+    }
+    const int compare = std::string_view(current).compare(key);
+    if (compare == 0) {
+      return index;
+    }
+    if (compare > 0) {
+      break;
+    }
+  }
+  return kNotFound;
+}
+
+std::string_view MappedKeyValueStore::value(int64_t index) const {
+  const uint64_t begin = Load<uint64_t>(value_offsets_, index);
+  const uint64_t end = Load<uint64_t>(value_offsets_, index + 1);
+  return values_.substr(begin, end - begin);
+}
+
+int64_t MappedKeyValueStore::logical_commit_time(int64_t index) const {
+  return Load<int64_t>(commit_times_, index);
+}
+
+void MappedKeyValueStore::ForEach(
+    const std::function<void(int64_t index, const Entry& entry)>& callback)
+    const {
+  std::string key;
+  for (int64_t block = 0; block < num_blocks_; ++block) {
+    const uint64_t begin = Load<uint64_t>(block_offsets_, block);
+    const uint64_t end = block + 1 < num_blocks_
+                             ? Load<uint64_t>(block_offsets_, block + 1)
+                             : keys_.size();
+    const std::string_view block_keys = keys_.substr(begin, end - begin);
+    size_t pos = 0;
+    for (int64_t index = block * kKeysPerBlock;
+         index < std::min(num_entries_, (block + 1) * kKeysPerBlock);
+         ++index) {
+      if (!ReadKey(block_keys, pos, key)) {
+        return;
+      }
+      callback(index, Entry{.key = key,
+                            .value = value(index),
+                            .logical_commit_time = logical_commit_time(index)});
+    }
+  }
+}
+
+}  // namespace kv_server
@@ -0,0 +1,126 @@
+/*
+ * Copyright 2023 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef COMPONENTS_DATA_SERVER_CACHE_MAPPED_KEY_VALUE_STORE_H_
+#define COMPONENTS_DATA_SERVER_CACHE_MAPPED_KEY_VALUE_STORE_H_
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/types/span.h"
+
+namespace kv_server {
+
+// Read-only key-value pairs in a file on local disk, which is memory mapped
+// instead of read. Opening a store only validates its layout, and pages are
+// faulted in from the file as they're looked up, so a large store can be
+// served right away and its pages can be dropped by the OS under memory
+// pressure.
+//
+// Keys are sorted and front coded in blocks of `kKeysPerBlock`: the first key
+// of a block is stored whole, and each following key as the length of the
+// prefix it shares with the previous key plus the rest of its bytes. A
+// lookup binary searches the first keys of the blocks and then scans one
+// block. Values are stored back to back in key order.
+//
+// Stores are written and read in the byte order of the host, so a file is
+// only meant to be read on the machine that wrote it.
+//
+// Thread-safe.
+class MappedKeyValueStore {
+ public:
+  struct Entry {
+    std::string_view key;
+    std::string_view value;
+    int64_t logical_commit_time = 0;
+  };
+
+  static constexpr int kKeysPerBlock = 16;
+  // Returned by `Find` for keys that aren't in the store.
+  static constexpr int64_t kNotFound = -1;
+
+  ~MappedKeyValueStore();
+
+  MappedKeyValueStore(const MappedKeyValueStore&) = delete;
+  MappedKeyValueStore& operator=(const MappedKeyValueStore&) = delete;
+
+  // Writes `entries`, which must be sorted by key without duplicates, to a
+  // store at `path`. `source` names the data the store was built from and is
+  // returned by `source()` once the store is opened. The store is written to
+  // a temporary file next to `path` which then replaces it, so a failed write
+  // keeps the previous store.
+  static absl::Status Write(const std::string& path, std::string_view source,
+                            absl::Span<const Entry> entries);
+
+  // Maps the store at `path`. Returns NotFound if there's no file at `path`,
+  // and DataLoss if the file isn't a complete store.
+  static absl::StatusOr<std::unique_ptr<MappedKeyValueStore>> Open(
+      const std::string& path);
+
+  std::string_view source() const { return source_; }
+
+  // Number of entries in the store.
+  int64_t size() const { return num_entries_; }
+
+  // Returns the index of the entry with `key`, or `kNotFound`.
+  int64_t Find(std::string_view key) const;
+
+  // The value and commit time of the entry at `index`, which must be in
+  // [0, size()). The value is a view of the mapped file.
+  std::string_view value(int64_t index) const;
+  int64_t logical_commit_time(int64_t index) const;
+
+  // Calls `callback` for each entry in key order, along with its index. The
+  // key is only valid during the call.
+  void ForEach(
+      const std::function<void(int64_t index, const Entry& entry)>& callback)
+      const;
+
+  // Bytes of the front coded keys and of the values in the file.
+  int64_t key_bytes() const { return keys_.size(); }
+  int64_t value_bytes() const { return values_.size(); }
+
+ private:
+  MappedKeyValueStore(const char* data, int64_t size)
+      : data_(data), size_(size) {}
+
+  absl::Status Parse();
+
+  // The first key of the block at `block`, a view of the mapped file.
+  std::string_view BlockFirstKey(int64_t block) const;
+
+  const char* const data_;
+  const int64_t size_;
+  int64_t num_entries_ = 0;
+  int64_t num_blocks_ = 0;
+  std::string_view source_;
+  // Offset of each block in `keys_`.
+  const char* block_offsets_ = nullptr;
+  std::string_view keys_;
+  // Offset of each value in `values_`, followed by the size of `values_`.
+  const char* value_offsets_ = nullptr;
+  const char* commit_times_ = nullptr;
+  std::string_view values_;
+};
+
+}  // namespace kv_server
+
+#endif  // COMPONENTS_DATA_SERVER_CACHE_MAPPED_KEY_VALUE_STORE_H_
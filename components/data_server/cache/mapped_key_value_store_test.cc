@@ -0,0 +1,129 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "components/data_server/cache/mapped_key_value_store.h"
+
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace kv_server {
+namespace {
+
+std::string StorePath(std::string_view name) {
+  return absl::StrCat(::testing::TempDir(), "/", name);
+}
+
+TEST(MappedKeyValueStoreTest, FindsEntriesAcrossBlocks) {
+  std::vector<std::string> keys;
+  std::vector<std::string> values;
+  for (int i = 0; i < 100; ++i) {
+    keys.push_back(absl::StrFormat("key%03d", i));
+    values.push_back(absl::StrCat("value", i));
+  }
+  std::vector<MappedKeyValueStore::Entry> entries;
+  for (int i = 0; i < 100; ++i) {
+    entries.push_back(
+        {.key = keys[i], .value = values[i], .logical_commit_time = i});
+  }
+  const std::string path = StorePath("finds_entries");
+  ASSERT_TRUE(MappedKeyValueStore::Write(path, "snapshot", entries).ok());
+  EXPECT_FALSE(std::filesystem::exists(absl::StrCat(path, ".tmp")));
+
+  auto store = MappedKeyValueStore::Open(path);
+  ASSERT_TRUE(store.ok()) << store.status();
+  EXPECT_EQ((*store)->source(), "snapshot");
+  EXPECT_EQ((*store)->size(), 100);
+  for (int i = 0; i < 100; ++i) {
+    const int64_t index = (*store)->Find(keys[i]);
+    ASSERT_EQ(index, i);
+    EXPECT_EQ((*store)->value(index), values[i]);
+    EXPECT_EQ((*store)->logical_commit_time(index), i);
+  }
+  EXPECT_EQ((*store)->Find("a"), MappedKeyValueStore::kNotFound);
+  EXPECT_EQ((*store)->Find("key0155"), MappedKeyValueStore::kNotFound);
+  EXPECT_EQ((*store)->Find("key100"), MappedKeyValueStore::kNotFound);
+  EXPECT_EQ((*store)->Find("z"), MappedKeyValueStore::kNotFound);
+}
+
+TEST(MappedKeyValueStoreTest, ForEachVisitsEntriesInKeyOrder) {
+  const std::vector<MappedKeyValueStore::Entry> entries = {
+      {.key = "", .value = "empty", .logical_commit_time = 1},
+      {.key = "apple", .value = "", .logical_commit_time = 2},
+      {.key = "applesauce", .value = "v3", .logical_commit_time = 3},
+      {.key = "banana", .value = "v4", .logical_commit_time = 4},
+  };
+  const std::string path = StorePath("for_each");
+  ASSERT_TRUE(MappedKeyValueStore::Write(path, "snapshot", entries).ok());
+  auto store = MappedKeyValueStore::Open(path);
+  ASSERT_TRUE(store.ok()) << store.status();
+  std::vector<std::string> visited;
+  (*store)->ForEach(
+      [&visited](int64_t index, const MappedKeyValueStore::Entry& entry) {
+        visited.push_back(absl::StrCat(index, ":", entry.key, "=", entry.value,
+                                       "@", entry.logical_commit_time));
+      });
+  EXPECT_THAT(visited, testing::ElementsAre("0:=empty@1", "1:apple=@2",
+                                            "2:applesauce=v3@3",
+                                            "3:banana=v4@4"));
+  EXPECT_EQ((*store)->Find(""), 0);
+  EXPECT_EQ((*store)->value_bytes(), 9);
+}
+
+TEST(MappedKeyValueStoreTest, EmptyStore) {
+  const std::string path = StorePath("empty");
+  ASSERT_TRUE(MappedKeyValueStore::Write(path, "snapshot", {}).ok());
+  auto store = MappedKeyValueStore::Open(path);
+  ASSERT_TRUE(store.ok()) << store.status();
+  EXPECT_EQ((*store)->size(), 0);
+  EXPECT_EQ((*store)->Find("key"), MappedKeyValueStore::kNotFound);
+}
+
+TEST(MappedKeyValueStoreTest, RejectsUnsortedEntries) {
+  const std::vector<MappedKeyValueStore::Entry> entries = {
+      {.key = "b", .value = "v1"},
+      {.key = "a", .value = "v2"},
+  };
+  const std::string path = StorePath("unsorted");
+  EXPECT_EQ(MappedKeyValueStore::Write(path, "snapshot", entries).code(),
+            absl::StatusCode::kInvalidArgument);
+  EXPECT_FALSE(std::filesystem::exists(path));
+  EXPECT_FALSE(std::filesystem::exists(absl::StrCat(path, ".tmp")));
+}
+
+TEST(MappedKeyValueStoreTest, RejectsMissingStore) {
+  EXPECT_EQ(MappedKeyValueStore::Open(StorePath("missing")).status().code(),
+            absl::StatusCode::kNotFound);
+}
+
+TEST(MappedKeyValueStoreTest, RejectsTruncatedStore) {
+  const std::vector<MappedKeyValueStore::Entry> entries = {
+      {.key = "key1", .value = "value1"},
+      {.key = "key2", .value = "value2"},
+  };
+  const std::string path = StorePath("truncated");
+  ASSERT_TRUE(MappedKeyValueStore::Write(path, "snapshot", entries).ok());
+  std::filesystem::resize_file(path, std::filesystem::file_size(path) - 1);
+  EXPECT_EQ(MappedKeyValueStore::Open(path).status().code(),
+            absl::StatusCode::kDataLoss);
+}
+
+}  // namespace
+}  // namespace kv_server
@@ -0,0 +1,70 @@
+/*
+ * Copyright 2023 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef COMPONENTS_DATA_SERVER_CACHE_MEMORY_COUNTERS_H_
+#define COMPONENTS_DATA_SERVER_CACHE_MEMORY_COUNTERS_H_
+
+#include <atomic>
+#include <cstdint>
+#include <string_view>
+
+#include "components/data_server/cache/cache.h"
+
+namespace kv_server {
+
+// Byte counts behind `Cache::GetMemoryUsage`. Counts are updated with relaxed
+// atomic additions, so writers holding different locks can share them and
+// readers don't need any lock. A snapshot may be slightly out of date.
+class MemoryCounters {
+ public:
+  // Bytes held for the record of a deleted key, until it is cleaned up.
+  static int64_t KeyTombstoneBytes(std::string_view key) {
+    return key.size() + sizeof(int64_t);
+  }
+
+  // Bytes held for a member of a key-value set: its value ID and its logical
+  // commit time.
+  static constexpr int64_t kSetMemberBytes = sizeof(uint32_t) + sizeof(int64_t);
+
+  void AddKeyBytes(int64_t bytes) { Add(key_bytes_, bytes); }
+  void AddValueBytes(int64_t bytes) { Add(value_bytes_, bytes); }
+  void AddSetMemberBytes(int64_t bytes) { Add(set_member_bytes_, bytes); }
+  void AddTombstoneBytes(int64_t bytes) { Add(tombstone_bytes_, bytes); }
+
+  // Returns the counts. Interned values aren't tracked here.
+  CacheMemoryUsage Get() const {
+    return CacheMemoryUsage{
+        .key_bytes = key_bytes_.load(std::memory_order_relaxed),
+        .value_bytes = value_bytes_.load(std::memory_order_relaxed),
+        .set_member_bytes = set_member_bytes_.load(std::memory_order_relaxed),
+        .tombstone_bytes = tombstone_bytes_.load(std::memory_order_relaxed),
+    };
+  }
+
+ private:
+  static void Add(std::atomic<int64_t>& counter, int64_t bytes) {
+    counter.fetch_add(bytes, std::memory_order_relaxed);
+  }
+
+  std::atomic<int64_t> key_bytes_ = 0;
+  std::atomic<int64_t> value_bytes_ = 0;
+  std::atomic<int64_t> set_member_bytes_ = 0;
+  std::atomic<int64_t> tombstone_bytes_ = 0;
+};
+
+}  // namespace kv_server
+
+#endif  // COMPONENTS_DATA_SERVER_CACHE_MEMORY_COUNTERS_H_
@@ -15,12 +15,15 @@
 #ifndef COMPONENTS_DATA_SERVER_CACHE_MOCKS_H_
 #define COMPONENTS_DATA_SERVER_CACHE_MOCKS_H_
 
+#include <functional>
 #include <memory>
 #include <string>
 #include <utility>
 #include <vector>
 
+#include "absl/strings/cord.h"
 #include "components/data_server/cache/cache.h"
+#include "components/query/roaring_bitmap.h"
 #include "gmock/gmock.h"
 
 namespace kv_server {
@@ -32,7 +35,8 @@ MATCHER_P2(KVPairEq, key, value, "") {
 
 class MockCache : public Cache {
  public:
-  MOCK_METHOD((absl::flat_hash_map<std::string, std::string>), GetKeyValuePairs,
+  MOCK_METHOD((absl::flat_hash_map<std::string_view, absl::Cord>),
+              GetKeyValuePairs,
               (const std::vector<std::string_view>& key_list),
               (const, override));
   MOCK_METHOD((std::unique_ptr<GetKeyValueSetResult>), GetKeyValueSet,
@@ -51,15 +55,22 @@ class MockCache : public Cache {
               (override));
   MOCK_METHOD(void, DeleteKey, (std::string_view key, int64_t ts), (override));
   MOCK_METHOD(void, RemoveDeletedKeys, (int64_t ts), (override));
+  MOCK_METHOD(CacheMemoryUsage, GetMemoryUsage, (), (const, override));
+  MOCK_METHOD(void, ExportMutations,
+              (const std::function<void(const Mutation&)>&),
+              (const, override));
 };
 
 class MockGetKeyValueSetResult : public GetKeyValueSetResult {
  public:
   MOCK_METHOD((absl::flat_hash_set<std::string_view>), GetValueSet,
               (std::string_view), (const, override));
+  MOCK_METHOD((const RoaringBitmap&), GetValueIdSet, (std::string_view),
+              (const, override));
+  MOCK_METHOD((std::vector<std::string_view>), GetValues,
+              (const RoaringBitmap&), (const, override));
   MOCK_METHOD(void, AddKeyValueSet,
-              (std::string_view, absl::flat_hash_set<std::string_view>,
-               std::unique_ptr<absl::ReaderMutexLock>),
+              (std::string_view, std::shared_ptr<const RoaringBitmap>),
               (override));
 };
 
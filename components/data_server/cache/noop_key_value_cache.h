@@ -16,16 +16,19 @@
 #ifndef COMPONENTS_DATA_SERVER_CACHE_NOOP_KEY_VALUE_CACHE_H_
 #define COMPONENTS_DATA_SERVER_CACHE_NOOP_KEY_VALUE_CACHE_H_
 
+#include <functional>
 #include <memory>
 #include <string>
 #include <vector>
 
+#include "absl/strings/cord.h"
 #include "components/data_server/cache/cache.h"
+#include "components/query/roaring_bitmap.h"
 
 namespace kv_server {
 class NoOpKeyValueCache : public Cache {
  public:
-  absl::flat_hash_map<std::string, std::string> GetKeyValuePairs(
+  absl::flat_hash_map<std::string_view, absl::Cord> GetKeyValuePairs(
       const std::vector<std::string_view>& key_list) const override {
     return {};
   };
@@ -43,6 +46,9 @@ class NoOpKeyValueCache : public Cache {
                          absl::Span<std::string_view> value_set,
                          int64_t logical_commit_time) override {}
   void RemoveDeletedKeys(int64_t logical_commit_time) override {}
+  CacheMemoryUsage GetMemoryUsage() const override { return {}; }
+  void ExportMutations(
+      const std::function<void(const Mutation&)>& callback) const override {}
   static std::unique_ptr<Cache> Create() {
     return std::make_unique<NoOpKeyValueCache>();
   }
@@ -53,9 +59,18 @@ class NoOpKeyValueCache : public Cache {
         std::string_view key) const override {
       return {};
     }
+    const RoaringBitmap& GetValueIdSet(std::string_view key) const override {
+      return empty_set_;
+    }
+    std::vector<std::string_view> GetValues(
+        const RoaringBitmap& value_ids) const override {
+      return {};
+    }
     void AddKeyValueSet(
-        std::string_view key, absl::flat_hash_set<std::string_view> value_set,
-        std::unique_ptr<absl::ReaderMutexLock> key_lock) override {}
+        std::string_view key,
+        std::shared_ptr<const RoaringBitmap> value_ids) override {}
+
+    RoaringBitmap empty_set_;
   };
 };
 
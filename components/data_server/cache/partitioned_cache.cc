@@ -0,0 +1,394 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "components/data_server/cache/partitioned_cache.h"
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "absl/memory/memory.h"
+
+namespace kv_server {
+namespace {
+
+bool IsSetMutation(const Mutation& mutation) {
+  return mutation.type == Mutation::Type::kUpdateKeyValueSet ||
+         mutation.type == Mutation::Type::kDeleteValuesInSet;
+}
+
+// Moves the set mutations after the pair mutations and returns the number
+// of pair mutations. Pairs and sets are keyed separately, so only the order
+// of the mutations of each kind matters.
+size_t PartitionPairMutations(absl::Span<Mutation> mutations) {
+  return std::stable_partition(
+             mutations.begin(), mutations.end(),
+             [](const Mutation& mutation) { return !IsSetMutation(mutation); }) -
+         mutations.begin();
+}
+
+// Partition of a namespace. Key-value pairs are kept in `table`, and
+// key-value sets in the table of the default partition, `set_table`.
+// `table` also holds the key-value pairs of data files without a namespace,
+// so lookups only read `table`.
+class NamespacePartition : public Cache {
+ public:
+  NamespacePartition(Cache& table, Cache& set_table)
+      : table_(table), set_table_(set_table) {}
+
+  absl::flat_hash_map<std::string_view, absl::Cord> GetKeyValuePairs(
+      const std::vector<std::string_view>& key_list) const override {
+    return table_.GetKeyValuePairs(key_list);
+  }
+
+  std::unique_ptr<ReadVersion> PinReadVersion() const override {
+    return table_.PinReadVersion();
+  }
+
+  absl::flat_hash_map<std::string_view, absl::Cord> GetKeyValuePairsAt(
+      const std::vector<std::string_view>& key_list,
+      const ReadVersion* read_version) const override {
+    return table_.GetKeyValuePairsAt(key_list, read_version);
+  }
+
+  absl::flat_hash_map<std::string_view, google::protobuf::Value>
+  GetValueProtosAt(const std::vector<std::string_view>& key_list,
+                   const ReadVersion* read_version) const override {
+    return table_.GetValueProtosAt(key_list, read_version);
+  }
+
+  std::unique_ptr<GetKeyValueSetResult> GetKeyValueSet(
+      const absl::flat_hash_set<std::string_view>& key_set) const override {
+    return set_table_.GetKeyValueSet(key_set);
+  }
+
+  void UpdateKeyValue(std::string_view key, std::string_view value,
+                      int64_t logical_commit_time) override {
+    table_.UpdateKeyValue(key, value, logical_commit_time);
+  }
+
+  void UpdateKeyValueSet(std::string_view key,
+                         absl::Span<std::string_view> value_set,
+                         int64_t logical_commit_time) override {
+    set_table_.UpdateKeyValueSet(key, value_set, logical_commit_time);
+  }
+
+  void DeleteKey(std::string_view key, int64_t logical_commit_time) override {
+    table_.DeleteKey(key, logical_commit_time);
+  }
+
+  void DeleteValuesInSet(std::string_view key,
+                         absl::Span<std::string_view> value_set,
+                         int64_t logical_commit_time) override {
+    set_table_.DeleteValuesInSet(key, value_set, logical_commit_time);
+  }
+
+  void ApplyBatch(absl::Span<Mutation> mutations) override {
+    const size_t num_pairs = PartitionPairMutations(mutations);
+    if (num_pairs > 0) {
+      table_.ApplyBatch(mutations.subspan(0, num_pairs));
+    }
+    if (num_pairs < mutations.size()) {
+      set_table_.ApplyBatch(mutations.subspan(num_pairs));
+    }
+  }
+
+  void RemoveDeletedKeys(int64_t logical_commit_time) override {
+    table_.RemoveDeletedKeys(logical_commit_time);
+  }
+
+  CacheMemoryUsage GetMemoryUsage() const override {
+    return table_.GetMemoryUsage();
+  }
+
+  void ExportMutations(
+      const std::function<void(const Mutation&)>& callback) const override {
+    table_.ExportMutations(callback);
+  }
+
+ private:
+  Cache& table_;
+  Cache& set_table_;
+};
+
+// Default partition, whose `table` holds the key-value sets and the
+// key-value pairs of data files without a namespace. Those pairs apply to
+// every namespace, so their mutations are applied to the tables of the
+// namespaces too, `namespace_tables`. Each table then orders an update or
+// deletion without a namespace against those of its own namespace by
+// logical commit time, like any other mutation of the key.
+class DefaultPartition : public Cache {
+ public:
+  DefaultPartition(Cache& table, std::vector<Cache*> namespace_tables)
+      : table_(table), namespace_tables_(std::move(namespace_tables)) {}
+
+  absl::flat_hash_map<std::string_view, absl::Cord> GetKeyValuePairs(
+      const std::vector<std::string_view>& key_list) const override {
+    return table_.GetKeyValuePairs(key_list);
+  }
+
+  std::unique_ptr<ReadVersion> PinReadVersion() const override {
+    return table_.PinReadVersion();
+  }
+
+  absl::flat_hash_map<std::string_view, absl::Cord> GetKeyValuePairsAt(
+      const std::vector<std::string_view>& key_list,
+      const ReadVersion* read_version) const override {
+    return table_.GetKeyValuePairsAt(key_list, read_version);
+  }
+
+  absl::flat_hash_map<std::string_view, google::protobuf::Value>
+  GetValueProtosAt(const std::vector<std::string_view>& key_list,
+                   const ReadVersion* read_version) const override {
+    return table_.GetValueProtosAt(key_list, read_version);
+  }
+
+  std::unique_ptr<GetKeyValueSetResult> GetKeyValueSet(
+      const absl::flat_hash_set<std::string_view>& key_set) const override {
+    return table_.GetKeyValueSet(key_set);
+  }
+
+  void UpdateKeyValue(std::string_view key, std::string_view value,
+                      int64_t logical_commit_time) override {
+    table_.UpdateKeyValue(key, value, logical_commit_time);
+    for (Cache* table : namespace_tables_) {
+      table->UpdateKeyValue(key, value, logical_commit_time);
+    }
+  }
+
+  void UpdateKeyValueSet(std::string_view key,
+                         absl::Span<std::string_view> value_set,
+                         int64_t logical_commit_time) override {
+    table_.UpdateKeyValueSet(key, value_set, logical_commit_time);
+  }
+
+  void DeleteKey(std::string_view key, int64_t logical_commit_time) override {
+    table_.DeleteKey(key, logical_commit_time);
+    for (Cache* table : namespace_tables_) {
+      table->DeleteKey(key, logical_commit_time);
+    }
+  }
+
+  void DeleteValuesInSet(std::string_view key,
+                         absl::Span<std::string_view> value_set,
+                         int64_t logical_commit_time) override {
+    table_.DeleteValuesInSet(key, value_set, logical_commit_time);
+  }
+
+  void ApplyBatch(absl::Span<Mutation> mutations) override {
+    const size_t num_pairs = PartitionPairMutations(mutations);
+    if (num_pairs > 0) {
+      const absl::Span<Mutation> pairs = mutations.subspan(0, num_pairs);
+      // Tables may move from the mutations they apply, so each namespace
+      // table gets a copy.
+      std::vector<Mutation> copy;
+      for (Cache* table : namespace_tables_) {
+        copy.assign(pairs.begin(), pairs.end());
+        table->ApplyBatch(absl::MakeSpan(copy));
+      }
+    }
+    table_.ApplyBatch(mutations);
+  }
+
+  void RemoveDeletedKeys(int64_t logical_commit_time) override {
+    table_.RemoveDeletedKeys(logical_commit_time);
+  }
+
+  CacheMemoryUsage GetMemoryUsage() const override {
+    return table_.GetMemoryUsage();
+  }
+
+  void ExportMutations(
+      const std::function<void(const Mutation&)>& callback) const override {
+    table_.ExportMutations(callback);
+  }
+
+ private:
+  Cache& table_;
+  const std::vector<Cache*> namespace_tables_;
+};
+
+// Versions pinned on each table, indexed by namespace.
+struct PartitionedReadVersion : public ReadVersion {
+  std::vector<std::unique_ptr<ReadVersion>> versions;
+};
+
+const ReadVersion* VersionOf(const ReadVersion* read_version, int index) {
+  if (read_version == nullptr) {
+    return nullptr;
+  }
+  return static_cast<const PartitionedReadVersion*>(read_version)
+      ->versions[index]
+      .get();
+}
+
+}  // namespace
+
+PartitionedCache::PartitionedCache(const Factory& factory) {
+  for (int i = 0; i < kNumPartitions; ++i) {
+    tables_[i] = factory(static_cast<KeyNamespace::Enum>(i));
+  }
+  std::vector<Cache*> namespace_tables;
+  for (int i = 1; i < kNumPartitions; ++i) {
+    partitions_[i] = std::make_unique<NamespacePartition>(*tables_[i],
+                                                          *tables_[0]);
+    namespace_tables.push_back(tables_[i].get());
+  }
+  partitions_[0] = std::make_unique<DefaultPartition>(
+      *tables_[0], std::move(namespace_tables));
+}
+
+template <typename ValueT>
+absl::flat_hash_map<std::string_view, ValueT> PartitionedCache::LookUp(
+    const std::vector<std::string_view>& key_list,
+    const std::function<absl::flat_hash_map<std::string_view, ValueT>(
+        const Cache&, int, const std::vector<std::string_view>&)>& look_up)
+    const {
+  absl::flat_hash_map<std::string_view, ValueT> kv_pairs =
+      look_up(*tables_[0], 0, key_list);
+  std::vector<std::string_view> missing_keys;
+  for (int i = 1; i < kNumPartitions; ++i) {
+    missing_keys.clear();
+    for (std::string_view key : key_list) {
+      if (!kv_pairs.contains(key)) {
+        missing_keys.push_back(key);
+      }
+    }
+    if (missing_keys.empty()) {
+      break;
+    }
+    for (auto& [key, value] : look_up(*tables_[i], i, missing_keys)) {
+      kv_pairs.emplace(key, std::move(value));
+    }
+  }
+  return kv_pairs;
+}
+
+absl::flat_hash_map<std::string_view, absl::Cord>
+PartitionedCache::GetKeyValuePairs(
+    const std::vector<std::string_view>& key_list) const {
+  return LookUp<absl::Cord>(
+      key_list, [](const Cache& table, int index,
+                   const std::vector<std::string_view>& keys) {
+        return table.GetKeyValuePairs(keys);
+      });
+}
+
+std::unique_ptr<ReadVersion> PartitionedCache::PinReadVersion() const {
+  auto version = std::make_unique<PartitionedReadVersion>();
+  version->versions.reserve(kNumPartitions);
+  for (const auto& table : tables_) {
+    version->versions.push_back(table->PinReadVersion());
+  }
+  return version;
+}
+
+absl::flat_hash_map<std::string_view, absl::Cord>
+PartitionedCache::GetKeyValuePairsAt(
+    const std::vector<std::string_view>& key_list,
+    const ReadVersion* read_version) const {
+  return LookUp<absl::Cord>(
+      key_list, [read_version](const Cache& table, int index,
+                               const std::vector<std::string_view>& keys) {
+        return table.GetKeyValuePairsAt(keys, VersionOf(read_version, index));
+      });
+}
+
+absl::flat_hash_map<std::string_view, google::protobuf::Value>
+PartitionedCache::GetValueProtosAt(
+    const std::vector<std::string_view>& key_list,
+    const ReadVersion* read_version) const {
+  return LookUp<google::protobuf::Value>(
+      key_list, [read_version](const Cache& table, int index,
+                               const std::vector<std::string_view>& keys) {
+        return table.GetValueProtosAt(keys, VersionOf(read_version, index));
+      });
+}
+
+std::unique_ptr<GetKeyValueSetResult> PartitionedCache::GetKeyValueSet(
+    const absl::flat_hash_set<std::string_view>& key_set) const {
+  return tables_[0]->GetKeyValueSet(key_set);
+}
+
+void PartitionedCache::UpdateKeyValue(std::string_view key,
+                                      std::string_view value,
+                                      int64_t logical_commit_time) {
+  partitions_[0]->UpdateKeyValue(key, value, logical_commit_time);
+}
+
+void PartitionedCache::UpdateKeyValueSet(
+    std::string_view key, absl::Span<std::string_view> value_set,
+    int64_t logical_commit_time) {
+  partitions_[0]->UpdateKeyValueSet(key, value_set, logical_commit_time);
+}
+
+void PartitionedCache::DeleteKey(std::string_view key,
+                                 int64_t logical_commit_time) {
+  partitions_[0]->DeleteKey(key, logical_commit_time);
+}
+
+void PartitionedCache::DeleteValuesInSet(
+    std::string_view key, absl::Span<std::string_view> value_set,
+    int64_t logical_commit_time) {
+  partitions_[0]->DeleteValuesInSet(key, value_set, logical_commit_time);
+}
+
+void PartitionedCache::ApplyBatch(absl::Span<Mutation> mutations) {
+  partitions_[0]->ApplyBatch(mutations);
+}
+
+void PartitionedCache::RemoveDeletedKeys(int64_t logical_commit_time) {
+  for (const auto& table : tables_) {
+    table->RemoveDeletedKeys(logical_commit_time);
+  }
+}
+
+CacheMemoryUsage PartitionedCache::GetMemoryUsage() const {
+  CacheMemoryUsage usage;
+  for (const auto& table : tables_) {
+    usage += table->GetMemoryUsage();
+  }
+  return usage;
+}
+
+void PartitionedCache::ExportMutations(
+    const std::function<void(const Mutation&)>& callback) const {
+  for (const auto& table : tables_) {
+    table->ExportMutations(callback);
+  }
+}
+
+Cache& PartitionedCache::GetPartition(KeyNamespace::Enum key_namespace) {
+  if (key_namespace <= 0 || key_namespace >= kNumPartitions) {
+    return *partitions_[0];
+  }
+  return *partitions_[key_namespace];
+}
+
+const Cache& PartitionedCache::GetPartition(
+    KeyNamespace::Enum key_namespace) const {
+  if (key_namespace <= 0 || key_namespace >= kNumPartitions) {
+    return *partitions_[0];
+  }
+  return *partitions_[key_namespace];
+}
+
+std::unique_ptr<PartitionedCache> PartitionedCache::Create(
+    const Factory& factory) {
+  return absl::WrapUnique(new PartitionedCache(factory));
+}
+
+}  // namespace kv_server
@@ -0,0 +1,129 @@
+/*
+ * Copyright 2023 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef COMPONENTS_DATA_SERVER_CACHE_PARTITIONED_CACHE_H_
+#define COMPONENTS_DATA_SERVER_CACHE_PARTITIONED_CACHE_H_
+
+#include <array>
+#include <functional>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
+#include "components/data_server/cache/cache.h"
+#include "components/data_server/cache/get_key_value_set_result.h"
+#include "public/base_types.pb.h"
+
+namespace kv_server {
+
+// Cache split into a partition per key namespace, each with its own table
+// and locks, so that lookups of one namespace don't contend with updates of
+// another and every table stays smaller. Data files and lookups select a
+// partition with `GetPartition`.
+//
+// Calls made on the cache itself, without a namespace, update the partition
+// of KEY_NAMESPACE_UNSPECIFIED, the default partition, and look up keys in
+// the default partition first and then in the others. Key-value sets are
+// queried without a namespace, so all of them are kept in the default
+// partition. Data files without a namespace apply to every namespace, so
+// their key-value pair mutations are applied to the partition of every
+// namespace too, where they take effect by logical commit time against the
+// mutations of that namespace. This holds such pairs once per partition.
+//
+// Namespaces aren't exported with `ExportMutations`, so exported mutations
+// load back into the default partition.
+class PartitionedCache : public Cache {
+ public:
+  // Makes the table of a partition.
+  using Factory = std::function<std::unique_ptr<Cache>(KeyNamespace::Enum)>;
+
+  absl::flat_hash_map<std::string_view, absl::Cord> GetKeyValuePairs(
+      const std::vector<std::string_view>& key_list) const override;
+
+  // Pins every partition.
+  std::unique_ptr<ReadVersion> PinReadVersion() const override;
+
+  absl::flat_hash_map<std::string_view, absl::Cord> GetKeyValuePairsAt(
+      const std::vector<std::string_view>& key_list,
+      const ReadVersion* read_version) const override;
+
+  absl::flat_hash_map<std::string_view, google::protobuf::Value>
+  GetValueProtosAt(const std::vector<std::string_view>& key_list,
+                   const ReadVersion* read_version) const override;
+
+  std::unique_ptr<GetKeyValueSetResult> GetKeyValueSet(
+      const absl::flat_hash_set<std::string_view>& key_set) const override;
+
+  void UpdateKeyValue(std::string_view key, std::string_view value,
+                      int64_t logical_commit_time) override;
+
+  void UpdateKeyValueSet(std::string_view key,
+                         absl::Span<std::string_view> value_set,
+                         int64_t logical_commit_time) override;
+
+  void DeleteKey(std::string_view key, int64_t logical_commit_time) override;
+
+  void DeleteValuesInSet(std::string_view key,
+                         absl::Span<std::string_view> value_set,
+                         int64_t logical_commit_time) override;
+
+  void ApplyBatch(absl::Span<Mutation> mutations) override;
+
+  // Removes deleted keys from every partition.
+  void RemoveDeletedKeys(int64_t logical_commit_time) override;
+
+  // Returns the bytes held by all partitions.
+  CacheMemoryUsage GetMemoryUsage() const override;
+
+  void ExportMutations(
+      const std::function<void(const Mutation&)>& callback) const override;
+
+  // Invalid namespaces select the default partition. The partitions of
+  // other namespaces keep their key-value set mutations in the default
+  // partition, and only measure and export their key-value pairs.
+  Cache& GetPartition(KeyNamespace::Enum key_namespace) override;
+  const Cache& GetPartition(KeyNamespace::Enum key_namespace) const override;
+
+  static std::unique_ptr<PartitionedCache> Create(const Factory& factory);
+
+ private:
+  static constexpr int kNumPartitions = KeyNamespace::Enum_ARRAYSIZE;
+
+  explicit PartitionedCache(const Factory& factory);
+
+  // Calls `look_up` with the table and index of each partition, the default
+  // one first, and the keys not found in the previous ones. `ValueT` is the
+  // type of the values it returns.
+  template <typename ValueT>
+  absl::flat_hash_map<std::string_view, ValueT> LookUp(
+      const std::vector<std::string_view>& key_list,
+      const std::function<absl::flat_hash_map<std::string_view, ValueT>(
+          const Cache&, int, const std::vector<std::string_view>&)>& look_up)
+      const;
+
+  // Indexed by namespace.
+  std::array<std::unique_ptr<Cache>, kNumPartitions> tables_;
+  // Views of the partitions. Those of the namespaces forward key-value set
+  // calls to the default table, and the default one forwards key-value pair
+  // mutations to every table.
+  std::array<std::unique_ptr<Cache>, kNumPartitions> partitions_;
+};
+
+}  // namespace kv_server
+
+#endif  // COMPONENTS_DATA_SERVER_CACHE_PARTITIONED_CACHE_H_
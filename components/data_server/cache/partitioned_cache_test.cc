@@ -0,0 +1,187 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "components/data_server/cache/partitioned_cache.h"
+
+#include <memory>
+#include <string_view>
+#include <vector>
+
+#include "components/data_server/cache/cache.h"
+#include "components/data_server/cache/key_value_cache.h"
+#include "components/data_server/cache/mocks.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "public/base_types.pb.h"
+#include "src/cpp/telemetry/metrics_recorder.h"
+#include "src/cpp/telemetry/telemetry_provider.h"
+
+namespace kv_server {
+namespace {
+
+using privacy_sandbox::server_common::MetricsRecorder;
+using privacy_sandbox::server_common::TelemetryProvider;
+using testing::IsEmpty;
+using testing::UnorderedElementsAre;
+
+std::unique_ptr<PartitionedCache> CreateCache(
+    MetricsRecorder& metrics_recorder) {
+  return PartitionedCache::Create([&metrics_recorder](KeyNamespace::Enum) {
+    return KeyValueCache::Create(metrics_recorder);
+  });
+}
+
+TEST(PartitionedCacheTest, KeepsNamespacesApart) {
+  auto noop_metrics_recorder =
+      TelemetryProvider::GetInstance().CreateMetricsRecorder();
+  auto cache = CreateCache(*noop_metrics_recorder);
+  Cache& keys = cache->GetPartition(KeyNamespace::KEYS);
+  Cache& render_urls = cache->GetPartition(KeyNamespace::RENDER_URLS);
+  keys.UpdateKeyValue("key1", "keys_value", 1);
+  render_urls.UpdateKeyValue("key1", "render_urls_value", 1);
+  render_urls.UpdateKeyValue("key2", "value2", 1);
+
+  EXPECT_THAT(keys.GetKeyValuePairs({"key1", "key2"}),
+              UnorderedElementsAre(KVPairEq("key1", "keys_value")));
+  EXPECT_THAT(render_urls.GetKeyValuePairs({"key1", "key2"}),
+              UnorderedElementsAre(KVPairEq("key1", "render_urls_value"),
+                                   KVPairEq("key2", "value2")));
+  EXPECT_THAT(cache->GetPartition(KeyNamespace::KV_INTERNAL)
+                  .GetKeyValuePairs({"key1", "key2"}),
+              IsEmpty());
+  // Each partition is measured on its own.
+  EXPECT_EQ(keys.GetMemoryUsage().value_bytes, 10);
+  EXPECT_EQ(render_urls.GetMemoryUsage().value_bytes, 23);
+  EXPECT_EQ(cache->GetMemoryUsage().value_bytes, 33);
+
+  keys.DeleteKey("key1", 2);
+  cache->RemoveDeletedKeys(3);
+  EXPECT_EQ(keys.GetMemoryUsage().total_bytes(), 0);
+}
+
+TEST(PartitionedCacheTest, LookupsWithoutNamespaceSearchAllPartitions) {
+  auto noop_metrics_recorder =
+      TelemetryProvider::GetInstance().CreateMetricsRecorder();
+  auto cache = CreateCache(*noop_metrics_recorder);
+  cache->UpdateKeyValue("key1", "default_value", 1);
+  cache->GetPartition(KeyNamespace::KEYS).UpdateKeyValue("key1", "ignored", 1);
+  cache->GetPartition(KeyNamespace::KEYS).UpdateKeyValue("key2", "value2", 1);
+  // Invalid namespaces select the default partition.
+  EXPECT_EQ(&cache->GetPartition(static_cast<KeyNamespace::Enum>(100)),
+            &cache->GetPartition(KeyNamespace::KEY_NAMESPACE_UNSPECIFIED));
+
+  EXPECT_THAT(cache->GetKeyValuePairs({"key1", "key2", "key3"}),
+              UnorderedElementsAre(KVPairEq("key1", "default_value"),
+                                   KVPairEq("key2", "value2")));
+
+  std::unique_ptr<ReadVersion> version = cache->PinReadVersion();
+  cache->GetPartition(KeyNamespace::KEYS).UpdateKeyValue("key2", "newer", 2);
+  EXPECT_THAT(cache->GetKeyValuePairsAt({"key2"}, version.get()),
+              UnorderedElementsAre(KVPairEq("key2", "value2")));
+  EXPECT_THAT(cache->GetKeyValuePairsAt({"key2"}, nullptr),
+              UnorderedElementsAre(KVPairEq("key2", "newer")));
+}
+
+TEST(PartitionedCacheTest, DefaultPartitionUpdatesApplyToEveryNamespace) {
+  auto noop_metrics_recorder =
+      TelemetryProvider::GetInstance().CreateMetricsRecorder();
+  auto cache = CreateCache(*noop_metrics_recorder);
+  cache->UpdateKeyValue("key1", "default_value", 1);
+  cache->UpdateKeyValue("key2", "default_value", 1);
+  Cache& keys = cache->GetPartition(KeyNamespace::KEYS);
+  keys.UpdateKeyValue("key2", "keys_value", 2);
+
+  EXPECT_THAT(keys.GetKeyValuePairs({"key1", "key2", "key3"}),
+              UnorderedElementsAre(KVPairEq("key1", "default_value"),
+                                   KVPairEq("key2", "keys_value")));
+  EXPECT_THAT(cache->GetPartition(KeyNamespace::RENDER_URLS)
+                  .GetKeyValuePairs({"key1", "key2"}),
+              UnorderedElementsAre(KVPairEq("key1", "default_value"),
+                                   KVPairEq("key2", "default_value")));
+
+  // Versions pinned on the partition cover the updates without a namespace.
+  std::unique_ptr<ReadVersion> version = keys.PinReadVersion();
+  cache->UpdateKeyValue("key1", "newer", 2);
+  EXPECT_THAT(keys.GetKeyValuePairsAt({"key1"}, version.get()),
+              UnorderedElementsAre(KVPairEq("key1", "default_value")));
+  EXPECT_THAT(keys.GetKeyValuePairsAt({"key1"}, nullptr),
+              UnorderedElementsAre(KVPairEq("key1", "newer")));
+}
+
+TEST(PartitionedCacheTest, OrdersNamespaceAndDefaultMutationsByCommitTime) {
+  auto noop_metrics_recorder =
+      TelemetryProvider::GetInstance().CreateMetricsRecorder();
+  auto cache = CreateCache(*noop_metrics_recorder);
+  Cache& default_partition =
+      cache->GetPartition(KeyNamespace::KEY_NAMESPACE_UNSPECIFIED);
+  Cache& keys = cache->GetPartition(KeyNamespace::KEYS);
+  keys.UpdateKeyValue("key1", "keys_value", 1);
+  keys.UpdateKeyValue("key2", "keys_value", 1);
+  keys.UpdateKeyValue("key3", "keys_value", 3);
+
+  // Newer mutations without a namespace replace older ones of a namespace.
+  default_partition.UpdateKeyValue("key1", "default_value", 2);
+  std::vector<Mutation> mutations = {
+      {.type = Mutation::Type::kDeleteKey,
+       .key = "key2",
+       .logical_commit_time = 2},
+      {.type = Mutation::Type::kUpdateKeyValue,
+       .key = "key3",
+       .value = "default_value",
+       .logical_commit_time = 2},
+  };
+  default_partition.ApplyBatch(absl::MakeSpan(mutations));
+  EXPECT_THAT(keys.GetKeyValuePairs({"key1", "key2", "key3"}),
+              UnorderedElementsAre(KVPairEq("key1", "default_value"),
+                                   KVPairEq("key3", "keys_value")));
+
+  // Newer deletions of a namespace hide older values without a namespace,
+  // in that namespace only.
+  keys.DeleteKey("key1", 3);
+  EXPECT_THAT(keys.GetKeyValuePairs({"key1"}), IsEmpty());
+  EXPECT_THAT(cache->GetPartition(KeyNamespace::RENDER_URLS)
+                  .GetKeyValuePairs({"key1"}),
+              UnorderedElementsAre(KVPairEq("key1", "default_value")));
+  cache->RemoveDeletedKeys(4);
+  EXPECT_THAT(keys.GetKeyValuePairs({"key1", "key2"}), IsEmpty());
+}
+
+TEST(PartitionedCacheTest, KeepsKeyValueSetsInDefaultPartition) {
+  auto noop_metrics_recorder =
+      TelemetryProvider::GetInstance().CreateMetricsRecorder();
+  auto cache = CreateCache(*noop_metrics_recorder);
+  std::vector<std::string_view> values = {"v1", "v2"};
+  std::vector<Mutation> mutations = {
+      {.type = Mutation::Type::kUpdateKeyValueSet,
+       .key = "my_set",
+       .value_set = values,
+       .logical_commit_time = 1},
+      {.type = Mutation::Type::kUpdateKeyValue,
+       .key = "my_key",
+       .value = "my_value",
+       .logical_commit_time = 1},
+  };
+  Cache& keys = cache->GetPartition(KeyNamespace::KEYS);
+  keys.ApplyBatch(absl::MakeSpan(mutations));
+
+  EXPECT_THAT(keys.GetKeyValuePairs({"my_key"}),
+              UnorderedElementsAre(KVPairEq("my_key", "my_value")));
+  EXPECT_THAT(cache->GetKeyValueSet({"my_set"})->GetValueSet("my_set"),
+              UnorderedElementsAre("v1", "v2"));
+  EXPECT_EQ(keys.GetMemoryUsage().set_member_bytes, 0);
+  EXPECT_GT(cache->GetMemoryUsage().set_member_bytes, 0);
+}
+
+}  // namespace
+}  // namespace kv_server
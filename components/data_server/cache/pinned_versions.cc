@@ -0,0 +1,57 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "components/data_server/cache/pinned_versions.h"
+
+#include <functional>
+#include <thread>
+
+namespace kv_server {
+
+PinnedVersions::PinnedVersions() : shards_(new Shard[kNumShards]) {}
+
+int PinnedVersions::Pin(int64_t version) {
+  const int shard =
+      std::hash<std::thread::id>()(std::this_thread::get_id()) % kNumShards;
+  absl::MutexLock lock(&shards_[shard].mutex);
+  ++shards_[shard].versions[version];
+  num_pins_.fetch_add(1, std::memory_order_release);
+  return shard;
+}
+
+void PinnedVersions::Unpin(int shard, int64_t version) {
+  absl::MutexLock lock(&shards_[shard].mutex);
+  auto& versions = shards_[shard].versions;
+  const auto it = versions.find(version);
+  if (--it->second == 0) {
+    versions.erase(it);
+  }
+  num_pins_.fetch_sub(1, std::memory_order_release);
+}
+
+bool PinnedVersions::IsAnyPinned(int64_t begin, int64_t end) const {
+  if (empty()) {
+    return false;
+  }
+  for (int i = 0; i < kNumShards; ++i) {
+    absl::MutexLock lock(&shards_[i].mutex);
+    const auto it = shards_[i].versions.lower_bound(begin);
+    if (it != shards_[i].versions.end() && it->first < end) {
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace kv_server
@@ -0,0 +1,69 @@
+/*
+ * Copyright 2023 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef COMPONENTS_DATA_SERVER_CACHE_PINNED_VERSIONS_H_
+#define COMPONENTS_DATA_SERVER_CACHE_PINNED_VERSIONS_H_
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+#include "absl/container/btree_map.h"
+#include "absl/synchronization/mutex.h"
+
+namespace kv_server {
+
+// Read versions pinned on a cache, with the number of pins of each.
+//
+// Split into shards with a lock each, picked by the pinning thread, so that
+// concurrent lookups rarely contend on their pins. The pins are also
+// counted, so that writers don't look at the shards while none are held.
+// Thread-safe.
+class PinnedVersions {
+ public:
+  PinnedVersions();
+
+  PinnedVersions(const PinnedVersions&) = delete;
+  PinnedVersions& operator=(const PinnedVersions&) = delete;
+
+  // Pins `version`, and returns the shard to pass to `Unpin`.
+  int Pin(int64_t version);
+
+  // Releases a pin of `version` taken with `Pin`.
+  void Unpin(int shard, int64_t version);
+
+  // Returns whether any version from `begin` up to, but excluding, `end` is
+  // pinned. Versions pinned concurrently may or may not be seen.
+  bool IsAnyPinned(int64_t begin, int64_t end) const;
+
+  // Doesn't take any lock.
+  bool empty() const { return num_pins_.load(std::memory_order_acquire) == 0; }
+
+ private:
+  static constexpr int kNumShards = 16;
+
+  struct alignas(64) Shard {
+    mutable absl::Mutex mutex;
+    absl::btree_map<int64_t, int> versions ABSL_GUARDED_BY(mutex);
+  };
+
+  const std::unique_ptr<Shard[]> shards_;
+  std::atomic<int64_t> num_pins_ = 0;
+};
+
+}  // namespace kv_server
+
+#endif  // COMPONENTS_DATA_SERVER_CACHE_PINNED_VERSIONS_H_
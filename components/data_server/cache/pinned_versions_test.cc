@@ -0,0 +1,78 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "components/data_server/cache/pinned_versions.h"
+
+#include <cstdint>
+#include <limits>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace kv_server {
+namespace {
+
+constexpr int64_t kMaxVersion = std::numeric_limits<int64_t>::max();
+
+TEST(PinnedVersionsTest, FindsPinnedVersionsInRange) {
+  PinnedVersions pins;
+  EXPECT_TRUE(pins.empty());
+  EXPECT_FALSE(pins.IsAnyPinned(0, kMaxVersion));
+
+  const int shard = pins.Pin(5);
+  EXPECT_FALSE(pins.empty());
+  EXPECT_TRUE(pins.IsAnyPinned(5, 6));
+  EXPECT_TRUE(pins.IsAnyPinned(0, kMaxVersion));
+  EXPECT_FALSE(pins.IsAnyPinned(0, 5));
+  EXPECT_FALSE(pins.IsAnyPinned(6, kMaxVersion));
+
+  pins.Unpin(shard, 5);
+  EXPECT_TRUE(pins.empty());
+  EXPECT_FALSE(pins.IsAnyPinned(0, kMaxVersion));
+}
+
+TEST(PinnedVersionsTest, CountsPinsOfEachVersion) {
+  PinnedVersions pins;
+  const int first = pins.Pin(3);
+  const int second = pins.Pin(3);
+  pins.Unpin(first, 3);
+  EXPECT_TRUE(pins.IsAnyPinned(3, 4));
+  pins.Unpin(second, 3);
+  EXPECT_FALSE(pins.IsAnyPinned(3, 4));
+}
+
+TEST(PinnedVersionsTest, PinsFromManyThreads) {
+  PinnedVersions pins;
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 8; ++i) {
+    threads.emplace_back([&pins, i] {
+      for (int j = 0; j < 1000; ++j) {
+        const int shard = pins.Pin(i);
+        pins.Unpin(shard, i);
+      }
+    });
+  }
+  const int shard = pins.Pin(100);
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  EXPECT_FALSE(pins.IsAnyPinned(0, 100));
+  EXPECT_TRUE(pins.IsAnyPinned(100, kMaxVersion));
+  pins.Unpin(shard, 100);
+  EXPECT_TRUE(pins.empty());
+}
+
+}  // namespace
+}  // namespace kv_server
@@ -0,0 +1,552 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "components/data_server/cache/rcu_key_value_cache.h"
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "absl/hash/hash.h"
+#include "absl/memory/memory.h"
+#include "components/data_server/cache/key_value_cache.h"
+#include "glog/logging.h"
+#include "src/cpp/telemetry/metrics_recorder.h"
+
+namespace kv_server {
+
+using privacy_sandbox::server_common::MetricsRecorder;
+using privacy_sandbox::server_common::ScopeLatencyRecorder;
+
+constexpr char kGetKeyValuePairsEvent[] = "GetKeyValuePairs";
+constexpr char kUpdateKeyValueEvent[] = "UpdateKeyValue";
+constexpr char kDeleteKeyEvent[] = "DeleteKey";
+constexpr char kApplyBatchEvent[] = "ApplyBatch";
+constexpr char kRemoveDeletedKeysEvent[] = "RemoveDeletedKeys";
+
+RcuKeyValueCache::Table::Table(size_t num_buckets)
+    : mask(num_buckets - 1),
+      buckets(std::make_unique<std::atomic<Node*>[]>(num_buckets)) {
+  for (size_t i = 0; i < num_buckets; ++i) {
+    buckets[i].store(nullptr, std::memory_order_relaxed);
+  }
+}
+
+RcuKeyValueCache::RcuKeyValueCache(MetricsRecorder& metrics_recorder)
+    : table_(new Table(kInitialNumBuckets)),
+      set_cache_(KeyValueCache::Create(metrics_recorder)),
+      metrics_recorder_(metrics_recorder) {}
+
+RcuKeyValueCache::~RcuKeyValueCache() {
+  Table* table = table_.load(std::memory_order_relaxed);
+  for (size_t i = 0; i <= table->mask; ++i) {
+    Node* node = table->buckets[i].load(std::memory_order_relaxed);
+    while (node != nullptr) {
+      Node* next = node->next.load(std::memory_order_relaxed);
+      const Version* version = node->version.load(std::memory_order_relaxed);
+      while (version != nullptr) {
+        const Version* previous =
+            version->previous.load(std::memory_order_relaxed);
+        delete version;
+        version = previous;
+      }
+      delete node;
+      node = next;
+    }
+  }
+  delete table;
+}
+
+// Releases its pin when destroyed.
+class RcuKeyValueCache::PinnedReadVersion : public ReadVersion {
+ public:
+  PinnedReadVersion(const RcuKeyValueCache& cache, int shard, int64_t version)
+      : cache_(cache), shard_(shard), version_(version) {}
+  ~PinnedReadVersion() override { cache_.Unpin(shard_, version_); }
+
+  int64_t version() const { return version_; }
+
+ private:
+  const RcuKeyValueCache& cache_;
+  const int shard_;
+  const int64_t version_;
+};
+
+absl::flat_hash_map<std::string_view, absl::Cord> RcuKeyValueCache::LookUp(
+    const std::vector<std::string_view>& key_list,
+    const ReadVersion* read_version) const {
+  ScopeLatencyRecorder latency_recorder(kGetKeyValuePairsEvent,
+                                        metrics_recorder_);
+  // Read versions passed to a cache always come from its own
+  // `PinReadVersion`.
+  const auto* pinned_version =
+      static_cast<const PinnedReadVersion*>(read_version);
+  absl::flat_hash_map<std::string_view, absl::Cord> kv_pairs;
+  EpochManager::ReadGuard guard = epoch_manager_.Pin();
+  const Table* table = table_.load(std::memory_order_acquire);
+  for (std::string_view key : key_list) {
+    const size_t hash = absl::Hash<std::string_view>{}(key);
+    const Node* node =
+        table->buckets[hash & table->mask].load(std::memory_order_acquire);
+    for (; node != nullptr; node = node->next.load(std::memory_order_acquire)) {
+      if (node->hash != hash || node->key != key) {
+        continue;
+      }
+      const Version* version = node->version.load(std::memory_order_acquire);
+      if (pinned_version != nullptr) {
+        while (version != nullptr &&
+               version->visible_from > pinned_version->version()) {
+          version = version->previous.load(std::memory_order_acquire);
+        }
+      }
+      if (version != nullptr && !version->deleted) {
+        VLOG(9) << "Get called for " << key
+                << ". returning value: " << version->value;
+        kv_pairs.insert_or_assign(key, version->value);
+      }
+      break;
+    }
+  }
+  return kv_pairs;
+}
+
+absl::flat_hash_map<std::string_view, absl::Cord>
+RcuKeyValueCache::GetKeyValuePairs(
+    const std::vector<std::string_view>& key_list) const {
+  return LookUp(key_list, /*read_version=*/nullptr);
+}
+
+std::unique_ptr<ReadVersion> RcuKeyValueCache::PinReadVersion() const {
+  while (true) {
+    const int64_t version = last_version_.load(std::memory_order_acquire);
+    const int shard = pinned_versions_.Pin(version);
+    // Pairs with the fence in `PublishVersion`: either the writer of the next
+    // version sees this pin, and keeps the versions it can see, or the pin
+    // sees the next version and is taken again.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (last_version_.load(std::memory_order_relaxed) == version) {
+      return std::make_unique<PinnedReadVersion>(*this, shard, version);
+    }
+    pinned_versions_.Unpin(shard, version);
+  }
+}
+
+void RcuKeyValueCache::Unpin(int shard, int64_t version) const {
+  pinned_versions_.Unpin(shard, version);
+}
+
+absl::flat_hash_map<std::string_view, absl::Cord>
+RcuKeyValueCache::GetKeyValuePairsAt(
+    const std::vector<std::string_view>& key_list,
+    const ReadVersion* read_version) const {
+  return LookUp(key_list, read_version);
+}
+
+std::unique_ptr<GetKeyValueSetResult> RcuKeyValueCache::GetKeyValueSet(
+    const absl::flat_hash_set<std::string_view>& key_set) const {
+  return set_cache_->GetKeyValueSet(key_set);
+}
+
+void RcuKeyValueCache::UpdateKeyValue(std::string_view key,
+                                      std::string_view value,
+                                      int64_t logical_commit_time) {
+  ScopeLatencyRecorder latency_recorder(kUpdateKeyValueEvent,
+                                        metrics_recorder_);
+  VLOG(9) << "Received update for [" << key << "] at " << logical_commit_time
+          << ". value will be set to: " << value;
+  {
+    absl::MutexLock lock(&mutex_);
+    UpdateKeyValueLocked(key, value, logical_commit_time);
+  }
+  epoch_manager_.MaybeSynchronize();
+}
+
+void RcuKeyValueCache::UpdateKeyValueLocked(std::string_view key,
+                                            std::string_view value,
+                                            int64_t logical_commit_time) {
+  if (logical_commit_time <= max_cleanup_logical_commit_time_) {
+    VLOG(1) << "Skipping the update as its logical_commit_time: "
+            << logical_commit_time << " is older than the current cutoff time:"
+            << max_cleanup_logical_commit_time_;
+    return;
+  }
+  const size_t hash = absl::Hash<std::string_view>{}(key);
+  Node* node = FindNode(key, hash);
+  if (node != nullptr) {
+    if (node->last_logical_commit_time >= logical_commit_time) {
+      VLOG(1) << "Skipping the update as its logical_commit_time: "
+              << logical_commit_time
+              << " is older than the current value's time:"
+              << node->last_logical_commit_time;
+      return;
+    }
+  } else {
+    node = FindOrInsertNode(key, hash);
+  }
+  // The tombstone of a deleted key stays in `deleted_nodes_`, and the
+  // cleanup skips it once it finds the key updated.
+  PublishVersion(*node, new Version{.value = absl::Cord(std::string(value))},
+                 logical_commit_time);
+}
+
+void RcuKeyValueCache::UpdateKeyValueSet(std::string_view key,
+                                         absl::Span<std::string_view> value_set,
+                                         int64_t logical_commit_time) {
+  set_cache_->UpdateKeyValueSet(key, value_set, logical_commit_time);
+}
+
+void RcuKeyValueCache::DeleteKey(std::string_view key,
+                                 int64_t logical_commit_time) {
+  ScopeLatencyRecorder latency_recorder(kDeleteKeyEvent, metrics_recorder_);
+  {
+    absl::MutexLock lock(&mutex_);
+    DeleteKeyLocked(key, logical_commit_time);
+  }
+  epoch_manager_.MaybeSynchronize();
+}
+
+void RcuKeyValueCache::DeleteKeyLocked(std::string_view key,
+                                       int64_t logical_commit_time) {
+  if (logical_commit_time <= max_cleanup_logical_commit_time_) {
+    return;
+  }
+  const size_t hash = absl::Hash<std::string_view>{}(key);
+  Node* node = FindNode(key, hash);
+  if (node != nullptr &&
+      node->last_logical_commit_time >= logical_commit_time) {
+    return;
+  }
+  // If key is missing, we still need to add a node without a value to avoid
+  // the late coming update with smaller logical commit time inserting value
+  // for the given key.
+  if (node == nullptr) {
+    node = FindOrInsertNode(key, hash);
+  }
+  PublishVersion(*node, new Version{.deleted = true}, logical_commit_time);
+  deleted_nodes_.Add(logical_commit_time, key);
+  memory_counters_.AddTombstoneBytes(TombstoneIndex::KeyBytes(key));
+}
+
+void RcuKeyValueCache::DeleteValuesInSet(std::string_view key,
+                                         absl::Span<std::string_view> value_set,
+                                         int64_t logical_commit_time) {
+  set_cache_->DeleteValuesInSet(key, value_set, logical_commit_time);
+}
+
+void RcuKeyValueCache::ApplyBatch(absl::Span<Mutation> mutations) {
+  ScopeLatencyRecorder latency_recorder(kApplyBatchEvent, metrics_recorder_);
+  std::vector<Mutation> set_mutations;
+  {
+    absl::MutexLock lock(&mutex_);
+    for (Mutation& mutation : mutations) {
+      switch (mutation.type) {
+        case Mutation::Type::kUpdateKeyValue:
+          UpdateKeyValueLocked(mutation.key, mutation.value,
+                               mutation.logical_commit_time);
+          break;
+        case Mutation::Type::kDeleteKey:
+          DeleteKeyLocked(mutation.key, mutation.logical_commit_time);
+          break;
+        case Mutation::Type::kUpdateKeyValueSet:
+        case Mutation::Type::kDeleteValuesInSet:
+          set_mutations.push_back(std::move(mutation));
+          break;
+      }
+    }
+  }
+  epoch_manager_.MaybeSynchronize();
+  if (!set_mutations.empty()) {
+    set_cache_->ApplyBatch(absl::MakeSpan(set_mutations));
+  }
+}
+
+void RcuKeyValueCache::RemoveDeletedKeys(int64_t logical_commit_time) {
+  ScopeLatencyRecorder latency_recorder(kRemoveDeletedKeysEvent,
+                                        metrics_recorder_);
+  {
+    absl::MutexLock lock(&mutex_);
+    std::optional<TombstoneIndex::Tombstone> tombstone;
+    while ((tombstone = deleted_nodes_.Peek(logical_commit_time)).has_value()) {
+      // The key may have been updated since, or already removed if it was
+      // deleted more than once. Keys with previous versions are removed once
+      // those are unlinked.
+      const Node* node = FindNode(
+          tombstone->key, absl::Hash<std::string_view>{}(tombstone->key));
+      if (node != nullptr) {
+        const Version* version = node->version.load(std::memory_order_relaxed);
+        if (version->deleted &&
+            version->previous.load(std::memory_order_relaxed) == nullptr &&
+            node->last_logical_commit_time <= logical_commit_time) {
+          EraseNode(*node);
+        }
+      }
+      memory_counters_.AddTombstoneBytes(
+          -TombstoneIndex::KeyBytes(tombstone->key));
+      deleted_nodes_.Pop();
+    }
+    max_cleanup_logical_commit_time_ =
+        std::max(max_cleanup_logical_commit_time_, logical_commit_time);
+    RemoveUnpinnedVersionsLocked();
+  }
+  // Readers don't take the writer lock, so waiting for them doesn't need to
+  // block other writers.
+  epoch_manager_.Synchronize();
+  set_cache_->RemoveDeletedKeys(logical_commit_time);
+}
+
+RcuKeyValueCache::Node* RcuKeyValueCache::FindNode(std::string_view key,
+                                                   size_t hash) const {
+  const Table* table = table_.load(std::memory_order_relaxed);
+  Node* node =
+      table->buckets[hash & table->mask].load(std::memory_order_relaxed);
+  for (; node != nullptr; node = node->next.load(std::memory_order_relaxed)) {
+    if (node->hash == hash && node->key == key) {
+      return node;
+    }
+  }
+  return nullptr;
+}
+
+RcuKeyValueCache::Node* RcuKeyValueCache::FindOrInsertNode(std::string_view key,
+                                                           size_t hash) {
+  if (Node* node = FindNode(key, hash); node != nullptr) {
+    return node;
+  }
+  if (size_ >= table_.load(std::memory_order_relaxed)->mask + 1) {
+    Grow();
+  }
+  Table* table = table_.load(std::memory_order_relaxed);
+  std::atomic<Node*>& bucket = table->buckets[hash & table->mask];
+  auto* node = new Node(key, hash);
+  memory_counters_.AddKeyBytes(key.size());
+  node->next.store(bucket.load(std::memory_order_relaxed),
+                   std::memory_order_relaxed);
+  bucket.store(node, std::memory_order_release);
+  ++size_;
+  return node;
+}
+
+void RcuKeyValueCache::PublishVersion(Node& node, Version* version,
+                                      int64_t logical_commit_time) {
+  node.last_logical_commit_time = logical_commit_time;
+  const int64_t visible_from =
+      last_version_.load(std::memory_order_relaxed) + 1;
+  version->visible_from = visible_from;
+  // The replaced version stays linked until the pins are checked, so that
+  // lookups at a version pinned meanwhile can still reach it.
+  const Version* previous = node.version.load(std::memory_order_relaxed);
+  version->previous.store(previous, std::memory_order_relaxed);
+  node.version.store(version, std::memory_order_release);
+  last_version_.store(visible_from, std::memory_order_release);
+  memory_counters_.AddValueBytes(version->value.size());
+  if (previous == nullptr) {
+    return;
+  }
+  // Pairs with the fence in `PinReadVersion`.
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (PrunePreviousVersionsLocked(*version)) {
+    keys_with_previous_versions_.emplace(node.key);
+  } else if (!keys_with_previous_versions_.empty()) {
+    keys_with_previous_versions_.erase(node.key);
+  }
+}
+
+bool RcuKeyValueCache::PrunePreviousVersionsLocked(const Version& head) {
+  // A version is seen by the read versions from its own up to that of the
+  // version that replaced it.
+  const Version* kept = &head;
+  int64_t replaced_at = head.visible_from;
+  const Version* version = head.previous.load(std::memory_order_relaxed);
+  while (version != nullptr) {
+    const Version* previous = version->previous.load(std::memory_order_relaxed);
+    if (pinned_versions_.IsAnyPinned(version->visible_from, replaced_at)) {
+      kept->previous.store(version, std::memory_order_release);
+      kept = version;
+    } else {
+      // Lookups that are on the version can still follow its link, which
+      // stays valid until the version is reclaimed.
+      memory_counters_.AddValueBytes(
+          -static_cast<int64_t>(version->value.size()));
+      epoch_manager_.Retire(const_cast<Version*>(version));
+    }
+    replaced_at = version->visible_from;
+    version = previous;
+  }
+  kept->previous.store(nullptr, std::memory_order_release);
+  return kept != &head;
+}
+
+void RcuKeyValueCache::RemoveUnpinnedVersionsLocked() {
+  for (auto it = keys_with_previous_versions_.begin();
+       it != keys_with_previous_versions_.end();) {
+    const Node* node = FindNode(*it, absl::Hash<std::string_view>{}(*it));
+    if (node != nullptr) {
+      const Version* version = node->version.load(std::memory_order_relaxed);
+      if (PrunePreviousVersionsLocked(*version)) {
+        ++it;
+        continue;
+      }
+      if (version->deleted && node->last_logical_commit_time <=
+                                  max_cleanup_logical_commit_time_) {
+        // The tombstone was cleaned up while the previous versions were
+        // kept.
+        EraseNode(*node);
+      }
+    }
+    keys_with_previous_versions_.erase(it++);
+  }
+}
+
+void RcuKeyValueCache::EraseNode(const Node& node) {
+  Table* table = table_.load(std::memory_order_relaxed);
+  std::atomic<Node*>* link = &table->buckets[node.hash & table->mask];
+  Node* current = link->load(std::memory_order_relaxed);
+  while (current != nullptr && current != &node) {
+    link = &current->next;
+    current = link->load(std::memory_order_relaxed);
+  }
+  if (current == nullptr) {
+    return;
+  }
+  // Readers that are currently on `node` can still follow its next pointer,
+  // which stays valid until the node is reclaimed.
+  link->store(current->next.load(std::memory_order_relaxed),
+              std::memory_order_release);
+  --size_;
+  memory_counters_.AddKeyBytes(-static_cast<int64_t>(current->key.size()));
+  // Nodes only lose their version when they're erased, so copies of the node
+  // in tables left behind by a resize don't own it.
+  epoch_manager_.Retire(
+      const_cast<Version*>(current->version.load(std::memory_order_relaxed)));
+  epoch_manager_.Retire(current);
+}
+
+void RcuKeyValueCache::Grow() {
+  Table* old_table = table_.load(std::memory_order_relaxed);
+  const size_t num_buckets = (old_table->mask + 1) * 2;
+  auto* new_table = new Table(num_buckets);
+  // Nodes are copied rather than relinked, so readers still walking the old
+  // table see consistent chains. The copies share the published versions;
+  // old nodes are reclaimed with the old table and don't own them.
+  for (size_t i = 0; i <= old_table->mask; ++i) {
+    const Node* node = old_table->buckets[i].load(std::memory_order_relaxed);
+    for (; node != nullptr; node = node->next.load(std::memory_order_relaxed)) {
+      auto* copy = new Node(node->key, node->hash);
+      copy->version.store(node->version.load(std::memory_order_relaxed),
+                          std::memory_order_relaxed);
+      copy->last_logical_commit_time = node->last_logical_commit_time;
+      std::atomic<Node*>& bucket = new_table->buckets[node->hash &
+                                                      new_table->mask];
+      copy->next.store(bucket.load(std::memory_order_relaxed),
+                       std::memory_order_relaxed);
+      bucket.store(copy, std::memory_order_relaxed);
+    }
+  }
+  table_.store(new_table, std::memory_order_release);
+  epoch_manager_.Retire(old_table, [](void* ptr) {
+    auto* table = static_cast<Table*>(ptr);
+    for (size_t i = 0; i <= table->mask; ++i) {
+      Node* node = table->buckets[i].load(std::memory_order_relaxed);
+      while (node != nullptr) {
+        Node* next = node->next.load(std::memory_order_relaxed);
+        delete node;
+        node = next;
+      }
+    }
+    delete table;
+  });
+}
+
+CacheMemoryUsage RcuKeyValueCache::GetMemoryUsage() const {
+  CacheMemoryUsage usage = set_cache_->GetMemoryUsage();
+  usage += memory_counters_.Get();
+  return usage;
+}
+
+void RcuKeyValueCache::ExportMutations(
+    const std::function<void(const Mutation&)>& callback) const {
+  // The keys are collected first, and their nodes then copied a chunk at a
+  // time, so that `callback` runs without holding the writer lock.
+  std::vector<std::string> keys;
+  {
+    absl::MutexLock lock(&mutex_);
+    keys.reserve(size_);
+    const Table* table = table_.load(std::memory_order_relaxed);
+    for (size_t i = 0; i <= table->mask; ++i) {
+      const Node* node = table->buckets[i].load(std::memory_order_relaxed);
+      for (; node != nullptr;
+           node = node->next.load(std::memory_order_relaxed)) {
+        keys.push_back(node->key);
+      }
+    }
+  }
+  struct ExportedPair {
+    std::string_view key;
+    std::optional<absl::Cord> value;
+    int64_t logical_commit_time;
+  };
+  std::vector<ExportedPair> pairs;
+  Mutation mutation;
+  std::string value;
+  for (size_t begin = 0; begin < keys.size(); begin += kNodesPerExportChunk) {
+    const size_t end = std::min(keys.size(), begin + kNodesPerExportChunk);
+    pairs.clear();
+    {
+      absl::MutexLock lock(&mutex_);
+      for (size_t i = begin; i < end; ++i) {
+        // The key may have been removed since.
+        const Node* node =
+            FindNode(keys[i], absl::Hash<std::string_view>{}(keys[i]));
+        if (node == nullptr) {
+          continue;
+        }
+        ExportedPair& pair = pairs.emplace_back();
+        pair.key = keys[i];
+        pair.logical_commit_time = node->last_logical_commit_time;
+        // Versions are only replaced under the writer lock.
+        if (const Version* version =
+                node->version.load(std::memory_order_relaxed);
+            !version->deleted) {
+          pair.value = version->value;
+        }
+      }
+    }
+    for (const ExportedPair& pair : pairs) {
+      mutation.key = pair.key;
+      mutation.logical_commit_time = pair.logical_commit_time;
+      if (pair.value.has_value()) {
+        mutation.type = Mutation::Type::kUpdateKeyValue;
+        absl::CopyCordToString(*pair.value, &value);
+        mutation.value = value;
+      } else {
+        mutation.type = Mutation::Type::kDeleteKey;
+        mutation.value = {};
+      }
+      callback(mutation);
+    }
+  }
+  set_cache_->ExportMutations(callback);
+}
+
+std::unique_ptr<Cache> RcuKeyValueCache::Create(
+    MetricsRecorder& metrics_recorder) {
+  return absl::WrapUnique(new RcuKeyValueCache(metrics_recorder));
+}
+
+}  // namespace kv_server
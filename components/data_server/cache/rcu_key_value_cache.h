@@ -0,0 +1,232 @@
+/*
+ * Copyright 2023 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef COMPONENTS_DATA_SERVER_CACHE_RCU_KEY_VALUE_CACHE_H_
+#define COMPONENTS_DATA_SERVER_CACHE_RCU_KEY_VALUE_CACHE_H_
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
+#include "absl/strings/cord.h"
+#include "absl/synchronization/mutex.h"
+#include "components/data_server/cache/cache.h"
+#include "components/data_server/cache/epoch_manager.h"
+#include "components/data_server/cache/get_key_value_set_result.h"
+#include "components/data_server/cache/memory_counters.h"
+#include "components/data_server/cache/pinned_versions.h"
+#include "components/data_server/cache/tombstone_index.h"
+#include "src/cpp/telemetry/metrics_recorder.h"
+
+namespace kv_server {
+
+// In-memory datastore whose key-value reads never take a lock.
+//
+// Key-value pairs live in a chained hash table whose buckets and links are
+// atomic pointers. Readers pin an epoch and walk the table without locking.
+// Writers are serialized by a mutex and publish a new immutable version of a
+// value by swapping a pointer; replaced versions, unlinked nodes and tables
+// left behind by a resize are reclaimed by an `EpochManager` once no reader
+// can still observe them. Writers only wait for readers after releasing the
+// mutex, so a slow reader doesn't hold back the other writers.
+//
+// While read versions are pinned, a replaced version stays linked behind the
+// one that replaced it, for the pinned lookups to walk back to, until no
+// pinned version can see it.
+//
+// Key-value sets are stored in an embedded `KeyValueCache` and keep its
+// locking behavior.
+// One cache object is only for keys in one namespace.
+class RcuKeyValueCache : public Cache {
+ public:
+  ~RcuKeyValueCache() override;
+
+  // Looks up and returns key-value pairs for the given keys. Lock-free.
+  absl::flat_hash_map<std::string_view, absl::Cord> GetKeyValuePairs(
+      const std::vector<std::string_view>& key_list) const override;
+
+  // Lock-free too, although it's taken again if a writer publishes a version
+  // meanwhile.
+  std::unique_ptr<ReadVersion> PinReadVersion() const override;
+
+  // Lock-free.
+  absl::flat_hash_map<std::string_view, absl::Cord> GetKeyValuePairsAt(
+      const std::vector<std::string_view>& key_list,
+      const ReadVersion* read_version) const override;
+
+  // Looks up and returns key-value set result for the given key set.
+  std::unique_ptr<GetKeyValueSetResult> GetKeyValueSet(
+      const absl::flat_hash_set<std::string_view>& key_set) const override;
+
+  // Inserts or updates the key with the new value.
+  void UpdateKeyValue(std::string_view key, std::string_view value,
+                      int64_t logical_commit_time) override;
+
+  // Inserts or updates values in the set for a given key, if a value exists,
+  // updates its timestamp to the latest logical commit time.
+  void UpdateKeyValueSet(std::string_view key,
+                         absl::Span<std::string_view> value_set,
+                         int64_t logical_commit_time) override;
+
+  // Deletes a particular (key, value) pair.
+  void DeleteKey(std::string_view key, int64_t logical_commit_time) override;
+
+  // Deletes values in the set for a given key. The deletion, this object
+  // still exist and is marked "deleted", in case there are
+  // late-arriving updates to this value.
+  void DeleteValuesInSet(std::string_view key,
+                         absl::Span<std::string_view> value_set,
+                         int64_t logical_commit_time) override;
+
+  // Applies the mutations of key-value pairs under one lock, and forwards
+  // the mutations of key-value sets to the set cache as one batch.
+  void ApplyBatch(absl::Span<Mutation> mutations) override;
+
+  // Removes the values that were deleted before the specified
+  // logical_commit_time, and the replaced values that no pinned read version
+  // can see anymore, and waits for a grace period so that their memory is
+  // released before returning.
+  void RemoveDeletedKeys(int64_t logical_commit_time) override;
+
+  // Values that were replaced or deleted are counted as released once no
+  // pinned read version can see them, although readers may hold them until
+  // the end of a grace period.
+  CacheMemoryUsage GetMemoryUsage() const override;
+
+  void ExportMutations(
+      const std::function<void(const Mutation&)>& callback) const override;
+
+  static std::unique_ptr<Cache> Create(
+      privacy_sandbox::server_common::MetricsRecorder& metrics_recorder);
+
+ private:
+  // Immutable value published to readers. Readers take a reference to the
+  // cord, which keeps the value alive after the version itself is reclaimed.
+  struct Version {
+    absl::Cord value;
+    // Set if the key is deleted as of this version.
+    bool deleted = false;
+    // Version of the cache from which the value is visible, see
+    // `last_version_`.
+    int64_t visible_from = 0;
+    // The version this one replaced, while a pinned read version can see it.
+    // Only changed by writers, to unlink the versions that nobody can see.
+    mutable std::atomic<const Version*> previous{nullptr};
+  };
+
+  struct Node {
+    Node(std::string_view key, size_t hash) : key(key), hash(hash) {}
+
+    const std::string key;
+    const size_t hash;
+    std::atomic<const Version*> version{nullptr};
+    std::atomic<Node*> next{nullptr};
+    // Only accessed by writers.
+    int64_t last_logical_commit_time = 0;
+  };
+
+  struct Table {
+    explicit Table(size_t num_buckets);
+
+    const size_t mask;
+    std::unique_ptr<std::atomic<Node*>[]> buckets;
+  };
+
+  static constexpr size_t kInitialNumBuckets = 1024;
+  // Nodes copied by `ExportMutations` per acquisition of the writer lock.
+  static constexpr size_t kNodesPerExportChunk = 1024;
+
+  explicit RcuKeyValueCache(
+      privacy_sandbox::server_common::MetricsRecorder& metrics_recorder);
+
+  // Returns the node for `key` in the current table, or nullptr.
+  Node* FindNode(std::string_view key, size_t hash) const
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Returns the node for `key`, inserting an empty one if it is missing.
+  Node* FindOrInsertNode(std::string_view key, size_t hash)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Publishes `version` for `node`, and retires the one it replaces unless a
+  // pinned read version can see it.
+  void PublishVersion(Node& node, Version* version,
+                      int64_t logical_commit_time)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Unlinks and retires the versions behind `head` that no pinned read
+  // version can see, and returns whether any are left.
+  bool PrunePreviousVersionsLocked(const Version& head)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Prunes the previous versions of all keys. Deleted keys left without
+  // previous versions are removed if their tombstone was already cleaned up.
+  void RemoveUnpinnedVersionsLocked() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Unlinks and retires `node` from the current table.
+  void EraseNode(const Node& node) ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Rebuilds the table with twice as many buckets and retires the old one.
+  void Grow() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  void UpdateKeyValueLocked(std::string_view key, std::string_view value,
+                            int64_t logical_commit_time)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  void DeleteKeyLocked(std::string_view key, int64_t logical_commit_time)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Looks up `key_list` at `read_version`, or the latest values if it's
+  // null.
+  absl::flat_hash_map<std::string_view, absl::Cord> LookUp(
+      const std::vector<std::string_view>& key_list,
+      const ReadVersion* read_version) const;
+
+  // Releases a pin of `version` taken on `shard` of `pinned_versions_`.
+  void Unpin(int shard, int64_t version) const;
+
+  class PinnedReadVersion;
+
+  // Serializes writers. Readers never take it.
+  mutable absl::Mutex mutex_;
+  std::atomic<Table*> table_;
+  // Number of nodes in the current table.
+  size_t size_ ABSL_GUARDED_BY(mutex_) = 0;
+  mutable EpochManager epoch_manager_;
+
+  // Keys of the nodes that were deleted, by the logical commit time of their
+  // deletion, to clean them up efficiently.
+  TombstoneIndex deleted_nodes_ ABSL_GUARDED_BY(mutex_);
+
+  // The maximum value that was passed to RemoveDeletedKeys.
+  int64_t max_cleanup_logical_commit_time_ ABSL_GUARDED_BY(mutex_) = 0;
+
+  // Version of the last mutation of a key-value pair, see `KeyValueCache`.
+  // Only written under `mutex_`, once the mutation is published.
+  std::atomic<int64_t> last_version_{0};
+  // Keys with previous versions.
+  absl::flat_hash_set<std::string> keys_with_previous_versions_
+      ABSL_GUARDED_BY(mutex_);
+  // Pinned read versions. Unlike in `KeyValueCache`, they're pinned without
+  // a lock, see `PinReadVersion`.
+  mutable PinnedVersions pinned_versions_;
+
+  // Holds key-value sets.
+  std::unique_ptr<Cache> set_cache_;
+
+  privacy_sandbox::server_common::MetricsRecorder& metrics_recorder_;
+  MemoryCounters memory_counters_;
+};
+
+}  // namespace kv_server
+
+#endif  // COMPONENTS_DATA_SERVER_CACHE_RCU_KEY_VALUE_CACHE_H_
@@ -0,0 +1,362 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "components/data_server/cache/rcu_key_value_cache.h"
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "absl/strings/match.h"
+#include "absl/strings/str_cat.h"
+#include "absl/synchronization/notification.h"
+#include "components/data_server/cache/cache.h"
+#include "components/data_server/cache/key_value_cache.h"
+#include "components/data_server/cache/memory_counters.h"
+#include "components/data_server/cache/mocks.h"
+#include "components/data_server/cache/tombstone_index.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "src/cpp/telemetry/metrics_recorder.h"
+#include "src/cpp/telemetry/telemetry_provider.h"
+
+namespace kv_server {
+namespace {
+
+using privacy_sandbox::server_common::TelemetryProvider;
+using testing::IsEmpty;
+using testing::UnorderedElementsAre;
+
+TEST(RcuKeyValueCacheTest, RetrievesMatchingEntry) {
+  auto noop_metrics_recorder =
+      TelemetryProvider::GetInstance().CreateMetricsRecorder();
+  auto cache = RcuKeyValueCache::Create(*noop_metrics_recorder);
+  cache->UpdateKeyValue("my_key", "my_value", 1);
+  std::vector<std::string_view> keys = {"my_key", "wrong_key"};
+  EXPECT_THAT(cache->GetKeyValuePairs(keys),
+              UnorderedElementsAre(KVPairEq("my_key", "my_value")));
+}
+
+TEST(RcuKeyValueCacheTest, GetAfterUpdateReturnsNewValue) {
+  auto noop_metrics_recorder =
+      TelemetryProvider::GetInstance().CreateMetricsRecorder();
+  auto cache = RcuKeyValueCache::Create(*noop_metrics_recorder);
+  std::vector<std::string_view> keys = {"my_key"};
+  cache->UpdateKeyValue("my_key", "my_value", 1);
+  cache->UpdateKeyValue("my_key", "my_new_value", 2);
+  // Out of order updates are ignored.
+  cache->UpdateKeyValue("my_key", "my_old_value", 1);
+  EXPECT_THAT(cache->GetKeyValuePairs(keys),
+              UnorderedElementsAre(KVPairEq("my_key", "my_new_value")));
+}
+
+TEST(RcuKeyValueCacheTest, ManyKeysSurviveTableGrowth) {
+  auto noop_metrics_recorder =
+      TelemetryProvider::GetInstance().CreateMetricsRecorder();
+  auto cache = RcuKeyValueCache::Create(*noop_metrics_recorder);
+  std::vector<std::string> keys;
+  for (int i = 0; i < 10000; ++i) {
+    keys.push_back(absl::StrCat("key", i));
+    cache->UpdateKeyValue(keys.back(), absl::StrCat("value", i), 1);
+  }
+  std::vector<std::string_view> lookup_keys(keys.begin(), keys.end());
+  auto kv_pairs = cache->GetKeyValuePairs(lookup_keys);
+  ASSERT_EQ(kv_pairs.size(), keys.size());
+  EXPECT_EQ(kv_pairs["key1234"], "value1234");
+}
+
+TEST(RcuKeyValueCacheTest, OutOfOrderUpdateAfterDeleteWorks) {
+  auto noop_metrics_recorder =
+      TelemetryProvider::GetInstance().CreateMetricsRecorder();
+  auto cache = RcuKeyValueCache::Create(*noop_metrics_recorder);
+  std::vector<std::string_view> keys = {"my_key"};
+  cache->DeleteKey("my_key", 2);
+  cache->UpdateKeyValue("my_key", "my_value", 1);
+  EXPECT_THAT(cache->GetKeyValuePairs(keys), IsEmpty());
+  cache->UpdateKeyValue("my_key", "my_value", 3);
+  EXPECT_THAT(cache->GetKeyValuePairs(keys),
+              UnorderedElementsAre(KVPairEq("my_key", "my_value")));
+}
+
+TEST(RcuKeyValueCacheTest, CantInsertOldRecordsAfterCleanup) {
+  auto noop_metrics_recorder =
+      TelemetryProvider::GetInstance().CreateMetricsRecorder();
+  auto cache = RcuKeyValueCache::Create(*noop_metrics_recorder);
+  std::vector<std::string_view> keys = {"my_key1", "my_key2"};
+  cache->UpdateKeyValue("my_key1", "my_value", 1);
+  cache->DeleteKey("my_key1", 2);
+  cache->UpdateKeyValue("my_key2", "my_value", 3);
+  cache->DeleteKey("my_key2", 4);
+  cache->RemoveDeletedKeys(2);
+  cache->UpdateKeyValue("my_key1", "my_value", 2);
+  EXPECT_THAT(cache->GetKeyValuePairs(keys), IsEmpty());
+  cache->RemoveDeletedKeys(5);
+  cache->UpdateKeyValue("my_key2", "my_value", 5);
+  EXPECT_THAT(cache->GetKeyValuePairs(keys), IsEmpty());
+  cache->UpdateKeyValue("my_key2", "my_value", 6);
+  EXPECT_THAT(cache->GetKeyValuePairs(keys),
+              UnorderedElementsAre(KVPairEq("my_key2", "my_value")));
+}
+
+TEST(RcuKeyValueCacheTest, RemoveDeletedKeysKeepsKeysUpdatedAgain) {
+  auto noop_metrics_recorder =
+      TelemetryProvider::GetInstance().CreateMetricsRecorder();
+  auto cache = RcuKeyValueCache::Create(*noop_metrics_recorder);
+  std::vector<std::string_view> keys = {"my_key"};
+  cache->DeleteKey("my_key", 1);
+  cache->UpdateKeyValue("my_key", "my_value", 2);
+  cache->DeleteKey("my_key", 3);
+  cache->UpdateKeyValue("my_key", "my_value", 4);
+  cache->RemoveDeletedKeys(4);
+  EXPECT_THAT(cache->GetKeyValuePairs(keys),
+              UnorderedElementsAre(KVPairEq("my_key", "my_value")));
+  EXPECT_EQ(cache->GetMemoryUsage().tombstone_bytes, 0);
+}
+
+TEST(RcuKeyValueCacheTest, GetMemoryUsageTracksKeysAndValues) {
+  auto noop_metrics_recorder =
+      TelemetryProvider::GetInstance().CreateMetricsRecorder();
+  auto cache = RcuKeyValueCache::Create(*noop_metrics_recorder);
+  cache->UpdateKeyValue("my_key", "my_value", 1);
+  cache->UpdateKeyValue("my_key", "v", 2);
+  std::vector<std::string_view> values = {"a"};
+  cache->UpdateKeyValueSet("my_set", absl::Span<std::string_view>(values), 1);
+  CacheMemoryUsage usage = cache->GetMemoryUsage();
+  EXPECT_EQ(usage.key_bytes, 12);
+  EXPECT_EQ(usage.value_bytes, 1);
+  EXPECT_EQ(usage.set_member_bytes, MemoryCounters::kSetMemberBytes);
+  EXPECT_EQ(usage.interned_value_bytes, 1);
+
+  cache->DeleteKey("my_key", 3);
+  usage = cache->GetMemoryUsage();
+  EXPECT_EQ(usage.value_bytes, 0);
+  EXPECT_EQ(usage.tombstone_bytes, TombstoneIndex::KeyBytes("my_key"));
+  cache->RemoveDeletedKeys(3);
+  usage = cache->GetMemoryUsage();
+  EXPECT_EQ(usage.key_bytes, 6);
+  EXPECT_EQ(usage.tombstone_bytes, 0);
+}
+
+TEST(RcuKeyValueCacheTest, GetKeyValueSetReturnsValueSet) {
+  auto noop_metrics_recorder =
+      TelemetryProvider::GetInstance().CreateMetricsRecorder();
+  auto cache = RcuKeyValueCache::Create(*noop_metrics_recorder);
+  std::vector<std::string_view> values = {"v1", "v2"};
+  cache->UpdateKeyValueSet("my_key", absl::Span<std::string_view>(values), 1);
+  auto result = cache->GetKeyValueSet({"my_key"});
+  EXPECT_THAT(result->GetValueSet("my_key"), UnorderedElementsAre("v1", "v2"));
+}
+
+TEST(RcuKeyValueCacheTest, ApplyBatchAppliesPairsAndSets) {
+  auto noop_metrics_recorder =
+      TelemetryProvider::GetInstance().CreateMetricsRecorder();
+  auto cache = RcuKeyValueCache::Create(*noop_metrics_recorder);
+  std::vector<Mutation> mutations = {
+      {.type = Mutation::Type::kUpdateKeyValue,
+       .key = "my_key1",
+       .value = "my_value",
+       .logical_commit_time = 1},
+      {.type = Mutation::Type::kUpdateKeyValue,
+       .key = "my_key2",
+       .value = "my_value",
+       .logical_commit_time = 1},
+      {.type = Mutation::Type::kDeleteKey,
+       .key = "my_key2",
+       .logical_commit_time = 2},
+      {.type = Mutation::Type::kUpdateKeyValueSet,
+       .key = "my_set",
+       .value_set = {"v1", "v2"},
+       .logical_commit_time = 1},
+  };
+  cache->ApplyBatch(absl::MakeSpan(mutations));
+  EXPECT_THAT(cache->GetKeyValuePairs({"my_key1", "my_key2"}),
+              UnorderedElementsAre(KVPairEq("my_key1", "my_value")));
+  EXPECT_THAT(cache->GetKeyValueSet({"my_set"})->GetValueSet("my_set"),
+              UnorderedElementsAre("v1", "v2"));
+}
+
+TEST(RcuKeyValueCacheTest, ExportMutationsIncludesPairsAndSets) {
+  auto noop_metrics_recorder =
+      TelemetryProvider::GetInstance().CreateMetricsRecorder();
+  auto cache = RcuKeyValueCache::Create(*noop_metrics_recorder);
+  cache->UpdateKeyValue("my_key1", "my_value", 1);
+  cache->UpdateKeyValue("my_key2", "my_value", 1);
+  cache->DeleteKey("my_key2", 2);
+  std::vector<std::string_view> values = {"v1", "v2"};
+  cache->UpdateKeyValueSet("my_set", absl::MakeSpan(values), 1);
+
+  auto restored = KeyValueCache::Create(*noop_metrics_recorder);
+  cache->ExportMutations([&restored](const Mutation& mutation) {
+    Mutation copy = mutation;
+    restored->ApplyBatch(absl::MakeSpan(&copy, 1));
+  });
+  EXPECT_THAT(restored->GetKeyValuePairs({"my_key1", "my_key2"}),
+              UnorderedElementsAre(KVPairEq("my_key1", "my_value")));
+  EXPECT_THAT(restored->GetKeyValueSet({"my_set"})->GetValueSet("my_set"),
+              UnorderedElementsAre("v1", "v2"));
+  // The deleted key is exported as a tombstone.
+  restored->UpdateKeyValue("my_key2", "stale", 1);
+  EXPECT_THAT(restored->GetKeyValuePairs({"my_key2"}), IsEmpty());
+}
+
+TEST(RcuKeyValueCacheTest, ConcurrentReadsSeeCompleteValues) {
+  auto noop_metrics_recorder =
+      TelemetryProvider::GetInstance().CreateMetricsRecorder();
+  auto cache = RcuKeyValueCache::Create(*noop_metrics_recorder);
+  // Enough keys to grow the table while readers are walking it.
+  std::vector<std::string> keys;
+  for (int i = 0; i < 3000; ++i) {
+    keys.push_back(absl::StrCat("key", i));
+  }
+  std::vector<std::string_view> lookup_keys(keys.begin(), keys.end());
+  std::atomic<bool> done = false;
+  absl::Notification start;
+  std::vector<std::thread> readers;
+  for (int t = 0; t < 4; ++t) {
+    readers.emplace_back([&]() {
+      start.WaitForNotification();
+      while (!done.load()) {
+        for (const auto& [key, value] : cache->GetKeyValuePairs(lookup_keys)) {
+          // Every value written for a key starts with the key itself.
+          EXPECT_TRUE(absl::StartsWith(std::string(value), key));
+        }
+      }
+    });
+  }
+  start.Notify();
+  int64_t logical_commit_time = 0;
+  for (int round = 0; round < 30; ++round) {
+    for (const auto& key : keys) {
+      ++logical_commit_time;
+      if (round % 3 == 2) {
+        cache->DeleteKey(key, logical_commit_time);
+      } else {
+        cache->UpdateKeyValue(key, absl::StrCat(key, "_", round),
+                              logical_commit_time);
+      }
+    }
+    if (round % 5 == 0) {
+      cache->RemoveDeletedKeys(logical_commit_time);
+    }
+  }
+  done = true;
+  for (auto& reader : readers) {
+    reader.join();
+  }
+}
+
+TEST(RcuKeyValueCacheTest, LookupsAtPinnedVersionIgnoreLaterMutations) {
+  auto noop_metrics_recorder =
+      TelemetryProvider::GetInstance().CreateMetricsRecorder();
+  auto cache = RcuKeyValueCache::Create(*noop_metrics_recorder);
+  cache->UpdateKeyValue("key1", "value1", 1);
+  cache->UpdateKeyValue("key2", "value2", 1);
+  std::unique_ptr<ReadVersion> version = cache->PinReadVersion();
+  ASSERT_NE(version, nullptr);
+  cache->UpdateKeyValue("key1", "newer1", 2);
+  cache->UpdateKeyValue("key1", "newest1", 3);
+  cache->DeleteKey("key2", 2);
+  cache->UpdateKeyValue("key3", "value3", 2);
+  // Tombstone cleanup doesn't change what the pin sees.
+  cache->RemoveDeletedKeys(2);
+
+  EXPECT_THAT(cache->GetKeyValuePairsAt({"key1", "key2", "key3"},
+                                        version.get()),
+              UnorderedElementsAre(KVPairEq("key1", "value1"),
+                                   KVPairEq("key2", "value2")));
+  EXPECT_THAT(cache->GetKeyValuePairs({"key1", "key2", "key3"}),
+              UnorderedElementsAre(KVPairEq("key1", "newest1"),
+                                   KVPairEq("key3", "value3")));
+
+  // The deleted key is removed once the pin is released.
+  version.reset();
+  cache->RemoveDeletedKeys(2);
+  EXPECT_EQ(cache->GetMemoryUsage().tombstone_bytes, 0);
+  EXPECT_THAT(cache->GetKeyValuePairs({"key2"}), IsEmpty());
+}
+
+TEST(RcuKeyValueCacheTest, ReplacedValuesAreOnlyKeptWhilePinned) {
+  auto noop_metrics_recorder =
+      TelemetryProvider::GetInstance().CreateMetricsRecorder();
+  auto cache = RcuKeyValueCache::Create(*noop_metrics_recorder);
+  cache->UpdateKeyValue("key1", "aaa", 1);
+  // Values replaced while nothing is pinned aren't kept.
+  cache->UpdateKeyValue("key1", "bbb", 2);
+  EXPECT_EQ(cache->GetMemoryUsage().value_bytes, 3);
+
+  std::unique_ptr<ReadVersion> version = cache->PinReadVersion();
+  cache->UpdateKeyValue("key1", "ccc", 3);
+  // Only "bbb" is visible to the pin, so "ccc" isn't kept when replaced.
+  cache->UpdateKeyValue("key1", "ddd", 4);
+  EXPECT_EQ(cache->GetMemoryUsage().value_bytes, 6);
+  EXPECT_THAT(cache->GetKeyValuePairsAt({"key1"}, version.get()),
+              UnorderedElementsAre(KVPairEq("key1", "bbb")));
+
+  version.reset();
+  cache->RemoveDeletedKeys(0);
+  EXPECT_EQ(cache->GetMemoryUsage().value_bytes, 3);
+  EXPECT_THAT(cache->GetKeyValuePairs({"key1"}),
+              UnorderedElementsAre(KVPairEq("key1", "ddd")));
+}
+
+TEST(RcuKeyValueCacheTest, ConcurrentPinnedReadsAreRepeatable) {
+  auto noop_metrics_recorder =
+      TelemetryProvider::GetInstance().CreateMetricsRecorder();
+  auto cache = RcuKeyValueCache::Create(*noop_metrics_recorder);
+  std::vector<std::string> keys;
+  for (int i = 0; i < 100; ++i) {
+    keys.push_back(absl::StrCat("key", i));
+  }
+  std::vector<std::string_view> lookup_keys(keys.begin(), keys.end());
+  std::atomic<bool> done = false;
+  absl::Notification start;
+  std::vector<std::thread> readers;
+  for (int t = 0; t < 4; ++t) {
+    readers.emplace_back([&]() {
+      start.WaitForNotification();
+      while (!done.load()) {
+        std::unique_ptr<ReadVersion> version = cache->PinReadVersion();
+        auto first = cache->GetKeyValuePairsAt(lookup_keys, version.get());
+        auto second = cache->GetKeyValuePairsAt(lookup_keys, version.get());
+        EXPECT_EQ(first, second);
+      }
+    });
+  }
+  start.Notify();
+  int64_t logical_commit_time = 0;
+  for (int round = 0; round < 200; ++round) {
+    for (const auto& key : keys) {
+      ++logical_commit_time;
+      if (round % 3 == 2) {
+        cache->DeleteKey(key, logical_commit_time);
+      } else {
+        cache->UpdateKeyValue(key, absl::StrCat(key, "_", round),
+                              logical_commit_time);
+      }
+    }
+    if (round % 5 == 0) {
+      cache->RemoveDeletedKeys(logical_commit_time);
+    }
+  }
+  done = true;
+  for (auto& reader : readers) {
+    reader.join();
+  }
+}
+
+}  // namespace
+}  // namespace kv_server
@@ -0,0 +1,153 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "components/data_server/cache/slab_arena.h"
+
+#include <sys/mman.h>
+
+#include <cstring>
+#include <memory>
+#include <string_view>
+
+#include "absl/container/flat_hash_set.h"
+#include "absl/strings/cord.h"
+#include "glog/logging.h"
+
+namespace kv_server {
+
+SlabArena::SlabArena(uint32_t slab_size) : slab_size_(slab_size) {
+  CHECK_GT(slab_size_, 0) << "Slabs must not be empty.";
+  current_slab_ = NewSlab(slab_size_);
+}
+
+SlabRef SlabArena::Store(std::string_view bytes) {
+  if (bytes.empty()) {
+    return SlabRef{};
+  }
+  const uint32_t size = bytes.size();
+  uint32_t index;
+  if (size > slab_size_ / 4) {
+    index = NewSlab(size);
+  } else {
+    if (slabs_[current_slab_].used + size > slabs_[current_slab_].capacity) {
+      const uint32_t previous_slab = current_slab_;
+      current_slab_ = NewSlab(slab_size_);
+      if (slabs_[previous_slab].live == 0) {
+        ReleaseSlab(previous_slab);
+      }
+    }
+    index = current_slab_;
+  }
+  Slab& slab = slabs_[index];
+  std::memcpy(slab.data.get() + slab.used, bytes.data(), size);
+  const SlabRef ref{.slab = index, .offset = slab.used, .size = size};
+  slab.used += size;
+  slab.live += size;
+  return ref;
+}
+
+std::string_view SlabArena::Get(SlabRef ref) const {
+  if (ref.size == 0) {
+    return {};
+  }
+  return std::string_view(slabs_[ref.slab].data.get() + ref.offset, ref.size);
+}
+
+absl::Cord SlabArena::GetCord(SlabRef ref) const {
+  if (ref.size <= kMaxCopiedCordSize) {
+    return absl::Cord(Get(ref));
+  }
+  // The cord holds a reference to the slab, which keeps the bytes alive after
+  // the arena releases it.
+  return absl::MakeCordFromExternal(Get(ref),
+                                    [data = slabs_[ref.slab].data]() {});
+}
+
+void SlabArena::Free(SlabRef ref) {
+  if (ref.size == 0) {
+    return;
+  }
+  Slab& slab = slabs_[ref.slab];
+  DCHECK_GE(slab.live, ref.size);
+  slab.live -= ref.size;
+  if (slab.live == 0 && ref.slab != current_slab_) {
+    ReleaseSlab(ref.slab);
+  }
+}
+
+SlabRef SlabArena::Relocate(SlabRef ref) {
+  // `Store` may grow `slabs_`, but the slab data itself doesn't move.
+  const SlabRef relocated = Store(Get(ref));
+  Free(ref);
+  return relocated;
+}
+
+absl::flat_hash_set<uint32_t> SlabArena::SparseSlabs(
+    double max_live_fraction) const {
+  absl::flat_hash_set<uint32_t> sparse_slabs;
+  for (uint32_t i = 0; i < slabs_.size(); ++i) {
+    const Slab& slab = slabs_[i];
+    if (slab.data == nullptr || i == current_slab_) {
+      continue;
+    }
+    if (slab.live <= max_live_fraction * slab.capacity) {
+      sparse_slabs.insert(i);
+    }
+  }
+  return sparse_slabs;
+}
+
+SlabArena::Stats SlabArena::GetStats() const {
+  Stats stats;
+  for (const Slab& slab : slabs_) {
+    if (slab.data == nullptr) {
+      continue;
+    }
+    ++stats.num_slabs;
+    stats.allocated_bytes += slab.capacity;
+    stats.live_bytes += slab.live;
+  }
+  return stats;
+}
+
+uint32_t SlabArena::NewSlab(uint32_t capacity) {
+  uint32_t index;
+  if (free_slabs_.empty()) {
+    index = slabs_.size();
+    slabs_.emplace_back();
+  } else {
+    index = free_slabs_.back();
+    free_slabs_.pop_back();
+  }
+  // Slabs are mapped directly so that releasing one returns its memory to
+  // the OS, instead of leaving it to the allocator's free lists.
+  void* data = mmap(nullptr, capacity, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  PCHECK(data != MAP_FAILED) << "Failed to map a slab of " << capacity
+                             << " bytes";
+  slabs_[index] = Slab{
+      .data = std::shared_ptr<char[]>(
+          static_cast<char*>(data),
+          [capacity](char* data) { munmap(data, capacity); }),
+      .capacity = capacity,
+  };
+  return index;
+}
+
+void SlabArena::ReleaseSlab(uint32_t index) {
+  slabs_[index] = Slab{};
+  free_slabs_.push_back(index);
+}
+
+}  // namespace kv_server
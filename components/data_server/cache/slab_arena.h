@@ -0,0 +1,118 @@
+/*
+ * Copyright 2023 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef COMPONENTS_DATA_SERVER_CACHE_SLAB_ARENA_H_
+#define COMPONENTS_DATA_SERVER_CACHE_SLAB_ARENA_H_
+
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+#include "absl/container/flat_hash_set.h"
+#include "absl/strings/cord.h"
+
+namespace kv_server {
+
+// Location of a byte string stored in a `SlabArena`.
+struct SlabRef {
+  uint32_t slab = 0;
+  uint32_t offset = 0;
+  uint32_t size = 0;
+};
+
+// Append-only storage for many small byte strings.
+//
+// Strings are copied back to back into large slabs, so storing one costs no
+// allocation of its own. Freeing a string only marks its bytes as dead; a
+// slab is released once all of its strings are freed. Slabs left mostly dead
+// by overwrites and deletes are reclaimed by relocating their remaining
+// strings, see `SparseSlabs` and `Relocate`.
+//
+// Bytes are never overwritten once stored, and each slab is reference
+// counted, so cords returned by `GetCord` stay valid after the string is
+// freed or relocated.
+//
+// Not thread-safe. Const methods may run concurrently with each other.
+class SlabArena {
+ public:
+  struct Stats {
+    int64_t num_slabs = 0;
+    // Bytes held by slabs that are still in use.
+    int64_t allocated_bytes = 0;
+    // Bytes of strings that haven't been freed.
+    int64_t live_bytes = 0;
+  };
+
+  static constexpr uint32_t kDefaultSlabSize = 1 << 20;
+
+  explicit SlabArena(uint32_t slab_size = kDefaultSlabSize);
+
+  SlabArena(const SlabArena&) = delete;
+  SlabArena& operator=(const SlabArena&) = delete;
+
+  // Copies `bytes` into the arena. Strings larger than a quarter of a slab get
+  // a slab of their own.
+  SlabRef Store(std::string_view bytes);
+
+  // Returns the bytes stored at `ref`. Valid until `ref` is freed.
+  std::string_view Get(SlabRef ref) const;
+
+  // Returns the bytes stored at `ref` as a cord. Large strings share the slab
+  // instead of being copied.
+  absl::Cord GetCord(SlabRef ref) const;
+
+  // Marks the bytes at `ref` as dead.
+  void Free(SlabRef ref);
+
+  // Moves the string at `ref` to the slab currently being filled and returns
+  // its new location.
+  SlabRef Relocate(SlabRef ref);
+
+  // Returns the slabs whose live bytes are at most `max_live_fraction` of
+  // their size. The slab currently being filled is never returned.
+  absl::flat_hash_set<uint32_t> SparseSlabs(double max_live_fraction) const;
+
+  Stats GetStats() const;
+
+ private:
+  // Strings up to this size are copied out by `GetCord`, which is cheaper
+  // than creating an external cord for them.
+  static constexpr uint32_t kMaxCopiedCordSize = 512;
+
+  struct Slab {
+    std::shared_ptr<char[]> data;
+    uint32_t capacity = 0;
+    uint32_t used = 0;
+    uint32_t live = 0;
+  };
+
+  // Returns the index of an empty slab with at least `capacity` bytes.
+  uint32_t NewSlab(uint32_t capacity);
+  // Drops the arena's reference to a slab without live strings.
+  void ReleaseSlab(uint32_t index);
+
+  const uint32_t slab_size_;
+  std::vector<Slab> slabs_;
+  // Indices of released slabs, reused by `NewSlab`.
+  std::vector<uint32_t> free_slabs_;
+  // Slab that small strings are appended to.
+  uint32_t current_slab_;
+};
+
+}  // namespace kv_server
+
+#endif  // COMPONENTS_DATA_SERVER_CACHE_SLAB_ARENA_H_
@@ -0,0 +1,110 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "components/data_server/cache/slab_arena.h"
+
+#include <string>
+#include <vector>
+
+#include "absl/strings/cord.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace kv_server {
+namespace {
+
+using testing::IsEmpty;
+using testing::UnorderedElementsAre;
+
+TEST(SlabArenaTest, StoresStrings) {
+  SlabArena arena(/*slab_size=*/64);
+  const SlabRef hello = arena.Store("hello");
+  const SlabRef world = arena.Store("world");
+  const SlabRef empty = arena.Store("");
+  EXPECT_EQ(arena.Get(hello), "hello");
+  EXPECT_EQ(arena.Get(world), "world");
+  EXPECT_EQ(arena.Get(empty), "");
+  EXPECT_EQ(hello.slab, world.slab);
+  const SlabArena::Stats stats = arena.GetStats();
+  EXPECT_EQ(stats.num_slabs, 1);
+  EXPECT_EQ(stats.allocated_bytes, 64);
+  EXPECT_EQ(stats.live_bytes, 10);
+}
+
+TEST(SlabArenaTest, LargeStringsGetTheirOwnSlab) {
+  SlabArena arena(/*slab_size=*/64);
+  const SlabRef small = arena.Store("small");
+  const std::string large(100, 'x');
+  const SlabRef large_ref = arena.Store(large);
+  EXPECT_NE(small.slab, large_ref.slab);
+  EXPECT_EQ(arena.Get(large_ref), large);
+  EXPECT_EQ(arena.GetStats().allocated_bytes, 164);
+  arena.Free(large_ref);
+  EXPECT_EQ(arena.GetStats().allocated_bytes, 64);
+}
+
+TEST(SlabArenaTest, ReleasesSlabWhenAllStringsAreFreed) {
+  SlabArena arena(/*slab_size=*/16);
+  std::vector<SlabRef> refs;
+  for (int i = 0; i < 8; ++i) {
+    refs.push_back(arena.Store("abcd"));
+  }
+  EXPECT_EQ(arena.GetStats().num_slabs, 2);
+  for (int i = 0; i < 4; ++i) {
+    arena.Free(refs[i]);
+  }
+  const SlabArena::Stats stats = arena.GetStats();
+  EXPECT_EQ(stats.num_slabs, 1);
+  EXPECT_EQ(stats.live_bytes, 16);
+}
+
+TEST(SlabArenaTest, RelocateMovesStringsOutOfSparseSlabs) {
+  SlabArena arena(/*slab_size=*/16);
+  const SlabRef a = arena.Store("aaaa");
+  const SlabRef b = arena.Store("bbbb");
+  arena.Store("cccc");
+  arena.Store("dddd");
+  const SlabRef e = arena.Store("eeee");
+  arena.Free(b);
+  // The current slab is never sparse.
+  EXPECT_THAT(arena.SparseSlabs(0.5), IsEmpty());
+  arena.Free(arena.Store("ffff"));
+  arena.Free(arena.Store("gggg"));
+  arena.Free(arena.Store("hhhh"));
+  arena.Store("iiii");
+  EXPECT_THAT(arena.SparseSlabs(0.5), UnorderedElementsAre(e.slab));
+
+  const SlabRef relocated_e = arena.Relocate(e);
+  EXPECT_EQ(arena.Get(relocated_e), "eeee");
+  EXPECT_NE(relocated_e.slab, e.slab);
+  EXPECT_EQ(arena.Get(a), "aaaa");
+  EXPECT_EQ(arena.GetStats().num_slabs, 2);
+}
+
+TEST(SlabArenaTest, CordsOutliveFreedStrings) {
+  SlabArena arena(/*slab_size=*/4096);
+  const std::string large(1000, 'x');
+  const SlabRef small = arena.Store("small");
+  const SlabRef large_ref = arena.Store(large);
+  const absl::Cord small_cord = arena.GetCord(small);
+  const absl::Cord large_cord = arena.GetCord(large_ref);
+  arena.Free(small);
+  arena.Free(large_ref);
+  EXPECT_EQ(arena.GetStats().live_bytes, 0);
+  EXPECT_EQ(small_cord, "small");
+  EXPECT_EQ(large_cord, large);
+}
+
+}  // namespace
+}  // namespace kv_server
@@ -0,0 +1,494 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "components/data_server/cache/slab_key_value_cache.h"
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "absl/algorithm/container.h"
+#include "absl/memory/memory.h"
+#include "components/data_server/cache/key_value_cache.h"
+#include "glog/logging.h"
+#include "src/cpp/telemetry/metrics_recorder.h"
+
+namespace kv_server {
+
+using privacy_sandbox::server_common::MetricsRecorder;
+using privacy_sandbox::server_common::ScopeLatencyRecorder;
+
+constexpr char kGetKeyValuePairsEvent[] = "GetKeyValuePairs";
+constexpr char kUpdateKeyValueEvent[] = "UpdateKeyValue";
+constexpr char kDeleteKeyEvent[] = "DeleteKey";
+constexpr char kApplyBatchEvent[] = "ApplyBatch";
+constexpr char kRemoveDeletedKeysEvent[] = "RemoveDeletedKeys";
+constexpr char kCompactEvent[] = "SlabCacheCompact";
+constexpr char kAllocatedBytes[] = "SlabCacheAllocatedBytes";
+constexpr char kLiveBytes[] = "SlabCacheLiveBytes";
+
+const std::vector<double> kBytesBucketBoundaries = {
+    1 << 20, 1 << 24, 1 << 28, 1LL << 30, 1LL << 32, 1LL << 34, 1LL << 36,
+};
+
+SlabKeyValueCache::SlabKeyValueCache(MetricsRecorder& metrics_recorder)
+    : map_(0, EntryHash{.arena = &arena_}, EntryEq{.arena = &arena_}),
+      set_cache_(KeyValueCache::Create(metrics_recorder)),
+      metrics_recorder_(metrics_recorder),
+      compactor_(PeriodicClosure::Create()) {
+  metrics_recorder_.RegisterHistogram(kAllocatedBytes,
+                                      "Bytes held by the slab cache arena",
+                                      "byte", kBytesBucketBoundaries);
+  metrics_recorder_.RegisterHistogram(
+      kLiveBytes, "Bytes of keys and values live in the slab cache arena",
+      "byte", kBytesBucketBoundaries);
+}
+
+SlabKeyValueCache::~SlabKeyValueCache() { compactor_->Stop(); }
+
+// Releases its pin when destroyed.
+class SlabKeyValueCache::PinnedReadVersion : public ReadVersion {
+ public:
+  PinnedReadVersion(const SlabKeyValueCache& cache, int shard, int64_t version)
+      : cache_(cache), shard_(shard), version_(version) {}
+  ~PinnedReadVersion() override { cache_.Unpin(shard_, version_); }
+
+  int64_t version() const { return version_; }
+
+ private:
+  const SlabKeyValueCache& cache_;
+  const int shard_;
+  const int64_t version_;
+};
+
+absl::flat_hash_map<std::string_view, absl::Cord> SlabKeyValueCache::LookUp(
+    const std::vector<std::string_view>& key_list,
+    const ReadVersion* read_version) const {
+  ScopeLatencyRecorder latency_recorder(kGetKeyValuePairsEvent,
+                                        metrics_recorder_);
+  // Read versions passed to a cache always come from its own
+  // `PinReadVersion`.
+  const auto* pinned_version =
+      static_cast<const PinnedReadVersion*>(read_version);
+  absl::flat_hash_map<std::string_view, absl::Cord> kv_pairs;
+  absl::ReaderMutexLock lock(&mutex_);
+  for (std::string_view key : key_list) {
+    if (pinned_version != nullptr && !past_values_.empty()) {
+      // The first value replaced after the pinned version is the one it sees.
+      // Past values are few, so a scan beats a binary search.
+      if (const auto past_iter = past_values_.find(key);
+          past_iter != past_values_.end()) {
+        const auto visible = absl::c_find_if(
+            past_iter->second,
+            [pinned_version](const PastValue& past_value) {
+              return past_value.replaced_at > pinned_version->version();
+            });
+        if (visible != past_iter->second.end()) {
+          if (visible->value.has_value()) {
+            kv_pairs.insert_or_assign(key, *visible->value);
+          }
+          continue;
+        }
+      }
+    }
+    const auto key_iter = map_.find(key);
+    if (key_iter == map_.end() || key_iter->is_deleted()) {
+      continue;
+    }
+    absl::Cord value = arena_.GetCord(key_iter->value);
+    VLOG(9) << "Get called for " << key << ". returning value: " << value;
+    kv_pairs.insert_or_assign(key, std::move(value));
+  }
+  return kv_pairs;
+}
+
+absl::flat_hash_map<std::string_view, absl::Cord>
+SlabKeyValueCache::GetKeyValuePairs(
+    const std::vector<std::string_view>& key_list) const {
+  return LookUp(key_list, /*read_version=*/nullptr);
+}
+
+std::unique_ptr<ReadVersion> SlabKeyValueCache::PinReadVersion() const {
+  absl::ReaderMutexLock lock(&mutex_);
+  const int shard = pinned_versions_.Pin(last_version_);
+  return std::make_unique<PinnedReadVersion>(*this, shard, last_version_);
+}
+
+void SlabKeyValueCache::Unpin(int shard, int64_t version) const {
+  pinned_versions_.Unpin(shard, version);
+}
+
+absl::flat_hash_map<std::string_view, absl::Cord>
+SlabKeyValueCache::GetKeyValuePairsAt(
+    const std::vector<std::string_view>& key_list,
+    const ReadVersion* read_version) const {
+  return LookUp(key_list, read_version);
+}
+
+std::unique_ptr<GetKeyValueSetResult> SlabKeyValueCache::GetKeyValueSet(
+    const absl::flat_hash_set<std::string_view>& key_set) const {
+  return set_cache_->GetKeyValueSet(key_set);
+}
+
+void SlabKeyValueCache::UpdateKeyValue(std::string_view key,
+                                       std::string_view value,
+                                       int64_t logical_commit_time) {
+  ScopeLatencyRecorder latency_recorder(kUpdateKeyValueEvent,
+                                        metrics_recorder_);
+  VLOG(9) << "Received update for [" << key << "] at " << logical_commit_time
+          << ". value will be set to: " << value;
+  absl::MutexLock lock(&mutex_);
+  UpdateKeyValueLocked(key, value, logical_commit_time);
+}
+
+void SlabKeyValueCache::UpdateKeyValueLocked(std::string_view key,
+                                             std::string_view value,
+                                             int64_t logical_commit_time) {
+  if (logical_commit_time <= max_cleanup_logical_commit_time_) {
+    VLOG(1) << "Skipping the update as its logical_commit_time: "
+            << logical_commit_time << " is older than the current cutoff time:"
+            << max_cleanup_logical_commit_time_;
+    return;
+  }
+  const auto key_iter = map_.find(key);
+  if (key_iter == map_.end()) {
+    StartVersionLocked(key, nullptr);
+    map_.insert(Entry{.key = arena_.Store(key),
+                      .value = arena_.Store(value),
+                      .last_logical_commit_time = logical_commit_time});
+    memory_counters_.AddKeyBytes(key.size());
+    memory_counters_.AddValueBytes(value.size());
+    return;
+  }
+  if (key_iter->last_logical_commit_time >= logical_commit_time) {
+    VLOG(1) << "Skipping the update as its logical_commit_time: "
+            << logical_commit_time << " is older than the current value's time:"
+            << key_iter->last_logical_commit_time;
+    return;
+  }
+  StartVersionLocked(key, &*key_iter);
+  if (key_iter->is_deleted()) {
+    // should always have this, but checking just in case
+    auto dl_key_iter = deleted_nodes_.find(key_iter->last_logical_commit_time);
+    if (dl_key_iter != deleted_nodes_.end() && dl_key_iter->second == key) {
+      deleted_nodes_.erase(dl_key_iter);
+      memory_counters_.AddTombstoneBytes(
+          -MemoryCounters::KeyTombstoneBytes(key));
+    }
+  } else {
+    memory_counters_.AddValueBytes(-static_cast<int64_t>(key_iter->value.size));
+    arena_.Free(key_iter->value);
+  }
+  memory_counters_.AddValueBytes(value.size());
+  key_iter->value = arena_.Store(value);
+  key_iter->last_logical_commit_time = logical_commit_time;
+}
+
+void SlabKeyValueCache::StartVersionLocked(std::string_view key,
+                                           const Entry* entry) {
+  const int64_t version = ++last_version_;
+  auto past_iter = past_values_.find(key);
+  // Without past values, the current one may have been visible since the
+  // first version.
+  const int64_t visible_from = past_iter == past_values_.end()
+                                   ? 0
+                                   : past_iter->second.back().replaced_at;
+  if (pinned_versions_.IsAnyPinned(visible_from, version)) {
+    PastValue& past_value =
+        past_iter == past_values_.end()
+            ? past_values_.try_emplace(key).first->second.emplace_back()
+            : past_iter->second.emplace_back();
+    past_value.replaced_at = version;
+    if (entry != nullptr && !entry->is_deleted()) {
+      // Shares the slab of large values, which isn't released while the
+      // value is kept. The bytes stay counted meanwhile.
+      past_value.value = arena_.GetCord(entry->value);
+      memory_counters_.AddValueBytes(entry->value.size);
+    }
+    return;
+  }
+  if (past_iter != past_values_.end() &&
+      !PrunePastValuesLocked(past_iter->second)) {
+    past_values_.erase(past_iter);
+  }
+}
+
+bool SlabKeyValueCache::PrunePastValuesLocked(
+    std::vector<PastValue>& past_values) {
+  // A past value is seen by the versions from the mutation before it, up to
+  // its own.
+  int64_t visible_from = 0;
+  auto kept = past_values.begin();
+  for (auto it = past_values.begin(); it != past_values.end(); ++it) {
+    const bool pinned =
+        pinned_versions_.IsAnyPinned(visible_from, it->replaced_at);
+    visible_from = it->replaced_at;
+    if (pinned) {
+      if (kept != it) {
+        *kept = std::move(*it);
+      }
+      ++kept;
+    } else if (it->value.has_value()) {
+      memory_counters_.AddValueBytes(-static_cast<int64_t>(it->value->size()));
+    }
+  }
+  past_values.erase(kept, past_values.end());
+  return !past_values.empty();
+}
+
+void SlabKeyValueCache::UpdateKeyValueSet(
+    std::string_view key, absl::Span<std::string_view> value_set,
+    int64_t logical_commit_time) {
+  set_cache_->UpdateKeyValueSet(key, value_set, logical_commit_time);
+}
+
+void SlabKeyValueCache::DeleteKey(std::string_view key,
+                                  int64_t logical_commit_time) {
+  ScopeLatencyRecorder latency_recorder(kDeleteKeyEvent, metrics_recorder_);
+  absl::MutexLock lock(&mutex_);
+  DeleteKeyLocked(key, logical_commit_time);
+}
+
+void SlabKeyValueCache::DeleteKeyLocked(std::string_view key,
+                                        int64_t logical_commit_time) {
+  if (logical_commit_time <= max_cleanup_logical_commit_time_) {
+    return;
+  }
+  const auto key_iter = map_.find(key);
+  if (key_iter == map_.end()) {
+    StartVersionLocked(key, nullptr);
+    // If key is missing, we still need to add an entry without a value to
+    // avoid the late coming update with smaller logical commit time inserting
+    // value for the given key.
+    map_.insert(Entry{.key = arena_.Store(key),
+                      .value = kDeletedValue,
+                      .last_logical_commit_time = logical_commit_time});
+    memory_counters_.AddKeyBytes(key.size());
+  } else {
+    if (key_iter->last_logical_commit_time >= logical_commit_time) {
+      return;
+    }
+    StartVersionLocked(key, &*key_iter);
+    if (!key_iter->is_deleted()) {
+      memory_counters_.AddValueBytes(
+          -static_cast<int64_t>(key_iter->value.size));
+    }
+    arena_.Free(key_iter->value);
+    key_iter->value = kDeletedValue;
+    key_iter->last_logical_commit_time = logical_commit_time;
+  }
+  deleted_nodes_.emplace(logical_commit_time, key);
+  memory_counters_.AddTombstoneBytes(MemoryCounters::KeyTombstoneBytes(key));
+}
+
+void SlabKeyValueCache::DeleteValuesInSet(
+    std::string_view key, absl::Span<std::string_view> value_set,
+    int64_t logical_commit_time) {
+  set_cache_->DeleteValuesInSet(key, value_set, logical_commit_time);
+}
+
+void SlabKeyValueCache::ApplyBatch(absl::Span<Mutation> mutations) {
+  ScopeLatencyRecorder latency_recorder(kApplyBatchEvent, metrics_recorder_);
+  std::vector<Mutation> set_mutations;
+  {
+    absl::MutexLock lock(&mutex_);
+    for (Mutation& mutation : mutations) {
+      switch (mutation.type) {
+        case Mutation::Type::kUpdateKeyValue:
+          UpdateKeyValueLocked(mutation.key, mutation.value,
+                               mutation.logical_commit_time);
+          break;
+        case Mutation::Type::kDeleteKey:
+          DeleteKeyLocked(mutation.key, mutation.logical_commit_time);
+          break;
+        case Mutation::Type::kUpdateKeyValueSet:
+        case Mutation::Type::kDeleteValuesInSet:
+          set_mutations.push_back(std::move(mutation));
+          break;
+      }
+    }
+  }
+  if (!set_mutations.empty()) {
+    set_cache_->ApplyBatch(absl::MakeSpan(set_mutations));
+  }
+}
+
+void SlabKeyValueCache::RemoveDeletedKeys(int64_t logical_commit_time) {
+  ScopeLatencyRecorder latency_recorder(kRemoveDeletedKeysEvent,
+                                        metrics_recorder_);
+  {
+    absl::MutexLock lock(&mutex_);
+    auto it = deleted_nodes_.begin();
+    while (it != deleted_nodes_.end() && it->first <= logical_commit_time) {
+      // should always have this, but checking just in case
+      const auto key_iter = map_.find(it->second);
+      if (key_iter != map_.end() && key_iter->is_deleted() &&
+          key_iter->last_logical_commit_time <= logical_commit_time) {
+        const SlabRef key = key_iter->key;
+        map_.erase(key_iter);
+        arena_.Free(key);
+        memory_counters_.AddKeyBytes(-static_cast<int64_t>(key.size));
+      }
+      memory_counters_.AddTombstoneBytes(
+          -MemoryCounters::KeyTombstoneBytes(it->second));
+      ++it;
+    }
+    deleted_nodes_.erase(deleted_nodes_.begin(), it);
+    max_cleanup_logical_commit_time_ =
+        std::max(max_cleanup_logical_commit_time_, logical_commit_time);
+    absl::erase_if(past_values_, [this](auto& key_and_past_values) {
+      return !PrunePastValuesLocked(key_and_past_values.second);
+    });
+  }
+  set_cache_->RemoveDeletedKeys(logical_commit_time);
+}
+
+void SlabKeyValueCache::Compact() {
+  ScopeLatencyRecorder latency_recorder(kCompactEvent, metrics_recorder_);
+  absl::flat_hash_set<uint32_t> sparse_slabs;
+  std::vector<std::string> keys;
+  {
+    absl::ReaderMutexLock lock(&mutex_);
+    sparse_slabs = arena_.SparseSlabs(kMaxLiveFractionToCompact);
+    if (!sparse_slabs.empty()) {
+      for (const Entry& entry : map_) {
+        if ((entry.key.size > 0 && sparse_slabs.contains(entry.key.slab)) ||
+            (!entry.is_deleted() && entry.value.size > 0 &&
+             sparse_slabs.contains(entry.value.slab))) {
+          keys.emplace_back(arena_.Get(entry.key));
+        }
+      }
+    }
+  }
+  for (size_t begin = 0; begin < keys.size();
+       begin += kEntriesPerCompactionSlice) {
+    const size_t end =
+        std::min(keys.size(), begin + kEntriesPerCompactionSlice);
+    absl::MutexLock lock(&mutex_);
+    // Writes since the last slice may have emptied a sparse slab, whose index
+    // is then reused by a new slab that mustn't be compacted.
+    const absl::flat_hash_set<uint32_t> still_sparse_slabs =
+        arena_.SparseSlabs(kMaxLiveFractionToCompact);
+    absl::erase_if(sparse_slabs, [&still_sparse_slabs](uint32_t slab) {
+      return !still_sparse_slabs.contains(slab);
+    });
+    for (size_t i = begin; i < end; ++i) {
+      const auto key_iter = map_.find(std::string_view(keys[i]));
+      if (key_iter == map_.end()) {
+        continue;
+      }
+      if (key_iter->key.size > 0 &&
+          sparse_slabs.contains(key_iter->key.slab)) {
+        key_iter->key = arena_.Relocate(key_iter->key);
+      }
+      if (!key_iter->is_deleted() && key_iter->value.size > 0 &&
+          sparse_slabs.contains(key_iter->value.slab)) {
+        key_iter->value = arena_.Relocate(key_iter->value);
+      }
+    }
+  }
+  const SlabArena::Stats stats = GetArenaStats();
+  VLOG(1) << "Compacted " << sparse_slabs.size() << " slabs. "
+          << stats.live_bytes << " of " << stats.allocated_bytes
+          << " bytes in " << stats.num_slabs << " slabs are live.";
+  metrics_recorder_.RecordHistogramEvent(kAllocatedBytes,
+                                         stats.allocated_bytes);
+  metrics_recorder_.RecordHistogramEvent(kLiveBytes, stats.live_bytes);
+}
+
+CacheMemoryUsage SlabKeyValueCache::GetMemoryUsage() const {
+  CacheMemoryUsage usage = set_cache_->GetMemoryUsage();
+  usage += memory_counters_.Get();
+  return usage;
+}
+
+void SlabKeyValueCache::ExportMutations(
+    const std::function<void(const Mutation&)>& callback) const {
+  // Like `Compact`, collects the keys first and then copies their entries a
+  // chunk at a time, so that `callback` runs without holding the lock.
+  std::vector<std::string> keys;
+  {
+    absl::ReaderMutexLock lock(&mutex_);
+    keys.reserve(map_.size());
+    for (const Entry& entry : map_) {
+      keys.emplace_back(arena_.Get(entry.key));
+    }
+  }
+  struct ExportedPair {
+    std::string_view key;
+    bool is_deleted;
+    std::string value;
+    int64_t logical_commit_time;
+  };
+  std::vector<ExportedPair> pairs;
+  Mutation mutation;
+  for (size_t begin = 0; begin < keys.size(); begin += kEntriesPerExportChunk) {
+    const size_t end = std::min(keys.size(), begin + kEntriesPerExportChunk);
+    pairs.clear();
+    {
+      absl::ReaderMutexLock lock(&mutex_);
+      for (size_t i = begin; i < end; ++i) {
+        // The key may have been removed since.
+        const auto key_iter = map_.find(std::string_view(keys[i]));
+        if (key_iter == map_.end()) {
+          continue;
+        }
+        pairs.push_back(
+            {.key = keys[i],
+             .is_deleted = key_iter->is_deleted(),
+             .value = key_iter->is_deleted()
+                          ? std::string()
+                          : std::string(arena_.Get(key_iter->value)),
+             .logical_commit_time = key_iter->last_logical_commit_time});
+      }
+    }
+    for (const ExportedPair& pair : pairs) {
+      mutation.key = pair.key;
+      mutation.logical_commit_time = pair.logical_commit_time;
+      if (pair.is_deleted) {
+        mutation.type = Mutation::Type::kDeleteKey;
+        mutation.value = {};
+      } else {
+        mutation.type = Mutation::Type::kUpdateKeyValue;
+        mutation.value = pair.value;
+      }
+      callback(mutation);
+    }
+  }
+  set_cache_->ExportMutations(callback);
+}
+
+SlabArena::Stats SlabKeyValueCache::GetArenaStats() const {
+  absl::ReaderMutexLock lock(&mutex_);
+  return arena_.GetStats();
+}
+
+std::unique_ptr<Cache> SlabKeyValueCache::Create(
+    MetricsRecorder& metrics_recorder, absl::Duration compaction_interval) {
+  auto cache = absl::WrapUnique(new SlabKeyValueCache(metrics_recorder));
+  if (compaction_interval > absl::ZeroDuration()) {
+    if (const absl::Status status = cache->compactor_->StartDelayed(
+            compaction_interval, [cache = cache.get()] { cache->Compact(); });
+        !status.ok()) {
+      LOG(ERROR) << "Failed to start the slab cache compactor: " << status;
+    }
+  }
+  return cache;
+}
+
+}  // namespace kv_server
@@ -0,0 +1,252 @@
+/*
+ * Copyright 2023 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef COMPONENTS_DATA_SERVER_CACHE_SLAB_KEY_VALUE_CACHE_H_
+#define COMPONENTS_DATA_SERVER_CACHE_SLAB_KEY_VALUE_CACHE_H_
+
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
+#include "absl/hash/hash.h"
+#include "absl/strings/cord.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "components/data_server/cache/cache.h"
+#include "components/data_server/cache/get_key_value_set_result.h"
+#include "components/data_server/cache/memory_counters.h"
+#include "components/data_server/cache/pinned_versions.h"
+#include "components/data_server/cache/slab_arena.h"
+#include "components/util/periodic_closure.h"
+#include "src/cpp/telemetry/metrics_recorder.h"
+
+namespace kv_server {
+
+// In-memory datastore that keeps keys and values in a `SlabArena`.
+//
+// Each entry of the key-value map is a fixed size record of arena offsets and
+// a commit time, instead of a heap allocated key and value. This removes the
+// per-entry allocator overhead, which dominates the footprint of caches with
+// many small entries. Space left behind by overwritten and deleted values is
+// reclaimed by `Compact`, which runs periodically on a background thread.
+//
+// Key-value sets are stored in an embedded `KeyValueCache`.
+// One cache object is only for keys in one namespace.
+class SlabKeyValueCache : public Cache {
+ public:
+  ~SlabKeyValueCache() override;
+
+  // Looks up and returns key-value pairs for the given keys.
+  absl::flat_hash_map<std::string_view, absl::Cord> GetKeyValuePairs(
+      const std::vector<std::string_view>& key_list) const override;
+
+  // Like `KeyValueCache`, only keeps values past their replacement while a
+  // version that can see them is pinned. They're kept out of the arena.
+  std::unique_ptr<ReadVersion> PinReadVersion() const override;
+
+  absl::flat_hash_map<std::string_view, absl::Cord> GetKeyValuePairsAt(
+      const std::vector<std::string_view>& key_list,
+      const ReadVersion* read_version) const override;
+
+  // Looks up and returns key-value set result for the given key set.
+  std::unique_ptr<GetKeyValueSetResult> GetKeyValueSet(
+      const absl::flat_hash_set<std::string_view>& key_set) const override;
+
+  // Inserts or updates the key with the new value.
+  void UpdateKeyValue(std::string_view key, std::string_view value,
+                      int64_t logical_commit_time) override;
+
+  // Inserts or updates values in the set for a given key, if a value exists,
+  // updates its timestamp to the latest logical commit time.
+  void UpdateKeyValueSet(std::string_view key,
+                         absl::Span<std::string_view> value_set,
+                         int64_t logical_commit_time) override;
+
+  // Deletes a particular (key, value) pair.
+  void DeleteKey(std::string_view key, int64_t logical_commit_time) override;
+
+  // Deletes values in the set for a given key. The deletion, this object
+  // still exist and is marked "deleted", in case there are
+  // late-arriving updates to this value.
+  void DeleteValuesInSet(std::string_view key,
+                         absl::Span<std::string_view> value_set,
+                         int64_t logical_commit_time) override;
+
+  // Applies the mutations of key-value pairs under one lock, and forwards
+  // the mutations of key-value sets to the set cache as one batch.
+  void ApplyBatch(absl::Span<Mutation> mutations) override;
+
+  // Removes the values that were deleted before the specified
+  // logical_commit_time. Also drops the replaced values that no pinned read
+  // version can see anymore.
+  void RemoveDeletedKeys(int64_t logical_commit_time) override;
+
+  // Moves the entries out of slabs that are mostly dead and releases those
+  // slabs. Finds the entries to move while only blocking writers, then moves
+  // them in slices of `kEntriesPerCompactionSlice`, releasing the lock
+  // between slices so that readers and writers aren't held up for long.
+  void Compact();
+
+  // Counts the bytes of live keys and values rather than the slabs holding
+  // them. See `GetArenaStats` for the latter.
+  CacheMemoryUsage GetMemoryUsage() const override;
+
+  void ExportMutations(
+      const std::function<void(const Mutation&)>& callback) const override;
+
+  // Returns the memory held by the key-value arena.
+  SlabArena::Stats GetArenaStats() const;
+
+  // Runs `Compact` every `compaction_interval`. A zero interval disables
+  // background compaction.
+  static std::unique_ptr<Cache> Create(
+      privacy_sandbox::server_common::MetricsRecorder& metrics_recorder,
+      absl::Duration compaction_interval = absl::Minutes(1));
+
+ private:
+  // Value of deleted entries.
+  static constexpr SlabRef kDeletedValue{
+      .slab = std::numeric_limits<uint32_t>::max()};
+  // Slabs with at most this fraction of live bytes are compacted.
+  static constexpr double kMaxLiveFractionToCompact = 0.5;
+  // Entries moved by `Compact` per acquisition of the lock.
+  static constexpr int kEntriesPerCompactionSlice = 1024;
+  // Entries copied by `ExportMutations` per acquisition of the lock.
+  static constexpr int kEntriesPerExportChunk = 1024;
+
+  struct Entry {
+    // Relocating an entry doesn't change the key bytes, and so doesn't change
+    // its position in the set.
+    mutable SlabRef key;
+    mutable SlabRef value;
+    mutable int64_t last_logical_commit_time;
+
+    bool is_deleted() const { return value.slab == kDeletedValue.slab; }
+  };
+
+  // Value of a key before a mutation, kept for the pinned read versions that
+  // don't see the mutation.
+  struct PastValue {
+    // Version of the mutation.
+    int64_t replaced_at;
+    // Unset if the key was deleted or missing.
+    std::optional<absl::Cord> value;
+  };
+
+  // Hashes and compares entries by their key bytes, and supports lookups by
+  // `std::string_view`.
+  struct EntryHash {
+    using is_transparent = void;
+
+    size_t operator()(std::string_view key) const {
+      return absl::Hash<std::string_view>{}(key);
+    }
+    size_t operator()(const Entry& entry) const {
+      return (*this)(arena->Get(entry.key));
+    }
+
+    const SlabArena* arena;
+  };
+  struct EntryEq {
+    using is_transparent = void;
+
+    std::string_view Key(std::string_view key) const { return key; }
+    std::string_view Key(const Entry& entry) const {
+      return arena->Get(entry.key);
+    }
+    template <typename A, typename B>
+    bool operator()(const A& a, const B& b) const {
+      return Key(a) == Key(b);
+    }
+
+    const SlabArena* arena;
+  };
+
+  explicit SlabKeyValueCache(
+      privacy_sandbox::server_common::MetricsRecorder& metrics_recorder);
+
+  void UpdateKeyValueLocked(std::string_view key, std::string_view value,
+                            int64_t logical_commit_time)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  void DeleteKeyLocked(std::string_view key, int64_t logical_commit_time)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Starts a new version for a mutation of `key`, whose current entry is
+  // `entry`, or null if it's missing. Keeps the current value if a pinned
+  // read version can see it. Must be called before the entry is changed.
+  void StartVersionLocked(std::string_view key, const Entry* entry)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Drops the values in `past_values` that no pinned read version can see,
+  // and returns whether any are left.
+  bool PrunePastValuesLocked(std::vector<PastValue>& past_values)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Looks up `key_list` at `read_version`, or the latest values if it's
+  // null.
+  absl::flat_hash_map<std::string_view, absl::Cord> LookUp(
+      const std::vector<std::string_view>& key_list,
+      const ReadVersion* read_version) const;
+
+  // Releases a pin of `version` taken on `shard` of `pinned_versions_`.
+  void Unpin(int shard, int64_t version) const;
+
+  class PinnedReadVersion;
+
+  mutable absl::Mutex mutex_;
+  // Declared before `map_`, whose hash and equality functions read from it.
+  SlabArena arena_ ABSL_GUARDED_BY(mutex_);
+  absl::flat_hash_set<Entry, EntryHash, EntryEq> map_ ABSL_GUARDED_BY(mutex_);
+
+  // Sorted mapping from the logical timestamp to a key, for nodes that were
+  // deleted We keep this to do proper and efficient clean up in map_.
+  std::multimap<int64_t, std::string> deleted_nodes_ ABSL_GUARDED_BY(mutex_);
+
+  // The maximum value that was passed to RemoveDeletedKeys.
+  int64_t max_cleanup_logical_commit_time_ ABSL_GUARDED_BY(mutex_) = 0;
+
+  // Version of the last mutation of a key-value pair, see `KeyValueCache`.
+  int64_t last_version_ ABSL_GUARDED_BY(mutex_) = 0;
+  // Values replaced by the mutations that pinned read versions don't see,
+  // oldest first, by key. Kept apart from `map_` so that entries don't grow.
+  absl::flat_hash_map<std::string, std::vector<PastValue>> past_values_
+      ABSL_GUARDED_BY(mutex_);
+  // Pinned read versions. Like in `KeyValueCache`, they're only pinned under
+  // a reader lock of `mutex_`.
+  mutable PinnedVersions pinned_versions_;
+
+  // Holds key-value sets.
+  std::unique_ptr<Cache> set_cache_;
+
+  privacy_sandbox::server_common::MetricsRecorder& metrics_recorder_;
+  MemoryCounters memory_counters_;
+
+  // Runs `Compact` in the background.
+  std::unique_ptr<PeriodicClosure> compactor_;
+};
+
+}  // namespace kv_server
+
+#endif  // COMPONENTS_DATA_SERVER_CACHE_SLAB_KEY_VALUE_CACHE_H_
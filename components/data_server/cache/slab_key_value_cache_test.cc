@@ -0,0 +1,286 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "components/data_server/cache/slab_key_value_cache.h"
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "absl/time/time.h"
+#include "components/data_server/cache/cache.h"
+#include "components/data_server/cache/key_value_cache.h"
+#include "components/data_server/cache/memory_counters.h"
+#include "components/data_server/cache/mocks.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "src/cpp/telemetry/metrics_recorder.h"
+#include "src/cpp/telemetry/telemetry_provider.h"
+
+namespace kv_server {
+namespace {
+
+using privacy_sandbox::server_common::TelemetryProvider;
+using testing::IsEmpty;
+using testing::UnorderedElementsAre;
+
+TEST(SlabKeyValueCacheTest, RetrievesMatchingEntry) {
+  auto noop_metrics_recorder =
+      TelemetryProvider::GetInstance().CreateMetricsRecorder();
+  auto cache = SlabKeyValueCache::Create(*noop_metrics_recorder,
+                                         absl::ZeroDuration());
+  cache->UpdateKeyValue("my_key", "my_value", 1);
+  cache->UpdateKeyValue("empty_key", "", 1);
+  std::vector<std::string_view> keys = {"my_key", "empty_key", "wrong_key"};
+  EXPECT_THAT(cache->GetKeyValuePairs(keys),
+              UnorderedElementsAre(KVPairEq("my_key", "my_value"),
+                                   KVPairEq("empty_key", "")));
+}
+
+TEST(SlabKeyValueCacheTest, GetAfterUpdateReturnsNewValue) {
+  auto noop_metrics_recorder =
+      TelemetryProvider::GetInstance().CreateMetricsRecorder();
+  auto cache = SlabKeyValueCache::Create(*noop_metrics_recorder,
+                                         absl::ZeroDuration());
+  std::vector<std::string_view> keys = {"my_key"};
+  cache->UpdateKeyValue("my_key", "my_value", 1);
+  cache->UpdateKeyValue("my_key", "my_new_value", 2);
+  // Out of order updates are ignored.
+  cache->UpdateKeyValue("my_key", "my_old_value", 1);
+  EXPECT_THAT(cache->GetKeyValuePairs(keys),
+              UnorderedElementsAre(KVPairEq("my_key", "my_new_value")));
+}
+
+TEST(SlabKeyValueCacheTest, OutOfOrderUpdateAfterDeleteWorks) {
+  auto noop_metrics_recorder =
+      TelemetryProvider::GetInstance().CreateMetricsRecorder();
+  auto cache = SlabKeyValueCache::Create(*noop_metrics_recorder,
+                                         absl::ZeroDuration());
+  std::vector<std::string_view> keys = {"my_key"};
+  cache->DeleteKey("my_key", 2);
+  cache->UpdateKeyValue("my_key", "my_value", 1);
+  EXPECT_THAT(cache->GetKeyValuePairs(keys), IsEmpty());
+  cache->UpdateKeyValue("my_key", "my_value", 3);
+  EXPECT_THAT(cache->GetKeyValuePairs(keys),
+              UnorderedElementsAre(KVPairEq("my_key", "my_value")));
+}
+
+TEST(SlabKeyValueCacheTest, CantInsertOldRecordsAfterCleanup) {
+  auto noop_metrics_recorder =
+      TelemetryProvider::GetInstance().CreateMetricsRecorder();
+  auto cache = SlabKeyValueCache::Create(*noop_metrics_recorder,
+                                         absl::ZeroDuration());
+  std::vector<std::string_view> keys = {"my_key1", "my_key2"};
+  cache->UpdateKeyValue("my_key1", "my_value", 1);
+  cache->DeleteKey("my_key1", 2);
+  cache->UpdateKeyValue("my_key2", "my_value", 3);
+  cache->DeleteKey("my_key2", 4);
+  cache->RemoveDeletedKeys(2);
+  cache->UpdateKeyValue("my_key1", "my_value", 2);
+  EXPECT_THAT(cache->GetKeyValuePairs(keys), IsEmpty());
+  cache->RemoveDeletedKeys(5);
+  cache->UpdateKeyValue("my_key2", "my_value", 5);
+  EXPECT_THAT(cache->GetKeyValuePairs(keys), IsEmpty());
+  cache->UpdateKeyValue("my_key2", "my_value", 6);
+  EXPECT_THAT(cache->GetKeyValuePairs(keys),
+              UnorderedElementsAre(KVPairEq("my_key2", "my_value")));
+}
+
+TEST(SlabKeyValueCacheTest, GetKeyValueSetReturnsValueSet) {
+  auto noop_metrics_recorder =
+      TelemetryProvider::GetInstance().CreateMetricsRecorder();
+  auto cache = SlabKeyValueCache::Create(*noop_metrics_recorder,
+                                         absl::ZeroDuration());
+  std::vector<std::string_view> values = {"v1", "v2"};
+  cache->UpdateKeyValueSet("my_key", absl::Span<std::string_view>(values), 1);
+  auto result = cache->GetKeyValueSet({"my_key"});
+  EXPECT_THAT(result->GetValueSet("my_key"), UnorderedElementsAre("v1", "v2"));
+}
+
+TEST(SlabKeyValueCacheTest, CompactReclaimsOverwrittenValues) {
+  auto noop_metrics_recorder =
+      TelemetryProvider::GetInstance().CreateMetricsRecorder();
+  auto cache = SlabKeyValueCache::Create(*noop_metrics_recorder,
+                                         absl::ZeroDuration());
+  auto& slab_cache = static_cast<SlabKeyValueCache&>(*cache);
+  std::vector<std::string> keys;
+  for (int i = 0; i < 20000; ++i) {
+    keys.push_back(absl::StrCat("key", i));
+  }
+  const std::string value(100, 'v');
+  for (int round = 1; round <= 4; ++round) {
+    for (const auto& key : keys) {
+      cache->UpdateKeyValue(key, absl::StrCat(value, round), round);
+    }
+  }
+  const SlabArena::Stats before = slab_cache.GetArenaStats();
+  slab_cache.Compact();
+  const SlabArena::Stats after = slab_cache.GetArenaStats();
+  EXPECT_EQ(after.live_bytes, before.live_bytes);
+  EXPECT_LT(after.allocated_bytes, before.allocated_bytes);
+  EXPECT_LT(after.allocated_bytes, 2 * after.live_bytes);
+
+  std::vector<std::string_view> lookup_keys(keys.begin(), keys.end());
+  auto kv_pairs = cache->GetKeyValuePairs(lookup_keys);
+  ASSERT_EQ(kv_pairs.size(), keys.size());
+  EXPECT_EQ(kv_pairs["key1234"], absl::StrCat(value, 4));
+}
+
+TEST(SlabKeyValueCacheTest, RemoveDeletedKeysReleasesKeys) {
+  auto noop_metrics_recorder =
+      TelemetryProvider::GetInstance().CreateMetricsRecorder();
+  auto cache = SlabKeyValueCache::Create(*noop_metrics_recorder,
+                                         absl::ZeroDuration());
+  auto& slab_cache = static_cast<SlabKeyValueCache&>(*cache);
+  cache->UpdateKeyValue("my_key", "my_value", 1);
+  cache->DeleteKey("my_key", 2);
+  EXPECT_EQ(slab_cache.GetArenaStats().live_bytes, 6);
+  cache->RemoveDeletedKeys(2);
+  EXPECT_EQ(slab_cache.GetArenaStats().live_bytes, 0);
+}
+
+TEST(SlabKeyValueCacheTest, GetMemoryUsageTracksKeysAndValues) {
+  auto noop_metrics_recorder =
+      TelemetryProvider::GetInstance().CreateMetricsRecorder();
+  auto cache = SlabKeyValueCache::Create(*noop_metrics_recorder,
+                                         absl::ZeroDuration());
+  cache->UpdateKeyValue("my_key", "my_value", 1);
+  cache->UpdateKeyValue("my_key", "v", 2);
+  std::vector<std::string_view> values = {"a"};
+  cache->UpdateKeyValueSet("my_set", absl::Span<std::string_view>(values), 1);
+  CacheMemoryUsage usage = cache->GetMemoryUsage();
+  EXPECT_EQ(usage.key_bytes, 12);
+  EXPECT_EQ(usage.value_bytes, 1);
+  EXPECT_EQ(usage.set_member_bytes, MemoryCounters::kSetMemberBytes);
+  EXPECT_EQ(usage.interned_value_bytes, 1);
+
+  cache->DeleteKey("my_key", 3);
+  usage = cache->GetMemoryUsage();
+  EXPECT_EQ(usage.value_bytes, 0);
+  EXPECT_EQ(usage.tombstone_bytes, MemoryCounters::KeyTombstoneBytes("my_key"));
+  cache->RemoveDeletedKeys(3);
+  usage = cache->GetMemoryUsage();
+  EXPECT_EQ(usage.key_bytes, 6);
+  EXPECT_EQ(usage.tombstone_bytes, 0);
+}
+
+TEST(SlabKeyValueCacheTest, ApplyBatchAppliesPairsAndSets) {
+  auto noop_metrics_recorder =
+      TelemetryProvider::GetInstance().CreateMetricsRecorder();
+  auto cache = SlabKeyValueCache::Create(*noop_metrics_recorder,
+                                         absl::ZeroDuration());
+  std::vector<Mutation> mutations = {
+      {.type = Mutation::Type::kUpdateKeyValue,
+       .key = "my_key1",
+       .value = "my_value",
+       .logical_commit_time = 1},
+      {.type = Mutation::Type::kUpdateKeyValue,
+       .key = "my_key2",
+       .value = "my_value",
+       .logical_commit_time = 1},
+      {.type = Mutation::Type::kDeleteKey,
+       .key = "my_key2",
+       .logical_commit_time = 2},
+      {.type = Mutation::Type::kUpdateKeyValueSet,
+       .key = "my_set",
+       .value_set = {"v1", "v2"},
+       .logical_commit_time = 1},
+  };
+  cache->ApplyBatch(absl::MakeSpan(mutations));
+  EXPECT_THAT(cache->GetKeyValuePairs({"my_key1", "my_key2"}),
+              UnorderedElementsAre(KVPairEq("my_key1", "my_value")));
+  EXPECT_THAT(cache->GetKeyValueSet({"my_set"})->GetValueSet("my_set"),
+              UnorderedElementsAre("v1", "v2"));
+}
+
+TEST(SlabKeyValueCacheTest, ExportMutationsIncludesPairsAndSets) {
+  auto noop_metrics_recorder =
+      TelemetryProvider::GetInstance().CreateMetricsRecorder();
+  auto cache = SlabKeyValueCache::Create(*noop_metrics_recorder,
+                                         absl::ZeroDuration());
+  cache->UpdateKeyValue("my_key1", "my_value", 1);
+  cache->UpdateKeyValue("my_key2", "my_value", 1);
+  cache->DeleteKey("my_key2", 2);
+  std::vector<std::string_view> values = {"v1", "v2"};
+  cache->UpdateKeyValueSet("my_set", absl::MakeSpan(values), 1);
+
+  auto restored = KeyValueCache::Create(*noop_metrics_recorder);
+  cache->ExportMutations([&restored](const Mutation& mutation) {
+    Mutation copy = mutation;
+    restored->ApplyBatch(absl::MakeSpan(&copy, 1));
+  });
+  EXPECT_THAT(restored->GetKeyValuePairs({"my_key1", "my_key2"}),
+              UnorderedElementsAre(KVPairEq("my_key1", "my_value")));
+  EXPECT_THAT(restored->GetKeyValueSet({"my_set"})->GetValueSet("my_set"),
+              UnorderedElementsAre("v1", "v2"));
+  // The deleted key is exported as a tombstone.
+  restored->UpdateKeyValue("my_key2", "stale", 1);
+  EXPECT_THAT(restored->GetKeyValuePairs({"my_key2"}), IsEmpty());
+}
+
+TEST(SlabKeyValueCacheTest, LookupsAtPinnedVersionIgnoreLaterMutations) {
+  auto noop_metrics_recorder =
+      TelemetryProvider::GetInstance().CreateMetricsRecorder();
+  auto cache = SlabKeyValueCache::Create(*noop_metrics_recorder,
+                                         absl::ZeroDuration());
+  cache->UpdateKeyValue("key1", "value1", 1);
+  cache->UpdateKeyValue("key2", "value2", 1);
+  std::unique_ptr<ReadVersion> version = cache->PinReadVersion();
+  ASSERT_NE(version, nullptr);
+  cache->UpdateKeyValue("key1", "newer1", 2);
+  cache->UpdateKeyValue("key1", "newest1", 3);
+  cache->DeleteKey("key2", 2);
+  cache->UpdateKeyValue("key3", "value3", 2);
+  // Compaction and tombstone cleanup don't change what the pin sees.
+  static_cast<SlabKeyValueCache&>(*cache).Compact();
+  cache->RemoveDeletedKeys(2);
+
+  EXPECT_THAT(cache->GetKeyValuePairsAt({"key1", "key2", "key3"},
+                                        version.get()),
+              UnorderedElementsAre(KVPairEq("key1", "value1"),
+                                   KVPairEq("key2", "value2")));
+  EXPECT_THAT(cache->GetKeyValuePairs({"key1", "key2", "key3"}),
+              UnorderedElementsAre(KVPairEq("key1", "newest1"),
+                                   KVPairEq("key3", "value3")));
+}
+
+TEST(SlabKeyValueCacheTest, ReplacedValuesAreOnlyKeptWhilePinned) {
+  auto noop_metrics_recorder =
+      TelemetryProvider::GetInstance().CreateMetricsRecorder();
+  auto cache = SlabKeyValueCache::Create(*noop_metrics_recorder,
+                                         absl::ZeroDuration());
+  cache->UpdateKeyValue("key1", "aaa", 1);
+  // Values replaced while nothing is pinned aren't kept.
+  cache->UpdateKeyValue("key1", "bbb", 2);
+  EXPECT_EQ(cache->GetMemoryUsage().value_bytes, 3);
+
+  std::unique_ptr<ReadVersion> version = cache->PinReadVersion();
+  cache->UpdateKeyValue("key1", "ccc", 3);
+  // Only "bbb" is visible to the pin, so "ccc" isn't kept when replaced.
+  cache->UpdateKeyValue("key1", "ddd", 4);
+  EXPECT_EQ(cache->GetMemoryUsage().value_bytes, 6);
+  EXPECT_THAT(cache->GetKeyValuePairsAt({"key1"}, version.get()),
+              UnorderedElementsAre(KVPairEq("key1", "bbb")));
+
+  version.reset();
+  cache->RemoveDeletedKeys(0);
+  EXPECT_EQ(cache->GetMemoryUsage().value_bytes, 3);
+  EXPECT_THAT(cache->GetKeyValuePairs({"key1"}),
+              UnorderedElementsAre(KVPairEq("key1", "ddd")));
+}
+
+}  // namespace
+}  // namespace kv_server
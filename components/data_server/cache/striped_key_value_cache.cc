@@ -0,0 +1,295 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "components/data_server/cache/striped_key_value_cache.h"
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/hash/hash.h"
+#include "absl/memory/memory.h"
+#include "components/data_server/cache/key_value_cache.h"
+#include "components/data_server/cache/value_dictionary.h"
+#include "components/query/roaring_bitmap.h"
+#include "glog/logging.h"
+#include "src/cpp/telemetry/metrics_recorder.h"
+
+namespace kv_server {
+namespace {
+
+using privacy_sandbox::server_common::MetricsRecorder;
+
+// Holds one sub-result per stripe and routes lookups to the stripe that owns
+// the key. The value set snapshots are owned by the sub-results.
+class StripedGetKeyValueSetResult : public GetKeyValueSetResult {
+ public:
+  StripedGetKeyValueSetResult(
+      const StripedKeyValueCache& cache,
+      std::vector<std::unique_ptr<GetKeyValueSetResult>> stripe_results)
+      : cache_(cache), stripe_results_(std::move(stripe_results)) {}
+
+  absl::flat_hash_set<std::string_view> GetValueSet(
+      std::string_view key) const override {
+    const auto& stripe_result = stripe_results_[cache_.StripeForKey(key)];
+    if (stripe_result == nullptr) {
+      return {};
+    }
+    return stripe_result->GetValueSet(key);
+  }
+
+  const RoaringBitmap& GetValueIdSet(std::string_view key) const override {
+    static const RoaringBitmap* kEmptySet = new RoaringBitmap();
+    const auto& stripe_result = stripe_results_[cache_.StripeForKey(key)];
+    if (stripe_result == nullptr) {
+      return *kEmptySet;
+    }
+    return stripe_result->GetValueIdSet(key);
+  }
+
+  // All stripes share one value dictionary, so any sub-result can resolve
+  // the IDs.
+  std::vector<std::string_view> GetValues(
+      const RoaringBitmap& value_ids) const override {
+    for (const auto& stripe_result : stripe_results_) {
+      if (stripe_result != nullptr) {
+        return stripe_result->GetValues(value_ids);
+      }
+    }
+    return {};
+  }
+
+ private:
+  // Key value sets are only ever added to the per-stripe results.
+  void AddKeyValueSet(
+      std::string_view key,
+      std::shared_ptr<const RoaringBitmap> value_ids) override {
+    LOG(FATAL) << "AddKeyValueSet is not supported on striped results.";
+  }
+
+  const StripedKeyValueCache& cache_;
+  std::vector<std::unique_ptr<GetKeyValueSetResult>> stripe_results_;
+};
+
+// Holds a pin of each stripe.
+class StripedReadVersion : public ReadVersion {
+ public:
+  explicit StripedReadVersion(
+      std::vector<std::unique_ptr<ReadVersion>> stripe_versions)
+      : stripe_versions_(std::move(stripe_versions)) {}
+
+  // Returns the pin of `stripe` in `read_version`, which must have been
+  // pinned on the striped cache, or null if `read_version` is null.
+  static const ReadVersion* ForStripe(const ReadVersion* read_version,
+                                      int stripe) {
+    if (read_version == nullptr) {
+      return nullptr;
+    }
+    return static_cast<const StripedReadVersion*>(read_version)
+        ->stripe_versions_[stripe]
+        .get();
+  }
+
+ private:
+  std::vector<std::unique_ptr<ReadVersion>> stripe_versions_;
+};
+
+}  // namespace
+
+StripedKeyValueCache::StripedKeyValueCache(MetricsRecorder& metrics_recorder,
+                                           int num_stripes)
+    // Stripes share one value dictionary, so values repeated across key-value
+    // sets in different stripes are stored once.
+    : dictionary_(std::make_shared<ValueDictionary>()) {
+  stripes_.reserve(num_stripes);
+  for (int i = 0; i < num_stripes; ++i) {
+    stripes_.push_back(KeyValueCache::Create(metrics_recorder, dictionary_));
+  }
+}
+
+int StripedKeyValueCache::StripeForKey(std::string_view key) const {
+  // The stripes' hash tables hash keys with the same function, and use the
+  // low bits of the hash for their control bytes. Selecting the stripe from
+  // the high bits keeps the per-stripe tables evenly spread.
+  const uint64_t hash = absl::Hash<std::string_view>{}(key);
+  return (hash >> 32) % stripes_.size();
+}
+
+template <typename ValueT>
+absl::flat_hash_map<std::string_view, ValueT> StripedKeyValueCache::LookUp(
+    const std::vector<std::string_view>& key_list,
+    absl::FunctionRef<absl::flat_hash_map<std::string_view, ValueT>(
+        int stripe, const std::vector<std::string_view>& keys)>
+        look_up_stripe) const {
+  if (stripes_.size() == 1) {
+    return look_up_stripe(0, key_list);
+  }
+  std::vector<std::vector<std::string_view>> keys_per_stripe(stripes_.size());
+  for (std::string_view key : key_list) {
+    keys_per_stripe[StripeForKey(key)].push_back(key);
+  }
+  absl::flat_hash_map<std::string_view, ValueT> kv_pairs;
+  kv_pairs.reserve(key_list.size());
+  for (size_t i = 0; i < stripes_.size(); ++i) {
+    if (keys_per_stripe[i].empty()) {
+      continue;
+    }
+    auto stripe_kv_pairs = look_up_stripe(i, keys_per_stripe[i]);
+    kv_pairs.insert(std::make_move_iterator(stripe_kv_pairs.begin()),
+                    std::make_move_iterator(stripe_kv_pairs.end()));
+  }
+  return kv_pairs;
+}
+
+absl::flat_hash_map<std::string_view, absl::Cord>
+StripedKeyValueCache::GetKeyValuePairs(
+    const std::vector<std::string_view>& key_list) const {
+  return LookUp<absl::Cord>(
+      key_list, [this](int stripe, const std::vector<std::string_view>& keys) {
+        return stripes_[stripe]->GetKeyValuePairs(keys);
+      });
+}
+
+std::unique_ptr<ReadVersion> StripedKeyValueCache::PinReadVersion() const {
+  std::vector<std::unique_ptr<ReadVersion>> stripe_versions;
+  stripe_versions.reserve(stripes_.size());
+  for (const auto& stripe : stripes_) {
+    stripe_versions.push_back(stripe->PinReadVersion());
+  }
+  return std::make_unique<StripedReadVersion>(std::move(stripe_versions));
+}
+
+absl::flat_hash_map<std::string_view, absl::Cord>
+StripedKeyValueCache::GetKeyValuePairsAt(
+    const std::vector<std::string_view>& key_list,
+    const ReadVersion* read_version) const {
+  return LookUp<absl::Cord>(
+      key_list,
+      [this, read_version](int stripe,
+                           const std::vector<std::string_view>& keys) {
+        return stripes_[stripe]->GetKeyValuePairsAt(
+            keys, StripedReadVersion::ForStripe(read_version, stripe));
+      });
+}
+
+absl::flat_hash_map<std::string_view, google::protobuf::Value>
+StripedKeyValueCache::GetValueProtosAt(
+    const std::vector<std::string_view>& key_list,
+    const ReadVersion* read_version) const {
+  return LookUp<google::protobuf::Value>(
+      key_list,
+      [this, read_version](int stripe,
+                           const std::vector<std::string_view>& keys) {
+        return stripes_[stripe]->GetValueProtosAt(
+            keys, StripedReadVersion::ForStripe(read_version, stripe));
+      });
+}
+
+std::unique_ptr<GetKeyValueSetResult> StripedKeyValueCache::GetKeyValueSet(
+    const absl::flat_hash_set<std::string_view>& key_set) const {
+  std::vector<absl::flat_hash_set<std::string_view>> keys_per_stripe(
+      stripes_.size());
+  for (std::string_view key : key_set) {
+    keys_per_stripe[StripeForKey(key)].insert(key);
+  }
+  std::vector<std::unique_ptr<GetKeyValueSetResult>> stripe_results(
+      stripes_.size());
+  for (size_t i = 0; i < stripes_.size(); ++i) {
+    if (!keys_per_stripe[i].empty()) {
+      stripe_results[i] = stripes_[i]->GetKeyValueSet(keys_per_stripe[i]);
+    }
+  }
+  return std::make_unique<StripedGetKeyValueSetResult>(
+      *this, std::move(stripe_results));
+}
+
+void StripedKeyValueCache::UpdateKeyValue(std::string_view key,
+                                          std::string_view value,
+                                          int64_t logical_commit_time) {
+  stripes_[StripeForKey(key)]->UpdateKeyValue(key, value, logical_commit_time);
+}
+
+void StripedKeyValueCache::UpdateKeyValueSet(
+    std::string_view key, absl::Span<std::string_view> value_set,
+    int64_t logical_commit_time) {
+  stripes_[StripeForKey(key)]->UpdateKeyValueSet(key, value_set,
+                                                 logical_commit_time);
+}
+
+void StripedKeyValueCache::DeleteKey(std::string_view key,
+                                     int64_t logical_commit_time) {
+  stripes_[StripeForKey(key)]->DeleteKey(key, logical_commit_time);
+}
+
+void StripedKeyValueCache::DeleteValuesInSet(
+    std::string_view key, absl::Span<std::string_view> value_set,
+    int64_t logical_commit_time) {
+  stripes_[StripeForKey(key)]->DeleteValuesInSet(key, value_set,
+                                                 logical_commit_time);
+}
+
+void StripedKeyValueCache::ApplyBatch(absl::Span<Mutation> mutations) {
+  if (stripes_.size() == 1) {
+    stripes_[0]->ApplyBatch(mutations);
+    return;
+  }
+  // All mutations of a key go to the same stripe, so grouping them keeps
+  // their relative order.
+  std::vector<std::vector<Mutation>> mutations_per_stripe(stripes_.size());
+  for (Mutation& mutation : mutations) {
+    mutations_per_stripe[StripeForKey(mutation.key)].push_back(
+        std::move(mutation));
+  }
+  for (size_t i = 0; i < stripes_.size(); ++i) {
+    if (!mutations_per_stripe[i].empty()) {
+      stripes_[i]->ApplyBatch(absl::MakeSpan(mutations_per_stripe[i]));
+    }
+  }
+}
+
+void StripedKeyValueCache::RemoveDeletedKeys(int64_t logical_commit_time) {
+  for (auto& stripe : stripes_) {
+    stripe->RemoveDeletedKeys(logical_commit_time);
+  }
+}
+
+CacheMemoryUsage StripedKeyValueCache::GetMemoryUsage() const {
+  CacheMemoryUsage usage;
+  for (const auto& stripe : stripes_) {
+    usage += stripe->GetMemoryUsage();
+  }
+  // Each stripe counts the whole shared dictionary.
+  usage.interned_value_bytes = dictionary_->bytes();
+  return usage;
+}
+
+void StripedKeyValueCache::ExportMutations(
+    const std::function<void(const Mutation&)>& callback) const {
+  for (const auto& stripe : stripes_) {
+    stripe->ExportMutations(callback);
+  }
+}
+
+std::unique_ptr<Cache> StripedKeyValueCache::Create(
+    MetricsRecorder& metrics_recorder, int num_stripes) {
+  CHECK_GT(num_stripes, 0) << "A striped cache needs at least one stripe.";
+  return absl::WrapUnique(
+      new StripedKeyValueCache(metrics_recorder, num_stripes));
+}
+
+}  // namespace kv_server
@@ -0,0 +1,133 @@
+/*
+ * Copyright 2023 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef COMPONENTS_DATA_SERVER_CACHE_STRIPED_KEY_VALUE_CACHE_H_
+#define COMPONENTS_DATA_SERVER_CACHE_STRIPED_KEY_VALUE_CACHE_H_
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
+#include "absl/functional/function_ref.h"
+#include "components/data_server/cache/cache.h"
+#include "components/data_server/cache/get_key_value_set_result.h"
+#include "components/data_server/cache/value_dictionary.h"
+#include "src/cpp/telemetry/metrics_recorder.h"
+
+namespace kv_server {
+
+// In-memory datastore that splits the key space into a fixed number of
+// stripes. Each stripe is an independent `KeyValueCache` with its own locks,
+// tombstone index and cleanup cutoff, so readers and writers working on keys
+// in different stripes never contend on the same mutex. Only the value
+// dictionary of key-value sets is shared between the stripes.
+// One cache object is only for keys in one namespace.
+class StripedKeyValueCache : public Cache {
+ public:
+  // Looks up and returns key-value pairs for the given keys. Keys are grouped
+  // by stripe so that each stripe lock is acquired once per call.
+  absl::flat_hash_map<std::string_view, absl::Cord> GetKeyValuePairs(
+      const std::vector<std::string_view>& key_list) const override;
+
+  // Pins every stripe, one after another. Like a batch, which is applied
+  // stripe by stripe, the pinned version is only consistent within each
+  // stripe.
+  std::unique_ptr<ReadVersion> PinReadVersion() const override;
+
+  absl::flat_hash_map<std::string_view, absl::Cord> GetKeyValuePairsAt(
+      const std::vector<std::string_view>& key_list,
+      const ReadVersion* read_version) const override;
+
+  // Stripes keep the values encoded, see `KeyValueCache`.
+  absl::flat_hash_map<std::string_view, google::protobuf::Value>
+  GetValueProtosAt(const std::vector<std::string_view>& key_list,
+                   const ReadVersion* read_version) const override;
+
+  // Looks up and returns key-value set result for the given key set.
+  std::unique_ptr<GetKeyValueSetResult> GetKeyValueSet(
+      const absl::flat_hash_set<std::string_view>& key_set) const override;
+
+  // Inserts or updates the key with the new value.
+  void UpdateKeyValue(std::string_view key, std::string_view value,
+                      int64_t logical_commit_time) override;
+
+  // Inserts or updates values in the set for a given key, if a value exists,
+  // updates its timestamp to the latest logical commit time.
+  void UpdateKeyValueSet(std::string_view key,
+                         absl::Span<std::string_view> value_set,
+                         int64_t logical_commit_time) override;
+
+  // Deletes a particular (key, value) pair.
+  void DeleteKey(std::string_view key, int64_t logical_commit_time) override;
+
+  // Deletes values in the set for a given key. The deletion, this object
+  // still exist and is marked "deleted", in case there are
+  // late-arriving updates to this value.
+  void DeleteValuesInSet(std::string_view key,
+                         absl::Span<std::string_view> value_set,
+                         int64_t logical_commit_time) override;
+
+  // Groups the mutations by stripe and applies each group as one batch of
+  // its stripe.
+  void ApplyBatch(absl::Span<Mutation> mutations) override;
+
+  // Removes the values that were deleted before the specified
+  // logical_commit_time. Stripes are cleaned up one at a time, so at most one
+  // stripe is write-locked at any point.
+  void RemoveDeletedKeys(int64_t logical_commit_time) override;
+
+  CacheMemoryUsage GetMemoryUsage() const override;
+
+  // Exports the stripes one after another.
+  void ExportMutations(
+      const std::function<void(const Mutation&)>& callback) const override;
+
+  // Returns the stripe that owns `key`.
+  int StripeForKey(std::string_view key) const;
+
+  int num_stripes() const { return stripes_.size(); }
+
+  // `num_stripes` must be positive.
+  static std::unique_ptr<Cache> Create(
+      privacy_sandbox::server_common::MetricsRecorder& metrics_recorder,
+      int num_stripes);
+
+ private:
+  StripedKeyValueCache(
+      privacy_sandbox::server_common::MetricsRecorder& metrics_recorder,
+      int num_stripes);
+
+  // Groups `key_list` by stripe and merges the results of `look_up_stripe`
+  // for each group. `ValueT` is the type of the values it returns.
+  template <typename ValueT>
+  absl::flat_hash_map<std::string_view, ValueT> LookUp(
+      const std::vector<std::string_view>& key_list,
+      absl::FunctionRef<absl::flat_hash_map<std::string_view, ValueT>(
+          int stripe, const std::vector<std::string_view>& keys)>
+          look_up_stripe) const;
+
+  std::vector<std::unique_ptr<Cache>> stripes_;
+  // Shared by all stripes.
+  std::shared_ptr<ValueDictionary> dictionary_;
+};
+
+}  // namespace kv_server
+
+#endif  // COMPONENTS_DATA_SERVER_CACHE_STRIPED_KEY_VALUE_CACHE_H_
@@ -0,0 +1,262 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "components/data_server/cache/striped_key_value_cache.h"
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "absl/synchronization/notification.h"
+#include "components/data_server/cache/cache.h"
+#include "components/data_server/cache/memory_counters.h"
+#include "components/data_server/cache/mocks.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "src/cpp/telemetry/metrics_recorder.h"
+#include "src/cpp/telemetry/telemetry_provider.h"
+
+namespace kv_server {
+namespace {
+
+using privacy_sandbox::server_common::TelemetryProvider;
+using testing::IsEmpty;
+using testing::UnorderedElementsAre;
+
+constexpr int kNumStripes = 8;
+
+// Returns `num_keys` keys that are spread over more than one stripe.
+std::vector<std::string> MakeKeys(int num_keys) {
+  std::vector<std::string> keys;
+  for (int i = 0; i < num_keys; ++i) {
+    keys.push_back(absl::StrCat("key", i));
+  }
+  return keys;
+}
+
+TEST(StripedKeyValueCacheTest, KeysAreSpreadAcrossStripes) {
+  auto noop_metrics_recorder =
+      TelemetryProvider::GetInstance().CreateMetricsRecorder();
+  auto cache =
+      StripedKeyValueCache::Create(*noop_metrics_recorder, kNumStripes);
+  const auto& striped_cache = static_cast<const StripedKeyValueCache&>(*cache);
+  absl::flat_hash_set<int> stripes;
+  for (const auto& key : MakeKeys(100)) {
+    const int stripe = striped_cache.StripeForKey(key);
+    EXPECT_GE(stripe, 0);
+    EXPECT_LT(stripe, kNumStripes);
+    EXPECT_EQ(stripe, striped_cache.StripeForKey(key));
+    stripes.insert(stripe);
+  }
+  EXPECT_GT(stripes.size(), 1);
+}
+
+TEST(StripedKeyValueCacheTest, GetWithMultipleKeysReturnsMatchingValues) {
+  auto noop_metrics_recorder =
+      TelemetryProvider::GetInstance().CreateMetricsRecorder();
+  auto cache =
+      StripedKeyValueCache::Create(*noop_metrics_recorder, kNumStripes);
+  const auto keys = MakeKeys(50);
+  for (const auto& key : keys) {
+    cache->UpdateKeyValue(key, absl::StrCat("value_of_", key), 1);
+  }
+  std::vector<std::string_view> lookup_keys = {keys[0], keys[17], keys[42],
+                                               "missing_key"};
+  EXPECT_THAT(cache->GetKeyValuePairs(lookup_keys),
+              UnorderedElementsAre(KVPairEq(keys[0], "value_of_key0"),
+                                   KVPairEq(keys[17], "value_of_key17"),
+                                   KVPairEq(keys[42], "value_of_key42")));
+}
+
+TEST(StripedKeyValueCacheTest, SingleStripeBehavesLikeKeyValueCache) {
+  auto noop_metrics_recorder =
+      TelemetryProvider::GetInstance().CreateMetricsRecorder();
+  auto cache = StripedKeyValueCache::Create(*noop_metrics_recorder, 1);
+  cache->UpdateKeyValue("key1", "value1", 1);
+  cache->UpdateKeyValue("key2", "value2", 2);
+  std::vector<std::string_view> keys = {"key1", "key2"};
+  EXPECT_THAT(cache->GetKeyValuePairs(keys),
+              UnorderedElementsAre(KVPairEq("key1", "value1"),
+                                   KVPairEq("key2", "value2")));
+}
+
+TEST(StripedKeyValueCacheTest, GetKeyValueSetReturnsSetsFromAllStripes) {
+  auto noop_metrics_recorder =
+      TelemetryProvider::GetInstance().CreateMetricsRecorder();
+  auto cache =
+      StripedKeyValueCache::Create(*noop_metrics_recorder, kNumStripes);
+  const auto keys = MakeKeys(20);
+  absl::flat_hash_set<std::string_view> key_set;
+  for (const auto& key : keys) {
+    std::vector<std::string_view> values = {key, "shared"};
+    cache->UpdateKeyValueSet(key, absl::Span<std::string_view>(values), 1);
+    key_set.insert(key);
+  }
+  key_set.insert("missing_key");
+  auto result = cache->GetKeyValueSet(key_set);
+  for (const auto& key : keys) {
+    EXPECT_THAT(result->GetValueSet(key), UnorderedElementsAre(key, "shared"));
+  }
+  EXPECT_THAT(result->GetValueSet("missing_key"), IsEmpty());
+  EXPECT_THAT(result->GetValueSet("not_requested"), IsEmpty());
+}
+
+TEST(StripedKeyValueCacheTest, GetMemoryUsageCountsSharedValuesOnce) {
+  auto noop_metrics_recorder =
+      TelemetryProvider::GetInstance().CreateMetricsRecorder();
+  auto cache =
+      StripedKeyValueCache::Create(*noop_metrics_recorder, kNumStripes);
+  const auto keys = MakeKeys(20);
+  int64_t key_bytes = 0;
+  for (const auto& key : keys) {
+    std::vector<std::string_view> values = {"shared"};
+    cache->UpdateKeyValueSet(key, absl::Span<std::string_view>(values), 1);
+    key_bytes += key.size();
+  }
+  const CacheMemoryUsage usage = cache->GetMemoryUsage();
+  EXPECT_EQ(usage.key_bytes, key_bytes);
+  EXPECT_EQ(usage.set_member_bytes,
+            keys.size() * MemoryCounters::kSetMemberBytes);
+  EXPECT_EQ(usage.interned_value_bytes, std::string_view("shared").size());
+}
+
+TEST(StripedKeyValueCacheTest, RemoveDeletedKeysAppliesCutoffToAllStripes) {
+  auto noop_metrics_recorder =
+      TelemetryProvider::GetInstance().CreateMetricsRecorder();
+  auto cache =
+      StripedKeyValueCache::Create(*noop_metrics_recorder, kNumStripes);
+  const auto keys = MakeKeys(20);
+  for (const auto& key : keys) {
+    cache->UpdateKeyValue(key, "value", 1);
+    cache->DeleteKey(key, 2);
+  }
+  cache->RemoveDeletedKeys(3);
+  std::vector<std::string_view> lookup_keys(keys.begin(), keys.end());
+  for (const auto& key : keys) {
+    // Updates older than the cleanup cutoff are dropped in every stripe.
+    cache->UpdateKeyValue(key, "stale", 3);
+  }
+  EXPECT_THAT(cache->GetKeyValuePairs(lookup_keys), IsEmpty());
+  for (const auto& key : keys) {
+    cache->UpdateKeyValue(key, "fresh", 4);
+  }
+  EXPECT_EQ(cache->GetKeyValuePairs(lookup_keys).size(), keys.size());
+}
+
+TEST(StripedKeyValueCacheTest, ApplyBatchRoutesMutationsToStripes) {
+  auto noop_metrics_recorder =
+      TelemetryProvider::GetInstance().CreateMetricsRecorder();
+  auto cache =
+      StripedKeyValueCache::Create(*noop_metrics_recorder, kNumStripes);
+  const auto keys = MakeKeys(20);
+  std::vector<Mutation> mutations;
+  for (const auto& key : keys) {
+    mutations.push_back({.type = Mutation::Type::kUpdateKeyValue,
+                         .key = key,
+                         .value = "old",
+                         .logical_commit_time = 1});
+    mutations.push_back({.type = Mutation::Type::kUpdateKeyValueSet,
+                         .key = key,
+                         .value_set = {"v1"},
+                         .logical_commit_time = 1});
+  }
+  // Later mutations of the same keys are applied after the earlier ones.
+  for (const auto& key : keys) {
+    mutations.push_back({.type = Mutation::Type::kUpdateKeyValue,
+                         .key = key,
+                         .value = "new",
+                         .logical_commit_time = 2});
+  }
+  cache->ApplyBatch(absl::MakeSpan(mutations));
+
+  std::vector<std::string_view> key_list(keys.begin(), keys.end());
+  const auto kv_pairs = cache->GetKeyValuePairs(key_list);
+  ASSERT_EQ(kv_pairs.size(), keys.size());
+  for (const auto& [key, value] : kv_pairs) {
+    EXPECT_EQ(value, "new") << key;
+  }
+  absl::flat_hash_set<std::string_view> key_set(keys.begin(), keys.end());
+  const auto result = cache->GetKeyValueSet(key_set);
+  for (const auto& key : keys) {
+    EXPECT_THAT(result->GetValueSet(key), UnorderedElementsAre("v1"));
+  }
+}
+
+TEST(StripedKeyValueCacheTest, LookupsAtPinnedVersionIgnoreLaterMutations) {
+  auto noop_metrics_recorder =
+      TelemetryProvider::GetInstance().CreateMetricsRecorder();
+  auto cache =
+      StripedKeyValueCache::Create(*noop_metrics_recorder, kNumStripes);
+  const auto keys = MakeKeys(50);
+  for (const auto& key : keys) {
+    cache->UpdateKeyValue(key, "old", 1);
+  }
+  std::unique_ptr<ReadVersion> version = cache->PinReadVersion();
+  ASSERT_NE(version, nullptr);
+  for (const auto& key : keys) {
+    cache->UpdateKeyValue(key, "new", 2);
+  }
+  cache->DeleteKey(keys[0], 3);
+  cache->UpdateKeyValue("added", "new", 2);
+
+  std::vector<std::string_view> lookup_keys(keys.begin(), keys.end());
+  lookup_keys.push_back("added");
+  const auto pinned_pairs =
+      cache->GetKeyValuePairsAt(lookup_keys, version.get());
+  EXPECT_EQ(pinned_pairs.size(), keys.size());
+  for (const auto& [key, value] : pinned_pairs) {
+    EXPECT_EQ(value, "old") << key;
+  }
+  const auto pinned_value_protos =
+      cache->GetValueProtosAt({keys[0], keys[1]}, version.get());
+  EXPECT_EQ(pinned_value_protos.size(), 2);
+  for (const auto& [key, value] : pinned_value_protos) {
+    EXPECT_EQ(value.string_value(), "old") << key;
+  }
+  EXPECT_THAT(cache->GetKeyValuePairsAt({keys[0], keys[1]}, nullptr),
+              UnorderedElementsAre(KVPairEq(keys[1], "new")));
+}
+
+TEST(StripedKeyValueCacheTest, ConcurrentUpdatesAndGets) {
+  auto noop_metrics_recorder =
+      TelemetryProvider::GetInstance().CreateMetricsRecorder();
+  auto cache =
+      StripedKeyValueCache::Create(*noop_metrics_recorder, kNumStripes);
+  const auto keys = MakeKeys(64);
+  std::vector<std::string_view> lookup_keys(keys.begin(), keys.end());
+  absl::Notification start;
+  std::vector<std::thread> threads;
+  const int num_threads =
+      std::min(20, static_cast<int>(std::thread::hardware_concurrency()));
+  for (int t = 0; t < num_threads; ++t) {
+    threads.emplace_back([&cache, &keys, &lookup_keys, &start, t]() {
+      start.WaitForNotification();
+      for (size_t i = 0; i < keys.size(); ++i) {
+        cache->UpdateKeyValue(keys[i], "value", t * keys.size() + i + 1);
+        EXPECT_LE(cache->GetKeyValuePairs(lookup_keys).size(), keys.size());
+      }
+    });
+  }
+  start.Notify();
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(cache->GetKeyValuePairs(lookup_keys).size(), keys.size());
+}
+
+}  // namespace
+}  // namespace kv_server
@@ -0,0 +1,199 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "components/data_server/cache/swappable_cache.h"
+
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "glog/logging.h"
+
+namespace kv_server {
+namespace {
+
+// How often `Swap` checks whether the calls on the previous instance are
+// done.
+constexpr absl::Duration kDrainPollInterval = absl::Milliseconds(10);
+
+// Keeps the instance that produced `result` alive, along with the dictionary
+// that resolves the values of `result`.
+class SwappableGetKeyValueSetResult : public GetKeyValueSetResult {
+ public:
+  SwappableGetKeyValueSetResult(std::shared_ptr<Cache> cache,
+                                std::unique_ptr<GetKeyValueSetResult> result)
+      : cache_(std::move(cache)), result_(std::move(result)) {}
+
+  absl::flat_hash_set<std::string_view> GetValueSet(
+      std::string_view key) const override {
+    return result_->GetValueSet(key);
+  }
+
+  const RoaringBitmap& GetValueIdSet(std::string_view key) const override {
+    return result_->GetValueIdSet(key);
+  }
+
+  std::vector<std::string_view> GetValues(
+      const RoaringBitmap& value_ids) const override {
+    return result_->GetValues(value_ids);
+  }
+
+ private:
+  // Key value sets are only ever added to the wrapped result.
+  void AddKeyValueSet(
+      std::string_view key,
+      std::shared_ptr<const RoaringBitmap> value_ids) override {
+    LOG(FATAL) << "AddKeyValueSet is not supported on swappable results.";
+  }
+
+  // Declared before `result_` so that it's destroyed after it.
+  std::shared_ptr<Cache> cache_;
+  std::unique_ptr<GetKeyValueSetResult> result_;
+};
+
+// Keeps the instance that `version` was pinned on alive. Declared before
+// `version` so that the instance outlives the pin.
+struct SwappableReadVersion : public ReadVersion {
+  SwappableReadVersion(std::shared_ptr<Cache> cache,
+                       std::unique_ptr<ReadVersion> version)
+      : cache(std::move(cache)), version(std::move(version)) {}
+
+  const std::shared_ptr<Cache> cache;
+  const std::unique_ptr<ReadVersion> version;
+};
+
+}  // namespace
+
+SwappableCache::SwappableCache(Factory factory)
+    : factory_(std::move(factory)), current_(factory_()) {}
+
+std::shared_ptr<Cache> SwappableCache::Current() const {
+  absl::ReaderMutexLock lock(&mutex_);
+  return current_;
+}
+
+absl::flat_hash_map<std::string_view, absl::Cord>
+SwappableCache::GetKeyValuePairs(
+    const std::vector<std::string_view>& key_list) const {
+  // The values are reference counted, so they outlive the instance.
+  return Current()->GetKeyValuePairs(key_list);
+}
+
+std::unique_ptr<ReadVersion> SwappableCache::PinReadVersion() const {
+  std::shared_ptr<Cache> cache = Current();
+  auto version = cache->PinReadVersion();
+  return std::make_unique<SwappableReadVersion>(std::move(cache),
+                                                std::move(version));
+}
+
+absl::flat_hash_map<std::string_view, absl::Cord>
+SwappableCache::GetKeyValuePairsAt(
+    const std::vector<std::string_view>& key_list,
+    const ReadVersion* read_version) const {
+  if (read_version == nullptr) {
+    return GetKeyValuePairs(key_list);
+  }
+  const auto* swappable_version =
+      static_cast<const SwappableReadVersion*>(read_version);
+  return swappable_version->cache->GetKeyValuePairsAt(
+      key_list, swappable_version->version.get());
+}
+
+absl::flat_hash_map<std::string_view, google::protobuf::Value>
+SwappableCache::GetValueProtosAt(
+    const std::vector<std::string_view>& key_list,
+    const ReadVersion* read_version) const {
+  if (read_version == nullptr) {
+    return Current()->GetValueProtosAt(key_list, nullptr);
+  }
+  const auto* swappable_version =
+      static_cast<const SwappableReadVersion*>(read_version);
+  return swappable_version->cache->GetValueProtosAt(
+      key_list, swappable_version->version.get());
+}
+
+std::unique_ptr<GetKeyValueSetResult> SwappableCache::GetKeyValueSet(
+    const absl::flat_hash_set<std::string_view>& key_set) const {
+  std::shared_ptr<Cache> cache = Current();
+  auto result = cache->GetKeyValueSet(key_set);
+  return std::make_unique<SwappableGetKeyValueSetResult>(std::move(cache),
+                                                         std::move(result));
+}
+
+void SwappableCache::UpdateKeyValue(std::string_view key,
+                                    std::string_view value,
+                                    int64_t logical_commit_time) {
+  Current()->UpdateKeyValue(key, value, logical_commit_time);
+}
+
+void SwappableCache::UpdateKeyValueSet(std::string_view key,
+                                       absl::Span<std::string_view> value_set,
+                                       int64_t logical_commit_time) {
+  Current()->UpdateKeyValueSet(key, value_set, logical_commit_time);
+}
+
+void SwappableCache::DeleteKey(std::string_view key,
+                               int64_t logical_commit_time) {
+  Current()->DeleteKey(key, logical_commit_time);
+}
+
+void SwappableCache::DeleteValuesInSet(std::string_view key,
+                                       absl::Span<std::string_view> value_set,
+                                       int64_t logical_commit_time) {
+  Current()->DeleteValuesInSet(key, value_set, logical_commit_time);
+}
+
+void SwappableCache::ApplyBatch(absl::Span<Mutation> mutations) {
+  Current()->ApplyBatch(mutations);
+}
+
+void SwappableCache::RemoveDeletedKeys(int64_t logical_commit_time) {
+  Current()->RemoveDeletedKeys(logical_commit_time);
+}
+
+CacheMemoryUsage SwappableCache::GetMemoryUsage() const {
+  return Current()->GetMemoryUsage();
+}
+
+void SwappableCache::ExportMutations(
+    const std::function<void(const Mutation&)>& callback) const {
+  Current()->ExportMutations(callback);
+}
+
+std::unique_ptr<Cache> SwappableCache::CreateInstance() const {
+  return factory_();
+}
+
+void SwappableCache::Swap(std::unique_ptr<Cache> cache) {
+  std::shared_ptr<Cache> previous;
+  {
+    absl::MutexLock lock(&mutex_);
+    previous = std::exchange(current_, std::move(cache));
+  }
+  // References to the previous instance are only dropped from here on.
+  while (previous.use_count() > 1) {
+    absl::SleepFor(kDrainPollInterval);
+  }
+  previous.reset();
+}
+
+std::unique_ptr<SwappableCache> SwappableCache::Create(Factory factory) {
+  return absl::WrapUnique(new SwappableCache(std::move(factory)));
+}
+
+}  // namespace kv_server
@@ -0,0 +1,108 @@
+/*
+ * Copyright 2023 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef COMPONENTS_DATA_SERVER_CACHE_SWAPPABLE_CACHE_H_
+#define COMPONENTS_DATA_SERVER_CACHE_SWAPPABLE_CACHE_H_
+
+#include <functional>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
+#include "absl/synchronization/mutex.h"
+#include "components/data_server/cache/cache.h"
+#include "components/data_server/cache/get_key_value_set_result.h"
+
+namespace kv_server {
+
+// Cache that forwards every call to a current instance, which can be
+// replaced at once with `Swap`. A replacement instance can be loaded from
+// scratch while the current one keeps serving lookups, without readers
+// contending with the load.
+// One cache object is only for keys in one namespace.
+class SwappableCache : public Cache {
+ public:
+  using Factory = std::function<std::unique_ptr<Cache>()>;
+
+  absl::flat_hash_map<std::string_view, absl::Cord> GetKeyValuePairs(
+      const std::vector<std::string_view>& key_list) const override;
+
+  // The read version pins the current instance, so that lookups at it read
+  // that instance even after a swap. `Swap` waits for it to be released.
+  std::unique_ptr<ReadVersion> PinReadVersion() const override;
+
+  absl::flat_hash_map<std::string_view, absl::Cord> GetKeyValuePairsAt(
+      const std::vector<std::string_view>& key_list,
+      const ReadVersion* read_version) const override;
+
+  absl::flat_hash_map<std::string_view, google::protobuf::Value>
+  GetValueProtosAt(const std::vector<std::string_view>& key_list,
+                   const ReadVersion* read_version) const override;
+
+  // The result keeps the instance it was looked up in alive.
+  std::unique_ptr<GetKeyValueSetResult> GetKeyValueSet(
+      const absl::flat_hash_set<std::string_view>& key_set) const override;
+
+  void UpdateKeyValue(std::string_view key, std::string_view value,
+                      int64_t logical_commit_time) override;
+
+  void UpdateKeyValueSet(std::string_view key,
+                         absl::Span<std::string_view> value_set,
+                         int64_t logical_commit_time) override;
+
+  void DeleteKey(std::string_view key, int64_t logical_commit_time) override;
+
+  void DeleteValuesInSet(std::string_view key,
+                         absl::Span<std::string_view> value_set,
+                         int64_t logical_commit_time) override;
+
+  void ApplyBatch(absl::Span<Mutation> mutations) override;
+
+  void RemoveDeletedKeys(int64_t logical_commit_time) override;
+
+  CacheMemoryUsage GetMemoryUsage() const override;
+
+  void ExportMutations(
+      const std::function<void(const Mutation&)>& callback) const override;
+
+  // Returns a new, empty instance made by the factory, to be loaded and then
+  // passed to `Swap`.
+  std::unique_ptr<Cache> CreateInstance() const;
+
+  // Makes `cache` the current instance. Calls that already started on the
+  // previous instance complete on it. Blocks until they're done and then
+  // destroys the previous instance, so that it's never destroyed on the
+  // thread of a lookup.
+  void Swap(std::unique_ptr<Cache> cache);
+
+  // The first instance is made by `factory`.
+  static std::unique_ptr<SwappableCache> Create(Factory factory);
+
+ private:
+  explicit SwappableCache(Factory factory);
+
+  std::shared_ptr<Cache> Current() const;
+
+  const Factory factory_;
+  mutable absl::Mutex mutex_;
+  std::shared_ptr<Cache> current_ ABSL_GUARDED_BY(mutex_);
+};
+
+}  // namespace kv_server
+
+#endif  // COMPONENTS_DATA_SERVER_CACHE_SWAPPABLE_CACHE_H_
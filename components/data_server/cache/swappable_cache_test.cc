@@ -0,0 +1,119 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "components/data_server/cache/swappable_cache.h"
+
+#include <memory>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "absl/synchronization/notification.h"
+#include "components/data_server/cache/cache.h"
+#include "components/data_server/cache/key_value_cache.h"
+#include "components/data_server/cache/mocks.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "src/cpp/telemetry/metrics_recorder.h"
+#include "src/cpp/telemetry/telemetry_provider.h"
+
+namespace kv_server {
+namespace {
+
+using privacy_sandbox::server_common::MetricsRecorder;
+using privacy_sandbox::server_common::TelemetryProvider;
+using testing::IsEmpty;
+using testing::UnorderedElementsAre;
+
+std::unique_ptr<SwappableCache> CreateCache(MetricsRecorder& metrics_recorder) {
+  return SwappableCache::Create(
+      [&metrics_recorder] { return KeyValueCache::Create(metrics_recorder); });
+}
+
+TEST(SwappableCacheTest, ForwardsToCurrentInstance) {
+  auto noop_metrics_recorder =
+      TelemetryProvider::GetInstance().CreateMetricsRecorder();
+  auto cache = CreateCache(*noop_metrics_recorder);
+  cache->UpdateKeyValue("my_key", "my_value", 1);
+  std::vector<std::string_view> values = {"v1", "v2"};
+  cache->UpdateKeyValueSet("my_set", absl::Span<std::string_view>(values), 1);
+  EXPECT_THAT(cache->GetKeyValuePairs({"my_key"}),
+              UnorderedElementsAre(KVPairEq("my_key", "my_value")));
+  EXPECT_THAT(cache->GetKeyValueSet({"my_set"})->GetValueSet("my_set"),
+              UnorderedElementsAre("v1", "v2"));
+  EXPECT_EQ(cache->GetMemoryUsage().value_bytes, 8);
+}
+
+TEST(SwappableCacheTest, SwapReplacesContents) {
+  auto noop_metrics_recorder =
+      TelemetryProvider::GetInstance().CreateMetricsRecorder();
+  auto cache = CreateCache(*noop_metrics_recorder);
+  cache->UpdateKeyValue("old_key", "old_value", 1);
+  std::unique_ptr<Cache> instance = cache->CreateInstance();
+  instance->UpdateKeyValue("new_key", "new_value", 1);
+  // The instance isn't visible until it's swapped in.
+  EXPECT_THAT(cache->GetKeyValuePairs({"new_key"}), IsEmpty());
+
+  cache->Swap(std::move(instance));
+  EXPECT_THAT(cache->GetKeyValuePairs({"old_key", "new_key"}),
+              UnorderedElementsAre(KVPairEq("new_key", "new_value")));
+}
+
+TEST(SwappableCacheTest, SwapWaitsForResultsOfPreviousInstance) {
+  auto noop_metrics_recorder =
+      TelemetryProvider::GetInstance().CreateMetricsRecorder();
+  auto cache = CreateCache(*noop_metrics_recorder);
+  std::vector<std::string_view> values = {"v1"};
+  cache->UpdateKeyValueSet("my_set", absl::Span<std::string_view>(values), 1);
+  auto result = cache->GetKeyValueSet({"my_set"});
+
+  absl::Notification swapped;
+  std::thread swapper([&cache, &swapped] {
+    cache->Swap(cache->CreateInstance());
+    swapped.Notify();
+  });
+  EXPECT_FALSE(
+      swapped.WaitForNotificationWithTimeout(absl::Milliseconds(100)));
+  // The result still reads from the previous instance.
+  EXPECT_THAT(result->GetValueSet("my_set"), UnorderedElementsAre("v1"));
+  result.reset();
+  swapper.join();
+  EXPECT_TRUE(swapped.HasBeenNotified());
+  EXPECT_THAT(cache->GetKeyValueSet({"my_set"})->GetValueSet("my_set"),
+              IsEmpty());
+}
+
+TEST(SwappableCacheTest, ReadVersionPinsInstance) {
+  auto noop_metrics_recorder =
+      TelemetryProvider::GetInstance().CreateMetricsRecorder();
+  auto cache = CreateCache(*noop_metrics_recorder);
+  cache->UpdateKeyValue("my_key", "old_value", 1);
+  std::unique_ptr<ReadVersion> version = cache->PinReadVersion();
+  cache->UpdateKeyValue("my_key", "new_value", 2);
+  absl::Notification swapped;
+  std::thread swapper([&cache, &swapped] {
+    cache->Swap(cache->CreateInstance());
+    swapped.Notify();
+  });
+  EXPECT_FALSE(
+      swapped.WaitForNotificationWithTimeout(absl::Milliseconds(100)));
+  EXPECT_THAT(cache->GetKeyValuePairsAt({"my_key"}, version.get()),
+              UnorderedElementsAre(KVPairEq("my_key", "old_value")));
+  version.reset();
+  swapper.join();
+  EXPECT_THAT(cache->GetKeyValuePairs({"my_key"}), IsEmpty());
+}
+
+}  // namespace
+}  // namespace kv_server
@@ -0,0 +1,382 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "components/data_server/cache/tiered_key_value_cache.h"
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/memory/memory.h"
+#include "absl/strings/cord.h"
+#include "absl/strings/str_cat.h"
+#include "components/data_server/cache/key_value_cache.h"
+
+namespace kv_server {
+
+using privacy_sandbox::server_common::MetricsRecorder;
+using privacy_sandbox::server_common::ScopeLatencyRecorder;
+
+constexpr char kFinishBaseBuildEvent[] = "FinishBaseBuild";
+
+TieredKeyValueCache::TieredKeyValueCache(MetricsRecorder& metrics_recorder,
+                                         std::string base_path)
+    : metrics_recorder_(metrics_recorder),
+      base_path_(std::move(base_path)),
+      overlay_(KeyValueCache::Create(metrics_recorder)) {}
+
+std::shared_ptr<const TieredKeyValueCache::Base> TieredKeyValueCache::GetBase()
+    const {
+  absl::ReaderMutexLock lock(&base_mutex_);
+  return base_;
+}
+
+bool TieredKeyValueCache::ApplyToBase(const Base* base, std::string_view key,
+                                      int64_t logical_commit_time,
+                                      bool deletion) {
+  if (base == nullptr) {
+    return true;
+  }
+  const int64_t index = base->store->Find(key);
+  if (index == MappedKeyValueStore::kNotFound) {
+    return true;
+  }
+  if (base->store->logical_commit_time(index) >= logical_commit_time) {
+    return false;
+  }
+  if (deletion) {
+    absl::MutexLock lock(&base->mutex);
+    ++base->num_deletions;
+    if (!base->pinned_versions.empty() && !base->deleted[index].load()) {
+      base->pinned_deletions.emplace(index, base->num_deletions);
+    }
+    base->deleted[index].store(true);
+  }
+  return true;
+}
+
+bool TieredKeyValueCache::Collect(std::string_view key,
+                                  std::optional<std::string_view> value,
+                                  int64_t logical_commit_time) {
+  if (!building_.load()) {
+    return false;
+  }
+  absl::MutexLock lock(&build_mutex_);
+  if (!building_.load()) {
+    return false;
+  }
+  auto [it, inserted] = build_entries_.try_emplace(key);
+  BuildEntry& entry = it->second;
+  if (inserted) {
+    build_usage_.key_bytes += key.size();
+  } else if (entry.logical_commit_time >= logical_commit_time) {
+    return true;
+  }
+  if (entry.value.has_value()) {
+    build_usage_.value_bytes -= entry.value->size();
+  }
+  if (value.has_value()) {
+    entry.value = std::string(*value);
+    build_usage_.value_bytes += value->size();
+  } else {
+    entry.value.reset();
+  }
+  entry.logical_commit_time = logical_commit_time;
+  return true;
+}
+
+// Releases its pins when destroyed.
+class TieredKeyValueCache::PinnedReadVersion : public ReadVersion {
+ public:
+  PinnedReadVersion(std::unique_ptr<ReadVersion> overlay_version,
+                    std::shared_ptr<const Base> base, int shard,
+                    int64_t num_deletions)
+      : overlay_version_(std::move(overlay_version)),
+        base_(std::move(base)),
+        shard_(shard),
+        num_deletions_(num_deletions) {}
+  ~PinnedReadVersion() override {
+    if (base_ != nullptr) {
+      base_->pinned_versions.Unpin(shard_, num_deletions_);
+    }
+  }
+
+  const ReadVersion* overlay_version() const { return overlay_version_.get(); }
+  const std::shared_ptr<const Base>& base() const { return base_; }
+
+  // Whether the deleted entry at `index` was deleted after the pin.
+  bool IsVisible(int64_t index) const {
+    absl::MutexLock lock(&base_->mutex);
+    const auto it = base_->pinned_deletions.find(index);
+    return it != base_->pinned_deletions.end() && it->second > num_deletions_;
+  }
+
+ private:
+  const std::unique_ptr<ReadVersion> overlay_version_;
+  const std::shared_ptr<const Base> base_;
+  const int shard_;
+  const int64_t num_deletions_;
+};
+
+absl::flat_hash_map<std::string_view, absl::Cord>
+TieredKeyValueCache::GetKeyValuePairs(
+    const std::vector<std::string_view>& key_list) const {
+  return GetKeyValuePairsAt(key_list, /*read_version=*/nullptr);
+}
+
+std::unique_ptr<ReadVersion> TieredKeyValueCache::PinReadVersion() const {
+  std::shared_ptr<const Base> base = GetBase();
+  int shard = 0;
+  int64_t num_deletions = 0;
+  if (base != nullptr) {
+    absl::MutexLock lock(&base->mutex);
+    num_deletions = base->num_deletions;
+    shard = base->pinned_versions.Pin(num_deletions);
+  }
+  // Deletions of base entries reach the overlay after the base, so the
+  // overlay may see some that the base pin doesn't. The overlay doesn't
+  // return values for those, and the base entries are still visible.
+  return std::make_unique<PinnedReadVersion>(overlay_->PinReadVersion(),
+                                             std::move(base), shard,
+                                             num_deletions);
+}
+
+absl::flat_hash_map<std::string_view, absl::Cord>
+TieredKeyValueCache::GetKeyValuePairsAt(
+    const std::vector<std::string_view>& key_list,
+    const ReadVersion* read_version) const {
+  // Read versions passed to a cache always come from its own
+  // `PinReadVersion`.
+  const auto* pinned_version =
+      static_cast<const PinnedReadVersion*>(read_version);
+  absl::flat_hash_map<std::string_view, absl::Cord> kv_pairs =
+      overlay_->GetKeyValuePairsAt(
+          key_list,
+          pinned_version == nullptr ? nullptr
+                                    : pinned_version->overlay_version());
+  if (kv_pairs.size() == key_list.size()) {
+    return kv_pairs;
+  }
+  std::shared_ptr<const Base> base =
+      pinned_version == nullptr ? GetBase() : pinned_version->base();
+  if (base == nullptr) {
+    return kv_pairs;
+  }
+  for (std::string_view key : key_list) {
+    if (kv_pairs.contains(key)) {
+      continue;
+    }
+    const int64_t index = base->store->Find(key);
+    if (index == MappedKeyValueStore::kNotFound ||
+        (base->deleted[index].load() &&
+         (pinned_version == nullptr || !pinned_version->IsVisible(index)))) {
+      continue;
+    }
+    // The cord keeps the base mapped for as long as it's referenced. Small
+    // values are copied into the cord instead.
+    kv_pairs.emplace(key, absl::MakeCordFromExternal(
+                              base->store->value(index),
+                              [base](std::string_view) {}));
+  }
+  return kv_pairs;
+}
+
+std::unique_ptr<GetKeyValueSetResult> TieredKeyValueCache::GetKeyValueSet(
+    const absl::flat_hash_set<std::string_view>& key_set) const {
+  return overlay_->GetKeyValueSet(key_set);
+}
+
+void TieredKeyValueCache::UpdateKeyValue(std::string_view key,
+                                         std::string_view value,
+                                         int64_t logical_commit_time) {
+  if (Collect(key, value, logical_commit_time)) {
+    return;
+  }
+  if (ApplyToBase(GetBase().get(), key, logical_commit_time,
+                  /*deletion=*/false)) {
+    overlay_->UpdateKeyValue(key, value, logical_commit_time);
+  }
+}
+
+void TieredKeyValueCache::UpdateKeyValueSet(
+    std::string_view key, absl::Span<std::string_view> value_set,
+    int64_t logical_commit_time) {
+  overlay_->UpdateKeyValueSet(key, value_set, logical_commit_time);
+}
+
+void TieredKeyValueCache::DeleteKey(std::string_view key,
+                                    int64_t logical_commit_time) {
+  if (Collect(key, std::nullopt, logical_commit_time)) {
+    return;
+  }
+  // The overlay keeps its own deletion too, so that it drops late updates
+  // of the key until the deletion is removed.
+  if (ApplyToBase(GetBase().get(), key, logical_commit_time,
+                  /*deletion=*/true)) {
+    overlay_->DeleteKey(key, logical_commit_time);
+  }
+}
+
+void TieredKeyValueCache::DeleteValuesInSet(
+    std::string_view key, absl::Span<std::string_view> value_set,
+    int64_t logical_commit_time) {
+  overlay_->DeleteValuesInSet(key, value_set, logical_commit_time);
+}
+
+void TieredKeyValueCache::ApplyBatch(absl::Span<Mutation> mutations) {
+  std::shared_ptr<const Base> base = GetBase();
+  // Mutations that reach the overlay are moved to the front of the batch.
+  size_t num_forwarded = 0;
+  for (Mutation& mutation : mutations) {
+    const bool deletion = mutation.type == Mutation::Type::kDeleteKey;
+    if (deletion || mutation.type == Mutation::Type::kUpdateKeyValue) {
+      const std::optional<std::string_view> value =
+          deletion ? std::nullopt
+                   : std::optional<std::string_view>(mutation.value);
+      if (Collect(mutation.key, value, mutation.logical_commit_time) ||
+          !ApplyToBase(base.get(), mutation.key, mutation.logical_commit_time,
+                       deletion)) {
+        continue;
+      }
+    }
+    if (&mutations[num_forwarded] != &mutation) {
+      mutations[num_forwarded] = std::move(mutation);
+    }
+    ++num_forwarded;
+  }
+  if (num_forwarded > 0) {
+    overlay_->ApplyBatch(mutations.subspan(0, num_forwarded));
+  }
+}
+
+void TieredKeyValueCache::RemoveDeletedKeys(int64_t logical_commit_time) {
+  overlay_->RemoveDeletedKeys(logical_commit_time);
+  if (std::shared_ptr<const Base> base = GetBase(); base != nullptr) {
+    absl::MutexLock lock(&base->mutex);
+    absl::erase_if(base->pinned_deletions, [&base](const auto& deletion) {
+      return !base->pinned_versions.IsAnyPinned(0, deletion.second);
+    });
+  }
+}
+
+CacheMemoryUsage TieredKeyValueCache::GetMemoryUsage() const {
+  CacheMemoryUsage usage = overlay_->GetMemoryUsage();
+  if (std::shared_ptr<const Base> base = GetBase(); base != nullptr) {
+    usage.key_bytes += base->store->key_bytes();
+    usage.value_bytes += base->store->value_bytes();
+  }
+  absl::MutexLock lock(&build_mutex_);
+  usage += build_usage_;
+  return usage;
+}
+
+void TieredKeyValueCache::ExportMutations(
+    const std::function<void(const Mutation&)>& callback) const {
+  if (std::shared_ptr<const Base> base = GetBase(); base != nullptr) {
+    Mutation mutation{.type = Mutation::Type::kUpdateKeyValue};
+    base->store->ForEach(
+        [&base, &mutation, &callback](int64_t index,
+                                      const MappedKeyValueStore::Entry& entry) {
+          if (base->deleted[index].load()) {
+            return;
+          }
+          mutation.key = entry.key;
+          mutation.value = entry.value;
+          mutation.logical_commit_time = entry.logical_commit_time;
+          callback(mutation);
+        });
+  }
+  overlay_->ExportMutations(callback);
+}
+
+absl::Status TieredKeyValueCache::OpenBase(std::string_view source) {
+  auto store = MappedKeyValueStore::Open(base_path_);
+  if (!store.ok()) {
+    return store.status();
+  }
+  if ((*store)->source() != source) {
+    return absl::FailedPreconditionError(
+        absl::StrCat("Key-value store ", base_path_, " was built from ",
+                     (*store)->source(), ", not ", source));
+  }
+  auto base = std::make_shared<Base>();
+  base->deleted.reset(new std::atomic<bool>[(*store)->size()]());
+  base->store = std::move(*store);
+  absl::MutexLock lock(&base_mutex_);
+  base_ = std::move(base);
+  return absl::OkStatus();
+}
+
+void TieredKeyValueCache::StartBaseBuild() {
+  absl::MutexLock lock(&build_mutex_);
+  building_.store(true);
+}
+
+absl::Status TieredKeyValueCache::FinishBaseBuild(std::string_view source) {
+  ScopeLatencyRecorder latency_recorder(kFinishBaseBuildEvent,
+                                        metrics_recorder_);
+  absl::flat_hash_map<std::string, BuildEntry> build_entries;
+  {
+    absl::MutexLock lock(&build_mutex_);
+    building_.store(false);
+    build_entries.swap(build_entries_);
+  }
+  std::vector<MappedKeyValueStore::Entry> entries;
+  entries.reserve(build_entries.size());
+  for (const auto& [key, build_entry] : build_entries) {
+    if (build_entry.value.has_value()) {
+      entries.push_back({.key = key,
+                         .value = *build_entry.value,
+                         .logical_commit_time =
+                             build_entry.logical_commit_time});
+    }
+  }
+  std::sort(entries.begin(), entries.end(),
+            [](const MappedKeyValueStore::Entry& a,
+               const MappedKeyValueStore::Entry& b) { return a.key < b.key; });
+  absl::Status status =
+      MappedKeyValueStore::Write(base_path_, source, entries);
+  entries.clear();
+  if (status.ok()) {
+    status = OpenBase(source);
+  }
+  for (const auto& [key, build_entry] : build_entries) {
+    if (!build_entry.value.has_value()) {
+      // Keeps dropping late updates of the key until the deletion is
+      // removed.
+      overlay_->DeleteKey(key, build_entry.logical_commit_time);
+    } else if (!status.ok()) {
+      overlay_->UpdateKeyValue(key, *build_entry.value,
+                               build_entry.logical_commit_time);
+    }
+  }
+  {
+    absl::MutexLock lock(&build_mutex_);
+    build_usage_ = CacheMemoryUsage();
+  }
+  return status;
+}
+
+std::unique_ptr<TieredKeyValueCache> TieredKeyValueCache::Create(
+    MetricsRecorder& metrics_recorder, std::string base_path) {
+  return absl::WrapUnique(
+      new TieredKeyValueCache(metrics_recorder, std::move(base_path)));
+}
+
+}  // namespace kv_server
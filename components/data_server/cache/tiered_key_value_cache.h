@@ -0,0 +1,185 @@
+/*
+ * Copyright 2023 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef COMPONENTS_DATA_SERVER_CACHE_TIERED_KEY_VALUE_CACHE_H_
+#define COMPONENTS_DATA_SERVER_CACHE_TIERED_KEY_VALUE_CACHE_H_
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
+#include "absl/status/status.h"
+#include "absl/synchronization/mutex.h"
+#include "components/data_server/cache/cache.h"
+#include "components/data_server/cache/get_key_value_set_result.h"
+#include "components/data_server/cache/mapped_key_value_store.h"
+#include "components/data_server/cache/pinned_versions.h"
+#include "src/cpp/telemetry/metrics_recorder.h"
+
+namespace kv_server {
+
+// Datastore in two tiers, for servers whose data mostly comes from a
+// snapshot.
+//
+// The base tier holds the key-value pairs of the snapshot in a read-only
+// `MappedKeyValueStore` on local disk. Everything else, that is the updates
+// and deletions from delta files and realtime updates and all key-value
+// sets, goes to a small mutable `KeyValueCache` overlay. Lookups check the
+// overlay first and then the base. Updates of a key that are older than its
+// base entry are dropped, and a deletion hides the base entry for good.
+//
+// The base is built once, while the snapshot is loaded: between
+// `StartBaseBuild` and `FinishBaseBuild`, updates and deletions of key-value
+// pairs are collected instead of applied, and then sorted and written to the
+// store. A restarted server whose snapshot hasn't changed maps the existing
+// store with `OpenBase` instead of loading the snapshot.
+// One cache object is only for keys in one namespace.
+class TieredKeyValueCache : public Cache {
+ public:
+  // Key-value pairs in the base share the mapping of the store, so no value
+  // bytes are copied.
+  absl::flat_hash_map<std::string_view, absl::Cord> GetKeyValuePairs(
+      const std::vector<std::string_view>& key_list) const override;
+
+  // Pins the overlay, and the base with the deletions of its entries made
+  // so far. Entries deleted later are tracked while a pin can see them.
+  std::unique_ptr<ReadVersion> PinReadVersion() const override;
+
+  absl::flat_hash_map<std::string_view, absl::Cord> GetKeyValuePairsAt(
+      const std::vector<std::string_view>& key_list,
+      const ReadVersion* read_version) const override;
+
+  std::unique_ptr<GetKeyValueSetResult> GetKeyValueSet(
+      const absl::flat_hash_set<std::string_view>& key_set) const override;
+
+  void UpdateKeyValue(std::string_view key, std::string_view value,
+                      int64_t logical_commit_time) override;
+
+  void UpdateKeyValueSet(std::string_view key,
+                         absl::Span<std::string_view> value_set,
+                         int64_t logical_commit_time) override;
+
+  void DeleteKey(std::string_view key, int64_t logical_commit_time) override;
+
+  void DeleteValuesInSet(std::string_view key,
+                         absl::Span<std::string_view> value_set,
+                         int64_t logical_commit_time) override;
+
+  // Checks the mutations of key-value pairs against the base, and forwards
+  // the rest to the overlay as one batch.
+  void ApplyBatch(absl::Span<Mutation> mutations) override;
+
+  // Only removes deleted keys and set values from the overlay. Base entries
+  // stay hidden once deleted, and are forgotten by the pins that can still
+  // see them once those are released.
+  void RemoveDeletedKeys(int64_t logical_commit_time) override;
+
+  // The keys and values of the base are counted at their size in the store,
+  // although the OS may only keep part of them in memory. Pairs collected
+  // for a base that's being built are counted too.
+  CacheMemoryUsage GetMemoryUsage() const override;
+
+  // Exports the live entries of the base, followed by the overlay.
+  void ExportMutations(
+      const std::function<void(const Mutation&)>& callback) const override;
+
+  // Maps the store at the base path as the base, if it was built from
+  // `source`. Returns NotFound if there's no store, and FailedPrecondition if
+  // it was built from another source.
+  absl::Status OpenBase(std::string_view source);
+
+  // Starts collecting updates and deletions of key-value pairs for a new
+  // base. Lookups don't see them until `FinishBaseBuild`.
+  void StartBaseBuild();
+
+  // Writes the pairs collected since `StartBaseBuild` to the store at the
+  // base path, tagged with `source`, and maps it as the base. If the store
+  // can't be written, the pairs are applied to the overlay instead so that
+  // none are lost, and the error is returned.
+  absl::Status FinishBaseBuild(std::string_view source);
+
+  // The base is stored at `base_path`.
+  static std::unique_ptr<TieredKeyValueCache> Create(
+      privacy_sandbox::server_common::MetricsRecorder& metrics_recorder,
+      std::string base_path);
+
+ private:
+  struct Base {
+    std::unique_ptr<MappedKeyValueStore> store;
+    // Whether each entry of the store has been deleted.
+    std::unique_ptr<std::atomic<bool>[]> deleted;
+
+    // Deletions are numbered, and read versions pin the number of deletions
+    // they see.
+    mutable absl::Mutex mutex;
+    mutable int64_t num_deletions ABSL_GUARDED_BY(mutex) = 0;
+    mutable PinnedVersions pinned_versions;
+    // Number of each entry deleted while a pin could see it, until no pin
+    // can anymore.
+    mutable absl::flat_hash_map<int64_t, int64_t> pinned_deletions
+        ABSL_GUARDED_BY(mutex);
+  };
+
+  class PinnedReadVersion;
+
+  // A pair collected for the base. Deleted pairs have no value.
+  struct BuildEntry {
+    std::optional<std::string> value;
+    int64_t logical_commit_time = 0;
+  };
+
+  TieredKeyValueCache(
+      privacy_sandbox::server_common::MetricsRecorder& metrics_recorder,
+      std::string base_path);
+
+  std::shared_ptr<const Base> GetBase() const;
+
+  // Returns whether an update or deletion of `key` is newer than its entry in
+  // `base`, if any, and so should be applied to the overlay. Marks the entry
+  // as deleted for newer deletions, and keeps its number while it's pinned.
+  static bool ApplyToBase(const Base* base, std::string_view key,
+                          int64_t logical_commit_time, bool deletion);
+
+  // Collects an update, or a deletion if `value` is empty, for the base.
+  // Returns false if no base is being built.
+  bool Collect(std::string_view key, std::optional<std::string_view> value,
+               int64_t logical_commit_time);
+
+  privacy_sandbox::server_common::MetricsRecorder& metrics_recorder_;
+  const std::string base_path_;
+  const std::unique_ptr<Cache> overlay_;
+
+  mutable absl::Mutex base_mutex_;
+  std::shared_ptr<const Base> base_ ABSL_GUARDED_BY(base_mutex_);
+
+  // Checked without the lock so that updates don't contend on it once the
+  // base is built.
+  std::atomic<bool> building_{false};
+  mutable absl::Mutex build_mutex_;
+  absl::flat_hash_map<std::string, BuildEntry> build_entries_
+      ABSL_GUARDED_BY(build_mutex_);
+  CacheMemoryUsage build_usage_ ABSL_GUARDED_BY(build_mutex_);
+};
+
+}  // namespace kv_server
+
+#endif  // COMPONENTS_DATA_SERVER_CACHE_TIERED_KEY_VALUE_CACHE_H_
@@ -0,0 +1,246 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "components/data_server/cache/tiered_key_value_cache.h"
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "components/data_server/cache/key_value_cache.h"
+#include "components/data_server/cache/mocks.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "src/cpp/telemetry/metrics_recorder.h"
+#include "src/cpp/telemetry/telemetry_provider.h"
+
+namespace kv_server {
+namespace {
+
+using privacy_sandbox::server_common::MetricsRecorder;
+using privacy_sandbox::server_common::TelemetryProvider;
+using testing::IsEmpty;
+using testing::UnorderedElementsAre;
+
+std::string BasePath(std::string_view name) {
+  return absl::StrCat(::testing::TempDir(), "/", name);
+}
+
+// Builds the base of `cache` from "key1" = "value1" and "key2" = "value2"
+// at commit time 5.
+void BuildBase(TieredKeyValueCache& cache) {
+  cache.StartBaseBuild();
+  cache.UpdateKeyValue("key1", "value1", 5);
+  cache.UpdateKeyValue("key2", "value2", 5);
+  ASSERT_TRUE(cache.FinishBaseBuild("snapshot").ok());
+}
+
+TEST(TieredKeyValueCacheTest, ReadsBaseAfterBuild) {
+  auto noop_metrics_recorder =
+      TelemetryProvider::GetInstance().CreateMetricsRecorder();
+  auto cache =
+      TieredKeyValueCache::Create(*noop_metrics_recorder, BasePath("build"));
+  cache->StartBaseBuild();
+  cache->UpdateKeyValue("key1", "stale", 1);
+  cache->UpdateKeyValue("key1", "value1", 2);
+  cache->UpdateKeyValue("key2", "value2", 1);
+  cache->DeleteKey("key2", 2);
+  // Collected pairs aren't visible until the base is built.
+  EXPECT_THAT(cache->GetKeyValuePairs({"key1"}), IsEmpty());
+  ASSERT_TRUE(cache->FinishBaseBuild("snapshot").ok());
+
+  EXPECT_THAT(cache->GetKeyValuePairs({"key1", "key2"}),
+              UnorderedElementsAre(KVPairEq("key1", "value1")));
+  // The deletion is kept in the overlay to drop late updates.
+  cache->UpdateKeyValue("key2", "late", 1);
+  EXPECT_THAT(cache->GetKeyValuePairs({"key2"}), IsEmpty());
+}
+
+TEST(TieredKeyValueCacheTest, OverlayTakesPrecedenceOverBase) {
+  auto noop_metrics_recorder =
+      TelemetryProvider::GetInstance().CreateMetricsRecorder();
+  auto cache =
+      TieredKeyValueCache::Create(*noop_metrics_recorder, BasePath("overlay"));
+  BuildBase(*cache);
+  cache->UpdateKeyValue("key1", "older", 4);
+  cache->UpdateKeyValue("key2", "newer", 6);
+  cache->UpdateKeyValue("key3", "value3", 1);
+  EXPECT_THAT(cache->GetKeyValuePairs({"key1", "key2", "key3"}),
+              UnorderedElementsAre(KVPairEq("key1", "value1"),
+                                   KVPairEq("key2", "newer"),
+                                   KVPairEq("key3", "value3")));
+}
+
+TEST(TieredKeyValueCacheTest, DeletionHidesBaseEntry) {
+  auto noop_metrics_recorder =
+      TelemetryProvider::GetInstance().CreateMetricsRecorder();
+  auto cache =
+      TieredKeyValueCache::Create(*noop_metrics_recorder, BasePath("delete"));
+  BuildBase(*cache);
+  cache->DeleteKey("key1", 4);
+  cache->DeleteKey("key2", 6);
+  EXPECT_THAT(cache->GetKeyValuePairs({"key1", "key2"}),
+              UnorderedElementsAre(KVPairEq("key1", "value1")));
+
+  // The base entry stays hidden after the deletion is removed.
+  cache->RemoveDeletedKeys(10);
+  EXPECT_THAT(cache->GetKeyValuePairs({"key2"}), IsEmpty());
+  cache->UpdateKeyValue("key2", "again", 11);
+  EXPECT_THAT(cache->GetKeyValuePairs({"key2"}),
+              UnorderedElementsAre(KVPairEq("key2", "again")));
+}
+
+TEST(TieredKeyValueCacheTest, LookupsAtPinnedVersionIgnoreLaterMutations) {
+  auto noop_metrics_recorder =
+      TelemetryProvider::GetInstance().CreateMetricsRecorder();
+  auto cache =
+      TieredKeyValueCache::Create(*noop_metrics_recorder, BasePath("pinned"));
+  BuildBase(*cache);
+  cache->DeleteKey("key2", 6);
+  std::unique_ptr<ReadVersion> version = cache->PinReadVersion();
+  ASSERT_NE(version, nullptr);
+  cache->DeleteKey("key1", 6);
+  cache->UpdateKeyValue("key2", "again", 7);
+  cache->UpdateKeyValue("key3", "value3", 7);
+  cache->RemoveDeletedKeys(6);
+
+  EXPECT_THAT(cache->GetKeyValuePairsAt({"key1", "key2", "key3"},
+                                        version.get()),
+              UnorderedElementsAre(KVPairEq("key1", "value1")));
+  EXPECT_THAT(cache->GetKeyValuePairs({"key1", "key2", "key3"}),
+              UnorderedElementsAre(KVPairEq("key2", "again"),
+                                   KVPairEq("key3", "value3")));
+
+  // The deletion of the base entry is forgotten once nothing can see it.
+  version.reset();
+  cache->RemoveDeletedKeys(6);
+  EXPECT_THAT(cache->GetKeyValuePairs({"key1"}), IsEmpty());
+}
+
+TEST(TieredKeyValueCacheTest, ApplyBatchChecksBase) {
+  auto noop_metrics_recorder =
+      TelemetryProvider::GetInstance().CreateMetricsRecorder();
+  auto cache =
+      TieredKeyValueCache::Create(*noop_metrics_recorder, BasePath("batch"));
+  BuildBase(*cache);
+  std::vector<std::string_view> values = {"v1", "v2"};
+  std::vector<Mutation> mutations = {
+      {.type = Mutation::Type::kUpdateKeyValue,
+       .key = "key1",
+       .value = "older",
+       .logical_commit_time = 4},
+      {.type = Mutation::Type::kDeleteKey,
+       .key = "key2",
+       .logical_commit_time = 6},
+      {.type = Mutation::Type::kUpdateKeyValueSet,
+       .key = "set1",
+       .value_set = values,
+       .logical_commit_time = 1},
+  };
+  cache->ApplyBatch(absl::MakeSpan(mutations));
+  EXPECT_THAT(cache->GetKeyValuePairs({"key1", "key2"}),
+              UnorderedElementsAre(KVPairEq("key1", "value1")));
+  EXPECT_THAT(cache->GetKeyValueSet({"set1"})->GetValueSet("set1"),
+              UnorderedElementsAre("v1", "v2"));
+}
+
+TEST(TieredKeyValueCacheTest, OpenBaseChecksSource) {
+  auto noop_metrics_recorder =
+      TelemetryProvider::GetInstance().CreateMetricsRecorder();
+  const std::string path = BasePath("reopen");
+  {
+    auto cache = TieredKeyValueCache::Create(*noop_metrics_recorder, path);
+    BuildBase(*cache);
+  }
+  auto cache = TieredKeyValueCache::Create(*noop_metrics_recorder, path);
+  EXPECT_EQ(cache->OpenBase("other_snapshot").code(),
+            absl::StatusCode::kFailedPrecondition);
+  EXPECT_THAT(cache->GetKeyValuePairs({"key1"}), IsEmpty());
+  ASSERT_TRUE(cache->OpenBase("snapshot").ok());
+  EXPECT_THAT(cache->GetKeyValuePairs({"key1", "key2"}),
+              UnorderedElementsAre(KVPairEq("key1", "value1"),
+                                   KVPairEq("key2", "value2")));
+  EXPECT_EQ(TieredKeyValueCache::Create(*noop_metrics_recorder,
+                                        BasePath("no_base"))
+                ->OpenBase("snapshot")
+                .code(),
+            absl::StatusCode::kNotFound);
+}
+
+TEST(TieredKeyValueCacheTest, KeepsPairsInOverlayWhenBaseCantBeWritten) {
+  auto noop_metrics_recorder =
+      TelemetryProvider::GetInstance().CreateMetricsRecorder();
+  auto cache = TieredKeyValueCache::Create(*noop_metrics_recorder,
+                                           BasePath("missing_dir/base"));
+  cache->StartBaseBuild();
+  cache->UpdateKeyValue("key1", "value1", 1);
+  EXPECT_FALSE(cache->FinishBaseBuild("snapshot").ok());
+  EXPECT_THAT(cache->GetKeyValuePairs({"key1"}),
+              UnorderedElementsAre(KVPairEq("key1", "value1")));
+}
+
+TEST(TieredKeyValueCacheTest, ValuesOutliveCache) {
+  auto noop_metrics_recorder =
+      TelemetryProvider::GetInstance().CreateMetricsRecorder();
+  const std::string value(1000, 'v');
+  auto cache =
+      TieredKeyValueCache::Create(*noop_metrics_recorder, BasePath("outlive"));
+  cache->StartBaseBuild();
+  cache->UpdateKeyValue("key1", value, 1);
+  ASSERT_TRUE(cache->FinishBaseBuild("snapshot").ok());
+  auto kv_pairs = cache->GetKeyValuePairs({"key1"});
+  cache.reset();
+  EXPECT_EQ(kv_pairs["key1"], value);
+}
+
+TEST(TieredKeyValueCacheTest, ExportMutationsRebuildsCache) {
+  auto noop_metrics_recorder =
+      TelemetryProvider::GetInstance().CreateMetricsRecorder();
+  auto cache =
+      TieredKeyValueCache::Create(*noop_metrics_recorder, BasePath("export"));
+  BuildBase(*cache);
+  cache->DeleteKey("key1", 6);
+  cache->UpdateKeyValue("key2", "newer", 6);
+  cache->UpdateKeyValue("key3", "value3", 6);
+  cache->RemoveDeletedKeys(10);
+
+  auto rebuilt = KeyValueCache::Create(*noop_metrics_recorder);
+  cache->ExportMutations([&rebuilt](const Mutation& mutation) {
+    Mutation copy = mutation;
+    rebuilt->ApplyBatch(absl::MakeSpan(&copy, 1));
+  });
+  EXPECT_THAT(rebuilt->GetKeyValuePairs({"key1", "key2", "key3"}),
+              UnorderedElementsAre(KVPairEq("key2", "newer"),
+                                   KVPairEq("key3", "value3")));
+}
+
+TEST(TieredKeyValueCacheTest, CountsBaseAndOverlayMemory) {
+  auto noop_metrics_recorder =
+      TelemetryProvider::GetInstance().CreateMetricsRecorder();
+  auto cache =
+      TieredKeyValueCache::Create(*noop_metrics_recorder, BasePath("memory"));
+  cache->StartBaseBuild();
+  cache->UpdateKeyValue("key1", "value1", 5);
+  EXPECT_EQ(cache->GetMemoryUsage().value_bytes, 6);
+  cache->UpdateKeyValue("key2", "value2", 5);
+  ASSERT_TRUE(cache->FinishBaseBuild("snapshot").ok());
+  EXPECT_EQ(cache->GetMemoryUsage().value_bytes, 12);
+  cache->UpdateKeyValue("key3", "value3", 6);
+  EXPECT_EQ(cache->GetMemoryUsage().value_bytes, 18);
+}
+
+}  // namespace
+}  // namespace kv_server
@@ -0,0 +1,73 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "components/data_server/cache/tombstone_compactor.h"
+
+#include <algorithm>
+#include <memory>
+
+#include "absl/memory/memory.h"
+#include "glog/logging.h"
+
+namespace kv_server {
+
+TombstoneCompactor::TombstoneCompactor(Cache& cache, bool inline_compaction)
+    : cache_(cache),
+      inline_compaction_(inline_compaction),
+      compactor_(PeriodicClosure::Create()) {}
+
+TombstoneCompactor::~TombstoneCompactor() { compactor_->Stop(); }
+
+void TombstoneCompactor::AdvanceCutoff(int64_t logical_commit_time) {
+  {
+    absl::MutexLock lock(&mutex_);
+    cutoff_ = std::max(cutoff_, logical_commit_time);
+  }
+  if (inline_compaction_) {
+    Compact();
+  }
+}
+
+void TombstoneCompactor::Compact() {
+  absl::MutexLock compaction_lock(&compaction_mutex_);
+  int64_t cutoff;
+  {
+    absl::MutexLock lock(&mutex_);
+    cutoff = cutoff_;
+  }
+  if (cutoff <= compacted_cutoff_) {
+    return;
+  }
+  VLOG(1) << "Removing tombstones up to logical commit time " << cutoff;
+  cache_.RemoveDeletedKeys(cutoff);
+  compacted_cutoff_ = cutoff;
+}
+
+std::unique_ptr<TombstoneCompactor> TombstoneCompactor::Create(
+    Cache& cache, absl::Duration interval) {
+  const bool inline_compaction = interval <= absl::ZeroDuration();
+  auto compactor =
+      absl::WrapUnique(new TombstoneCompactor(cache, inline_compaction));
+  if (!inline_compaction) {
+    if (const absl::Status status = compactor->compactor_->StartDelayed(
+            interval, [compactor = compactor.get()] { compactor->Compact(); });
+        !status.ok()) {
+      LOG(ERROR) << "Failed to start the tombstone compactor: " << status;
+    }
+  }
+  return compactor;
+}
+
+}  // namespace kv_server
@@ -0,0 +1,75 @@
+/*
+ * Copyright 2023 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef COMPONENTS_DATA_SERVER_CACHE_TOMBSTONE_COMPACTOR_H_
+#define COMPONENTS_DATA_SERVER_CACHE_TOMBSTONE_COMPACTOR_H_
+
+#include <cstdint>
+#include <limits>
+#include <memory>
+
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "components/data_server/cache/cache.h"
+#include "components/util/periodic_closure.h"
+
+namespace kv_server {
+
+// Removes the tombstones of deleted keys and set values from a cache on a
+// background thread, so that data loading doesn't wait for the cleanup.
+//
+// Data loading advances the cutoff once it has applied all the mutations up
+// to a logical commit time, and the compactor removes the tombstones up to
+// the latest cutoff every `interval`.
+class TombstoneCompactor {
+ public:
+  ~TombstoneCompactor();
+
+  TombstoneCompactor(const TombstoneCompactor&) = delete;
+  TombstoneCompactor& operator=(const TombstoneCompactor&) = delete;
+
+  // Allows the tombstones with a logical commit time up to
+  // `logical_commit_time` to be removed. Cutoffs never move back.
+  void AdvanceCutoff(int64_t logical_commit_time);
+
+  // Removes the tombstones up to the current cutoff, if it advanced since the
+  // last compaction.
+  void Compact();
+
+  // Runs `Compact` every `interval`. A zero interval disables the background
+  // thread, and `AdvanceCutoff` then compacts inline. `cache` must outlive
+  // the compactor.
+  static std::unique_ptr<TombstoneCompactor> Create(Cache& cache,
+                                                    absl::Duration interval);
+
+ private:
+  TombstoneCompactor(Cache& cache, bool inline_compaction);
+
+  Cache& cache_;
+  const bool inline_compaction_;
+  std::unique_ptr<PeriodicClosure> compactor_;
+  // Serializes compactions.
+  absl::Mutex compaction_mutex_;
+  absl::Mutex mutex_;
+  int64_t cutoff_ ABSL_GUARDED_BY(mutex_) =
+      std::numeric_limits<int64_t>::min();
+  int64_t compacted_cutoff_ ABSL_GUARDED_BY(compaction_mutex_) =
+      std::numeric_limits<int64_t>::min();
+};
+
+}  // namespace kv_server
+
+#endif  // COMPONENTS_DATA_SERVER_CACHE_TOMBSTONE_COMPACTOR_H_
@@ -0,0 +1,70 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "components/data_server/cache/tombstone_compactor.h"
+
+#include <memory>
+
+#include "absl/synchronization/notification.h"
+#include "absl/time/time.h"
+#include "components/data_server/cache/mocks.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace kv_server {
+namespace {
+
+using testing::_;
+
+TEST(TombstoneCompactorTest, CompactsInlineWithoutInterval) {
+  MockCache cache;
+  auto compactor = TombstoneCompactor::Create(cache, absl::ZeroDuration());
+  EXPECT_CALL(cache, RemoveDeletedKeys(3)).Times(1);
+  compactor->AdvanceCutoff(3);
+}
+
+TEST(TombstoneCompactorTest, DefersCompactionToInterval) {
+  MockCache cache;
+  auto compactor = TombstoneCompactor::Create(cache, absl::Hours(1));
+  EXPECT_CALL(cache, RemoveDeletedKeys(_)).Times(0);
+  compactor->AdvanceCutoff(3);
+  testing::Mock::VerifyAndClearExpectations(&cache);
+
+  EXPECT_CALL(cache, RemoveDeletedKeys(3)).Times(1);
+  compactor->Compact();
+}
+
+TEST(TombstoneCompactorTest, CompactsLatestCutoffOnce) {
+  MockCache cache;
+  auto compactor = TombstoneCompactor::Create(cache, absl::Hours(1));
+  compactor->AdvanceCutoff(5);
+  compactor->AdvanceCutoff(3);
+  EXPECT_CALL(cache, RemoveDeletedKeys(5)).Times(1);
+  compactor->Compact();
+  compactor->Compact();
+}
+
+TEST(TombstoneCompactorTest, CompactsPeriodically) {
+  MockCache cache;
+  absl::Notification compacted;
+  EXPECT_CALL(cache, RemoveDeletedKeys(7)).WillOnce([&compacted] {
+    compacted.Notify();
+  });
+  auto compactor = TombstoneCompactor::Create(cache, absl::Milliseconds(1));
+  compactor->AdvanceCutoff(7);
+  EXPECT_TRUE(compacted.WaitForNotificationWithTimeout(absl::Seconds(10)));
+}
+
+}  // namespace
+}  // namespace kv_server
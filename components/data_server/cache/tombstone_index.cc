@@ -0,0 +1,67 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "components/data_server/cache/tombstone_index.h"
+
+namespace kv_server {
+
+void TombstoneIndex::Add(int64_t logical_commit_time, std::string_view key) {
+  Bucket& bucket = buckets_[logical_commit_time];
+  bucket.keys.append(key);
+  bucket.ends.push_back(bucket.keys.size());
+}
+
+std::optional<TombstoneIndex::Tombstone> TombstoneIndex::Peek(
+    int64_t max_logical_commit_time) const {
+  if (buckets_.empty() ||
+      buckets_.begin()->first > max_logical_commit_time) {
+    return std::nullopt;
+  }
+  // Keys are taken from the back of the bucket, so that popping them only
+  // shrinks the buffer.
+  const auto& [logical_commit_time, bucket] = *buckets_.begin();
+  const uint32_t begin =
+      bucket.ends.size() > 1 ? bucket.ends[bucket.ends.size() - 2] : 0;
+  return Tombstone{
+      .logical_commit_time = logical_commit_time,
+      .key = std::string_view(bucket.keys).substr(begin,
+                                                  bucket.ends.back() - begin),
+  };
+}
+
+void TombstoneIndex::Pop() {
+  Bucket& bucket = buckets_.begin()->second;
+  bucket.ends.pop_back();
+  if (bucket.ends.empty()) {
+    buckets_.erase(buckets_.begin());
+    return;
+  }
+  bucket.keys.resize(bucket.ends.back());
+}
+
+void TombstoneIndex::ForEach(
+    const std::function<void(const Tombstone&)>& callback) const {
+  for (const auto& [logical_commit_time, bucket] : buckets_) {
+    uint32_t begin = 0;
+    for (const uint32_t end : bucket.ends) {
+      callback(Tombstone{
+          .logical_commit_time = logical_commit_time,
+          .key = std::string_view(bucket.keys).substr(begin, end - begin),
+      });
+      begin = end;
+    }
+  }
+}
+
+}  // namespace kv_server
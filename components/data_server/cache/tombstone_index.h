@@ -0,0 +1,77 @@
+/*
+ * Copyright 2023 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef COMPONENTS_DATA_SERVER_CACHE_TOMBSTONE_INDEX_H_
+#define COMPONENTS_DATA_SERVER_CACHE_TOMBSTONE_INDEX_H_
+
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "absl/container/btree_map.h"
+
+namespace kv_server {
+
+// Keys of deleted entries, in buckets by the logical commit time of their
+// deletion, so that a cleanup sweeps them bucket by bucket.
+//
+// The keys of a bucket are packed into one buffer, with the offsets of their
+// ends, rather than allocated one by one. Keys aren't removed when they're
+// updated again after their deletion, as that would mean searching their
+// bucket, so the sweep has to skip the keys that are no longer deleted.
+class TombstoneIndex {
+ public:
+  // Bytes held for `key` in the index.
+  static int64_t KeyBytes(std::string_view key) {
+    return key.size() + sizeof(uint32_t);
+  }
+
+  struct Tombstone {
+    int64_t logical_commit_time;
+    std::string_view key;
+  };
+
+  void Add(int64_t logical_commit_time, std::string_view key);
+
+  // Returns a key of the oldest bucket, if that bucket is at most as old as
+  // `max_logical_commit_time`. The key is valid until the next `Add` or
+  // `Pop`.
+  std::optional<Tombstone> Peek(int64_t max_logical_commit_time) const;
+
+  // Removes the key returned by `Peek`.
+  void Pop();
+
+  // Calls `callback` with each key, oldest bucket first.
+  void ForEach(const std::function<void(const Tombstone&)>& callback) const;
+
+  // Returns the number of buckets.
+  size_t num_buckets() const { return buckets_.size(); }
+
+ private:
+  struct Bucket {
+    std::string keys;
+    std::vector<uint32_t> ends;
+  };
+
+  absl::btree_map<int64_t, Bucket> buckets_;
+};
+
+}  // namespace kv_server
+
+#endif  // COMPONENTS_DATA_SERVER_CACHE_TOMBSTONE_INDEX_H_
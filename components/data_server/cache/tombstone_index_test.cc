@@ -0,0 +1,76 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "components/data_server/cache/tombstone_index.h"
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace kv_server {
+namespace {
+
+using testing::ElementsAre;
+using testing::IsEmpty;
+using testing::Pair;
+
+std::vector<std::pair<int64_t, std::string>> PopAll(
+    TombstoneIndex& index, int64_t max_logical_commit_time) {
+  std::vector<std::pair<int64_t, std::string>> popped;
+  while (const auto tombstone = index.Peek(max_logical_commit_time)) {
+    popped.emplace_back(tombstone->logical_commit_time, tombstone->key);
+    index.Pop();
+  }
+  return popped;
+}
+
+TEST(TombstoneIndexTest, PopsOldestBucketsFirst) {
+  TombstoneIndex index;
+  index.Add(3, "key3");
+  index.Add(1, "key1");
+  index.Add(2, "a_longer_key2");
+  index.Add(1, "");
+  index.Add(1, "key1b");
+  EXPECT_EQ(index.num_buckets(), 3);
+
+  EXPECT_THAT(PopAll(index, 2),
+              ElementsAre(Pair(1, "key1b"), Pair(1, ""), Pair(1, "key1"),
+                          Pair(2, "a_longer_key2")));
+  EXPECT_EQ(index.num_buckets(), 1);
+  EXPECT_THAT(PopAll(index, 3), ElementsAre(Pair(3, "key3")));
+  EXPECT_EQ(index.num_buckets(), 0);
+  EXPECT_FALSE(index.Peek(3).has_value());
+}
+
+TEST(TombstoneIndexTest, AddsToPartlyPoppedBucket) {
+  TombstoneIndex index;
+  index.Add(1, "key1");
+  index.Add(1, "key2");
+  index.Pop();
+  index.Add(1, "key3");
+
+  std::vector<std::pair<int64_t, std::string>> all;
+  index.ForEach([&all](const TombstoneIndex::Tombstone& tombstone) {
+    all.emplace_back(tombstone.logical_commit_time, tombstone.key);
+  });
+  EXPECT_THAT(all, ElementsAre(Pair(1, "key1"), Pair(1, "key3")));
+  EXPECT_THAT(PopAll(index, 0), IsEmpty());
+}
+
+}  // namespace
+}  // namespace kv_server
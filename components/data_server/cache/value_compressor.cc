@@ -0,0 +1,132 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "components/data_server/cache/value_compressor.h"
+
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "absl/memory/memory.h"
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "zdict.h"
+#include "zstd.h"
+
+namespace kv_server {
+namespace {
+
+struct CCtxDeleter {
+  void operator()(ZSTD_CCtx* cctx) const { ZSTD_freeCCtx(cctx); }
+};
+
+struct DCtxDeleter {
+  void operator()(ZSTD_DCtx* dctx) const { ZSTD_freeDCtx(dctx); }
+};
+
+// Contexts are large and costly to set up, so each thread reuses its own.
+ZSTD_CCtx* ThreadCCtx() {
+  thread_local std::unique_ptr<ZSTD_CCtx, CCtxDeleter> cctx(ZSTD_createCCtx());
+  return cctx.get();
+}
+
+ZSTD_DCtx* ThreadDCtx() {
+  thread_local std::unique_ptr<ZSTD_DCtx, DCtxDeleter> dctx(ZSTD_createDCtx());
+  return dctx.get();
+}
+
+}  // namespace
+
+ValueCompressor::ValueCompressor(std::string dictionary, int level)
+    : dictionary_(std::move(dictionary)), level_(level) {
+  if (!dictionary_.empty()) {
+    cdict_ = ZSTD_createCDict(dictionary_.data(), dictionary_.size(), level_);
+    ddict_ = ZSTD_createDDict(dictionary_.data(), dictionary_.size());
+  }
+}
+
+ValueCompressor::~ValueCompressor() {
+  ZSTD_freeCDict(cdict_);
+  ZSTD_freeDDict(ddict_);
+}
+
+std::optional<std::string> ValueCompressor::Compress(
+    std::string_view value) const {
+  std::string compressed(ZSTD_compressBound(value.size()), '\0');
+  const size_t size =
+      cdict_ == nullptr
+          ? ZSTD_compressCCtx(ThreadCCtx(), compressed.data(),
+                              compressed.size(), value.data(), value.size(),
+                              level_)
+          : ZSTD_compress_usingCDict(ThreadCCtx(), compressed.data(),
+                                     compressed.size(), value.data(),
+                                     value.size(), cdict_);
+  if (ZSTD_isError(size) || size >= value.size()) {
+    return std::nullopt;
+  }
+  compressed.resize(size);
+  compressed.shrink_to_fit();
+  return compressed;
+}
+
+absl::StatusOr<std::string> ValueCompressor::Decompress(
+    std::string_view compressed) const {
+  // Frames record the size of their content.
+  const unsigned long long content_size =
+      ZSTD_getFrameContentSize(compressed.data(), compressed.size());
+  if (content_size == ZSTD_CONTENTSIZE_ERROR ||
+      content_size == ZSTD_CONTENTSIZE_UNKNOWN) {
+    return absl::DataLossError("Compressed value has no content size");
+  }
+  std::string value(content_size, '\0');
+  const size_t size =
+      ddict_ == nullptr
+          ? ZSTD_decompressDCtx(ThreadDCtx(), value.data(), value.size(),
+                                compressed.data(), compressed.size())
+          : ZSTD_decompress_usingDDict(ThreadDCtx(), value.data(),
+                                       value.size(), compressed.data(),
+                                       compressed.size(), ddict_);
+  if (ZSTD_isError(size)) {
+    return absl::DataLossError(absl::StrCat(
+        "Failed to decompress value: ", ZSTD_getErrorName(size)));
+  }
+  if (size != value.size()) {
+    return absl::DataLossError("Decompressed value has the wrong size");
+  }
+  return value;
+}
+
+absl::StatusOr<std::string> ValueCompressor::TrainDictionary(
+    std::string_view samples, absl::Span<const size_t> sample_sizes,
+    int64_t dictionary_bytes) {
+  std::string dictionary(dictionary_bytes, '\0');
+  const size_t size = ZDICT_trainFromBuffer(
+      dictionary.data(), dictionary.size(), samples.data(),
+      sample_sizes.data(), sample_sizes.size());
+  if (ZDICT_isError(size)) {
+    return absl::FailedPreconditionError(absl::StrCat(
+        "Failed to train dictionary: ", ZDICT_getErrorName(size)));
+  }
+  dictionary.resize(size);
+  return dictionary;
+}
+
+std::unique_ptr<ValueCompressor> ValueCompressor::Create(
+    std::string dictionary, int level) {
+  return absl::WrapUnique(new ValueCompressor(std::move(dictionary), level));
+}
+
+}  // namespace kv_server
@@ -0,0 +1,93 @@
+/*
+ * Copyright 2023 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef COMPONENTS_DATA_SERVER_CACHE_VALUE_COMPRESSOR_H_
+#define COMPONENTS_DATA_SERVER_CACHE_VALUE_COMPRESSOR_H_
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "absl/status/statusor.h"
+#include "absl/types/span.h"
+
+struct ZSTD_CDict_s;
+struct ZSTD_DDict_s;
+
+namespace kv_server {
+
+// How a cache compresses the values of its key-value pairs.
+struct ValueCompressionOptions {
+  // Values of at least this many bytes are compressed. Zero disables
+  // compression.
+  int64_t threshold_bytes = 0;
+  // zstd compression level.
+  int level = 3;
+  // Bytes of values that are sampled to train the dictionary. Values are
+  // stored uncompressed while they're sampled. Zero compresses every value on
+  // its own, without a dictionary.
+  int64_t sample_bytes = 1 << 20;
+  // Maximum size of the trained dictionary.
+  int64_t dictionary_bytes = 16 << 10;
+  // Bytes of recently read values kept decompressed. Zero disables it.
+  int64_t decompressed_cache_bytes = 16 << 20;
+};
+
+// Compresses values with zstd, using a dictionary trained from samples of
+// similar values. Small values, like most JSON documents, compress much
+// better with a shared dictionary than on their own.
+//
+// Thread-safe. Each thread uses its own zstd contexts.
+class ValueCompressor {
+ public:
+  ~ValueCompressor();
+
+  ValueCompressor(const ValueCompressor&) = delete;
+  ValueCompressor& operator=(const ValueCompressor&) = delete;
+
+  // Returns the compressed value, or nullopt if compressing it doesn't save
+  // any bytes.
+  std::optional<std::string> Compress(std::string_view value) const;
+
+  // Returns the value that `compressed` was compressed from.
+  absl::StatusOr<std::string> Decompress(std::string_view compressed) const;
+
+  // Returns a dictionary of at most `dictionary_bytes` trained from the
+  // concatenated `samples`, whose sizes are given by `sample_sizes`.
+  static absl::StatusOr<std::string> TrainDictionary(
+      std::string_view samples, absl::Span<const size_t> sample_sizes,
+      int64_t dictionary_bytes);
+
+  // Compresses at `level` with `dictionary`. An empty dictionary compresses
+  // every value on its own.
+  static std::unique_ptr<ValueCompressor> Create(std::string dictionary,
+                                                 int level);
+
+ private:
+  ValueCompressor(std::string dictionary, int level);
+
+  const std::string dictionary_;
+  const int level_;
+  // Null without a dictionary.
+  ZSTD_CDict_s* cdict_ = nullptr;
+  ZSTD_DDict_s* ddict_ = nullptr;
+};
+
+}  // namespace kv_server
+
+#endif  // COMPONENTS_DATA_SERVER_CACHE_VALUE_COMPRESSOR_H_
@@ -0,0 +1,93 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "components/data_server/cache/value_compressor.h"
+
+#include <string>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "gtest/gtest.h"
+
+namespace kv_server {
+namespace {
+
+std::string JsonValue(int i) {
+  return absl::StrCat(R"({"campaign_id":)", i,
+                      R"(,"render_url":"https://ads.example/creative/)", i,
+                      R"(","bid_floor":)", i % 7,
+                      R"(,"categories":["sports","news","travel"]})");
+}
+
+TEST(ValueCompressorTest, RoundTripsWithoutDictionary) {
+  auto compressor = ValueCompressor::Create("", 3);
+  const std::string value(1000, 'a');
+  auto compressed = compressor->Compress(value);
+  ASSERT_TRUE(compressed.has_value());
+  EXPECT_LT(compressed->size(), value.size());
+  auto decompressed = compressor->Decompress(*compressed);
+  ASSERT_TRUE(decompressed.ok()) << decompressed.status();
+  EXPECT_EQ(*decompressed, value);
+}
+
+TEST(ValueCompressorTest, DictionaryCompressesSmallValues) {
+  std::string samples;
+  std::vector<size_t> sample_sizes;
+  for (int i = 0; i < 1000; ++i) {
+    const std::string value = JsonValue(i);
+    samples.append(value);
+    sample_sizes.push_back(value.size());
+  }
+  auto dictionary =
+      ValueCompressor::TrainDictionary(samples, sample_sizes, 4 << 10);
+  ASSERT_TRUE(dictionary.ok()) << dictionary.status();
+  auto compressor = ValueCompressor::Create(*dictionary, 3);
+  auto plain_compressor = ValueCompressor::Create("", 3);
+
+  const std::string value = JsonValue(12345);
+  auto compressed = compressor->Compress(value);
+  ASSERT_TRUE(compressed.has_value());
+  auto plain_compressed = plain_compressor->Compress(value);
+  EXPECT_TRUE(!plain_compressed.has_value() ||
+              compressed->size() < plain_compressed->size());
+  auto decompressed = compressor->Decompress(*compressed);
+  ASSERT_TRUE(decompressed.ok()) << decompressed.status();
+  EXPECT_EQ(*decompressed, value);
+}
+
+TEST(ValueCompressorTest, SkipsIncompressibleValues) {
+  auto compressor = ValueCompressor::Create("", 3);
+  EXPECT_FALSE(compressor->Compress("abc").has_value());
+}
+
+TEST(ValueCompressorTest, RejectsCorruptValues) {
+  auto compressor = ValueCompressor::Create("", 3);
+  auto compressed = compressor->Compress(std::string(1000, 'a'));
+  ASSERT_TRUE(compressed.has_value());
+  EXPECT_EQ(compressor->Decompress("not compressed").status().code(),
+            absl::StatusCode::kDataLoss);
+  compressed->resize(compressed->size() - 1);
+  EXPECT_EQ(compressor->Decompress(*compressed).status().code(),
+            absl::StatusCode::kDataLoss);
+}
+
+TEST(ValueCompressorTest, TrainingFailsWithoutEnoughSamples) {
+  const std::string samples = "abc";
+  const std::vector<size_t> sample_sizes = {3};
+  EXPECT_FALSE(
+      ValueCompressor::TrainDictionary(samples, sample_sizes, 4 << 10).ok());
+}
+
+}  // namespace
+}  // namespace kv_server
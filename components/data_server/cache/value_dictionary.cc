@@ -0,0 +1,195 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "components/data_server/cache/value_dictionary.h"
+
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "absl/hash/hash.h"
+#include "glog/logging.h"
+
+namespace kv_server {
+namespace {
+
+// Calls `callback` once for each shard that elements of a call belong to,
+// given the shard of each element in `shards`, with the positions of its
+// elements, so that the shard is locked once per call.
+template <uint32_t kNumShards, typename Callback>
+void ForEachShardGroup(absl::Span<const uint32_t> shards, Callback callback) {
+  if (shards.size() == 1) {
+    const uint32_t position = 0;
+    callback(shards[0], absl::MakeConstSpan(&position, 1));
+    return;
+  }
+  // Sorts the positions by shard, with `begins[s]` the first one of shard
+  // `s`.
+  std::array<uint32_t, kNumShards + 1> begins = {};
+  for (uint32_t shard : shards) {
+    ++begins[shard + 1];
+  }
+  for (uint32_t shard = 0; shard < kNumShards; ++shard) {
+    begins[shard + 1] += begins[shard];
+  }
+  std::array<uint32_t, kNumShards> next;
+  std::copy(begins.begin(), begins.end() - 1, next.begin());
+  std::vector<uint32_t> positions(shards.size());
+  for (uint32_t position = 0; position < shards.size(); ++position) {
+    positions[next[shards[position]]++] = position;
+  }
+  for (uint32_t shard = 0; shard < kNumShards; ++shard) {
+    if (begins[shard] < begins[shard + 1]) {
+      callback(shard, absl::MakeConstSpan(positions).subspan(
+                          begins[shard], begins[shard + 1] - begins[shard]));
+    }
+  }
+}
+
+}  // namespace
+
+uint32_t ValueDictionary::ShardOf(std::string_view value) {
+  // The top bits of the hash, as the hash maps of the shards use the low
+  // ones.
+  return absl::Hash<std::string_view>{}(value) >>
+         (std::numeric_limits<size_t>::digits - kShardBits);
+}
+
+std::vector<uint32_t> ValueDictionary::ShardsOf(
+    absl::Span<const uint32_t> value_ids) {
+  std::vector<uint32_t> shards;
+  shards.reserve(value_ids.size());
+  for (uint32_t id : value_ids) {
+    shards.push_back(ShardOf(id));
+  }
+  return shards;
+}
+
+std::vector<uint32_t> ValueDictionary::Intern(
+    absl::Span<const std::string_view> values) {
+  std::vector<uint32_t> shards;
+  shards.reserve(values.size());
+  for (std::string_view value : values) {
+    shards.push_back(ShardOf(value));
+  }
+  std::vector<uint32_t> value_ids(values.size());
+  ForEachShardGroup<kNumShards>(
+      shards, [&](uint32_t shard_num, absl::Span<const uint32_t> positions) {
+        Shard& shard = shards_[shard_num];
+        absl::MutexLock lock(&shard.mutex);
+        for (uint32_t position : positions) {
+          const std::string_view value = values[position];
+          if (const auto id_iter = shard.ids.find(value);
+              id_iter != shard.ids.end()) {
+            ++shard.entries[IndexOf(id_iter->second)].references;
+            value_ids[position] = id_iter->second;
+            continue;
+          }
+          uint32_t id;
+          if (shard.free_ids.empty()) {
+            DCHECK_LT(shard.entries.size(), uint32_t{1} << (32 - kShardBits))
+                << "Too many values interned";
+            id = (shard.entries.size() << kShardBits) | shard_num;
+            shard.entries.emplace_back();
+          } else {
+            id = shard.free_ids.back();
+            shard.free_ids.pop_back();
+          }
+          Entry& entry = shard.entries[IndexOf(id)];
+          entry.value = std::string(value);
+          entry.references = 1;
+          shard.ids.emplace(entry.value, id);
+          bytes_.fetch_add(value.size(), std::memory_order_relaxed);
+          value_ids[position] = id;
+        }
+      });
+  return value_ids;
+}
+
+void ValueDictionary::Retain(absl::Span<const uint32_t> value_ids) {
+  ForEachShardGroup<kNumShards>(
+      ShardsOf(value_ids),
+      [&](uint32_t shard_num, absl::Span<const uint32_t> positions) {
+        Shard& shard = shards_[shard_num];
+        absl::MutexLock lock(&shard.mutex);
+        for (uint32_t position : positions) {
+          Entry& entry = shard.entries[IndexOf(value_ids[position])];
+          DCHECK_GT(entry.references, 0)
+              << "Retained an unreferenced value ID";
+          ++entry.references;
+        }
+      });
+}
+
+void ValueDictionary::Release(absl::Span<const uint32_t> value_ids) {
+  ForEachShardGroup<kNumShards>(
+      ShardsOf(value_ids),
+      [&](uint32_t shard_num, absl::Span<const uint32_t> positions) {
+        Shard& shard = shards_[shard_num];
+        absl::MutexLock lock(&shard.mutex);
+        for (uint32_t position : positions) {
+          const uint32_t id = value_ids[position];
+          Entry& entry = shard.entries[IndexOf(id)];
+          DCHECK_GT(entry.references, 0)
+              << "Released an unreferenced value ID";
+          if (--entry.references > 0) {
+            continue;
+          }
+          shard.ids.erase(entry.value);
+          bytes_.fetch_sub(entry.value.size(), std::memory_order_relaxed);
+          // Frees the string's buffer as well.
+          std::string().swap(entry.value);
+          shard.free_ids.push_back(id);
+        }
+      });
+}
+
+std::optional<uint32_t> ValueDictionary::Find(std::string_view value) const {
+  const Shard& shard = shards_[ShardOf(value)];
+  absl::ReaderMutexLock lock(&shard.mutex);
+  if (const auto id_iter = shard.ids.find(value); id_iter != shard.ids.end()) {
+    return id_iter->second;
+  }
+  return std::nullopt;
+}
+
+std::vector<std::string_view> ValueDictionary::GetValues(
+    absl::Span<const uint32_t> value_ids) const {
+  std::vector<std::string_view> values(value_ids.size());
+  ForEachShardGroup<kNumShards>(
+      ShardsOf(value_ids),
+      [&](uint32_t shard_num, absl::Span<const uint32_t> positions) {
+        const Shard& shard = shards_[shard_num];
+        absl::ReaderMutexLock lock(&shard.mutex);
+        for (uint32_t position : positions) {
+          values[position] = shard.entries[IndexOf(value_ids[position])].value;
+        }
+      });
+  return values;
+}
+
+int64_t ValueDictionary::size() const {
+  int64_t size = 0;
+  for (const Shard& shard : shards_) {
+    absl::ReaderMutexLock lock(&shard.mutex);
+    size += shard.ids.size();
+  }
+  return size;
+}
+
+}  // namespace kv_server
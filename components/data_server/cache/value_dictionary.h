@@ -0,0 +1,112 @@
+/*
+ * Copyright 2023 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef COMPONENTS_DATA_SERVER_CACHE_VALUE_DICTIONARY_H_
+#define COMPONENTS_DATA_SERVER_CACHE_VALUE_DICTIONARY_H_
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/types/span.h"
+
+namespace kv_server {
+
+// Interns the values of key-value sets. Each distinct value is stored once
+// and identified by a dense 32 bit ID, so sets can hold IDs instead of copies
+// of the strings.
+//
+// IDs are reference counted. A value is removed once its last reference is
+// released, and its ID may then be reused for another value. Views returned
+// by `GetValues` stay valid as long as the caller holds a reference to the
+// ID, directly or through a set snapshot that contains it.
+//
+// Values are spread over shards by hash, each with its own lock, so that
+// updates and reads of sets holding different values don't contend. Calls
+// taking several values or IDs lock each of their shards once.
+//
+// Thread-safe.
+class ValueDictionary {
+ public:
+  ValueDictionary() = default;
+
+  ValueDictionary(const ValueDictionary&) = delete;
+  ValueDictionary& operator=(const ValueDictionary&) = delete;
+
+  // Returns the IDs of `values`, adding the ones that are missing, and takes
+  // one reference on each returned ID.
+  std::vector<uint32_t> Intern(absl::Span<const std::string_view> values);
+
+  // Takes one more reference on each ID, which must already be referenced.
+  void Retain(absl::Span<const uint32_t> value_ids);
+
+  // Releases one reference on each ID.
+  void Release(absl::Span<const uint32_t> value_ids);
+
+  // Returns the ID of `value` without taking a reference, or nullopt if it
+  // isn't interned.
+  std::optional<uint32_t> Find(std::string_view value) const;
+
+  // Returns the values of `value_ids`, in the same order.
+  std::vector<std::string_view> GetValues(
+      absl::Span<const uint32_t> value_ids) const;
+
+  // Returns the number of interned values.
+  int64_t size() const;
+
+  // Returns the total size of the interned values. Doesn't take the locks.
+  int64_t bytes() const { return bytes_.load(std::memory_order_relaxed); }
+
+ private:
+  // The low bits of an ID are its shard, and the others its index in the
+  // shard, so that the IDs of all the shards together stay dense.
+  static constexpr int kShardBits = 6;
+  static constexpr uint32_t kNumShards = 1 << kShardBits;
+
+  struct Entry {
+    std::string value;
+    int64_t references = 0;
+  };
+
+  struct alignas(64) Shard {
+    mutable absl::Mutex mutex;
+    // Entries indexed by their index in the shard. A deque never moves its
+    // elements, so the views used as keys in `ids` stay valid as it grows.
+    std::deque<Entry> entries ABSL_GUARDED_BY(mutex);
+    absl::flat_hash_map<std::string_view, uint32_t> ids ABSL_GUARDED_BY(mutex);
+    // IDs of removed values, reused before new ones.
+    std::vector<uint32_t> free_ids ABSL_GUARDED_BY(mutex);
+  };
+
+  static uint32_t ShardOf(std::string_view value);
+  static uint32_t ShardOf(uint32_t id) { return id & (kNumShards - 1); }
+  static uint32_t IndexOf(uint32_t id) { return id >> kShardBits; }
+  static std::vector<uint32_t> ShardsOf(absl::Span<const uint32_t> value_ids);
+
+  Shard shards_[kNumShards];
+  // Written with the lock of the shard of the value held.
+  std::atomic<int64_t> bytes_ = 0;
+};
+
+}  // namespace kv_server
+
+#endif  // COMPONENTS_DATA_SERVER_CACHE_VALUE_DICTIONARY_H_
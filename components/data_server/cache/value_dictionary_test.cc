@@ -0,0 +1,132 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "components/data_server/cache/value_dictionary.h"
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "absl/container/flat_hash_set.h"
+#include "absl/strings/str_cat.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace kv_server {
+namespace {
+
+using testing::ElementsAre;
+using testing::ElementsAreArray;
+
+TEST(ValueDictionaryTest, InternReturnsSameIdForSameValue) {
+  ValueDictionary dictionary;
+  std::vector<uint32_t> ids = dictionary.Intern({"a", "b", "a"});
+  ASSERT_EQ(ids.size(), 3);
+  EXPECT_NE(ids[0], ids[1]);
+  EXPECT_EQ(ids[0], ids[2]);
+  EXPECT_EQ(dictionary.size(), 2);
+  EXPECT_THAT(dictionary.GetValues(ids), ElementsAre("a", "b", "a"));
+  EXPECT_EQ(dictionary.Find("b"), ids[1]);
+  EXPECT_EQ(dictionary.Find("c"), std::nullopt);
+}
+
+TEST(ValueDictionaryTest, ReleaseRemovesUnreferencedValues) {
+  ValueDictionary dictionary;
+  std::vector<uint32_t> ids = dictionary.Intern({"a", "b", "a"});
+  dictionary.Release({ids[0], ids[1]});
+  EXPECT_EQ(dictionary.size(), 1);
+  EXPECT_EQ(dictionary.Find("a"), ids[0]);
+  EXPECT_EQ(dictionary.Find("b"), std::nullopt);
+  dictionary.Release({ids[2]});
+  EXPECT_EQ(dictionary.size(), 0);
+  EXPECT_EQ(dictionary.Find("a"), std::nullopt);
+}
+
+TEST(ValueDictionaryTest, RetainedValuesOutliveTheirFirstReference) {
+  ValueDictionary dictionary;
+  std::vector<uint32_t> ids = dictionary.Intern({"a"});
+  dictionary.Retain(ids);
+  dictionary.Release(ids);
+  EXPECT_THAT(dictionary.GetValues(ids), ElementsAre("a"));
+  dictionary.Release(ids);
+  EXPECT_EQ(dictionary.size(), 0);
+}
+
+TEST(ValueDictionaryTest, ReleasedIdsAreReused) {
+  ValueDictionary dictionary;
+  std::vector<uint32_t> ids = dictionary.Intern({"a", "b"});
+  dictionary.Release({ids[0]});
+  // IDs are only reused by values of the same shard, so values are interned
+  // until one of them lands in the shard of "a".
+  std::string value;
+  for (int i = 0; i < 10000; ++i) {
+    value = absl::StrCat("c", i);
+    if (dictionary.Intern({value}) == std::vector<uint32_t>{ids[0]}) {
+      break;
+    }
+  }
+  EXPECT_THAT(dictionary.GetValues({ids[0], ids[1]}), ElementsAre(value, "b"));
+}
+
+TEST(ValueDictionaryTest, ValuesKeepTheirIdsAcrossShards) {
+  ValueDictionary dictionary;
+  std::vector<std::string> values;
+  for (int i = 0; i < 1000; ++i) {
+    values.push_back(absl::StrCat("value", i));
+  }
+  std::vector<std::string_view> views(values.begin(), values.end());
+  std::vector<uint32_t> ids = dictionary.Intern(views);
+  EXPECT_THAT(dictionary.GetValues(ids), ElementsAreArray(views));
+  EXPECT_EQ(absl::flat_hash_set<uint32_t>(ids.begin(), ids.end()).size(),
+            values.size());
+  for (size_t i = 0; i < values.size(); ++i) {
+    EXPECT_EQ(dictionary.Find(values[i]), ids[i]);
+  }
+  EXPECT_EQ(dictionary.size(), values.size());
+}
+
+TEST(ValueDictionaryTest, ConcurrentInternAndRelease) {
+  ValueDictionary dictionary;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([&dictionary]() {
+      for (int i = 0; i < 1000; ++i) {
+        const std::string value = absl::StrCat("value", i % 100);
+        std::vector<uint32_t> ids = dictionary.Intern({value, "shared"});
+        EXPECT_THAT(dictionary.GetValues(ids), ElementsAre(value, "shared"));
+        dictionary.Release(ids);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(dictionary.size(), 0);
+  EXPECT_EQ(dictionary.bytes(), 0);
+}
+
+TEST(ValueDictionaryTest, BytesCountsInternedValues) {
+  ValueDictionary dictionary;
+  std::vector<uint32_t> ids = dictionary.Intern({"ab", "cde", "ab"});
+  EXPECT_EQ(dictionary.bytes(), 5);
+  dictionary.Release({ids[0], ids[1]});
+  EXPECT_EQ(dictionary.bytes(), 2);
+  dictionary.Release({ids[2]});
+  EXPECT_EQ(dictionary.bytes(), 0);
+}
+
+}  // namespace
+}  // namespace kv_server
@@ -0,0 +1,48 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "components/data_server/cache/value_proto.h"
+
+#include <string_view>
+
+#include "google/protobuf/util/json_util.h"
+#include "nlohmann/json.hpp"
+#include "src/google/protobuf/struct.pb.h"
+
+namespace kv_server {
+
+using google::protobuf::Value;
+
+bool IsJsonValue(std::string_view value) {
+  return nlohmann::json::accept(value);
+}
+
+Value ToValueProto(std::string_view value, bool is_json) {
+  Value value_proto;
+  if (is_json && google::protobuf::util::JsonStringToMessage(
+                     {value.data(), value.size()}, &value_proto)
+                     .ok()) {
+    return value_proto;
+  }
+  // Documents that the validator accepts but protobuf doesn't are returned
+  // as they are too.
+  value_proto.set_string_value(value.data(), value.size());
+  return value_proto;
+}
+
+Value ToValueProto(std::string_view value) {
+  return ToValueProto(value, /*is_json=*/true);
+}
+
+}  // namespace kv_server
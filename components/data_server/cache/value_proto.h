@@ -0,0 +1,43 @@
+/*
+ * Copyright 2023 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef COMPONENTS_DATA_SERVER_CACHE_VALUE_PROTO_H_
+#define COMPONENTS_DATA_SERVER_CACHE_VALUE_PROTO_H_
+
+#include <string_view>
+
+#include "src/google/protobuf/struct.pb.h"
+
+namespace kv_server {
+
+// Cached values are returned in V1 responses as google.protobuf.Value
+// messages: values that are JSON documents as the JSON value they hold, and
+// other values as strings.
+
+// Whether `value` is a JSON document. Cheap enough to check once when a value
+// is loaded, as it doesn't build the document.
+bool IsJsonValue(std::string_view value);
+
+// Returns the Value that `value` stands for in a V1 response, given whether
+// it's a JSON document, see `IsJsonValue`. Other values aren't parsed.
+google::protobuf::Value ToValueProto(std::string_view value, bool is_json);
+
+// Like the above, for a value that isn't known to be a JSON document or not.
+google::protobuf::Value ToValueProto(std::string_view value);
+
+}  // namespace kv_server
+
+#endif  // COMPONENTS_DATA_SERVER_CACHE_VALUE_PROTO_H_
@@ -0,0 +1,61 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "components/data_server/cache/value_proto.h"
+
+#include "gtest/gtest.h"
+#include "src/google/protobuf/struct.pb.h"
+
+namespace kv_server {
+namespace {
+
+using google::protobuf::Value;
+
+TEST(ValueProtoTest, DetectsJsonValues) {
+  EXPECT_TRUE(IsJsonValue(R"({"a":[1,"b"],"c":true})"));
+  EXPECT_TRUE(IsJsonValue("3"));
+  EXPECT_TRUE(IsJsonValue(R"("quoted")"));
+  EXPECT_FALSE(IsJsonValue("not json"));
+  EXPECT_FALSE(IsJsonValue(R"({"a":)"));
+  EXPECT_FALSE(IsJsonValue(""));
+}
+
+TEST(ValueProtoTest, ConvertsJsonObject) {
+  const Value value = ToValueProto(R"({"a":[1,"b"],"c":true})");
+  ASSERT_TRUE(value.has_struct_value());
+  const auto& fields = value.struct_value().fields();
+  ASSERT_EQ(fields.at("a").list_value().values_size(), 2);
+  EXPECT_EQ(fields.at("a").list_value().values(0).number_value(), 1);
+  EXPECT_EQ(fields.at("a").list_value().values(1).string_value(), "b");
+  EXPECT_TRUE(fields.at("c").bool_value());
+}
+
+TEST(ValueProtoTest, ConvertsJsonScalars) {
+  EXPECT_EQ(ToValueProto("3").number_value(), 3);
+  EXPECT_EQ(ToValueProto(R"("quoted")").string_value(), "quoted");
+}
+
+TEST(ValueProtoTest, ConvertsOtherValuesToStrings) {
+  EXPECT_EQ(ToValueProto("not json").string_value(), "not json");
+  EXPECT_EQ(ToValueProto("").string_value(), "");
+  EXPECT_EQ(ToValueProto("not json", /*is_json=*/true).string_value(),
+            "not json");
+}
+
+TEST(ValueProtoTest, DoesntParseValuesThatArentJson) {
+  EXPECT_EQ(ToValueProto("3", /*is_json=*/false).string_value(), "3");
+}
+
+}  // namespace
+}  // namespace kv_server
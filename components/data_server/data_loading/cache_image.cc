@@ -0,0 +1,156 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "components/data_server/data_loading/cache_image.h"
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "glog/logging.h"
+#include "public/data_loading/data_loading_generated.h"
+#include "public/data_loading/readers/riegeli_stream_io.h"
+#include "public/data_loading/writers/delta_record_stream_writer.h"
+
+namespace kv_server {
+namespace {
+
+constexpr std::string_view kTempFileSuffix = ".tmp";
+
+KeyValueMutationRecordStruct ToRecord(const Mutation& mutation) {
+  KeyValueMutationRecordStruct record{
+      .logical_commit_time = mutation.logical_commit_time,
+      .key = mutation.key};
+  switch (mutation.type) {
+    case Mutation::Type::kUpdateKeyValue:
+      record.mutation_type = KeyValueMutationType::Update;
+      record.value = mutation.value;
+      break;
+    case Mutation::Type::kDeleteKey:
+      record.mutation_type = KeyValueMutationType::Delete;
+      record.value = std::string_view();
+      break;
+    case Mutation::Type::kUpdateKeyValueSet:
+      record.mutation_type = KeyValueMutationType::Update;
+      record.value = mutation.value_set;
+      break;
+    case Mutation::Type::kDeleteValuesInSet:
+      record.mutation_type = KeyValueMutationType::Delete;
+      record.value = mutation.value_set;
+      break;
+  }
+  return record;
+}
+
+// Writes the image to the open `stream`.
+absl::Status WriteRecords(
+    const Cache& cache, const KVFileMetadata& metadata,
+    const std::vector<UserDefinedFunctionsConfigStruct>& udf_configs,
+    std::ofstream& stream) {
+  auto writer = DeltaRecordStreamWriter<std::ofstream>::Create(
+      stream, {.enable_compression = true, .metadata = metadata});
+  if (!writer.ok()) {
+    return writer.status();
+  }
+  absl::Status status;
+  cache.ExportMutations([&writer, &status](const Mutation& mutation) {
+    if (status.ok()) {
+      status = (*writer)->WriteRecord({.record = ToRecord(mutation)});
+    }
+  });
+  for (const auto& udf_config : udf_configs) {
+    if (!status.ok()) {
+      break;
+    }
+    status = (*writer)->WriteRecord({.record = udf_config});
+  }
+  (*writer)->Close();
+  status.Update((*writer)->Status());
+  return status;
+}
+
+}  // namespace
+
+absl::Status WriteCacheImage(
+    const Cache& cache, const KVFileMetadata& metadata,
+    const std::vector<UserDefinedFunctionsConfigStruct>& udf_configs,
+    const std::string& path) {
+  const std::string temp_path = absl::StrCat(path, kTempFileSuffix);
+  std::ofstream stream(temp_path, std::ios::binary | std::ios::trunc);
+  if (!stream.is_open()) {
+    return absl::InternalError(
+        absl::StrCat("Failed to open cache image file: ", temp_path));
+  }
+  absl::Status status = WriteRecords(cache, metadata, udf_configs, stream);
+  stream.close();
+  if (status.ok() && stream.fail()) {
+    status = absl::InternalError(
+        absl::StrCat("Failed to write cache image file: ", temp_path));
+  }
+  std::error_code error;
+  if (status.ok()) {
+    std::filesystem::rename(temp_path, path, error);
+    if (!error) {
+      return absl::OkStatus();
+    }
+    status = absl::InternalError(absl::StrCat(
+        "Failed to replace cache image ", path, ": ", error.message()));
+  }
+  std::filesystem::remove(temp_path, error);
+  return status;
+}
+
+absl::StatusOr<KVFileMetadata> ValidateCacheImage(const std::string& path) {
+  std::ifstream stream(path, std::ios::binary);
+  if (!stream.is_open()) {
+    return absl::NotFoundError(
+        absl::StrCat("Failed to open cache image file: ", path));
+  }
+  // Corrupted regions fail the read instead of being skipped.
+  RiegeliStreamReader<std::string_view> reader(
+      stream, [](const riegeli::SkippedRegion& skipped_region) {
+        LOG(ERROR) << "Corrupted region in cache image: " << skipped_region;
+        return false;
+      });
+  auto metadata = reader.GetKVFileMetadata();
+  if (!metadata.ok()) {
+    return metadata.status();
+  }
+  if (!metadata->has_snapshot()) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Cache image ", path, " has no snapshot metadata."));
+  }
+  absl::Status record_status;
+  if (const auto status = reader.ReadStreamRecords(
+          [&record_status](std::string_view raw) {
+            if (record_status.ok()) {
+              record_status = DeserializeDataRecord(
+                  raw, [](const DataRecord&) { return absl::OkStatus(); });
+            }
+            return absl::OkStatus();
+          });
+      !status.ok()) {
+    return status;
+  }
+  if (!record_status.ok()) {
+    return record_status;
+  }
+  return metadata;
+}
+
+}  // namespace kv_server
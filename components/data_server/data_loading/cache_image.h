@@ -0,0 +1,52 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef COMPONENTS_DATA_SERVER_DATA_LOADING_CACHE_IMAGE_H_
+#define COMPONENTS_DATA_SERVER_DATA_LOADING_CACHE_IMAGE_H_
+
+#include <string>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "components/data_server/cache/cache.h"
+#include "public/data_loading/records_utils.h"
+#include "public/data_loading/riegeli_metadata.pb.h"
+
+namespace kv_server {
+
+// A cache image is a file on local disk that holds the contents of a cache,
+// so that a restarted server can load it instead of the snapshot and deltas
+// the cache was loaded from. Images are written in the format of snapshot
+// files. The snapshot's ending delta file is the last delta file whose
+// records are all in the cache, so only the deltas after it need to be
+// loaded on top of the image. Unlike snapshots, images also hold the deleted
+// keys and set values that the cache keeps until they're cleaned up.
+
+// Writes the contents of `cache`, followed by `udf_configs`, to an image at
+// `path` with `metadata`. The image is written to a temporary file next to
+// `path` which then replaces it, so a failed write keeps the previous image.
+absl::Status WriteCacheImage(
+    const Cache& cache, const KVFileMetadata& metadata,
+    const std::vector<UserDefinedFunctionsConfigStruct>& udf_configs,
+    const std::string& path);
+
+// Reads the whole image at `path` and returns its metadata. Fails if the
+// image is truncated, a checksum or record doesn't match, or it has no
+// snapshot metadata.
+absl::StatusOr<KVFileMetadata> ValidateCacheImage(const std::string& path);
+
+}  // namespace kv_server
+
+#endif  // COMPONENTS_DATA_SERVER_DATA_LOADING_CACHE_IMAGE_H_
@@ -0,0 +1,136 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "components/data_server/data_loading/cache_image.h"
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "components/data_server/cache/key_value_cache.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "public/data_loading/readers/delta_record_stream_reader.h"
+#include "src/cpp/telemetry/metrics_recorder.h"
+#include "src/cpp/telemetry/telemetry_provider.h"
+
+namespace kv_server {
+namespace {
+
+using privacy_sandbox::server_common::TelemetryProvider;
+using testing::UnorderedElementsAre;
+
+std::string ImagePath(std::string_view name) {
+  return absl::StrCat(::testing::TempDir(), "/", name);
+}
+
+KVFileMetadata ImageMetadata(std::string_view ending_delta_file) {
+  KVFileMetadata metadata;
+  metadata.mutable_snapshot()->set_ending_delta_file(ending_delta_file);
+  metadata.mutable_sharding_metadata()->set_shard_num(1);
+  return metadata;
+}
+
+TEST(CacheImageTest, WritesCacheContentsAndUdfConfigs) {
+  auto noop_metrics_recorder =
+      TelemetryProvider::GetInstance().CreateMetricsRecorder();
+  auto cache = KeyValueCache::Create(*noop_metrics_recorder);
+  cache->UpdateKeyValue("key1", "value1", 1);
+  cache->UpdateKeyValue("key2", "value2", 1);
+  cache->DeleteKey("key2", 2);
+  std::vector<std::string_view> values = {"v1", "v2"};
+  cache->UpdateKeyValueSet("set1", absl::MakeSpan(values), 3);
+  const UserDefinedFunctionsConfigStruct udf_config{
+      .language = UserDefinedFunctionsLanguage::Javascript,
+      .code_snippet = "function hello() {}",
+      .handler_name = "hello",
+      .logical_commit_time = 4,
+      .version = 1};
+  const std::string path = ImagePath("writes_cache_contents");
+  ASSERT_TRUE(WriteCacheImage(*cache, ImageMetadata("DELTA_1"), {udf_config},
+                              path)
+                  .ok());
+  EXPECT_FALSE(std::filesystem::exists(absl::StrCat(path, ".tmp")));
+
+  auto metadata = ValidateCacheImage(path);
+  ASSERT_TRUE(metadata.ok()) << metadata.status();
+  EXPECT_EQ(metadata->snapshot().ending_delta_file(), "DELTA_1");
+  EXPECT_EQ(metadata->sharding_metadata().shard_num(), 1);
+
+  std::ifstream stream(path, std::ios::binary);
+  DeltaRecordStreamReader record_reader(stream);
+  std::vector<DataRecordStruct> records;
+  ASSERT_TRUE(record_reader
+                  .ReadRecords([&records](DataRecordStruct record) {
+                    records.push_back(record);
+                    return absl::OkStatus();
+                  })
+                  .ok());
+  std::vector<std::string_view> value_set = {"v1", "v2"};
+  const KeyValueMutationRecordStruct pair_record{
+      .mutation_type = KeyValueMutationType::Update,
+      .logical_commit_time = 1,
+      .key = "key1",
+      .value = "value1"};
+  const KeyValueMutationRecordStruct deleted_record{
+      .mutation_type = KeyValueMutationType::Delete,
+      .logical_commit_time = 2,
+      .key = "key2",
+      .value = ""};
+  const KeyValueMutationRecordStruct set_record{
+      .mutation_type = KeyValueMutationType::Update,
+      .logical_commit_time = 3,
+      .key = "set1",
+      .value = value_set};
+  EXPECT_THAT(records,
+              UnorderedElementsAre(DataRecordStruct{.record = pair_record},
+                                   DataRecordStruct{.record = deleted_record},
+                                   DataRecordStruct{.record = set_record},
+                                   DataRecordStruct{.record = udf_config}));
+}
+
+TEST(CacheImageTest, RejectsTruncatedImage) {
+  auto noop_metrics_recorder =
+      TelemetryProvider::GetInstance().CreateMetricsRecorder();
+  auto cache = KeyValueCache::Create(*noop_metrics_recorder);
+  for (int i = 0; i < 1000; ++i) {
+    cache->UpdateKeyValue(absl::StrCat("key", i), absl::StrCat("value", i), 1);
+  }
+  const std::string path = ImagePath("truncated");
+  ASSERT_TRUE(
+      WriteCacheImage(*cache, ImageMetadata("DELTA_1"), {}, path).ok());
+  std::filesystem::resize_file(path, std::filesystem::file_size(path) / 2);
+  EXPECT_FALSE(ValidateCacheImage(path).ok());
+}
+
+TEST(CacheImageTest, RejectsMissingImage) {
+  EXPECT_EQ(ValidateCacheImage(ImagePath("missing")).status().code(),
+            absl::StatusCode::kNotFound);
+}
+
+TEST(CacheImageTest, RejectsImageWithoutSnapshotMetadata) {
+  auto noop_metrics_recorder =
+      TelemetryProvider::GetInstance().CreateMetricsRecorder();
+  auto cache = KeyValueCache::Create(*noop_metrics_recorder);
+  const std::string path = ImagePath("no_snapshot_metadata");
+  ASSERT_TRUE(WriteCacheImage(*cache, KVFileMetadata(), {}, path).ok());
+  EXPECT_EQ(ValidateCacheImage(path).status().code(),
+            absl::StatusCode::kInvalidArgument);
+}
+
+}  // namespace
+}  // namespace kv_server
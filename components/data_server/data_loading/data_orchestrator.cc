@@ -15,14 +15,29 @@
 #include "components/data_server/data_loading/data_orchestrator.h"
 
 #include <algorithm>
+#include <atomic>
 #include <deque>
+#include <fstream>
+#include <memory>
+#include <optional>
+#include <string>
 #include <utility>
 #include <vector>
 
+#include "absl/container/flat_hash_set.h"
 #include "absl/functional/bind_front.h"
 #include "absl/strings/str_cat.h"
+#include "absl/strings/str_join.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "components/data_server/data_loading/cache_image.h"
+#include "components/data_server/data_loading/mutation_applier.h"
 #include "components/errors/retry.h"
+#include "components/util/periodic_closure.h"
 #include "glog/logging.h"
+#include "public/base_types.pb.h"
 #include "public/constants.h"
 #include "public/data_loading/data_loading_generated.h"
 #include "public/data_loading/filename_utils.h"
@@ -34,10 +49,59 @@ namespace kv_server {
 namespace {
 
 using privacy_sandbox::server_common::MetricsRecorder;
+using privacy_sandbox::server_common::ScopeLatencyRecorder;
 using privacy_sandbox::server_common::TraceWithStatusOr;
 
 constexpr char kTotalRowsDroppedIncorrectShardNumber[] =
     "kTotalRowsDroppedIncorrectShardNumber";
+constexpr char kCacheMemoryBudgetExceeded[] = "CacheMemoryBudgetExceeded";
+constexpr char kCacheMemoryBudgetPaused[] = "CacheMemoryBudgetPaused";
+constexpr char kCacheMemoryBudgetPauseEvent[] = "CacheMemoryBudgetPause";
+constexpr char kCacheKeyBytes[] = "CacheKeyBytes";
+constexpr char kCacheValueBytes[] = "CacheValueBytes";
+constexpr char kCacheSetMemberBytes[] = "CacheSetMemberBytes";
+constexpr char kCacheInternedValueBytes[] = "CacheInternedValueBytes";
+constexpr char kCacheTombstoneBytes[] = "CacheTombstoneBytes";
+constexpr char kCacheDecompressedValueBytes[] = "CacheDecompressedValueBytes";
+constexpr char kWriteCacheImageEvent[] = "WriteCacheImage";
+constexpr char kDecodeBatchEvent[] = "DataLoadingDecodeBatch";
+constexpr char kDecodeThroughput[] = "DataLoadingDecodeThroughput";
+constexpr char kApplyThroughput[] = "DataLoadingApplyThroughput";
+constexpr char kLoadDeltaFileEvent[] = "DataLoadingLoadDeltaFile";
+
+// Histograms of the bytes held by each partition of a cache partitioned by
+// key namespace, see `Cache::GetPartition`.
+struct PartitionBytesHistogram {
+  KeyNamespace::Enum key_namespace;
+  const char* event;
+};
+constexpr PartitionBytesHistogram kCachePartitionBytes[] = {
+    {KeyNamespace::KEY_NAMESPACE_UNSPECIFIED, "CacheDefaultPartitionBytes"},
+    {KeyNamespace::KV_INTERNAL, "CacheKvInternalPartitionBytes"},
+    {KeyNamespace::KEYS, "CacheKeysPartitionBytes"},
+    {KeyNamespace::RENDER_URLS, "CacheRenderUrlsPartitionBytes"},
+    {KeyNamespace::AD_COMPONENT_RENDER_URLS,
+     "CacheAdComponentRenderUrlsPartitionBytes"},
+};
+
+const std::vector<double> kCacheBytesBucketBoundaries = {
+    1 << 20, 1 << 24, 1 << 28, 1LL << 30, 1LL << 32, 1LL << 34, 1LL << 36,
+};
+
+// Records per second spent in a loading stage, summed over its threads.
+const std::vector<double> kThroughputBucketBoundaries = {
+    1 << 10, 1 << 13, 1 << 16, 1 << 19, 1 << 22, 1 << 25,
+};
+
+constexpr char kMemoryBudgetExceededError[] =
+    "Cache memory budget exceeded while loading data.";
+// Records loaded between two checks of the cache memory budget.
+constexpr int64_t kRecordsPerMemoryBudgetCheck = 1024;
+// Bounds of the backoff between checks of the budget while a load is paused.
+constexpr absl::Duration kMinMemoryBudgetBackoff = absl::Milliseconds(100);
+constexpr absl::Duration kMaxMemoryBudgetBackoff = absl::Seconds(10);
+// Records read from a file and applied to the cache at once.
+constexpr int64_t kRecordsPerBatch = 1024;
 
 // Holds an input stream pointing to a blob of Riegeli records.
 class BlobRecordStream : public RecordStream {
@@ -50,36 +114,199 @@ class BlobRecordStream : public RecordStream {
   std::unique_ptr<BlobReader> blob_reader_;
 };
 
-absl::Status ApplyUpdateMutation(const KeyValueMutationRecord& record,
-                                 Cache& cache) {
-  if (record.value_type() == Value::String) {
-    cache.UpdateKeyValue(record.key()->string_view(),
-                         GetRecordValue<std::string_view>(record),
-                         record.logical_commit_time());
+// Holds an input stream pointing to a local file of Riegeli records.
+class FileRecordStream : public RecordStream {
+ public:
+  explicit FileRecordStream(const std::string& path)
+      : stream_(path, std::ios::binary) {}
+  std::istream& Stream() { return stream_; }
+
+ private:
+  std::ifstream stream_;
+};
+
+// UDF code config most recently set on the UDF client. The cache doesn't
+// hold it, so it's kept here to be written to cache images: a server that
+// loads an image skips the snapshot the config came from.
+class LatestCodeConfig {
+ public:
+  void Update(const CodeConfig& code_config) {
+    absl::MutexLock lock(&mutex_);
+    if (!code_config_.has_value() ||
+        code_config_->logical_commit_time < code_config.logical_commit_time) {
+      code_config_ = code_config;
+    }
+  }
+
+  std::optional<CodeConfig> Get() const {
+    absl::MutexLock lock(&mutex_);
+    return code_config_;
+  }
+
+ private:
+  mutable absl::Mutex mutex_;
+  std::optional<CodeConfig> code_config_ ABSL_GUARDED_BY(mutex_);
+};
+
+void RegisterCacheMemoryHistograms(MetricsRecorder& metrics_recorder) {
+  metrics_recorder.RegisterHistogram(kCacheKeyBytes, "Bytes of cache keys",
+                                     "byte", kCacheBytesBucketBoundaries);
+  metrics_recorder.RegisterHistogram(kCacheValueBytes, "Bytes of cache values",
+                                     "byte", kCacheBytesBucketBoundaries);
+  metrics_recorder.RegisterHistogram(kCacheSetMemberBytes,
+                                     "Bytes of cache key-value set members",
+                                     "byte", kCacheBytesBucketBoundaries);
+  metrics_recorder.RegisterHistogram(kCacheInternedValueBytes,
+                                     "Bytes of interned cache set values",
+                                     "byte", kCacheBytesBucketBoundaries);
+  metrics_recorder.RegisterHistogram(
+      kCacheTombstoneBytes, "Bytes of deleted cache entries not cleaned up yet",
+      "byte", kCacheBytesBucketBoundaries);
+  metrics_recorder.RegisterHistogram(
+      kCacheDecompressedValueBytes,
+      "Bytes of compressed cache values kept decompressed", "byte",
+      kCacheBytesBucketBoundaries);
+  for (const auto& [key_namespace, event] : kCachePartitionBytes) {
+    metrics_recorder.RegisterHistogram(
+        event,
+        absl::StrCat("Bytes of the ", KeyNamespace::Enum_Name(key_namespace),
+                     " cache partition"),
+        "byte", kCacheBytesBucketBoundaries);
+  }
+}
+
+void RegisterDataLoadingHistograms(MetricsRecorder& metrics_recorder) {
+  metrics_recorder.RegisterHistogram(
+      kDecodeThroughput, "Records decoded per second of decoding, per file",
+      "record/s", kThroughputBucketBoundaries);
+  metrics_recorder.RegisterHistogram(
+      kApplyThroughput, "Records applied per second of applying, per file",
+      "record/s", kThroughputBucketBoundaries);
+  MutationApplier::RegisterMetrics(metrics_recorder);
+}
+
+// Records the throughput of a loading stage that handled `num_records` in
+// `busy_time`. Comparing the stages shows which one bounds the load.
+void RecordStageThroughput(const char* event, int64_t num_records,
+                           absl::Duration busy_time,
+                           MetricsRecorder& metrics_recorder) {
+  if (num_records == 0 || busy_time <= absl::ZeroDuration()) {
+    return;
+  }
+  metrics_recorder.RecordHistogramEvent(
+      event, num_records / absl::ToDoubleSeconds(busy_time));
+}
+
+void RecordCacheMemoryUsage(const Cache& cache,
+                            MetricsRecorder& metrics_recorder) {
+  const CacheMemoryUsage usage = cache.GetMemoryUsage();
+  metrics_recorder.RecordHistogramEvent(kCacheKeyBytes, usage.key_bytes);
+  metrics_recorder.RecordHistogramEvent(kCacheValueBytes, usage.value_bytes);
+  metrics_recorder.RecordHistogramEvent(kCacheSetMemberBytes,
+                                        usage.set_member_bytes);
+  metrics_recorder.RecordHistogramEvent(kCacheInternedValueBytes,
+                                        usage.interned_value_bytes);
+  metrics_recorder.RecordHistogramEvent(kCacheTombstoneBytes,
+                                        usage.tombstone_bytes);
+  metrics_recorder.RecordHistogramEvent(kCacheDecompressedValueBytes,
+                                        usage.decompressed_value_bytes);
+  for (const auto& [key_namespace, event] : kCachePartitionBytes) {
+    if (const Cache& partition = cache.GetPartition(key_namespace);
+        &partition != &cache) {
+      metrics_recorder.RecordHistogramEvent(
+          event, partition.GetMemoryUsage().total_bytes());
+    }
+  }
+}
+
+// Returns the bytes held by `cache`, and by `replaced_cache` if not null.
+// While a fresh instance of a swappable cache is loaded, the instance it
+// replaces is held too, so both count against the memory budget.
+int64_t TotalBytes(const Cache& cache, const Cache* replaced_cache) {
+  int64_t total_bytes = cache.GetMemoryUsage().total_bytes();
+  if (replaced_cache != nullptr) {
+    total_bytes += replaced_cache->GetMemoryUsage().total_bytes();
+  }
+  return total_bytes;
+}
+
+// Returns ResourceExhausted if the cache holds `memory_budget_bytes` or more,
+// with `replaced_cache` if not null. A non-positive budget is unlimited.
+absl::Status CheckMemoryBudget(const Cache& cache, const Cache* replaced_cache,
+                               int64_t memory_budget_bytes,
+                               MetricsRecorder& metrics_recorder) {
+  if (memory_budget_bytes <= 0) {
     return absl::OkStatus();
   }
-  if (record.value_type() == Value::StringSet) {
-    auto values = GetRecordValue<std::vector<std::string_view>>(record);
-    cache.UpdateKeyValueSet(record.key()->string_view(), absl::MakeSpan(values),
-                            record.logical_commit_time());
+  const int64_t total_bytes = TotalBytes(cache, replaced_cache);
+  if (total_bytes < memory_budget_bytes) {
     return absl::OkStatus();
   }
-  return absl::InvalidArgumentError(
-      absl::StrCat("Record with key: ", record.key()->string_view(),
-                   " has unsupported value type: ", record.value_type()));
+  metrics_recorder.IncrementEventCounter(kCacheMemoryBudgetExceeded);
+  return absl::ResourceExhaustedError(
+      absl::StrCat("Cache holds ", total_bytes,
+                   " bytes, which exceeds its memory budget of ",
+                   memory_budget_bytes, " bytes."));
 }
 
-absl::Status ApplyDeleteMutation(const KeyValueMutationRecord& record,
-                                 Cache& cache) {
-  if (record.value_type() == Value::String) {
-    cache.DeleteKey(record.key()->string_view(), record.logical_commit_time());
+// Returns once `cache`, with `replaced_cache` if not null, holds less than
+// `memory_budget_bytes`, checking with backoff for up to `max_pause`, or
+// ResourceExhausted if it still doesn't by then. Pauses are counted apart
+// from loads rejected before they start.
+absl::Status WaitForMemoryBudget(const Cache& cache,
+                                 const Cache* replaced_cache,
+                                 int64_t memory_budget_bytes,
+                                 absl::Duration max_pause,
+                                 MetricsRecorder& metrics_recorder) {
+  if (TotalBytes(cache, replaced_cache) < memory_budget_bytes) {
     return absl::OkStatus();
   }
+  LOG(WARNING) << "Pausing data load: cache is over its memory budget of "
+               << memory_budget_bytes << " bytes";
+  metrics_recorder.IncrementEventCounter(kCacheMemoryBudgetPaused);
+  ScopeLatencyRecorder latency_recorder(kCacheMemoryBudgetPauseEvent,
+                                        metrics_recorder);
+  const absl::Time deadline = absl::Now() + max_pause;
+  absl::Duration backoff = kMinMemoryBudgetBackoff;
+  for (absl::Time now = absl::Now(); now < deadline; now = absl::Now()) {
+    absl::SleepFor(std::min(backoff, deadline - now));
+    backoff = std::min(backoff * 2, kMaxMemoryBudgetBackoff);
+    if (TotalBytes(cache, replaced_cache) < memory_budget_bytes) {
+      LOG(INFO) << "Resuming data load after "
+                << latency_recorder.GetLatency();
+      return absl::OkStatus();
+    }
+  }
+  return CheckMemoryBudget(cache, replaced_cache, memory_budget_bytes,
+                           metrics_recorder);
+}
+
+// Converts `record` to a cache mutation. The mutation refers to the bytes of
+// `record`, so it must not outlive it.
+absl::StatusOr<Mutation> ToCacheMutation(const KeyValueMutationRecord& record) {
+  Mutation mutation{.key = record.key()->string_view(),
+                    .logical_commit_time = record.logical_commit_time()};
+  const bool is_update =
+      record.mutation_type() == KeyValueMutationType::Update;
+  if (!is_update && record.mutation_type() != KeyValueMutationType::Delete) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Invalid mutation type: ",
+                     EnumNameKeyValueMutationType(record.mutation_type())));
+  }
+  if (record.value_type() == Value::String) {
+    if (is_update) {
+      mutation.type = Mutation::Type::kUpdateKeyValue;
+      mutation.value = GetRecordValue<std::string_view>(record);
+    } else {
+      mutation.type = Mutation::Type::kDeleteKey;
+    }
+    return mutation;
+  }
   if (record.value_type() == Value::StringSet) {
-    auto values = GetRecordValue<std::vector<std::string_view>>(record);
-    cache.DeleteValuesInSet(record.key()->string_view(), absl::MakeSpan(values),
-                            record.logical_commit_time());
-    return absl::OkStatus();
+    mutation.type = is_update ? Mutation::Type::kUpdateKeyValueSet
+                              : Mutation::Type::kDeleteValuesInSet;
+    mutation.value_set = GetRecordValue<std::vector<std::string_view>>(record);
+    return mutation;
   }
   return absl::InvalidArgumentError(
       absl::StrCat("Record with key: ", record.key()->string_view(),
@@ -88,13 +315,18 @@ absl::Status ApplyDeleteMutation(const KeyValueMutationRecord& record,
 
 bool ShouldProcessRecord(const KeyValueMutationRecord& record,
                          int64_t num_shards, int64_t server_shard_num,
+                         const LogicalShardMapping* logical_shard_mapping,
+                         const ShardingFunction& sharding_function,
                          MetricsRecorder& metrics_recorder) {
   if (num_shards <= 1) {
     return true;
   }
   auto shard_num =
-      ShardingFunction(/*seed=*/"")
-          .GetShardNumForKey(record.key()->string_view(), num_shards);
+      logical_shard_mapping == nullptr
+          ? sharding_function.GetShardNumForKey(record.key()->string_view(),
+                                                num_shards)
+          : logical_shard_mapping->GetPhysicalShardForKey(
+                sharding_function, record.key()->string_view());
   if (shard_num == server_shard_num) {
     return true;
   }
@@ -106,102 +338,267 @@ bool ShouldProcessRecord(const KeyValueMutationRecord& record,
   return false;
 }
 
-absl::Status ApplyKeyValueMutationToCache(
-    const KeyValueMutationRecord& record, Cache& cache, int64_t& max_timestamp,
-    DataLoadingStats& data_loading_stats) {
-  switch (record.mutation_type()) {
-    case KeyValueMutationType::Update: {
-      if (auto status = ApplyUpdateMutation(record, cache); !status.ok()) {
-        return status;
-      }
-      max_timestamp = std::max(max_timestamp, record.logical_commit_time());
-      data_loading_stats.total_updated_records++;
-      break;
-    }
-    case KeyValueMutationType::Delete: {
-      if (auto status = ApplyDeleteMutation(record, cache); !status.ok()) {
-        return status;
-      }
-      max_timestamp = std::max(max_timestamp, record.logical_commit_time());
-      data_loading_stats.total_deleted_records++;
-      break;
-    }
-    default:
-      return absl::InvalidArgumentError(
-          absl::StrCat("Invalid mutation type: ",
-                       EnumNameKeyValueMutationType(record.mutation_type())));
+// Whether a file with `metadata` holds records of the server's shard. Files
+// without sharding metadata hold records of all the shards. With a logical
+// shard mapping, the shard of a file is a logical shard.
+bool IsFileOfServerShard(const KVFileMetadata& metadata,
+                         const DataOrchestrator::Options& options) {
+  if (!metadata.has_sharding_metadata()) {
+    return true;
   }
-  return absl::OkStatus();
+  const int64_t shard_num = metadata.sharding_metadata().shard_num();
+  const LogicalShardMapping* mapping = options.logical_shard_mapping;
+  if (mapping == nullptr) {
+    return shard_num == options.shard_num;
+  }
+  return shard_num >= 0 && shard_num < mapping->num_logical_shards() &&
+         mapping->GetPhysicalShard(shard_num) == options.shard_num;
 }
 
+// Returns FailedPrecondition if the keys of a sharded file with `metadata`
+// were assigned to their shard by another function than the server's.
+absl::Status CheckShardingFunctionVersion(
+    const KVFileMetadata& metadata, const DataOrchestrator::Options& options) {
+  if (options.num_shards <= 1 || !metadata.has_sharding_metadata()) {
+    return absl::OkStatus();
+  }
+  const ShardingFunctionVersion::Enum file_version =
+      ResolveShardingFunctionVersion(
+          metadata.sharding_metadata().sharding_function_version());
+  const ShardingFunctionVersion::Enum server_version =
+      ResolveShardingFunctionVersion(options.sharding_function_version);
+  if (file_version == server_version) {
+    return absl::OkStatus();
+  }
+  return absl::FailedPreconditionError(absl::StrCat(
+      "File is sharded with ", ShardingFunctionVersion::Enum_Name(file_version),
+      " but the server shards with ",
+      ShardingFunctionVersion::Enum_Name(server_version)));
+}
+
+// Records are read in batches, and the key-value mutations of each batch are
+// applied to the cache with one `Cache::ApplyBatch` call, so that the cache
+// takes its locks and records its metrics once per batch rather than once per
+// record. Pauses once the cache, with `replaced_cache` if not null, exceeds
+// `memory_budget_bytes`, until it holds less, and only stops applying
+// mutations, and then returns ResourceExhausted, if that takes longer than
+// `memory_budget_max_pause`.
+// Batches may be read concurrently, so the budget is only checked every
+// `kRecordsPerMemoryBudgetCheck` records in total, and a pause holds back
+// all the reading threads. The mutations go to the partition of
+// `key_namespace`, while the budget applies to the whole cache.
+//
+// Unless `apply_on_calling_thread`, the reading threads only decode the
+// records, and the mutations are applied by the workers of `applier`, if it
+// has any. The records of a batch are then copied, as the reader reuses its
+// buffers, and the budget is checked against a cache that may lag behind by
+// the batches queued.
 absl::StatusOr<DataLoadingStats> LoadCacheWithData(
     StreamRecordReader<std::string_view>& record_reader, Cache& cache,
-    int64_t& max_timestamp, const int32_t server_shard_num,
-    const int32_t num_shards, MetricsRecorder& metrics_recorder,
-    UdfClient& udf_client) {
+    KeyNamespace::Enum key_namespace, int64_t& max_timestamp,
+    const int32_t server_shard_num, const int32_t num_shards,
+    const LogicalShardMapping* logical_shard_mapping,
+    ShardingFunctionVersion::Enum sharding_function_version,
+    const int64_t memory_budget_bytes, const Cache* replaced_cache,
+    const absl::Duration memory_budget_max_pause, MutationApplier& applier,
+    bool apply_on_calling_thread, MetricsRecorder& metrics_recorder,
+    UdfClient& udf_client, LatestCodeConfig& latest_code_config) {
+  // Shared by the records, which are checked against it one by one.
+  const ShardingFunction sharding_function(/*seed=*/"",
+                                           sharding_function_version);
+  Cache& partition = cache.GetPartition(key_namespace);
+  std::unique_ptr<MutationApplier::Stream> stream =
+      applier.NewStream(partition, apply_on_calling_thread);
+  std::atomic<int64_t> num_decoded = 0;
+  std::atomic<int64_t> decode_nanos = 0;
+  absl::Mutex stats_mutex;
   DataLoadingStats data_loading_stats;
+  std::atomic<int64_t> num_mutation_records = 0;
+  std::atomic<bool> over_memory_budget = false;
+  // Held while the budget is checked, which may pause the load, so that the
+  // other reading threads wait on it rather than keep loading.
+  absl::Mutex memory_budget_mutex;
+  std::atomic<bool> checking_memory_budget = false;
+  const auto within_memory_budget = [&]() {
+    if (checking_memory_budget.load(std::memory_order_relaxed)) {
+      absl::MutexLock lock(&memory_budget_mutex);
+    }
+    if (over_memory_budget.load(std::memory_order_relaxed)) {
+      return false;
+    }
+    if (memory_budget_bytes <= 0 ||
+        num_mutation_records.fetch_add(1, std::memory_order_relaxed) %
+                kRecordsPerMemoryBudgetCheck !=
+            0) {
+      return true;
+    }
+    absl::MutexLock lock(&memory_budget_mutex);
+    checking_memory_budget.store(true, std::memory_order_relaxed);
+    const auto status =
+        WaitForMemoryBudget(cache, replaced_cache, memory_budget_bytes,
+                            memory_budget_max_pause, metrics_recorder);
+    if (!status.ok()) {
+      LOG(ERROR) << "Stopping data load: " << status;
+      over_memory_budget.store(true, std::memory_order_relaxed);
+    }
+    checking_memory_budget.store(false, std::memory_order_relaxed);
+    return status.ok();
+  };
   const auto process_data_record_fn =
-      [&cache, &max_timestamp, &data_loading_stats, server_shard_num,
-       num_shards, &metrics_recorder,
-       &udf_client](const DataRecord& data_record) {
+      [server_shard_num, num_shards, logical_shard_mapping, &sharding_function,
+       &metrics_recorder, &udf_client, &latest_code_config,
+       &within_memory_budget](const DataRecord& data_record,
+                              std::vector<Mutation>& mutations) {
         if (data_record.record_type() == Record::KeyValueMutationRecord) {
+          if (!within_memory_budget()) {
+            return absl::ResourceExhaustedError(kMemoryBudgetExceededError);
+          }
           const auto* record = data_record.record_as_KeyValueMutationRecord();
           if (!ShouldProcessRecord(*record, num_shards, server_shard_num,
+                                   logical_shard_mapping, sharding_function,
                                    metrics_recorder)) {
             // NOTE: currently upstream logic retries on non-ok status
             // this will get us in a loop
             return absl::OkStatus();
           }
-          return ApplyKeyValueMutationToCache(*record, cache, max_timestamp,
-                                              data_loading_stats);
+          auto mutation = ToCacheMutation(*record);
+          if (!mutation.ok()) {
+            return mutation.status();
+          }
+          mutations.push_back(*std::move(mutation));
+          return absl::OkStatus();
         } else if (data_record.record_type() ==
                    Record::UserDefinedFunctionsConfig) {
           const auto* udf_config =
               data_record.record_as_UserDefinedFunctionsConfig();
           VLOG(3) << "Setting UDF code snippet for version: "
                   << udf_config->version();
-          return udf_client.SetCodeObject(CodeConfig{
+          CodeConfig code_config{
               .js = udf_config->code_snippet()->str(),
               .udf_handler_name = udf_config->handler_name()->str(),
               .logical_commit_time = udf_config->logical_commit_time(),
-              .version = udf_config->version()});
+              .version = udf_config->version()};
+          const auto status = udf_client.SetCodeObject(code_config);
+          if (status.ok()) {
+            latest_code_config.Update(code_config);
+          }
+          return status;
         }
         LOG(ERROR) << "Received unsupported record ";
         return absl::InvalidArgumentError("Record type not supported.");
       };
 
-  auto status = record_reader.ReadStreamRecords(
-      [&process_data_record_fn](std::string_view raw) {
-        return DeserializeDataRecord(raw, process_data_record_fn);
+  auto status = record_reader.ReadStreamRecordBatches(
+      kRecordsPerBatch,
+      [&](absl::Span<const std::string_view> raw_records) {
+        const absl::Time decode_start = absl::Now();
+        std::shared_ptr<const std::vector<std::string>> records;
+        if (!stream->applies_on_calling_thread()) {
+          records = std::make_shared<const std::vector<std::string>>(
+              raw_records.begin(), raw_records.end());
+        }
+        std::vector<Mutation> mutations;
+        mutations.reserve(raw_records.size());
+        absl::Status batch_status;
+        for (size_t i = 0; i < raw_records.size(); ++i) {
+          const std::string_view raw =
+              records == nullptr ? raw_records[i] : (*records)[i];
+          batch_status.Update(DeserializeDataRecord(
+              raw, [&process_data_record_fn,
+                    &mutations](const DataRecord& data_record) {
+                return process_data_record_fn(data_record, mutations);
+              }));
+        }
+        if (mutations.empty()) {
+          return batch_status;
+        }
+        DataLoadingStats batch_stats;
+        int64_t batch_max_timestamp = 0;
+        for (const Mutation& mutation : mutations) {
+          if (mutation.type == Mutation::Type::kUpdateKeyValue ||
+              mutation.type == Mutation::Type::kUpdateKeyValueSet) {
+            batch_stats.total_updated_records++;
+          } else {
+            batch_stats.total_deleted_records++;
+          }
+          batch_max_timestamp =
+              std::max(batch_max_timestamp, mutation.logical_commit_time);
+        }
+        const absl::Duration decode_time = absl::Now() - decode_start;
+        metrics_recorder.RecordLatency(kDecodeBatchEvent, decode_time);
+        num_decoded.fetch_add(mutations.size(), std::memory_order_relaxed);
+        decode_nanos.fetch_add(absl::ToInt64Nanoseconds(decode_time),
+                               std::memory_order_relaxed);
+        stream->Apply(std::move(records), std::move(mutations));
+        absl::MutexLock lock(&stats_mutex);
+        data_loading_stats.total_updated_records +=
+            batch_stats.total_updated_records;
+        data_loading_stats.total_deleted_records +=
+            batch_stats.total_deleted_records;
+        max_timestamp = std::max(max_timestamp, batch_max_timestamp);
+        return batch_status;
       });
+  // The mutations must all be in the cache before their tombstones are
+  // removed.
+  stream->Finish();
+  RecordStageThroughput(kDecodeThroughput, num_decoded.load(),
+                        absl::Nanoseconds(decode_nanos.load()),
+                        metrics_recorder);
+  RecordStageThroughput(kApplyThroughput, stream->num_applied(),
+                        stream->apply_time(), metrics_recorder);
   if (!status.ok()) {
     return status;
   }
+  if (over_memory_budget.load(std::memory_order_relaxed)) {
+    return absl::ResourceExhaustedError(kMemoryBudgetExceededError);
+  }
   return data_loading_stats;
 }
 
-// Reads the file from `location` and updates the cache based on the delta read.
-absl::StatusOr<DataLoadingStats> LoadCacheWithDataFromFile(
+// Returns the instance of the swappable cache that `cache` is loaded to
+// replace, or null if `cache` is `options.cache` itself.
+const Cache* ReplacedCache(const DataOrchestrator::Options& options,
+                           const Cache& cache) {
+  return &cache == &options.cache ? nullptr : &options.cache;
+}
+
+// Removes the keys deleted at or before `max_timestamp` from `cache`, or
+// leaves that to the tombstone compactor if there's one. The compactor
+// compacts `options.cache`, which forwards to the current instance of a
+// swappable cache, so a fresh instance loaded to replace it is compacted
+// inline. From the swap on, the compactor compacts the fresh instance.
+void RemoveDeletedKeys(const DataOrchestrator::Options& options, Cache& cache,
+                       int64_t max_timestamp) {
+  if (options.tombstone_compactor != nullptr && &cache == &options.cache) {
+    options.tombstone_compactor->AdvanceCutoff(max_timestamp);
+  } else {
+    cache.RemoveDeletedKeys(max_timestamp);
+  }
+}
+
+// Reads the file `name` from `record_reader` and updates `cache` based on the
+// delta read.
+//
+// The keys deleted by the file are then removed from the cache, unless
+// `deferred_max_timestamp` is given, in which case it's set to the latest
+// logical commit time of the file and the caller is to remove them.
+//
+// The shard of a cache image is the server's physical shard, which the
+// caller checks, even with a logical shard mapping, so it isn't checked
+// against the mapping when `is_cache_image`. Its records are still.
+absl::StatusOr<DataLoadingStats> LoadCacheWithDataFromReader(
     MetricsRecorder& metrics_recorder,
-    const BlobStorageClient::DataLocation& location,
-    const DataOrchestrator::Options& options) {
-  LOG(INFO) << "Loading " << location;
+    StreamRecordReader<std::string_view>& record_reader, std::string_view name,
+    const DataOrchestrator::Options& options, Cache& cache,
+    LatestCodeConfig& latest_code_config, MutationApplier& applier,
+    int64_t* deferred_max_timestamp = nullptr, bool is_cache_image = false) {
   int64_t max_timestamp = 0;
-  auto& cache = options.cache;
-  auto record_reader =
-      options.delta_stream_reader_factory.CreateConcurrentReader(
-          metrics_recorder,
-          /*stream_factory=*/[&location, &options]() {
-            return std::make_unique<BlobRecordStream>(
-                options.blob_client.GetBlobReader(location));
-          });
-  auto metadata = record_reader->GetKVFileMetadata();
+  auto metadata = record_reader.GetKVFileMetadata();
   if (!metadata.ok()) {
     return metadata.status();
   }
-  if (metadata->has_sharding_metadata() &&
-      metadata->sharding_metadata().shard_num() != options.shard_num) {
-    LOG(INFO) << "Blob " << location << " belongs to shard num "
+  if (!is_cache_image && !IsFileOfServerShard(*metadata, options)) {
+    LOG(INFO) << "Blob " << name << " belongs to shard num "
               << metadata->sharding_metadata().shard_num()
               << " but server shard num is " << options.shard_num
               << " Skipping it.";
@@ -210,21 +607,65 @@ absl::StatusOr<DataLoadingStats> LoadCacheWithDataFromFile(
         .total_deleted_records = 0,
     };
   }
-  auto status = LoadCacheWithData(*record_reader, cache, max_timestamp,
-                                  options.shard_num, options.num_shards,
-                                  metrics_recorder, options.udf_client);
-  if (status.ok()) {
-    cache.RemoveDeletedKeys(max_timestamp);
+  if (const auto status = CheckShardingFunctionVersion(*metadata, options);
+      !status.ok()) {
+    LOG(ERROR) << "Not loading " << name << ": " << status;
+    return status;
+  }
+  if (const auto status =
+          CheckMemoryBudget(cache, ReplacedCache(options, cache),
+                            options.memory_budget_bytes, metrics_recorder);
+      !status.ok()) {
+    LOG(ERROR) << "Not loading " << name << ": " << status;
+    return status;
+  }
+  auto status = LoadCacheWithData(
+      record_reader, cache, metadata->key_namespace(), max_timestamp,
+      options.shard_num, options.num_shards, options.logical_shard_mapping,
+      options.sharding_function_version, options.memory_budget_bytes,
+      ReplacedCache(options, cache), options.memory_budget_max_pause, applier,
+      /*apply_on_calling_thread=*/false, metrics_recorder, options.udf_client,
+      latest_code_config);
+  RecordCacheMemoryUsage(cache, metrics_recorder);
+  if (deferred_max_timestamp != nullptr) {
+    *deferred_max_timestamp = max_timestamp;
+  } else if (status.ok()) {
+    RemoveDeletedKeys(options, cache, max_timestamp);
   }
   return status;
 }
+
+// Reads the file from `location` and updates `cache` based on the delta read.
+absl::StatusOr<DataLoadingStats> LoadCacheWithDataFromFile(
+    MetricsRecorder& metrics_recorder,
+    const BlobStorageClient::DataLocation& location,
+    const DataOrchestrator::Options& options, Cache& cache,
+    LatestCodeConfig& latest_code_config, MutationApplier& applier,
+    int64_t* deferred_max_timestamp = nullptr) {
+  LOG(INFO) << "Loading " << location;
+  auto record_reader =
+      options.delta_stream_reader_factory.CreateConcurrentReader(
+          metrics_recorder,
+          /*stream_factory=*/[&location, &options]() {
+            return std::make_unique<BlobRecordStream>(
+                options.blob_client.GetBlobReader(location));
+          });
+  return LoadCacheWithDataFromReader(
+      metrics_recorder, *record_reader,
+      absl::StrCat(location.bucket, "/", location.key), options, cache,
+      latest_code_config, applier, deferred_max_timestamp);
+}
 absl::StatusOr<DataLoadingStats> TraceLoadCacheWithDataFromFile(
     MetricsRecorder& metrics_recorder, BlobStorageClient::DataLocation location,
-    const DataOrchestrator::Options& options) {
+    const DataOrchestrator::Options& options, Cache& cache,
+    LatestCodeConfig& latest_code_config, MutationApplier& applier,
+    int64_t* deferred_max_timestamp = nullptr) {
   return TraceWithStatusOr(
-      [&metrics_recorder, location, &options] {
-        return LoadCacheWithDataFromFile(metrics_recorder, std::move(location),
-                                         options);
+      [&metrics_recorder, location, &options, &cache, &latest_code_config,
+       &applier, deferred_max_timestamp] {
+        return LoadCacheWithDataFromFile(
+            metrics_recorder, std::move(location), options, cache,
+            latest_code_config, applier, deferred_max_timestamp);
       },
       "LoadCacheWithDataFromFile",
       {{"bucket", std::move(location.bucket)},
@@ -236,12 +677,18 @@ class DataOrchestratorImpl : public DataOrchestrator {
   // `last_basename` is the last file seen during init. The cache is up to
   // date until this file.
   DataOrchestratorImpl(Options options, std::string last_basename,
+                       std::unique_ptr<LatestCodeConfig> latest_code_config,
+                       std::unique_ptr<MutationApplier> applier,
                        MetricsRecorder& metrics_recorder)
       : options_(std::move(options)),
+        last_loaded_basename_(last_basename),
         last_basename_of_init_(std::move(last_basename)),
+        latest_code_config_(std::move(latest_code_config)),
+        applier_(std::move(applier)),
         metrics_recorder_(metrics_recorder) {}
 
   ~DataOrchestratorImpl() override {
+    cache_image_writer_->Stop();
     if (!data_loader_thread_) return;
     {
       absl::MutexLock l(&mu_);
@@ -259,9 +706,36 @@ class DataOrchestratorImpl : public DataOrchestrator {
     LOG(INFO) << "Stopped loading new data";
   }
 
-  static absl::StatusOr<std::string> Init(Options& options,
-                                          MetricsRecorder& metrics_recorder) {
-    auto ending_delta_file = LoadSnapshotFiles(options, metrics_recorder);
+  static absl::StatusOr<std::string> Init(
+      Options& options, LatestCodeConfig& latest_code_config,
+      MutationApplier& applier, MetricsRecorder& metrics_recorder) {
+    if (options.swappable_cache == nullptr) {
+      return LoadAllFiles(options, options.cache, latest_code_config, applier,
+                          metrics_recorder);
+    }
+    // Lookups keep being served by the current instance, without contending
+    // with the load, until the fresh one has caught up with the deltas.
+    LOG(INFO) << "Loading data into a fresh cache instance";
+    std::unique_ptr<Cache> fresh_cache =
+        options.swappable_cache->CreateInstance();
+    auto last_basename = LoadAllFiles(options, *fresh_cache, latest_code_config,
+                                      applier, metrics_recorder);
+    if (!last_basename.ok()) {
+      return last_basename.status();
+    }
+    options.swappable_cache->Swap(std::move(fresh_cache));
+    LOG(INFO) << "Swapped in the fresh cache instance";
+    return last_basename;
+  }
+
+  // Loads the latest snapshot, or the cache image, and the deltas after it,
+  // into `cache`. Returns the last delta file loaded.
+  static absl::StatusOr<std::string> LoadAllFiles(
+      const Options& options, Cache& cache,
+      LatestCodeConfig& latest_code_config, MutationApplier& applier,
+      MetricsRecorder& metrics_recorder) {
+    auto ending_delta_file = LoadSnapshotFiles(
+        options, cache, latest_code_config, applier, metrics_recorder);
     if (!ending_delta_file.ok()) {
       return ending_delta_file.status();
     }
@@ -275,24 +749,102 @@ class DataOrchestratorImpl : public DataOrchestrator {
     LOG(INFO) << "Initializing cache with " << maybe_filenames->size()
               << " delta files from " << options.data_bucket;
 
-    std::string last_basename = std::move(*ending_delta_file);
+    std::vector<std::string> basenames;
     for (auto&& basename : std::move(*maybe_filenames)) {
       if (!IsDeltaFilename(basename)) {
         LOG(WARNING) << "Saw a file " << basename
                      << " not in delta file format. Skipping it.";
         continue;
       }
-      last_basename = basename;
-      if (const auto s = TraceLoadCacheWithDataFromFile(
-              metrics_recorder,
-              {.bucket = options.data_bucket, .key = std::move(basename)},
-              options);
-          !s.ok()) {
-        return s.status();
+      basenames.push_back(std::move(basename));
+    }
+    if (const auto status =
+            LoadDeltaFiles(options, cache, basenames, latest_code_config,
+                           applier, metrics_recorder);
+        !status.ok()) {
+      return status;
+    }
+    return basenames.empty() ? *std::move(ending_delta_file)
+                             : std::move(basenames.back());
+  }
+
+  // Loads the delta files `basenames`, in order, into `cache`. Up to
+  // `options.num_concurrent_delta_loads` files are read and applied at once.
+  //
+  // Files may then be applied out of order, which the cache allows for: a
+  // mutation only overwrites, or deletes, a key changed at an earlier logical
+  // commit time, and the UDF client only takes a code config newer than its
+  // current one. The keys deleted by a file however are only removed once it
+  // and the files before it are all loaded, so that the tombstones still
+  // hold back the older mutations of the files being loaded. Only mutations
+  // of a key at the same logical commit time in different files may be
+  // applied in a different order than when loading one file at a time, as
+  // they already are for the shards of a file read concurrently.
+  static absl::Status LoadDeltaFiles(const Options& options, Cache& cache,
+                                     const std::vector<std::string>& basenames,
+                                     LatestCodeConfig& latest_code_config,
+                                     MutationApplier& applier,
+                                     MetricsRecorder& metrics_recorder) {
+    // Guards the variables below.
+    absl::Mutex mutex;
+    size_t next_file = 0;
+    // Files before this one are loaded and their deleted keys removed.
+    size_t next_file_to_clean_up = 0;
+    // The latest logical commit time of each file, once it's loaded.
+    std::vector<std::optional<int64_t>> max_timestamps(basenames.size());
+    absl::Status status;
+    const auto load_files = [&]() {
+      absl::MutexLock lock(&mutex);
+      while (status.ok() && next_file < basenames.size()) {
+        const size_t file = next_file++;
+        mutex.Unlock();
+        int64_t max_timestamp = 0;
+        const absl::Time start = absl::Now();
+        const auto loaded = TraceLoadCacheWithDataFromFile(
+            metrics_recorder,
+            {.bucket = options.data_bucket, .key = basenames[file]}, options,
+            cache, latest_code_config, applier, &max_timestamp);
+        const absl::Duration duration = absl::Now() - start;
+        metrics_recorder.RecordLatency(kLoadDeltaFileEvent, duration);
+        mutex.Lock();
+        if (!loaded.ok()) {
+          status.Update(loaded.status());
+          break;
+        }
+        LOG(INFO) << "Done loading " << basenames[file] << " in " << duration;
+        max_timestamps[file] = max_timestamp;
+        // Removing the keys deleted by several files at once is the same as
+        // removing them file by file, so it's done once, without holding
+        // `mutex`, so that the other loaders keep claiming files meanwhile.
+        std::optional<int64_t> cleanup_cutoff;
+        for (; next_file_to_clean_up < basenames.size() &&
+               max_timestamps[next_file_to_clean_up].has_value();
+             ++next_file_to_clean_up) {
+          const int64_t cutoff = *max_timestamps[next_file_to_clean_up];
+          cleanup_cutoff = std::max(cleanup_cutoff.value_or(cutoff), cutoff);
+        }
+        if (cleanup_cutoff.has_value()) {
+          mutex.Unlock();
+          RemoveDeletedKeys(options, cache, *cleanup_cutoff);
+          mutex.Lock();
+        }
       }
-      LOG(INFO) << "Done loading " << last_basename;
+    };
+    const int num_loaders =
+        std::clamp<int>(options.num_concurrent_delta_loads, 1,
+                        std::max<int>(basenames.size(), 1));
+    if (num_loaders > 1) {
+      LOG(INFO) << "Loading up to " << num_loaders << " delta files at once";
     }
-    return last_basename;
+    std::vector<std::thread> loaders;
+    for (int i = 1; i < num_loaders; ++i) {
+      loaders.emplace_back(load_files);
+    }
+    load_files();
+    for (auto& loader : loaders) {
+      loader.join();
+    }
+    return status;
   }
 
   absl::Status Start() override {
@@ -310,6 +862,14 @@ class DataOrchestratorImpl : public DataOrchestrator {
     }
     data_loader_thread_ = std::make_unique<std::thread>(
         absl::bind_front(&DataOrchestratorImpl::ProcessNewFiles, this));
+    if (!options_.cache_image_path.empty() &&
+        options_.tiered_cache == nullptr) {
+      if (const auto s = cache_image_writer_->StartDelayed(
+              options_.cache_image_interval, [this] { UpdateCacheImage(); });
+          !s.ok()) {
+        LOG(ERROR) << "Failed to start the cache image writer: " << s;
+      }
+    }
 
     return options_.realtime_thread_pool_manager.Start(
         [this, &cache = options_.cache,
@@ -355,10 +915,121 @@ class DataOrchestratorImpl : public DataOrchestrator {
             // are fatal.
             return TraceLoadCacheWithDataFromFile(
                 metrics_recorder_,
-                {.bucket = options_.data_bucket, .key = basename}, options_);
+                {.bucket = options_.data_bucket, .key = basename}, options_,
+                options_.cache, *latest_code_config_, *applier_);
           },
           "LoadNewFile", &metrics_recorder_);
+      absl::MutexLock l(&mu_);
+      last_loaded_basename_ = std::move(basename);
+    }
+  }
+
+  // Writes the cache to the cache image. All records of the files up to the
+  // last one loaded are in the cache. Records of a file being loaded
+  // meanwhile may be too, as may records of files loaded while the image is
+  // written, which is harmless as those files are loaded again on top of the
+  // image.
+  void UpdateCacheImage() {
+    KVFileMetadata metadata;
+    {
+      absl::MutexLock l(&mu_);
+      if (last_loaded_basename_.empty()) {
+        return;
+      }
+      metadata.mutable_snapshot()->set_ending_delta_file(
+          last_loaded_basename_);
+    }
+    metadata.mutable_sharding_metadata()->set_shard_num(options_.shard_num);
+    metadata.mutable_sharding_metadata()->set_sharding_function_version(
+        ResolveShardingFunctionVersion(options_.sharding_function_version));
+    std::vector<UserDefinedFunctionsConfigStruct> udf_configs;
+    const std::optional<CodeConfig> code_config = latest_code_config_->Get();
+    if (code_config.has_value()) {
+      udf_configs.push_back(
+          {.language = UserDefinedFunctionsLanguage::Javascript,
+           .code_snippet = code_config->js,
+           .handler_name = code_config->udf_handler_name,
+           .logical_commit_time = code_config->logical_commit_time,
+           .version = code_config->version});
+    }
+    ScopeLatencyRecorder latency_recorder(kWriteCacheImageEvent,
+                                          metrics_recorder_);
+    if (const auto status =
+            WriteCacheImage(options_.cache, metadata, udf_configs,
+                            options_.cache_image_path);
+        !status.ok()) {
+      LOG(ERROR) << "Failed to write the cache image: " << status;
+      return;
+    }
+    LOG(INFO) << "Wrote the cache image up to "
+              << metadata.snapshot().ending_delta_file() << " to "
+              << options_.cache_image_path;
+  }
+
+  // Loads the cache image into `cache`, unless it's corrupt, belongs to
+  // another shard, or is older than `snapshot_ending_delta_file`, the ending
+  // delta file of the latest snapshot. Deltas before it may have been
+  // removed from the bucket. Returns the ending delta file of the image, or
+  // nullopt if the snapshot must be loaded instead.
+  static std::optional<std::string> LoadCacheImage(
+      const Options& options, Cache& cache,
+      std::string_view snapshot_ending_delta_file,
+      LatestCodeConfig& latest_code_config, MutationApplier& applier,
+      MetricsRecorder& metrics_recorder) {
+    if (options.cache_image_path.empty()) {
+      return std::nullopt;
+    }
+    const std::string& path = options.cache_image_path;
+    auto metadata = ValidateCacheImage(path);
+    if (!metadata.ok()) {
+      LOG(WARNING) << "Not loading the cache image " << path << ": "
+                   << metadata.status();
+      return std::nullopt;
+    }
+    if (metadata->sharding_metadata().shard_num() != options.shard_num) {
+      LOG(WARNING) << "Not loading the cache image " << path
+                   << ": it belongs to shard num "
+                   << metadata->sharding_metadata().shard_num()
+                   << " but server shard num is " << options.shard_num;
+      return std::nullopt;
     }
+    if (const auto status = CheckShardingFunctionVersion(*metadata, options);
+        !status.ok()) {
+      LOG(WARNING) << "Not loading the cache image " << path << ": "
+                   << status;
+      return std::nullopt;
+    }
+    std::string ending_delta_file =
+        std::move(*metadata->mutable_snapshot()->mutable_ending_delta_file());
+    if (ending_delta_file < snapshot_ending_delta_file) {
+      LOG(WARNING) << "Not loading the cache image " << path
+                   << ": it ends at " << ending_delta_file
+                   << " but the latest snapshot ends at "
+                   << snapshot_ending_delta_file;
+      return std::nullopt;
+    }
+    LOG(INFO) << "Loading the cache image " << path;
+    auto record_reader =
+        options.delta_stream_reader_factory.CreateConcurrentReader(
+            metrics_recorder,
+            /*stream_factory=*/[&path]() {
+              return std::make_unique<FileRecordStream>(path);
+            });
+    // If the load fails, the records already loaded from the image stay in
+    // the cache. The deltas loaded after the snapshot instead are at least
+    // as recent, so they overwrite them.
+    if (const auto status = LoadCacheWithDataFromReader(
+            metrics_recorder, *record_reader, path, options, cache,
+            latest_code_config, applier, /*deferred_max_timestamp=*/nullptr,
+            /*is_cache_image=*/true);
+        !status.ok()) {
+      LOG(WARNING) << "Failed to load the cache image " << path << ": "
+                   << status.status();
+      return std::nullopt;
+    }
+    LOG(INFO) << "Done loading the cache image, which ends at "
+              << ending_delta_file;
+    return ending_delta_file;
   }
 
   // Puts newly found file names into `unprocessed_basenames_`.
@@ -369,10 +1040,13 @@ class DataOrchestratorImpl : public DataOrchestrator {
     // TODO: block if the queue is too large: consumption is too slow.
   }
 
-  // Loads snapshot files if there are any.
-  // Returns the latest delta file to be included in a snapshot.
+  // Loads the cache image if it's usable, and snapshot files otherwise if
+  // there are any.
+  // Returns the latest delta file to be included in the image or snapshot.
   static absl::StatusOr<std::string> LoadSnapshotFiles(
-      const Options& options, MetricsRecorder& metrics_recorder) {
+      const Options& options, Cache& cache,
+      LatestCodeConfig& latest_code_config, MutationApplier& applier,
+      MetricsRecorder& metrics_recorder) {
     absl::StatusOr<std::vector<std::string>> snapshots =
         options.blob_client.ListBlobs(
             {.bucket = options.data_bucket},
@@ -383,6 +1057,10 @@ class DataOrchestratorImpl : public DataOrchestrator {
     LOG(INFO) << "Initializing cache with snapshot file(s) from: "
               << options.data_bucket;
     std::string ending_delta_file;
+    // The latest snapshot of the shard, or with a logical shard mapping, the
+    // latest snapshot of each logical shard mapped to it.
+    std::vector<BlobStorageClient::DataLocation> snapshot_locations;
+    absl::flat_hash_set<int64_t> logical_shards;
     for (int64_t s = snapshots->size() - 1; s >= 0; s--) {
       std::string_view snapshot = snapshots->at(s);
       if (!IsSnapshotFilename(snapshot)) {
@@ -403,38 +1081,134 @@ class DataOrchestratorImpl : public DataOrchestrator {
       if (!metadata.ok()) {
         return metadata.status();
       }
-      if (metadata->has_sharding_metadata() &&
-          metadata->sharding_metadata().shard_num() != options.shard_num) {
+      if (!IsFileOfServerShard(*metadata, options)) {
         LOG(INFO) << "Snapshot " << location << " belongs to shard num "
                   << metadata->sharding_metadata().shard_num()
                   << " but server shard num is " << options.shard_num
                   << ". Skipping it.";
         continue;
       }
-      LOG(INFO) << "Loading snapshot file: " << location;
-      if (auto status = TraceLoadCacheWithDataFromFile(metrics_recorder,
-                                                       location, options);
+      if (options.logical_shard_mapping == nullptr ||
+          !metadata->has_sharding_metadata()) {
+        // Holds all the records of the shard, unless newer snapshots of some
+        // of its logical shards were found already.
+        if (snapshot_locations.empty()) {
+          ending_delta_file =
+              std::move(*metadata->mutable_snapshot()
+                             ->mutable_ending_delta_file());
+          snapshot_locations.push_back(std::move(location));
+        }
+        break;
+      }
+      if (!logical_shards.insert(metadata->sharding_metadata().shard_num())
+               .second) {
+        continue;
+      }
+      // Deltas are loaded after the snapshot that ends first. The others
+      // already hold some of them, which are then loaded again, but loading
+      // the same mutations twice leaves the cache as is.
+      if (snapshot_locations.empty() ||
+          metadata->snapshot().ending_delta_file() < ending_delta_file) {
+        ending_delta_file =
+            std::move(*metadata->mutable_snapshot()
+                           ->mutable_ending_delta_file());
+      }
+      snapshot_locations.push_back(std::move(location));
+      if (logical_shards.size() ==
+          options.logical_shard_mapping->GetLogicalShards(options.shard_num)
+              .size()) {
+        break;
+      }
+    }
+    if (options.tiered_cache == nullptr) {
+      if (auto image_ending_delta_file =
+              LoadCacheImage(options, cache, ending_delta_file,
+                             latest_code_config, applier, metrics_recorder);
+          image_ending_delta_file.has_value()) {
+        return *std::move(image_ending_delta_file);
+      }
+    }
+    if (snapshot_locations.empty()) {
+      return ending_delta_file;
+    }
+    const bool building_base =
+        options.tiered_cache != nullptr &&
+        !OpenCacheBase(options, snapshot_locations);
+    for (const auto& snapshot_location : snapshot_locations) {
+      LOG(INFO) << "Loading snapshot file: " << snapshot_location;
+      if (auto status = TraceLoadCacheWithDataFromFile(
+              metrics_recorder, snapshot_location, options, cache,
+              latest_code_config, applier);
           !status.ok()) {
         return status.status();
       }
-      if (metadata->snapshot().ending_delta_file() > ending_delta_file) {
-        ending_delta_file = std::move(metadata->snapshot().ending_delta_file());
+      LOG(INFO) << "Done loading snapshot file: " << snapshot_location;
+    }
+    if (building_base) {
+      if (const auto status = options.tiered_cache->FinishBaseBuild(
+              CacheBaseSource(options, snapshot_locations));
+          !status.ok()) {
+        LOG(ERROR) << "Failed to build the cache base, keeping the snapshot "
+                      "in memory instead: "
+                   << status;
       }
-      LOG(INFO) << "Done loading snapshot file: " << location;
-      break;
     }
     return ending_delta_file;
   }
 
+  // Identifies the data of the cache base built from the snapshots at
+  // `locations`.
+  static std::string CacheBaseSource(
+      const Options& options,
+      absl::Span<const BlobStorageClient::DataLocation> locations) {
+    return absl::StrCat(
+        absl::StrJoin(locations, ", ",
+                      [](std::string* out,
+                         const BlobStorageClient::DataLocation& location) {
+                        absl::StrAppend(out, location.bucket, "/",
+                                        location.key);
+                      }),
+        " shard ", options.shard_num, " of ", options.num_shards);
+  }
+
+  // Maps the cache base if it was built from the snapshots at `locations`.
+  // Otherwise starts building it from the snapshots, and returns false.
+  // Either way the snapshots are loaded next: their key-value pairs are then
+  // collected for the base, or dropped as they're already in it, and their
+  // key-value sets and UDF configs are loaded as usual.
+  static bool OpenCacheBase(
+      const Options& options,
+      absl::Span<const BlobStorageClient::DataLocation> locations) {
+    const std::string source = CacheBaseSource(options, locations);
+    if (const auto status = options.tiered_cache->OpenBase(source);
+        !status.ok()) {
+      LOG(INFO) << "Building the cache base from " << source << ": "
+                << status;
+      options.tiered_cache->StartBaseBuild();
+      return false;
+    }
+    LOG(INFO) << "Mapped the cache base built from " << source;
+    return true;
+  }
+
   absl::StatusOr<DataLoadingStats> LoadCacheWithHighPriorityUpdates(
       StreamRecordReaderFactory<std::string_view>& delta_stream_reader_factory,
       const std::string& record_string, Cache& cache) {
     std::istringstream is(record_string);
     int64_t max_timestamp = 0;
     auto record_reader = delta_stream_reader_factory.CreateReader(is);
-    return LoadCacheWithData(*record_reader, cache, max_timestamp,
-                             options_.shard_num, options_.num_shards,
-                             metrics_recorder_, options_.udf_client);
+    // Updates without metadata go to the default partition.
+    const auto metadata = record_reader->GetKVFileMetadata();
+    return LoadCacheWithData(
+        *record_reader, cache,
+        metadata.ok() ? metadata->key_namespace()
+                      : KeyNamespace::KEY_NAMESPACE_UNSPECIFIED,
+        max_timestamp, options_.shard_num, options_.num_shards,
+        options_.logical_shard_mapping, options_.sharding_function_version,
+        options_.memory_budget_bytes, /*replaced_cache=*/nullptr,
+        options_.memory_budget_max_pause, *applier_,
+        /*apply_on_calling_thread=*/true, metrics_recorder_,
+        options_.udf_client, *latest_code_config_);
   }
 
   const Options options_;
@@ -442,23 +1216,36 @@ class DataOrchestratorImpl : public DataOrchestrator {
   std::deque<std::string> unprocessed_basenames_ ABSL_GUARDED_BY(mu_);
   std::unique_ptr<std::thread> data_loader_thread_;
   bool stop_ ABSL_GUARDED_BY(mu_) = false;
+  // Last basename of a file whose records are all in the cache.
+  std::string last_loaded_basename_ ABSL_GUARDED_BY(mu_);
   // last basename of file in initialization.
   const std::string last_basename_of_init_;
+  std::unique_ptr<LatestCodeConfig> latest_code_config_;
+  // Applies the mutations of all the files loaded, at startup and after.
+  std::unique_ptr<MutationApplier> applier_;
   MetricsRecorder& metrics_recorder_;
+  std::unique_ptr<PeriodicClosure> cache_image_writer_ =
+      PeriodicClosure::Create();
 };
 
 }  // namespace
 
 absl::StatusOr<std::unique_ptr<DataOrchestrator>> DataOrchestrator::TryCreate(
     Options options, MetricsRecorder& metrics_recorder) {
-  const auto maybe_last_basename =
-      DataOrchestratorImpl::Init(options, metrics_recorder);
+  RegisterCacheMemoryHistograms(metrics_recorder);
+  RegisterDataLoadingHistograms(metrics_recorder);
+  auto latest_code_config = std::make_unique<LatestCodeConfig>();
+  // Started once, and shared by all the loads, including concurrent ones.
+  auto applier = MutationApplier::Create(
+      metrics_recorder, {.num_workers = options.num_apply_workers});
+  const auto maybe_last_basename = DataOrchestratorImpl::Init(
+      options, *latest_code_config, *applier, metrics_recorder);
   if (!maybe_last_basename.ok()) {
     return maybe_last_basename.status();
   }
   auto orchestrator = std::make_unique<DataOrchestratorImpl>(
       std::move(options), std::move(maybe_last_basename.value()),
-      metrics_recorder);
+      std::move(latest_code_config), std::move(applier), metrics_recorder);
   return orchestrator;
 }
 }  // namespace kv_server
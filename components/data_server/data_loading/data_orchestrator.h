@@ -22,14 +22,20 @@
 
 #include "absl/functional/any_invocable.h"
 #include "absl/status/status.h"
+#include "absl/time/time.h"
 #include "components/data/blob_storage/blob_storage_change_notifier.h"
 #include "components/data/blob_storage/blob_storage_client.h"
 #include "components/data/blob_storage/delta_file_notifier.h"
 #include "components/data/realtime/realtime_notifier.h"
 #include "components/data/realtime/realtime_thread_pool_manager.h"
 #include "components/data_server/cache/cache.h"
+#include "components/data_server/cache/swappable_cache.h"
+#include "components/data_server/cache/tiered_key_value_cache.h"
+#include "components/data_server/cache/tombstone_compactor.h"
 #include "components/udf/udf_client.h"
 #include "public/data_loading/readers/riegeli_stream_io.h"
+#include "public/data_loading/riegeli_metadata.pb.h"
+#include "public/sharding/logical_shard_mapping.h"
 #include "src/cpp/telemetry/metrics_recorder.h"
 
 namespace kv_server {
@@ -54,6 +60,56 @@ class DataOrchestrator {
     RealtimeThreadPoolManager& realtime_thread_pool_manager;
     const int32_t shard_num = 0;
     const int32_t num_shards = 1;
+    // If set, keys are assigned to its logical shards, and the records of
+    // the logical shards it maps to `shard_num` are loaded. The sharding
+    // metadata of files is then their logical shard.
+    const LogicalShardMapping* logical_shard_mapping = nullptr;
+    // Function assigning keys to shards. Sharded files written with another
+    // one fail to load.
+    const ShardingFunctionVersion::Enum sharding_function_version =
+        ShardingFunctionVersion::SHARDING_FUNCTION_VERSION_UNSPECIFIED;
+    // Files aren't loaded while the cache holds this many bytes or more.
+    // Such loads fail with ResourceExhausted, so files loaded after startup
+    // are retried, with backoff, until enough memory is released. Loads that
+    // reach the budget midway through a file pause instead, so that the file
+    // isn't left partially loaded, and resume once the cache holds less,
+    // e.g. once tombstones are removed. Zero means unlimited.
+    const int64_t memory_budget_bytes = 0;
+    // Longest pause of a load over `memory_budget_bytes`, after which it
+    // fails with ResourceExhausted.
+    const absl::Duration memory_budget_max_pause = absl::Minutes(5);
+    // Removes the tombstones of a file once it's loaded. If null, they are
+    // removed inline at the end of the load.
+    TombstoneCompactor* tombstone_compactor = nullptr;
+    // If set, must point to `cache`. Data is then loaded at startup into a
+    // fresh instance, which replaces the current one once it's caught up
+    // with the deltas, so that lookups served meanwhile don't contend with
+    // the load. Both instances are held in memory until the swap, and both
+    // count against `memory_budget_bytes`. The fresh instance is compacted
+    // inline until then, as `tombstone_compactor` compacts the current one.
+    SwappableCache* swappable_cache = nullptr;
+    // If set, must point to `cache`. The key-value pairs of the latest
+    // snapshot are then kept in its base. At startup, the base is mapped
+    // from local disk if it was built from that snapshot, and built while
+    // the snapshot is loaded otherwise. The cache image isn't used with it.
+    TieredKeyValueCache* tiered_cache = nullptr;
+    // Local file of the cache image, see cache_image.h. If set, the image
+    // is loaded at startup instead of the latest snapshot, unless it's
+    // corrupt, belongs to another shard or is older than the snapshot. Once
+    // data loading has started, the cache is written to it every
+    // `cache_image_interval`. Updates to the cache go on while it's written.
+    const std::string cache_image_path;
+    const absl::Duration cache_image_interval = absl::Hours(1);
+    // Number of threads applying the mutations read from data files to the
+    // cache, each owning a partition of the keys, while the threads reading
+    // the files only decode them. They're started once and shared by all
+    // the files loaded. Zero applies them on the reading threads. Realtime
+    // updates are always applied on the reading thread.
+    const int32_t num_apply_workers = 0;
+    // Number of delta files read and applied at once when initializing the
+    // cache, each still read by threads of its own. Zero or one loads them
+    // one at a time.
+    const int32_t num_concurrent_delta_loads = 0;
   };
 
   // Creates initial state. Scans the bucket and initializes the cache with data
@@ -14,15 +14,25 @@
 
 #include "components/data_server/data_loading/data_orchestrator.h"
 
+#include <filesystem>
+#include <sstream>
 #include <string>
+#include <string_view>
 #include <utility>
 #include <vector>
 
+#include "absl/strings/str_cat.h"
 #include "absl/synchronization/notification.h"
+#include "absl/time/time.h"
 #include "components/data/common/mocks.h"
 #include "components/data/realtime/realtime_notifier.h"
 #include "components/data_server/cache/cache.h"
 #include "components/data_server/cache/mocks.h"
+#include "components/data_server/cache/partitioned_cache.h"
+#include "components/data_server/cache/swappable_cache.h"
+#include "components/data_server/cache/tiered_key_value_cache.h"
+#include "components/data_server/cache/tombstone_compactor.h"
+#include "components/data_server/data_loading/cache_image.h"
 #include "components/udf/code_config.h"
 #include "components/udf/mocks.h"
 #include "glog/logging.h"
@@ -32,20 +42,28 @@
 #include "public/constants.h"
 #include "public/data_loading/filename_utils.h"
 #include "public/data_loading/records_utils.h"
+#include "public/sharding/logical_shard_mapping.h"
+#include "public/sharding/sharding_function.h"
 #include "public/test_util/mocks.h"
 #include "public/test_util/proto_matcher.h"
 #include "src/cpp/telemetry/mocks.h"
 
+using kv_server::BlobReader;
 using kv_server::BlobStorageChangeNotifier;
 using kv_server::BlobStorageClient;
+using kv_server::Cache;
+using kv_server::CacheMemoryUsage;
 using kv_server::CodeConfig;
 using kv_server::DataOrchestrator;
 using kv_server::DataRecordStruct;
 using kv_server::FilePrefix;
 using kv_server::FileType;
 using kv_server::KeyValueMutationRecordStruct;
+using kv_server::KeyNamespace;
 using kv_server::KeyValueMutationType;
 using kv_server::KVFileMetadata;
+using kv_server::KVPairEq;
+using kv_server::LogicalShardMapping;
 using kv_server::MockBlobReader;
 using kv_server::MockBlobStorageChangeNotifier;
 using kv_server::MockBlobStorageClient;
@@ -56,14 +74,25 @@ using kv_server::MockRealtimeThreadPoolManager;
 using kv_server::MockStreamRecordReader;
 using kv_server::MockStreamRecordReaderFactory;
 using kv_server::MockUdfClient;
+using kv_server::PartitionedCache;
 using kv_server::Record;
+using kv_server::RecordStream;
+using kv_server::ShardingFunction;
+using kv_server::ShardingFunctionVersion;
+using kv_server::ShardMappingRecordStruct;
+using kv_server::StreamRecordReader;
+using kv_server::SwappableCache;
 using kv_server::ToDeltaFileName;
 using kv_server::ToFlatBufferBuilder;
 using kv_server::ToSnapshotFileName;
+using kv_server::TieredKeyValueCache;
 using kv_server::ToStringView;
+using kv_server::TombstoneCompactor;
 using kv_server::UserDefinedFunctionsConfigStruct;
 using kv_server::UserDefinedFunctionsLanguage;
 using kv_server::Value;
+using kv_server::WriteCacheImage;
+using privacy_sandbox::server_common::MetricsRecorder;
 using privacy_sandbox::server_common::MockMetricsRecorder;
 using testing::_;
 using testing::AllOf;
@@ -71,6 +100,8 @@ using testing::ByMove;
 using testing::Field;
 using testing::Return;
 using testing::ReturnRef;
+using testing::Sequence;
+using testing::UnorderedElementsAre;
 
 namespace {
 // using google::protobuf::TextFormat;
@@ -82,6 +113,20 @@ BlobStorageClient::DataLocation GetTestLocation(
                                          .key = basename};
 }
 
+// Writes an empty cache image for shard 0 that ends at `ending_delta_file`,
+// and returns its path.
+std::string WriteTestCacheImage(std::string_view name,
+                                const std::string& ending_delta_file) {
+  KVFileMetadata metadata;
+  metadata.mutable_snapshot()->set_ending_delta_file(ending_delta_file);
+  metadata.mutable_sharding_metadata()->set_shard_num(0);
+  MockCache cache;
+  EXPECT_CALL(cache, ExportMutations).Times(1);
+  const std::string path = absl::StrCat(::testing::TempDir(), "/", name);
+  EXPECT_TRUE(WriteCacheImage(cache, metadata, {}, path).ok());
+  return path;
+}
+
 class DataOrchestratorTest : public ::testing::Test {
  protected:
   DataOrchestratorTest()
@@ -357,7 +402,7 @@ TEST_F(DataOrchestratorTest, InitCacheSuccess) {
   EXPECT_FALSE((*maybe_orchestrator)->Start().ok());
 }
 
-TEST_F(DataOrchestratorTest, UpdateUdfCodeSuccess) {
+TEST_F(DataOrchestratorTest, InitCacheDefersTombstoneRemovalToCompactor) {
   const std::vector<std::string> fnames({ToDeltaFileName(1).value()});
   EXPECT_CALL(
       blob_client_,
@@ -378,37 +423,44 @@ TEST_F(DataOrchestratorTest, UpdateUdfCodeSuccess) {
   auto reader = std::make_unique<MockStreamRecordReader>();
   EXPECT_CALL(*reader, GetKVFileMetadata).Times(1).WillOnce(Return(metadata));
   EXPECT_CALL(*reader, ReadStreamRecords)
+      .Times(1)
       .WillOnce(
           [](const std::function<absl::Status(std::string_view)>& callback) {
-            callback(ToStringView(ToFlatBufferBuilder(DataRecordStruct{
-                         .record =
-                             UserDefinedFunctionsConfigStruct{
-                                 .code_snippet = "function hello(){}",
-                                 .handler_name = "hello",
-                                 .language =
-                                     UserDefinedFunctionsLanguage::Javascript,
-                                 .logical_commit_time = 1}})))
+            callback(ToStringView(ToFlatBufferBuilder(
+                         DataRecordStruct{.record =
+                                              KeyValueMutationRecordStruct{
+                                                  KeyValueMutationType::Delete,
+                                                  3, "bar", "bar value"}})))
                 .IgnoreError();
             return absl::OkStatus();
           });
   EXPECT_CALL(delta_stream_reader_factory_, CreateConcurrentReader)
       .WillOnce(Return(ByMove(std::move(reader))));
+  EXPECT_CALL(cache_, DeleteKey("bar", 3)).Times(1);
+  EXPECT_CALL(cache_, RemoveDeletedKeys).Times(0);
 
-  EXPECT_CALL(udf_client_, SetCodeObject(CodeConfig{.js = "function hello(){}",
-                                                    .udf_handler_name = "hello",
-                                                    .logical_commit_time = 1}))
-      .WillOnce(Return(absl::OkStatus()));
+  auto tombstone_compactor =
+      TombstoneCompactor::Create(cache_, /*interval=*/absl::Hours(1));
+  auto options = DataOrchestrator::Options{
+      .data_bucket = GetTestLocation().bucket,
+      .cache = cache_,
+      .blob_client = blob_client_,
+      .delta_notifier = notifier_,
+      .change_notifier = change_notifier_,
+      .udf_client = udf_client_,
+      .delta_stream_reader_factory = delta_stream_reader_factory_,
+      .realtime_thread_pool_manager = realtime_thread_pool_manager_,
+      .tombstone_compactor = tombstone_compactor.get()};
   auto maybe_orchestrator =
-      DataOrchestrator::TryCreate(options_, metrics_recorder_);
+      DataOrchestrator::TryCreate(options, metrics_recorder_);
   ASSERT_TRUE(maybe_orchestrator.ok());
+  testing::Mock::VerifyAndClearExpectations(&cache_);
 
-  const std::string last_basename = ToDeltaFileName(1).value();
-  EXPECT_CALL(notifier_, Start(_, GetTestLocation(), last_basename, _))
-      .WillOnce(Return(absl::UnknownError("")));
-  EXPECT_FALSE((*maybe_orchestrator)->Start().ok());
+  EXPECT_CALL(cache_, RemoveDeletedKeys(3)).Times(1);
+  tombstone_compactor->Compact();
 }
 
-TEST_F(DataOrchestratorTest, UpdateUdfCodeFails_OrchestratorContinues) {
+TEST_F(DataOrchestratorTest, InitCacheAppliesRecordsOnApplyWorkers) {
   const std::vector<std::string> fnames({ToDeltaFileName(1).value()});
   EXPECT_CALL(
       blob_client_,
@@ -429,66 +481,169 @@ TEST_F(DataOrchestratorTest, UpdateUdfCodeFails_OrchestratorContinues) {
   auto reader = std::make_unique<MockStreamRecordReader>();
   EXPECT_CALL(*reader, GetKVFileMetadata).Times(1).WillOnce(Return(metadata));
   EXPECT_CALL(*reader, ReadStreamRecords)
+      .Times(1)
       .WillOnce(
           [](const std::function<absl::Status(std::string_view)>& callback) {
-            callback(ToStringView(ToFlatBufferBuilder(DataRecordStruct{
-                         .record =
-                             UserDefinedFunctionsConfigStruct{
-                                 .code_snippet = "function hello(){}",
-                                 .handler_name = "hello",
-                                 .language =
-                                     UserDefinedFunctionsLanguage::Javascript,
-                                 .logical_commit_time = 1}})))
-                .IgnoreError();
+            // The records only live during the callback, so the workers
+            // must apply copies.
+            for (const auto& [key, type] :
+                 {std::pair("foo", KeyValueMutationType::Update),
+                  std::pair("bar", KeyValueMutationType::Delete)}) {
+              callback(ToStringView(ToFlatBufferBuilder(DataRecordStruct{
+                           .record = KeyValueMutationRecordStruct{
+                               type, 3, key, "value"}})))
+                  .IgnoreError();
+            }
             return absl::OkStatus();
           });
   EXPECT_CALL(delta_stream_reader_factory_, CreateConcurrentReader)
       .WillOnce(Return(ByMove(std::move(reader))));
+  // All the records are applied before the tombstones are removed.
+  Sequence update, deletion;
+  EXPECT_CALL(cache_, UpdateKeyValue("foo", "value", 3))
+      .Times(1)
+      .InSequence(update);
+  EXPECT_CALL(cache_, DeleteKey("bar", 3)).Times(1).InSequence(deletion);
+  EXPECT_CALL(cache_, RemoveDeletedKeys(3))
+      .Times(1)
+      .InSequence(update, deletion);
 
-  EXPECT_CALL(udf_client_, SetCodeObject(CodeConfig{.js = "function hello(){}",
-                                                    .udf_handler_name = "hello",
-                                                    .logical_commit_time = 1}))
-      .WillOnce(Return(absl::UnknownError("Some error.")));
+  auto options = DataOrchestrator::Options{
+      .data_bucket = GetTestLocation().bucket,
+      .cache = cache_,
+      .blob_client = blob_client_,
+      .delta_notifier = notifier_,
+      .change_notifier = change_notifier_,
+      .udf_client = udf_client_,
+      .delta_stream_reader_factory = delta_stream_reader_factory_,
+      .realtime_thread_pool_manager = realtime_thread_pool_manager_,
+      .num_apply_workers = 2};
   auto maybe_orchestrator =
-      DataOrchestrator::TryCreate(options_, metrics_recorder_);
+      DataOrchestrator::TryCreate(options, metrics_recorder_);
   ASSERT_TRUE(maybe_orchestrator.ok());
-
-  const std::string last_basename = ToDeltaFileName(1).value();
-  EXPECT_CALL(notifier_, Start(_, GetTestLocation(), last_basename, _))
-      .WillOnce(Return(absl::UnknownError("")));
-  EXPECT_FALSE((*maybe_orchestrator)->Start().ok());
 }
 
-TEST_F(DataOrchestratorTest, StartLoading) {
-  ON_CALL(blob_client_, ListBlobs)
-      .WillByDefault(Return(std::vector<std::string>({})));
-  auto maybe_orchestrator =
-      DataOrchestrator::TryCreate(options_, metrics_recorder_);
-  ASSERT_TRUE(maybe_orchestrator.ok());
-  auto orchestrator = std::move(maybe_orchestrator.value());
+TEST_F(DataOrchestratorTest, InitCacheLoadsDeltaFilesConcurrently) {
+  const std::vector<std::string> fnames(
+      {ToDeltaFileName(1).value(), ToDeltaFileName(2).value()});
+  EXPECT_CALL(
+      blob_client_,
+      ListBlobs(GetTestLocation(),
+                AllOf(Field(&BlobStorageClient::ListOptions::start_after, ""),
+                      Field(&BlobStorageClient::ListOptions::prefix,
+                            FilePrefix<FileType::SNAPSHOT>()))))
+      .WillOnce(Return(std::vector<std::string>()));
+  EXPECT_CALL(
+      blob_client_,
+      ListBlobs(GetTestLocation(),
+                AllOf(Field(&BlobStorageClient::ListOptions::start_after, ""),
+                      Field(&BlobStorageClient::ListOptions::prefix,
+                            FilePrefix<FileType::DELTA>()))))
+      .WillOnce(Return(fnames));
+  // Each file is read from a stream holding its name, so that the reader
+  // created for it can be told apart whichever file is loaded first.
+  std::istringstream first_stream(fnames[0]), second_stream(fnames[1]);
+  EXPECT_CALL(blob_client_, GetBlobReader)
+      .Times(2)
+      .WillRepeatedly([&](BlobStorageClient::DataLocation location)
+                          -> std::unique_ptr<BlobReader> {
+        auto blob_reader = std::make_unique<MockBlobReader>();
+        EXPECT_CALL(*blob_reader, Stream)
+            .WillOnce(ReturnRef(location.key == fnames[0]
+                                    ? static_cast<std::istream&>(first_stream)
+                                    : second_stream));
+        return blob_reader;
+      });
 
-  const std::string last_basename = "";
-  EXPECT_CALL(notifier_, Start(_, GetTestLocation(), last_basename, _))
-      .WillOnce([](BlobStorageChangeNotifier& change_notifier,
-                   BlobStorageClient::DataLocation location,
-                   std::string start_after,
-                   std::function<void(const std::string& key)> callback) {
-        callback(ToDeltaFileName(6).value());
-        callback(ToDeltaFileName(7).value());
-        LOG(INFO) << "Notified 2 files";
+  KVFileMetadata metadata;
+  absl::Notification second_file_read;
+  auto first_reader = std::make_unique<MockStreamRecordReader>();
+  EXPECT_CALL(*first_reader, GetKVFileMetadata).WillOnce(Return(metadata));
+  EXPECT_CALL(*first_reader, ReadStreamRecords)
+      .WillOnce([&second_file_read](
+                    const std::function<absl::Status(std::string_view)>&
+                        callback) {
+        // Only returns once the next file is read as well.
+        second_file_read.WaitForNotification();
+        callback(ToStringView(ToFlatBufferBuilder(DataRecordStruct{
+                     .record = KeyValueMutationRecordStruct{
+                         KeyValueMutationType::Delete, 5, "bar", ""}})))
+            .IgnoreError();
         return absl::OkStatus();
       });
+  auto second_reader = std::make_unique<MockStreamRecordReader>();
+  EXPECT_CALL(*second_reader, GetKVFileMetadata).WillOnce(Return(metadata));
+  EXPECT_CALL(*second_reader, ReadStreamRecords)
+      .WillOnce([&second_file_read](
+                    const std::function<absl::Status(std::string_view)>&
+                        callback) {
+        callback(ToStringView(ToFlatBufferBuilder(DataRecordStruct{
+                     .record = KeyValueMutationRecordStruct{
+                         KeyValueMutationType::Update, 3, "bar", "value"}})))
+            .IgnoreError();
+        second_file_read.Notify();
+        return absl::OkStatus();
+      });
+  EXPECT_CALL(delta_stream_reader_factory_, CreateConcurrentReader)
+      .Times(2)
+      .WillRepeatedly(
+          [&](MetricsRecorder&,
+              std::function<std::unique_ptr<RecordStream>()> stream_factory)
+              -> std::unique_ptr<StreamRecordReader<std::string_view>> {
+            std::string basename;
+            stream_factory()->Stream() >> basename;
+            return basename == fnames[0] ? std::move(first_reader)
+                                         : std::move(second_reader);
+          });
 
-  EXPECT_CALL(notifier_, IsRunning).Times(1).WillOnce(Return(true));
-  EXPECT_CALL(notifier_, Stop()).Times(1).WillOnce(Return(absl::OkStatus()));
+  EXPECT_CALL(cache_, DeleteKey("bar", 5)).Times(1);
+  EXPECT_CALL(cache_, UpdateKeyValue("bar", "value", 3)).Times(1);
+  // The tombstones of the second file, loaded first, are only removed along
+  // with those of the first file, once it's loaded.
+  EXPECT_CALL(cache_, RemoveDeletedKeys(5)).Times(1);
+  EXPECT_CALL(cache_, RemoveDeletedKeys(3)).Times(0);
+
+  auto options = DataOrchestrator::Options{
+      .data_bucket = GetTestLocation().bucket,
+      .cache = cache_,
+      .blob_client = blob_client_,
+      .delta_notifier = notifier_,
+      .change_notifier = change_notifier_,
+      .udf_client = udf_client_,
+      .delta_stream_reader_factory = delta_stream_reader_factory_,
+      .realtime_thread_pool_manager = realtime_thread_pool_manager_,
+      .num_concurrent_delta_loads = 2};
+  auto maybe_orchestrator =
+      DataOrchestrator::TryCreate(options, metrics_recorder_);
+  ASSERT_TRUE(maybe_orchestrator.ok());
+
+  // The last file is the one the cache is up to date with.
+  EXPECT_CALL(notifier_, Start(_, GetTestLocation(), fnames[1], _))
+      .WillOnce(Return(absl::UnknownError("")));
+  EXPECT_FALSE((*maybe_orchestrator)->Start().ok());
+}
+
+TEST_F(DataOrchestratorTest, InitCacheLoadsFreshInstanceAndSwapsItIn) {
+  const std::vector<std::string> fnames({ToDeltaFileName(1).value()});
+  EXPECT_CALL(
+      blob_client_,
+      ListBlobs(GetTestLocation(),
+                AllOf(Field(&BlobStorageClient::ListOptions::start_after, ""),
+                      Field(&BlobStorageClient::ListOptions::prefix,
+                            FilePrefix<FileType::SNAPSHOT>()))))
+      .WillOnce(Return(std::vector<std::string>()));
+  EXPECT_CALL(
+      blob_client_,
+      ListBlobs(GetTestLocation(),
+                AllOf(Field(&BlobStorageClient::ListOptions::start_after, ""),
+                      Field(&BlobStorageClient::ListOptions::prefix,
+                            FilePrefix<FileType::DELTA>()))))
+      .WillOnce(Return(fnames));
 
-  absl::Notification all_records_loaded;
   KVFileMetadata metadata;
-  auto update_reader = std::make_unique<MockStreamRecordReader>();
-  EXPECT_CALL(*update_reader, GetKVFileMetadata)
-      .Times(1)
-      .WillOnce(Return(metadata));
-  EXPECT_CALL(*update_reader, ReadStreamRecords)
+  auto reader = std::make_unique<MockStreamRecordReader>();
+  EXPECT_CALL(*reader, GetKVFileMetadata).Times(1).WillOnce(Return(metadata));
+  EXPECT_CALL(*reader, ReadStreamRecords)
       .Times(1)
       .WillOnce(
           [](const std::function<absl::Status(std::string_view)>& callback) {
@@ -500,58 +655,121 @@ TEST_F(DataOrchestratorTest, StartLoading) {
                 .IgnoreError();
             return absl::OkStatus();
           });
-  auto delete_reader = std::make_unique<MockStreamRecordReader>();
-  EXPECT_CALL(*delete_reader, GetKVFileMetadata)
-      .Times(1)
-      .WillOnce(Return(metadata));
-  EXPECT_CALL(*delete_reader, ReadStreamRecords)
-      .Times(1)
-      .WillOnce(
-          [&all_records_loaded](
-              const std::function<absl::Status(std::string_view)>& callback) {
-            callback(ToStringView(ToFlatBufferBuilder(
-                         DataRecordStruct{.record =
-                                              KeyValueMutationRecordStruct{
-                                                  KeyValueMutationType::Delete,
-                                                  3, "bar", "bar value"}})))
-                .IgnoreError();
-            all_records_loaded.Notify();
-            return absl::OkStatus();
-          });
   EXPECT_CALL(delta_stream_reader_factory_, CreateConcurrentReader)
-      .Times(2)
-      .WillOnce(Return(ByMove(std::move(update_reader))))
-      .WillOnce(Return(ByMove(std::move(delete_reader))));
-
-  EXPECT_CALL(cache_, UpdateKeyValue("bar", "bar value", 3)).Times(1);
-  EXPECT_CALL(cache_, DeleteKey("bar", 3)).Times(1);
-  EXPECT_CALL(cache_, RemoveDeletedKeys(3)).Times(2);
+      .WillOnce(Return(ByMove(std::move(reader))));
 
-  EXPECT_TRUE(orchestrator->Start().ok());
-  LOG(INFO) << "Created ContinuouslyLoadNewData";
-  all_records_loaded.WaitForNotificationWithTimeout(absl::Seconds(10));
-}
+  // The current instance isn't written to by the load, but its bytes count
+  // against the memory budget. The fresh instance is compacted inline, as
+  // the compactor compacts the current one until the swap.
+  auto current_cache = std::make_unique<testing::StrictMock<MockCache>>();
+  EXPECT_CALL(*current_cache, GetMemoryUsage)
+      .WillRepeatedly(Return(CacheMemoryUsage{.value_bytes = 50}));
+  auto fresh_cache = std::make_unique<testing::StrictMock<MockCache>>();
+  MockCache* fresh_cache_ptr = fresh_cache.get();
+  EXPECT_CALL(*fresh_cache, UpdateKeyValue("bar", "bar value", 3)).Times(1);
+  EXPECT_CALL(*fresh_cache, RemoveDeletedKeys(3)).Times(1);
+  EXPECT_CALL(*fresh_cache, GetMemoryUsage)
+      .WillRepeatedly(Return(CacheMemoryUsage{}));
+  std::vector<std::unique_ptr<Cache>> instances;
+  instances.push_back(std::move(current_cache));
+  instances.push_back(std::move(fresh_cache));
+  int next_instance = 0;
+  auto swappable_cache = SwappableCache::Create(
+      [&instances, &next_instance] {
+        return std::move(instances[next_instance++]);
+      });
+  auto tombstone_compactor =
+      TombstoneCompactor::Create(*swappable_cache, /*interval=*/absl::Hours(1));
 
-TEST_F(DataOrchestratorTest, CreateOrchestratorWithRealtimeDisabled) {
-  ON_CALL(blob_client_, ListBlobs)
-      .WillByDefault(Return(std::vector<std::string>({})));
+  auto options = DataOrchestrator::Options{
+      .data_bucket = GetTestLocation().bucket,
+      .cache = *swappable_cache,
+      .blob_client = blob_client_,
+      .delta_notifier = notifier_,
+      .change_notifier = change_notifier_,
+      .udf_client = udf_client_,
+      .delta_stream_reader_factory = delta_stream_reader_factory_,
+      .realtime_thread_pool_manager = realtime_thread_pool_manager_,
+      .memory_budget_bytes = 100,
+      .tombstone_compactor = tombstone_compactor.get(),
+      .swappable_cache = swappable_cache.get()};
   auto maybe_orchestrator =
-      DataOrchestrator::TryCreate(options_, metrics_recorder_);
+      DataOrchestrator::TryCreate(options, metrics_recorder_);
   ASSERT_TRUE(maybe_orchestrator.ok());
+
+  // Later updates and compactions go to the fresh instance.
+  EXPECT_CALL(*fresh_cache_ptr, DeleteKey("bar", 4)).Times(1);
+  swappable_cache->DeleteKey("bar", 4);
+  EXPECT_CALL(*fresh_cache_ptr, RemoveDeletedKeys(4)).Times(1);
+  tombstone_compactor->AdvanceCutoff(4);
+  tombstone_compactor->Compact();
 }
 
-TEST_F(DataOrchestratorTest, InitCacheShardedSuccessSkipRecord) {
-  testing::StrictMock<MockCache> strict_cache;
+TEST_F(DataOrchestratorTest, InitCacheCountsCurrentInstanceAgainstBudget) {
+  const std::vector<std::string> fnames({ToDeltaFileName(1).value()});
+  EXPECT_CALL(
+      blob_client_,
+      ListBlobs(GetTestLocation(),
+                AllOf(Field(&BlobStorageClient::ListOptions::start_after, ""),
+                      Field(&BlobStorageClient::ListOptions::prefix,
+                            FilePrefix<FileType::SNAPSHOT>()))))
+      .WillOnce(Return(std::vector<std::string>()));
+  EXPECT_CALL(
+      blob_client_,
+      ListBlobs(GetTestLocation(),
+                AllOf(Field(&BlobStorageClient::ListOptions::start_after, ""),
+                      Field(&BlobStorageClient::ListOptions::prefix,
+                            FilePrefix<FileType::DELTA>()))))
+      .WillOnce(Return(fnames));
 
-  const std::vector<std::string> fnames(
-      {ToDeltaFileName(1).value(), ToDeltaFileName(2).value()});
+  KVFileMetadata metadata;
+  auto reader = std::make_unique<MockStreamRecordReader>();
+  EXPECT_CALL(*reader, GetKVFileMetadata).Times(1).WillOnce(Return(metadata));
+  EXPECT_CALL(*reader, ReadStreamRecords).Times(0);
+  EXPECT_CALL(delta_stream_reader_factory_, CreateConcurrentReader)
+      .WillOnce(Return(ByMove(std::move(reader))));
+
+  // Neither instance is over the budget on its own.
+  auto current_cache = std::make_unique<testing::StrictMock<MockCache>>();
+  EXPECT_CALL(*current_cache, GetMemoryUsage)
+      .WillRepeatedly(Return(CacheMemoryUsage{.value_bytes = 60}));
+  auto fresh_cache = std::make_unique<testing::StrictMock<MockCache>>();
+  EXPECT_CALL(*fresh_cache, GetMemoryUsage)
+      .WillRepeatedly(Return(CacheMemoryUsage{.value_bytes = 60}));
+  std::vector<std::unique_ptr<Cache>> instances;
+  instances.push_back(std::move(current_cache));
+  instances.push_back(std::move(fresh_cache));
+  int next_instance = 0;
+  auto swappable_cache = SwappableCache::Create(
+      [&instances, &next_instance] {
+        return std::move(instances[next_instance++]);
+      });
+
+  auto options = DataOrchestrator::Options{
+      .data_bucket = GetTestLocation().bucket,
+      .cache = *swappable_cache,
+      .blob_client = blob_client_,
+      .delta_notifier = notifier_,
+      .change_notifier = change_notifier_,
+      .udf_client = udf_client_,
+      .delta_stream_reader_factory = delta_stream_reader_factory_,
+      .realtime_thread_pool_manager = realtime_thread_pool_manager_,
+      .memory_budget_bytes = 100,
+      .swappable_cache = swappable_cache.get()};
+  auto maybe_orchestrator =
+      DataOrchestrator::TryCreate(options, metrics_recorder_);
+  EXPECT_EQ(maybe_orchestrator.status().code(),
+            absl::StatusCode::kResourceExhausted);
+}
+
+TEST_F(DataOrchestratorTest, InitCacheLoadsFileIntoPartitionOfItsNamespace) {
+  const std::vector<std::string> fnames({ToDeltaFileName(1).value()});
   EXPECT_CALL(
       blob_client_,
       ListBlobs(GetTestLocation(),
                 AllOf(Field(&BlobStorageClient::ListOptions::start_after, ""),
                       Field(&BlobStorageClient::ListOptions::prefix,
                             FilePrefix<FileType::SNAPSHOT>()))))
-      .Times(1)
       .WillOnce(Return(std::vector<std::string>()));
   EXPECT_CALL(
       blob_client_,
@@ -562,37 +780,680 @@ TEST_F(DataOrchestratorTest, InitCacheShardedSuccessSkipRecord) {
       .WillOnce(Return(fnames));
 
   KVFileMetadata metadata;
-  auto update_reader = std::make_unique<MockStreamRecordReader>();
-  EXPECT_CALL(*update_reader, GetKVFileMetadata)
-      .Times(1)
-      .WillOnce(Return(metadata));
-  EXPECT_CALL(*update_reader, ReadStreamRecords)
+  metadata.set_key_namespace(KeyNamespace::KEYS);
+  auto reader = std::make_unique<MockStreamRecordReader>();
+  EXPECT_CALL(*reader, GetKVFileMetadata).Times(1).WillOnce(Return(metadata));
+  EXPECT_CALL(*reader, ReadStreamRecords)
       .Times(1)
       .WillOnce(
           [](const std::function<absl::Status(std::string_view)>& callback) {
-            // key: "shard1" -> shard num: 0
             callback(ToStringView(ToFlatBufferBuilder(
                          DataRecordStruct{.record =
                                               KeyValueMutationRecordStruct{
                                                   KeyValueMutationType::Update,
-                                                  3, "shard1", "bar value"}})))
-                .IgnoreError();
-            return absl::OkStatus();
-          });
-  auto delete_reader = std::make_unique<MockStreamRecordReader>();
-  EXPECT_CALL(*delete_reader, GetKVFileMetadata)
-      .Times(1)
-      .WillOnce(Return(metadata));
-  EXPECT_CALL(*delete_reader, ReadStreamRecords)
-      .Times(1)
-      .WillOnce(
-          [](const std::function<absl::Status(std::string_view)>& callback) {
-            // key: "shard2" -> shard num: 1
-            callback(ToStringView(ToFlatBufferBuilder(
-                         DataRecordStruct{.record =
-                                              KeyValueMutationRecordStruct{
-                                                  KeyValueMutationType::Delete,
-                                                  3, "shard2", "bar value"}})))
+                                                  3, "bar", "bar value"}})))
+                .IgnoreError();
+            return absl::OkStatus();
+          });
+  EXPECT_CALL(delta_stream_reader_factory_, CreateConcurrentReader)
+      .WillOnce(Return(ByMove(std::move(reader))));
+
+  std::vector<testing::NiceMock<MockCache>*> tables;
+  auto partitioned_cache =
+      PartitionedCache::Create([&tables](KeyNamespace::Enum) {
+        auto table = std::make_unique<testing::NiceMock<MockCache>>();
+        tables.push_back(table.get());
+        return table;
+      });
+  EXPECT_CALL(*tables[KeyNamespace::KEYS],
+              UpdateKeyValue("bar", "bar value", 3))
+      .Times(1);
+  EXPECT_CALL(*tables[KeyNamespace::KEY_NAMESPACE_UNSPECIFIED], UpdateKeyValue)
+      .Times(0);
+  // Deleted keys are removed from every partition.
+  for (auto* table : tables) {
+    EXPECT_CALL(*table, RemoveDeletedKeys(3)).Times(1);
+  }
+
+  auto options = DataOrchestrator::Options{
+      .data_bucket = GetTestLocation().bucket,
+      .cache = *partitioned_cache,
+      .blob_client = blob_client_,
+      .delta_notifier = notifier_,
+      .change_notifier = change_notifier_,
+      .udf_client = udf_client_,
+      .delta_stream_reader_factory = delta_stream_reader_factory_,
+      .realtime_thread_pool_manager = realtime_thread_pool_manager_};
+  auto maybe_orchestrator =
+      DataOrchestrator::TryCreate(options, metrics_recorder_);
+  ASSERT_TRUE(maybe_orchestrator.ok());
+}
+
+TEST_F(DataOrchestratorTest, InitCacheLoadsCacheImageInsteadOfSnapshot) {
+  const std::string image_path =
+      WriteTestCacheImage("fresh_image", ToDeltaFileName(7).value());
+  EXPECT_CALL(
+      blob_client_,
+      ListBlobs(GetTestLocation(),
+                AllOf(Field(&BlobStorageClient::ListOptions::start_after, ""),
+                      Field(&BlobStorageClient::ListOptions::prefix,
+                            FilePrefix<FileType::SNAPSHOT>()))))
+      .WillOnce(Return(std::vector<std::string>({*ToSnapshotFileName(1)})));
+  KVFileMetadata snapshot_metadata;
+  *snapshot_metadata.mutable_snapshot()->mutable_ending_delta_file() =
+      ToDeltaFileName(5).value();
+  auto snapshot_reader = std::make_unique<MockStreamRecordReader>();
+  EXPECT_CALL(*snapshot_reader, GetKVFileMetadata)
+      .WillOnce(Return(snapshot_metadata));
+  // Only the image is read.
+  auto image_reader = std::make_unique<MockStreamRecordReader>();
+  EXPECT_CALL(*image_reader, GetKVFileMetadata)
+      .WillOnce(Return(KVFileMetadata()));
+  EXPECT_CALL(*image_reader, ReadStreamRecords)
+      .WillOnce(
+          [](const std::function<absl::Status(std::string_view)>& callback) {
+            callback(ToStringView(ToFlatBufferBuilder(
+                         DataRecordStruct{.record =
+                                              KeyValueMutationRecordStruct{
+                                                  KeyValueMutationType::Update,
+                                                  3, "bar", "bar value"}})))
+                .IgnoreError();
+            return absl::OkStatus();
+          });
+  EXPECT_CALL(delta_stream_reader_factory_, CreateConcurrentReader)
+      .WillOnce(Return(ByMove(std::move(snapshot_reader))))
+      .WillOnce(Return(ByMove(std::move(image_reader))));
+  EXPECT_CALL(cache_, UpdateKeyValue("bar", "bar value", 3)).Times(1);
+  EXPECT_CALL(cache_, RemoveDeletedKeys(3)).Times(1);
+  EXPECT_CALL(cache_, GetMemoryUsage)
+      .WillRepeatedly(Return(CacheMemoryUsage{}));
+  // Only the deltas after the image are loaded.
+  EXPECT_CALL(
+      blob_client_,
+      ListBlobs(GetTestLocation(),
+                AllOf(Field(&BlobStorageClient::ListOptions::start_after,
+                            ToDeltaFileName(7).value()),
+                      Field(&BlobStorageClient::ListOptions::prefix,
+                            FilePrefix<FileType::DELTA>()))))
+      .WillOnce(Return(std::vector<std::string>()));
+
+  auto options = DataOrchestrator::Options{
+      .data_bucket = GetTestLocation().bucket,
+      .cache = cache_,
+      .blob_client = blob_client_,
+      .delta_notifier = notifier_,
+      .change_notifier = change_notifier_,
+      .udf_client = udf_client_,
+      .delta_stream_reader_factory = delta_stream_reader_factory_,
+      .realtime_thread_pool_manager = realtime_thread_pool_manager_,
+      .cache_image_path = image_path};
+  EXPECT_TRUE(DataOrchestrator::TryCreate(options, metrics_recorder_).ok());
+}
+
+TEST_F(DataOrchestratorTest, InitCacheLoadsCacheImageWithLogicalShardMapping) {
+  // Logical shards 1 and 3 are mapped to shard 0, so the shard of the image
+  // isn't one of its logical shards.
+  std::vector<ShardMappingRecordStruct> mapping_records;
+  for (int32_t logical_shard = 0; logical_shard < 4; ++logical_shard) {
+    mapping_records.push_back({.logical_shard = logical_shard,
+                               .physical_shard = (logical_shard + 1) % 2});
+  }
+  const auto mapping = LogicalShardMapping::Create(4, 2, mapping_records);
+  ASSERT_TRUE(mapping.ok()) << mapping.status();
+  std::string key = "key";
+  while (mapping->GetPhysicalShardForKey(ShardingFunction(""), key) != 0) {
+    key += "0";
+  }
+
+  const std::string image_path =
+      WriteTestCacheImage("logical_image", ToDeltaFileName(7).value());
+  EXPECT_CALL(
+      blob_client_,
+      ListBlobs(GetTestLocation(),
+                AllOf(Field(&BlobStorageClient::ListOptions::start_after, ""),
+                      Field(&BlobStorageClient::ListOptions::prefix,
+                            FilePrefix<FileType::SNAPSHOT>()))))
+      .WillOnce(Return(std::vector<std::string>({*ToSnapshotFileName(1)})));
+  KVFileMetadata snapshot_metadata;
+  *snapshot_metadata.mutable_snapshot()->mutable_ending_delta_file() =
+      ToDeltaFileName(5).value();
+  auto snapshot_reader = std::make_unique<MockStreamRecordReader>();
+  EXPECT_CALL(*snapshot_reader, GetKVFileMetadata)
+      .WillOnce(Return(snapshot_metadata));
+  KVFileMetadata image_metadata;
+  image_metadata.mutable_sharding_metadata()->set_shard_num(0);
+  auto image_reader = std::make_unique<MockStreamRecordReader>();
+  EXPECT_CALL(*image_reader, GetKVFileMetadata)
+      .WillOnce(Return(image_metadata));
+  EXPECT_CALL(*image_reader, ReadStreamRecords)
+      .WillOnce([&key](const std::function<absl::Status(std::string_view)>&
+                           callback) {
+        callback(ToStringView(ToFlatBufferBuilder(DataRecordStruct{
+                     .record = KeyValueMutationRecordStruct{
+                         KeyValueMutationType::Update, 3, key, "value"}})))
+            .IgnoreError();
+        return absl::OkStatus();
+      });
+  EXPECT_CALL(delta_stream_reader_factory_, CreateConcurrentReader)
+      .WillOnce(Return(ByMove(std::move(snapshot_reader))))
+      .WillOnce(Return(ByMove(std::move(image_reader))));
+  EXPECT_CALL(cache_, UpdateKeyValue(key, "value", 3)).Times(1);
+  EXPECT_CALL(cache_, RemoveDeletedKeys(3)).Times(1);
+  EXPECT_CALL(cache_, GetMemoryUsage)
+      .WillRepeatedly(Return(CacheMemoryUsage{}));
+  EXPECT_CALL(
+      blob_client_,
+      ListBlobs(GetTestLocation(),
+                AllOf(Field(&BlobStorageClient::ListOptions::start_after,
+                            ToDeltaFileName(7).value()),
+                      Field(&BlobStorageClient::ListOptions::prefix,
+                            FilePrefix<FileType::DELTA>()))))
+      .WillOnce(Return(std::vector<std::string>()));
+
+  auto options = DataOrchestrator::Options{
+      .data_bucket = GetTestLocation().bucket,
+      .cache = cache_,
+      .blob_client = blob_client_,
+      .delta_notifier = notifier_,
+      .change_notifier = change_notifier_,
+      .udf_client = udf_client_,
+      .delta_stream_reader_factory = delta_stream_reader_factory_,
+      .realtime_thread_pool_manager = realtime_thread_pool_manager_,
+      .shard_num = 0,
+      .num_shards = 2,
+      .logical_shard_mapping = &*mapping,
+      .cache_image_path = image_path};
+  EXPECT_TRUE(DataOrchestrator::TryCreate(options, metrics_recorder_).ok());
+}
+
+TEST_F(DataOrchestratorTest, InitCacheLoadsSnapshotWhenCacheImageIsStale) {
+  const std::string image_path =
+      WriteTestCacheImage("stale_image", ToDeltaFileName(3).value());
+  EXPECT_CALL(
+      blob_client_,
+      ListBlobs(GetTestLocation(),
+                AllOf(Field(&BlobStorageClient::ListOptions::start_after, ""),
+                      Field(&BlobStorageClient::ListOptions::prefix,
+                            FilePrefix<FileType::SNAPSHOT>()))))
+      .WillOnce(Return(std::vector<std::string>({*ToSnapshotFileName(1)})));
+  KVFileMetadata snapshot_metadata;
+  *snapshot_metadata.mutable_snapshot()->mutable_ending_delta_file() =
+      ToDeltaFileName(5).value();
+  auto record_reader1 = std::make_unique<MockStreamRecordReader>();
+  EXPECT_CALL(*record_reader1, GetKVFileMetadata)
+      .WillOnce(Return(snapshot_metadata));
+  auto record_reader2 = std::make_unique<MockStreamRecordReader>();
+  EXPECT_CALL(*record_reader2, GetKVFileMetadata)
+      .WillOnce(Return(snapshot_metadata));
+  EXPECT_CALL(*record_reader2, ReadStreamRecords)
+      .WillOnce(Return(absl::OkStatus()));
+  EXPECT_CALL(delta_stream_reader_factory_, CreateConcurrentReader)
+      .WillOnce(Return(ByMove(std::move(record_reader1))))
+      .WillOnce(Return(ByMove(std::move(record_reader2))));
+  EXPECT_CALL(cache_, RemoveDeletedKeys(0)).Times(1);
+  EXPECT_CALL(cache_, GetMemoryUsage)
+      .WillRepeatedly(Return(CacheMemoryUsage{}));
+  EXPECT_CALL(
+      blob_client_,
+      ListBlobs(GetTestLocation(),
+                AllOf(Field(&BlobStorageClient::ListOptions::start_after,
+                            ToDeltaFileName(5).value()),
+                      Field(&BlobStorageClient::ListOptions::prefix,
+                            FilePrefix<FileType::DELTA>()))))
+      .WillOnce(Return(std::vector<std::string>()));
+
+  auto options = DataOrchestrator::Options{
+      .data_bucket = GetTestLocation().bucket,
+      .cache = cache_,
+      .blob_client = blob_client_,
+      .delta_notifier = notifier_,
+      .change_notifier = change_notifier_,
+      .udf_client = udf_client_,
+      .delta_stream_reader_factory = delta_stream_reader_factory_,
+      .realtime_thread_pool_manager = realtime_thread_pool_manager_,
+      .cache_image_path = image_path};
+  EXPECT_TRUE(DataOrchestrator::TryCreate(options, metrics_recorder_).ok());
+}
+
+TEST_F(DataOrchestratorTest, InitCacheBuildsTieredCacheBaseFromSnapshot) {
+  const std::string base_path =
+      absl::StrCat(::testing::TempDir(), "/tiered_cache_base");
+  EXPECT_CALL(
+      blob_client_,
+      ListBlobs(GetTestLocation(),
+                AllOf(Field(&BlobStorageClient::ListOptions::start_after, ""),
+                      Field(&BlobStorageClient::ListOptions::prefix,
+                            FilePrefix<FileType::SNAPSHOT>()))))
+      .WillOnce(Return(std::vector<std::string>({*ToSnapshotFileName(1)})));
+  KVFileMetadata snapshot_metadata;
+  *snapshot_metadata.mutable_snapshot()->mutable_ending_delta_file() =
+      ToDeltaFileName(5).value();
+  auto record_reader1 = std::make_unique<MockStreamRecordReader>();
+  EXPECT_CALL(*record_reader1, GetKVFileMetadata)
+      .WillOnce(Return(snapshot_metadata));
+  auto record_reader2 = std::make_unique<MockStreamRecordReader>();
+  EXPECT_CALL(*record_reader2, GetKVFileMetadata)
+      .WillOnce(Return(snapshot_metadata));
+  EXPECT_CALL(*record_reader2, ReadStreamRecords)
+      .WillOnce(
+          [](const std::function<absl::Status(std::string_view)>& callback) {
+            callback(ToStringView(ToFlatBufferBuilder(
+                         DataRecordStruct{.record =
+                                              KeyValueMutationRecordStruct{
+                                                  KeyValueMutationType::Update,
+                                                  3, "bar", "bar value"}})))
+                .IgnoreError();
+            return absl::OkStatus();
+          });
+  EXPECT_CALL(delta_stream_reader_factory_, CreateConcurrentReader)
+      .WillOnce(Return(ByMove(std::move(record_reader1))))
+      .WillOnce(Return(ByMove(std::move(record_reader2))));
+  EXPECT_CALL(
+      blob_client_,
+      ListBlobs(GetTestLocation(),
+                AllOf(Field(&BlobStorageClient::ListOptions::start_after,
+                            ToDeltaFileName(5).value()),
+                      Field(&BlobStorageClient::ListOptions::prefix,
+                            FilePrefix<FileType::DELTA>()))))
+      .WillOnce(Return(std::vector<std::string>()));
+
+  auto tiered_cache = TieredKeyValueCache::Create(metrics_recorder_, base_path);
+  auto options = DataOrchestrator::Options{
+      .data_bucket = GetTestLocation().bucket,
+      .cache = *tiered_cache,
+      .blob_client = blob_client_,
+      .delta_notifier = notifier_,
+      .change_notifier = change_notifier_,
+      .udf_client = udf_client_,
+      .delta_stream_reader_factory = delta_stream_reader_factory_,
+      .realtime_thread_pool_manager = realtime_thread_pool_manager_,
+      .tiered_cache = tiered_cache.get()};
+  EXPECT_TRUE(DataOrchestrator::TryCreate(options, metrics_recorder_).ok());
+  EXPECT_TRUE(std::filesystem::exists(base_path));
+  EXPECT_THAT(tiered_cache->GetKeyValuePairs({"bar"}),
+              UnorderedElementsAre(KVPairEq("bar", "bar value")));
+}
+
+TEST_F(DataOrchestratorTest, InitCacheFailsWhenOverMemoryBudget) {
+  const std::vector<std::string> fnames({ToDeltaFileName(1).value()});
+  EXPECT_CALL(
+      blob_client_,
+      ListBlobs(GetTestLocation(),
+                AllOf(Field(&BlobStorageClient::ListOptions::start_after, ""),
+                      Field(&BlobStorageClient::ListOptions::prefix,
+                            FilePrefix<FileType::SNAPSHOT>()))))
+      .WillOnce(Return(std::vector<std::string>()));
+  EXPECT_CALL(
+      blob_client_,
+      ListBlobs(GetTestLocation(),
+                AllOf(Field(&BlobStorageClient::ListOptions::start_after, ""),
+                      Field(&BlobStorageClient::ListOptions::prefix,
+                            FilePrefix<FileType::DELTA>()))))
+      .WillOnce(Return(fnames));
+
+  KVFileMetadata metadata;
+  auto reader = std::make_unique<MockStreamRecordReader>();
+  EXPECT_CALL(*reader, GetKVFileMetadata).Times(1).WillOnce(Return(metadata));
+  EXPECT_CALL(*reader, ReadStreamRecords).Times(0);
+  EXPECT_CALL(delta_stream_reader_factory_, CreateConcurrentReader)
+      .WillOnce(Return(ByMove(std::move(reader))));
+  EXPECT_CALL(cache_, GetMemoryUsage)
+      .WillRepeatedly(Return(CacheMemoryUsage{.value_bytes = 100}));
+  EXPECT_CALL(cache_, UpdateKeyValue).Times(0);
+  EXPECT_CALL(cache_, RemoveDeletedKeys).Times(0);
+
+  auto options = DataOrchestrator::Options{
+      .data_bucket = GetTestLocation().bucket,
+      .cache = cache_,
+      .blob_client = blob_client_,
+      .delta_notifier = notifier_,
+      .change_notifier = change_notifier_,
+      .udf_client = udf_client_,
+      .delta_stream_reader_factory = delta_stream_reader_factory_,
+      .realtime_thread_pool_manager = realtime_thread_pool_manager_,
+      .memory_budget_bytes = 100};
+  auto maybe_orchestrator =
+      DataOrchestrator::TryCreate(options, metrics_recorder_);
+  EXPECT_EQ(maybe_orchestrator.status().code(),
+            absl::StatusCode::kResourceExhausted);
+}
+
+TEST_F(DataOrchestratorTest, InitCacheResumesLoadPausedOnMemoryBudget) {
+  const std::vector<std::string> fnames({ToDeltaFileName(1).value()});
+  EXPECT_CALL(
+      blob_client_,
+      ListBlobs(GetTestLocation(),
+                AllOf(Field(&BlobStorageClient::ListOptions::start_after, ""),
+                      Field(&BlobStorageClient::ListOptions::prefix,
+                            FilePrefix<FileType::SNAPSHOT>()))))
+      .WillOnce(Return(std::vector<std::string>()));
+  EXPECT_CALL(
+      blob_client_,
+      ListBlobs(GetTestLocation(),
+                AllOf(Field(&BlobStorageClient::ListOptions::start_after, ""),
+                      Field(&BlobStorageClient::ListOptions::prefix,
+                            FilePrefix<FileType::DELTA>()))))
+      .WillOnce(Return(fnames));
+
+  KVFileMetadata metadata;
+  auto reader = std::make_unique<MockStreamRecordReader>();
+  EXPECT_CALL(*reader, GetKVFileMetadata).Times(1).WillOnce(Return(metadata));
+  EXPECT_CALL(*reader, ReadStreamRecords)
+      .WillOnce(
+          [](const std::function<absl::Status(std::string_view)>& callback) {
+            return callback(ToStringView(ToFlatBufferBuilder(
+                DataRecordStruct{.record = KeyValueMutationRecordStruct{
+                                     KeyValueMutationType::Update, 3, "bar",
+                                     "bar value"}})));
+          });
+  EXPECT_CALL(delta_stream_reader_factory_, CreateConcurrentReader)
+      .WillOnce(Return(ByMove(std::move(reader))));
+  // Under budget when the file is opened, over it when the first record is
+  // read, and under it again once the load has paused.
+  EXPECT_CALL(cache_, GetMemoryUsage)
+      .WillOnce(Return(CacheMemoryUsage{}))
+      .WillOnce(Return(CacheMemoryUsage{.value_bytes = 100}))
+      .WillRepeatedly(Return(CacheMemoryUsage{}));
+  EXPECT_CALL(cache_, UpdateKeyValue("bar", "bar value", 3)).Times(1);
+  EXPECT_CALL(cache_, RemoveDeletedKeys(3)).Times(1);
+
+  auto options = DataOrchestrator::Options{
+      .data_bucket = GetTestLocation().bucket,
+      .cache = cache_,
+      .blob_client = blob_client_,
+      .delta_notifier = notifier_,
+      .change_notifier = change_notifier_,
+      .udf_client = udf_client_,
+      .delta_stream_reader_factory = delta_stream_reader_factory_,
+      .realtime_thread_pool_manager = realtime_thread_pool_manager_,
+      .memory_budget_bytes = 100};
+  EXPECT_TRUE(DataOrchestrator::TryCreate(options, metrics_recorder_).ok());
+}
+
+TEST_F(DataOrchestratorTest, UpdateUdfCodeSuccess) {
+  const std::vector<std::string> fnames({ToDeltaFileName(1).value()});
+  EXPECT_CALL(
+      blob_client_,
+      ListBlobs(GetTestLocation(),
+                AllOf(Field(&BlobStorageClient::ListOptions::start_after, ""),
+                      Field(&BlobStorageClient::ListOptions::prefix,
+                            FilePrefix<FileType::SNAPSHOT>()))))
+      .WillOnce(Return(std::vector<std::string>()));
+  EXPECT_CALL(
+      blob_client_,
+      ListBlobs(GetTestLocation(),
+                AllOf(Field(&BlobStorageClient::ListOptions::start_after, ""),
+                      Field(&BlobStorageClient::ListOptions::prefix,
+                            FilePrefix<FileType::DELTA>()))))
+      .WillOnce(Return(fnames));
+
+  KVFileMetadata metadata;
+  auto reader = std::make_unique<MockStreamRecordReader>();
+  EXPECT_CALL(*reader, GetKVFileMetadata).Times(1).WillOnce(Return(metadata));
+  EXPECT_CALL(*reader, ReadStreamRecords)
+      .WillOnce(
+          [](const std::function<absl::Status(std::string_view)>& callback) {
+            callback(ToStringView(ToFlatBufferBuilder(DataRecordStruct{
+                         .record =
+                             UserDefinedFunctionsConfigStruct{
+                                 .code_snippet = "function hello(){}",
+                                 .handler_name = "hello",
+                                 .language =
+                                     UserDefinedFunctionsLanguage::Javascript,
+                                 .logical_commit_time = 1}})))
+                .IgnoreError();
+            return absl::OkStatus();
+          });
+  EXPECT_CALL(delta_stream_reader_factory_, CreateConcurrentReader)
+      .WillOnce(Return(ByMove(std::move(reader))));
+
+  EXPECT_CALL(udf_client_, SetCodeObject(CodeConfig{.js = "function hello(){}",
+                                                    .udf_handler_name = "hello",
+                                                    .logical_commit_time = 1}))
+      .WillOnce(Return(absl::OkStatus()));
+  auto maybe_orchestrator =
+      DataOrchestrator::TryCreate(options_, metrics_recorder_);
+  ASSERT_TRUE(maybe_orchestrator.ok());
+
+  const std::string last_basename = ToDeltaFileName(1).value();
+  EXPECT_CALL(notifier_, Start(_, GetTestLocation(), last_basename, _))
+      .WillOnce(Return(absl::UnknownError("")));
+  EXPECT_FALSE((*maybe_orchestrator)->Start().ok());
+}
+
+TEST_F(DataOrchestratorTest, UpdateUdfCodeFails_OrchestratorContinues) {
+  const std::vector<std::string> fnames({ToDeltaFileName(1).value()});
+  EXPECT_CALL(
+      blob_client_,
+      ListBlobs(GetTestLocation(),
+                AllOf(Field(&BlobStorageClient::ListOptions::start_after, ""),
+                      Field(&BlobStorageClient::ListOptions::prefix,
+                            FilePrefix<FileType::SNAPSHOT>()))))
+      .WillOnce(Return(std::vector<std::string>()));
+  EXPECT_CALL(
+      blob_client_,
+      ListBlobs(GetTestLocation(),
+                AllOf(Field(&BlobStorageClient::ListOptions::start_after, ""),
+                      Field(&BlobStorageClient::ListOptions::prefix,
+                            FilePrefix<FileType::DELTA>()))))
+      .WillOnce(Return(fnames));
+
+  KVFileMetadata metadata;
+  auto reader = std::make_unique<MockStreamRecordReader>();
+  EXPECT_CALL(*reader, GetKVFileMetadata).Times(1).WillOnce(Return(metadata));
+  EXPECT_CALL(*reader, ReadStreamRecords)
+      .WillOnce(
+          [](const std::function<absl::Status(std::string_view)>& callback) {
+            callback(ToStringView(ToFlatBufferBuilder(DataRecordStruct{
+                         .record =
+                             UserDefinedFunctionsConfigStruct{
+                                 .code_snippet = "function hello(){}",
+                                 .handler_name = "hello",
+                                 .language =
+                                     UserDefinedFunctionsLanguage::Javascript,
+                                 .logical_commit_time = 1}})))
+                .IgnoreError();
+            return absl::OkStatus();
+          });
+  EXPECT_CALL(delta_stream_reader_factory_, CreateConcurrentReader)
+      .WillOnce(Return(ByMove(std::move(reader))));
+
+  EXPECT_CALL(udf_client_, SetCodeObject(CodeConfig{.js = "function hello(){}",
+                                                    .udf_handler_name = "hello",
+                                                    .logical_commit_time = 1}))
+      .WillOnce(Return(absl::UnknownError("Some error.")));
+  auto maybe_orchestrator =
+      DataOrchestrator::TryCreate(options_, metrics_recorder_);
+  ASSERT_TRUE(maybe_orchestrator.ok());
+
+  const std::string last_basename = ToDeltaFileName(1).value();
+  EXPECT_CALL(notifier_, Start(_, GetTestLocation(), last_basename, _))
+      .WillOnce(Return(absl::UnknownError("")));
+  EXPECT_FALSE((*maybe_orchestrator)->Start().ok());
+}
+
+TEST_F(DataOrchestratorTest, StartLoading) {
+  ON_CALL(blob_client_, ListBlobs)
+      .WillByDefault(Return(std::vector<std::string>({})));
+  auto maybe_orchestrator =
+      DataOrchestrator::TryCreate(options_, metrics_recorder_);
+  ASSERT_TRUE(maybe_orchestrator.ok());
+  auto orchestrator = std::move(maybe_orchestrator.value());
+
+  const std::string last_basename = "";
+  EXPECT_CALL(notifier_, Start(_, GetTestLocation(), last_basename, _))
+      .WillOnce([](BlobStorageChangeNotifier& change_notifier,
+                   BlobStorageClient::DataLocation location,
+                   std::string start_after,
+                   std::function<void(const std::string& key)> callback) {
+        callback(ToDeltaFileName(6).value());
+        callback(ToDeltaFileName(7).value());
+        LOG(INFO) << "Notified 2 files";
+        return absl::OkStatus();
+      });
+
+  EXPECT_CALL(notifier_, IsRunning).Times(1).WillOnce(Return(true));
+  EXPECT_CALL(notifier_, Stop()).Times(1).WillOnce(Return(absl::OkStatus()));
+
+  absl::Notification all_records_loaded;
+  KVFileMetadata metadata;
+  auto update_reader = std::make_unique<MockStreamRecordReader>();
+  EXPECT_CALL(*update_reader, GetKVFileMetadata)
+      .Times(1)
+      .WillOnce(Return(metadata));
+  EXPECT_CALL(*update_reader, ReadStreamRecords)
+      .Times(1)
+      .WillOnce(
+          [](const std::function<absl::Status(std::string_view)>& callback) {
+            callback(ToStringView(ToFlatBufferBuilder(
+                         DataRecordStruct{.record =
+                                              KeyValueMutationRecordStruct{
+                                                  KeyValueMutationType::Update,
+                                                  3, "bar", "bar value"}})))
+                .IgnoreError();
+            return absl::OkStatus();
+          });
+  auto delete_reader = std::make_unique<MockStreamRecordReader>();
+  EXPECT_CALL(*delete_reader, GetKVFileMetadata)
+      .Times(1)
+      .WillOnce(Return(metadata));
+  EXPECT_CALL(*delete_reader, ReadStreamRecords)
+      .Times(1)
+      .WillOnce(
+          [&all_records_loaded](
+              const std::function<absl::Status(std::string_view)>& callback) {
+            callback(ToStringView(ToFlatBufferBuilder(
+                         DataRecordStruct{.record =
+                                              KeyValueMutationRecordStruct{
+                                                  KeyValueMutationType::Delete,
+                                                  3, "bar", "bar value"}})))
+                .IgnoreError();
+            all_records_loaded.Notify();
+            return absl::OkStatus();
+          });
+  EXPECT_CALL(delta_stream_reader_factory_, CreateConcurrentReader)
+      .Times(2)
+      .WillOnce(Return(ByMove(std::move(update_reader))))
+      .WillOnce(Return(ByMove(std::move(delete_reader))));
+
+  EXPECT_CALL(cache_, UpdateKeyValue("bar", "bar value", 3)).Times(1);
+  EXPECT_CALL(cache_, DeleteKey("bar", 3)).Times(1);
+  EXPECT_CALL(cache_, RemoveDeletedKeys(3)).Times(2);
+
+  EXPECT_TRUE(orchestrator->Start().ok());
+  LOG(INFO) << "Created ContinuouslyLoadNewData";
+  all_records_loaded.WaitForNotificationWithTimeout(absl::Seconds(10));
+}
+
+TEST_F(DataOrchestratorTest, CreateOrchestratorWithRealtimeDisabled) {
+  ON_CALL(blob_client_, ListBlobs)
+      .WillByDefault(Return(std::vector<std::string>({})));
+  auto maybe_orchestrator =
+      DataOrchestrator::TryCreate(options_, metrics_recorder_);
+  ASSERT_TRUE(maybe_orchestrator.ok());
+}
+
+TEST_F(DataOrchestratorTest, InitCacheFailsOnFileShardedByAnotherFunction) {
+  const std::vector<std::string> fnames({ToDeltaFileName(1).value()});
+  EXPECT_CALL(
+      blob_client_,
+      ListBlobs(GetTestLocation(),
+                AllOf(Field(&BlobStorageClient::ListOptions::start_after, ""),
+                      Field(&BlobStorageClient::ListOptions::prefix,
+                            FilePrefix<FileType::SNAPSHOT>()))))
+      .WillOnce(Return(std::vector<std::string>()));
+  EXPECT_CALL(
+      blob_client_,
+      ListBlobs(GetTestLocation(),
+                AllOf(Field(&BlobStorageClient::ListOptions::start_after, ""),
+                      Field(&BlobStorageClient::ListOptions::prefix,
+                            FilePrefix<FileType::DELTA>()))))
+      .WillOnce(Return(fnames));
+
+  KVFileMetadata metadata;
+  metadata.mutable_sharding_metadata()->set_shard_num(1);
+  metadata.mutable_sharding_metadata()->set_sharding_function_version(
+      ShardingFunctionVersion::HIGHWAYHASH);
+  auto reader = std::make_unique<MockStreamRecordReader>();
+  EXPECT_CALL(*reader, GetKVFileMetadata).Times(1).WillOnce(Return(metadata));
+  EXPECT_CALL(*reader, ReadStreamRecords).Times(0);
+  EXPECT_CALL(delta_stream_reader_factory_, CreateConcurrentReader)
+      .WillOnce(Return(ByMove(std::move(reader))));
+  EXPECT_CALL(cache_, UpdateKeyValue).Times(0);
+  EXPECT_CALL(cache_, RemoveDeletedKeys).Times(0);
+
+  auto sharded_options = DataOrchestrator::Options{
+      .data_bucket = GetTestLocation().bucket,
+      .cache = cache_,
+      .blob_client = blob_client_,
+      .delta_notifier = notifier_,
+      .change_notifier = change_notifier_,
+      .udf_client = udf_client_,
+      .delta_stream_reader_factory = delta_stream_reader_factory_,
+      .realtime_thread_pool_manager = realtime_thread_pool_manager_,
+      .shard_num = 1,
+      .num_shards = 2,
+      .sharding_function_version = ShardingFunctionVersion::SHA256,
+  };
+  auto maybe_orchestrator =
+      DataOrchestrator::TryCreate(sharded_options, metrics_recorder_);
+  EXPECT_EQ(maybe_orchestrator.status().code(),
+            absl::StatusCode::kFailedPrecondition);
+}
+
+TEST_F(DataOrchestratorTest, InitCacheShardedSuccessSkipRecord) {
+  testing::StrictMock<MockCache> strict_cache;
+
+  const std::vector<std::string> fnames(
+      {ToDeltaFileName(1).value(), ToDeltaFileName(2).value()});
+  EXPECT_CALL(
+      blob_client_,
+      ListBlobs(GetTestLocation(),
+                AllOf(Field(&BlobStorageClient::ListOptions::start_after, ""),
+                      Field(&BlobStorageClient::ListOptions::prefix,
+                            FilePrefix<FileType::SNAPSHOT>()))))
+      .Times(1)
+      .WillOnce(Return(std::vector<std::string>()));
+  EXPECT_CALL(
+      blob_client_,
+      ListBlobs(GetTestLocation(),
+                AllOf(Field(&BlobStorageClient::ListOptions::start_after, ""),
+                      Field(&BlobStorageClient::ListOptions::prefix,
+                            FilePrefix<FileType::DELTA>()))))
+      .WillOnce(Return(fnames));
+
+  KVFileMetadata metadata;
+  auto update_reader = std::make_unique<MockStreamRecordReader>();
+  EXPECT_CALL(*update_reader, GetKVFileMetadata)
+      .Times(1)
+      .WillOnce(Return(metadata));
+  EXPECT_CALL(*update_reader, ReadStreamRecords)
+      .Times(1)
+      .WillOnce(
+          [](const std::function<absl::Status(std::string_view)>& callback) {
+            // key: "shard1" -> shard num: 0
+            callback(ToStringView(ToFlatBufferBuilder(
+                         DataRecordStruct{.record =
+                                              KeyValueMutationRecordStruct{
+                                                  KeyValueMutationType::Update,
+                                                  3, "shard1", "bar value"}})))
+                .IgnoreError();
+            return absl::OkStatus();
+          });
+  auto delete_reader = std::make_unique<MockStreamRecordReader>();
+  EXPECT_CALL(*delete_reader, GetKVFileMetadata)
+      .Times(1)
+      .WillOnce(Return(metadata));
+  EXPECT_CALL(*delete_reader, ReadStreamRecords)
+      .Times(1)
+      .WillOnce(
+          [](const std::function<absl::Status(std::string_view)>& callback) {
+            // key: "shard2" -> shard num: 1
+            callback(ToStringView(ToFlatBufferBuilder(
+                         DataRecordStruct{.record =
+                                              KeyValueMutationRecordStruct{
+                                                  KeyValueMutationType::Delete,
+                                                  3, "shard2", "bar value"}})))
                 .IgnoreError();
             return absl::OkStatus();
           });
@@ -605,6 +1466,8 @@ TEST_F(DataOrchestratorTest, InitCacheShardedSuccessSkipRecord) {
   EXPECT_CALL(strict_cache, RemoveDeletedKeys(0)).Times(1);
   EXPECT_CALL(strict_cache, DeleteKey("shard2", 3)).Times(1);
   EXPECT_CALL(strict_cache, RemoveDeletedKeys(3)).Times(1);
+  EXPECT_CALL(strict_cache, GetMemoryUsage)
+      .WillRepeatedly(Return(CacheMemoryUsage{}));
 
   auto sharded_options = DataOrchestrator::Options{
       .data_bucket = GetTestLocation().bucket,
@@ -624,6 +1487,92 @@ TEST_F(DataOrchestratorTest, InitCacheShardedSuccessSkipRecord) {
   ASSERT_TRUE(maybe_orchestrator.ok());
 }
 
+TEST_F(DataOrchestratorTest, InitCacheLoadsLogicalShardsMappedToServerShard) {
+  // Odd logical shards are mapped to shard 1.
+  std::vector<ShardMappingRecordStruct> mapping_records;
+  for (int32_t logical_shard = 0; logical_shard < 4; ++logical_shard) {
+    mapping_records.push_back({.logical_shard = logical_shard,
+                               .physical_shard = logical_shard % 2});
+  }
+  const auto mapping = LogicalShardMapping::Create(4, 2, mapping_records);
+  ASSERT_TRUE(mapping.ok()) << mapping.status();
+
+  const std::vector<std::string> fnames(
+      {ToDeltaFileName(1).value(), ToDeltaFileName(2).value()});
+  EXPECT_CALL(
+      blob_client_,
+      ListBlobs(GetTestLocation(),
+                AllOf(Field(&BlobStorageClient::ListOptions::start_after, ""),
+                      Field(&BlobStorageClient::ListOptions::prefix,
+                            FilePrefix<FileType::SNAPSHOT>()))))
+      .WillOnce(Return(std::vector<std::string>()));
+  EXPECT_CALL(
+      blob_client_,
+      ListBlobs(GetTestLocation(),
+                AllOf(Field(&BlobStorageClient::ListOptions::start_after, ""),
+                      Field(&BlobStorageClient::ListOptions::prefix,
+                            FilePrefix<FileType::DELTA>()))))
+      .WillOnce(Return(fnames));
+
+  const std::vector<std::string> keys = {"key0", "key1", "key2", "key3",
+                                         "key4", "key5", "key6", "key7"};
+  auto reader = std::make_unique<MockStreamRecordReader>();
+  EXPECT_CALL(*reader, GetKVFileMetadata)
+      .WillOnce(Return(KVFileMetadata()));
+  EXPECT_CALL(*reader, ReadStreamRecords)
+      .WillOnce(
+          [&keys](const std::function<absl::Status(std::string_view)>&
+                      callback) {
+            for (const std::string& key : keys) {
+              callback(ToStringView(ToFlatBufferBuilder(DataRecordStruct{
+                           .record = KeyValueMutationRecordStruct{
+                               KeyValueMutationType::Update, 3, key,
+                               "value"}})))
+                  .IgnoreError();
+            }
+            return absl::OkStatus();
+          });
+  // The second file holds the records of logical shard 2, which is mapped
+  // to shard 0.
+  KVFileMetadata other_shard_metadata;
+  other_shard_metadata.mutable_sharding_metadata()->set_shard_num(2);
+  auto other_shard_reader = std::make_unique<MockStreamRecordReader>();
+  EXPECT_CALL(*other_shard_reader, GetKVFileMetadata)
+      .WillOnce(Return(other_shard_metadata));
+  EXPECT_CALL(*other_shard_reader, ReadStreamRecords).Times(0);
+  EXPECT_CALL(delta_stream_reader_factory_, CreateConcurrentReader)
+      .WillOnce(Return(ByMove(std::move(reader))))
+      .WillOnce(Return(ByMove(std::move(other_shard_reader))));
+
+  int num_loaded = 0;
+  for (const std::string& key : keys) {
+    if (ShardingFunction("").GetShardNumForKey(key, 4) % 2 == 1) {
+      EXPECT_CALL(cache_, UpdateKeyValue(key, "value", 3)).Times(1);
+      ++num_loaded;
+    }
+  }
+  EXPECT_CALL(metrics_recorder_,
+              IncrementEventCounter("kTotalRowsDroppedIncorrectShardNumber"))
+      .Times(keys.size() - num_loaded);
+
+  auto options = DataOrchestrator::Options{
+      .data_bucket = GetTestLocation().bucket,
+      .cache = cache_,
+      .blob_client = blob_client_,
+      .delta_notifier = notifier_,
+      .change_notifier = change_notifier_,
+      .udf_client = udf_client_,
+      .delta_stream_reader_factory = delta_stream_reader_factory_,
+      .realtime_thread_pool_manager = realtime_thread_pool_manager_,
+      .shard_num = 1,
+      .num_shards = 2,
+      .logical_shard_mapping = &*mapping,
+  };
+  auto maybe_orchestrator =
+      DataOrchestrator::TryCreate(options, metrics_recorder_);
+  ASSERT_TRUE(maybe_orchestrator.ok());
+}
+
 TEST_F(DataOrchestratorTest, InitCacheSkipsSnapshotFilesForOtherShards) {
   auto snapshot_name = ToSnapshotFileName(1);
   EXPECT_CALL(
@@ -0,0 +1,105 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "components/data_server/data_loading/logical_sharding_config.h"
+
+#include <algorithm>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "glog/logging.h"
+#include "public/constants.h"
+#include "public/data_loading/data_loading_generated.h"
+#include "public/data_loading/filename_utils.h"
+#include "public/data_loading/records_utils.h"
+
+namespace kv_server {
+
+absl::StatusOr<std::optional<LogicalShardMapping>> LoadLogicalShardMapping(
+    BlobStorageClient& blob_client,
+    StreamRecordReaderFactory<std::string_view>& stream_reader_factory,
+    const std::string& data_bucket, int32_t num_physical_shards) {
+  auto basenames = blob_client.ListBlobs(
+      {.bucket = data_bucket},
+      {.prefix = std::string(
+           FilePrefix<FileType::LOGICAL_SHARDING_CONFIG>())});
+  if (!basenames.ok()) {
+    return basenames.status();
+  }
+  // Names end with the logical commit time, so the latest file sorts last.
+  const auto latest =
+      std::find_if(basenames->rbegin(), basenames->rend(),
+                   [](const std::string& basename) {
+                     return IsLogicalShardingConfigFilename(basename);
+                   });
+  if (latest == basenames->rend()) {
+    return std::nullopt;
+  }
+  const BlobStorageClient::DataLocation location{.bucket = data_bucket,
+                                                 .key = *latest};
+  LOG(INFO) << "Loading logical sharding config " << location;
+  std::unique_ptr<BlobReader> blob_reader = blob_client.GetBlobReader(location);
+  auto record_reader = stream_reader_factory.CreateReader(blob_reader->Stream());
+  auto metadata = record_reader->GetKVFileMetadata();
+  if (!metadata.ok()) {
+    return metadata.status();
+  }
+  if (!metadata->has_logical_sharding_config()) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Logical sharding config ", location.key,
+                     " has no logical sharding config metadata."));
+  }
+  const LogicalShardingConfigMetadata& config =
+      metadata->logical_sharding_config();
+  if (config.num_physical_shards() != num_physical_shards) {
+    return absl::FailedPreconditionError(absl::StrCat(
+        "Logical sharding config ", location.key, " is for ",
+        config.num_physical_shards(), " physical shards, but there are ",
+        num_physical_shards, "."));
+  }
+  std::vector<ShardMappingRecordStruct> records;
+  if (const auto status = record_reader->ReadStreamRecords(
+          [&records](std::string_view raw) {
+            return DeserializeDataRecord(
+                raw, [&records](const DataRecord& data_record) {
+                  if (data_record.record_type() !=
+                      Record::ShardMappingRecord) {
+                    return absl::InvalidArgumentError(
+                        "Logical sharding configs only hold shard mapping "
+                        "records.");
+                  }
+                  records.push_back(
+                      GetTypedRecordStruct<ShardMappingRecordStruct>(
+                          data_record));
+                  return absl::OkStatus();
+                });
+          });
+      !status.ok()) {
+    return status;
+  }
+  auto mapping = LogicalShardMapping::Create(
+      config.num_logical_shards(), config.num_physical_shards(), records);
+  if (!mapping.ok()) {
+    return mapping.status();
+  }
+  LOG(INFO) << "Mapping " << mapping->num_logical_shards()
+            << " logical shards to " << mapping->num_physical_shards()
+            << " physical shards";
+  return *std::move(mapping);
+}
+
+}  // namespace kv_server
@@ -0,0 +1,40 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef COMPONENTS_DATA_SERVER_DATA_LOADING_LOGICAL_SHARDING_CONFIG_H_
+#define COMPONENTS_DATA_SERVER_DATA_LOADING_LOGICAL_SHARDING_CONFIG_H_
+
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "absl/status/statusor.h"
+#include "components/data/blob_storage/blob_storage_client.h"
+#include "public/data_loading/readers/riegeli_stream_io.h"
+#include "public/sharding/logical_shard_mapping.h"
+
+namespace kv_server {
+
+// Reads the latest LOGICAL_SHARDING_CONFIG file of `data_bucket` and returns
+// the mapping of its shard mapping records, or nullopt if the bucket has no
+// such file, in which case keys are sharded straight to physical shards.
+// Fails if the mapping is invalid or isn't for `num_physical_shards`.
+absl::StatusOr<std::optional<LogicalShardMapping>> LoadLogicalShardMapping(
+    BlobStorageClient& blob_client,
+    StreamRecordReaderFactory<std::string_view>& stream_reader_factory,
+    const std::string& data_bucket, int32_t num_physical_shards);
+
+}  // namespace kv_server
+
+#endif  // COMPONENTS_DATA_SERVER_DATA_LOADING_LOGICAL_SHARDING_CONFIG_H_
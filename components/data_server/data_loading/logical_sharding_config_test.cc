@@ -0,0 +1,135 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "components/data_server/data_loading/logical_sharding_config.h"
+
+#include <memory>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "components/data/common/mocks.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "public/data_loading/filename_utils.h"
+#include "public/data_loading/records_utils.h"
+#include "public/test_util/mocks.h"
+
+namespace kv_server {
+namespace {
+
+using testing::_;
+using testing::ByMove;
+using testing::Field;
+using testing::Return;
+using testing::ReturnRef;
+
+class LogicalShardingConfigTest : public ::testing::Test {
+ protected:
+  // Expects the bucket to hold the config files `basenames`, of which
+  // `latest` is read with `metadata` and `records`.
+  void ExpectConfig(std::vector<std::string> basenames,
+                    const std::string& latest, KVFileMetadata metadata,
+                    std::vector<ShardMappingRecordStruct> records) {
+    EXPECT_CALL(blob_client_, ListBlobs(_, _))
+        .WillOnce(Return(std::move(basenames)));
+    auto blob_reader = std::make_unique<MockBlobReader>();
+    EXPECT_CALL(*blob_reader, Stream).WillOnce(ReturnRef(stream_));
+    EXPECT_CALL(blob_client_,
+                GetBlobReader(Field(&BlobStorageClient::DataLocation::key,
+                                    latest)))
+        .WillOnce(Return(ByMove(std::move(blob_reader))));
+    auto record_reader = std::make_unique<MockStreamRecordReader>();
+    EXPECT_CALL(*record_reader, GetKVFileMetadata).WillOnce(Return(metadata));
+    EXPECT_CALL(*record_reader, ReadStreamRecords)
+        .WillRepeatedly(
+            [records](const std::function<absl::Status(
+                          const std::string_view&)>& callback) {
+              for (const ShardMappingRecordStruct& record : records) {
+                auto builder =
+                    ToFlatBufferBuilder(DataRecordStruct{.record = record});
+                if (const auto status = callback(ToStringView(builder));
+                    !status.ok()) {
+                  return status;
+                }
+              }
+              return absl::OkStatus();
+            });
+    EXPECT_CALL(stream_reader_factory_, CreateReader)
+        .WillOnce(Return(ByMove(std::move(record_reader))));
+  }
+
+  static KVFileMetadata ConfigMetadata(int32_t num_logical_shards,
+                                       int32_t num_physical_shards) {
+    KVFileMetadata metadata;
+    auto* config = metadata.mutable_logical_sharding_config();
+    config->set_num_logical_shards(num_logical_shards);
+    config->set_num_physical_shards(num_physical_shards);
+    return metadata;
+  }
+
+  MockBlobStorageClient blob_client_;
+  MockStreamRecordReaderFactory stream_reader_factory_;
+  std::stringstream stream_;
+};
+
+TEST_F(LogicalShardingConfigTest, ReturnsNulloptWithoutConfigFiles) {
+  EXPECT_CALL(blob_client_, ListBlobs(_, _))
+      .WillOnce(Return(std::vector<std::string>({"NOT_A_CONFIG"})));
+  EXPECT_CALL(blob_client_, GetBlobReader).Times(0);
+  const auto mapping = LoadLogicalShardMapping(
+      blob_client_, stream_reader_factory_, "bucket", 2);
+  ASSERT_TRUE(mapping.ok()) << mapping.status();
+  EXPECT_FALSE(mapping->has_value());
+}
+
+TEST_F(LogicalShardingConfigTest, LoadsMappingOfLatestConfig) {
+  const std::string older = ToLogicalShardingConfigFilename(1).value();
+  const std::string latest = ToLogicalShardingConfigFilename(2).value();
+  ExpectConfig({older, latest}, latest, ConfigMetadata(3, 2),
+               {{.logical_shard = 0, .physical_shard = 1},
+                {.logical_shard = 1, .physical_shard = 0},
+                {.logical_shard = 2, .physical_shard = 1}});
+  const auto mapping = LoadLogicalShardMapping(
+      blob_client_, stream_reader_factory_, "bucket", 2);
+  ASSERT_TRUE(mapping.ok()) << mapping.status();
+  ASSERT_TRUE(mapping->has_value());
+  EXPECT_EQ((*mapping)->num_logical_shards(), 3);
+  EXPECT_EQ((*mapping)->GetPhysicalShard(0), 1);
+  EXPECT_EQ((*mapping)->GetPhysicalShard(1), 0);
+  EXPECT_EQ((*mapping)->GetPhysicalShard(2), 1);
+}
+
+TEST_F(LogicalShardingConfigTest, FailsForOtherNumberOfPhysicalShards) {
+  const std::string config = ToLogicalShardingConfigFilename(1).value();
+  ExpectConfig({config}, config, ConfigMetadata(2, 2),
+               {{.logical_shard = 0, .physical_shard = 0},
+                {.logical_shard = 1, .physical_shard = 1}});
+  EXPECT_FALSE(LoadLogicalShardMapping(blob_client_, stream_reader_factory_,
+                                       "bucket", 4)
+                   .ok());
+}
+
+TEST_F(LogicalShardingConfigTest, FailsForIncompleteMapping) {
+  const std::string config = ToLogicalShardingConfigFilename(1).value();
+  ExpectConfig({config}, config, ConfigMetadata(2, 2),
+               {{.logical_shard = 0, .physical_shard = 0}});
+  EXPECT_FALSE(LoadLogicalShardMapping(blob_client_, stream_reader_factory_,
+                                       "bucket", 2)
+                   .ok());
+}
+
+}  // namespace
+}  // namespace kv_server
@@ -0,0 +1,246 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "components/data_server/data_loading/mutation_applier.h"
+
+#include <functional>
+#include <iterator>
+#include <string>
+#include <utility>
+
+#include "absl/hash/hash.h"
+#include "absl/memory/memory.h"
+#include "glog/logging.h"
+
+namespace kv_server {
+namespace {
+
+using privacy_sandbox::server_common::MetricsRecorder;
+using privacy_sandbox::server_common::ScopeLatencyRecorder;
+
+constexpr char kApplyQueueDepth[] = "DataLoadingApplyQueueDepth";
+constexpr char kApplyBatchSize[] = "DataLoadingApplyBatchSize";
+constexpr char kApplyBatchLatency[] = "DataLoadingApplyBatch";
+constexpr char kApplyQueueFull[] = "DataLoadingApplyQueueFull";
+
+const std::vector<double> kQueueDepthBucketBoundaries = {0, 1, 2, 4, 8, 16};
+const std::vector<double> kBatchSizeBucketBoundaries = {
+    1, 16, 64, 256, 1024, 4096, 16384,
+};
+
+}  // namespace
+
+MutationApplier::Stream::Stream(MutationApplier& applier, Cache& cache,
+                                bool on_calling_thread)
+    : applier_(applier),
+      cache_(cache),
+      on_calling_thread_(on_calling_thread) {}
+
+MutationApplier::Stream::~Stream() { Finish(); }
+
+void MutationApplier::Stream::Apply(std::shared_ptr<const void> records,
+                                    std::vector<Mutation> mutations) {
+  if (mutations.empty()) {
+    return;
+  }
+  const auto& workers = applier_.workers_;
+  if (on_calling_thread_ || workers.size() == 1) {
+    {
+      absl::MutexLock lock(&mutex_);
+      ++num_queued_batches_;
+    }
+    Batch batch{.stream = this,
+                .records = std::move(records),
+                .mutations = std::move(mutations)};
+    if (on_calling_thread_) {
+      std::vector<Batch> batches;
+      batches.push_back(std::move(batch));
+      applier_.ApplyBatches(std::move(batches));
+    } else {
+      applier_.Enqueue(*workers[0], std::move(batch));
+    }
+    return;
+  }
+  std::vector<std::vector<Mutation>> mutations_per_worker(workers.size());
+  for (Mutation& mutation : mutations) {
+    mutations_per_worker[applier_.WorkerForKey(mutation.key)].push_back(
+        std::move(mutation));
+  }
+  for (size_t i = 0; i < workers.size(); ++i) {
+    if (mutations_per_worker[i].empty()) {
+      continue;
+    }
+    {
+      absl::MutexLock lock(&mutex_);
+      ++num_queued_batches_;
+    }
+    applier_.Enqueue(*workers[i],
+                     Batch{.stream = this,
+                           .records = records,
+                           .mutations = std::move(mutations_per_worker[i])});
+  }
+}
+
+void MutationApplier::Stream::Finish() {
+  absl::MutexLock lock(&mutex_, absl::Condition(this, &Stream::IsDone));
+}
+
+void MutationApplier::Stream::RecordApplied(int64_t num_batches,
+                                            int64_t num_mutations,
+                                            absl::Duration latency) {
+  absl::MutexLock lock(&mutex_);
+  num_queued_batches_ -= num_batches;
+  num_applied_ += num_mutations;
+  apply_time_ += latency;
+}
+
+int64_t MutationApplier::Stream::num_applied() const {
+  absl::MutexLock lock(&mutex_);
+  return num_applied_;
+}
+
+absl::Duration MutationApplier::Stream::apply_time() const {
+  absl::MutexLock lock(&mutex_);
+  return apply_time_;
+}
+
+MutationApplier::MutationApplier(MetricsRecorder& metrics_recorder,
+                                 Options options)
+    : metrics_recorder_(metrics_recorder), options_(std::move(options)) {}
+
+MutationApplier::~MutationApplier() {
+  for (auto& worker : workers_) {
+    {
+      absl::MutexLock lock(&worker->mutex);
+      worker->finished = true;
+    }
+    if (worker->thread.joinable()) {
+      worker->thread.join();
+    }
+  }
+}
+
+std::unique_ptr<MutationApplier::Stream> MutationApplier::NewStream(
+    Cache& cache, bool on_calling_thread) {
+  return absl::WrapUnique(
+      new Stream(*this, cache, on_calling_thread || workers_.empty()));
+}
+
+int MutationApplier::WorkerForKey(std::string_view key) const {
+  // Same as `StripedKeyValueCache::StripeForKey`, so that each stripe is
+  // owned by one worker.
+  const uint64_t hash = absl::Hash<std::string_view>{}(key);
+  return (hash >> 32) % workers_.size();
+}
+
+void MutationApplier::Enqueue(Worker& worker, Batch batch) {
+  const size_t max_queued_batches = options_.max_queued_batches;
+  int64_t queue_depth;
+  {
+    absl::MutexLock lock(&worker.mutex);
+    if (worker.queue.size() >= max_queued_batches) {
+      metrics_recorder_.IncrementEventCounter(kApplyQueueFull);
+      while (worker.queue.size() >= max_queued_batches) {
+        worker.has_room.Wait(&worker.mutex);
+      }
+    }
+    queue_depth = worker.queue.size();
+    worker.queue.push_back(std::move(batch));
+  }
+  metrics_recorder_.RecordHistogramEvent(kApplyQueueDepth, queue_depth);
+}
+
+void MutationApplier::RunWorker(Worker& worker) {
+  absl::Condition has_batches(&worker, &Worker::HasBatches);
+  while (true) {
+    std::vector<Batch> batches;
+    {
+      absl::MutexLock lock(&worker.mutex, has_batches);
+      if (worker.queue.empty()) {
+        return;
+      }
+      // Everything queued is applied at once, so a worker that falls behind
+      // takes the cache locks less often.
+      batches.assign(std::make_move_iterator(worker.queue.begin()),
+                     std::make_move_iterator(worker.queue.end()));
+      worker.queue.clear();
+      worker.has_room.SignalAll();
+    }
+    // Streams are applied one at a time, each in the order of its batches.
+    while (!batches.empty()) {
+      const Stream* stream = batches.front().stream;
+      std::vector<Batch> stream_batches;
+      std::vector<Batch> other_batches;
+      for (Batch& batch : batches) {
+        (batch.stream == stream ? stream_batches : other_batches)
+            .push_back(std::move(batch));
+      }
+      ApplyBatches(std::move(stream_batches));
+      batches = std::move(other_batches);
+    }
+  }
+}
+
+void MutationApplier::ApplyBatches(std::vector<Batch> batches) {
+  std::vector<Mutation> merged;
+  std::vector<Mutation>* mutations = &batches.front().mutations;
+  if (batches.size() > 1) {
+    size_t num_mutations = 0;
+    for (const Batch& batch : batches) {
+      num_mutations += batch.mutations.size();
+    }
+    merged.reserve(num_mutations);
+    for (Batch& batch : batches) {
+      merged.insert(merged.end(),
+                    std::make_move_iterator(batch.mutations.begin()),
+                    std::make_move_iterator(batch.mutations.end()));
+    }
+    mutations = &merged;
+  }
+  metrics_recorder_.RecordHistogramEvent(kApplyBatchSize, mutations->size());
+  ScopeLatencyRecorder latency_recorder(std::string(kApplyBatchLatency),
+                                        metrics_recorder_);
+  Stream& stream = *batches.front().stream;
+  stream.cache_.ApplyBatch(absl::MakeSpan(*mutations));
+  // The stream may be destroyed as soon as this returns.
+  stream.RecordApplied(batches.size(), mutations->size(),
+                       latency_recorder.GetLatency());
+}
+
+void MutationApplier::RegisterMetrics(MetricsRecorder& metrics_recorder) {
+  metrics_recorder.RegisterHistogram(
+      kApplyQueueDepth, "Batches queued ahead of a batch of decoded records",
+      "batch", kQueueDepthBucketBoundaries);
+  metrics_recorder.RegisterHistogram(
+      kApplyBatchSize, "Mutations applied to the cache at once", "mutation",
+      kBatchSizeBucketBoundaries);
+}
+
+std::unique_ptr<MutationApplier> MutationApplier::Create(
+    MetricsRecorder& metrics_recorder, Options options) {
+  CHECK_GE(options.num_workers, 0) << "Number of workers can't be negative.";
+  CHECK_GT(options.max_queued_batches, 0)
+      << "Workers must queue at least one batch.";
+  auto applier = absl::WrapUnique(
+      new MutationApplier(metrics_recorder, std::move(options)));
+  applier->workers_.reserve(applier->options_.num_workers);
+  for (int i = 0; i < applier->options_.num_workers; ++i) {
+    auto& worker = applier->workers_.emplace_back(std::make_unique<Worker>());
+    worker->thread = std::thread(&MutationApplier::RunWorker, applier.get(),
+                                 std::ref(*worker));
+  }
+  return applier;
+}
+
+}  // namespace kv_server
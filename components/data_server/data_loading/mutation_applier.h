@@ -0,0 +1,167 @@
+/*
+ * Copyright 2023 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef COMPONENTS_DATA_SERVER_DATA_LOADING_MUTATION_APPLIER_H_
+#define COMPONENTS_DATA_SERVER_DATA_LOADING_MUTATION_APPLIER_H_
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "components/data_server/cache/cache.h"
+#include "src/cpp/telemetry/metrics_recorder.h"
+
+namespace kv_server {
+
+// Apply stage of data loading. The threads reading a data file decode its
+// records into mutations and hand them over in batches, and a fixed set of
+// workers applies them to the cache, so that decoding doesn't wait for cache
+// locks and the cache is written by a few threads rather than by every
+// reader.
+//
+// One applier serves all the loads of a server, including loads of several
+// files at once, each handing its mutations over through a `Stream` of its
+// own. The workers are started once rather than for every file.
+//
+// Keys are partitioned between the workers by hash, with each worker
+// draining its own bounded queue, so all mutations of a key are applied by
+// the same worker. The partitions follow the stripes of a
+// `StripedKeyValueCache` whose number of stripes is a multiple of the number
+// of workers, so that workers never contend on a stripe.
+//
+// Without workers, batches are applied by the calling thread.
+class MutationApplier {
+ public:
+  struct Options {
+    int32_t num_workers = 0;
+    // Batches queued per worker before `Stream::Apply` blocks.
+    int32_t max_queued_batches = 4;
+  };
+
+  // Mutations of one load, applied to one cache.
+  class Stream {
+   public:
+    // Waits until the mutations are applied.
+    ~Stream();
+
+    Stream(const Stream&) = delete;
+    Stream& operator=(const Stream&) = delete;
+
+    // Queues `mutations` for the workers owning their keys, blocking while
+    // any of their queues is full. The views in the mutations must point
+    // into `records`, which is held until they are applied.
+    void Apply(std::shared_ptr<const void> records,
+               std::vector<Mutation> mutations);
+
+    // Waits until all the mutations queued by `Apply` are applied. Must not
+    // be called concurrently with `Apply`.
+    void Finish();
+
+    // Whether `Apply` applies the mutations before returning, so that the
+    // records don't have to outlive the call.
+    bool applies_on_calling_thread() const { return on_calling_thread_; }
+
+    // Number of mutations applied and time spent applying them, summed over
+    // the workers. Only complete once `Finish` returned.
+    int64_t num_applied() const;
+    absl::Duration apply_time() const;
+
+   private:
+    friend class MutationApplier;
+
+    Stream(MutationApplier& applier, Cache& cache, bool on_calling_thread);
+
+    bool IsDone() const ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_) {
+      return num_queued_batches_ == 0;
+    }
+
+    // Records that `num_batches` queued batches of `num_mutations` were
+    // applied in `latency`.
+    void RecordApplied(int64_t num_batches, int64_t num_mutations,
+                       absl::Duration latency);
+
+    MutationApplier& applier_;
+    Cache& cache_;
+    const bool on_calling_thread_;
+    mutable absl::Mutex mutex_;
+    int64_t num_queued_batches_ ABSL_GUARDED_BY(mutex_) = 0;
+    int64_t num_applied_ ABSL_GUARDED_BY(mutex_) = 0;
+    absl::Duration apply_time_ ABSL_GUARDED_BY(mutex_);
+  };
+
+  // Stops the workers. All streams must be destroyed first.
+  ~MutationApplier();
+
+  MutationApplier(const MutationApplier&) = delete;
+  MutationApplier& operator=(const MutationApplier&) = delete;
+
+  // Returns a stream applying mutations to `cache`, which must outlive it.
+  // With `on_calling_thread`, the stream doesn't use the workers, e.g. for
+  // small loads that must be applied with low latency.
+  std::unique_ptr<Stream> NewStream(Cache& cache,
+                                    bool on_calling_thread = false);
+
+  static void RegisterMetrics(
+      privacy_sandbox::server_common::MetricsRecorder& metrics_recorder);
+
+  static std::unique_ptr<MutationApplier> Create(
+      privacy_sandbox::server_common::MetricsRecorder& metrics_recorder,
+      Options options);
+
+ private:
+  struct Batch {
+    Stream* stream;
+    std::shared_ptr<const void> records;
+    std::vector<Mutation> mutations;
+  };
+
+  struct Worker {
+    bool HasBatches() const ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex) {
+      return !queue.empty() || finished;
+    }
+
+    absl::Mutex mutex;
+    absl::CondVar has_room;
+    std::deque<Batch> queue ABSL_GUARDED_BY(mutex);
+    bool finished ABSL_GUARDED_BY(mutex) = false;
+    std::thread thread;
+  };
+
+  MutationApplier(
+      privacy_sandbox::server_common::MetricsRecorder& metrics_recorder,
+      Options options);
+
+  // Returns the worker owning `key`.
+  int WorkerForKey(std::string_view key) const;
+  void Enqueue(Worker& worker, Batch batch);
+  void RunWorker(Worker& worker);
+  // Applies the mutations of `batches`, which all belong to one stream,
+  // with one `Cache::ApplyBatch` call.
+  void ApplyBatches(std::vector<Batch> batches);
+
+  privacy_sandbox::server_common::MetricsRecorder& metrics_recorder_;
+  const Options options_;
+  std::vector<std::unique_ptr<Worker>> workers_;
+};
+
+}  // namespace kv_server
+
+#endif  // COMPONENTS_DATA_SERVER_DATA_LOADING_MUTATION_APPLIER_H_
@@ -0,0 +1,220 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "components/data_server/data_loading/mutation_applier.h"
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "components/data_server/cache/cache.h"
+#include "components/data_server/cache/key_value_cache.h"
+#include "components/data_server/cache/mocks.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "src/cpp/telemetry/metrics_recorder.h"
+#include "src/cpp/telemetry/telemetry_provider.h"
+
+namespace kv_server {
+namespace {
+
+using privacy_sandbox::server_common::TelemetryProvider;
+using testing::_;
+using testing::Ne;
+using testing::SizeIs;
+using testing::UnorderedElementsAre;
+
+// Returns mutations setting each of `records` as both key and value, which
+// point into `records`.
+std::vector<Mutation> MakeUpdates(const std::vector<std::string>& records) {
+  std::vector<Mutation> mutations;
+  for (const std::string& record : records) {
+    mutations.push_back(Mutation{.type = Mutation::Type::kUpdateKeyValue,
+                                 .key = record,
+                                 .value = record,
+                                 .logical_commit_time = 1});
+  }
+  return mutations;
+}
+
+std::shared_ptr<const std::vector<std::string>> MakeRecords(int thread,
+                                                            int num_records) {
+  auto records = std::make_shared<std::vector<std::string>>();
+  for (int i = 0; i < num_records; ++i) {
+    records->push_back(absl::StrCat("key", thread, "_", i));
+  }
+  return records;
+}
+
+TEST(MutationApplierTest, AppliesMutationsFromConcurrentReaders) {
+  auto noop_metrics_recorder =
+      TelemetryProvider::GetInstance().CreateMetricsRecorder();
+  std::unique_ptr<Cache> cache = KeyValueCache::Create(*noop_metrics_recorder);
+  auto applier = MutationApplier::Create(
+      *noop_metrics_recorder, {.num_workers = 3, .max_queued_batches = 1});
+  auto stream = applier->NewStream(*cache);
+  constexpr int kNumReaders = 4;
+  constexpr int kBatchesPerReader = 20;
+  constexpr int kRecordsPerBatch = 50;
+  std::vector<std::thread> readers;
+  for (int reader = 0; reader < kNumReaders; ++reader) {
+    readers.emplace_back([&stream, reader] {
+      for (int batch = 0; batch < kBatchesPerReader; ++batch) {
+        // The records are only held by the applier once handed over.
+        auto records =
+            MakeRecords(reader * kBatchesPerReader + batch, kRecordsPerBatch);
+        std::vector<Mutation> mutations = MakeUpdates(*records);
+        stream->Apply(std::move(records), std::move(mutations));
+      }
+    });
+  }
+  for (auto& reader : readers) {
+    reader.join();
+  }
+  stream->Finish();
+
+  constexpr int kNumRecords =
+      kNumReaders * kBatchesPerReader * kRecordsPerBatch;
+  EXPECT_EQ(stream->num_applied(), kNumRecords);
+  std::vector<std::string> keys;
+  for (int i = 0; i < kNumReaders * kBatchesPerReader; ++i) {
+    const auto records = MakeRecords(i, kRecordsPerBatch);
+    keys.insert(keys.end(), records->begin(), records->end());
+  }
+  const auto kv_pairs =
+      cache->GetKeyValuePairs(std::vector<std::string_view>(keys.begin(),
+                                                            keys.end()));
+  EXPECT_THAT(kv_pairs, SizeIs(kNumRecords));
+  for (const auto& [key, value] : kv_pairs) {
+    EXPECT_EQ(value, key);
+  }
+}
+
+TEST(MutationApplierTest, AppliesMutationsOfAKeyInOrder) {
+  auto noop_metrics_recorder =
+      TelemetryProvider::GetInstance().CreateMetricsRecorder();
+  testing::StrictMock<MockCache> cache;
+  {
+    testing::InSequence sequence;
+    for (int i = 0; i < 10; ++i) {
+      EXPECT_CALL(cache, UpdateKeyValue("key", absl::StrCat("value", i), i));
+      EXPECT_CALL(cache, DeleteKey("key", i));
+    }
+  }
+  // Other keys go to whichever worker, in any order.
+  EXPECT_CALL(cache, UpdateKeyValue(Ne("key"), _, _)).Times(40);
+  auto applier =
+      MutationApplier::Create(*noop_metrics_recorder, {.num_workers = 4});
+  auto stream = applier->NewStream(cache);
+  for (int i = 0; i < 10; ++i) {
+    auto records = std::make_shared<std::vector<std::string>>();
+    records->push_back(absl::StrCat("value", i));
+    for (int j = 0; j < 4; ++j) {
+      records->push_back(absl::StrCat("other", i, "_", j));
+    }
+    std::vector<Mutation> mutations;
+    mutations.push_back(Mutation{.type = Mutation::Type::kUpdateKeyValue,
+                                 .key = "key",
+                                 .value = records->front(),
+                                 .logical_commit_time = i});
+    for (size_t j = 1; j < records->size(); ++j) {
+      mutations.push_back(Mutation{.type = Mutation::Type::kUpdateKeyValue,
+                                   .key = (*records)[j],
+                                   .value = (*records)[j],
+                                   .logical_commit_time = i});
+    }
+    mutations.push_back(Mutation{.type = Mutation::Type::kDeleteKey,
+                                 .key = "key",
+                                 .logical_commit_time = i});
+    stream->Apply(std::move(records), std::move(mutations));
+  }
+  stream->Finish();
+  EXPECT_EQ(stream->num_applied(), 60);
+}
+
+TEST(MutationApplierTest, AppliesOnCallingThreadWithoutWorkers) {
+  auto noop_metrics_recorder =
+      TelemetryProvider::GetInstance().CreateMetricsRecorder();
+  std::unique_ptr<Cache> cache = KeyValueCache::Create(*noop_metrics_recorder);
+  auto applier =
+      MutationApplier::Create(*noop_metrics_recorder, {.num_workers = 0});
+  auto stream = applier->NewStream(*cache);
+  EXPECT_TRUE(stream->applies_on_calling_thread());
+  const std::vector<std::string> records = {"key1", "key2"};
+  stream->Apply(nullptr, MakeUpdates(records));
+  // Applied before `Finish`.
+  EXPECT_EQ(stream->num_applied(), 2);
+  EXPECT_THAT(cache->GetKeyValuePairs({"key1", "key2"}),
+              UnorderedElementsAre(KVPairEq("key1", "key1"),
+                                   KVPairEq("key2", "key2")));
+}
+
+TEST(MutationApplierTest, AppliesOnCallingThreadWhenAsked) {
+  auto noop_metrics_recorder =
+      TelemetryProvider::GetInstance().CreateMetricsRecorder();
+  std::unique_ptr<Cache> cache = KeyValueCache::Create(*noop_metrics_recorder);
+  auto applier =
+      MutationApplier::Create(*noop_metrics_recorder, {.num_workers = 2});
+  auto stream = applier->NewStream(*cache, /*on_calling_thread=*/true);
+  EXPECT_TRUE(stream->applies_on_calling_thread());
+  const std::vector<std::string> records = {"key1", "key2"};
+  stream->Apply(nullptr, MakeUpdates(records));
+  EXPECT_EQ(stream->num_applied(), 2);
+  EXPECT_THAT(cache->GetKeyValuePairs({"key1", "key2"}),
+              UnorderedElementsAre(KVPairEq("key1", "key1"),
+                                   KVPairEq("key2", "key2")));
+}
+
+TEST(MutationApplierTest, SharesWorkersBetweenStreams) {
+  auto noop_metrics_recorder =
+      TelemetryProvider::GetInstance().CreateMetricsRecorder();
+  std::unique_ptr<Cache> cache1 = KeyValueCache::Create(*noop_metrics_recorder);
+  std::unique_ptr<Cache> cache2 = KeyValueCache::Create(*noop_metrics_recorder);
+  auto applier = MutationApplier::Create(
+      *noop_metrics_recorder, {.num_workers = 2, .max_queued_batches = 1});
+  constexpr int kBatches = 20;
+  constexpr int kRecordsPerBatch = 50;
+  // Two loads at once, each to a cache of its own, and then a third one
+  // reusing the workers.
+  const auto load = [&applier](Cache& cache, int first_batch) {
+    auto stream = applier->NewStream(cache);
+    for (int batch = first_batch; batch < first_batch + kBatches; ++batch) {
+      auto records = MakeRecords(batch, kRecordsPerBatch);
+      std::vector<Mutation> mutations = MakeUpdates(*records);
+      stream->Apply(std::move(records), std::move(mutations));
+    }
+    stream->Finish();
+    EXPECT_EQ(stream->num_applied(), kBatches * kRecordsPerBatch);
+  };
+  std::thread loader(load, std::ref(*cache1), 0);
+  load(*cache2, kBatches);
+  loader.join();
+  load(*cache1, 2 * kBatches);
+
+  for (int batch = 0; batch < 3 * kBatches; ++batch) {
+    const auto records = MakeRecords(batch, kRecordsPerBatch);
+    Cache& cache = batch >= kBatches && batch < 2 * kBatches ? *cache2
+                                                             : *cache1;
+    EXPECT_THAT(cache.GetKeyValuePairs(std::vector<std::string_view>(
+                    records->begin(), records->end())),
+                SizeIs(kRecordsPerBatch));
+  }
+}
+
+}  // namespace
+}  // namespace kv_server
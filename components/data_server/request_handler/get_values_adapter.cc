@@ -29,7 +29,6 @@ namespace kv_server {
 namespace {
 using google::protobuf::RepeatedPtrField;
 using google::protobuf::Struct;
-using google::protobuf::Value;
 using google::protobuf::util::JsonStringToMessage;
 
 constexpr char kKeysTag[] = "keys";
@@ -93,14 +92,6 @@ v2::GetValuesHttpRequest BuildV2Request(
 // Add key value pairs to the result struct
 void ProcessKeyValues(KeyGroupOutput key_group_output, Struct& result_struct) {
   for (auto&& [k, v] : std::move(key_group_output.key_values())) {
-    if (v.value().has_string_value()) {
-      Value value_proto;
-      absl::Status status =
-          JsonStringToMessage(v.value().string_value(), &value_proto);
-      if (status.ok()) {
-        (*result_struct.mutable_fields())[std::move(k)] = value_proto;
-      }
-    }
     (*result_struct.mutable_fields())[std::move(k)] = v.value();
   }
 }
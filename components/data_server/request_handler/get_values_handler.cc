@@ -15,15 +15,19 @@
 #include "components/data_server/request_handler/get_values_handler.h"
 
 #include <iterator>
+#include <memory>
 #include <string>
 #include <utility>
 #include <vector>
 
+#include "absl/container/flat_hash_map.h"
+#include "absl/strings/cord.h"
 #include "absl/strings/str_replace.h"
 #include "absl/strings/str_split.h"
 #include "components/data_server/request_handler/get_values_adapter.h"
 #include "glog/logging.h"
 #include "grpcpp/grpcpp.h"
+#include "public/base_types.pb.h"
 #include "public/constants.h"
 #include "public/query/get_values.grpc.pb.h"
 #include "src/cpp/telemetry/metrics_recorder.h"
@@ -38,7 +42,6 @@ namespace kv_server {
 namespace {
 using google::protobuf::RepeatedPtrField;
 using google::protobuf::Struct;
-using google::protobuf::Value;
 using grpc::StatusCode;
 using privacy_sandbox::server_common::GetTracer;
 using privacy_sandbox::server_common::MetricsRecorder;
@@ -58,28 +61,34 @@ std::vector<std::string_view> GetKeys(
   return key_list;
 }
 
+// Read versions pinned by one request, one per cache partition.
+using PinnedVersions =
+    absl::flat_hash_map<const Cache*, std::unique_ptr<ReadVersion>>;
+
 void ProcessKeys(const RepeatedPtrField<std::string>& keys, const Cache& cache,
+                 KeyNamespace::Enum key_namespace,
+                 PinnedVersions& pinned_versions,
                  MetricsRecorder& metrics_recorder, Struct& result_struct) {
   if (keys.empty()) return;
-  auto kv_pairs = cache.GetKeyValuePairs(GetKeys(keys));
+  // Namespaces in the same partition are looked up at the same version, so
+  // that a response never mixes values from before and after an update.
+  const Cache& partition = cache.GetPartition(key_namespace);
+  std::unique_ptr<ReadVersion>& read_version = pinned_versions[&partition];
+  if (read_version == nullptr) {
+    read_version = partition.PinReadVersion();
+  }
+  // Values come as google.protobuf.Value. Caches that know which values are
+  // JSON documents only parse those.
+  auto value_protos =
+      partition.GetValueProtosAt(GetKeys(keys), read_version.get());
 
-  if (kv_pairs.empty())
+  if (value_protos.empty())
     metrics_recorder.IncrementEventCounter(kCacheKeyMiss);
   else
     metrics_recorder.IncrementEventCounter(kCacheKeyHit);
 
-  for (auto&& [k, v] : std::move(kv_pairs)) {
-    Value value_proto;
-    absl::Status status =
-        google::protobuf::util::JsonStringToMessage(v, &value_proto);
-    if (status.ok()) {
-      (*result_struct.mutable_fields())[std::move(k)] = value_proto;
-    } else {
-      // If string is not a Json string that can be parsed into Value proto,
-      // simply set it as pure string value to the response.
-      (*result_struct.mutable_fields())[std::move(k)].set_string_value(
-          std::move(v));
-    }
+  for (auto& [k, v] : value_protos) {
+    (*result_struct.mutable_fields())[std::string(k)] = std::move(v);
   }
 }
 
@@ -92,25 +101,32 @@ grpc::Status GetValuesHandler::GetValues(const GetValuesRequest& request,
     return adapter_.CallV2Handler(request, *response);
   }
 
+  // Released once the response is built.
+  PinnedVersions pinned_versions;
+
   if (!request.kv_internal().empty()) {
     VLOG(5) << "Processing kv_internal for " << request.DebugString();
-    ProcessKeys(request.kv_internal(), cache_, metrics_recorder_,
+    ProcessKeys(request.kv_internal(), cache_, KeyNamespace::KV_INTERNAL,
+                pinned_versions, metrics_recorder_,
                 *response->mutable_kv_internal());
   }
   if (!request.keys().empty()) {
     VLOG(5) << "Processing keys for " << request.DebugString();
-    ProcessKeys(request.keys(), cache_, metrics_recorder_,
-                *response->mutable_keys());
+    ProcessKeys(request.keys(), cache_, KeyNamespace::KEYS, pinned_versions,
+                metrics_recorder_, *response->mutable_keys());
   }
   if (!request.render_urls().empty()) {
     VLOG(5) << "Processing render_urls for " << request.DebugString();
-    ProcessKeys(request.render_urls(), cache_, metrics_recorder_,
+    ProcessKeys(request.render_urls(), cache_, KeyNamespace::RENDER_URLS,
+                pinned_versions, metrics_recorder_,
                 *response->mutable_render_urls());
   }
   if (!request.ad_component_render_urls().empty()) {
     VLOG(5) << "Processing ad_component_render_urls for "
             << request.DebugString();
-    ProcessKeys(request.ad_component_render_urls(), cache_, metrics_recorder_,
+    ProcessKeys(request.ad_component_render_urls(), cache_,
+                KeyNamespace::AD_COMPONENT_RENDER_URLS, pinned_versions,
+                metrics_recorder_,
                 *response->mutable_ad_component_render_urls());
   }
   return grpc::Status::OK;
@@ -19,9 +19,11 @@
 #include <utility>
 #include <vector>
 
+#include "absl/strings/cord.h"
 #include "components/data_server/cache/cache.h"
 #include "components/data_server/cache/key_value_cache.h"
 #include "components/data_server/cache/mocks.h"
+#include "components/data_server/cache/partitioned_cache.h"
 #include "components/data_server/request_handler/mocks.h"
 #include "gmock/gmock.h"
 #include "google/protobuf/text_format.h"
@@ -56,8 +58,8 @@ class GetValuesHandlerTest : public ::testing::Test {
 TEST_F(GetValuesHandlerTest, ReturnsExistingKeyTwice) {
   EXPECT_CALL(mock_cache_, GetKeyValuePairs(UnorderedElementsAre("my_key")))
       .Times(2)
-      .WillRepeatedly(Return(absl::flat_hash_map<std::string, std::string>{
-          {"my_key", "my_value"}}));
+      .WillRepeatedly(Return(absl::flat_hash_map<std::string_view, absl::Cord>{
+          {"my_key", absl::Cord("my_value")}}));
   GetValuesRequest request;
   request.add_keys("my_key");
   GetValuesResponse response;
@@ -86,8 +88,8 @@ TEST_F(GetValuesHandlerTest, RepeatedKeys) {
   EXPECT_CALL(mock_cache_,
               GetKeyValuePairs(UnorderedElementsAre("key1", "key2", "key3")))
       .Times(1)
-      .WillRepeatedly(Return(
-          absl::flat_hash_map<std::string, std::string>{{"key1", "value1"}}));
+      .WillRepeatedly(Return(absl::flat_hash_map<std::string_view, absl::Cord>{
+          {"key1", absl::Cord("value1")}}));
   GetValuesRequest request;
   request.add_keys("key1,key2,key3");
   GetValuesResponse response;
@@ -111,8 +113,8 @@ TEST_F(GetValuesHandlerTest, ReturnsMultipleExistingKeysSameNamespace) {
   EXPECT_CALL(mock_cache_,
               GetKeyValuePairs(UnorderedElementsAre("key1", "key2")))
       .Times(1)
-      .WillOnce(Return(absl::flat_hash_map<std::string, std::string>{
-          {"key1", "value1"}, {"key2", "value2"}}));
+      .WillOnce(Return(absl::flat_hash_map<std::string_view, absl::Cord>{
+          {"key1", absl::Cord("value1")}, {"key2", absl::Cord("value2")}}));
   GetValuesRequest request;
   request.add_keys("key1");
   request.add_keys("key2");
@@ -140,12 +142,12 @@ TEST_F(GetValuesHandlerTest, ReturnsMultipleExistingKeysSameNamespace) {
 TEST_F(GetValuesHandlerTest, ReturnsMultipleExistingKeysDifferentNamespace) {
   EXPECT_CALL(mock_cache_, GetKeyValuePairs(UnorderedElementsAre("key1")))
       .Times(1)
-      .WillOnce(Return(
-          absl::flat_hash_map<std::string, std::string>{{"key1", "value1"}}));
+      .WillOnce(Return(absl::flat_hash_map<std::string_view, absl::Cord>{
+          {"key1", absl::Cord("value1")}}));
   EXPECT_CALL(mock_cache_, GetKeyValuePairs(UnorderedElementsAre("key2")))
       .Times(1)
-      .WillOnce(Return(
-          absl::flat_hash_map<std::string, std::string>{{"key2", "value2"}}));
+      .WillOnce(Return(absl::flat_hash_map<std::string_view, absl::Cord>{
+          {"key2", absl::Cord("value2")}}));
   GetValuesRequest request;
   request.add_render_urls("key1");
   request.add_ad_component_render_urls("key2");
@@ -249,8 +251,10 @@ TEST_F(GetValuesHandlerTest, TestResponseOnDifferentValueFormats) {
   EXPECT_CALL(mock_cache_,
               GetKeyValuePairs(UnorderedElementsAre("key1", "key2", "key3")))
       .Times(1)
-      .WillOnce(Return(absl::flat_hash_map<std::string, std::string>{
-          {"key1", value1}, {"key2", value2}, {"key3", value3}}));
+      .WillOnce(Return(absl::flat_hash_map<std::string_view, absl::Cord>{
+          {"key1", absl::Cord(value1)},
+          {"key2", absl::Cord(value2)},
+          {"key3", absl::Cord(value3)}}));
 
   GetValuesRequest request;
   request.add_keys("key1");
@@ -270,6 +274,73 @@ TEST_F(GetValuesHandlerTest, TestResponseOnDifferentValueFormats) {
   EXPECT_THAT(response, EqualsProto(expected_from_json));
 }
 
+TEST_F(GetValuesHandlerTest, LooksUpNamespacesInTheirPartitions) {
+  auto cache = PartitionedCache::Create([this](KeyNamespace::Enum) {
+    return KeyValueCache::Create(mock_metrics_recorder_);
+  });
+  cache->GetPartition(KeyNamespace::KEYS).UpdateKeyValue("key1", "keys", 1);
+  cache->GetPartition(KeyNamespace::RENDER_URLS)
+      .UpdateKeyValue("key1", "render_urls", 1);
+  GetValuesRequest request;
+  request.add_keys("key1");
+  request.add_render_urls("key1");
+  request.add_kv_internal("key1");
+  GetValuesResponse response;
+  GetValuesHandler handler(*cache, mock_get_values_adapter_,
+                           mock_metrics_recorder_,
+                           /*use_v2=*/false);
+  ASSERT_TRUE(handler.GetValues(request, &response).ok());
+
+  GetValuesResponse expected;
+  TextFormat::ParseFromString(R"pb(keys {
+                                     fields {
+                                       key: "key1"
+                                       value { string_value: "keys" }
+                                     }
+                                   }
+                                   render_urls {
+                                     fields {
+                                       key: "key1"
+                                       value { string_value: "render_urls" }
+                                     }
+                                   }
+                                   kv_internal {})pb",
+                              &expected);
+  EXPECT_THAT(response, EqualsProto(expected));
+}
+
+TEST_F(GetValuesHandlerTest, ServesUpdatesWithoutNamespaceInNamespaces) {
+  auto cache = PartitionedCache::Create([this](KeyNamespace::Enum) {
+    return KeyValueCache::Create(mock_metrics_recorder_);
+  });
+  // Data files without a namespace update every partition.
+  cache->UpdateKeyValue("key1", "value1", 1);
+  cache->UpdateKeyValue("key2", "value2", 1);
+  cache->GetPartition(KeyNamespace::KEYS).UpdateKeyValue("key2", "keys", 2);
+  GetValuesRequest request;
+  request.add_keys("key1");
+  request.add_keys("key2");
+  GetValuesResponse response;
+  GetValuesHandler handler(*cache, mock_get_values_adapter_,
+                           mock_metrics_recorder_,
+                           /*use_v2=*/false);
+  ASSERT_TRUE(handler.GetValues(request, &response).ok());
+
+  GetValuesResponse expected;
+  TextFormat::ParseFromString(R"pb(keys {
+                                     fields {
+                                       key: "key1"
+                                       value { string_value: "value1" }
+                                     }
+                                     fields {
+                                       key: "key2"
+                                       value { string_value: "keys" }
+                                     }
+                                   })pb",
+                              &expected);
+  EXPECT_THAT(response, EqualsProto(expected));
+}
+
 TEST_F(GetValuesHandlerTest, CallsV2Adapter) {
   GetValuesResponse adapter_response;
   TextFormat::ParseFromString(R"pb(keys {
@@ -18,8 +18,11 @@
 #include <utility>
 #include <vector>
 
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
 #include "absl/strings/str_join.h"
 #include "components/errors/retry.h"
+#include "glog/logging.h"
 #include "public/constants.h"
 
 namespace kv_server {
@@ -63,6 +66,58 @@ bool ParameterFetcher::GetBoolParameter(
       "GetParameter", metrics_recorder_, {{"param", param_name}});
 }
 
+template <typename T>
+T ParameterFetcher::ValueOrDefault(std::string_view param_name,
+                                   absl::StatusOr<T> parameter,
+                                   T default_value) const {
+  if (!parameter.ok()) {
+    LOG(INFO) << "Using the default value of " << param_name << ", "
+              << default_value << ": " << parameter.status();
+    return default_value;
+  }
+  return *std::move(parameter);
+}
+
+std::string ParameterFetcher::GetParameterOrDefault(
+    std::string_view parameter_suffix, std::string default_value) const {
+  const std::string param_name = GetParamName(parameter_suffix);
+  return ValueOrDefault(param_name, parameter_client_.GetParameter(param_name),
+                        std::move(default_value));
+}
+
+int32_t ParameterFetcher::GetInt32ParameterOrDefault(
+    std::string_view parameter_suffix, int32_t default_value) const {
+  const std::string param_name = GetParamName(parameter_suffix);
+  return ValueOrDefault(param_name,
+                        parameter_client_.GetInt32Parameter(param_name),
+                        default_value);
+}
+
+int64_t ParameterFetcher::GetInt64ParameterOrDefault(
+    std::string_view parameter_suffix, int64_t default_value) const {
+  const std::string param_name = GetParamName(parameter_suffix);
+  absl::StatusOr<int64_t> parameter;
+  if (absl::StatusOr<std::string> value =
+          parameter_client_.GetParameter(param_name);
+      !value.ok()) {
+    parameter = value.status();
+  } else if (int64_t parsed; absl::SimpleAtoi(*value, &parsed)) {
+    parameter = parsed;
+  } else {
+    parameter = absl::InvalidArgumentError(
+        absl::StrCat("Parameter ", param_name, " is not an integer: ", *value));
+  }
+  return ValueOrDefault(param_name, std::move(parameter), default_value);
+}
+
+bool ParameterFetcher::GetBoolParameterOrDefault(
+    std::string_view parameter_suffix, bool default_value) const {
+  const std::string param_name = GetParamName(parameter_suffix);
+  return ValueOrDefault(param_name,
+                        parameter_client_.GetBoolParameter(param_name),
+                        default_value);
+}
+
 std::string ParameterFetcher::GetParamName(
     std::string_view parameter_suffix) const {
   const std::vector<std::string_view> v = {kServiceName, environment_,
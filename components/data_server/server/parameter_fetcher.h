@@ -49,6 +49,20 @@ class ParameterFetcher {
   // This function will retry any necessary requests until it succeeds.
   virtual bool GetBoolParameter(std::string_view parameter_suffix) const;
 
+  // These functions look up optional parameters, which deployments may not
+  // define. They make a single request, and return `default_value` if it
+  // fails.
+  virtual std::string GetParameterOrDefault(std::string_view parameter_suffix,
+                                            std::string default_value) const;
+  virtual int32_t GetInt32ParameterOrDefault(std::string_view parameter_suffix,
+                                             int32_t default_value) const;
+  // Parameters are only stored as 32-bit integers, so this one is parsed
+  // from a string parameter.
+  virtual int64_t GetInt64ParameterOrDefault(std::string_view parameter_suffix,
+                                             int64_t default_value) const;
+  virtual bool GetBoolParameterOrDefault(std::string_view parameter_suffix,
+                                         bool default_value) const;
+
   virtual NotifierMetadata GetBlobStorageNotifierMetadata() const;
 
   virtual BlobStorageClient::ClientOptions GetBlobStorageClientOptions() const;
@@ -59,6 +73,11 @@ class ParameterFetcher {
  private:
   std::string GetParamName(std::string_view parameter_suffix) const;
 
+  // Returns the value of `parameter`, or `default_value` if it's not ok.
+  template <typename T>
+  T ValueOrDefault(std::string_view param_name, absl::StatusOr<T> parameter,
+                   T default_value) const;
+
   const std::string environment_;
   const ParameterClient& parameter_client_;
   privacy_sandbox::server_common::MetricsRecorder* const metrics_recorder_;
@@ -16,6 +16,7 @@
 #include <string>
 #include <utility>
 
+#include "absl/status/status.h"
 #include "absl/status/statusor.h"
 #include "components/data_server/server/parameter_fetcher.h"
 #include "gmock/gmock.h"
@@ -70,4 +71,27 @@ TEST(ParameterFetcherTest, CreateDeltaFileRecordChangeNotifierSmokeTest) {
   EXPECT_EQ(::testing::TempDir(), local_notifier_metadata.local_directory);
 }
 
+TEST(ParameterFetcherTest, OptionalParametersFallBackToDefaults) {
+  MockParameterClient client;
+  EXPECT_CALL(client, GetInt32Parameter("kv-server-local-defined"))
+      .WillOnce(::testing::Return(5));
+  EXPECT_CALL(client, GetInt32Parameter("kv-server-local-undefined"))
+      .WillOnce(::testing::Return(absl::NotFoundError("undefined")));
+  EXPECT_CALL(client, GetParameter("kv-server-local-large"))
+      .WillOnce(::testing::Return("8589934592"));
+  EXPECT_CALL(client, GetParameter("kv-server-local-invalid"))
+      .WillOnce(::testing::Return("8 GiB"));
+  EXPECT_CALL(client, GetBoolParameter("kv-server-local-undefined"))
+      .WillOnce(::testing::Return(absl::NotFoundError("undefined")));
+  MockMetricsRecorder metrics_recorder;
+  ParameterFetcher fetcher(
+      /*environment=*/"local", client, &metrics_recorder);
+
+  EXPECT_EQ(fetcher.GetInt32ParameterOrDefault("defined", 1), 5);
+  EXPECT_EQ(fetcher.GetInt32ParameterOrDefault("undefined", 1), 1);
+  EXPECT_EQ(fetcher.GetInt64ParameterOrDefault("large", 1), int64_t{1} << 33);
+  EXPECT_EQ(fetcher.GetInt64ParameterOrDefault("invalid", 1), 1);
+  EXPECT_TRUE(fetcher.GetBoolParameterOrDefault("undefined", true));
+}
+
 }  // namespace kv_server
@@ -15,6 +15,9 @@
 #include "components/data_server/server/server.h"
 
 #include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
 
 #include "absl/flags/flag.h"
 #include "absl/flags/parse.h"
@@ -22,6 +25,16 @@
 #include "absl/functional/bind_front.h"
 #include "absl/status/status.h"
 #include "absl/strings/str_cat.h"
+#include "components/data_server/cache/key_filter_cache.h"
+#include "components/data_server/cache/partitioned_cache.h"
+#include "components/data_server/cache/rcu_key_value_cache.h"
+#include "components/data_server/cache/slab_key_value_cache.h"
+#include "components/data_server/cache/striped_key_value_cache.h"
+#include "components/data_server/cache/swappable_cache.h"
+#include "components/data_server/cache/tiered_key_value_cache.h"
+#include "components/data_server/cache/tombstone_compactor.h"
+#include "components/data_server/cache/value_compressor.h"
+#include "components/data_server/data_loading/logical_sharding_config.h"
 #include "components/data_server/request_handler/get_values_adapter.h"
 #include "components/data_server/request_handler/get_values_handler.h"
 #include "components/data_server/request_handler/get_values_v2_handler.h"
@@ -52,6 +65,24 @@
 
 ABSL_FLAG(uint16_t, port, 50051,
           "Port the server is listening on. Defaults to 50051.");
+ABSL_FLAG(absl::Duration, key_filter_refresh_interval, absl::Seconds(10),
+          "How often the key filters of the other shards are fetched, when "
+          "the cache-key-filter-expected-keys parameter is set. Keys a shard "
+          "loaded since are reported missing until the next fetch.");
+ABSL_FLAG(int32_t, data_loading_apply_workers, 0,
+          "Number of threads applying the records read from data files to the "
+          "cache, each owning a partition of the keys, while the reading "
+          "threads only decode them. With the cache-num-stripes parameter, a "
+          "divisor of the number of stripes keeps each stripe written by one "
+          "thread. Zero applies the records on the reading threads.");
+ABSL_FLAG(int32_t, data_loading_concurrent_delta_files, 0,
+          "Number of delta files loaded at once at startup, after the "
+          "snapshot. Deleted keys are still removed in file order. Zero or one "
+          "loads them one at a time.");
+ABSL_FLAG(std::string, sharding_function, "SHA256",
+          "Function assigning keys to shards: SHA256, or HIGHWAYHASH, which is "
+          "much faster. Sharded data files must be written with the same one, "
+          "and record it in their sharding metadata.");
 
 namespace kv_server {
 namespace {
@@ -81,6 +112,49 @@ constexpr absl::string_view kDataLoadingNumThreadsParameterSuffix =
 constexpr absl::string_view kNumShardsParameterSuffix = "num-shards";
 constexpr absl::string_view kUdfNumWorkersParameterSuffix = "udf-num-workers";
 constexpr absl::string_view kRouteV1ToV2Suffix = "route-v1-to-v2";
+// The parameters below are optional. Deployments that don't define them get
+// the defaults in `GetCacheParameters` and `CreateStreamRecordReaderFactory`.
+constexpr absl::string_view kDataLoadingMaxThreadsParameterSuffix =
+    "data-loading-max-threads";
+// At most one of lock-free-reads, slab-storage, num-stripes > 1 and
+// compression-threshold-bytes > 0 selects how the cache stores key-value
+// pairs, and at most one of use-snapshot-base, swap-on-load and
+// partition-by-namespace how it's laid out.
+constexpr absl::string_view kCacheNumStripesParameterSuffix =
+    "cache-num-stripes";
+constexpr absl::string_view kCacheLockFreeReadsParameterSuffix =
+    "cache-lock-free-reads";
+constexpr absl::string_view kCacheSlabStorageParameterSuffix =
+    "cache-slab-storage";
+constexpr absl::string_view kCacheSlabCompactionIntervalSecsParameterSuffix =
+    "cache-slab-compaction-interval-secs";
+constexpr absl::string_view
+    kCacheTombstoneCompactionIntervalSecsParameterSuffix =
+        "cache-tombstone-compaction-interval-secs";
+constexpr absl::string_view kCacheMemoryBudgetBytesParameterSuffix =
+    "cache-memory-budget-bytes";
+constexpr absl::string_view kCacheSwapOnLoadParameterSuffix =
+    "cache-swap-on-load";
+// Zero disables the cache image, and cache-image-path isn't read.
+constexpr absl::string_view kCacheImageIntervalSecsParameterSuffix =
+    "cache-image-interval-secs";
+constexpr absl::string_view kCacheImagePathParameterSuffix = "cache-image-path";
+// Unless set, cache-base-path isn't read.
+constexpr absl::string_view kCacheUseSnapshotBaseParameterSuffix =
+    "cache-use-snapshot-base";
+constexpr absl::string_view kCacheBasePathParameterSuffix = "cache-base-path";
+constexpr absl::string_view kCachePartitionByNamespaceParameterSuffix =
+    "cache-partition-by-namespace";
+constexpr absl::string_view kCacheCompressionThresholdBytesParameterSuffix =
+    "cache-compression-threshold-bytes";
+constexpr absl::string_view kCacheDecompressedValuesBytesParameterSuffix =
+    "cache-decompressed-values-bytes";
+constexpr absl::string_view kCacheKeyFilterExpectedKeysParameterSuffix =
+    "cache-key-filter-expected-keys";
+
+const std::vector<double> kReaderParallelismBucketBoundaries = {
+    1, 2, 4, 8, 16, 32, 64,
+};
 
 opentelemetry::sdk::metrics::PeriodicExportingMetricReaderOptions
 GetMetricsOptions(const ParameterClient& parameter_client,
@@ -138,6 +212,14 @@ absl::optional<std::string> GetMetricsCollectorEndPoint(
   return std::move(metrics_collection_endpoint);
 }
 
+void AddGreeting(Cache& cache) {
+  cache.UpdateKeyValue(
+      "hi",
+      "Hello, world! If you are seeing this, it means you can "
+      "query me successfully",
+      /*logical_commit_time = */ 1);
+}
+
 }  // namespace
 
 Server::Server()
@@ -149,16 +231,188 @@ Server::Server()
           GetValuesHook::Create(GetValuesHook::OutputType::kBinary)),
       run_query_hook_(RunQueryHook::Create()) {}
 
+absl::Status Server::GetCacheParameters(
+    const ParameterFetcher& parameter_fetcher) {
+  const auto get_int32 = [&parameter_fetcher](std::string_view suffix,
+                                               int32_t default_value) {
+    const int32_t value =
+        parameter_fetcher.GetInt32ParameterOrDefault(suffix, default_value);
+    LOG(INFO) << "Retrieved " << suffix << " parameter: " << value;
+    return value;
+  };
+  const auto get_int64 = [&parameter_fetcher](std::string_view suffix,
+                                               int64_t default_value) {
+    const int64_t value =
+        parameter_fetcher.GetInt64ParameterOrDefault(suffix, default_value);
+    LOG(INFO) << "Retrieved " << suffix << " parameter: " << value;
+    return value;
+  };
+  const auto get_bool = [&parameter_fetcher](std::string_view suffix) {
+    const bool value = parameter_fetcher.GetBoolParameterOrDefault(
+        suffix, /*default_value=*/false);
+    LOG(INFO) << "Retrieved " << suffix << " parameter: " << value;
+    return value;
+  };
+  const auto get_string = [&parameter_fetcher](std::string_view suffix) {
+    std::string value = parameter_fetcher.GetParameterOrDefault(
+        suffix, /*default_value=*/"");
+    LOG(INFO) << "Retrieved " << suffix << " parameter: " << value;
+    return value;
+  };
+  CacheParameters& params = cache_parameters_;
+  params.num_stripes = get_int32(kCacheNumStripesParameterSuffix, 1);
+  params.lock_free_reads = get_bool(kCacheLockFreeReadsParameterSuffix);
+  params.slab_storage = get_bool(kCacheSlabStorageParameterSuffix);
+  params.slab_compaction_interval = absl::Seconds(
+      get_int32(kCacheSlabCompactionIntervalSecsParameterSuffix, 60));
+  params.tombstone_compaction_interval = absl::Seconds(
+      get_int32(kCacheTombstoneCompactionIntervalSecsParameterSuffix, 30));
+  params.memory_budget_bytes =
+      get_int64(kCacheMemoryBudgetBytesParameterSuffix, 0);
+  params.swap_on_load = get_bool(kCacheSwapOnLoadParameterSuffix);
+  params.image_interval =
+      absl::Seconds(get_int32(kCacheImageIntervalSecsParameterSuffix, 0));
+  if (params.image_interval > absl::ZeroDuration()) {
+    params.image_path = get_string(kCacheImagePathParameterSuffix);
+  }
+  if (get_bool(kCacheUseSnapshotBaseParameterSuffix)) {
+    params.base_path = get_string(kCacheBasePathParameterSuffix);
+  }
+  params.partition_by_namespace =
+      get_bool(kCachePartitionByNamespaceParameterSuffix);
+  params.compression_threshold_bytes =
+      get_int32(kCacheCompressionThresholdBytesParameterSuffix, 0);
+  params.decompressed_values_bytes =
+      get_int64(kCacheDecompressedValuesBytesParameterSuffix, 16 << 20);
+  params.key_filter_expected_keys =
+      get_int32(kCacheKeyFilterExpectedKeysParameterSuffix, 0);
+
+  const auto conflict = [](std::string_view a, std::string_view b) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "Cache parameters ", a, " and ", b, " can't both be set."));
+  };
+  // Parameters selecting how the pairs are stored.
+  std::vector<std::string_view> storage;
+  if (params.lock_free_reads) {
+    storage.push_back(kCacheLockFreeReadsParameterSuffix);
+  }
+  if (params.slab_storage) {
+    storage.push_back(kCacheSlabStorageParameterSuffix);
+  }
+  if (params.num_stripes > 1) {
+    storage.push_back(kCacheNumStripesParameterSuffix);
+  }
+  if (params.compression_threshold_bytes > 0) {
+    storage.push_back(kCacheCompressionThresholdBytesParameterSuffix);
+  }
+  if (storage.size() > 1) {
+    return conflict(storage[0], storage[1]);
+  }
+  // Parameters selecting how the cache is laid out.
+  std::vector<std::string_view> layout;
+  if (!params.base_path.empty()) {
+    layout.push_back(kCacheUseSnapshotBaseParameterSuffix);
+  }
+  if (params.swap_on_load) {
+    layout.push_back(kCacheSwapOnLoadParameterSuffix);
+  }
+  if (params.partition_by_namespace) {
+    layout.push_back(kCachePartitionByNamespaceParameterSuffix);
+  }
+  if (layout.size() > 1) {
+    return conflict(layout[0], layout[1]);
+  }
+  if (!params.base_path.empty()) {
+    // The snapshot base stores the pairs itself, keys mapped from it would
+    // never be added to a key filter, and it's mapped again at startup
+    // instead of loading an image.
+    if (!storage.empty()) {
+      return conflict(kCacheUseSnapshotBaseParameterSuffix, storage[0]);
+    }
+    if (params.key_filter_expected_keys > 0) {
+      return conflict(kCacheUseSnapshotBaseParameterSuffix,
+                      kCacheKeyFilterExpectedKeysParameterSuffix);
+    }
+    if (!params.image_path.empty()) {
+      return conflict(kCacheUseSnapshotBaseParameterSuffix,
+                      kCacheImageIntervalSecsParameterSuffix);
+    }
+  }
+  // Images don't record the partitions of the pairs.
+  if (params.partition_by_namespace && !params.image_path.empty()) {
+    return conflict(kCachePartitionByNamespaceParameterSuffix,
+                    kCacheImageIntervalSecsParameterSuffix);
+  }
+  return absl::OkStatus();
+}
+
 // Because the cache relies on metrics_recorder_, this function needs to be
 // called right after telemetry has been initialized but before anything that
 // requires the cache has been initialized.
 void Server::InitializeKeyValueCache() {
-  cache_ = KeyValueCache::Create(*metrics_recorder_);
-  cache_->UpdateKeyValue(
-      "hi",
-      "Hello, world! If you are seeing this, it means you can "
-      "query me successfully",
-      /*logical_commit_time = */ 1);
+  const CacheParameters& params = cache_parameters_;
+  if (params.key_filter_expected_keys > 0) {
+    LOG(INFO) << "Filtering lookups of keys that weren't loaded, sized for "
+              << params.key_filter_expected_keys << " keys.";
+    key_filter_ = KeyFilter::Create(params.key_filter_expected_keys);
+  }
+  if (!params.base_path.empty()) {
+    LOG(INFO) << "Using cache with a snapshot base at " << params.base_path;
+    auto tiered_cache =
+        TieredKeyValueCache::Create(*metrics_recorder_, params.base_path);
+    AddGreeting(*tiered_cache);
+    tiered_cache_ = tiered_cache.get();
+    cache_ = std::move(tiered_cache);
+  } else if (params.swap_on_load) {
+    LOG(INFO) << "Loading data into a fresh cache instance at startup.";
+    auto swappable_cache =
+        SwappableCache::Create([this] { return CreateKeyValueCache(); });
+    swappable_cache_ = swappable_cache.get();
+    cache_ = std::move(swappable_cache);
+  } else if (params.partition_by_namespace) {
+    LOG(INFO) << "Partitioning the cache by key namespace.";
+    auto partitioned_cache = PartitionedCache::Create(
+        [this](KeyNamespace::Enum) { return CreateKeyValueCache(); });
+    partitioned_cache_ = partitioned_cache.get();
+    cache_ = std::move(partitioned_cache);
+  } else {
+    cache_ = CreateKeyValueCache();
+  }
+  tombstone_compactor_ = TombstoneCompactor::Create(
+      *cache_, params.tombstone_compaction_interval);
+}
+
+std::unique_ptr<Cache> Server::CreateKeyValueCache() {
+  const CacheParameters& params = cache_parameters_;
+  std::unique_ptr<Cache> cache;
+  if (params.lock_free_reads) {
+    LOG(INFO) << "Using cache with lock-free reads.";
+    cache = RcuKeyValueCache::Create(*metrics_recorder_);
+  } else if (params.slab_storage) {
+    LOG(INFO) << "Using cache with slab storage.";
+    cache = SlabKeyValueCache::Create(*metrics_recorder_,
+                                      params.slab_compaction_interval);
+  } else if (params.num_stripes > 1) {
+    LOG(INFO) << "Using lock-striped cache with " << params.num_stripes
+              << " stripes.";
+    cache = StripedKeyValueCache::Create(*metrics_recorder_,
+                                         params.num_stripes);
+  } else if (params.compression_threshold_bytes > 0) {
+    LOG(INFO) << "Compressing cache values of at least "
+              << params.compression_threshold_bytes << " bytes.";
+    cache = KeyValueCache::Create(
+        *metrics_recorder_,
+        ValueCompressionOptions{
+            .threshold_bytes = params.compression_threshold_bytes,
+            .decompressed_cache_bytes = params.decompressed_values_bytes});
+  } else {
+    cache = KeyValueCache::Create(*metrics_recorder_);
+  }
+  if (key_filter_ != nullptr) {
+    cache = KeyFilterCache::Create(std::move(cache), *key_filter_);
+  }
+  AddGreeting(*cache);
+  return cache;
 }
 
 void Server::InitializeTelemetry(const ParameterClient& parameter_client,
@@ -246,13 +500,17 @@ absl::Status Server::Init(
 
 absl::Status Server::InitOnceInstancesAreCreated() {
   InitializeTelemetry(*parameter_client_, *instance_client_);
+  ParameterFetcher parameter_fetcher(environment_, *parameter_client_,
+                                     metrics_recorder_.get());
+  if (absl::Status status = GetCacheParameters(parameter_fetcher);
+      !status.ok()) {
+    return status;
+  }
   InitializeKeyValueCache();
   auto span = GetTracer()->StartSpan("InitServer");
   auto scope = opentelemetry::trace::Scope(span);
   std::unique_ptr<LifecycleHeartbeat> lifecycle_heartbeat =
       LifecycleHeartbeat::Create(*instance_client_, *metrics_recorder_);
-  ParameterFetcher parameter_fetcher(environment_, *parameter_client_,
-                                     metrics_recorder_.get());
   if (absl::Status status = lifecycle_heartbeat->Start(parameter_fetcher);
       status != absl::OkStatus()) {
     return status;
@@ -276,10 +534,23 @@ absl::Status Server::InitOnceInstancesAreCreated() {
   num_shards_ = parameter_fetcher.GetInt32Parameter(kNumShardsParameterSuffix);
   LOG(INFO) << "Retrieved " << kNumShardsParameterSuffix
             << " parameter: " << num_shards_;
+  const std::string sharding_function = absl::GetFlag(FLAGS_sharding_function);
+  if (!ShardingFunctionVersion::Enum_Parse(sharding_function,
+                                           &sharding_function_version_)) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Unknown sharding function: ", sharding_function));
+  }
 
   blob_client_ = CreateBlobClient(parameter_fetcher);
   delta_stream_reader_factory_ =
       CreateStreamRecordReaderFactory(parameter_fetcher);
+  auto logical_shard_mapping = LoadLogicalShardMapping(
+      *blob_client_, *delta_stream_reader_factory_,
+      parameter_fetcher.GetParameter(kDataBucketParameterSuffix), num_shards_);
+  if (!logical_shard_mapping.ok()) {
+    return logical_shard_mapping.status();
+  }
+  logical_shard_mapping_ = std::move(*logical_shard_mapping);
   notifier_ = CreateDeltaFileNotifier(parameter_fetcher);
   auto factory = KeyFetcherFactory::Create();
   key_fetcher_manager_ = factory->CreateKeyFetcherManager(parameter_fetcher);
@@ -296,7 +567,10 @@ absl::Status Server::InitOnceInstancesAreCreated() {
   local_lookup_ = CreateLocalLookup(*cache_, *metrics_recorder_);
   auto server_initializer = GetServerInitializer(
       num_shards_, *metrics_recorder_, *key_fetcher_manager_, *local_lookup_,
-      environment_, shard_num_, *instance_client_, *cache_);
+      environment_, shard_num_, *instance_client_, *cache_, key_filter_.get(),
+      absl::GetFlag(FLAGS_key_filter_refresh_interval),
+      logical_shard_mapping_ ? &*logical_shard_mapping_ : nullptr,
+      sharding_function_version_);
   remote_lookup_ = server_initializer->CreateAndStartRemoteLookupServer();
   {
     auto status_or_notifier = BlobStorageChangeNotifier::Create(
@@ -449,6 +723,19 @@ Server::CreateStreamRecordReaderFactory(
             << " parameter: " << data_loading_num_threads;
   ConcurrentStreamRecordReader<std::string_view>::Options options;
   options.num_worker_threads = data_loading_num_threads;
+  const int32_t max_threads = parameter_fetcher.GetInt32ParameterOrDefault(
+      kDataLoadingMaxThreadsParameterSuffix, /*default_value=*/0);
+  LOG(INFO) << "Retrieved " << kDataLoadingMaxThreadsParameterSuffix
+            << " parameter: " << max_threads;
+  if (max_threads > 0) {
+    LOG(INFO) << "Reading data files on " << max_threads << " shared threads";
+    reader_thread_pool_ = std::make_unique<ReaderThreadPool>(max_threads);
+    options.thread_pool = reader_thread_pool_.get();
+    metrics_recorder_->RegisterHistogram(
+        std::string(kReadStreamRecordsParallelismEvent),
+        "Threads that read a data file at once", "thread",
+        kReaderParallelismBucketBoundaries);
+  }
   return StreamRecordReaderFactory<std::string_view>::Create(options);
 }
 
@@ -472,6 +759,20 @@ std::unique_ptr<DataOrchestrator> Server::CreateDataOrchestrator(
                 .udf_client = *udf_client_,
                 .shard_num = shard_num_,
                 .num_shards = num_shards_,
+                .logical_shard_mapping = logical_shard_mapping_
+                                             ? &*logical_shard_mapping_
+                                             : nullptr,
+                .sharding_function_version = sharding_function_version_,
+                .memory_budget_bytes = cache_parameters_.memory_budget_bytes,
+                .tombstone_compactor = tombstone_compactor_.get(),
+                .swappable_cache = swappable_cache_,
+                .tiered_cache = tiered_cache_,
+                .cache_image_path = cache_parameters_.image_path,
+                .cache_image_interval = cache_parameters_.image_interval,
+                .num_apply_workers =
+                    absl::GetFlag(FLAGS_data_loading_apply_workers),
+                .num_concurrent_delta_loads =
+                    absl::GetFlag(FLAGS_data_loading_concurrent_delta_files),
             },
             *metrics_recorder_);
       },
@@ -17,6 +17,7 @@
 
 #include <iostream>
 #include <memory>
+#include <optional>
 #include <string>
 #include <utility>
 #include <vector>
@@ -29,6 +30,11 @@
 #include "components/data/realtime/realtime_thread_pool_manager.h"
 #include "components/data_server/cache/cache.h"
 #include "components/data_server/cache/key_value_cache.h"
+#include "components/data_server/cache/partitioned_cache.h"
+#include "components/data_server/cache/swappable_cache.h"
+#include "components/data_server/cache/key_filter.h"
+#include "components/data_server/cache/tiered_key_value_cache.h"
+#include "components/data_server/cache/tombstone_compactor.h"
 #include "components/data_server/data_loading/data_orchestrator.h"
 #include "components/data_server/request_handler/get_values_adapter.h"
 #include "components/data_server/server/lifecycle_heartbeat.h"
@@ -43,7 +49,10 @@
 #include "components/util/platform_initializer.h"
 #include "grpcpp/grpcpp.h"
 #include "public/base_types.pb.h"
+#include "public/data_loading/riegeli_metadata.pb.h"
+#include "public/data_loading/readers/reader_thread_pool.h"
 #include "public/query/get_values.grpc.pb.h"
+#include "public/sharding/logical_shard_mapping.h"
 #include "src/cpp/telemetry/metrics_recorder.h"
 #include "src/cpp/telemetry/telemetry.h"
 
@@ -77,7 +86,13 @@ class Server {
       std::unique_ptr<UdfClient> udf_client);
 
   absl::Status InitOnceInstancesAreCreated();
+  // Reads the cache parameters, or the defaults of those not defined, into
+  // `cache_parameters_`, rejecting combinations that select more than one
+  // cache type.
+  absl::Status GetCacheParameters(const ParameterFetcher& parameter_fetcher);
   void InitializeKeyValueCache();
+  // Creates a cache of the type selected by the parameters.
+  std::unique_ptr<Cache> CreateKeyValueCache();
 
   std::unique_ptr<BlobStorageClient> CreateBlobClient(
       const ParameterFetcher& parameter_fetcher);
@@ -113,7 +128,38 @@ class Server {
       metrics_recorder_;
   std::vector<std::unique_ptr<grpc::Service>> grpc_services_;
   std::unique_ptr<grpc::Server> grpc_server_;
+  // Cache configuration, see the parameters they are read from in server.cc.
+  struct CacheParameters {
+    int32_t num_stripes = 1;
+    bool lock_free_reads = false;
+    bool slab_storage = false;
+    absl::Duration slab_compaction_interval;
+    absl::Duration tombstone_compaction_interval;
+    int64_t memory_budget_bytes = 0;
+    bool swap_on_load = false;
+    // Empty if the cache isn't written to an image.
+    std::string image_path;
+    absl::Duration image_interval;
+    // Empty if the snapshot isn't kept in a memory mapped base.
+    std::string base_path;
+    bool partition_by_namespace = false;
+    int64_t compression_threshold_bytes = 0;
+    int64_t decompressed_values_bytes = 0;
+    int64_t key_filter_expected_keys = 0;
+  };
+  CacheParameters cache_parameters_;
+  // Set if cache-key-filter-expected-keys is, must outlive the caches that
+  // add keys to it.
+  std::unique_ptr<KeyFilter> key_filter_;
   std::unique_ptr<Cache> cache_;
+  // Set if `cache_` is a SwappableCache.
+  SwappableCache* swappable_cache_ = nullptr;
+  // Set if `cache_` is a TieredKeyValueCache.
+  TieredKeyValueCache* tiered_cache_ = nullptr;
+  // Set if `cache_` is a PartitionedCache.
+  PartitionedCache* partitioned_cache_ = nullptr;
+  // Must be destroyed before the cache it compacts.
+  std::unique_ptr<TombstoneCompactor> tombstone_compactor_;
   std::unique_ptr<GetValuesAdapter> get_values_adapter_;
   std::unique_ptr<GetValuesHook> string_get_values_hook_;
   std::unique_ptr<GetValuesHook> binary_get_values_hook_;
@@ -129,6 +175,8 @@ class Server {
   std::unique_ptr<DeltaFileNotifier> notifier_;
   std::unique_ptr<BlobStorageChangeNotifier> change_notifier_;
   std::unique_ptr<RealtimeThreadPoolManager> realtime_thread_pool_manager_;
+  // Set if data-loading-max-threads is, shared by the readers.
+  std::unique_ptr<ReaderThreadPool> reader_thread_pool_;
   std::unique_ptr<StreamRecordReaderFactory<std::string_view>>
       delta_stream_reader_factory_;
 
@@ -150,6 +198,10 @@ class Server {
 
   int32_t shard_num_;
   int32_t num_shards_;
+  // Set if the data bucket has a logical sharding config.
+  std::optional<LogicalShardMapping> logical_shard_mapping_;
+  ShardingFunctionVersion::Enum sharding_function_version_ =
+      ShardingFunctionVersion::SHA256;
 
   std::unique_ptr<privacy_sandbox::server_common::KeyFetcherManagerInterface>
       key_fetcher_manager_;
@@ -80,19 +80,26 @@ class ShardedServerInitializer : public ServerInitializer {
       MetricsRecorder& metrics_recorder,
       KeyFetcherManagerInterface& key_fetcher_manager, Lookup& local_lookup,
       std::string environment, int32_t num_shards, int32_t current_shard_num,
-      InstanceClient& instance_client)
+      InstanceClient& instance_client, const KeyFilter* key_filter,
+      absl::Duration key_filter_refresh_interval,
+      const LogicalShardMapping* logical_shard_mapping,
+      ShardingFunctionVersion::Enum sharding_function_version)
       : metrics_recorder_(metrics_recorder),
         key_fetcher_manager_(key_fetcher_manager),
         local_lookup_(local_lookup),
         environment_(environment),
         num_shards_(num_shards),
         current_shard_num_(current_shard_num),
-        instance_client_(instance_client) {}
+        instance_client_(instance_client),
+        key_filter_(key_filter),
+        key_filter_refresh_interval_(key_filter_refresh_interval),
+        logical_shard_mapping_(logical_shard_mapping),
+        sharding_function_version_(sharding_function_version) {}
 
   RemoteLookup CreateAndStartRemoteLookupServer() override {
     RemoteLookup remote_lookup;
     remote_lookup.remote_lookup_service = std::make_unique<LookupServiceImpl>(
-        local_lookup_, key_fetcher_manager_, metrics_recorder_);
+        local_lookup_, key_fetcher_manager_, metrics_recorder_, key_filter_);
     grpc::ServerBuilder remote_lookup_server_builder;
     auto remoteLookupServerAddress =
         absl::StrCat(kLocalIp, ":", kRemoteLookupServerPort);
@@ -115,14 +122,25 @@ class ShardedServerInitializer : public ServerInitializer {
     if (!maybe_shard_state.ok()) {
       return maybe_shard_state.status();
     }
-    auto lookup_supplier = [&local_lookup = local_lookup_,
-                            num_shards = num_shards_,
-                            current_shard_num = current_shard_num_,
-                            &shard_manager = *maybe_shard_state->shard_manager,
-                            &metrics_recorder = metrics_recorder_]() {
-      return CreateShardedLookup(local_lookup, num_shards, current_shard_num,
-                                 shard_manager, metrics_recorder);
-    };
+    if (key_filter_ != nullptr) {
+      maybe_shard_state->peer_key_filters = PeerKeyFilters::Create(
+          num_shards_, current_shard_num_, *key_filter_,
+          *maybe_shard_state->shard_manager, metrics_recorder_,
+          key_filter_refresh_interval_);
+    }
+    auto lookup_supplier =
+        [&local_lookup = local_lookup_, num_shards = num_shards_,
+         current_shard_num = current_shard_num_,
+         &shard_manager = *maybe_shard_state->shard_manager,
+         &metrics_recorder = metrics_recorder_,
+         key_filters = maybe_shard_state->peer_key_filters.get(),
+         logical_shard_mapping = logical_shard_mapping_,
+         sharding_function_version = sharding_function_version_]() {
+          return CreateShardedLookup(
+              local_lookup, num_shards, current_shard_num, shard_manager,
+              metrics_recorder, key_filters, logical_shard_mapping,
+              sharding_function_version);
+        };
     InitializeUdfHooksInternal(std::move(lookup_supplier),
                                string_get_values_hook, binary_get_values_hook,
                                run_query_hook);
@@ -168,6 +186,10 @@ class ShardedServerInitializer : public ServerInitializer {
   int32_t num_shards_;
   int32_t current_shard_num_;
   InstanceClient& instance_client_;
+  const KeyFilter* key_filter_;
+  absl::Duration key_filter_refresh_interval_;
+  const LogicalShardMapping* logical_shard_mapping_;
+  ShardingFunctionVersion::Enum sharding_function_version_;
 };
 
 }  // namespace
@@ -176,7 +198,10 @@ std::unique_ptr<ServerInitializer> GetServerInitializer(
     int64_t num_shards, MetricsRecorder& metrics_recorder,
     KeyFetcherManagerInterface& key_fetcher_manager, Lookup& local_lookup,
     std::string environment, int32_t current_shard_num,
-    InstanceClient& instance_client, Cache& cache) {
+    InstanceClient& instance_client, Cache& cache, const KeyFilter* key_filter,
+    absl::Duration key_filter_refresh_interval,
+    const LogicalShardMapping* logical_shard_mapping,
+    ShardingFunctionVersion::Enum sharding_function_version) {
   CHECK_GT(num_shards, 0) << "num_shards must be greater than 0";
   if (num_shards == 1) {
     return std::make_unique<NonshardedServerInitializer>(metrics_recorder,
@@ -185,6 +210,8 @@ std::unique_ptr<ServerInitializer> GetServerInitializer(
 
   return std::make_unique<ShardedServerInitializer>(
       metrics_recorder, key_fetcher_manager, local_lookup, environment,
-      num_shards, current_shard_num, instance_client);
+      num_shards, current_shard_num, instance_client, key_filter,
+      key_filter_refresh_interval, logical_shard_mapping,
+      sharding_function_version);
 }
 }  // namespace kv_server
@@ -22,11 +22,16 @@
 
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
+#include "absl/time/time.h"
+#include "components/data_server/cache/key_filter.h"
 #include "components/internal_server/lookup.h"
 #include "components/sharding/cluster_mappings_manager.h"
+#include "components/sharding/peer_key_filters.h"
 #include "components/udf/hooks/get_values_hook.h"
 #include "components/udf/hooks/run_query_hook.h"
 #include "grpcpp/grpcpp.h"
+#include "public/data_loading/riegeli_metadata.pb.h"
+#include "public/sharding/logical_shard_mapping.h"
 #include "src/cpp/encryption/key_fetcher/interface/key_fetcher_manager_interface.h"
 #include "src/cpp/telemetry/metrics_recorder.h"
 
@@ -45,6 +50,9 @@ struct RemoteLookup {
 struct ShardManagerState {
   std::unique_ptr<ClusterMappingsManager> cluster_mappings_manager;
   std::unique_ptr<ShardManager> shard_manager;
+  // Set if the cache has a key filter, must be destroyed before the shard
+  // manager it fetches through.
+  std::unique_ptr<PeerKeyFilters> peer_key_filters;
 };
 
 // Encapsulates logic that differs for sharded and non-sharded implementations.
@@ -56,12 +64,23 @@ class ServerInitializer {
       GetValuesHook& binary_get_values_hook, RunQueryHook& run_query_hook) = 0;
 };
 
+// `key_filter` is the filter of the keys loaded into `cache`, or null if it
+// has none. With more than one shard, it's served to the other shards, and
+// `key_filter_refresh_interval` is how often theirs are fetched.
+// `logical_shard_mapping`, if set, maps the logical shards keys hash to onto
+// the `num_shards` physical shards requests are sent to. Keys are assigned to
+// shards by the function of `sharding_function_version`.
 std::unique_ptr<ServerInitializer> GetServerInitializer(
     int64_t num_shards, MetricsRecorder& metrics_recorder,
     privacy_sandbox::server_common::KeyFetcherManagerInterface&
         key_fetcher_manager,
     Lookup& local_lookup, std::string environment, int32_t current_shard_num,
-    InstanceClient& instance_client, Cache& cache);
+    InstanceClient& instance_client, Cache& cache,
+    const KeyFilter* key_filter = nullptr,
+    absl::Duration key_filter_refresh_interval = absl::ZeroDuration(),
+    const LogicalShardMapping* logical_shard_mapping = nullptr,
+    ShardingFunctionVersion::Enum sharding_function_version =
+        ShardingFunctionVersion::SHARDING_FUNCTION_VERSION_UNSPECIFIED);
 
 }  // namespace kv_server
 #endif  // COMPONENTS_DATA_SERVER_SERVER_INITIALIZER_H_
@@ -14,8 +14,10 @@
  * limitations under the License.
  */
 
+#include <string_view>
 #include <thread>
 
+#include "absl/status/status.h"
 #include "components/data_server/server/mocks.h"
 #include "components/data_server/server/server.h"
 #include "components/udf/mocks.h"
@@ -58,6 +60,37 @@ class MockParameterClient : public ParameterClient {
                            "kv-server-environment-backup-poll-frequency-secs"))
         .WillOnce(::testing::Return(123));
   }
+
+  // Selects the default cache, unless overridden by later expectations.
+  void RegisterDefaultCacheExpectations() {
+    for (std::string_view name :
+         {"kv-server-environment-cache-lock-free-reads",
+          "kv-server-environment-cache-slab-storage",
+          "kv-server-environment-cache-swap-on-load",
+          "kv-server-environment-cache-use-snapshot-base",
+          "kv-server-environment-cache-partition-by-namespace"}) {
+      EXPECT_CALL(*this, GetBoolParameter(name))
+          .WillRepeatedly(::testing::Return(false));
+    }
+    for (std::string_view name :
+         {"kv-server-environment-cache-num-stripes",
+          "kv-server-environment-cache-slab-compaction-interval-secs",
+          "kv-server-environment-cache-tombstone-compaction-interval-secs",
+          "kv-server-environment-cache-image-interval-secs",
+          "kv-server-environment-cache-compression-threshold-bytes",
+          "kv-server-environment-cache-key-filter-expected-keys",
+          "kv-server-environment-data-loading-max-threads"}) {
+      EXPECT_CALL(*this, GetInt32Parameter(name))
+          .WillRepeatedly(::testing::Return(0));
+    }
+    // Parameters deployments don't define take their defaults.
+    for (std::string_view name :
+         {"kv-server-environment-cache-memory-budget-bytes",
+          "kv-server-environment-cache-decompressed-values-bytes"}) {
+      EXPECT_CALL(*this, GetParameter(name))
+          .WillRepeatedly(::testing::Return(absl::NotFoundError(name)));
+    }
+  }
 };
 
 void InitializeMetrics() {
@@ -89,6 +122,7 @@ TEST(ServerLocalTest, InitFailsWithNoDeltaDirectory) {
   auto instance_client = std::make_unique<MockInstanceClient>();
   auto parameter_client = std::make_unique<MockParameterClient>();
   parameter_client->RegisterRequiredTelemetryExpectations();
+  parameter_client->RegisterDefaultCacheExpectations();
   auto mock_udf_client = std::make_unique<MockUdfClient>();
 
   EXPECT_CALL(*instance_client, GetEnvironmentTag())
@@ -122,10 +156,50 @@ TEST(ServerLocalTest, InitFailsWithNoDeltaDirectory) {
   EXPECT_FALSE(status.ok());
 }
 
+TEST(ServerLocalTest, InitFailsWithConflictingCacheParameters) {
+  auto instance_client = std::make_unique<MockInstanceClient>();
+  auto parameter_client = std::make_unique<MockParameterClient>();
+  parameter_client->RegisterDefaultCacheExpectations();
+  auto mock_udf_client = std::make_unique<MockUdfClient>();
+
+  EXPECT_CALL(*instance_client, GetEnvironmentTag())
+      .WillOnce(::testing::Return("environment"));
+  EXPECT_CALL(*instance_client, GetInstanceId())
+      .WillOnce(::testing::Return("instance id"));
+  EXPECT_CALL(*parameter_client, GetBoolParameter("kv-server-environment-use-"
+                                                  "external-metrics-collector-"
+                                                  "endpoint"))
+      .WillOnce(::testing::Return(false));
+  EXPECT_CALL(
+      *parameter_client,
+      GetInt32Parameter("kv-server-environment-metrics-export-interval-millis"))
+      .WillOnce(::testing::Return(100));
+  EXPECT_CALL(
+      *parameter_client,
+      GetInt32Parameter("kv-server-environment-metrics-export-timeout-millis"))
+      .WillOnce(::testing::Return(200));
+  EXPECT_CALL(*parameter_client,
+              GetInt32Parameter("kv-server-environment-udf-num-workers"))
+      .WillOnce(::testing::Return(2));
+  EXPECT_CALL(*parameter_client,
+              GetBoolParameter("kv-server-environment-cache-lock-free-reads"))
+      .WillOnce(::testing::Return(true));
+  EXPECT_CALL(*parameter_client,
+              GetBoolParameter("kv-server-environment-cache-slab-storage"))
+      .WillOnce(::testing::Return(true));
+
+  kv_server::Server server;
+  absl::Status status =
+      server.Init(std::move(parameter_client), std::move(instance_client),
+                  std::move(mock_udf_client));
+  EXPECT_EQ(status.code(), absl::StatusCode::kInvalidArgument);
+}
+
 TEST(ServerLocalTest, InitPassesWithDeltaDirectoryAndRealtimeDirectory) {
   auto instance_client = std::make_unique<MockInstanceClient>();
   auto parameter_client = std::make_unique<MockParameterClient>();
   parameter_client->RegisterRequiredTelemetryExpectations();
+  parameter_client->RegisterDefaultCacheExpectations();
   auto mock_udf_client = std::make_unique<MockUdfClient>();
 
   EXPECT_CALL(*instance_client, GetEnvironmentTag())
@@ -176,6 +250,7 @@ TEST(ServerLocalTest, GracefulServerShutdown) {
   auto instance_client = std::make_unique<MockInstanceClient>();
   auto parameter_client = std::make_unique<MockParameterClient>();
   parameter_client->RegisterRequiredTelemetryExpectations();
+  parameter_client->RegisterDefaultCacheExpectations();
   auto mock_udf_client = std::make_unique<MockUdfClient>();
 
   EXPECT_CALL(*instance_client, GetEnvironmentTag())
@@ -229,6 +304,7 @@ TEST(ServerLocalTest, ForceServerShutdown) {
   auto instance_client = std::make_unique<MockInstanceClient>();
   auto parameter_client = std::make_unique<MockParameterClient>();
   parameter_client->RegisterRequiredTelemetryExpectations();
+  parameter_client->RegisterDefaultCacheExpectations();
   auto mock_udf_client = std::make_unique<MockUdfClient>();
 
   EXPECT_CALL(*instance_client, GetEnvironmentTag())
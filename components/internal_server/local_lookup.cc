@@ -20,10 +20,12 @@
 #include <utility>
 #include <vector>
 
+#include "absl/strings/cord.h"
 #include "components/data_server/cache/cache.h"
 #include "components/internal_server/lookup.h"
 #include "components/internal_server/lookup.pb.h"
 #include "components/query/driver.h"
+#include "components/query/roaring_bitmap.h"
 #include "components/query/scanner.h"
 #include "glog/logging.h"
 #include "src/cpp/telemetry/metrics_recorder.h"
@@ -44,7 +46,17 @@ class LocalLookup : public Lookup {
 
   absl::StatusOr<InternalLookupResponse> GetKeyValues(
       const std::vector<std::string_view>& keys) const override {
-    return ProcessKeys(keys);
+    return ProcessKeys(keys, /*read_version=*/nullptr);
+  }
+
+  std::unique_ptr<ReadVersion> PinReadVersion() const override {
+    return cache_.PinReadVersion();
+  }
+
+  absl::StatusOr<InternalLookupResponse> GetKeyValuesAt(
+      const std::vector<std::string_view>& keys,
+      const ReadVersion* read_version) const override {
+    return ProcessKeys(keys, read_version);
   }
 
   absl::StatusOr<InternalLookupResponse> GetKeyValueSet(
@@ -58,13 +70,13 @@ class LocalLookup : public Lookup {
   }
 
  private:
-  InternalLookupResponse ProcessKeys(
-      const std::vector<std::string_view>& keys) const {
+  InternalLookupResponse ProcessKeys(const std::vector<std::string_view>& keys,
+                                     const ReadVersion* read_version) const {
     InternalLookupResponse response;
     if (keys.empty()) {
       return response;
     }
-    auto kv_pairs = cache_.GetKeyValuePairs(keys);
+    auto kv_pairs = cache_.GetKeyValuePairsAt(keys, read_version);
 
     for (const auto& key : keys) {
       SingleLookupResult result;
@@ -73,7 +85,7 @@ class LocalLookup : public Lookup {
         auto status = result.mutable_status();
         status->set_code(static_cast<int>(absl::StatusCode::kNotFound));
       } else {
-        result.set_value(std::move(key_iter->second));
+        absl::CopyCordToString(key_iter->second, result.mutable_value());
       }
       (*response.mutable_kv_pairs())[key] = std::move(result);
     }
@@ -124,12 +136,19 @@ class LocalLookup : public Lookup {
     get_key_value_set_result =
         cache_.GetKeyValueSet(driver.GetRootNode()->Keys());
 
-    auto result = driver.GetResult();
+    // Set operations run on bitmaps of value IDs, so only the values in the
+    // result are resolved to strings.
+    auto result = driver.GetResult<RoaringBitmap>(
+        [&get_key_value_set_result](std::string_view key) {
+          return get_key_value_set_result->GetValueIdSet(key);
+        });
     if (!result.ok()) {
       return result.status();
     }
+    const std::vector<std::string_view> values =
+        get_key_value_set_result->GetValues(*result);
     InternalRunQueryResponse response;
-    response.mutable_elements()->Assign(result->begin(), result->end());
+    response.mutable_elements()->Assign(values.begin(), values.end());
     return response;
   }
 
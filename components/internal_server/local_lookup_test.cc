@@ -19,7 +19,10 @@
 #include <utility>
 #include <vector>
 
+#include "absl/strings/cord.h"
+#include "components/data_server/cache/key_value_cache.h"
 #include "components/data_server/cache/mocks.h"
+#include "components/query/roaring_bitmap.h"
 #include "gmock/gmock.h"
 #include "google/protobuf/text_format.h"
 #include "gtest/gtest.h"
@@ -43,8 +46,8 @@ class LocalLookupTest : public ::testing::Test {
 
 TEST_F(LocalLookupTest, GetKeyValues_KeysFound_Success) {
   EXPECT_CALL(mock_cache_, GetKeyValuePairs(_))
-      .WillOnce(Return(absl::flat_hash_map<std::string, std::string>{
-          {"key1", "value1"}, {"key2", "value2"}}));
+      .WillOnce(Return(absl::flat_hash_map<std::string_view, absl::Cord>{
+          {"key1", absl::Cord("value1")}, {"key2", absl::Cord("value2")}}));
 
   auto local_lookup = CreateLocalLookup(mock_cache_, mock_metrics_recorder_);
   auto response = local_lookup->GetKeyValues({"key1", "key2"});
@@ -66,8 +69,8 @@ TEST_F(LocalLookupTest, GetKeyValues_KeysFound_Success) {
 
 TEST_F(LocalLookupTest, GetKeyValues_KeyMissing_ReturnsStatusForKey) {
   EXPECT_CALL(mock_cache_, GetKeyValuePairs(_))
-      .WillOnce(Return(
-          absl::flat_hash_map<std::string, std::string>{{"key1", "value1"}}));
+      .WillOnce(Return(absl::flat_hash_map<std::string_view, absl::Cord>{
+          {"key1", absl::Cord("value1")}}));
 
   auto local_lookup = CreateLocalLookup(mock_cache_, mock_metrics_recorder_);
   auto response = local_lookup->GetKeyValues({"key1", "key2"});
@@ -96,6 +99,27 @@ TEST_F(LocalLookupTest, GetKeyValues_EmptyRequest_ReturnsEmptyResponse) {
   EXPECT_THAT(response.value(), EqualsProto(expected));
 }
 
+TEST_F(LocalLookupTest, GetKeyValuesAt_PinnedVersion_IgnoresLaterUpdates) {
+  auto cache = KeyValueCache::Create(mock_metrics_recorder_);
+  cache->UpdateKeyValue("key1", "value1", 1);
+  auto local_lookup = CreateLocalLookup(*cache, mock_metrics_recorder_);
+  std::unique_ptr<ReadVersion> read_version = local_lookup->PinReadVersion();
+  ASSERT_NE(read_version, nullptr);
+  cache->UpdateKeyValue("key1", "value2", 2);
+
+  auto response = local_lookup->GetKeyValuesAt({"key1"}, read_version.get());
+  EXPECT_TRUE(response.ok());
+
+  InternalLookupResponse expected;
+  TextFormat::ParseFromString(R"pb(kv_pairs {
+                                     key: "key1"
+                                     value { value: "value1" }
+                                   }
+                              )pb",
+                              &expected);
+  EXPECT_THAT(response.value(), EqualsProto(expected));
+}
+
 TEST_F(LocalLookupTest, GetKeyValueSets_KeysFound_Success) {
   auto mock_get_key_value_set_result =
       std::make_unique<MockGetKeyValueSetResult>();
@@ -150,9 +174,11 @@ TEST_F(LocalLookupTest, RunQuery_Success) {
 
   auto mock_get_key_value_set_result =
       std::make_unique<MockGetKeyValueSetResult>();
-  EXPECT_CALL(*mock_get_key_value_set_result, GetValueSet("someset"))
-      .WillOnce(
-          Return(absl::flat_hash_set<std::string_view>{"value1", "value2"}));
+  const RoaringBitmap value_ids = RoaringBitmap::FromSorted({3, 7});
+  EXPECT_CALL(*mock_get_key_value_set_result, GetValueIdSet("someset"))
+      .WillOnce(testing::ReturnRef(value_ids));
+  EXPECT_CALL(*mock_get_key_value_set_result, GetValues(value_ids))
+      .WillOnce(Return(std::vector<std::string_view>{"value1", "value2"}));
   EXPECT_CALL(mock_cache_,
               GetKeyValueSet(absl::flat_hash_set<std::string_view>{"someset"}))
       .WillOnce(Return(std::move(mock_get_key_value_set_result)));
@@ -23,6 +23,7 @@
 
 #include "absl/container/flat_hash_set.h"
 #include "absl/status/statusor.h"
+#include "components/data_server/cache/cache.h"
 #include "components/internal_server/lookup.pb.h"
 
 namespace kv_server {
@@ -35,6 +36,21 @@ class Lookup {
   virtual absl::StatusOr<InternalLookupResponse> GetKeyValues(
       const std::vector<std::string_view>& keys) const = 0;
 
+  // Pins the key-value pairs for `GetKeyValuesAt`, see
+  // `Cache::PinReadVersion`. Returns null if lookups can't be pinned.
+  virtual std::unique_ptr<ReadVersion> PinReadVersion() const {
+    return nullptr;
+  }
+
+  // Like `GetKeyValues`, but as of `read_version`, which must have been
+  // pinned by a lookup of the same cache. A null `read_version` reads the
+  // latest values.
+  virtual absl::StatusOr<InternalLookupResponse> GetKeyValuesAt(
+      const std::vector<std::string_view>& keys,
+      const ReadVersion* read_version) const {
+    return GetKeyValues(keys);
+  }
+
   virtual absl::StatusOr<InternalLookupResponse> GetKeyValueSet(
       const absl::flat_hash_set<std::string_view>& key_set) const = 0;
 
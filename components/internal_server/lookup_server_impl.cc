@@ -43,6 +43,7 @@ constexpr char kEncryptionError[] = "EncryptionError";
 constexpr char kDeserializationError[] = "DeserializationError";
 constexpr char kRunQueryError[] = "RunQueryError";
 constexpr char kSecureLookup[] = "SecureLookup";
+constexpr char kSecureKeyFilter[] = "SecureKeyFilter";
 
 grpc::Status LookupServiceImpl::ToInternalGrpcStatus(
     const absl::Status& status, const char* eventName) const {
@@ -167,4 +168,53 @@ grpc::Status LookupServiceImpl::InternalRunQuery(
   return grpc::Status::OK;
 }
 
+grpc::Status LookupServiceImpl::SecureKeyFilter(
+    grpc::ServerContext* context,
+    const SecureKeyFilterRequest* secure_key_filter_request,
+    SecureKeyFilterResponse* secure_response) {
+  ScopeLatencyRecorder latency_recorder(std::string(kSecureKeyFilter),
+                                        metrics_recorder_);
+  if (context->IsCancelled()) {
+    return grpc::Status(grpc::StatusCode::CANCELLED,
+                        "Deadline exceeded or client cancelled, abandoning.");
+  }
+  if (key_filter_ == nullptr) {
+    return grpc::Status(grpc::StatusCode::UNIMPLEMENTED,
+                        "The server doesn't keep a key filter.");
+  }
+
+  OhttpServerEncryptor encryptor(key_fetcher_manager_);
+  auto padded_serialized_request_maybe =
+      encryptor.DecryptRequest(secure_key_filter_request->ohttp_request());
+  if (!padded_serialized_request_maybe.ok()) {
+    return ToInternalGrpcStatus(padded_serialized_request_maybe.status(),
+                                kDecryptionError);
+  }
+  auto serialized_request_maybe =
+      kv_server::Unpad(*padded_serialized_request_maybe);
+  if (!serialized_request_maybe.ok()) {
+    return ToInternalGrpcStatus(serialized_request_maybe.status(),
+                                kUnpaddingError);
+  }
+  KeyFilterRequest request;
+  if (!request.ParseFromString(*serialized_request_maybe)) {
+    return grpc::Status(grpc::StatusCode::INTERNAL,
+                        "Failed parsing incoming request");
+  }
+
+  KeyFilterResponse response;
+  response.set_version(key_filter_->version());
+  if (response.version() != request.known_version()) {
+    response.set_filter(key_filter_->Serialize());
+  }
+  auto encrypted_response_payload =
+      encryptor.EncryptResponse(response.SerializeAsString());
+  if (!encrypted_response_payload.ok()) {
+    return ToInternalGrpcStatus(encrypted_response_payload.status(),
+                                kEncryptionError);
+  }
+  secure_response->set_ohttp_response(*encrypted_response_payload);
+  return grpc::Status::OK;
+}
+
 }  // namespace kv_server
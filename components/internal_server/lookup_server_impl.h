@@ -19,6 +19,7 @@
 
 #include <string>
 
+#include "components/data_server/cache/key_filter.h"
 #include "components/internal_server/lookup.grpc.pb.h"
 #include "components/internal_server/lookup.h"
 #include "grpcpp/grpcpp.h"
@@ -31,14 +32,18 @@ namespace kv_server {
 class LookupServiceImpl final
     : public kv_server::InternalLookupService::Service {
  public:
+  // `key_filter`, if set, is the filter of the keys `lookup` holds, served
+  // by `SecureKeyFilter`.
   LookupServiceImpl(
       const Lookup& lookup,
       privacy_sandbox::server_common::KeyFetcherManagerInterface&
           key_fetcher_manager,
-      privacy_sandbox::server_common::MetricsRecorder& metrics_recorder)
+      privacy_sandbox::server_common::MetricsRecorder& metrics_recorder,
+      const KeyFilter* key_filter = nullptr)
       : lookup_(lookup),
         key_fetcher_manager_(key_fetcher_manager),
-        metrics_recorder_(metrics_recorder) {}
+        metrics_recorder_(metrics_recorder),
+        key_filter_(key_filter) {}
 
   ~LookupServiceImpl() override = default;
 
@@ -56,6 +61,12 @@ class LookupServiceImpl final
       const kv_server::InternalRunQueryRequest* request,
       kv_server::InternalRunQueryResponse* response) override;
 
+  // Returns UNIMPLEMENTED if the service has no key filter.
+  grpc::Status SecureKeyFilter(
+      grpc::ServerContext* context,
+      const kv_server::SecureKeyFilterRequest* request,
+      kv_server::SecureKeyFilterResponse* response) override;
+
  private:
   std::string GetPayload(
       const bool lookup_sets,
@@ -71,6 +82,7 @@ class LookupServiceImpl final
   privacy_sandbox::server_common::KeyFetcherManagerInterface&
       key_fetcher_manager_;
   privacy_sandbox::server_common::MetricsRecorder& metrics_recorder_;
+  const KeyFilter* key_filter_;
 };
 
 }  // namespace kv_server
@@ -17,6 +17,7 @@
 #ifndef COMPONENTS_INTERNAL_SERVER_MOCKS_H_
 #define COMPONENTS_INTERNAL_SERVER_MOCKS_H_
 
+#include <memory>
 #include <string>
 #include <string_view>
 #include <vector>
@@ -35,6 +36,8 @@ class MockRemoteLookupClient : public RemoteLookupClient {
   MOCK_METHOD(absl::StatusOr<InternalLookupResponse>, GetValues,
               (std::string_view serialized_message, int32_t padding_length),
               (const, override));
+  MOCK_METHOD(absl::StatusOr<KeyFilterResponse>, GetKeyFilter,
+              (int64_t known_version), (const, override));
   MOCK_METHOD(std::string_view, GetIpAddress, (), (const, override));
 };
 
@@ -42,6 +45,8 @@ class MockLookup : public Lookup {
  public:
   MOCK_METHOD(absl::StatusOr<InternalLookupResponse>, GetKeyValues,
               (const std::vector<std::string_view>&), (const, override));
+  MOCK_METHOD(std::unique_ptr<ReadVersion>, PinReadVersion, (),
+              (const, override));
   MOCK_METHOD(absl::StatusOr<InternalLookupResponse>, GetKeyValueSet,
               (const absl::flat_hash_set<std::string_view>&),
               (const, override));
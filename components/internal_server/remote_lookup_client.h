@@ -39,6 +39,10 @@ class RemoteLookupClient {
   // with preventing double serialization.
   virtual absl::StatusOr<InternalLookupResponse> GetValues(
       std::string_view serialized_message, int32_t padding_length) const = 0;
+  // Fetches the key filter of the remote server. The response only carries
+  // the filter if its version differs from `known_version`.
+  virtual absl::StatusOr<KeyFilterResponse> GetKeyFilter(
+      int64_t known_version) const = 0;
   virtual std::string_view GetIpAddress() const = 0;
   static std::unique_ptr<RemoteLookupClient> Create(
       std::string ip_address,
@@ -12,6 +12,7 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 #include <memory>
+#include <memory>
 #include <string>
 
 #include "absl/status/status.h"
@@ -34,6 +35,16 @@ constexpr char kEncryptionFailure[] = "EncryptionFailure";
 constexpr char kSecureLookupFailure[] = "SecureLookupFailure";
 constexpr char kDecryptionFailure[] = "DecryptionFailure";
 constexpr char kRemoteLookupGetValues[] = "RemoteLookupGetValues";
+constexpr char kSecureKeyFilterFailure[] = "SecureKeyFilterFailure";
+constexpr char kRemoteLookupGetKeyFilter[] = "RemoteLookupGetKeyFilter";
+
+// Filters are larger than gRPC's default limit of 4MB for large key sets.
+std::shared_ptr<grpc::Channel> CreateChannel(const std::string& ip_address) {
+  grpc::ChannelArguments args;
+  args.SetMaxReceiveMessageSize(-1);
+  return grpc::CreateCustomChannel(
+      ip_address, grpc::InsecureChannelCredentials(), args);
+}
 
 class RemoteLookupClientImpl : public RemoteLookupClient {
  public:
@@ -47,8 +58,7 @@ class RemoteLookupClientImpl : public RemoteLookupClient {
       privacy_sandbox::server_common::MetricsRecorder& metrics_recorder)
       : ip_address_(
             absl::StrFormat("%s:%s", ip_address, kRemoteLookupServerPort)),
-        stub_(InternalLookupService::NewStub(grpc::CreateChannel(
-            ip_address_, grpc::InsecureChannelCredentials()))),
+        stub_(InternalLookupService::NewStub(CreateChannel(ip_address_))),
         key_fetcher_manager_(key_fetcher_manager),
         metrics_recorder_(metrics_recorder) {}
 
@@ -106,6 +116,44 @@ class RemoteLookupClientImpl : public RemoteLookupClient {
     return response;
   }
 
+  absl::StatusOr<KeyFilterResponse> GetKeyFilter(
+      int64_t known_version) const override {
+    ScopeLatencyRecorder latency_recorder(
+        std::string(kRemoteLookupGetKeyFilter), metrics_recorder_);
+    KeyFilterRequest request;
+    request.set_known_version(known_version);
+    OhttpClientEncryptor encryptor(key_fetcher_manager_);
+    auto encrypted_request_maybe =
+        encryptor.EncryptRequest(Pad(request.SerializeAsString(), 0));
+    if (!encrypted_request_maybe.ok()) {
+      metrics_recorder_.IncrementEventCounter(kEncryptionFailure);
+      return encrypted_request_maybe.status();
+    }
+    SecureKeyFilterRequest secure_request;
+    secure_request.set_ohttp_request(*encrypted_request_maybe);
+    SecureKeyFilterResponse secure_response;
+    grpc::ClientContext context;
+    grpc::Status status =
+        stub_->SecureKeyFilter(&context, secure_request, &secure_response);
+    if (!status.ok()) {
+      metrics_recorder_.IncrementEventCounter(kSecureKeyFilterFailure);
+      return absl::Status((absl::StatusCode)status.error_code(),
+                          status.error_message());
+    }
+    auto decrypted_response_maybe =
+        encryptor.DecryptResponse(std::move(secure_response.ohttp_response()));
+    if (!decrypted_response_maybe.ok()) {
+      metrics_recorder_.IncrementEventCounter(kDecryptionFailure);
+      return decrypted_response_maybe.status();
+    }
+    KeyFilterResponse response;
+    if (!response.ParseFromString(
+            decrypted_response_maybe->GetPlaintextData())) {
+      return absl::InvalidArgumentError("Failed parsing the response.");
+    }
+    return response;
+  }
+
   std::string_view GetIpAddress() const override { return ip_address_; }
 
  private:
@@ -13,6 +13,7 @@
 // limitations under the License.
 
 #include "components/data_server/cache/cache.h"
+#include "components/data_server/cache/key_filter.h"
 #include "components/internal_server/lookup_server_impl.h"
 #include "components/internal_server/mocks.h"
 #include "components/internal_server/remote_lookup_client.h"
@@ -36,7 +37,8 @@ class RemoteLookupClientImplTest : public ::testing::Test {
  protected:
   RemoteLookupClientImplTest() {
     lookup_service_ = std::make_unique<LookupServiceImpl>(
-        mock_lookup_, fake_key_fetcher_manager_, mock_metrics_recorder_);
+        mock_lookup_, fake_key_fetcher_manager_, mock_metrics_recorder_,
+        key_filter_.get());
     grpc::ServerBuilder builder;
     builder.RegisterService(lookup_service_.get());
     server_ = (builder.BuildAndStart());
@@ -54,11 +56,28 @@ class RemoteLookupClientImplTest : public ::testing::Test {
   MockMetricsRecorder mock_metrics_recorder_;
   privacy_sandbox::server_common::FakeKeyFetcherManager
       fake_key_fetcher_manager_;
+  std::unique_ptr<KeyFilter> key_filter_ = KeyFilter::Create(100);
   std::unique_ptr<LookupServiceImpl> lookup_service_;
   std::unique_ptr<grpc::Server> server_;
   std::unique_ptr<RemoteLookupClient> remote_lookup_client_;
 };
 
+TEST_F(RemoteLookupClientImplTest, FetchesKeyFilterOnlyWhenItChanged) {
+  key_filter_->Add("key1");
+  auto response = remote_lookup_client_->GetKeyFilter(0);
+  ASSERT_TRUE(response.ok()) << response.status();
+  EXPECT_EQ(response->version(), key_filter_->version());
+  auto filter = KeyFilter::Parse(response->filter());
+  ASSERT_TRUE(filter.ok()) << filter.status();
+  EXPECT_TRUE((*filter)->MayContain("key1"));
+  EXPECT_FALSE((*filter)->MayContain("key2"));
+
+  response = remote_lookup_client_->GetKeyFilter(key_filter_->version());
+  ASSERT_TRUE(response.ok()) << response.status();
+  EXPECT_EQ(response->version(), key_filter_->version());
+  EXPECT_TRUE(response->filter().empty());
+}
+
 TEST_F(RemoteLookupClientImplTest, EncryptedPaddedSuccessfulCall) {
   std::vector<std::string> keys = {"key1", "key2"};
   InternalLookupRequest request;
@@ -27,9 +27,10 @@
 #include "components/internal_server/remote_lookup_client.h"
 #include "components/query/driver.h"
 #include "components/query/scanner.h"
+#include "components/sharding/peer_key_filters.h"
 #include "components/sharding/shard_manager.h"
 #include "glog/logging.h"
-#include "pir/hashing/sha256_hash_family.h"
+#include "public/sharding/sharding_function.h"
 #include "src/cpp/telemetry/metrics_recorder.h"
 
 namespace kv_server {
@@ -94,6 +95,9 @@ class ShardedLookup : public Lookup {
       const Lookup& local_lookup, const int32_t num_shards,
       const int32_t current_shard_num, const ShardManager& shard_manager,
       privacy_sandbox::server_common::MetricsRecorder& metrics_recorder,
+      const PeerKeyFilters* key_filters,
+      const LogicalShardMapping* logical_shard_mapping,
+      ShardingFunctionVersion::Enum sharding_function_version,
       // We're currently going with a default empty string and not
       // allowing AdTechs to modify it.
       const std::string hashing_seed)
@@ -101,11 +105,16 @@ class ShardedLookup : public Lookup {
         num_shards_(num_shards),
         current_shard_num_(current_shard_num),
         hashing_seed_(hashing_seed),
-        hash_function_(
-            distributed_point_functions::SHA256HashFunction(hashing_seed_)),
+        sharding_function_(hashing_seed_, sharding_function_version),
         shard_manager_(shard_manager),
-        metrics_recorder_(metrics_recorder) {
+        metrics_recorder_(metrics_recorder),
+        key_filters_(key_filters),
+        logical_shard_mapping_(logical_shard_mapping) {
     CHECK_GT(num_shards, 1) << "num_shards for ShardedLookup must be > 1";
+    if (logical_shard_mapping_ != nullptr) {
+      CHECK_EQ(logical_shard_mapping_->num_physical_shards(), num_shards)
+          << "The logical shard mapping must be for num_shards";
+    }
   }
 
   // Iterates over all keys specified in the `request` and assigns them to shard
@@ -221,6 +230,9 @@ class ShardedLookup : public Lookup {
     // Identifies by how many chars `keys` should be padded, so that
     // all requests add up to the same length.
     int32_t padding;
+    // Keys that the key filter of the shard rules out, which aren't looked
+    // up.
+    std::vector<std::string_view> absent_keys;
   };
 
   std::vector<ShardLookupInput> BucketKeys(
@@ -228,21 +240,30 @@ class ShardedLookup : public Lookup {
     ShardLookupInput sli;
     std::vector<ShardLookupInput> lookup_inputs(num_shards_, sli);
     for (const auto& key : keys) {
-      int32_t shard_num = hash_function_(key, num_shards_);
+      int32_t shard_num =
+          logical_shard_mapping_ == nullptr
+              ? sharding_function_.GetShardNumForKey(key, num_shards_)
+              : logical_shard_mapping_->GetPhysicalShardForKey(
+                    sharding_function_, key);
       VLOG(9) << "key: " << key << ", shard number: " << shard_num;
       lookup_inputs[shard_num].keys.emplace_back(key);
     }
     return lookup_inputs;
   }
 
+  void SerializeRequest(ShardLookupInput& lookup_input,
+                        bool lookup_sets) const {
+    InternalLookupRequest request;
+    request.mutable_keys()->Assign(lookup_input.keys.begin(),
+                                   lookup_input.keys.end());
+    request.set_lookup_sets(lookup_sets);
+    lookup_input.serialized_request = request.SerializeAsString();
+  }
+
   void SerializeShardedRequests(std::vector<ShardLookupInput>& lookup_inputs,
                                 bool lookup_sets) const {
     for (auto& lookup_input : lookup_inputs) {
-      InternalLookupRequest request;
-      request.mutable_keys()->Assign(lookup_input.keys.begin(),
-                                     lookup_input.keys.end());
-      request.set_lookup_sets(lookup_sets);
-      lookup_input.serialized_request = request.SerializeAsString();
+      SerializeRequest(lookup_input, lookup_sets);
     }
   }
 
@@ -258,12 +279,62 @@ class ShardedLookup : public Lookup {
     }
   }
 
+  // Moves the keys that the key filters rule out to `absent_keys`, and
+  // serializes the requests again without them. The padding grows by the
+  // bytes of the dropped keys, so every request keeps the size it had with
+  // all of its keys, and sizes don't reveal which keys exist.
+  //
+  // A shard's filter only rules out keys if it's at least as recent as the
+  // local one, i.e. the shard has loaded every update this server has.
+  // Otherwise keys loaded since the copy was fetched would be missed, and
+  // all of them are forwarded.
+  void DropAbsentKeys(std::vector<ShardLookupInput>& lookup_inputs,
+                      bool lookup_sets) const {
+    if (key_filters_ == nullptr) {
+      return;
+    }
+    const std::vector<std::shared_ptr<const KeyFilter>> filters =
+        key_filters_->Get();
+    const KeyFilter* local_filter = filters[current_shard_num_].get();
+    if (local_filter == nullptr) {
+      return;
+    }
+    const int64_t local_logical_commit_time =
+        local_filter->logical_commit_time();
+    for (int shard_num = 0; shard_num < num_shards_; shard_num++) {
+      const KeyFilter* filter = filters[shard_num].get();
+      if (filter == nullptr ||
+          filter->logical_commit_time() < local_logical_commit_time) {
+        continue;
+      }
+      auto& lookup_input = lookup_inputs[shard_num];
+      auto& keys = lookup_input.keys;
+      const auto absent_begin =
+          std::stable_partition(keys.begin(), keys.end(),
+                                [filter](std::string_view key) {
+                                  return filter->MayContain(key);
+                                });
+      if (absent_begin == keys.end()) {
+        continue;
+      }
+      lookup_input.absent_keys.assign(absent_begin, keys.end());
+      keys.erase(absent_begin, keys.end());
+      const int32_t padded_length =
+          lookup_input.serialized_request.size() + lookup_input.padding;
+      SerializeRequest(lookup_input, lookup_sets);
+      lookup_input.padding =
+          padded_length - lookup_input.serialized_request.size();
+    }
+  }
+
   std::vector<ShardLookupInput> ShardKeys(
       const absl::flat_hash_set<std::string_view>& keys,
       bool lookup_sets) const {
     auto lookup_inputs = BucketKeys(keys);
     SerializeShardedRequests(lookup_inputs, lookup_sets);
+    // Computed with all the keys, so that it doesn't depend on the filters.
     ComputePadding(lookup_inputs);
+    DropAbsentKeys(lookup_inputs, lookup_sets);
     return lookup_inputs;
   }
 
@@ -336,8 +407,10 @@ class ShardedLookup : public Lookup {
       return responses.status();
     }
     // process responses
+    ::google::protobuf::Map<std::string, SingleLookupResult> no_kv_pairs;
     for (int shard_num = 0; shard_num < num_shards_; shard_num++) {
       auto& shard_lookup_input = shard_lookup_inputs[shard_num];
+      UpdateResponse(shard_lookup_input.absent_keys, no_kv_pairs, response);
       auto result = (*responses)[shard_num].get();
       if (!result.ok()) {
         // mark all keys as internal failure
@@ -413,9 +486,11 @@ class ShardedLookup : public Lookup {
   const int32_t num_shards_;
   const int32_t current_shard_num_;
   const std::string hashing_seed_;
-  const distributed_point_functions::SHA256HashFunction hash_function_;
+  const ShardingFunction sharding_function_;
   const ShardManager& shard_manager_;
   MetricsRecorder& metrics_recorder_;
+  const PeerKeyFilters* key_filters_;
+  const LogicalShardMapping* logical_shard_mapping_;
 };
 
 }  // namespace
@@ -424,12 +499,16 @@ std::unique_ptr<Lookup> CreateShardedLookup(
     const Lookup& local_lookup, const int32_t num_shards,
     const int32_t current_shard_num, const ShardManager& shard_manager,
     privacy_sandbox::server_common::MetricsRecorder& metrics_recorder,
+    const PeerKeyFilters* key_filters,
+    const LogicalShardMapping* logical_shard_mapping,
+    ShardingFunctionVersion::Enum sharding_function_version,
     // We're currently going with a default empty string and not
     // allowing AdTechs to modify it.
     const std::string hashing_seed) {
-  return std::make_unique<ShardedLookup>(local_lookup, num_shards,
-                                         current_shard_num, shard_manager,
-                                         metrics_recorder, hashing_seed);
+  return std::make_unique<ShardedLookup>(
+      local_lookup, num_shards, current_shard_num, shard_manager,
+      metrics_recorder, key_filters, logical_shard_mapping,
+      sharding_function_version, hashing_seed);
 }
 
 }  // namespace kv_server
@@ -21,15 +21,27 @@
 #include <string>
 
 #include "components/internal_server/lookup.h"
+#include "components/sharding/peer_key_filters.h"
 #include "components/sharding/shard_manager.h"
+#include "public/data_loading/riegeli_metadata.pb.h"
+#include "public/sharding/logical_shard_mapping.h"
 #include "src/cpp/telemetry/metrics_recorder.h"
 
 namespace kv_server {
 
+// `key_filters`, if set, rule out the keys that aren't looked up on their
+// shard, and must outlive the lookup. `logical_shard_mapping`, if set, must
+// be for `num_shards` physical shards and outlive the lookup: keys are then
+// looked up on the shard their logical shard is mapped to. Keys are assigned
+// to shards by the function of `sharding_function_version`.
 std::unique_ptr<Lookup> CreateShardedLookup(
     const Lookup& local_lookup, const int32_t num_shards,
     const int32_t current_shard_num, const ShardManager& shard_manager,
     privacy_sandbox::server_common::MetricsRecorder& metrics_recorder,
+    const PeerKeyFilters* key_filters = nullptr,
+    const LogicalShardMapping* logical_shard_mapping = nullptr,
+    ShardingFunctionVersion::Enum sharding_function_version =
+        ShardingFunctionVersion::SHARDING_FUNCTION_VERSION_UNSPECIFIED,
     // We're currently going with a default empty string and not
     // allowing AdTechs to modify it.
     const std::string hashing_seed = "");
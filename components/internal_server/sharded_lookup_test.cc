@@ -19,12 +19,15 @@
 #include <utility>
 #include <vector>
 
+#include "components/data_server/cache/key_filter.h"
 #include "components/data_server/cache/mocks.h"
 #include "components/internal_server/mocks.h"
 #include "components/sharding/mocks.h"
+#include "components/sharding/peer_key_filters.h"
 #include "gmock/gmock.h"
 #include "google/protobuf/text_format.h"
 #include "gtest/gtest.h"
+#include "public/sharding/logical_shard_mapping.h"
 #include "public/test_util/proto_matcher.h"
 #include "src/cpp/telemetry/mocks.h"
 
@@ -34,6 +37,7 @@ namespace {
 using google::protobuf::TextFormat;
 using privacy_sandbox::server_common::MockMetricsRecorder;
 using testing::_;
+using testing::ElementsAre;
 using testing::Return;
 using testing::ReturnRef;
 
@@ -108,6 +112,71 @@ TEST_F(ShardedLookupTest, GetKeyValues_Success) {
   EXPECT_THAT(response.value(), EqualsProto(expected));
 }
 
+TEST_F(ShardedLookupTest, GetKeyValues_LooksUpKeysOnShardOfLogicalShard) {
+  // "key1" and "key4" are in logical shards 1 and 0, mapped to the other
+  // physical shard.
+  const auto logical_shard_mapping = LogicalShardMapping::Create(
+      /*num_logical_shards=*/2, num_shards_,
+      {{.logical_shard = 0, .physical_shard = 1},
+       {.logical_shard = 1, .physical_shard = 0}});
+  ASSERT_TRUE(logical_shard_mapping.ok());
+  InternalLookupResponse local_lookup_response;
+  TextFormat::ParseFromString(R"pb(kv_pairs {
+                                     key: "key1"
+                                     value { value: "value1" }
+                                   }
+                              )pb",
+                              &local_lookup_response);
+  EXPECT_CALL(mock_local_lookup_, GetKeyValues(ElementsAre("key1")))
+      .WillOnce(Return(local_lookup_response));
+
+  std::vector<absl::flat_hash_set<std::string>> cluster_mappings;
+  for (int i = 0; i < 2; i++) {
+    cluster_mappings.push_back({std::to_string(i)});
+  }
+  auto shard_manager = ShardManager::Create(
+      num_shards_, std::move(cluster_mappings),
+      std::make_unique<MockRandomGenerator>(), [](const std::string& ip) {
+        if (ip != "1") {
+          return std::make_unique<MockRemoteLookupClient>();
+        }
+        auto mock_remote_lookup_client_1 =
+            std::make_unique<MockRemoteLookupClient>();
+        InternalLookupRequest request;
+        request.add_keys("key4");
+        EXPECT_CALL(*mock_remote_lookup_client_1,
+                    GetValues(request.SerializeAsString(), 0))
+            .WillOnce([&]() {
+              InternalLookupResponse resp;
+              SingleLookupResult result;
+              result.set_value("value4");
+              (*resp.mutable_kv_pairs())["key4"] = result;
+              return resp;
+            });
+        return mock_remote_lookup_client_1;
+      });
+
+  auto sharded_lookup = CreateShardedLookup(
+      mock_local_lookup_, num_shards_, shard_num_, *(*shard_manager),
+      mock_metrics_recorder_, /*key_filters=*/nullptr,
+      &*logical_shard_mapping);
+  auto response = sharded_lookup->GetKeyValues({"key1", "key4"});
+  EXPECT_TRUE(response.ok());
+
+  InternalLookupResponse expected;
+  TextFormat::ParseFromString(R"pb(kv_pairs {
+                                     key: "key1"
+                                     value { value: "value1" }
+                                   }
+                                   kv_pairs {
+                                     key: "key4"
+                                     value { value: "value4" }
+                                   }
+                              )pb",
+                              &expected);
+  EXPECT_THAT(response.value(), EqualsProto(expected));
+}
+
 TEST_F(ShardedLookupTest, GetKeyValues_KeyMissing_ReturnsStatus) {
   InternalLookupResponse local_lookup_response;
   TextFormat::ParseFromString(
@@ -186,6 +255,172 @@ TEST_F(ShardedLookupTest, GetKeyValues_KeyMissing_ReturnsStatus) {
   EXPECT_THAT(response.value(), EqualsProto(expected));
 }
 
+TEST_F(ShardedLookupTest, GetKeyValues_KeyFilters_SkipAbsentKeysKeepPadding) {
+  auto local_filter = KeyFilter::Create(100);
+  local_filter->Add("key4");
+  auto remote_filter = KeyFilter::Create(100);
+  remote_filter->Add("key1");
+  KeyFilterResponse key_filter_response;
+  key_filter_response.set_version(remote_filter->version());
+  key_filter_response.set_filter(remote_filter->Serialize());
+
+  InternalLookupResponse local_lookup_response;
+  TextFormat::ParseFromString(R"pb(kv_pairs {
+                                     key: "key4"
+                                     value { value: "value4" }
+                                   }
+                              )pb",
+                              &local_lookup_response);
+  EXPECT_CALL(mock_local_lookup_, GetKeyValues(ElementsAre("key4")))
+      .WillOnce(Return(local_lookup_response));
+
+  std::vector<absl::flat_hash_set<std::string>> cluster_mappings;
+  for (int i = 0; i < 2; i++) {
+    cluster_mappings.push_back({std::to_string(i)});
+  }
+  auto shard_manager = ShardManager::Create(
+      num_shards_, std::move(cluster_mappings),
+      std::make_unique<MockRandomGenerator>(),
+      [&key_filter_response](const std::string& ip) {
+        if (ip != "1") {
+          return std::make_unique<MockRemoteLookupClient>();
+        }
+        auto mock_remote_lookup_client_1 =
+            std::make_unique<MockRemoteLookupClient>();
+        EXPECT_CALL(*mock_remote_lookup_client_1, GetKeyFilter(_))
+            .WillOnce(Return(key_filter_response));
+        // "key5" is ruled out, and the padding makes up for it.
+        InternalLookupRequest request;
+        request.add_keys("key1");
+        const std::string serialized_request = request.SerializeAsString();
+        request.add_keys("key5");
+        const int32_t padding =
+            request.SerializeAsString().size() - serialized_request.size();
+        EXPECT_CALL(*mock_remote_lookup_client_1,
+                    GetValues(serialized_request, padding))
+            .WillOnce([]() {
+              InternalLookupResponse resp;
+              SingleLookupResult result;
+              result.set_value("value1");
+              (*resp.mutable_kv_pairs())["key1"] = result;
+              return resp;
+            });
+        return mock_remote_lookup_client_1;
+      });
+  auto key_filters =
+      PeerKeyFilters::Create(num_shards_, shard_num_, *local_filter,
+                             **shard_manager, mock_metrics_recorder_,
+                             absl::ZeroDuration());
+  key_filters->Refresh();
+
+  auto sharded_lookup = CreateShardedLookup(
+      mock_local_lookup_, num_shards_, shard_num_, *(*shard_manager),
+      mock_metrics_recorder_, key_filters.get());
+  auto response = sharded_lookup->GetKeyValues({"key1", "key4", "key5"});
+  EXPECT_TRUE(response.ok());
+
+  InternalLookupResponse expected;
+  TextFormat::ParseFromString(
+      R"pb(kv_pairs {
+             key: "key1"
+             value { value: "value1" }
+           }
+           kv_pairs {
+             key: "key4"
+             value { value: "value4" }
+           },
+           kv_pairs {
+             key: "key5"
+             value { status: { code: 5, message: "" } }
+           }
+      )pb",
+      &expected);
+  EXPECT_THAT(response.value(), EqualsProto(expected));
+}
+
+TEST_F(ShardedLookupTest, GetKeyValues_KeyFilters_ForwardKeysIfFilterIsOlder) {
+  auto local_filter = KeyFilter::Create(100);
+  local_filter->Add("key4");
+  local_filter->AdvanceLogicalCommitTime(5);
+  // The remote shard hasn't loaded the updates up to 5, so "key5" may have
+  // been added to it since.
+  auto remote_filter = KeyFilter::Create(100);
+  remote_filter->Add("key1");
+  remote_filter->AdvanceLogicalCommitTime(3);
+  KeyFilterResponse key_filter_response;
+  key_filter_response.set_version(remote_filter->version());
+  key_filter_response.set_filter(remote_filter->Serialize());
+
+  InternalLookupResponse local_lookup_response;
+  TextFormat::ParseFromString(R"pb(kv_pairs {
+                                     key: "key4"
+                                     value { value: "value4" }
+                                   }
+                              )pb",
+                              &local_lookup_response);
+  EXPECT_CALL(mock_local_lookup_, GetKeyValues(ElementsAre("key4")))
+      .WillOnce(Return(local_lookup_response));
+
+  std::vector<absl::flat_hash_set<std::string>> cluster_mappings;
+  for (int i = 0; i < 2; i++) {
+    cluster_mappings.push_back({std::to_string(i)});
+  }
+  auto shard_manager = ShardManager::Create(
+      num_shards_, std::move(cluster_mappings),
+      std::make_unique<MockRandomGenerator>(),
+      [&key_filter_response](const std::string& ip) {
+        if (ip != "1") {
+          return std::make_unique<MockRemoteLookupClient>();
+        }
+        auto mock_remote_lookup_client_1 =
+            std::make_unique<MockRemoteLookupClient>();
+        EXPECT_CALL(*mock_remote_lookup_client_1, GetKeyFilter(_))
+            .WillOnce(Return(key_filter_response));
+        InternalLookupRequest request;
+        request.add_keys("key1");
+        request.add_keys("key5");
+        EXPECT_CALL(*mock_remote_lookup_client_1,
+                    GetValues(request.SerializeAsString(), 0))
+            .WillOnce([]() {
+              InternalLookupResponse resp;
+              SingleLookupResult result;
+              result.set_value("value1");
+              (*resp.mutable_kv_pairs())["key1"] = result;
+              return resp;
+            });
+        return mock_remote_lookup_client_1;
+      });
+  auto key_filters =
+      PeerKeyFilters::Create(num_shards_, shard_num_, *local_filter,
+                             **shard_manager, mock_metrics_recorder_,
+                             absl::ZeroDuration());
+  key_filters->Refresh();
+
+  auto sharded_lookup = CreateShardedLookup(
+      mock_local_lookup_, num_shards_, shard_num_, *(*shard_manager),
+      mock_metrics_recorder_, key_filters.get());
+  auto response = sharded_lookup->GetKeyValues({"key1", "key4", "key5"});
+  EXPECT_TRUE(response.ok());
+
+  InternalLookupResponse expected;
+  TextFormat::ParseFromString(
+      R"pb(kv_pairs {
+             key: "key1"
+             value { value: "value1" }
+           }
+           kv_pairs {
+             key: "key4"
+             value { value: "value4" }
+           },
+           kv_pairs {
+             key: "key5"
+             value { status: { code: 5, message: "" } }
+           }
+      )pb",
+      &expected);
+  EXPECT_THAT(response.value(), EqualsProto(expected));
+}
+
 TEST_F(ShardedLookupTest, GetKeyValues_EmptyRequest_ReturnsEmptyResponse) {
   std::vector<absl::flat_hash_set<std::string>> cluster_mappings;
   for (int i = 0; i < 2; i++) {
@@ -24,11 +24,6 @@
 
 namespace kv_server {
 
-namespace {
-// Traverses the binary tree starting at root.
-// Returns a vector of `Node`s in post order.
-// This is represents the infix input as postfix.
-// Postfix can then be more easily evaluated.
 std::vector<const Node*> PostOrderTraversal(const Node* root) {
   std::vector<const Node*> result;
   std::vector<const Node*> stack;
@@ -48,39 +43,24 @@ std::vector<const Node*> PostOrderTraversal(const Node* root) {
   return result;
 }
 
-}  // namespace
-
-void ASTStackVisitor::Visit(const OpNode& node, std::vector<KVSetView>& stack) {
-  KVSetView right = std::move(stack.back());
-  stack.pop_back();
-  KVSetView left = std::move(stack.back());
-  stack.pop_back();
-  stack.emplace_back(node.Op(std::move(left), std::move(right)));
-}
-
-void ASTStackVisitor::Visit(const ValueNode& node,
-                            std::vector<KVSetView>& stack) {
-  stack.emplace_back(node.Lookup());
-}
-
-KVSetView Compute(const std::vector<const Node*>& postorder) {
-  std::vector<KVSetView> stack;
-  ASTStackVisitor visitor;
+KVSetView Eval(const Node& node) {
+  auto lookup_fn = [](const ValueNode& value_node) {
+    return value_node.Lookup();
+  };
+  ASTStackVisitor<KVSetView> visitor(lookup_fn);
   // Apply the operations on the postorder stack
-  for (const auto* node : postorder) {
-    node->Accept(visitor, stack);
+  for (const Node* postorder_node : PostOrderTraversal(&node)) {
+    postorder_node->Accept(visitor);
   }
-  return stack.back();
+  return visitor.TakeResult();
 }
 
-KVSetView Eval(const Node& node) {
-  std::vector<const Node*> postorder = PostOrderTraversal(&node);
-  return Compute(postorder);
+void UnionNode::Accept(ASTVisitor& visitor) const { visitor.Visit(*this); }
+void DifferenceNode::Accept(ASTVisitor& visitor) const {
+  visitor.Visit(*this);
 }
-
-void OpNode::Accept(ASTStackVisitor& visitor,
-                    std::vector<KVSetView>& stack) const {
-  visitor.Visit(*this, stack);
+void IntersectionNode::Accept(ASTVisitor& visitor) const {
+  visitor.Visit(*this);
 }
 
 std::string UnionNode::Accept(ASTStringVisitor& visitor) const {
@@ -124,10 +104,7 @@ ValueNode::ValueNode(
     : lookup_fn_(absl::bind_front(std::move(lookup_fn), key)),
       key_(std::move(key)) {}
 
-void ValueNode::Accept(ASTStackVisitor& visitor,
-                       std::vector<KVSetView>& stack) const {
-  visitor.Visit(*this, stack);
-}
+void ValueNode::Accept(ASTVisitor& visitor) const { visitor.Visit(*this); }
 
 std::string ValueNode::Accept(ASTStringVisitor& visitor) const {
   return visitor.Visit(*this);
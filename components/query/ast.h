@@ -25,10 +25,11 @@
 #include "absl/container/flat_hash_set.h"
 #include "absl/functional/any_invocable.h"
 #include "absl/functional/bind_front.h"
+#include "absl/functional/function_ref.h"
 #include "components/query/sets.h"
 
 namespace kv_server {
-class ASTStackVisitor;
+class ASTVisitor;
 class ASTStringVisitor;
 
 // All set operations operate on a reference to the data in the DB
@@ -45,8 +46,7 @@ class Node {
   virtual absl::flat_hash_set<std::string_view> Keys() const = 0;
   // Uses the Visitor pattern for the concrete class
   // to mutate the stack accordingly for `Eval` (ValueNode vs. OpNode)
-  virtual void Accept(ASTStackVisitor& visitor,
-                      std::vector<KVSetView>& stack) const = 0;
+  virtual void Accept(ASTVisitor& visitor) const = 0;
   virtual std::string Accept(ASTStringVisitor& visitor) const = 0;
 };
 
@@ -57,8 +57,8 @@ class ValueNode : public Node {
             std::string key);
   absl::flat_hash_set<std::string_view> Keys() const override;
   KVSetView Lookup() const;
-  void Accept(ASTStackVisitor& visitor,
-              std::vector<KVSetView>& stack) const override;
+  std::string_view Key() const { return key_; }
+  void Accept(ASTVisitor& visitor) const override;
   std::string Accept(ASTStringVisitor& visitor) const override;
 
  private:
@@ -73,10 +73,6 @@ class OpNode : public Node {
   absl::flat_hash_set<std::string_view> Keys() const override;
   inline Node* Left() const override { return left_.get(); }
   inline Node* Right() const override { return right_.get(); }
-  // Computes the operation over the `left` and `right` nodes.
-  virtual KVSetView Op(KVSetView left, KVSetView right) const = 0;
-  void Accept(ASTStackVisitor& visitor,
-              std::vector<KVSetView>& stack) const override;
 
  private:
   std::unique_ptr<Node> left_;
@@ -85,48 +81,106 @@ class OpNode : public Node {
 
 class UnionNode : public OpNode {
  public:
-  using OpNode::Accept;
   using OpNode::OpNode;
-  inline KVSetView Op(KVSetView left, KVSetView right) const override {
-    return Union(std::move(left), std::move(right));
-  }
+  void Accept(ASTVisitor& visitor) const override;
   std::string Accept(ASTStringVisitor& visitor) const override;
 };
 
 class IntersectionNode : public OpNode {
  public:
-  using OpNode::Accept;
   using OpNode::OpNode;
-  inline KVSetView Op(KVSetView left, KVSetView right) const override {
-    return Intersection(std::move(left), std::move(right));
-  }
+  void Accept(ASTVisitor& visitor) const override;
   std::string Accept(ASTStringVisitor& visitor) const override;
 };
 
 class DifferenceNode : public OpNode {
  public:
-  using OpNode::Accept;
   using OpNode::OpNode;
-  inline KVSetView Op(KVSetView left, KVSetView right) const override {
-    return Difference(std::move(left), std::move(right));
-  }
+  void Accept(ASTVisitor& visitor) const override;
   std::string Accept(ASTStringVisitor& visitor) const override;
 };
 
-// Creates execution plan and runs it.
-KVSetView Eval(const Node& node);
+// Traverses the binary tree starting at root.
+// Returns a vector of `Node`s in post order.
+// This is represents the infix input as postfix.
+// Postfix can then be more easily evaluated.
+std::vector<const Node*> PostOrderTraversal(const Node* root);
+
+// General purpose Visitor dispatching on the concrete class of a Node.
+class ASTVisitor {
+ public:
+  virtual ~ASTVisitor() = default;
+  virtual void Visit(const UnionNode&) = 0;
+  virtual void Visit(const DifferenceNode&) = 0;
+  virtual void Visit(const IntersectionNode&) = 0;
+  virtual void Visit(const ValueNode&) = 0;
+};
 
-// Responsible for mutating the stack with the given `Node`.
-// Avoids downcasting for subclass specific behaviors.
-class ASTStackVisitor {
+// Responsible for mutating a stack of `SetT` with the given `Node`.
+// Avoids downcasting for subclass specific behaviors. `SetT` is any set type
+// with `Union`, `Intersection` and `Difference` overloads in sets.h.
+template <typename SetT>
+class ASTStackVisitor : public ASTVisitor {
  public:
+  // `lookup_fn` returns the set of a ValueNode.
+  explicit ASTStackVisitor(
+      absl::FunctionRef<SetT(const ValueNode& node)> lookup_fn)
+      : lookup_fn_(lookup_fn) {}
+
   // Applies the operation to the top two values on the stack.
   // Replaces the top two values with the result.
-  void Visit(const OpNode& node, std::vector<KVSetView>& stack);
-  // Pushes the result of `Lookup` to the stack.
-  void Visit(const ValueNode& node, std::vector<KVSetView>& stack);
+  void Visit(const UnionNode&) override {
+    auto [left, right] = PopOperands();
+    stack_.push_back(Union(std::move(left), std::move(right)));
+  }
+  void Visit(const DifferenceNode&) override {
+    auto [left, right] = PopOperands();
+    stack_.push_back(Difference(std::move(left), std::move(right)));
+  }
+  void Visit(const IntersectionNode&) override {
+    auto [left, right] = PopOperands();
+    stack_.push_back(Intersection(std::move(left), std::move(right)));
+  }
+  // Pushes the result of `lookup_fn` to the stack.
+  void Visit(const ValueNode& node) override {
+    stack_.push_back(lookup_fn_(node));
+  }
+
+  // Returns the set on top of the stack.
+  SetT TakeResult() { return std::move(stack_.back()); }
+
+ private:
+  std::pair<SetT, SetT> PopOperands() {
+    SetT right = std::move(stack_.back());
+    stack_.pop_back();
+    SetT left = std::move(stack_.back());
+    stack_.pop_back();
+    return {std::move(left), std::move(right)};
+  }
+
+  absl::FunctionRef<SetT(const ValueNode& node)> lookup_fn_;
+  std::vector<SetT> stack_;
 };
 
+// Creates execution plan and runs it.
+KVSetView Eval(const Node& node);
+
+// Creates execution plan and runs it on the sets returned by `lookup_fn`
+// instead of the ValueNodes' own lookup functions. Lets queries run on
+// compact set representations, e.g. bitmaps of value IDs.
+template <typename SetT>
+SetT Eval(const Node& node,
+          absl::FunctionRef<SetT(std::string_view key)> lookup_fn) {
+  auto lookup_value_node = [lookup_fn](const ValueNode& value_node) {
+    return lookup_fn(value_node.Key());
+  };
+  ASTStackVisitor<SetT> visitor(lookup_value_node);
+  for (const Node* postorder_node : PostOrderTraversal(&node)) {
+    postorder_node->Accept(visitor);
+  }
+  return visitor.TakeResult();
+}
+
 // General purpose Vistor capable of returning a string representation of a Node
 // upon inspection.
 class ASTStringVisitor {
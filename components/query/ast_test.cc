@@ -14,6 +14,8 @@
 
 #include "components/query/ast.h"
 
+#include <vector>
+
 #include "absl/container/flat_hash_map.h"
 #include "absl/container/flat_hash_set.h"
 #include "gmock/gmock.h"
@@ -122,6 +124,68 @@ TEST(AstTest, All) {
   EXPECT_EQ(Eval(center), expected);
 }
 
+// The values of kDb as IDs: a=0, b=1, ...
+const absl::flat_hash_map<std::string, std::vector<uint32_t>> kIdDb = {
+    {"A", {0, 1, 2}},
+    {"B", {1, 2, 3}},
+    {"C", {2, 3, 4}},
+    {"D", {3, 4, 5}},
+};
+
+RoaringBitmap LookupIds(std::string_view key) {
+  const auto& it = kIdDb.find(key);
+  if (it != kIdDb.end()) {
+    return RoaringBitmap::FromSorted(it->second);
+  }
+  return {};
+}
+
+TEST(AstTest, IdSetOperations) {
+  std::unique_ptr<ValueNode> a = std::make_unique<ValueNode>(Lookup, "A");
+  std::unique_ptr<ValueNode> b = std::make_unique<ValueNode>(Lookup, "B");
+  UnionNode union_op(std::move(a), std::move(b));
+  EXPECT_THAT(Eval<RoaringBitmap>(union_op, LookupIds),
+              testing::Property(&RoaringBitmap::ToVector,
+                                testing::ElementsAre(0, 1, 2, 3)));
+
+  a = std::make_unique<ValueNode>(Lookup, "A");
+  b = std::make_unique<ValueNode>(Lookup, "B");
+  IntersectionNode intersection_op(std::move(a), std::move(b));
+  EXPECT_THAT(Eval<RoaringBitmap>(intersection_op, LookupIds),
+              testing::Property(&RoaringBitmap::ToVector,
+                                testing::ElementsAre(1, 2)));
+
+  a = std::make_unique<ValueNode>(Lookup, "A");
+  b = std::make_unique<ValueNode>(Lookup, "B");
+  DifferenceNode difference_op(std::move(a), std::move(b));
+  EXPECT_THAT(Eval<RoaringBitmap>(difference_op, LookupIds),
+              testing::Property(&RoaringBitmap::ToVector,
+                                testing::ElementsAre(0)));
+
+  a = std::make_unique<ValueNode>(Lookup, "A");
+  std::unique_ptr<ValueNode> e = std::make_unique<ValueNode>(Lookup, "E");
+  IntersectionNode empty_op(std::move(a), std::move(e));
+  EXPECT_TRUE(Eval<RoaringBitmap>(empty_op, LookupIds).empty());
+}
+
+TEST(AstTest, AllIdSets) {
+  // (A-B) | (C&D) =
+  // {0} | {3,4} =
+  // {0, 3, 4}
+  std::unique_ptr<ValueNode> a = std::make_unique<ValueNode>(Lookup, "A");
+  std::unique_ptr<ValueNode> b = std::make_unique<ValueNode>(Lookup, "B");
+  std::unique_ptr<ValueNode> c = std::make_unique<ValueNode>(Lookup, "C");
+  std::unique_ptr<ValueNode> d = std::make_unique<ValueNode>(Lookup, "D");
+  std::unique_ptr<DifferenceNode> left =
+      std::make_unique<DifferenceNode>(std::move(a), std::move(b));
+  std::unique_ptr<IntersectionNode> right =
+      std::make_unique<IntersectionNode>(std::move(c), std::move(d));
+  UnionNode center(std::move(left), std::move(right));
+  EXPECT_THAT(Eval<RoaringBitmap>(center, LookupIds),
+              testing::Property(&RoaringBitmap::ToVector,
+                                testing::ElementsAre(0, 3, 4)));
+}
+
 TEST(AstTest, ValueNodeKeys) {
   ValueNode v(Lookup, "A");
   EXPECT_THAT(v.Keys(), testing::UnorderedElementsAre("A"));
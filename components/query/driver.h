@@ -23,6 +23,7 @@
 
 #include "absl/container/flat_hash_set.h"
 #include "absl/functional/any_invocable.h"
+#include "absl/functional/function_ref.h"
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
 #include "components/query/ast.h"
@@ -53,6 +54,21 @@ class Driver {
   // The result contains views of the data within the DB.
   absl::StatusOr<absl::flat_hash_set<std::string_view>> GetResult() const;
 
+  // Evaluates the query on the sets returned by `lookup_fn` instead of the
+  // lookup function the driver was created with, e.g. to run it on bitmaps
+  // of value IDs.
+  template <typename SetT>
+  absl::StatusOr<SetT> GetResult(
+      absl::FunctionRef<SetT(std::string_view key)> lookup_fn) const {
+    if (!status_.ok()) {
+      return status_;
+    }
+    if (ast_ == nullptr) {
+      return SetT();
+    }
+    return Eval<SetT>(*ast_, lookup_fn);
+  }
+
   // Returns the the `Node` associated with `SetAst`
   // or nullptr if unset.
   const kv_server::Node* GetRootNode() const;
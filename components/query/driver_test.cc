@@ -163,6 +163,24 @@ TEST_F(DriverTest, MultipleOperations) {
   EXPECT_THAT(*result, testing::UnorderedElementsAre("a", "d", "e"));
 }
 
+TEST_F(DriverTest, IdSetLookup) {
+  const absl::flat_hash_map<std::string, std::vector<uint32_t>> id_db = {
+      {"A", {0, 1, 2}},
+      {"B", {1, 2, 3}},
+      {"C", {2, 3, 4}},
+      {"D", {3, 4, 5}},
+  };
+  auto lookup_ids = [&id_db](std::string_view key) {
+    const auto& it = id_db.find(key);
+    return it == id_db.end() ? RoaringBitmap()
+                             : RoaringBitmap::FromSorted(it->second);
+  };
+  Parse("(A-B) | (C&D)");
+  auto result = driver_->GetResult<RoaringBitmap>(lookup_ids);
+  ASSERT_TRUE(result.ok());
+  EXPECT_THAT(result->ToVector(), testing::ElementsAre(0, 3, 4));
+}
+
 TEST_F(DriverTest, MultipleThreads) {
   absl::Notification notification;
   auto test_func = [&notification](Driver* driver) {
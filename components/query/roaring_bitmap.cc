@@ -0,0 +1,318 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "components/query/roaring_bitmap.h"
+
+#include <algorithm>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+#include "absl/numeric/bits.h"
+
+namespace kv_server {
+namespace {
+
+bool TestBit(const std::vector<uint64_t>& bits, uint16_t low) {
+  return (bits[low >> 6] >> (low & 63)) & 1;
+}
+
+int32_t CountBits(const std::vector<uint64_t>& bits) {
+  int32_t count = 0;
+  for (uint64_t word : bits) {
+    count += absl::popcount(word);
+  }
+  return count;
+}
+
+}  // namespace
+
+RoaringBitmap RoaringBitmap::FromSorted(absl::Span<const uint32_t> values) {
+  RoaringBitmap bitmap;
+  for (uint32_t value : values) {
+    const uint16_t key = value >> 16;
+    if (bitmap.containers_.empty() || bitmap.containers_.back().key != key) {
+      bitmap.containers_.push_back(Container{.key = key});
+    }
+    Container& container = bitmap.containers_.back();
+    container.array.push_back(value & 0xFFFF);
+    ++container.cardinality;
+  }
+  for (Container& container : bitmap.containers_) {
+    Normalize(container);
+  }
+  return bitmap;
+}
+
+RoaringBitmap RoaringBitmap::Union(const RoaringBitmap& left,
+                                   const RoaringBitmap& right) {
+  RoaringBitmap result;
+  result.containers_.reserve(
+      std::max(left.containers_.size(), right.containers_.size()));
+  auto left_iter = left.containers_.begin();
+  auto right_iter = right.containers_.begin();
+  while (left_iter != left.containers_.end() &&
+         right_iter != right.containers_.end()) {
+    if (left_iter->key < right_iter->key) {
+      result.containers_.push_back(*left_iter++);
+    } else if (right_iter->key < left_iter->key) {
+      result.containers_.push_back(*right_iter++);
+    } else {
+      result.containers_.push_back(UnionContainers(*left_iter++,
+                                                   *right_iter++));
+    }
+  }
+  result.containers_.insert(result.containers_.end(), left_iter,
+                            left.containers_.end());
+  result.containers_.insert(result.containers_.end(), right_iter,
+                            right.containers_.end());
+  return result;
+}
+
+RoaringBitmap RoaringBitmap::Intersection(const RoaringBitmap& left,
+                                          const RoaringBitmap& right) {
+  RoaringBitmap result;
+  auto left_iter = left.containers_.begin();
+  auto right_iter = right.containers_.begin();
+  while (left_iter != left.containers_.end() &&
+         right_iter != right.containers_.end()) {
+    if (left_iter->key < right_iter->key) {
+      ++left_iter;
+    } else if (right_iter->key < left_iter->key) {
+      ++right_iter;
+    } else {
+      Container container = IntersectContainers(*left_iter++, *right_iter++);
+      if (container.cardinality > 0) {
+        result.containers_.push_back(std::move(container));
+      }
+    }
+  }
+  return result;
+}
+
+RoaringBitmap RoaringBitmap::Difference(const RoaringBitmap& left,
+                                        const RoaringBitmap& right) {
+  RoaringBitmap result;
+  auto right_iter = right.containers_.begin();
+  for (const Container& container : left.containers_) {
+    while (right_iter != right.containers_.end() &&
+           right_iter->key < container.key) {
+      ++right_iter;
+    }
+    if (right_iter == right.containers_.end() ||
+        right_iter->key != container.key) {
+      result.containers_.push_back(container);
+      continue;
+    }
+    Container difference = SubtractContainers(container, *right_iter);
+    if (difference.cardinality > 0) {
+      result.containers_.push_back(std::move(difference));
+    }
+  }
+  return result;
+}
+
+bool RoaringBitmap::Contains(uint32_t value) const {
+  const Container* container = FindContainer(value >> 16);
+  if (container == nullptr) {
+    return false;
+  }
+  const uint16_t low = value & 0xFFFF;
+  if (container->IsArray()) {
+    return std::binary_search(container->array.begin(), container->array.end(),
+                              low);
+  }
+  return TestBit(container->bits, low);
+}
+
+int64_t RoaringBitmap::Rank(uint32_t value) const {
+  const uint16_t key = value >> 16;
+  const uint16_t low = value & 0xFFFF;
+  int64_t rank = 0;
+  for (const Container& container : containers_) {
+    if (container.key < key) {
+      rank += container.cardinality;
+      continue;
+    }
+    if (container.key > key) {
+      break;
+    }
+    if (container.IsArray()) {
+      rank += std::lower_bound(container.array.begin(), container.array.end(),
+                               low) -
+              container.array.begin();
+      break;
+    }
+    const int word = low >> 6;
+    for (int i = 0; i < word; ++i) {
+      rank += absl::popcount(container.bits[i]);
+    }
+    const uint64_t lower_bits = (uint64_t{1} << (low & 63)) - 1;
+    rank += absl::popcount(container.bits[word] & lower_bits);
+    break;
+  }
+  return rank;
+}
+
+int64_t RoaringBitmap::size() const {
+  int64_t size = 0;
+  for (const Container& container : containers_) {
+    size += container.cardinality;
+  }
+  return size;
+}
+
+std::vector<uint32_t> RoaringBitmap::ToVector() const {
+  std::vector<uint32_t> values;
+  values.reserve(size());
+  ForEach([&values](uint32_t value) { values.push_back(value); });
+  return values;
+}
+
+bool operator==(const RoaringBitmap& left, const RoaringBitmap& right) {
+  if (left.containers_.size() != right.containers_.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < left.containers_.size(); ++i) {
+    const RoaringBitmap::Container& l = left.containers_[i];
+    const RoaringBitmap::Container& r = right.containers_[i];
+    // Containers are normalized, so equal ones have the same representation.
+    if (l.key != r.key || l.cardinality != r.cardinality ||
+        l.array != r.array || l.bits != r.bits) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void RoaringBitmap::Normalize(Container& container) {
+  if (container.IsArray() && container.cardinality > kMaxArraySize) {
+    container.bits.assign(kBitmapWords, 0);
+    for (uint16_t low : container.array) {
+      container.bits[low >> 6] |= uint64_t{1} << (low & 63);
+    }
+    container.array = std::vector<uint16_t>();
+  } else if (!container.IsArray() && container.cardinality <= kMaxArraySize) {
+    container.array.clear();
+    container.array.reserve(container.cardinality);
+    for (int word = 0; word < kBitmapWords; ++word) {
+      for (uint64_t bits = container.bits[word]; bits != 0; bits &= bits - 1) {
+        container.array.push_back((word << 6) | absl::countr_zero(bits));
+      }
+    }
+    container.bits = std::vector<uint64_t>();
+  } else if (container.IsArray()) {
+    container.array.shrink_to_fit();
+  }
+}
+
+RoaringBitmap::Container RoaringBitmap::UnionContainers(
+    const Container& left, const Container& right) {
+  Container result{.key = left.key};
+  if (left.IsArray() && right.IsArray()) {
+    result.array.reserve(left.array.size() + right.array.size());
+    std::set_union(left.array.begin(), left.array.end(), right.array.begin(),
+                   right.array.end(), std::back_inserter(result.array));
+    result.cardinality = result.array.size();
+  } else {
+    const Container& bitmap = left.IsArray() ? right : left;
+    const Container& other = left.IsArray() ? left : right;
+    result.bits = bitmap.bits;
+    if (other.IsArray()) {
+      for (uint16_t low : other.array) {
+        result.bits[low >> 6] |= uint64_t{1} << (low & 63);
+      }
+    } else {
+      for (int word = 0; word < kBitmapWords; ++word) {
+        result.bits[word] |= other.bits[word];
+      }
+    }
+    result.cardinality = CountBits(result.bits);
+  }
+  Normalize(result);
+  return result;
+}
+
+RoaringBitmap::Container RoaringBitmap::IntersectContainers(
+    const Container& left, const Container& right) {
+  Container result{.key = left.key};
+  if (left.IsArray() && right.IsArray()) {
+    std::set_intersection(left.array.begin(), left.array.end(),
+                          right.array.begin(), right.array.end(),
+                          std::back_inserter(result.array));
+    result.cardinality = result.array.size();
+  } else if (left.IsArray() || right.IsArray()) {
+    const Container& array = left.IsArray() ? left : right;
+    const Container& bitmap = left.IsArray() ? right : left;
+    for (uint16_t low : array.array) {
+      if (TestBit(bitmap.bits, low)) {
+        result.array.push_back(low);
+      }
+    }
+    result.cardinality = result.array.size();
+  } else {
+    result.bits.resize(kBitmapWords);
+    for (int word = 0; word < kBitmapWords; ++word) {
+      result.bits[word] = left.bits[word] & right.bits[word];
+    }
+    result.cardinality = CountBits(result.bits);
+  }
+  Normalize(result);
+  return result;
+}
+
+RoaringBitmap::Container RoaringBitmap::SubtractContainers(
+    const Container& left, const Container& right) {
+  Container result{.key = left.key};
+  if (left.IsArray()) {
+    if (right.IsArray()) {
+      std::set_difference(left.array.begin(), left.array.end(),
+                          right.array.begin(), right.array.end(),
+                          std::back_inserter(result.array));
+    } else {
+      for (uint16_t low : left.array) {
+        if (!TestBit(right.bits, low)) {
+          result.array.push_back(low);
+        }
+      }
+    }
+    result.cardinality = result.array.size();
+  } else {
+    result.bits = left.bits;
+    if (right.IsArray()) {
+      for (uint16_t low : right.array) {
+        result.bits[low >> 6] &= ~(uint64_t{1} << (low & 63));
+      }
+    } else {
+      for (int word = 0; word < kBitmapWords; ++word) {
+        result.bits[word] &= ~right.bits[word];
+      }
+    }
+    result.cardinality = CountBits(result.bits);
+  }
+  Normalize(result);
+  return result;
+}
+
+const RoaringBitmap::Container* RoaringBitmap::FindContainer(
+    uint16_t key) const {
+  const auto iter = std::lower_bound(
+      containers_.begin(), containers_.end(), key,
+      [](const Container& container, uint16_t key) {
+        return container.key < key;
+      });
+  return iter != containers_.end() && iter->key == key ? &*iter : nullptr;
+}
+
+}  // namespace kv_server
@@ -0,0 +1,120 @@
+/*
+ * Copyright 2023 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef COMPONENTS_QUERY_ROARING_BITMAP_H_
+#define COMPONENTS_QUERY_ROARING_BITMAP_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "absl/numeric/bits.h"
+#include "absl/types/span.h"
+
+namespace kv_server {
+
+// Compressed set of 32 bit integers with the Roaring layout. Integers are
+// partitioned by their high 16 bits into containers. A container stores the
+// low 16 bits of its integers as a sorted array while it has at most 4096 of
+// them, and as a bitmap of 2^16 bits otherwise, so that a container never
+// takes more than 8KiB. Set operations work a container at a time.
+class RoaringBitmap {
+ public:
+  RoaringBitmap() = default;
+
+  // Returns a bitmap holding `values`, which must be sorted and distinct.
+  static RoaringBitmap FromSorted(absl::Span<const uint32_t> values);
+
+  static RoaringBitmap Union(const RoaringBitmap& left,
+                             const RoaringBitmap& right);
+  static RoaringBitmap Intersection(const RoaringBitmap& left,
+                                    const RoaringBitmap& right);
+  // Returns the elements of `left` that aren't in `right`.
+  static RoaringBitmap Difference(const RoaringBitmap& left,
+                                  const RoaringBitmap& right);
+
+  bool Contains(uint32_t value) const;
+
+  // Returns the number of elements smaller than `value`.
+  int64_t Rank(uint32_t value) const;
+
+  // Returns the number of elements.
+  int64_t size() const;
+
+  bool empty() const { return containers_.empty(); }
+
+  // Calls `fn` with each element, in ascending order.
+  template <typename Fn>
+  void ForEach(Fn fn) const {
+    for (const Container& container : containers_) {
+      const uint32_t high = static_cast<uint32_t>(container.key) << 16;
+      if (container.IsArray()) {
+        for (uint16_t low : container.array) {
+          fn(high | low);
+        }
+        continue;
+      }
+      for (uint32_t word = 0; word < container.bits.size(); ++word) {
+        for (uint64_t bits = container.bits[word]; bits != 0;
+             bits &= bits - 1) {
+          fn(high | (word << 6) | absl::countr_zero(bits));
+        }
+      }
+    }
+  }
+
+  // Returns the elements in ascending order.
+  std::vector<uint32_t> ToVector() const;
+
+  friend bool operator==(const RoaringBitmap& left,
+                         const RoaringBitmap& right);
+
+ private:
+  // Containers with more elements than this are stored as bitmaps.
+  static constexpr int kMaxArraySize = 4096;
+  static constexpr int kBitmapWords = (1 << 16) / 64;
+
+  struct Container {
+    bool IsArray() const { return bits.empty(); }
+
+    // High 16 bits shared by the elements of the container.
+    uint16_t key = 0;
+    int32_t cardinality = 0;
+    // Sorted low 16 bits, if the container is an array.
+    std::vector<uint16_t> array;
+    // kBitmapWords words, if the container is a bitmap.
+    std::vector<uint64_t> bits;
+  };
+
+  // Converts `container` to the representation matching its cardinality.
+  static void Normalize(Container& container);
+
+  static Container UnionContainers(const Container& left,
+                                   const Container& right);
+  static Container IntersectContainers(const Container& left,
+                                       const Container& right);
+  static Container SubtractContainers(const Container& left,
+                                      const Container& right);
+
+  // Returns the container for `key`, or nullptr if there is none.
+  const Container* FindContainer(uint16_t key) const;
+
+  // Sorted by key. Containers are never empty.
+  std::vector<Container> containers_;
+};
+
+}  // namespace kv_server
+
+#endif  // COMPONENTS_QUERY_ROARING_BITMAP_H_
@@ -0,0 +1,133 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "components/query/roaring_bitmap.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <random>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace kv_server {
+namespace {
+
+using testing::ElementsAre;
+using testing::IsEmpty;
+
+// Returns sorted, distinct values with a sparse part and a dense part, so
+// that bitmaps built from them have both array and bitmap containers.
+std::vector<uint32_t> RandomValues(std::mt19937& rng, double density) {
+  std::vector<uint32_t> values;
+  std::uniform_real_distribution<double> coin(0, 1);
+  for (uint32_t value = 0; value < 3 * (1 << 16); ++value) {
+    if (coin(rng) < density) {
+      values.push_back(value);
+    }
+  }
+  std::uniform_int_distribution<uint32_t> sparse(3 * (1 << 16), UINT32_MAX);
+  for (int i = 0; i < 1000; ++i) {
+    values.push_back(sparse(rng));
+  }
+  std::sort(values.begin(), values.end());
+  values.erase(std::unique(values.begin(), values.end()), values.end());
+  return values;
+}
+
+TEST(RoaringBitmapTest, Empty) {
+  RoaringBitmap bitmap;
+  EXPECT_TRUE(bitmap.empty());
+  EXPECT_EQ(bitmap.size(), 0);
+  EXPECT_FALSE(bitmap.Contains(0));
+  EXPECT_EQ(bitmap.Rank(100), 0);
+  EXPECT_THAT(bitmap.ToVector(), IsEmpty());
+}
+
+TEST(RoaringBitmapTest, FromSorted) {
+  RoaringBitmap bitmap =
+      RoaringBitmap::FromSorted({1, 5, 70000, 70001, UINT32_MAX});
+  EXPECT_EQ(bitmap.size(), 5);
+  EXPECT_TRUE(bitmap.Contains(5));
+  EXPECT_TRUE(bitmap.Contains(UINT32_MAX));
+  EXPECT_FALSE(bitmap.Contains(6));
+  EXPECT_EQ(bitmap.Rank(5), 1);
+  EXPECT_EQ(bitmap.Rank(70001), 3);
+  EXPECT_EQ(bitmap.Rank(80000), 4);
+  EXPECT_THAT(bitmap.ToVector(),
+              ElementsAre(1, 5, 70000, 70001, UINT32_MAX));
+}
+
+TEST(RoaringBitmapTest, DenseContainer) {
+  std::vector<uint32_t> values;
+  for (uint32_t value = 0; value < 10000; ++value) {
+    values.push_back(2 * value);
+  }
+  RoaringBitmap bitmap = RoaringBitmap::FromSorted(values);
+  EXPECT_EQ(bitmap.size(), values.size());
+  EXPECT_TRUE(bitmap.Contains(19998));
+  EXPECT_FALSE(bitmap.Contains(19999));
+  EXPECT_EQ(bitmap.Rank(19998), 9999);
+  EXPECT_EQ(bitmap.ToVector(), values);
+}
+
+TEST(RoaringBitmapTest, SetOperationsMatchSortedVectors) {
+  std::mt19937 rng(42);
+  for (double left_density : {0.01, 0.2, 0.9}) {
+    for (double right_density : {0.01, 0.2, 0.9}) {
+      const std::vector<uint32_t> left = RandomValues(rng, left_density);
+      const std::vector<uint32_t> right = RandomValues(rng, right_density);
+      const RoaringBitmap left_bitmap = RoaringBitmap::FromSorted(left);
+      const RoaringBitmap right_bitmap = RoaringBitmap::FromSorted(right);
+
+      std::vector<uint32_t> expected;
+      std::set_union(left.begin(), left.end(), right.begin(), right.end(),
+                     std::back_inserter(expected));
+      EXPECT_EQ(RoaringBitmap::Union(left_bitmap, right_bitmap),
+                RoaringBitmap::FromSorted(expected));
+      EXPECT_EQ(RoaringBitmap::Union(left_bitmap, right_bitmap).ToVector(),
+                expected);
+
+      expected.clear();
+      std::set_intersection(left.begin(), left.end(), right.begin(),
+                            right.end(), std::back_inserter(expected));
+      EXPECT_EQ(RoaringBitmap::Intersection(left_bitmap, right_bitmap),
+                RoaringBitmap::FromSorted(expected));
+
+      expected.clear();
+      std::set_difference(left.begin(), left.end(), right.begin(),
+                          right.end(), std::back_inserter(expected));
+      EXPECT_EQ(RoaringBitmap::Difference(left_bitmap, right_bitmap),
+                RoaringBitmap::FromSorted(expected));
+      EXPECT_EQ(RoaringBitmap::Difference(left_bitmap, right_bitmap).size(),
+                expected.size());
+    }
+  }
+}
+
+TEST(RoaringBitmapTest, RankMatchesSortedVector) {
+  std::mt19937 rng(7);
+  const std::vector<uint32_t> values = RandomValues(rng, 0.3);
+  const RoaringBitmap bitmap = RoaringBitmap::FromSorted(values);
+  for (uint32_t probe : {0u, 100u, 65536u, 100000u, 196607u, 4000000000u}) {
+    EXPECT_EQ(bitmap.Rank(probe),
+              std::lower_bound(values.begin(), values.end(), probe) -
+                  values.begin());
+  }
+}
+
+}  // namespace
+}  // namespace kv_server
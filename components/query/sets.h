@@ -20,6 +20,7 @@
 #include <utility>
 
 #include "absl/container/flat_hash_set.h"
+#include "components/query/roaring_bitmap.h"
 
 namespace kv_server {
 template <typename T>
@@ -51,5 +52,28 @@ absl::flat_hash_set<T> Difference(absl::flat_hash_set<T>&& left,
   return std::move(left);
 }
 
+// Sets of integer IDs are compressed bitmaps.
+inline RoaringBitmap Union(RoaringBitmap&& left, RoaringBitmap&& right) {
+  if (left.empty()) {
+    return std::move(right);
+  }
+  if (right.empty()) {
+    return std::move(left);
+  }
+  return RoaringBitmap::Union(left, right);
+}
+
+inline RoaringBitmap Intersection(RoaringBitmap&& left,
+                                  RoaringBitmap&& right) {
+  return RoaringBitmap::Intersection(left, right);
+}
+
+inline RoaringBitmap Difference(RoaringBitmap&& left, RoaringBitmap&& right) {
+  if (right.empty()) {
+    return std::move(left);
+  }
+  return RoaringBitmap::Difference(left, right);
+}
+
 }  // namespace kv_server
 #endif  // COMPONENTS_QUERY_SETS_H_
@@ -0,0 +1,119 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "components/sharding/peer_key_filters.h"
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "glog/logging.h"
+
+namespace kv_server {
+namespace {
+
+using privacy_sandbox::server_common::MetricsRecorder;
+
+constexpr char kKeyFilterClientMissing[] = "KeyFilterClientMissing";
+constexpr char kKeyFilterFetchFailure[] = "KeyFilterFetchFailure";
+constexpr char kKeyFilterParsingFailure[] = "KeyFilterParsingFailure";
+
+}  // namespace
+
+PeerKeyFilters::PeerKeyFilters(int32_t num_shards, int32_t current_shard_num,
+                               const KeyFilter& local_filter,
+                               const ShardManager& shard_manager,
+                               MetricsRecorder& metrics_recorder)
+    : current_shard_num_(current_shard_num),
+      shard_manager_(shard_manager),
+      metrics_recorder_(metrics_recorder),
+      refresher_(PeriodicClosure::Create()),
+      filters_(num_shards) {
+  // Never owned, the local filter outlives this object.
+  filters_[current_shard_num] =
+      std::shared_ptr<const KeyFilter>(std::shared_ptr<void>(), &local_filter);
+}
+
+PeerKeyFilters::~PeerKeyFilters() { refresher_->Stop(); }
+
+std::vector<std::shared_ptr<const KeyFilter>> PeerKeyFilters::Get() const {
+  absl::MutexLock lock(&mutex_);
+  return filters_;
+}
+
+void PeerKeyFilters::Refresh() {
+  absl::MutexLock refresh_lock(&refresh_mutex_);
+  std::vector<std::shared_ptr<const KeyFilter>> filters = Get();
+  const int32_t num_shards = filters.size();
+  for (int32_t shard_num = 0; shard_num < num_shards; ++shard_num) {
+    if (shard_num == current_shard_num_) {
+      continue;
+    }
+    std::shared_ptr<const KeyFilter> filter =
+        Fetch(shard_num, filters[shard_num]);
+    absl::MutexLock lock(&mutex_);
+    filters_[shard_num] = std::move(filter);
+  }
+}
+
+std::shared_ptr<const KeyFilter> PeerKeyFilters::Fetch(
+    int32_t shard_num, std::shared_ptr<const KeyFilter> known_filter) const {
+  const RemoteLookupClient* client = shard_manager_.Get(shard_num);
+  if (client == nullptr) {
+    metrics_recorder_.IncrementEventCounter(kKeyFilterClientMissing);
+    return nullptr;
+  }
+  // Versions are never negative, so without a copy the filter is fetched.
+  const int64_t known_version =
+      known_filter == nullptr ? -1 : known_filter->version();
+  auto response = client->GetKeyFilter(known_version);
+  if (!response.ok()) {
+    metrics_recorder_.IncrementEventCounter(kKeyFilterFetchFailure);
+    VLOG(1) << "Failed to fetch the key filter of shard " << shard_num << ": "
+            << response.status();
+    return nullptr;
+  }
+  if (known_filter != nullptr && response->version() == known_version) {
+    return known_filter;
+  }
+  auto filter = KeyFilter::Parse(response->filter());
+  if (!filter.ok()) {
+    metrics_recorder_.IncrementEventCounter(kKeyFilterParsingFailure);
+    LOG(ERROR) << "Failed to parse the key filter of shard " << shard_num
+               << ": " << filter.status();
+    return nullptr;
+  }
+  return *std::move(filter);
+}
+
+std::unique_ptr<PeerKeyFilters> PeerKeyFilters::Create(
+    int32_t num_shards, int32_t current_shard_num,
+    const KeyFilter& local_filter, const ShardManager& shard_manager,
+    MetricsRecorder& metrics_recorder, absl::Duration refresh_interval) {
+  auto filters = absl::WrapUnique(
+      new PeerKeyFilters(num_shards, current_shard_num, local_filter,
+                         shard_manager, metrics_recorder));
+  if (refresh_interval > absl::ZeroDuration()) {
+    PeerKeyFilters* refreshed = filters.get();
+    if (const absl::Status status = filters->refresher_->StartNow(
+            refresh_interval, [refreshed] { refreshed->Refresh(); });
+        !status.ok()) {
+      LOG(ERROR) << "Failed to start refreshing the key filters: " << status;
+    }
+  }
+  return filters;
+}
+
+}  // namespace kv_server
@@ -0,0 +1,90 @@
+/*
+ * Copyright 2023 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef COMPONENTS_SHARDING_PEER_KEY_FILTERS_H_
+#define COMPONENTS_SHARDING_PEER_KEY_FILTERS_H_
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "components/data_server/cache/key_filter.h"
+#include "components/sharding/shard_manager.h"
+#include "components/util/periodic_closure.h"
+#include "src/cpp/telemetry/metrics_recorder.h"
+
+namespace kv_server {
+
+// Copies of the key filters of the other shards, fetched periodically from
+// one of their replicas, so that sharded lookups can skip the keys a shard
+// definitely doesn't hold.
+//
+// A copy is only as recent as the last fetch, and replicas of a shard don't
+// load data in lockstep, so keys loaded by a shard since are ruled out until
+// the next fetch. A shard whose filter couldn't be fetched has no copy until
+// it can, and then nothing is ruled out for it.
+class PeerKeyFilters {
+ public:
+  ~PeerKeyFilters();
+
+  PeerKeyFilters(const PeerKeyFilters&) = delete;
+  PeerKeyFilters& operator=(const PeerKeyFilters&) = delete;
+
+  // Returns the filters of all the shards, indexed by shard number. The
+  // filter of the current shard is the local one, and the filters of shards
+  // without a copy are null.
+  std::vector<std::shared_ptr<const KeyFilter>> Get() const;
+
+  // Fetches the filters of the other shards that changed since they were
+  // last fetched.
+  void Refresh();
+
+  // Runs `Refresh` now and then every `refresh_interval`. A zero interval
+  // disables the background thread. `local_filter` and `shard_manager` must
+  // outlive the filters.
+  static std::unique_ptr<PeerKeyFilters> Create(
+      int32_t num_shards, int32_t current_shard_num,
+      const KeyFilter& local_filter, const ShardManager& shard_manager,
+      privacy_sandbox::server_common::MetricsRecorder& metrics_recorder,
+      absl::Duration refresh_interval);
+
+ private:
+  PeerKeyFilters(
+      int32_t num_shards, int32_t current_shard_num,
+      const KeyFilter& local_filter, const ShardManager& shard_manager,
+      privacy_sandbox::server_common::MetricsRecorder& metrics_recorder);
+
+  // Returns the filter of `shard_num`, which is `known_filter` if it didn't
+  // change, or null if it couldn't be fetched.
+  std::shared_ptr<const KeyFilter> Fetch(
+      int32_t shard_num, std::shared_ptr<const KeyFilter> known_filter) const;
+
+  const int32_t current_shard_num_;
+  const ShardManager& shard_manager_;
+  privacy_sandbox::server_common::MetricsRecorder& metrics_recorder_;
+  std::unique_ptr<PeriodicClosure> refresher_;
+  // Serializes refreshes.
+  absl::Mutex refresh_mutex_;
+  mutable absl::Mutex mutex_;
+  std::vector<std::shared_ptr<const KeyFilter>> filters_
+      ABSL_GUARDED_BY(mutex_);
+};
+
+}  // namespace kv_server
+
+#endif  // COMPONENTS_SHARDING_PEER_KEY_FILTERS_H_
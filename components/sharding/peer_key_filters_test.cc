@@ -0,0 +1,114 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "components/sharding/peer_key_filters.h"
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "components/data_server/cache/key_filter.h"
+#include "components/internal_server/mocks.h"
+#include "components/sharding/mocks.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "src/cpp/telemetry/mocks.h"
+
+namespace kv_server {
+namespace {
+
+using privacy_sandbox::server_common::MockMetricsRecorder;
+using testing::Return;
+
+KeyFilterResponse ToResponse(const KeyFilter& filter) {
+  KeyFilterResponse response;
+  response.set_version(filter.version());
+  response.set_filter(filter.Serialize());
+  return response;
+}
+
+class PeerKeyFiltersTest : public ::testing::Test {
+ protected:
+  PeerKeyFiltersTest() {
+    std::vector<absl::flat_hash_set<std::string>> cluster_mappings = {
+        {"0"}, {"1"}, {"2"}};
+    shard_manager_ = *ShardManager::Create(
+        3, std::move(cluster_mappings),
+        std::make_unique<MockRandomGenerator>(), [this](const std::string& ip) {
+          auto client = std::make_unique<MockRemoteLookupClient>();
+          clients_[std::stoi(ip)] = client.get();
+          return client;
+        });
+  }
+
+  std::unique_ptr<KeyFilter> local_filter_ = KeyFilter::Create(100);
+  MockRemoteLookupClient* clients_[3] = {};
+  std::unique_ptr<ShardManager> shard_manager_;
+  MockMetricsRecorder mock_metrics_recorder_;
+};
+
+TEST_F(PeerKeyFiltersTest, FetchesFiltersOfOtherShards) {
+  auto filter1 = KeyFilter::Create(100);
+  filter1->Add("key1");
+  EXPECT_CALL(*clients_[1], GetKeyFilter(-1))
+      .WillOnce(Return(ToResponse(*filter1)));
+  EXPECT_CALL(*clients_[2], GetKeyFilter(-1))
+      .WillOnce(Return(absl::InternalError("down")));
+  auto peer_key_filters =
+      PeerKeyFilters::Create(3, 0, *local_filter_, *shard_manager_,
+                             mock_metrics_recorder_, absl::ZeroDuration());
+  auto filters = peer_key_filters->Get();
+  ASSERT_EQ(filters.size(), 3);
+  EXPECT_EQ(filters[0].get(), local_filter_.get());
+  EXPECT_EQ(filters[1], nullptr);
+  EXPECT_EQ(filters[2], nullptr);
+
+  peer_key_filters->Refresh();
+  filters = peer_key_filters->Get();
+  EXPECT_EQ(filters[0].get(), local_filter_.get());
+  ASSERT_NE(filters[1], nullptr);
+  EXPECT_TRUE(filters[1]->MayContain("key1"));
+  EXPECT_FALSE(filters[1]->MayContain("key2"));
+  EXPECT_EQ(filters[2], nullptr);
+}
+
+TEST_F(PeerKeyFiltersTest, KeepsFiltersThatDidNotChange) {
+  auto filter1 = KeyFilter::Create(100);
+  filter1->Add("key1");
+  KeyFilterResponse unchanged;
+  unchanged.set_version(filter1->version());
+  EXPECT_CALL(*clients_[1], GetKeyFilter(-1))
+      .WillOnce(Return(ToResponse(*filter1)));
+  EXPECT_CALL(*clients_[1], GetKeyFilter(filter1->version()))
+      .WillOnce(Return(unchanged))
+      .WillOnce(Return(absl::InternalError("down")));
+  EXPECT_CALL(*clients_[2], GetKeyFilter(-1))
+      .WillRepeatedly(Return(absl::InternalError("down")));
+  auto peer_key_filters =
+      PeerKeyFilters::Create(3, 0, *local_filter_, *shard_manager_,
+                             mock_metrics_recorder_, absl::ZeroDuration());
+
+  peer_key_filters->Refresh();
+  const auto fetched_filter = peer_key_filters->Get()[1];
+  ASSERT_NE(fetched_filter, nullptr);
+  peer_key_filters->Refresh();
+  EXPECT_EQ(peer_key_filters->Get()[1], fetched_filter);
+  // Filters that can't be fetched are dropped rather than kept stale.
+  peer_key_filters->Refresh();
+  EXPECT_EQ(peer_key_filters->Get()[1], nullptr);
+}
+
+}  // namespace
+}  // namespace kv_server
@@ -28,9 +28,12 @@
 #include "absl/strings/str_format.h"
 #include "absl/time/time.h"
 #include "benchmark/benchmark.h"
+#include "components/data_server/cache/batched_lookup.h"
 #include "components/data_server/cache/cache.h"
 #include "components/data_server/cache/key_value_cache.h"
 #include "components/data_server/cache/noop_key_value_cache.h"
+#include "components/data_server/cache/rcu_key_value_cache.h"
+#include "components/data_server/cache/striped_key_value_cache.h"
 #include "components/tools/benchmarks/benchmark_util.h"
 #include "glog/logging.h"
 #include "src/cpp/telemetry/metrics_recorder.h"
@@ -62,10 +65,15 @@ ABSL_FLAG(int64_t, min_threads, 1,
           "Minimum number of threads for benchmarking reading keys.");
 ABSL_FLAG(int64_t, max_threads, 1,
           "Maximum number of threads for benchmarking reading keys.");
+ABSL_FLAG(int32_t, num_stripes, 16,
+          "Number of stripes used by the lock-striped cache benchmarks.");
 
+using kv_server::BatchedLookup;
 using kv_server::Cache;
 using kv_server::KeyValueCache;
 using kv_server::NoOpKeyValueCache;
+using kv_server::RcuKeyValueCache;
+using kv_server::StripedKeyValueCache;
 using kv_server::benchmark::AsyncTask;
 using kv_server::benchmark::GenerateRandomString;
 using kv_server::benchmark::ParseInt64List;
@@ -78,23 +86,47 @@ using privacy_sandbox::server_common::TelemetryProvider;
 // GetKeyValuePairs call.
 // => rz - record size, i.e., approximate byte size of each key/value pair
 // written into the cache. Actual record size is greater than this number.
+// => ksz - keyspace size, i.e., number of keys in the map or cache.
 constexpr std::string_view kNoOpCacheGetKeyValuePairsFmt =
     "BM_NoOpCache_GetKeyValuePairs/qz:%d/rz:%d/cw:%d";
 constexpr std::string_view kLockBasedCacheGetKeyValuePairsFmt =
     "BM_LockBasedCache_GetKeyValuePairs/qz:%d/rz:%d/cw:%d";
+constexpr std::string_view kLockStripedCacheGetKeyValuePairsFmt =
+    "BM_LockStripedCache_GetKeyValuePairs/qz:%d/rz:%d/cw:%d";
+constexpr std::string_view kRcuCacheGetKeyValuePairsFmt =
+    "BM_RcuCache_GetKeyValuePairs/qz:%d/rz:%d/cw:%d";
 constexpr std::string_view kNoOpCacheGetKeyValueSetFmt =
     "BM_NoOpCache_GetKeyValueSet/qz:%d/sqz:%d/rz:%d/cw:%d";
 constexpr std::string_view kLockBasedCacheGetKeyValueSetFmt =
     "BM_LockBasedCache_GetKeyValueSet/qz:%d/sqz:%d/rz:%d/cw:%d";
+constexpr std::string_view kLockStripedCacheGetKeyValueSetFmt =
+    "BM_LockStripedCache_GetKeyValueSet/qz:%d/sqz:%d/rz:%d/cw:%d";
+constexpr std::string_view kRcuCacheGetKeyValueSetFmt =
+    "BM_RcuCache_GetKeyValueSet/qz:%d/sqz:%d/rz:%d/cw:%d";
 
 constexpr std::string_view kNoOpCacheUpdateKeyValueFmt =
     "BM_NoOpCache_UpdateKeyValue/ksz:%d/rz:%d/cr:%d";
 constexpr std::string_view kLockBasedCacheUpdateKeyValueFmt =
     "BM_LockBasedCache_UpdateKeyValue/ksz:%d/rz:%d/cr:%d";
+constexpr std::string_view kLockStripedCacheUpdateKeyValueFmt =
+    "BM_LockStripedCache_UpdateKeyValue/ksz:%d/rz:%d/cr:%d";
+constexpr std::string_view kRcuCacheUpdateKeyValueFmt =
+    "BM_RcuCache_UpdateKeyValue/ksz:%d/rz:%d/cr:%d";
 constexpr std::string_view kNoOpCacheUpdateKeyValueSetFmt =
     "BM_NoOpCache_UpdateKeyValueSet/ksz:%d/sqz:%d/rz:%d/cr:%d";
 constexpr std::string_view kLockBasedCacheUpdateKeyValueSetFmt =
     "BM_LockBasedCache_UpdateKeyValueSet/ksz:%d/sqz:%d/rz:%d/cr:%d";
+constexpr std::string_view kLockStripedCacheUpdateKeyValueSetFmt =
+    "BM_LockStripedCache_UpdateKeyValueSet/ksz:%d/sqz:%d/rz:%d/cr:%d";
+constexpr std::string_view kRcuCacheUpdateKeyValueSetFmt =
+    "BM_RcuCache_UpdateKeyValueSet/ksz:%d/sqz:%d/rz:%d/cr:%d";
+
+// Compare probing a large map one key at a time, as caches used to, with
+// `BatchedLookup`.
+constexpr std::string_view kScalarMapLookupFmt =
+    "BM_ScalarMapLookup/qz:%d/ksz:%d/rz:%d";
+constexpr std::string_view kBatchedMapLookupFmt =
+    "BM_BatchedMapLookup/qz:%d/ksz:%d/rz:%d";
 
 constexpr std::string_view kReadsPerSec = "Reads/s";
 constexpr std::string_view kWritesPerSec = "Writes/s";
@@ -109,6 +141,20 @@ Cache* GetLockBasedCache(MetricsRecorder& metrics_recorder) {
   return cache;
 }
 
+Cache* GetLockStripedCache(MetricsRecorder& metrics_recorder) {
+  static auto* const cache =
+      StripedKeyValueCache::Create(metrics_recorder,
+                                   absl::GetFlag(FLAGS_num_stripes))
+          .release();
+  return cache;
+}
+
+Cache* GetRcuCache(MetricsRecorder& metrics_recorder) {
+  static auto* const cache =
+      RcuKeyValueCache::Create(metrics_recorder).release();
+  return cache;
+}
+
 std::atomic<int64_t>& GetLogicalTimestamp() {
   static auto* const timestamp = new std::atomic<int64_t>(0);
   return *timestamp;
@@ -132,6 +178,34 @@ std::vector<std::string> GetSetQuery(int64_t num_elems, int64_t elem_size) {
   return set_query;
 }
 
+// Returns `num_queries` queries of `query_size` keys picked at random from
+// `GetKeys(keyspace_size)`. Benchmarks cycle through them, so that the keys
+// they look up aren't all in the CPU caches.
+std::vector<std::vector<std::string>> GetRandomQueries(int64_t num_queries,
+                                                       int64_t query_size,
+                                                       int64_t keyspace_size) {
+  uint seed = query_size;
+  std::vector<std::vector<std::string>> queries(num_queries);
+  for (auto& query : queries) {
+    query.reserve(query_size);
+    for (int64_t i = 0; i < query_size; i++) {
+      query.push_back(std::to_string(rand_r(&seed) % keyspace_size));
+    }
+  }
+  return queries;
+}
+
+using LookupMap = absl::flat_hash_map<std::string, std::string>;
+
+LookupMap GetLookupMap(int64_t keyspace_size, int64_t record_size) {
+  LookupMap map;
+  map.reserve(keyspace_size);
+  for (auto& key : GetKeys(keyspace_size)) {
+    map.emplace(std::move(key), GenerateRandomString(record_size));
+  }
+  return map;
+}
+
 template <typename ContainerT>
 ContainerT ToContainerView(const std::vector<std::string>& list) {
   ContainerT container;
@@ -180,6 +254,48 @@ void BM_GetKeyValuePairs(benchmark::State& state, BenchmarkArgs args) {
       benchmark::Counter(state.iterations(), benchmark::Counter::kIsRate);
 }
 
+// Number of queries that map lookup benchmarks cycle through.
+constexpr int64_t kNumLookupQueries = 1024;
+
+void BM_ScalarMapLookup(benchmark::State& state, BenchmarkArgs args) {
+  const LookupMap map = GetLookupMap(args.keyspace_size, args.record_size);
+  auto queries = GetRandomQueries(kNumLookupQueries, args.query_size,
+                                  args.keyspace_size);
+  int64_t query_index = 0;
+  for (auto _ : state) {
+    const auto keys_view = ToContainerView<std::vector<std::string_view>>(
+        queries[query_index++ % kNumLookupQueries]);
+    for (std::string_view key : keys_view) {
+      const auto it = map.find(key);
+      if (it != map.end()) {
+        benchmark::DoNotOptimize(it->second.data());
+      }
+    }
+  }
+  state.counters[std::string(kReadsPerSec)] =
+      benchmark::Counter(state.iterations(), benchmark::Counter::kIsRate);
+}
+
+void BM_BatchedMapLookup(benchmark::State& state, BenchmarkArgs args) {
+  const LookupMap map = GetLookupMap(args.keyspace_size, args.record_size);
+  auto queries = GetRandomQueries(kNumLookupQueries, args.query_size,
+                                  args.keyspace_size);
+  int64_t query_index = 0;
+  for (auto _ : state) {
+    const BatchedLookup<LookupMap> lookup(
+        ToContainerView<std::vector<std::string_view>>(
+            queries[query_index++ % kNumLookupQueries]));
+    for (size_t i = 0; i < lookup.keys().size(); ++i) {
+      const auto it = lookup.Find(map, i);
+      if (it != map.end()) {
+        benchmark::DoNotOptimize(it->second.data());
+      }
+    }
+  }
+  state.counters[std::string(kReadsPerSec)] =
+      benchmark::Counter(state.iterations(), benchmark::Counter::kIsRate);
+}
+
 void BM_GetKeyValueSet(benchmark::State& state, BenchmarkArgs args) {
   uint seed = args.concurrent_tasks;
   std::vector<AsyncTask> writer_tasks;
@@ -288,6 +404,14 @@ void RegisterReadBenchmarks(MetricsRecorder& metrics_recorder) {
         RegisterBenchmark(absl::StrFormat(kLockBasedCacheGetKeyValuePairsFmt,
                                           query_size, record_size, num_writers),
                           args, BM_GetKeyValuePairs);
+        args.cache = GetLockStripedCache(metrics_recorder);
+        RegisterBenchmark(absl::StrFormat(kLockStripedCacheGetKeyValuePairsFmt,
+                                          query_size, record_size, num_writers),
+                          args, BM_GetKeyValuePairs);
+        args.cache = GetRcuCache(metrics_recorder);
+        RegisterBenchmark(absl::StrFormat(kRcuCacheGetKeyValuePairsFmt,
+                                          query_size, record_size, num_writers),
+                          args, BM_GetKeyValuePairs);
         for (auto set_query_size : set_query_sizes.value()) {
           args.set_query_size = set_query_size;
           args.cache = GetNoOpCache();
@@ -300,12 +424,49 @@ void RegisterReadBenchmarks(MetricsRecorder& metrics_recorder) {
               absl::StrFormat(kLockBasedCacheGetKeyValueSetFmt, query_size,
                               set_query_size, record_size, num_writers),
               args, BM_GetKeyValueSet);
+          args.cache = GetLockStripedCache(metrics_recorder);
+          RegisterBenchmark(
+              absl::StrFormat(kLockStripedCacheGetKeyValueSetFmt, query_size,
+                              set_query_size, record_size, num_writers),
+              args, BM_GetKeyValueSet);
+          args.cache = GetRcuCache(metrics_recorder);
+          RegisterBenchmark(
+              absl::StrFormat(kRcuCacheGetKeyValueSetFmt, query_size,
+                              set_query_size, record_size, num_writers),
+              args, BM_GetKeyValueSet);
         }
       }
     }
   }
 }
 
+// Registers the map lookup benchmarks, for every query and keyspace size.
+// Batching only pays off once queries have hundreds of keys and the map
+// doesn't fit in the CPU caches, e.g. --query_size=1,100,1000
+// --keyspace_size=10000000.
+void RegisterLookupBenchmarks() {
+  auto query_sizes = ParseInt64List(absl::GetFlag(FLAGS_query_size));
+  auto keyspace_sizes = ParseInt64List(absl::GetFlag(FLAGS_keyspace_size));
+  auto record_sizes = ParseInt64List(absl::GetFlag(FLAGS_record_size));
+  for (auto query_size : query_sizes.value()) {
+    for (auto keyspace_size : keyspace_sizes.value()) {
+      for (auto record_size : record_sizes.value()) {
+        auto args = BenchmarkArgs{
+            .record_size = record_size,
+            .query_size = query_size,
+            .keyspace_size = keyspace_size,
+        };
+        RegisterBenchmark(absl::StrFormat(kScalarMapLookupFmt, query_size,
+                                          keyspace_size, record_size),
+                          args, BM_ScalarMapLookup);
+        RegisterBenchmark(absl::StrFormat(kBatchedMapLookupFmt, query_size,
+                                          keyspace_size, record_size),
+                          args, BM_BatchedMapLookup);
+      }
+    }
+  }
+}
+
 void RegisterWriteBenchmarks(MetricsRecorder& metrics_recorder) {
   auto keyspace_sizes = ParseInt64List(absl::GetFlag(FLAGS_keyspace_size));
   auto record_sizes = ParseInt64List(absl::GetFlag(FLAGS_record_size));
@@ -330,6 +491,16 @@ void RegisterWriteBenchmarks(MetricsRecorder& metrics_recorder) {
             absl::StrFormat(kLockBasedCacheUpdateKeyValueFmt, keyspace_size,
                             record_size, num_readers),
             args, BM_UpdateKeyValue);
+        args.cache = GetLockStripedCache(metrics_recorder);
+        RegisterBenchmark(
+            absl::StrFormat(kLockStripedCacheUpdateKeyValueFmt, keyspace_size,
+                            record_size, num_readers),
+            args, BM_UpdateKeyValue);
+        args.cache = GetRcuCache(metrics_recorder);
+        RegisterBenchmark(
+            absl::StrFormat(kRcuCacheUpdateKeyValueFmt, keyspace_size,
+                            record_size, num_readers),
+            args, BM_UpdateKeyValue);
         for (auto set_query_size : set_query_sizes.value()) {
           args.set_query_size = set_query_size;
           args.cache = GetNoOpCache();
@@ -342,6 +513,17 @@ void RegisterWriteBenchmarks(MetricsRecorder& metrics_recorder) {
                                             keyspace_size, set_query_size,
                                             record_size, num_readers),
                             args, BM_UpdateKeyValueSet);
+          args.cache = GetLockStripedCache(metrics_recorder);
+          RegisterBenchmark(
+              absl::StrFormat(kLockStripedCacheUpdateKeyValueSetFmt,
+                              keyspace_size, set_query_size, record_size,
+                              num_readers),
+              args, BM_UpdateKeyValueSet);
+          args.cache = GetRcuCache(metrics_recorder);
+          RegisterBenchmark(
+              absl::StrFormat(kRcuCacheUpdateKeyValueSetFmt, keyspace_size,
+                              set_query_size, record_size, num_readers),
+              args, BM_UpdateKeyValueSet);
         }
       }
     }
@@ -362,6 +544,7 @@ int main(int argc, char** argv) {
   auto noop_metrics_recorder =
       TelemetryProvider::GetInstance().CreateMetricsRecorder();
   RegisterReadBenchmarks(*noop_metrics_recorder);
+  RegisterLookupBenchmarks();
   RegisterWriteBenchmarks(*noop_metrics_recorder);
   ::benchmark::RunSpecifiedBenchmarks();
   ::benchmark::Shutdown();
@@ -0,0 +1,177 @@
+/*
+ * Copyright 2023 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <malloc.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "absl/time/time.h"
+#include "benchmark/benchmark.h"
+#include "components/data_server/cache/cache.h"
+#include "components/data_server/cache/key_value_cache.h"
+#include "components/data_server/cache/slab_key_value_cache.h"
+#include "components/tools/benchmarks/benchmark_util.h"
+#include "glog/logging.h"
+#include "src/cpp/telemetry/metrics_recorder.h"
+#include "src/cpp/telemetry/telemetry_provider.h"
+
+ABSL_FLAG(std::vector<std::string>, record_size,
+          std::vector<std::string>({"16"}),
+          "Sizes of the values that we want to insert into the cache.");
+ABSL_FLAG(std::vector<std::string>, num_records,
+          std::vector<std::string>({"1000000"}),
+          "Number of key value pairs loaded into each cache.");
+ABSL_FLAG(int64_t, num_overwrites, 0,
+          "Number of times every key is overwritten after it is loaded. "
+          "Slab caches are compacted once loading finishes.");
+
+using kv_server::Cache;
+using kv_server::KeyValueCache;
+using kv_server::SlabKeyValueCache;
+using kv_server::benchmark::GenerateRandomString;
+using kv_server::benchmark::ParseInt64List;
+using privacy_sandbox::server_common::MetricsRecorder;
+using privacy_sandbox::server_common::TelemetryProvider;
+
+// Format variables used to generate benchmark names.
+//
+// => nr - number of records loaded into the cache.
+// => rz - record size, i.e., byte size of each value.
+constexpr std::string_view kLockBasedCacheLoadKeyValuePairsFmt =
+    "BM_LockBasedCache_LoadKeyValuePairs/nr:%d/rz:%d";
+constexpr std::string_view kSlabCacheLoadKeyValuePairsFmt =
+    "BM_SlabCache_LoadKeyValuePairs/nr:%d/rz:%d";
+
+constexpr std::string_view kRssBytes = "RssBytes";
+constexpr std::string_view kRssBytesPerRecord = "RssBytes/record";
+constexpr std::string_view kPayloadBytesPerRecord = "PayloadBytes/record";
+
+// Returns the resident set size of this process.
+int64_t GetResidentSetBytes() {
+  std::ifstream statm("/proc/self/statm");
+  int64_t size_pages = 0;
+  int64_t resident_pages = 0;
+  statm >> size_pages >> resident_pages;
+  return resident_pages * sysconf(_SC_PAGESIZE);
+}
+
+struct BenchmarkArgs {
+  int64_t record_size = 1;
+  int64_t num_records = 1;
+  std::function<std::unique_ptr<Cache>()> create_cache;
+};
+
+void BM_LoadKeyValuePairs(benchmark::State& state, BenchmarkArgs args) {
+  const std::string value = GenerateRandomString(args.record_size);
+  int64_t payload_bytes = 0;
+  for (int64_t i = 0; i < args.num_records; ++i) {
+    payload_bytes += absl::StrCat("key", i).size() + value.size();
+  }
+  int64_t rss_bytes = 0;
+  for (auto _ : state) {
+    state.PauseTiming();
+    // Return memory freed by earlier benchmarks to the OS so that it isn't
+    // reused without showing up in the resident set.
+    malloc_trim(0);
+    const int64_t rss_before = GetResidentSetBytes();
+    state.ResumeTiming();
+    std::unique_ptr<Cache> cache = args.create_cache();
+    int64_t logical_commit_time = 0;
+    for (int64_t round = 0; round <= absl::GetFlag(FLAGS_num_overwrites);
+         ++round) {
+      for (int64_t i = 0; i < args.num_records; ++i) {
+        cache->UpdateKeyValue(absl::StrCat("key", i), value,
+                              ++logical_commit_time);
+      }
+    }
+    if (auto* slab_cache = dynamic_cast<SlabKeyValueCache*>(cache.get())) {
+      slab_cache->Compact();
+    }
+    state.PauseTiming();
+    rss_bytes = GetResidentSetBytes() - rss_before;
+    cache.reset();
+    state.ResumeTiming();
+  }
+  state.counters[std::string(kRssBytes)] = rss_bytes;
+  state.counters[std::string(kRssBytesPerRecord)] =
+      static_cast<double>(rss_bytes) / args.num_records;
+  state.counters[std::string(kPayloadBytesPerRecord)] =
+      static_cast<double>(payload_bytes) / args.num_records;
+}
+
+void RegisterBenchmark(
+    std::string name, BenchmarkArgs args,
+    std::function<void(benchmark::State&, BenchmarkArgs)> benchmark) {
+  benchmark::RegisterBenchmark(name.c_str(), benchmark, std::move(args))
+      ->Iterations(1)
+      ->Unit(benchmark::kMillisecond);
+}
+
+void RegisterLoadBenchmarks(MetricsRecorder& metrics_recorder) {
+  auto num_records = ParseInt64List(absl::GetFlag(FLAGS_num_records));
+  auto record_sizes = ParseInt64List(absl::GetFlag(FLAGS_record_size));
+  for (auto num_record : num_records.value()) {
+    for (auto record_size : record_sizes.value()) {
+      auto args = BenchmarkArgs{
+          .record_size = record_size,
+          .num_records = num_record,
+          .create_cache =
+              [&metrics_recorder]() {
+                return KeyValueCache::Create(metrics_recorder);
+              },
+      };
+      RegisterBenchmark(absl::StrFormat(kLockBasedCacheLoadKeyValuePairsFmt,
+                                        num_record, record_size),
+                        args, BM_LoadKeyValuePairs);
+      args.create_cache = [&metrics_recorder]() {
+        return SlabKeyValueCache::Create(metrics_recorder,
+                                         absl::ZeroDuration());
+      };
+      RegisterBenchmark(absl::StrFormat(kSlabCacheLoadKeyValuePairsFmt,
+                                        num_record, record_size),
+                        args, BM_LoadKeyValuePairs);
+    }
+  }
+}
+
+// Compares the resident memory of Cache implementations after loading the
+// same key value pairs. Benchmarks run in one process, so run each of them on
+// its own with --benchmark_filter for the most accurate numbers. Sample run:
+//
+//  GLOG_logtostderr=1 bazel run -c opt \
+//    //components/tools/benchmarks:cache_memory_benchmark \
+//    --//:instance=local \
+//    --//:platform=local -- \
+//    --num_records=10000000 --record_size=16,256 \
+//    --benchmark_counters_tabular=true
+int main(int argc, char** argv) {
+  google::InitGoogleLogging(argv[0]);
+  ::benchmark::Initialize(&argc, argv);
+  absl::ParseCommandLine(argc, argv);
+  auto noop_metrics_recorder =
+      TelemetryProvider::GetInstance().CreateMetricsRecorder();
+  RegisterLoadBenchmarks(*noop_metrics_recorder);
+  ::benchmark::RunSpecifiedBenchmarks();
+  ::benchmark::Shutdown();
+  return 0;
+}
@@ -56,6 +56,13 @@ ABSL_FLAG(int64_t, record_size, 10 * 1024,
 ABSL_FLAG(std::vector<std::string>, args_reader_worker_threads,
           std::vector<std::string>({"16"}),
           "A list of num of worker threads to use for concurrent reading.");
+ABSL_FLAG(std::vector<std::string>, args_reader_thread_pool_threads,
+          std::vector<std::string>({"0"}),
+          "A list of num of threads of the thread pool shared by the readers. "
+          "Zero reads each shard on a thread of its own.");
+ABSL_FLAG(std::vector<std::string>, args_concurrent_reads,
+          std::vector<std::string>({"1"}),
+          "A list of num of readers reading the data file at once.");
 ABSL_FLAG(std::vector<std::string>, args_client_max_connections,
           std::vector<std::string>({"32"}),
           "Maximum number of connections to use for reading blobs. Ignored for "
@@ -80,6 +87,7 @@ using kv_server::KeyValueMutationRecord;
 using kv_server::KeyValueMutationType;
 using kv_server::NoOpKeyValueCache;
 using kv_server::Record;
+using kv_server::ReaderThreadPool;
 using kv_server::RecordStream;
 using kv_server::Value;
 using kv_server::benchmark::ParseInt64List;
@@ -88,13 +96,16 @@ using privacy_sandbox::server_common::MetricsRecorder;
 using privacy_sandbox::server_common::TelemetryProvider;
 
 constexpr std::string_view kNoOpCacheNameFormat =
-    "BM_DataLoading_NoOpCache/tds:%d/conns:%d/buf:%d";
+    "BM_DataLoading_NoOpCache/tds:%d/pool:%d/reads:%d/conns:%d/buf:%d";
 constexpr std::string_view kMutexCacheNameFormat =
-    "BM_DataLoading_MutexCache/tds:%d/conns:%d/buf:%d";
+    "BM_DataLoading_MutexCache/tds:%d/pool:%d/reads:%d/conns:%d/buf:%d";
 
 // Args config for benchmarks.
 struct BenchmarkArgs {
   int64_t reader_worker_threads;
+  // Zero reads without a thread pool.
+  int64_t thread_pool_threads;
+  int64_t concurrent_reads;
   int64_t client_max_connections;
   int64_t client_max_range_mb;
   std::function<std::unique_ptr<Cache>()> create_cache_fn;
@@ -157,6 +168,10 @@ void RegisterBenchmark(std::string_view benchmark_name, BenchmarkArgs args,
 void RegisterBenchmarks(MetricsRecorder& metrics_recorder) {
   auto num_worker_threads =
       ParseInt64List(absl::GetFlag(FLAGS_args_reader_worker_threads));
+  auto thread_pool_threads =
+      ParseInt64List(absl::GetFlag(FLAGS_args_reader_thread_pool_threads));
+  auto concurrent_reads =
+      ParseInt64List(absl::GetFlag(FLAGS_args_concurrent_reads));
   auto client_max_conns =
       ParseInt64List(absl::GetFlag(FLAGS_args_client_max_connections));
   auto client_max_range_mb =
@@ -164,21 +179,32 @@ void RegisterBenchmarks(MetricsRecorder& metrics_recorder) {
   for (const int64_t byte_range_mb : client_max_range_mb.value()) {
     for (const int64_t num_connections : client_max_conns.value()) {
       for (const int64_t num_threads : num_worker_threads.value()) {
-        auto args = BenchmarkArgs{
-            .reader_worker_threads = num_threads,
-            .client_max_connections = num_connections,
-            .client_max_range_mb = byte_range_mb,
-            .create_cache_fn = []() { return NoOpKeyValueCache::Create(); },
-        };
-        RegisterBenchmark(absl::StrFormat(kNoOpCacheNameFormat, num_threads,
-                                          num_connections, byte_range_mb),
-                          args, metrics_recorder);
-        args.create_cache_fn = [&metrics_recorder]() {
-          return KeyValueCache::Create(metrics_recorder);
-        };
-        RegisterBenchmark(absl::StrFormat(kMutexCacheNameFormat, num_threads,
-                                          num_connections, byte_range_mb),
-                          args, metrics_recorder);
+        for (const int64_t pool_threads : thread_pool_threads.value()) {
+          for (const int64_t num_reads : concurrent_reads.value()) {
+            auto args = BenchmarkArgs{
+                .reader_worker_threads = num_threads,
+                .thread_pool_threads = pool_threads,
+                .concurrent_reads = num_reads,
+                .client_max_connections = num_connections,
+                .client_max_range_mb = byte_range_mb,
+                .create_cache_fn =
+                    []() { return NoOpKeyValueCache::Create(); },
+            };
+            RegisterBenchmark(
+                absl::StrFormat(kNoOpCacheNameFormat, num_threads,
+                                pool_threads, num_reads, num_connections,
+                                byte_range_mb),
+                args, metrics_recorder);
+            args.create_cache_fn = [&metrics_recorder]() {
+              return KeyValueCache::Create(metrics_recorder);
+            };
+            RegisterBenchmark(
+                absl::StrFormat(kMutexCacheNameFormat, num_threads,
+                                pool_threads, num_reads, num_connections,
+                                byte_range_mb),
+                args, metrics_recorder);
+          }
+        }
       }
     }
   }
@@ -231,6 +257,10 @@ void BM_LoadDataIntoCache(benchmark::State& state, BenchmarkArgs args,
   std::unique_ptr<BlobStorageClient> blob_client =
       blob_storage_client_factory->CreateBlobStorageClient(metrics_recorder,
                                                            options);
+  std::unique_ptr<ReaderThreadPool> thread_pool;
+  if (args.thread_pool_threads > 0) {
+    thread_pool = std::make_unique<ReaderThreadPool>(args.thread_pool_threads);
+  }
   ConcurrentStreamRecordReader<std::string_view> record_reader(
       metrics_recorder,
       /*stream_factory=*/
@@ -241,6 +271,7 @@ void BM_LoadDataIntoCache(benchmark::State& state, BenchmarkArgs args,
       /*options=*/
       {
           .num_worker_threads = args.reader_worker_threads,
+          .thread_pool = thread_pool.get(),
       });
   auto stream_size = GetBlobSize(*blob_client, GetBlobLocation());
   std::atomic<int64_t> num_records_read{0};
@@ -248,41 +279,56 @@ void BM_LoadDataIntoCache(benchmark::State& state, BenchmarkArgs args,
     state.PauseTiming();
     auto cache = args.create_cache_fn();
     state.ResumeTiming();
-    auto status = record_reader.ReadStreamRecords([&num_records_read,
-                                                   cache = cache.get()](
-                                                      std::string_view raw) {
-      num_records_read++;
-      return DeserializeDataRecord(raw, [cache](const DataRecord& data_record) {
-        if (data_record.record_type() == Record::KeyValueMutationRecord) {
-          const auto* record = data_record.record_as_KeyValueMutationRecord();
-          switch (record->mutation_type()) {
-            case KeyValueMutationType::Update: {
-              if (auto status = ApplyUpdateMutation(*record, *cache);
-                  status.ok()) {
-                return status;
+    auto read_records = [&record_reader, &num_records_read,
+                         cache = cache.get()]() {
+      return record_reader.ReadStreamRecords([&num_records_read,
+                                              cache](std::string_view raw) {
+        num_records_read++;
+        return DeserializeDataRecord(raw, [cache](const auto& data_record) {
+          if (data_record.record_type() == Record::KeyValueMutationRecord) {
+            const auto* record = data_record.record_as_KeyValueMutationRecord();
+            switch (record->mutation_type()) {
+              case KeyValueMutationType::Update: {
+                if (auto status = ApplyUpdateMutation(*record, *cache);
+                    status.ok()) {
+                  return status;
+                }
+                break;
               }
-              break;
-            }
-            case KeyValueMutationType::Delete: {
-              if (auto status = ApplyDeleteMutation(*record, *cache);
-                  status.ok()) {
-                return status;
+              case KeyValueMutationType::Delete: {
+                if (auto status = ApplyDeleteMutation(*record, *cache);
+                    status.ok()) {
+                  return status;
+                }
               }
+              default:
+                return absl::InvalidArgumentError(
+                    absl::StrCat("Invalid mutation type: ",
+                                 kv_server::EnumNameKeyValueMutationType(
+                                     record->mutation_type())));
             }
-            default:
-              return absl::InvalidArgumentError(
-                  absl::StrCat("Invalid mutation type: ",
-                               kv_server::EnumNameKeyValueMutationType(
-                                   record->mutation_type())));
           }
-        }
-        return absl::OkStatus();
+          return absl::OkStatus();
+        });
+      });
+    };
+    // Other readers of the same file compete for the reading threads, as
+    // concurrent loads do in the server.
+    std::vector<std::thread> other_reads;
+    for (int i = 1; i < args.concurrent_reads; ++i) {
+      other_reads.emplace_back([&read_records]() {
+        auto status = read_records();
+        benchmark::DoNotOptimize(status);
       });
-    });
+    }
+    auto status = read_records();
     benchmark::DoNotOptimize(status);
+    for (auto& other_read : other_reads) {
+      other_read.join();
+    }
   }
   state.SetItemsProcessed(num_records_read);
-  state.SetBytesProcessed(stream_size *
+  state.SetBytesProcessed(stream_size * args.concurrent_reads *
                           static_cast<int64_t>(state.iterations()));
 }
 
@@ -300,7 +346,9 @@ void BM_LoadDataIntoCache(benchmark::State& state, BenchmarkArgs args,
 //    --record_size=1000 \
 //    --args_client_max_range_mb=8 \
 //    --args_client_max_connections=64 \
-//    --args_reader_worker_threads=16,32,64
+//    --args_reader_worker_threads=16,32,64 \
+//    --args_reader_thread_pool_threads=0,16 \
+//    --args_concurrent_reads=1,4
 int main(int argc, char** argv) {
   ::kv_server::PlatformInitializer platform_initializer;
   google::InitGoogleLogging(argv[0]);
@@ -0,0 +1,118 @@
+/*
+ * Copyright 2023 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/strings/str_format.h"
+#include "benchmark/benchmark.h"
+#include "components/tools/benchmarks/benchmark_util.h"
+#include "glog/logging.h"
+#include "public/data_loading/riegeli_metadata.pb.h"
+#include "public/sharding/sharding_function.h"
+
+ABSL_FLAG(std::vector<std::string>, key_size,
+          std::vector<std::string>({"16", "64"}),
+          "Sizes of the keys assigned to shards.");
+ABSL_FLAG(std::vector<std::string>, num_shards,
+          std::vector<std::string>({"4", "1024"}),
+          "Numbers of shards keys are assigned to, e.g. physical shards or "
+          "logical shards.");
+ABSL_FLAG(int64_t, num_keys, 1000, "Number of distinct keys cycled through.");
+
+using kv_server::ShardingFunction;
+using kv_server::ShardingFunctionVersion;
+using kv_server::benchmark::GenerateRandomString;
+using kv_server::benchmark::ParseInt64List;
+
+// Format variables used to generate benchmark names.
+//
+// => ks - key size.
+// => ns - number of shards.
+constexpr std::string_view kSha256Fmt =
+    "BM_Sha256_GetShardNumForKey/ks:%d/ns:%d";
+constexpr std::string_view kHighwayHashFmt =
+    "BM_HighwayHash_GetShardNumForKey/ks:%d/ns:%d";
+
+constexpr std::string_view kKeysPerSec = "Keys/s";
+
+struct BenchmarkArgs {
+  int64_t key_size = 1;
+  int64_t num_shards = 1;
+  ShardingFunctionVersion::Enum version = ShardingFunctionVersion::SHA256;
+};
+
+void BM_GetShardNumForKey(benchmark::State& state, BenchmarkArgs args) {
+  const ShardingFunction sharding_function(/*seed=*/"", args.version);
+  std::vector<std::string> keys;
+  keys.reserve(absl::GetFlag(FLAGS_num_keys));
+  for (int64_t i = 0; i < absl::GetFlag(FLAGS_num_keys); ++i) {
+    keys.push_back(GenerateRandomString(args.key_size));
+  }
+  size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        sharding_function.GetShardNumForKey(keys[i], args.num_shards));
+    if (++i == keys.size()) {
+      i = 0;
+    }
+  }
+  state.counters[std::string(kKeysPerSec)] =
+      benchmark::Counter(state.iterations(), benchmark::Counter::kIsRate);
+}
+
+void RegisterBenchmarks() {
+  auto key_sizes = ParseInt64List(absl::GetFlag(FLAGS_key_size));
+  auto num_shards = ParseInt64List(absl::GetFlag(FLAGS_num_shards));
+  for (auto key_size : key_sizes.value()) {
+    for (auto shards : num_shards.value()) {
+      auto args = BenchmarkArgs{
+          .key_size = key_size,
+          .num_shards = shards,
+          .version = ShardingFunctionVersion::SHA256,
+      };
+      benchmark::RegisterBenchmark(
+          absl::StrFormat(kSha256Fmt, key_size, shards).c_str(),
+          BM_GetShardNumForKey, args);
+      args.version = ShardingFunctionVersion::HIGHWAYHASH;
+      benchmark::RegisterBenchmark(
+          absl::StrFormat(kHighwayHashFmt, key_size, shards).c_str(),
+          BM_GetShardNumForKey, args);
+    }
+  }
+}
+
+// Compares the cost of assigning a key to its shard with each sharding
+// function, which data loading pays per record and sharded lookups per key.
+// Sample run:
+//
+//  GLOG_logtostderr=1 bazel run -c opt \
+//    //components/tools/benchmarks:sharding_function_benchmark \
+//    --//:instance=local \
+//    --//:platform=local -- \
+//    --key_size=16,64,256 --num_shards=4,1024 \
+//    --benchmark_counters_tabular=true
+int main(int argc, char** argv) {
+  google::InitGoogleLogging(argv[0]);
+  ::benchmark::Initialize(&argc, argv);
+  absl::ParseCommandLine(argc, argv);
+  RegisterBenchmarks();
+  ::benchmark::RunSpecifiedBenchmarks();
+  ::benchmark::Shutdown();
+  return 0;
+}
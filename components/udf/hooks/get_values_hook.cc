@@ -22,10 +22,12 @@
 
 #include "absl/functional/any_invocable.h"
 #include "absl/status/statusor.h"
+#include "absl/strings/numbers.h"
 #include "absl/strings/str_join.h"
 #include "components/data_server/cache/cache.h"
 #include "components/internal_server/local_lookup.h"
 #include "components/internal_server/lookup.pb.h"
+#include "components/udf/hooks/read_version_scopes.h"
 #include "glog/logging.h"
 #include "google/protobuf/util/json_util.h"
 #include "nlohmann/json.hpp"
@@ -129,6 +131,15 @@ class GetValuesHookImpl : public GetValuesHook {
   }
 
   void operator()(FunctionBindingIoProto& io) {
+    Call(io, /*in_read_scope=*/false);
+  }
+
+  void CallInReadScope(FunctionBindingIoProto& io) {
+    Call(io, /*in_read_scope=*/true);
+  }
+
+ private:
+  void Call(FunctionBindingIoProto& io, bool in_read_scope) {
     if (lookup_ == nullptr) {
       SetStatus(absl::StatusCode::kInternal,
                 "getValues has not been initialized yet", io);
@@ -145,14 +156,26 @@ class GetValuesHookImpl : public GetValuesHook {
       return;
     }
 
-    std::vector<std::string_view> keys;
-    for (const auto& key : io.input_list_of_string().data()) {
-      keys.emplace_back(key);
+    const auto& input = io.input_list_of_string().data();
+    auto key_it = input.begin();
+    std::shared_ptr<const ReadVersion> read_version;
+    if (in_read_scope) {
+      int64_t scope_id;
+      if (key_it == input.end() || !absl::SimpleAtoi(*key_it, &scope_id)) {
+        SetStatus(absl::StatusCode::kInvalidArgument,
+                  "getValues read scope must be an integer", io);
+        VLOG(1) << "getValues result: " << io.DebugString();
+        return;
+      }
+      ++key_it;
+      read_version = ReadVersionScopes::Get().GetOrPin(
+          scope_id, [this]() { return lookup_->PinReadVersion(); });
     }
+    std::vector<std::string_view> keys(key_it, input.end());
 
     VLOG(9) << "Calling internal lookup client";
     absl::StatusOr<InternalLookupResponse> response_or_status =
-        lookup_->GetKeyValues(keys);
+        lookup_->GetKeyValuesAt(keys, read_version.get());
     if (!response_or_status.ok()) {
       SetStatus(response_or_status.status().code(),
                 response_or_status.status().message(), io);
@@ -164,7 +187,6 @@ class GetValuesHookImpl : public GetValuesHook {
     VLOG(9) << "getValues result: " << io.DebugString();
   }
 
- private:
   void SetStatus(absl::StatusCode code, std::string_view message,
                  FunctionBindingIoProto& io) {
     if (output_type_ == OutputType::kString) {
@@ -32,6 +32,13 @@ namespace kv_server {
 
 using privacy_sandbox::server_common::MetricsRecorder;
 
+// Names of the hooks in Roma, called in their read version scope. UDFs call
+// them through the getValues and getValuesBinary functions that the UDF
+// client defines, which pass the scope of the execution along.
+inline constexpr char kScopedStringGetValuesHookJsName[] = "kvServerGetValues";
+inline constexpr char kScopedBinaryGetValuesHookJsName[] =
+    "kvServerGetValuesBinary";
+
 // Functor that acts as a wrapper for the internal lookup client call.
 class GetValuesHook {
  public:
@@ -50,6 +57,12 @@ class GetValuesHook {
   virtual void operator()(
       google::scp::roma::proto::FunctionBindingIoProto& io) = 0;
 
+  // Like the call operator, but the first input string is the ID of the
+  // read version scope of the UDF execution, see `ReadVersionScopes`, and
+  // the keys are looked up at its read version.
+  virtual void CallInReadScope(
+      google::scp::roma::proto::FunctionBindingIoProto& io) = 0;
+
   static std::unique_ptr<GetValuesHook> Create(OutputType output_type);
 };
 
@@ -20,7 +20,9 @@
 
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
 #include "components/internal_server/mocks.h"
+#include "components/udf/hooks/read_version_scopes.h"
 #include "gmock/gmock.h"
 #include "google/protobuf/message_lite.h"
 #include "google/protobuf/text_format.h"
@@ -136,6 +138,47 @@ TEST(GetValuesHookTest, StringOutput_InputIsNotListOfStrings) {
   EXPECT_EQ(io.output_string(), expected.dump());
 }
 
+TEST(GetValuesHookTest, StringOutput_LookupsInReadScopeShareReadVersion) {
+  std::vector<std::string_view> keys = {"key1"};
+  auto mock_lookup = std::make_unique<MockLookup>();
+  EXPECT_CALL(*mock_lookup, PinReadVersion()).WillOnce([]() {
+    return std::make_unique<ReadVersion>();
+  });
+  EXPECT_CALL(*mock_lookup, GetKeyValues(keys))
+      .Times(2)
+      .WillRepeatedly(Return(InternalLookupResponse()));
+  auto get_values_hook =
+      GetValuesHook::Create(GetValuesHook::OutputType::kString);
+  get_values_hook->FinishInit(std::move(mock_lookup));
+
+  const int64_t scope_id = ReadVersionScopes::Get().Open();
+  for (int i = 0; i < 2; ++i) {
+    FunctionBindingIoProto io;
+    io.mutable_input_list_of_string()->add_data(absl::StrCat(scope_id));
+    io.mutable_input_list_of_string()->add_data("key1");
+    get_values_hook->CallInReadScope(io);
+    nlohmann::json result_json = nlohmann::json::parse(io.output_string());
+    EXPECT_EQ(result_json["status"]["code"], 0);
+  }
+  ReadVersionScopes::Get().Close(scope_id);
+}
+
+TEST(GetValuesHookTest, StringOutput_ReadScopeIsNotAnInteger) {
+  auto mock_lookup = std::make_unique<MockLookup>();
+
+  FunctionBindingIoProto io;
+  TextFormat::ParseFromString(
+      R"pb(input_list_of_string { data: "key1" data: "key2" })pb", &io);
+  auto get_values_hook =
+      GetValuesHook::Create(GetValuesHook::OutputType::kString);
+  get_values_hook->FinishInit(std::move(mock_lookup));
+  get_values_hook->CallInReadScope(io);
+
+  nlohmann::json expected =
+      R"({"code":3,"message":"getValues read scope must be an integer"})"_json;
+  EXPECT_EQ(io.output_string(), expected.dump());
+}
+
 TEST(GetValuesHookTest, BinaryOutput_SuccessfullyProcessesValue) {
   std::vector<std::string_view> keys = {"key1", "key2"};
   InternalLookupResponse lookup_response;
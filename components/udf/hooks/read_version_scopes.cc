@@ -0,0 +1,70 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "components/udf/hooks/read_version_scopes.h"
+
+#include <memory>
+#include <utility>
+
+namespace kv_server {
+
+int64_t ReadVersionScopes::Open() {
+  absl::MutexLock lock(&mutex_);
+  const int64_t scope_id = ++last_scope_id_;
+  scopes_.emplace(scope_id, nullptr);
+  return scope_id;
+}
+
+void ReadVersionScopes::Close(int64_t scope_id) {
+  // Released outside the lock.
+  std::shared_ptr<const ReadVersion> read_version;
+  absl::MutexLock lock(&mutex_);
+  if (const auto it = scopes_.find(scope_id); it != scopes_.end()) {
+    read_version = std::move(it->second);
+    scopes_.erase(it);
+  }
+}
+
+std::shared_ptr<const ReadVersion> ReadVersionScopes::GetOrPin(
+    int64_t scope_id, absl::FunctionRef<std::unique_ptr<ReadVersion>()> pin) {
+  {
+    absl::MutexLock lock(&mutex_);
+    const auto it = scopes_.find(scope_id);
+    if (it == scopes_.end()) {
+      return nullptr;
+    }
+    if (it->second != nullptr) {
+      return it->second;
+    }
+  }
+  // Pinned without the lock, and dropped outside of it if another lookup of
+  // the scope pinned first or the scope was closed meanwhile.
+  std::shared_ptr<const ReadVersion> read_version = pin();
+  absl::MutexLock lock(&mutex_);
+  const auto it = scopes_.find(scope_id);
+  if (it == scopes_.end()) {
+    return nullptr;
+  }
+  if (it->second == nullptr) {
+    it->second = read_version;
+  }
+  return it->second;
+}
+
+ReadVersionScopes& ReadVersionScopes::Get() {
+  static auto* const scopes = new ReadVersionScopes();
+  return *scopes;
+}
+
+}  // namespace kv_server
@@ -0,0 +1,71 @@
+/*
+ * Copyright 2023 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef COMPONENTS_UDF_HOOKS_READ_VERSION_SCOPES_H_
+#define COMPONENTS_UDF_HOOKS_READ_VERSION_SCOPES_H_
+
+#include <cstdint>
+#include <memory>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/functional/function_ref.h"
+#include "absl/synchronization/mutex.h"
+#include "components/data_server/cache/cache.h"
+
+namespace kv_server {
+
+// Read versions pinned for UDF executions, so that all the lookups of one
+// execution see the same key-value pairs.
+//
+// Roma doesn't tell hooks which execution calls them, so the UDF client
+// opens a scope per execution and passes its ID to the UDF, which passes it
+// back with each lookup. The first lookup of a scope pins the read version,
+// and it's released when the scope is closed.
+// Thread-safe.
+class ReadVersionScopes {
+ public:
+  ReadVersionScopes() = default;
+
+  ReadVersionScopes(const ReadVersionScopes&) = delete;
+  ReadVersionScopes& operator=(const ReadVersionScopes&) = delete;
+
+  // Opens a scope, and returns its ID.
+  int64_t Open();
+
+  // Closes the scope, and releases its read version unless a lookup still
+  // uses it.
+  void Close(int64_t scope_id);
+
+  // Returns the read version of the scope, which `pin` is called to pin on
+  // the first call. Returns null if the scope isn't open, or if `pin` does.
+  std::shared_ptr<const ReadVersion> GetOrPin(
+      int64_t scope_id, absl::FunctionRef<std::unique_ptr<ReadVersion>()> pin);
+
+  // Hooks and UDF clients of a server share its instance, as they share
+  // Roma.
+  static ReadVersionScopes& Get();
+
+ private:
+  absl::Mutex mutex_;
+  int64_t last_scope_id_ ABSL_GUARDED_BY(mutex_) = 0;
+  // Scopes whose read version isn't pinned yet map to null.
+  absl::flat_hash_map<int64_t, std::shared_ptr<const ReadVersion>> scopes_
+      ABSL_GUARDED_BY(mutex_);
+};
+
+}  // namespace kv_server
+
+#endif  // COMPONENTS_UDF_HOOKS_READ_VERSION_SCOPES_H_
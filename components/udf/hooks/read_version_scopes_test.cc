@@ -0,0 +1,89 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "components/udf/hooks/read_version_scopes.h"
+
+#include <memory>
+
+#include "gtest/gtest.h"
+
+namespace kv_server {
+namespace {
+
+// Counts the read versions that are pinned.
+class CountedReadVersion : public ReadVersion {
+ public:
+  explicit CountedReadVersion(int& num_pinned) : num_pinned_(num_pinned) {
+    ++num_pinned_;
+  }
+  ~CountedReadVersion() override { --num_pinned_; }
+
+ private:
+  int& num_pinned_;
+};
+
+TEST(ReadVersionScopesTest, PinsOncePerScopeUntilClosed) {
+  ReadVersionScopes scopes;
+  int num_pinned = 0;
+  int num_pin_calls = 0;
+  const auto pin = [&]() -> std::unique_ptr<ReadVersion> {
+    ++num_pin_calls;
+    return std::make_unique<CountedReadVersion>(num_pinned);
+  };
+  const int64_t scope_id = scopes.Open();
+  std::shared_ptr<const ReadVersion> first = scopes.GetOrPin(scope_id, pin);
+  std::shared_ptr<const ReadVersion> second = scopes.GetOrPin(scope_id, pin);
+  EXPECT_NE(first, nullptr);
+  EXPECT_EQ(first, second);
+  EXPECT_EQ(num_pin_calls, 1);
+
+  // Lookups that still use the read version keep it pinned.
+  scopes.Close(scope_id);
+  EXPECT_EQ(num_pinned, 1);
+  first.reset();
+  second.reset();
+  EXPECT_EQ(num_pinned, 0);
+}
+
+TEST(ReadVersionScopesTest, ClosedScopesArentPinned) {
+  ReadVersionScopes scopes;
+  int num_pinned = 0;
+  const auto pin = [&]() -> std::unique_ptr<ReadVersion> {
+    return std::make_unique<CountedReadVersion>(num_pinned);
+  };
+  const int64_t scope_id = scopes.Open();
+  scopes.Close(scope_id);
+  EXPECT_EQ(scopes.GetOrPin(scope_id, pin), nullptr);
+  EXPECT_EQ(num_pinned, 0);
+}
+
+TEST(ReadVersionScopesTest, ScopesHaveTheirOwnReadVersions) {
+  ReadVersionScopes scopes;
+  int num_pinned = 0;
+  const auto pin = [&]() -> std::unique_ptr<ReadVersion> {
+    return std::make_unique<CountedReadVersion>(num_pinned);
+  };
+  const int64_t scope_id1 = scopes.Open();
+  const int64_t scope_id2 = scopes.Open();
+  EXPECT_NE(scope_id1, scope_id2);
+  EXPECT_NE(scopes.GetOrPin(scope_id1, pin), scopes.GetOrPin(scope_id2, pin));
+  EXPECT_EQ(num_pinned, 2);
+  scopes.Close(scope_id1);
+  EXPECT_EQ(num_pinned, 1);
+  scopes.Close(scope_id2);
+  EXPECT_EQ(num_pinned, 0);
+}
+
+}  // namespace
+}  // namespace kv_server
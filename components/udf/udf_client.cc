@@ -16,17 +16,23 @@
 
 #include <functional>
 #include <memory>
+#include <optional>
 #include <string>
 #include <tuple>
 #include <utility>
 #include <vector>
 
+#include "absl/cleanup/cleanup.h"
 #include "absl/flags/flag.h"
 #include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
 #include "absl/strings/string_view.h"
+#include "absl/strings/substitute.h"
 #include "absl/synchronization/notification.h"
 #include "absl/time/time.h"
 #include "components/errors/retry.h"
+#include "components/udf/hooks/get_values_hook.h"
+#include "components/udf/hooks/read_version_scopes.h"
 #include "glog/logging.h"
 #include "google/protobuf/util/json_util.h"
 #include "roma/config/src/config.h"
@@ -57,6 +63,26 @@ constexpr char kCodeObjectId[] = "id";
 constexpr char kInvocationRequestId[] = "id";
 constexpr int kVersionNum = 1;
 
+// Handler that runs the UDF handler in the read version scope passed as its
+// first argument, so that the getValues calls of one execution see the same
+// key-value pairs. $0 is the name of the UDF handler, and $1 and $2 those of
+// the string and binary hooks. Scope 0 is never opened, so lookups outside
+// of an execution read the latest values.
+constexpr char kReadScopeHandlerName[] = "kvServerReadScopeHandler";
+constexpr absl::string_view kReadScopeJs = R"JS(
+var kvServerReadScope = "0";
+function kvServerReadScopeHandler(readScope, ...args) {
+  kvServerReadScope = String(readScope);
+  return $0(...args);
+}
+function getValues(keys) {
+  return Array.isArray(keys) ? $1([kvServerReadScope, ...keys]) : $1(keys);
+}
+function getValuesBinary(keys) {
+  return Array.isArray(keys) ? $2([kvServerReadScope, ...keys]) : $2(keys);
+}
+)JS";
+
 class UdfClientImpl : public UdfClient {
  public:
   UdfClientImpl() : udf_timeout_(absl::GetFlag(FLAGS_udf_timeout)) {}
@@ -99,6 +125,18 @@ class UdfClientImpl : public UdfClient {
     std::shared_ptr<std::string> result = std::make_shared<std::string>();
     std::shared_ptr<absl::Notification> notification =
         std::make_shared<absl::Notification>();
+    // UDFs that run past the timeout read the latest values once the scope
+    // is closed.
+    std::optional<int64_t> read_scope_id;
+    absl::Cleanup read_scope_closer = [&read_scope_id] {
+      if (read_scope_id.has_value()) {
+        ReadVersionScopes::Get().Close(*read_scope_id);
+      }
+    };
+    if (in_read_scope_) {
+      read_scope_id = ReadVersionScopes::Get().Open();
+      keys.insert(keys.begin(), absl::StrCat(*read_scope_id));
+    }
     InvocationRequestStrInput invocation_request =
         BuildInvocationRequest(std::move(keys));
     VLOG(9) << "Executing UDF";
@@ -147,6 +185,15 @@ class UdfClientImpl : public UdfClient {
     std::shared_ptr<absl::Notification> notification =
         std::make_shared<absl::Notification>();
     VLOG(9) << "Setting UDF: " << code_config.js;
+    // Code objects without JS can't call the hooks.
+    const bool in_read_scope = !code_config.js.empty();
+    if (in_read_scope) {
+      absl::StrAppend(&code_config.js,
+                      absl::Substitute(kReadScopeJs,
+                                       code_config.udf_handler_name,
+                                       kScopedStringGetValuesHookJsName,
+                                       kScopedBinaryGetValuesHookJsName));
+    }
     CodeObject code_object =
         BuildCodeObject(std::move(code_config.js), std::move(code_config.wasm),
                         code_config.version);
@@ -172,7 +219,9 @@ class UdfClientImpl : public UdfClient {
       LOG(ERROR) << "Error setting UDF Code object: " << *response_status;
       return *response_status;
     }
-    handler_name_ = std::move(code_config.udf_handler_name);
+    handler_name_ = in_read_scope ? kReadScopeHandlerName
+                                  : std::move(code_config.udf_handler_name);
+    in_read_scope_ = in_read_scope;
     logical_commit_time_ = code_config.logical_commit_time;
     version_ = code_config.version;
     return absl::OkStatus();
@@ -204,6 +253,9 @@ class UdfClientImpl : public UdfClient {
   }
 
   std::string handler_name_;
+  // Whether `handler_name_` is the read scope handler, which takes the ID of
+  // the scope before the UDF arguments.
+  bool in_read_scope_ = false;
   int64_t logical_commit_time_ = -1;
   int64_t version_ = 1;
   const absl::Duration udf_timeout_;
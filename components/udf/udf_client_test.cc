@@ -15,6 +15,7 @@
 #include "components/udf/udf_client.h"
 
 #include <fstream>
+#include <memory>
 #include <string>
 #include <tuple>
 #include <utility>
@@ -325,6 +326,57 @@ TEST(UdfClientTest, JsStringInWithGetValuesHookSucceeds) {
   EXPECT_TRUE(stop.ok());
 }
 
+TEST(UdfClientTest, JsGetValuesCallsShareReadVersion) {
+  auto mock_lookup = std::make_unique<MockLookup>();
+
+  InternalLookupResponse response;
+  TextFormat::ParseFromString(R"pb(kv_pairs {
+                                     key: "key1"
+                                     value { value: "value1" }
+                                   })pb",
+                              &response);
+  // Pinned once per execution.
+  EXPECT_CALL(*mock_lookup, PinReadVersion())
+      .Times(2)
+      .WillRepeatedly([]() { return std::make_unique<ReadVersion>(); });
+  EXPECT_CALL(*mock_lookup, GetKeyValues(_))
+      .Times(4)
+      .WillRepeatedly(Return(response));
+
+  auto get_values_hook =
+      GetValuesHook::Create(GetValuesHook::OutputType::kString);
+  get_values_hook->FinishInit(std::move(mock_lookup));
+  UdfConfigBuilder config_builder;
+  absl::StatusOr<std::unique_ptr<UdfClient>> udf_client = UdfClient::Create(
+      config_builder.RegisterStringGetValuesHook(*get_values_hook)
+          .SetNumberOfWorkers(1)
+          .Config());
+  EXPECT_TRUE(udf_client.ok());
+
+  absl::Status code_obj_status = udf_client.value()->SetCodeObject(CodeConfig{
+      .js = R"(
+          function hello(input) {
+            const first = JSON.parse(getValues([input])).kvPairs;
+            const second = JSON.parse(getValues([input])).kvPairs;
+            return first[input].value + second[input].value;
+          }  )",
+      .udf_handler_name = "hello",
+      .logical_commit_time = 1,
+      .version = 1,
+  });
+  EXPECT_TRUE(code_obj_status.ok());
+
+  for (int i = 0; i < 2; ++i) {
+    absl::StatusOr<std::string> result =
+        udf_client.value()->ExecuteCode({R"("key1")"});
+    EXPECT_TRUE(result.ok());
+    EXPECT_EQ(*result, R"("value1value1")");
+  }
+
+  absl::Status stop = udf_client.value()->Stop();
+  EXPECT_TRUE(stop.ok());
+}
+
 TEST(UdfClientTest, JsJSONObjectInWithGetValuesHookSucceeds) {
   auto mock_lookup = std::make_unique<MockLookup>();
 
@@ -35,8 +35,6 @@ using google::scp::roma::Config;
 using google::scp::roma::FunctionBindingObjectV2;
 using google::scp::roma::proto::FunctionBindingIoProto;
 
-constexpr char kStringGetValuesHookJsName[] = "getValues";
-constexpr char kBinaryGetValuesHookJsName[] = "getValuesBinary";
 constexpr char kRunQueryHookJsName[] = "runQuery";
 constexpr char kLoggingHookJsName[] = "logMessage";
 
@@ -45,7 +43,9 @@ std::unique_ptr<FunctionBindingObjectV2> GetValuesFunctionObject(
   auto get_values_function_object = std::make_unique<FunctionBindingObjectV2>();
   get_values_function_object->function_name = std::move(handler_name);
   get_values_function_object->function =
-      [&get_values_hook](FunctionBindingIoProto& in) { get_values_hook(in); };
+      [&get_values_hook](FunctionBindingIoProto& in) {
+        get_values_hook.CallInReadScope(in);
+      };
   return get_values_function_object;
 }
 
@@ -53,15 +53,15 @@ std::unique_ptr<FunctionBindingObjectV2> GetValuesFunctionObject(
 
 UdfConfigBuilder& UdfConfigBuilder::RegisterStringGetValuesHook(
     GetValuesHook& get_values_hook) {
-  config_.RegisterFunctionBinding(
-      GetValuesFunctionObject(get_values_hook, kStringGetValuesHookJsName));
+  config_.RegisterFunctionBinding(GetValuesFunctionObject(
+      get_values_hook, kScopedStringGetValuesHookJsName));
   return *this;
 }
 
 UdfConfigBuilder& UdfConfigBuilder::RegisterBinaryGetValuesHook(
     GetValuesHook& get_values_hook) {
-  config_.RegisterFunctionBinding(
-      GetValuesFunctionObject(get_values_hook, kBinaryGetValuesHookJsName));
+  config_.RegisterFunctionBinding(GetValuesFunctionObject(
+      get_values_hook, kScopedBinaryGetValuesHookJsName));
   return *this;
 }
 
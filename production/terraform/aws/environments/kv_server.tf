@@ -71,9 +71,27 @@ module "kv_server" {
 
   # Variables related to data loading.
   data_loading_num_threads = var.data_loading_num_threads
+  data_loading_max_threads = var.data_loading_max_threads
   s3client_max_connections = var.s3client_max_connections
   s3client_max_range_bytes = var.s3client_max_range_bytes
 
+  # Variables related to the cache.
+  cache_num_stripes                        = var.cache_num_stripes
+  cache_lock_free_reads                    = var.cache_lock_free_reads
+  cache_slab_storage                       = var.cache_slab_storage
+  cache_slab_compaction_interval_secs      = var.cache_slab_compaction_interval_secs
+  cache_tombstone_compaction_interval_secs = var.cache_tombstone_compaction_interval_secs
+  cache_memory_budget_bytes                = var.cache_memory_budget_bytes
+  cache_swap_on_load                       = var.cache_swap_on_load
+  cache_image_interval_secs                = var.cache_image_interval_secs
+  cache_image_path                         = var.cache_image_path
+  cache_use_snapshot_base                  = var.cache_use_snapshot_base
+  cache_base_path                          = var.cache_base_path
+  cache_partition_by_namespace             = var.cache_partition_by_namespace
+  cache_compression_threshold_bytes        = var.cache_compression_threshold_bytes
+  cache_decompressed_values_bytes          = var.cache_decompressed_values_bytes
+  cache_key_filter_expected_keys           = var.cache_key_filter_expected_keys
+
   # Variables related to sharding.
   num_shards = var.num_shards
 
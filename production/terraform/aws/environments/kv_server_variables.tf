@@ -217,3 +217,99 @@ variable "secondary_coordinator_account_identity" {
   description = "Account identity for the secondary coordinator."
   type        = string
 }
+
+variable "data_loading_max_threads" {
+  description = "Number of threads shared by all the readers of data files. Zero reads each file shard on a thread of its own."
+  default     = 0
+  type        = number
+}
+
+variable "cache_num_stripes" {
+  description = "Number of independently locked stripes the key-value cache is split into. Values greater than 1 enable the lock-striped cache."
+  default     = 1
+  type        = number
+}
+
+variable "cache_lock_free_reads" {
+  description = "Whether key-value lookups use the epoch-based cache whose readers never take a lock."
+  default     = false
+  type        = bool
+}
+
+variable "cache_slab_storage" {
+  description = "Whether key-value pairs are stored in large slabs instead of one allocation per key and value."
+  default     = false
+  type        = bool
+}
+
+variable "cache_slab_compaction_interval_secs" {
+  description = "How often space left by overwritten and deleted values is reclaimed from the slabs, in seconds."
+  default     = 60
+  type        = number
+}
+
+variable "cache_tombstone_compaction_interval_secs" {
+  description = "How often the tombstones of deleted keys and set values are removed, in seconds. Zero removes them at the end of each data file load."
+  default     = 30
+  type        = number
+}
+
+variable "cache_memory_budget_bytes" {
+  description = "Approximate number of bytes the cache may hold. Data files aren't loaded past it. Zero means unlimited."
+  default     = 0
+  type        = number
+}
+
+variable "cache_swap_on_load" {
+  description = "Whether data is loaded at startup into a fresh cache instance, which replaces the serving one once it has caught up with the deltas."
+  default     = false
+  type        = bool
+}
+
+variable "cache_image_interval_secs" {
+  description = "How often the cache is written to cache_image_path, in seconds. Zero disables the cache image."
+  default     = 0
+  type        = number
+}
+
+variable "cache_image_path" {
+  description = "Local file the cache image is written to and loaded from at startup."
+  default     = ""
+  type        = string
+}
+
+variable "cache_use_snapshot_base" {
+  description = "Whether the key-value pairs of the latest snapshot are kept memory mapped in cache_base_path."
+  default     = false
+  type        = bool
+}
+
+variable "cache_base_path" {
+  description = "Local file the key-value pairs of the latest snapshot are kept in."
+  default     = ""
+  type        = string
+}
+
+variable "cache_partition_by_namespace" {
+  description = "Whether the cache keeps the key-value pairs of each key namespace in a separate partition."
+  default     = false
+  type        = bool
+}
+
+variable "cache_compression_threshold_bytes" {
+  description = "Values of at least this many bytes are compressed in the cache. Zero disables compression."
+  default     = 0
+  type        = number
+}
+
+variable "cache_decompressed_values_bytes" {
+  description = "Bytes of recently read compressed values kept decompressed."
+  default     = 16777216
+  type        = number
+}
+
+variable "cache_key_filter_expected_keys" {
+  description = "Number of keys a Bloom filter of the keys loaded is sized for. Zero disables the filter."
+  default     = 0
+  type        = number
+}
@@ -139,27 +139,43 @@ module "ssh" {
 }
 
 module "parameter" {
-  source                                                 = "../../services/parameter"
-  service                                                = local.service
-  environment                                            = var.environment
-  s3_bucket_parameter_value                              = module.data_storage.s3_data_bucket_id
-  bucket_update_sns_arn_parameter_value                  = module.data_storage.sns_data_updates_topic_arn
-  realtime_sns_arn_parameter_value                       = module.data_storage.sns_realtime_topic_arn
-  backup_poll_frequency_secs_parameter_value             = var.backup_poll_frequency_secs
-  use_external_metrics_collector_endpoint                = var.use_external_metrics_collector_endpoint
-  metrics_collector_endpoint                             = var.metrics_collector_endpoint
-  metrics_export_interval_millis_parameter_value         = var.metrics_export_interval_millis
-  metrics_export_timeout_millis_parameter_value          = var.metrics_export_timeout_millis
-  realtime_updater_num_threads_parameter_value           = var.realtime_updater_num_threads
-  data_loading_num_threads_parameter_value               = var.data_loading_num_threads
-  s3client_max_connections_parameter_value               = var.s3client_max_connections
-  s3client_max_range_bytes_parameter_value               = var.s3client_max_range_bytes
-  num_shards_parameter_value                             = var.num_shards
-  udf_num_workers_parameter_value                        = var.udf_num_workers
-  route_v1_requests_to_v2_parameter_value                = var.route_v1_requests_to_v2
-  use_real_coordinators_parameter_value                  = var.use_real_coordinators
-  primary_coordinator_account_identity_parameter_value   = var.primary_coordinator_account_identity
-  secondary_coordinator_account_identity_parameter_value = var.secondary_coordinator_account_identity
+  source                                                   = "../../services/parameter"
+  service                                                  = local.service
+  environment                                              = var.environment
+  s3_bucket_parameter_value                                = module.data_storage.s3_data_bucket_id
+  bucket_update_sns_arn_parameter_value                    = module.data_storage.sns_data_updates_topic_arn
+  realtime_sns_arn_parameter_value                         = module.data_storage.sns_realtime_topic_arn
+  backup_poll_frequency_secs_parameter_value               = var.backup_poll_frequency_secs
+  use_external_metrics_collector_endpoint                  = var.use_external_metrics_collector_endpoint
+  metrics_collector_endpoint                               = var.metrics_collector_endpoint
+  metrics_export_interval_millis_parameter_value           = var.metrics_export_interval_millis
+  metrics_export_timeout_millis_parameter_value            = var.metrics_export_timeout_millis
+  realtime_updater_num_threads_parameter_value             = var.realtime_updater_num_threads
+  data_loading_num_threads_parameter_value                 = var.data_loading_num_threads
+  s3client_max_connections_parameter_value                 = var.s3client_max_connections
+  s3client_max_range_bytes_parameter_value                 = var.s3client_max_range_bytes
+  num_shards_parameter_value                               = var.num_shards
+  udf_num_workers_parameter_value                          = var.udf_num_workers
+  route_v1_requests_to_v2_parameter_value                  = var.route_v1_requests_to_v2
+  use_real_coordinators_parameter_value                    = var.use_real_coordinators
+  primary_coordinator_account_identity_parameter_value     = var.primary_coordinator_account_identity
+  secondary_coordinator_account_identity_parameter_value   = var.secondary_coordinator_account_identity
+  data_loading_max_threads_parameter_value                 = var.data_loading_max_threads
+  cache_num_stripes_parameter_value                        = var.cache_num_stripes
+  cache_lock_free_reads_parameter_value                    = var.cache_lock_free_reads
+  cache_slab_storage_parameter_value                       = var.cache_slab_storage
+  cache_slab_compaction_interval_secs_parameter_value      = var.cache_slab_compaction_interval_secs
+  cache_tombstone_compaction_interval_secs_parameter_value = var.cache_tombstone_compaction_interval_secs
+  cache_memory_budget_bytes_parameter_value                = var.cache_memory_budget_bytes
+  cache_swap_on_load_parameter_value                       = var.cache_swap_on_load
+  cache_image_interval_secs_parameter_value                = var.cache_image_interval_secs
+  cache_image_path_parameter_value                         = var.cache_image_path
+  cache_use_snapshot_base_parameter_value                  = var.cache_use_snapshot_base
+  cache_base_path_parameter_value                          = var.cache_base_path
+  cache_partition_by_namespace_parameter_value             = var.cache_partition_by_namespace
+  cache_compression_threshold_bytes_parameter_value        = var.cache_compression_threshold_bytes
+  cache_decompressed_values_bytes_parameter_value          = var.cache_decompressed_values_bytes
+  cache_key_filter_expected_keys_parameter_value           = var.cache_key_filter_expected_keys
 }
 
 module "security_group_rules" {
@@ -187,7 +203,7 @@ module "iam_role_policies" {
   sns_data_updates_topic_arn   = module.data_storage.sns_data_updates_topic_arn
   sns_realtime_topic_arn       = module.data_storage.sns_realtime_topic_arn
   ssh_instance_role_name       = module.iam_roles.ssh_instance_role_name
-  server_parameter_arns = [
+  server_parameter_arns = concat([
     module.parameter.s3_bucket_parameter_arn,
     module.parameter.bucket_update_sns_arn_parameter_arn,
     module.parameter.realtime_sns_arn_parameter_arn,
@@ -203,7 +219,26 @@ module "iam_role_policies" {
     module.parameter.num_shards_parameter_arn,
     module.parameter.udf_num_workers_parameter_arn,
     module.parameter.route_v1_requests_to_v2_parameter_arn,
-  module.parameter.use_real_coordinators_parameter_arn]
+    module.parameter.use_real_coordinators_parameter_arn,
+    module.parameter.data_loading_max_threads_parameter_arn,
+    module.parameter.cache_num_stripes_parameter_arn,
+    module.parameter.cache_lock_free_reads_parameter_arn,
+    module.parameter.cache_slab_storage_parameter_arn,
+    module.parameter.cache_slab_compaction_interval_secs_parameter_arn,
+    module.parameter.cache_tombstone_compaction_interval_secs_parameter_arn,
+    module.parameter.cache_memory_budget_bytes_parameter_arn,
+    module.parameter.cache_swap_on_load_parameter_arn,
+    module.parameter.cache_image_interval_secs_parameter_arn,
+    module.parameter.cache_use_snapshot_base_parameter_arn,
+    module.parameter.cache_partition_by_namespace_parameter_arn,
+    module.parameter.cache_compression_threshold_bytes_parameter_arn,
+    module.parameter.cache_decompressed_values_bytes_parameter_arn,
+    module.parameter.cache_key_filter_expected_keys_parameter_arn],
+    # Only created when the cache image or the snapshot base is enabled.
+    compact([
+      module.parameter.cache_image_path_parameter_arn,
+      module.parameter.cache_base_path_parameter_arn,
+  ]))
   coordinator_parameter_arns = (
     var.use_real_coordinators ? [
       module.parameter.primary_coordinator_account_identity_parameter_arn,
@@ -217,3 +217,83 @@ variable "secondary_coordinator_account_identity" {
   description = "Account identity for the secondary coordinator."
   type        = string
 }
+
+variable "data_loading_max_threads" {
+  description = "Number of threads shared by all the readers of data files. Zero reads each file shard on a thread of its own."
+  type        = number
+}
+
+variable "cache_num_stripes" {
+  description = "Number of independently locked stripes the key-value cache is split into. Values greater than 1 enable the lock-striped cache."
+  type        = number
+}
+
+variable "cache_lock_free_reads" {
+  description = "Whether key-value lookups use the epoch-based cache whose readers never take a lock."
+  type        = bool
+}
+
+variable "cache_slab_storage" {
+  description = "Whether key-value pairs are stored in large slabs instead of one allocation per key and value."
+  type        = bool
+}
+
+variable "cache_slab_compaction_interval_secs" {
+  description = "How often space left by overwritten and deleted values is reclaimed from the slabs, in seconds."
+  type        = number
+}
+
+variable "cache_tombstone_compaction_interval_secs" {
+  description = "How often the tombstones of deleted keys and set values are removed, in seconds. Zero removes them at the end of each data file load."
+  type        = number
+}
+
+variable "cache_memory_budget_bytes" {
+  description = "Approximate number of bytes the cache may hold. Data files aren't loaded past it. Zero means unlimited."
+  type        = number
+}
+
+variable "cache_swap_on_load" {
+  description = "Whether data is loaded at startup into a fresh cache instance, which replaces the serving one once it has caught up with the deltas."
+  type        = bool
+}
+
+variable "cache_image_interval_secs" {
+  description = "How often the cache is written to cache_image_path, in seconds. Zero disables the cache image."
+  type        = number
+}
+
+variable "cache_image_path" {
+  description = "Local file the cache image is written to and loaded from at startup."
+  type        = string
+}
+
+variable "cache_use_snapshot_base" {
+  description = "Whether the key-value pairs of the latest snapshot are kept memory mapped in cache_base_path."
+  type        = bool
+}
+
+variable "cache_base_path" {
+  description = "Local file the key-value pairs of the latest snapshot are kept in."
+  type        = string
+}
+
+variable "cache_partition_by_namespace" {
+  description = "Whether the cache keeps the key-value pairs of each key namespace in a separate partition."
+  type        = bool
+}
+
+variable "cache_compression_threshold_bytes" {
+  description = "Values of at least this many bytes are compressed in the cache. Zero disables compression."
+  type        = number
+}
+
+variable "cache_decompressed_values_bytes" {
+  description = "Bytes of recently read compressed values kept decompressed."
+  type        = number
+}
+
+variable "cache_key_filter_expected_keys" {
+  description = "Number of keys a Bloom filter of the keys loaded is sized for. Zero disables the filter."
+  type        = number
+}
@@ -150,3 +150,117 @@ resource "aws_ssm_parameter" "secondary_coordinator_account_identity_parameter"
   value     = var.secondary_coordinator_account_identity_parameter_value
   overwrite = true
 }
+
+resource "aws_ssm_parameter" "data_loading_max_threads_parameter" {
+  name      = "${var.service}-${var.environment}-data-loading-max-threads"
+  type      = "String"
+  value     = var.data_loading_max_threads_parameter_value
+  overwrite = true
+}
+
+resource "aws_ssm_parameter" "cache_num_stripes_parameter" {
+  name      = "${var.service}-${var.environment}-cache-num-stripes"
+  type      = "String"
+  value     = var.cache_num_stripes_parameter_value
+  overwrite = true
+}
+
+resource "aws_ssm_parameter" "cache_lock_free_reads_parameter" {
+  name      = "${var.service}-${var.environment}-cache-lock-free-reads"
+  type      = "String"
+  value     = var.cache_lock_free_reads_parameter_value
+  overwrite = true
+}
+
+resource "aws_ssm_parameter" "cache_slab_storage_parameter" {
+  name      = "${var.service}-${var.environment}-cache-slab-storage"
+  type      = "String"
+  value     = var.cache_slab_storage_parameter_value
+  overwrite = true
+}
+
+resource "aws_ssm_parameter" "cache_slab_compaction_interval_secs_parameter" {
+  name      = "${var.service}-${var.environment}-cache-slab-compaction-interval-secs"
+  type      = "String"
+  value     = var.cache_slab_compaction_interval_secs_parameter_value
+  overwrite = true
+}
+
+resource "aws_ssm_parameter" "cache_tombstone_compaction_interval_secs_parameter" {
+  name      = "${var.service}-${var.environment}-cache-tombstone-compaction-interval-secs"
+  type      = "String"
+  value     = var.cache_tombstone_compaction_interval_secs_parameter_value
+  overwrite = true
+}
+
+resource "aws_ssm_parameter" "cache_memory_budget_bytes_parameter" {
+  name      = "${var.service}-${var.environment}-cache-memory-budget-bytes"
+  type      = "String"
+  value     = var.cache_memory_budget_bytes_parameter_value
+  overwrite = true
+}
+
+resource "aws_ssm_parameter" "cache_swap_on_load_parameter" {
+  name      = "${var.service}-${var.environment}-cache-swap-on-load"
+  type      = "String"
+  value     = var.cache_swap_on_load_parameter_value
+  overwrite = true
+}
+
+resource "aws_ssm_parameter" "cache_image_interval_secs_parameter" {
+  name      = "${var.service}-${var.environment}-cache-image-interval-secs"
+  type      = "String"
+  value     = var.cache_image_interval_secs_parameter_value
+  overwrite = true
+}
+
+resource "aws_ssm_parameter" "cache_image_path_parameter" {
+  count     = (var.cache_image_interval_secs_parameter_value > 0) ? 1 : 0
+  name      = "${var.service}-${var.environment}-cache-image-path"
+  type      = "String"
+  value     = var.cache_image_path_parameter_value
+  overwrite = true
+}
+
+resource "aws_ssm_parameter" "cache_use_snapshot_base_parameter" {
+  name      = "${var.service}-${var.environment}-cache-use-snapshot-base"
+  type      = "String"
+  value     = var.cache_use_snapshot_base_parameter_value
+  overwrite = true
+}
+
+resource "aws_ssm_parameter" "cache_base_path_parameter" {
+  count     = (var.cache_use_snapshot_base_parameter_value) ? 1 : 0
+  name      = "${var.service}-${var.environment}-cache-base-path"
+  type      = "String"
+  value     = var.cache_base_path_parameter_value
+  overwrite = true
+}
+
+resource "aws_ssm_parameter" "cache_partition_by_namespace_parameter" {
+  name      = "${var.service}-${var.environment}-cache-partition-by-namespace"
+  type      = "String"
+  value     = var.cache_partition_by_namespace_parameter_value
+  overwrite = true
+}
+
+resource "aws_ssm_parameter" "cache_compression_threshold_bytes_parameter" {
+  name      = "${var.service}-${var.environment}-cache-compression-threshold-bytes"
+  type      = "String"
+  value     = var.cache_compression_threshold_bytes_parameter_value
+  overwrite = true
+}
+
+resource "aws_ssm_parameter" "cache_decompressed_values_bytes_parameter" {
+  name      = "${var.service}-${var.environment}-cache-decompressed-values-bytes"
+  type      = "String"
+  value     = var.cache_decompressed_values_bytes_parameter_value
+  overwrite = true
+}
+
+resource "aws_ssm_parameter" "cache_key_filter_expected_keys_parameter" {
+  name      = "${var.service}-${var.environment}-cache-key-filter-expected-keys"
+  type      = "String"
+  value     = var.cache_key_filter_expected_keys_parameter_value
+  overwrite = true
+}
@@ -93,3 +93,67 @@ output "primary_coordinator_account_identity_parameter_arn" {
 output "secondary_coordinator_account_identity_parameter_arn" {
   value = (var.use_real_coordinators_parameter_value) ? aws_ssm_parameter.secondary_coordinator_account_identity_parameter[0].arn : ""
 }
+
+output "data_loading_max_threads_parameter_arn" {
+  value = aws_ssm_parameter.data_loading_max_threads_parameter.arn
+}
+
+output "cache_num_stripes_parameter_arn" {
+  value = aws_ssm_parameter.cache_num_stripes_parameter.arn
+}
+
+output "cache_lock_free_reads_parameter_arn" {
+  value = aws_ssm_parameter.cache_lock_free_reads_parameter.arn
+}
+
+output "cache_slab_storage_parameter_arn" {
+  value = aws_ssm_parameter.cache_slab_storage_parameter.arn
+}
+
+output "cache_slab_compaction_interval_secs_parameter_arn" {
+  value = aws_ssm_parameter.cache_slab_compaction_interval_secs_parameter.arn
+}
+
+output "cache_tombstone_compaction_interval_secs_parameter_arn" {
+  value = aws_ssm_parameter.cache_tombstone_compaction_interval_secs_parameter.arn
+}
+
+output "cache_memory_budget_bytes_parameter_arn" {
+  value = aws_ssm_parameter.cache_memory_budget_bytes_parameter.arn
+}
+
+output "cache_swap_on_load_parameter_arn" {
+  value = aws_ssm_parameter.cache_swap_on_load_parameter.arn
+}
+
+output "cache_image_interval_secs_parameter_arn" {
+  value = aws_ssm_parameter.cache_image_interval_secs_parameter.arn
+}
+
+output "cache_image_path_parameter_arn" {
+  value = (var.cache_image_interval_secs_parameter_value > 0) ? aws_ssm_parameter.cache_image_path_parameter[0].arn : ""
+}
+
+output "cache_use_snapshot_base_parameter_arn" {
+  value = aws_ssm_parameter.cache_use_snapshot_base_parameter.arn
+}
+
+output "cache_base_path_parameter_arn" {
+  value = (var.cache_use_snapshot_base_parameter_value) ? aws_ssm_parameter.cache_base_path_parameter[0].arn : ""
+}
+
+output "cache_partition_by_namespace_parameter_arn" {
+  value = aws_ssm_parameter.cache_partition_by_namespace_parameter.arn
+}
+
+output "cache_compression_threshold_bytes_parameter_arn" {
+  value = aws_ssm_parameter.cache_compression_threshold_bytes_parameter.arn
+}
+
+output "cache_decompressed_values_bytes_parameter_arn" {
+  value = aws_ssm_parameter.cache_decompressed_values_bytes_parameter.arn
+}
+
+output "cache_key_filter_expected_keys_parameter_arn" {
+  value = aws_ssm_parameter.cache_key_filter_expected_keys_parameter.arn
+}
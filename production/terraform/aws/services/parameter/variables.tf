@@ -113,3 +113,83 @@ variable "use_external_metrics_collector_endpoint" {
   description = "Whether to connect external metrics collector endpoint"
   type        = bool
 }
+
+variable "data_loading_max_threads_parameter_value" {
+  description = "Number of threads shared by all the readers of data files. Zero reads each file shard on a thread of its own."
+  type        = number
+}
+
+variable "cache_num_stripes_parameter_value" {
+  description = "Number of independently locked stripes the key-value cache is split into. Values greater than 1 enable the lock-striped cache."
+  type        = number
+}
+
+variable "cache_lock_free_reads_parameter_value" {
+  description = "Whether key-value lookups use the epoch-based cache whose readers never take a lock."
+  type        = bool
+}
+
+variable "cache_slab_storage_parameter_value" {
+  description = "Whether key-value pairs are stored in large slabs instead of one allocation per key and value."
+  type        = bool
+}
+
+variable "cache_slab_compaction_interval_secs_parameter_value" {
+  description = "How often space left by overwritten and deleted values is reclaimed from the slabs, in seconds."
+  type        = number
+}
+
+variable "cache_tombstone_compaction_interval_secs_parameter_value" {
+  description = "How often the tombstones of deleted keys and set values are removed, in seconds. Zero removes them at the end of each data file load."
+  type        = number
+}
+
+variable "cache_memory_budget_bytes_parameter_value" {
+  description = "Approximate number of bytes the cache may hold. Data files aren't loaded past it. Zero means unlimited."
+  type        = number
+}
+
+variable "cache_swap_on_load_parameter_value" {
+  description = "Whether data is loaded at startup into a fresh cache instance, which replaces the serving one once it has caught up with the deltas."
+  type        = bool
+}
+
+variable "cache_image_interval_secs_parameter_value" {
+  description = "How often the cache is written to cache_image_path, in seconds. Zero disables the cache image."
+  type        = number
+}
+
+variable "cache_image_path_parameter_value" {
+  description = "Local file the cache image is written to and loaded from at startup."
+  type        = string
+}
+
+variable "cache_use_snapshot_base_parameter_value" {
+  description = "Whether the key-value pairs of the latest snapshot are kept memory mapped in cache_base_path."
+  type        = bool
+}
+
+variable "cache_base_path_parameter_value" {
+  description = "Local file the key-value pairs of the latest snapshot are kept in."
+  type        = string
+}
+
+variable "cache_partition_by_namespace_parameter_value" {
+  description = "Whether the cache keeps the key-value pairs of each key namespace in a separate partition."
+  type        = bool
+}
+
+variable "cache_compression_threshold_bytes_parameter_value" {
+  description = "Values of at least this many bytes are compressed in the cache. Zero disables compression."
+  type        = number
+}
+
+variable "cache_decompressed_values_bytes_parameter_value" {
+  description = "Bytes of recently read compressed values kept decompressed."
+  type        = number
+}
+
+variable "cache_key_filter_expected_keys_parameter_value" {
+  description = "Number of keys a Bloom filter of the keys loaded is sized for. Zero disables the filter."
+  type        = number
+}
@@ -70,6 +70,22 @@ module "kv_server" {
     num-shards                                = var.num_shards
     udf-num-workers                           = var.udf_num_workers
     route-v1-to-v2                            = var.route_v1_to_v2
+    data-loading-max-threads                  = var.data_loading_max_threads
+    cache-num-stripes                         = var.cache_num_stripes
+    cache-lock-free-reads                     = var.cache_lock_free_reads
+    cache-slab-storage                        = var.cache_slab_storage
+    cache-slab-compaction-interval-secs       = var.cache_slab_compaction_interval_secs
+    cache-tombstone-compaction-interval-secs  = var.cache_tombstone_compaction_interval_secs
+    cache-memory-budget-bytes                 = var.cache_memory_budget_bytes
+    cache-swap-on-load                        = var.cache_swap_on_load
+    cache-image-interval-secs                 = var.cache_image_interval_secs
+    cache-image-path                          = var.cache_image_path
+    cache-use-snapshot-base                   = var.cache_use_snapshot_base
+    cache-base-path                           = var.cache_base_path
+    cache-partition-by-namespace              = var.cache_partition_by_namespace
+    cache-compression-threshold-bytes         = var.cache_compression_threshold_bytes
+    cache-decompressed-values-bytes           = var.cache_decompressed_values_bytes
+    cache-key-filter-expected-keys            = var.cache_key_filter_expected_keys
     use-real-coordinators                     = var.use_real_coordinators
     environment                               = var.environment
     project-id                                = var.project_id
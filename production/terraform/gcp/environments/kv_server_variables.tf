@@ -230,3 +230,99 @@ variable "existing_service_mesh" {
   description = "Existing service mesh. This would only be used if use_existing_service_mesh is true."
   type        = string
 }
+
+variable "data_loading_max_threads" {
+  type        = number
+  description = "Number of threads shared by all the readers of data files. Zero reads each file shard on a thread of its own."
+  default     = 0
+}
+
+variable "cache_num_stripes" {
+  type        = number
+  description = "Number of independently locked stripes the key-value cache is split into. Values greater than 1 enable the lock-striped cache."
+  default     = 1
+}
+
+variable "cache_lock_free_reads" {
+  type        = bool
+  description = "Whether key-value lookups use the epoch-based cache whose readers never take a lock."
+  default     = false
+}
+
+variable "cache_slab_storage" {
+  type        = bool
+  description = "Whether key-value pairs are stored in large slabs instead of one allocation per key and value."
+  default     = false
+}
+
+variable "cache_slab_compaction_interval_secs" {
+  type        = number
+  description = "How often space left by overwritten and deleted values is reclaimed from the slabs, in seconds."
+  default     = 60
+}
+
+variable "cache_tombstone_compaction_interval_secs" {
+  type        = number
+  description = "How often the tombstones of deleted keys and set values are removed, in seconds. Zero removes them at the end of each data file load."
+  default     = 30
+}
+
+variable "cache_memory_budget_bytes" {
+  type        = number
+  description = "Approximate number of bytes the cache may hold. Data files aren't loaded past it. Zero means unlimited."
+  default     = 0
+}
+
+variable "cache_swap_on_load" {
+  type        = bool
+  description = "Whether data is loaded at startup into a fresh cache instance, which replaces the serving one once it has caught up with the deltas."
+  default     = false
+}
+
+variable "cache_image_interval_secs" {
+  type        = number
+  description = "How often the cache is written to cache_image_path, in seconds. Zero disables the cache image."
+  default     = 0
+}
+
+variable "cache_image_path" {
+  type        = string
+  description = "Local file the cache image is written to and loaded from at startup. Set to "EMPTY_STRING" if unused."
+  default     = ""
+}
+
+variable "cache_use_snapshot_base" {
+  type        = bool
+  description = "Whether the key-value pairs of the latest snapshot are kept memory mapped in cache_base_path."
+  default     = false
+}
+
+variable "cache_base_path" {
+  type        = string
+  description = "Local file the key-value pairs of the latest snapshot are kept in. Set to "EMPTY_STRING" if unused."
+  default     = ""
+}
+
+variable "cache_partition_by_namespace" {
+  type        = bool
+  description = "Whether the cache keeps the key-value pairs of each key namespace in a separate partition."
+  default     = false
+}
+
+variable "cache_compression_threshold_bytes" {
+  type        = number
+  description = "Values of at least this many bytes are compressed in the cache. Zero disables compression."
+  default     = 0
+}
+
+variable "cache_decompressed_values_bytes" {
+  type        = number
+  description = "Bytes of recently read compressed values kept decompressed."
+  default     = 16777216
+}
+
+variable "cache_key_filter_expected_keys" {
+  type        = number
+  description = "Number of keys a Bloom filter of the keys loaded is sized for. Zero disables the filter."
+  default     = 0
+}
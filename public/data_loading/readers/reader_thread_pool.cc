@@ -0,0 +1,99 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "public/data_loading/readers/reader_thread_pool.h"
+
+#include <algorithm>
+
+#include "glog/logging.h"
+
+namespace kv_server {
+
+ReaderThreadPool::ReaderThreadPool(int num_threads) {
+  CHECK_GT(num_threads, 0) << "A reader thread pool needs at least one thread.";
+  threads_.reserve(num_threads);
+  for (int i = 0; i < num_threads; ++i) {
+    threads_.emplace_back(&ReaderThreadPool::RunThread, this);
+  }
+}
+
+ReaderThreadPool::~ReaderThreadPool() {
+  {
+    absl::MutexLock lock(&mutex_);
+    stop_ = true;
+  }
+  for (auto& thread : threads_) {
+    thread.join();
+  }
+}
+
+bool ReaderThreadPool::HasClaimableJob() const {
+  return stop_ ||
+         std::any_of(jobs_.begin(), jobs_.end(), [](const Job* job) {
+           return job->num_threads < job->max_parallelism;
+         });
+}
+
+void ReaderThreadPool::RunTasks(Job& job) {
+  ++job.num_threads;
+  job.max_threads = std::max(job.max_threads, job.num_threads);
+  while (job.next_task < job.num_tasks) {
+    const int task = job.next_task++;
+    if (job.next_task == job.num_tasks) {
+      jobs_.remove(&job);
+    }
+    mutex_.Unlock();
+    (*job.task)(task);
+    mutex_.Lock();
+    ++job.num_done;
+  }
+  --job.num_threads;
+}
+
+void ReaderThreadPool::RunThread() {
+  absl::MutexLock lock(&mutex_);
+  while (true) {
+    mutex_.Await(absl::Condition(this, &ReaderThreadPool::HasClaimableJob));
+    if (stop_) {
+      return;
+    }
+    Job* job = *std::find_if(jobs_.begin(), jobs_.end(), [](const Job* job) {
+      return job->num_threads < job->max_parallelism;
+    });
+    RunTasks(*job);
+  }
+}
+
+int ReaderThreadPool::ParallelFor(int num_tasks, int max_parallelism,
+                                  const std::function<void(int)>& task) {
+  if (num_tasks <= 0) {
+    return 0;
+  }
+  Job job{
+      .task = &task,
+      .num_tasks = num_tasks,
+      .max_parallelism = std::max(max_parallelism, 1),
+  };
+  absl::MutexLock lock(&mutex_);
+  jobs_.push_back(&job);
+  RunTasks(job);
+  // All the tasks are claimed once the calling thread is done, but some may
+  // still be running on the pool.
+  mutex_.Await(absl::Condition(
+      +[](Job* job) { return job->num_threads == 0; }, &job));
+  DCHECK_EQ(job.num_done, num_tasks);
+  return job.max_threads;
+}
+
+}  // namespace kv_server
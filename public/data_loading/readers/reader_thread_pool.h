@@ -0,0 +1,84 @@
+/*
+ * Copyright 2023 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PUBLIC_DATA_LOADING_READERS_READER_THREAD_POOL_H_
+#define PUBLIC_DATA_LOADING_READERS_READER_THREAD_POOL_H_
+
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <thread>
+#include <vector>
+
+#include "absl/synchronization/mutex.h"
+
+namespace kv_server {
+
+// Fixed set of threads shared by the concurrent readers of data files, so
+// that the number of threads reading doesn't grow with the size or number
+// of the files read at once.
+//
+// Each read is split into more chunks than it has threads, and the chunks
+// are claimed one at a time by whichever thread is free, so threads that are
+// done with their chunks take over the remaining ones instead of idling
+// while a slow chunk is read.
+class ReaderThreadPool {
+ public:
+  // `num_threads` must be positive.
+  explicit ReaderThreadPool(int num_threads);
+  // Waits for the running tasks to finish.
+  ~ReaderThreadPool();
+
+  ReaderThreadPool(const ReaderThreadPool&) = delete;
+  ReaderThreadPool& operator=(const ReaderThreadPool&) = delete;
+
+  int num_threads() const { return threads_.size(); }
+
+  // Calls `task` with each of `0, ..., num_tasks - 1` and blocks until all
+  // the calls returned. The calling thread runs tasks too, along with up to
+  // `max_parallelism - 1` threads of the pool, fewer if they're busy with
+  // other calls. Tasks are started in order. Returns the most threads that
+  // ran tasks at once.
+  int ParallelFor(int num_tasks, int max_parallelism,
+                  const std::function<void(int)>& task);
+
+ private:
+  // One `ParallelFor` call.
+  struct Job {
+    const std::function<void(int)>* task;
+    int num_tasks;
+    int max_parallelism;
+    int next_task = 0;
+    int num_done = 0;
+    int num_threads = 0;
+    int max_threads = 0;
+  };
+
+  bool HasClaimableJob() const ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Runs tasks of `job` until none are left to claim.
+  void RunTasks(Job& job) ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  void RunThread();
+
+  absl::Mutex mutex_;
+  // Jobs with tasks left to claim, oldest first.
+  std::list<Job*> jobs_ ABSL_GUARDED_BY(mutex_);
+  bool stop_ ABSL_GUARDED_BY(mutex_) = false;
+  std::vector<std::thread> threads_;
+};
+
+}  // namespace kv_server
+
+#endif  // PUBLIC_DATA_LOADING_READERS_READER_THREAD_POOL_H_
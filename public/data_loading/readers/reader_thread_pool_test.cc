@@ -0,0 +1,92 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "public/data_loading/readers/reader_thread_pool.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "absl/synchronization/notification.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace kv_server {
+namespace {
+
+using testing::Each;
+using testing::Le;
+
+TEST(ReaderThreadPoolTest, RunsEachTaskOnce) {
+  ReaderThreadPool pool(4);
+  std::vector<std::atomic<int>> runs(100);
+  const int max_threads = pool.ParallelFor(
+      runs.size(), /*max_parallelism=*/8, [&runs](int task) { ++runs[task]; });
+  EXPECT_THAT(std::vector<int>(runs.begin(), runs.end()), Each(1));
+  EXPECT_GE(max_threads, 1);
+  // The pool's threads and the calling one.
+  EXPECT_LE(max_threads, 5);
+  EXPECT_EQ(pool.ParallelFor(0, 8, [](int) { FAIL(); }), 0);
+}
+
+TEST(ReaderThreadPoolTest, LimitsParallelismOfACall) {
+  ReaderThreadPool pool(8);
+  std::atomic<int> running = 0;
+  std::vector<int> max_running(50);
+  pool.ParallelFor(max_running.size(), /*max_parallelism=*/2,
+                   [&running, &max_running](int task) {
+                     max_running[task] = ++running;
+                     std::this_thread::yield();
+                     --running;
+                   });
+  EXPECT_THAT(max_running, Each(Le(2)));
+}
+
+TEST(ReaderThreadPoolTest, FreeThreadsTakeOverTasksOfASlowThread) {
+  ReaderThreadPool pool(2);
+  absl::Notification others_done;
+  std::atomic<int> num_others_done = 0;
+  constexpr int kNumTasks = 20;
+  pool.ParallelFor(kNumTasks, /*max_parallelism=*/3,
+                   [&others_done, &num_others_done](int task) {
+                     if (task == 0) {
+                       // Blocks until every other task ran elsewhere.
+                       others_done.WaitForNotification();
+                       return;
+                     }
+                     if (++num_others_done == kNumTasks - 1) {
+                       others_done.Notify();
+                     }
+                   });
+  EXPECT_EQ(num_others_done, kNumTasks - 1);
+}
+
+TEST(ReaderThreadPoolTest, SharesThreadsBetweenConcurrentCalls) {
+  ReaderThreadPool pool(2);
+  std::atomic<int> num_runs = 0;
+  std::vector<std::thread> callers;
+  for (int i = 0; i < 4; ++i) {
+    callers.emplace_back([&pool, &num_runs] {
+      pool.ParallelFor(25, /*max_parallelism=*/2,
+                       [&num_runs](int) { ++num_runs; });
+    });
+  }
+  for (auto& caller : callers) {
+    caller.join();
+  }
+  EXPECT_EQ(num_runs, 100);
+}
+
+}  // namespace
+}  // namespace kv_server
@@ -22,6 +22,8 @@
 #include <future>
 #include <memory>
 #include <string>
+#include <string_view>
+#include <type_traits>
 #include <utility>
 #include <vector>
 
@@ -30,7 +32,9 @@
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
 #include "absl/strings/str_format.h"
+#include "absl/types/span.h"
 #include "glog/logging.h"
+#include "public/data_loading/readers/reader_thread_pool.h"
 #include "public/data_loading/riegeli_metadata.pb.h"
 #include "riegeli/bytes/istream_reader.h"
 #include "riegeli/records/record_reader.h"
@@ -60,6 +64,18 @@ class StreamRecordReader {
   // reading and logs the error at the end.
   virtual absl::Status ReadStreamRecords(
       const std::function<absl::Status(const RecordT&)>& callback) = 0;
+
+  // Like `ReadStreamRecords`, but calls `callback` with batches of up to
+  // `max_batch_size` records, so that callers can amortize per-record work.
+  // The records are only valid during the callback. By default, every batch
+  // holds a single record.
+  virtual absl::Status ReadStreamRecordBatches(
+      int64_t max_batch_size,
+      const std::function<absl::Status(absl::Span<const RecordT>)>& callback) {
+    return ReadStreamRecords([&callback](const RecordT& record) {
+      return callback(absl::MakeConstSpan(&record, 1));
+    });
+  }
 };
 
 // Reader that can read streams in Riegeli format.
@@ -113,10 +129,15 @@ class RiegeliStreamReader : public StreamRecordReader<RecordT> {
 
 const int64_t kDefaultNumWorkerThreads = std::thread::hardware_concurrency();
 constexpr int64_t kDefaultMinShardSize = 8 * 1024 * 1024;  // 8MB
+// Shards per worker thread a stream is split into when it's read on a
+// `ReaderThreadPool`, so that threads done early take over the shards left.
+constexpr int64_t kShardsPerWorkerThread = 4;
 constexpr std::string_view kReadShardRecordsLatencyEvent =
     "ConcurrentStreamRecordReader::ReadShardRecords";
 constexpr std::string_view kReadStreamRecordsLatencyEvent =
     "ConcurrentStreamRecordReader::ReadStreamRecords";
+constexpr std::string_view kReadStreamRecordsParallelismEvent =
+    "ConcurrentStreamRecordReader::Parallelism";
 
 // Holds a stream of data.
 class RecordStream {
@@ -130,7 +151,9 @@ class RecordStream {
 // into shards with an approximately equal number of records and reads the
 // shards in parallel. Each record in the underlying data stream is guaranteed
 // to be read exactly once. The concurrency level can be configured using
-// `ConcurrentStreamRecordReader<RecordT>::Options`.
+// `ConcurrentStreamRecordReader<RecordT>::Options`. Shards are read on
+// threads of their own, unless a `ReaderThreadPool` is set, in which case
+// they're smaller and read on the threads of the pool.
 //
 // Sample usage:
 //
@@ -157,8 +180,13 @@ template <typename RecordT>
 class ConcurrentStreamRecordReader : public StreamRecordReader<RecordT> {
  public:
   struct Options {
+    // Threads reading the shards of a stream at once. With a thread pool,
+    // it's an upper bound that includes the thread calling the reader.
     int64_t num_worker_threads = kDefaultNumWorkerThreads;
     int64_t min_shard_size_bytes = kDefaultMinShardSize;
+    // Shared by the readers, must outlive them. Null reads each shard on a
+    // new thread.
+    ReaderThreadPool* thread_pool = nullptr;
     std::function<bool(const riegeli::SkippedRegion&)> recovery_callback =
         [](const riegeli::SkippedRegion& region) {
           LOG(WARNING) << "Skipping over corrupted region: " << region;
@@ -176,8 +204,20 @@ class ConcurrentStreamRecordReader : public StreamRecordReader<RecordT> {
   absl::StatusOr<KVFileMetadata> GetKVFileMetadata() override;
   absl::Status ReadStreamRecords(
       const std::function<absl::Status(const RecordT&)>& callback) override;
+  // Each shard is read into its own batches, so batches are read and passed
+  // to `callback` concurrently.
+  absl::Status ReadStreamRecordBatches(
+      int64_t max_batch_size,
+      const std::function<absl::Status(absl::Span<const RecordT>)>& callback)
+      override;
 
  private:
+  // Owns the bytes of a record read into a batch. Records read as views are
+  // only valid until the next read, so they are copied.
+  using RecordBuffer =
+      std::conditional_t<std::is_same_v<RecordT, std::string_view>,
+                         std::string, RecordT>;
+
   // Defines a byte range in the underlying record stream that will be read
   // concurrently with other shards.
   struct ShardRange {
@@ -192,9 +232,16 @@ class ConcurrentStreamRecordReader : public StreamRecordReader<RecordT> {
     int64_t num_records_read;
   };
   absl::StatusOr<ShardResult> ReadShardRecords(
-      const ShardRange& shard,
-      const std::function<absl::Status(const RecordT&)>& record_callback);
-  absl::StatusOr<std::vector<ShardRange>> BuildShards();
+      const ShardRange& shard, int64_t max_batch_size,
+      const std::function<absl::Status(absl::Span<const RecordT>)>&
+          batch_callback);
+  // Splits the stream into up to `num_shards` shards.
+  absl::StatusOr<std::vector<ShardRange>> BuildShards(int64_t num_shards);
+  // Reads `shards` concurrently and returns their results, in order.
+  std::vector<absl::StatusOr<ShardResult>> ReadShards(
+      const std::vector<ShardRange>& shards, int64_t max_batch_size,
+      const std::function<absl::Status(absl::Span<const RecordT>)>&
+          batch_callback);
   absl::StatusOr<int64_t> RecordStreamSize();
 
   privacy_sandbox::server_common::MetricsRecorder& metrics_recorder_;
@@ -241,7 +288,7 @@ ConcurrentStreamRecordReader<RecordT>::RecordStreamSize() {
 template <typename RecordT>
 absl::StatusOr<
     std::vector<typename ConcurrentStreamRecordReader<RecordT>::ShardRange>>
-ConcurrentStreamRecordReader<RecordT>::BuildShards() {
+ConcurrentStreamRecordReader<RecordT>::BuildShards(int64_t num_shards) {
   using ShardRangeT =
       typename ConcurrentStreamRecordReader<RecordT>::ShardRange;
   absl::StatusOr<int64_t> stream_size = RecordStreamSize();
@@ -256,12 +303,12 @@ ConcurrentStreamRecordReader<RecordT>::BuildShards() {
   // The shard size must be at least `options_.min_shard_size_bytes` and
   // at most `*stream_size`.
   int64_t shard_size = std::min(
-      *stream_size, std::max(int64_t(std::ceil((double)*stream_size /
-                                               options_.num_worker_threads)),
-                             options_.min_shard_size_bytes));
+      *stream_size,
+      std::max(int64_t(std::ceil((double)*stream_size / num_shards)),
+               options_.min_shard_size_bytes));
   int64_t shard_start_pos = 0;
   std::vector<ShardRangeT> shards;
-  shards.reserve(options_.num_worker_threads);
+  shards.reserve(num_shards);
   while (shard_start_pos < *stream_size) {
     int64_t shard_end_pos = shard_start_pos + shard_size;
     shard_end_pos = std::min(shard_end_pos, *stream_size);
@@ -277,34 +324,43 @@ ConcurrentStreamRecordReader<RecordT>::BuildShards() {
   return shards;
 }
 
-// Note that this function blocks until all records in the underlying record
-// stream are read.
 template <typename RecordT>
 absl::Status ConcurrentStreamRecordReader<RecordT>::ReadStreamRecords(
     const std::function<absl::Status(const RecordT&)>& callback) {
+  return ReadStreamRecordBatches(
+      /*max_batch_size=*/1, [&callback](absl::Span<const RecordT> records) {
+        return callback(records.front());
+      });
+}
+
+// Note that this function blocks until all records in the underlying record
+// stream are read.
+template <typename RecordT>
+absl::Status ConcurrentStreamRecordReader<RecordT>::ReadStreamRecordBatches(
+    int64_t max_batch_size,
+    const std::function<absl::Status(absl::Span<const RecordT>)>& callback) {
+  if (max_batch_size < 1) {
+    return absl::InvalidArgumentError(absl::StrFormat(
+        "Batches must hold at least one record, got: %d", max_batch_size));
+  }
   privacy_sandbox::server_common::ScopeLatencyRecorder latency_recorder(
       std::string(kReadStreamRecordsLatencyEvent), metrics_recorder_);
-  auto shards = BuildShards();
+  auto shards = BuildShards(options_.thread_pool == nullptr
+                                ? options_.num_worker_threads
+                                : options_.num_worker_threads *
+                                      kShardsPerWorkerThread);
   if (!shards.ok() || shards->empty()) {
     return shards.status();
   }
-  std::vector<std::future<absl::StatusOr<ShardResult>>> shard_reader_tasks;
-  for (const auto& shard : *shards) {
-    // TODO: b/268339067 - Investigate using an executor because
-    // std::async is generally not preffered, but works fine as an
-    // initial implementation.
-    shard_reader_tasks.push_back(
-        std::async(std::launch::async,
-                   &ConcurrentStreamRecordReader<RecordT>::ReadShardRecords,
-                   this, std::ref(shard), std::ref(callback)));
-  }
-  absl::StatusOr<ShardResult> prev_shard_result = shard_reader_tasks[0].get();
+  std::vector<absl::StatusOr<ShardResult>> shard_results =
+      ReadShards(*shards, max_batch_size, callback);
+  absl::StatusOr<ShardResult> prev_shard_result = shard_results[0];
   if (!prev_shard_result.ok()) {
     return prev_shard_result.status();
   }
   int64_t total_records_read = prev_shard_result->num_records_read;
-  for (int i = 1; i < shard_reader_tasks.size(); i++) {
-    absl::StatusOr<ShardResult> curr_shard_result = shard_reader_tasks[i].get();
+  for (size_t i = 1; i < shard_results.size(); i++) {
+    absl::StatusOr<ShardResult>& curr_shard_result = shard_results[i];
     // TODO: The stuff below should be handled more gracefully,
     // e.g., only retry the shard that failed or skipped some
     // records.
@@ -327,11 +383,48 @@ absl::Status ConcurrentStreamRecordReader<RecordT>::ReadStreamRecords(
   return absl::OkStatus();
 }
 
+template <typename RecordT>
+std::vector<
+    absl::StatusOr<typename ConcurrentStreamRecordReader<RecordT>::ShardResult>>
+ConcurrentStreamRecordReader<RecordT>::ReadShards(
+    const std::vector<ShardRange>& shards, int64_t max_batch_size,
+    const std::function<absl::Status(absl::Span<const RecordT>)>&
+        batch_callback) {
+  std::vector<absl::StatusOr<ShardResult>> shard_results;
+  shard_results.reserve(shards.size());
+  if (options_.thread_pool == nullptr) {
+    std::vector<std::future<absl::StatusOr<ShardResult>>> shard_reader_tasks;
+    for (const auto& shard : shards) {
+      shard_reader_tasks.push_back(
+          std::async(std::launch::async,
+                     &ConcurrentStreamRecordReader<RecordT>::ReadShardRecords,
+                     this, std::ref(shard), max_batch_size,
+                     std::ref(batch_callback)));
+    }
+    for (auto& task : shard_reader_tasks) {
+      shard_results.push_back(task.get());
+    }
+    metrics_recorder_.RecordHistogramEvent(
+        std::string(kReadStreamRecordsParallelismEvent), shards.size());
+    return shard_results;
+  }
+  shard_results.resize(shards.size(), absl::UnknownError("Shard not read."));
+  const int parallelism = options_.thread_pool->ParallelFor(
+      shards.size(), options_.num_worker_threads, [&](int i) {
+        shard_results[i] =
+            ReadShardRecords(shards[i], max_batch_size, batch_callback);
+      });
+  metrics_recorder_.RecordHistogramEvent(
+      std::string(kReadStreamRecordsParallelismEvent), parallelism);
+  return shard_results;
+}
+
 template <typename RecordT>
 absl::StatusOr<typename ConcurrentStreamRecordReader<RecordT>::ShardResult>
 ConcurrentStreamRecordReader<RecordT>::ReadShardRecords(
-    const ShardRange& shard,
-    const std::function<absl::Status(const RecordT&)>& record_callback) {
+    const ShardRange& shard, int64_t max_batch_size,
+    const std::function<absl::Status(absl::Span<const RecordT>)>&
+        batch_callback) {
   VLOG(2) << "Reading shard: "
           << "[" << shard.start_pos << "," << shard.end_pos << "]";
   privacy_sandbox::server_common::ScopeLatencyRecorder latency_recorder(
@@ -348,12 +441,34 @@ ConcurrentStreamRecordReader<RecordT>::ReadShardRecords(
   ShardResult shard_result;
   shard_result.first_record_pos = next_record_pos;
   int64_t num_records_read = 0;
-  RecordT record;
   absl::Status overall_status;
-  while (next_record_pos <= shard.end_pos && record_reader.ReadRecord(record)) {
-    overall_status.Update(record_callback(record));
+  // Single records are passed to the callback without copying them.
+  std::vector<RecordBuffer> buffers(max_batch_size > 1 ? max_batch_size : 0);
+  std::vector<RecordT> batch;
+  batch.reserve(max_batch_size);
+  while (next_record_pos <= shard.end_pos) {
+    RecordT record;
+    if (max_batch_size == 1) {
+      if (!record_reader.ReadRecord(record)) {
+        break;
+      }
+    } else {
+      RecordBuffer& buffer = buffers[batch.size()];
+      if (!record_reader.ReadRecord(buffer)) {
+        break;
+      }
+      record = RecordT(buffer);
+    }
+    batch.push_back(std::move(record));
     num_records_read++;
     next_record_pos = record_reader.pos().numeric();
+    if (batch.size() == max_batch_size) {
+      overall_status.Update(batch_callback(absl::MakeConstSpan(batch)));
+      batch.clear();
+    }
+  }
+  if (!batch.empty()) {
+    overall_status.Update(batch_callback(absl::MakeConstSpan(batch)));
   }
   // TODO: b/269119466 - Figure out how to handle this better. Maybe add
   // metrics to track callback failures (??).
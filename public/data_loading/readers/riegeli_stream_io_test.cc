@@ -17,11 +17,15 @@
 #include <sstream>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include "absl/status/status.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/types/span.h"
 #include "gmock/gmock.h"
 #include "google/protobuf/text_format.h"
 #include "gtest/gtest.h"
+#include "public/data_loading/readers/reader_thread_pool.h"
 #include "public/test_util/mocks.h"
 #include "public/test_util/proto_matcher.h"
 #include "riegeli/bytes/string_writer.h"
@@ -74,6 +78,13 @@ class StreamRecordReaderTest : public ::testing::TestWithParam<ReaderType> {
 
 using ConcurrentReaderOptions =
     ConcurrentStreamRecordReader<std::string_view>::Options;
+
+// Shared by all tests, as a server shares one pool between its readers.
+ReaderThreadPool* TestThreadPool() {
+  static ReaderThreadPool* const thread_pool = new ReaderThreadPool(3);
+  return thread_pool;
+}
+
 class ConcurrentStreamRecordReaderTest
     : public ::testing::TestWithParam<ConcurrentReaderOptions> {
  protected:
@@ -213,6 +224,16 @@ INSTANTIATE_TEST_SUITE_P(ConcurrentOptions, ConcurrentStreamRecordReaderTest,
                              ConcurrentReaderOptions{
                                  .num_worker_threads = 5,
                                  .min_shard_size_bytes = 1024 * 1024,
+                             },
+                             ConcurrentReaderOptions{
+                                 .num_worker_threads = 1,
+                                 .min_shard_size_bytes = 1024,
+                                 .thread_pool = TestThreadPool(),
+                             },
+                             ConcurrentReaderOptions{
+                                 .num_worker_threads = 5,
+                                 .min_shard_size_bytes = 1024,
+                                 .thread_pool = TestThreadPool(),
                              }));
 
 TEST_P(ConcurrentStreamRecordReaderTest, ReadsAllRecordsExactlyOnce) {
@@ -240,6 +261,40 @@ TEST_P(ConcurrentStreamRecordReaderTest, ReadsAllRecordsExactlyOnce) {
   }
 }
 
+TEST_P(ConcurrentStreamRecordReaderTest, ReadsAllRecordsInBatches) {
+  std::string content;
+  auto writer = riegeli::RecordWriter(riegeli::StringWriter(&content),
+                                      riegeli::RecordWriterBase::Options());
+  for (int i = 0; i < 2500; i++) {
+    writer.WriteRecord(absl::StrCat(i));
+  }
+  ASSERT_TRUE(writer.Close());
+  constexpr int64_t kMaxBatchSize = 64;
+  absl::Mutex mutex;
+  std::vector<std::string> records_read;
+  auto record_reader = CreateConcurrentReader(content);
+  EXPECT_TRUE(record_reader
+                  ->ReadStreamRecordBatches(
+                      kMaxBatchSize,
+                      [&mutex, &records_read](
+                          absl::Span<const std::string_view> records) {
+                        EXPECT_LE(records.size(), kMaxBatchSize);
+                        absl::MutexLock lock(&mutex);
+                        // Records of a batch must stay valid until the end
+                        // of the callback.
+                        records_read.insert(records_read.end(),
+                                            records.begin(), records.end());
+                        return absl::OkStatus();
+                      })
+                  .ok());
+  std::vector<std::string> expected_records;
+  for (int i = 0; i < 2500; i++) {
+    expected_records.push_back(absl::StrCat(i));
+  }
+  EXPECT_THAT(records_read,
+              testing::UnorderedElementsAreArray(expected_records));
+}
+
 // Disables seeking from stringbufs.
 class NonSeekingSStreamBuf : public std::stringbuf {
  public:
@@ -48,7 +48,8 @@ class RecordBuffer {
 
 // A `ShardedRecordBuffer` buffers `DataRecordStruct` records
 // serialized as `data_loading.fbs:DataRecord` flatbuffers in
-// separate sharded streams
+// separate sharded streams. Files written from the streams should record
+// `sharding_func.version()` in their sharding metadata.
 class ShardedRecordBuffer {
  public:
   ~ShardedRecordBuffer() = default;
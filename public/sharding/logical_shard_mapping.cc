@@ -0,0 +1,78 @@
+/*
+ * Copyright 2023 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "public/sharding/logical_shard_mapping.h"
+
+#include <utility>
+
+#include "absl/status/status.h"
+#include "absl/strings/str_format.h"
+
+namespace kv_server {
+
+absl::StatusOr<LogicalShardMapping> LogicalShardMapping::Create(
+    int32_t num_logical_shards, int32_t num_physical_shards,
+    absl::Span<const ShardMappingRecordStruct> records) {
+  if (num_logical_shards <= 0 || num_physical_shards <= 0) {
+    return absl::InvalidArgumentError(absl::StrFormat(
+        "Number of logical shards %d and of physical shards %d must be "
+        "positive.",
+        num_logical_shards, num_physical_shards));
+  }
+  std::vector<int32_t> physical_shards(num_logical_shards, -1);
+  for (const ShardMappingRecordStruct& record : records) {
+    if (record.logical_shard < 0 ||
+        record.logical_shard >= num_logical_shards) {
+      return absl::InvalidArgumentError(
+          absl::StrFormat("Logical shard %d is not in [0, %d).",
+                          record.logical_shard, num_logical_shards));
+    }
+    if (record.physical_shard < 0 ||
+        record.physical_shard >= num_physical_shards) {
+      return absl::InvalidArgumentError(
+          absl::StrFormat("Physical shard %d is not in [0, %d).",
+                          record.physical_shard, num_physical_shards));
+    }
+    if (physical_shards[record.logical_shard] != -1) {
+      return absl::InvalidArgumentError(absl::StrFormat(
+          "Logical shard %d is mapped more than once.", record.logical_shard));
+    }
+    physical_shards[record.logical_shard] = record.physical_shard;
+  }
+  for (int32_t logical_shard = 0; logical_shard < num_logical_shards;
+       ++logical_shard) {
+    if (physical_shards[logical_shard] == -1) {
+      return absl::InvalidArgumentError(absl::StrFormat(
+          "Logical shard %d is not mapped to a physical shard.",
+          logical_shard));
+    }
+  }
+  return LogicalShardMapping(num_physical_shards, std::move(physical_shards));
+}
+
+std::vector<int32_t> LogicalShardMapping::GetLogicalShards(
+    int32_t physical_shard) const {
+  std::vector<int32_t> logical_shards;
+  for (int32_t logical_shard = 0; logical_shard < num_logical_shards();
+       ++logical_shard) {
+    if (physical_shards_[logical_shard] == physical_shard) {
+      logical_shards.push_back(logical_shard);
+    }
+  }
+  return logical_shards;
+}
+
+}  // namespace kv_server
@@ -0,0 +1,79 @@
+/*
+ * Copyright 2023 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PUBLIC_SHARDING_LOGICAL_SHARD_MAPPING_H_
+#define PUBLIC_SHARDING_LOGICAL_SHARD_MAPPING_H_
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "absl/status/statusor.h"
+#include "absl/types/span.h"
+#include "public/data_loading/records_utils.h"
+#include "public/sharding/sharding_function.h"
+
+namespace kv_server {
+
+// Maps logical shards to physical shards, as set by the shard mapping records
+// of a LOGICAL_SHARDING_CONFIG file.
+//
+// Data is produced for many more logical shards than there are servers, keys
+// being assigned to logical shards by the sharding function, and each
+// physical shard serves the logical shards mapped to it. Changing the number
+// of physical shards then only takes a new mapping, not new data.
+class LogicalShardMapping {
+ public:
+  // Returns InvalidArgument unless `records` map each logical shard in
+  // [0, `num_logical_shards`) to exactly one physical shard in
+  // [0, `num_physical_shards`).
+  static absl::StatusOr<LogicalShardMapping> Create(
+      int32_t num_logical_shards, int32_t num_physical_shards,
+      absl::Span<const ShardMappingRecordStruct> records);
+
+  int32_t num_logical_shards() const { return physical_shards_.size(); }
+  int32_t num_physical_shards() const { return num_physical_shards_; }
+
+  // `logical_shard` must be in [0, `num_logical_shards()`).
+  int32_t GetPhysicalShard(int32_t logical_shard) const {
+    return physical_shards_[logical_shard];
+  }
+
+  // Returns the logical shards mapped to `physical_shard`, in order.
+  std::vector<int32_t> GetLogicalShards(int32_t physical_shard) const;
+
+  // Returns the physical shard of the logical shard `sharding_function`
+  // assigns `key` to.
+  int32_t GetPhysicalShardForKey(const ShardingFunction& sharding_function,
+                                 std::string_view key) const {
+    return GetPhysicalShard(
+        sharding_function.GetShardNumForKey(key, num_logical_shards()));
+  }
+
+ private:
+  LogicalShardMapping(int32_t num_physical_shards,
+                      std::vector<int32_t> physical_shards)
+      : num_physical_shards_(num_physical_shards),
+        physical_shards_(std::move(physical_shards)) {}
+
+  int32_t num_physical_shards_;
+  // Physical shard of each logical shard.
+  std::vector<int32_t> physical_shards_;
+};
+
+}  // namespace kv_server
+
+#endif  // PUBLIC_SHARDING_LOGICAL_SHARD_MAPPING_H_
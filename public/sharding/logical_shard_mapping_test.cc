@@ -0,0 +1,84 @@
+/*
+ * Copyright 2023 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "public/sharding/logical_shard_mapping.h"
+
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace kv_server {
+namespace {
+
+using testing::ElementsAre;
+
+TEST(LogicalShardMappingTest, MapsLogicalShardsToPhysicalShards) {
+  const auto mapping = LogicalShardMapping::Create(
+      /*num_logical_shards=*/4, /*num_physical_shards=*/2,
+      {{.logical_shard = 3, .physical_shard = 0},
+       {.logical_shard = 0, .physical_shard = 1},
+       {.logical_shard = 2, .physical_shard = 1},
+       {.logical_shard = 1, .physical_shard = 0}});
+  ASSERT_TRUE(mapping.ok()) << mapping.status();
+  EXPECT_EQ(mapping->num_logical_shards(), 4);
+  EXPECT_EQ(mapping->num_physical_shards(), 2);
+  EXPECT_EQ(mapping->GetPhysicalShard(0), 1);
+  EXPECT_EQ(mapping->GetPhysicalShard(1), 0);
+  EXPECT_EQ(mapping->GetPhysicalShard(2), 1);
+  EXPECT_EQ(mapping->GetPhysicalShard(3), 0);
+  EXPECT_THAT(mapping->GetLogicalShards(0), ElementsAre(1, 3));
+  EXPECT_THAT(mapping->GetLogicalShards(1), ElementsAre(0, 2));
+}
+
+TEST(LogicalShardMappingTest, MapsKeysThroughTheirLogicalShard) {
+  std::vector<ShardMappingRecordStruct> records;
+  for (int32_t logical_shard = 0; logical_shard < 7; ++logical_shard) {
+    records.push_back({.logical_shard = logical_shard,
+                       .physical_shard = logical_shard % 3});
+  }
+  const auto mapping = LogicalShardMapping::Create(7, 3, records);
+  ASSERT_TRUE(mapping.ok()) << mapping.status();
+  ShardingFunction sharding_function("");
+  for (const auto key : {"key1", "key2", "key3"}) {
+    EXPECT_EQ(mapping->GetPhysicalShardForKey(sharding_function, key),
+              sharding_function.GetShardNumForKey(key, 7) % 3);
+  }
+}
+
+TEST(LogicalShardMappingTest, RejectsInvalidMappings) {
+  // A logical shard isn't mapped.
+  EXPECT_FALSE(LogicalShardMapping::Create(
+                   2, 2, {{.logical_shard = 0, .physical_shard = 0}})
+                   .ok());
+  // A logical shard is mapped twice.
+  EXPECT_FALSE(LogicalShardMapping::Create(
+                   1, 2,
+                   {{.logical_shard = 0, .physical_shard = 0},
+                    {.logical_shard = 0, .physical_shard = 1}})
+                   .ok());
+  // Shards out of range.
+  EXPECT_FALSE(LogicalShardMapping::Create(
+                   1, 2, {{.logical_shard = 1, .physical_shard = 0}})
+                   .ok());
+  EXPECT_FALSE(LogicalShardMapping::Create(
+                   1, 2, {{.logical_shard = 0, .physical_shard = 2}})
+                   .ok());
+  EXPECT_FALSE(LogicalShardMapping::Create(0, 2, {}).ok());
+}
+
+}  // namespace
+}  // namespace kv_server
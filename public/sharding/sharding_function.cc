@@ -16,14 +16,64 @@
 
 #include "public/sharding/sharding_function.h"
 
+#include <algorithm>
+#include <iterator>
+
+#include "absl/numeric/int128.h"
+#include "highwayhash/instruction_sets.h"
+
 namespace kv_server {
+namespace {
+
+using highwayhash::HHKey;
+using highwayhash::HHResult256;
+using highwayhash::HHResult64;
+using highwayhash::HighwayHash;
+using highwayhash::InstructionSets;
+
+// Key the seed is hashed with into the key of the keys' hashes. Changing it
+// reassigns every key.
+HH_ALIGNAS(32)
+constexpr HHKey kSeedKey = {
+    0x6b76736861726431,
+    0x6b76736861726432,
+    0x6b76736861726433,
+    0x6b76736861726434,
+};
 
-ShardingFunction::ShardingFunction(std::string seed)
-    : hash_function_(std::move(seed)) {}
+}  // namespace
+
+ShardingFunctionVersion::Enum ResolveShardingFunctionVersion(
+    ShardingFunctionVersion::Enum version) {
+  if (version ==
+      ShardingFunctionVersion::SHARDING_FUNCTION_VERSION_UNSPECIFIED) {
+    return ShardingFunctionVersion::SHA256;
+  }
+  return version;
+}
+
+ShardingFunction::ShardingFunction(std::string seed,
+                                   ShardingFunctionVersion::Enum version)
+    : version_(ResolveShardingFunctionVersion(version)),
+      hash_function_(seed) {
+  HHResult256 seed_hash;
+  InstructionSets::Run<HighwayHash>(kSeedKey, seed.data(), seed.size(),
+                                    &seed_hash);
+  std::copy(std::begin(seed_hash), std::end(seed_hash),
+            std::begin(highwayhash_key_));
+}
 
 int ShardingFunction::GetShardNumForKey(std::string_view key,
                                         int num_shards) const {
-  return hash_function_(key, num_shards);
+  if (version_ != ShardingFunctionVersion::HIGHWAYHASH) {
+    return hash_function_(key, num_shards);
+  }
+  HHResult64 hash;
+  InstructionSets::Run<HighwayHash>(highwayhash_key_, key.data(), key.size(),
+                                    &hash);
+  // Scales the hash down to [0, num_shards), which is as uniform as the
+  // hash's high bits and cheaper than a modulo.
+  return absl::Uint128High64(absl::uint128(hash) * num_shards);
 }
 
 }  // namespace kv_server
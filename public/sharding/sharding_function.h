@@ -20,19 +20,35 @@
 #include <string>
 #include <string_view>
 
+#include "highwayhash/highwayhash_target.h"
 #include "pir/hashing/sha256_hash_family.h"
+#include "public/data_loading/riegeli_metadata.pb.h"
 
 namespace kv_server {
 
+// Returns the function `version` stands for, SHA256 if it's unspecified.
+ShardingFunctionVersion::Enum ResolveShardingFunctionVersion(
+    ShardingFunctionVersion::Enum version);
+
 // Sharding function to assign different keys to shard numbers within the range
-// [0, `num_shards`).
+// [0, `num_shards`). Keys are assigned to the same shards as long as the seed
+// and the version are the same, across processes and machines.
 class ShardingFunction {
  public:
-  explicit ShardingFunction(std::string seed);
+  explicit ShardingFunction(
+      std::string seed,
+      ShardingFunctionVersion::Enum version =
+          ShardingFunctionVersion::SHARDING_FUNCTION_VERSION_UNSPECIFIED);
   int GetShardNumForKey(std::string_view key, int num_shards) const;
 
+  // Never unspecified.
+  ShardingFunctionVersion::Enum version() const { return version_; }
+
  private:
+  ShardingFunctionVersion::Enum version_;
   distributed_point_functions::SHA256HashFunction hash_function_;
+  // Derived from the seed, for HIGHWAYHASH.
+  HH_ALIGNAS(32) highwayhash::HHKey highwayhash_key_;
 };
 
 }  // namespace kv_server
@@ -16,6 +16,10 @@
 
 #include "public/sharding/sharding_function.h"
 
+#include <string>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
 #include "gtest/gtest.h"
 
 namespace kv_server {
@@ -28,5 +32,53 @@ TEST(ShardingFunctionTest, VerifyAssigningKeysToShards) {
   EXPECT_EQ(1, func.GetShardNumForKey("key3", 7));
 }
 
+TEST(ShardingFunctionTest, UnspecifiedVersionIsSha256) {
+  ShardingFunction unspecified("");
+  ShardingFunction sha256("", ShardingFunctionVersion::SHA256);
+  EXPECT_EQ(unspecified.version(), ShardingFunctionVersion::SHA256);
+  for (int i = 0; i < 100; ++i) {
+    const std::string key = absl::StrCat("key", i);
+    EXPECT_EQ(unspecified.GetShardNumForKey(key, 7),
+              sha256.GetShardNumForKey(key, 7));
+  }
+}
+
+TEST(ShardingFunctionTest, HighwayHashAssignsKeysUniformly) {
+  ShardingFunction func("", ShardingFunctionVersion::HIGHWAYHASH);
+  EXPECT_EQ(func.version(), ShardingFunctionVersion::HIGHWAYHASH);
+  constexpr int kNumShards = 16;
+  constexpr int kKeysPerShard = 10000;
+  std::vector<int> num_keys(kNumShards);
+  for (int i = 0; i < kNumShards * kKeysPerShard; ++i) {
+    const int shard_num =
+        func.GetShardNumForKey(absl::StrCat("key", i), kNumShards);
+    ASSERT_GE(shard_num, 0);
+    ASSERT_LT(shard_num, kNumShards);
+    ++num_keys[shard_num];
+  }
+  for (int shard_num = 0; shard_num < kNumShards; ++shard_num) {
+    // About 5 standard deviations.
+    EXPECT_NEAR(num_keys[shard_num], kKeysPerShard, kKeysPerShard / 20)
+        << "shard " << shard_num;
+  }
+}
+
+TEST(ShardingFunctionTest, HighwayHashDependsOnSeed) {
+  ShardingFunction func1("seed1", ShardingFunctionVersion::HIGHWAYHASH);
+  ShardingFunction func2("seed2", ShardingFunctionVersion::HIGHWAYHASH);
+  ShardingFunction same_as_func1("seed1",
+                                 ShardingFunctionVersion::HIGHWAYHASH);
+  int num_reassigned = 0;
+  for (int i = 0; i < 100; ++i) {
+    const std::string key = absl::StrCat("key", i);
+    EXPECT_EQ(func1.GetShardNumForKey(key, 7),
+              same_as_func1.GetShardNumForKey(key, 7));
+    if (func1.GetShardNumForKey(key, 7) != func2.GetShardNumForKey(key, 7)) {
+      ++num_reassigned;
+    }
+  }
+  EXPECT_GT(num_reassigned, 50);
+}
+
 }  // namespace
 }  // namespace kv_server